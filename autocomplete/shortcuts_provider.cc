@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <cmath>
 #include <map>
+#include <set>
 #include <vector>
 
 #include "base/i18n/break_iterator.h"
@@ -48,6 +49,28 @@ class DestinationURLEqualsURL {
   const GURL url_;
 };
 
+// A shortcut matching the input, with its score.
+struct ScoredShortcut {
+  ScoredShortcut(int relevance,
+                 const history::ShortcutsDatabase::Shortcut* shortcut)
+      : relevance(relevance),
+        shortcut(shortcut) {
+  }
+
+  int relevance;
+  const history::ShortcutsDatabase::Shortcut* shortcut;
+};
+
+// Orders scored shortcuts the way AutocompleteMatch::MoreRelevant() orders
+// the matches built from them.
+bool MoreRelevantShortcut(const ScoredShortcut& elem1,
+                          const ScoredShortcut& elem2) {
+  return (elem1.relevance == elem2.relevance) ?
+      (elem1.shortcut->match_core.contents <
+       elem2.shortcut->match_core.contents) :
+      (elem1.relevance > elem2.relevance);
+}
+
 }  // namespace
 
 const int ShortcutsProvider::kShortcutsProviderDefaultMaxRelevance = 1199;
@@ -149,18 +172,45 @@ void ShortcutsProvider::GetMatches(const AutocompleteInput& input) {
       input.current_page_classification(), &max_relevance))
     max_relevance = kShortcutsProviderDefaultMaxRelevance;
 
+  // Scoring a shortcut is much cheaper than building a match for it, and a
+  // short input can match thousands of shortcuts, so score them all first.
+  std::vector<ScoredShortcut> scored_shortcuts;
   for (ShortcutsBackend::ShortcutMap::const_iterator it =
            FindFirstMatch(term_string, backend.get());
        it != backend->shortcuts_map().end() &&
            StartsWith(it->first, term_string, true); ++it) {
     // Don't return shortcuts with zero relevance.
     int relevance = CalculateScore(term_string, it->second, max_relevance);
-    if (relevance) {
-      matches_.push_back(ShortcutToACMatch(it->second, relevance, input,
-                                           fixed_up_input, input_as_gurl));
-      matches_.back().ComputeStrippedDestinationURL(profile_);
-    }
+    if (relevance)
+      scored_shortcuts.push_back(ScoredShortcut(relevance, &it->second));
   }
+  std::sort(scored_shortcuts.begin(), scored_shortcuts.end(),
+            &MoreRelevantShortcut);
+
+  // Then build matches, most relevant first, until there are kMaxMatches
+  // distinct destinations; the less relevant duplicates of those would be
+  // removed below anyway.  When matches are demoted by type, a less relevant
+  // duplicate may be the one kept, so all the matches are built.
+  OmniboxFieldTrial::DemotionMultipliers demotions;
+  OmniboxFieldTrial::GetDemotionsByType(input.current_page_classification(),
+                                        &demotions);
+  std::set<GURL> destinations;
+  size_t num_destinations = 0;
+  for (std::vector<ScoredShortcut>::const_iterator it(
+           scored_shortcuts.begin());
+       (it != scored_shortcuts.end()) &&
+           (!demotions.empty() ||
+            (num_destinations < AutocompleteProvider::kMaxMatches));
+       ++it) {
+    matches_.push_back(ShortcutToACMatch(*it->shortcut, it->relevance, input,
+                                         fixed_up_input, input_as_gurl));
+    matches_.back().ComputeStrippedDestinationURL(profile_);
+    // Matches without a stripped destination are never duplicates.
+    const GURL& stripped_url = matches_.back().stripped_destination_url;
+    if (stripped_url.is_empty() || destinations.insert(stripped_url).second)
+      ++num_destinations;
+  }
+
   // Remove duplicates.  Duplicates don't need to be preserved in the matches
   // because they are only used for deletions, and shortcuts deletes matches
   // based on the URL.
@@ -175,6 +225,18 @@ void ShortcutsProvider::GetMatches(const AutocompleteInput& input) {
     matches_.erase(matches_.begin() + AutocompleteProvider::kMaxMatches,
                    matches_.end());
   }
+  // Mark the pieces of the contents and description of the remaining matches
+  // that appear in the input.
+  WordMap terms_map(CreateWordMapForString(term_string));
+  if (!terms_map.empty()) {
+    for (ACMatches::iterator it = matches_.begin(); it != matches_.end();
+         ++it) {
+      it->contents_class = ClassifyAllMatchesInString(term_string, terms_map,
+          it->contents, it->contents_class);
+      it->description_class = ClassifyAllMatchesInString(term_string,
+          terms_map, it->description, it->description_class);
+    }
+  }
   // Guarantee that all scores are decreasing (but do not assign any scores
   // below 1).
   for (ACMatches::iterator it = matches_.begin(); it != matches_.end(); ++it) {
@@ -251,17 +313,6 @@ AutocompleteMatch ShortcutsProvider::ShortcutToACMatch(
                                std::string()));
     }
   }
-
-  // Try to mark pieces of the contents and description as matches if they
-  // appear in |input.text()|.
-  const base::string16 term_string = base::i18n::ToLower(input.text());
-  WordMap terms_map(CreateWordMapForString(term_string));
-  if (!terms_map.empty()) {
-    match.contents_class = ClassifyAllMatchesInString(term_string, terms_map,
-        match.contents, match.contents_class);
-    match.description_class = ClassifyAllMatchesInString(term_string, terms_map,
-        match.description, match.description_class);
-  }
   return match;
 }
 
@@ -49,10 +49,10 @@ class ShortcutsProvider
   void GetMatches(const AutocompleteInput& input);
 
   // Returns an AutocompleteMatch corresponding to |shortcut|. Assigns it
-  // |relevance| score in the process, and highlights the description and
-  // contents against |input|, which should be the lower-cased version
-  // of the user's input. |input|, |fixed_up_input_text|, and
-  // |input_as_gurl| are used to decide what can be inlined.
+  // |relevance| score in the process. |input|, |fixed_up_input_text|, and
+  // |input_as_gurl| are used to decide what can be inlined.  The description
+  // and contents are not highlighted against |input|; GetMatches() only does
+  // that for the matches it keeps.
   AutocompleteMatch ShortcutToACMatch(
       const history::ShortcutsDatabase::Shortcut& shortcut,
       int relevance,
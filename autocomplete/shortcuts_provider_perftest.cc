@@ -0,0 +1,139 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include "base/memory/ref_counted.h"
+#include "base/message_loop/message_loop.h"
+#include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
+#include "chrome/browser/autocomplete/autocomplete_input.h"
+#include "chrome/browser/autocomplete/autocomplete_match.h"
+#include "chrome/browser/autocomplete/autocomplete_provider_listener.h"
+#include "chrome/browser/autocomplete/shortcuts_backend.h"
+#include "chrome/browser/autocomplete/shortcuts_backend_factory.h"
+#include "chrome/browser/autocomplete/shortcuts_provider.h"
+#include "chrome/browser/test/base/synthetic_random.h"
+#include "chrome/test/base/testing_profile.h"
+#include "components/metrics/proto/omnibox_event.pb.h"
+#include "content/public/test/test_browser_thread.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+namespace {
+
+const size_t kShortcutCount = 50 * 1000;
+const size_t kShortcutsPerDestination = 3;
+const size_t kTypedQueryCount = 500;
+
+// Returns a word of 4 to 10 lowercase letters.
+std::string RandomWord(SyntheticRandom* random) {
+  std::string word(4 + random->Next() % 7, 'a');
+  for (size_t i = 0; i < word.length(); ++i)
+    word[i] += random->Next() % 26;
+  return word;
+}
+
+}  // namespace
+
+class ShortcutsProviderPerfTest : public testing::Test,
+                                  public AutocompleteProviderListener {
+ public:
+  ShortcutsProviderPerfTest()
+      : ui_thread_(content::BrowserThread::UI, &message_loop_),
+        file_thread_(content::BrowserThread::FILE, &message_loop_) {
+  }
+
+  // AutocompleteProviderListener:
+  virtual void OnProviderUpdate(bool updated_matches) OVERRIDE {}
+
+  virtual void SetUp() OVERRIDE {
+    ShortcutsBackendFactory::GetInstance()->SetTestingFactoryAndUse(
+        &profile_, &ShortcutsBackendFactory::BuildProfileNoDatabaseForTesting);
+    backend_ = ShortcutsBackendFactory::GetForProfile(&profile_);
+    ASSERT_TRUE(backend_.get());
+    provider_ = new ShortcutsProvider(this, &profile_);
+  }
+
+  virtual void TearDown() OVERRIDE {
+    message_loop_.RunUntilIdle();
+    provider_ = NULL;
+  }
+
+ protected:
+  // Adds shortcuts for kShortcutCount / kShortcutsPerDestination pages, each
+  // reached from a few different prefixes of a word of its title.  Returns
+  // the words.
+  std::vector<std::string> AddShortcuts() {
+    SyntheticRandom random;
+    std::vector<std::string> words;
+    while (backend_->shortcuts_map().size() < kShortcutCount) {
+      const std::string word = RandomWord(&random);
+      words.push_back(word);
+      AutocompleteMatch match;
+      match.type = AutocompleteMatchType::HISTORY_TITLE;
+      match.destination_url = GURL(base::StringPrintf(
+          "http://www.%s.com/%u", word.c_str(),
+          static_cast<unsigned>(words.size())));
+      match.fill_into_edit = base::ASCIIToUTF16(
+          match.destination_url.host() + match.destination_url.path());
+      match.contents = match.fill_into_edit;
+      match.contents_class.push_back(
+          ACMatchClassification(0, ACMatchClassification::URL));
+      match.description = base::ASCIIToUTF16("The " + word + " page");
+      match.description_class.push_back(
+          ACMatchClassification(0, ACMatchClassification::NONE));
+      // AddOrUpdateShortcut() updates a shortcut to the same destination
+      // whose text starts with the new one's, so add the shortest first.
+      for (size_t i = kShortcutsPerDestination; i > 0; --i) {
+        backend_->AddOrUpdateShortcut(
+            base::ASCIIToUTF16(word.substr(0, word.length() + 1 - i)), match);
+      }
+    }
+    return words;
+  }
+
+  base::MessageLoopForUI message_loop_;
+  content::TestBrowserThread ui_thread_;
+  content::TestBrowserThread file_thread_;
+
+  TestingProfile profile_;
+
+  scoped_refptr<ShortcutsBackend> backend_;
+  scoped_refptr<ShortcutsProvider> provider_;
+};
+
+// Replays typing queries a character at a time, as the omnibox does.
+TEST_F(ShortcutsProviderPerfTest, KeystrokeReplay) {
+  const std::vector<std::string> words = AddShortcuts();
+  EXPECT_LE(kShortcutCount, backend_->shortcuts_map().size());
+
+  SyntheticRandom random;
+  std::vector<base::string16> keystrokes;
+  for (size_t i = 0; i < kTypedQueryCount; ++i) {
+    const std::string& word = words[random.Next() % words.size()];
+    for (size_t j = 1; j <= word.length(); ++j)
+      keystrokes.push_back(base::ASCIIToUTF16(word.substr(0, j)));
+  }
+
+  size_t num_matches = 0;
+  const base::TimeTicks start = base::TimeTicks::HighResNow();
+  for (size_t i = 0; i < keystrokes.size(); ++i) {
+    AutocompleteInput input(keystrokes[i], base::string16::npos,
+                            base::string16(), GURL(),
+                            metrics::OmniboxEventProto::INVALID_SPEC, false,
+                            false, true, true, &profile_);
+    provider_->Start(input, false);
+    num_matches += provider_->matches().size();
+  }
+  const base::TimeDelta elapsed = base::TimeTicks::HighResNow() - start;
+
+  EXPECT_LT(0u, num_matches);
+  perf_test::PrintResult("shortcuts_provider_keystroke", "", "50k_shortcuts",
+                         elapsed.InMicroseconds() /
+                             static_cast<double>(keystrokes.size()),
+                         "us/keystroke", true);
+}
@@ -580,6 +580,59 @@ TEST_F(ShortcutsProviderTest, RemoveDuplicates) {
           ASCIIToUTF16("icate.com"));
 }
 
+TEST_F(ShortcutsProviderTest, DuplicatesOfMoreRelevantMatches) {
+  // Shorter shortcut texts score higher, so the duplicates of the two most
+  // relevant destinations are more relevant than the third destination.
+  TestShortcutInfo dedupe_db[] = {
+    { "BD85DBA2-8C29-49F9-84AE-48E1E9088100", "dedupeA", "dedupea.com",
+      "http://dedupea.com/", "dedupea.com", "0,1", "Dedupe A", "0,0",
+      content::PAGE_TRANSITION_TYPED, AutocompleteMatchType::HISTORY_URL, "",
+      0, 1 },
+    { "BD85DBA2-8C29-49F9-84AE-48E1E9088101", "dedupeAA", "dedupea.com",
+      "http://dedupea.com/", "dedupea.com", "0,1", "Dedupe A", "0,0",
+      content::PAGE_TRANSITION_TYPED, AutocompleteMatchType::HISTORY_URL, "",
+      0, 1 },
+    { "BD85DBA2-8C29-49F9-84AE-48E1E9088102", "dedupeBBB", "dedupeb.com",
+      "http://dedupeb.com/", "dedupeb.com", "0,1", "Dedupe B", "0,0",
+      content::PAGE_TRANSITION_TYPED, AutocompleteMatchType::HISTORY_URL, "",
+      0, 1 },
+    { "BD85DBA2-8C29-49F9-84AE-48E1E9088103", "dedupeBBBB", "dedupeb.com",
+      "http://dedupeb.com/", "dedupeb.com", "0,1", "Dedupe B", "0,0",
+      content::PAGE_TRANSITION_TYPED, AutocompleteMatchType::HISTORY_URL, "",
+      0, 1 },
+    { "BD85DBA2-8C29-49F9-84AE-48E1E9088104", "dedupeCCCCC", "dedupec.com",
+      "http://dedupec.com/", "dedupec.com", "0,1", "Dedupe C", "0,0",
+      content::PAGE_TRANSITION_TYPED, AutocompleteMatchType::HISTORY_URL, "",
+      0, 1 },
+    { "BD85DBA2-8C29-49F9-84AE-48E1E9088105", "dedupeDDDDDD", "deduped.com",
+      "http://deduped.com/", "deduped.com", "0,1", "Dedupe D", "0,0",
+      content::PAGE_TRANSITION_TYPED, AutocompleteMatchType::HISTORY_URL, "",
+      0, 1 },
+  };
+  FillData(dedupe_db, arraysize(dedupe_db));
+
+  base::string16 text(ASCIIToUTF16("dedupe"));
+  ExpectedURLs expected_urls;
+  expected_urls.push_back(ExpectedURLAndAllowedToBeDefault(
+      "http://dedupea.com/", true));
+  expected_urls.push_back(ExpectedURLAndAllowedToBeDefault(
+      "http://dedupeb.com/", true));
+  expected_urls.push_back(ExpectedURLAndAllowedToBeDefault(
+      "http://dedupec.com/", true));
+  RunTest(text, false, expected_urls, "http://dedupea.com/",
+          ASCIIToUTF16("a.com"));
+
+  // The matches kept are highlighted against the input.
+  for (ACMatches::const_iterator it = ac_matches_.begin();
+       it != ac_matches_.end(); ++it) {
+    ASSERT_FALSE(it->contents_class.empty());
+    EXPECT_EQ(ACMatchClassification::URL | ACMatchClassification::MATCH,
+              it->contents_class[0].style);
+    ASSERT_FALSE(it->description_class.empty());
+    EXPECT_EQ(ACMatchClassification::MATCH, it->description_class[0].style);
+  }
+}
+
 TEST_F(ShortcutsProviderTest, TypedCountMatches) {
   base::string16 text(ASCIIToUTF16("just"));
   ExpectedURLs expected_urls;
@@ -8,10 +8,13 @@
 #include <vector>
 
 #include "base/basictypes.h"
+#include "base/bind.h"
 #include "base/file_util.h"
 #include "base/files/file_path.h"
 #include "base/json/json_file_value_serializer.h"
 #include "base/memory/weak_ptr.h"
+#include "base/metrics/histogram.h"
+#include "base/threading/sequenced_worker_pool.h"
 #include "base/values.h"
 #include "chrome/browser/component_updater/component_patcher_operation.h"
 #include "chrome/browser/component_updater/component_updater_service.h"
@@ -37,8 +40,33 @@ base::ListValue* ReadCommands(const base::FilePath& unpack_path) {
              : NULL;
 }
 
+// Returns the files in the unpack and input directories which the operation
+// of |command_args| writes or consumes. Operations which share any of them
+// must not run at the same time.
+std::vector<base::FilePath> GetCommandPaths(
+    const base::DictionaryValue& command_args,
+    const base::FilePath& input_dir,
+    const base::FilePath& unpack_dir) {
+  std::vector<base::FilePath> paths;
+  std::string output_rel_path;
+  if (command_args.GetString("output", &output_rel_path)) {
+    paths.push_back(
+        unpack_dir.Append(base::FilePath::FromUTF8Unsafe(output_rel_path)));
+  }
+  std::string patch_rel_path;
+  if (command_args.GetString("patch", &patch_rel_path)) {
+    paths.push_back(
+        input_dir.Append(base::FilePath::FromUTF8Unsafe(patch_rel_path)));
+  }
+  return paths;
+}
+
 }  // namespace
 
+// The operations are disk bound, and out-of-process operations each start a
+// utility process, so this is kept small.
+const size_t ComponentPatcher::kMaxParallelOperations = 4;
+
 ComponentPatcher::ComponentPatcher(
     const base::FilePath& input_dir,
     const base::FilePath& unpack_dir,
@@ -49,6 +77,11 @@ ComponentPatcher::ComponentPatcher(
       unpack_dir_(unpack_dir),
       installer_(installer),
       in_process_(in_process),
+      next_command_(0),
+      max_parallel_operations_(kMaxParallelOperations),
+      operations_in_flight_(0),
+      error_(ComponentUnpacker::kNone),
+      extended_error_(0),
       task_runner_(task_runner) {
 }
 
@@ -62,55 +95,106 @@ void ComponentPatcher::Start(const ComponentUnpacker::Callback& callback) {
                                     scoped_refptr<ComponentPatcher>(this)));
 }
 
+void ComponentPatcher::SetMaxParallelOperationsForTesting(
+    size_t max_parallel_operations) {
+  DCHECK_GT(max_parallel_operations, 0U);
+  max_parallel_operations_ = max_parallel_operations;
+}
+
 void ComponentPatcher::StartPatching() {
+  start_time_ = base::TimeTicks::Now();
   commands_.reset(ReadCommands(input_dir_));
   if (!commands_.get()) {
     DonePatching(ComponentUnpacker::kDeltaBadCommands, 0);
   } else {
-    next_command_ = commands_->begin();
-    PatchNextFile();
+    next_command_ = 0;
+    PatchNextFiles();
   }
 }
 
-void ComponentPatcher::PatchNextFile() {
-  if (next_command_ == commands_->end()) {
-    DonePatching(ComponentUnpacker::kNone, 0);
-    return;
-  }
-  if (!(*next_command_)->IsType(base::Value::TYPE_DICTIONARY)) {
-    DonePatching(ComponentUnpacker::kDeltaBadCommands, 0);
-    return;
+void ComponentPatcher::PatchNextFiles() {
+  while (error_ == ComponentUnpacker::kNone &&
+         operations_in_flight_ < max_parallel_operations_ &&
+         next_command_ < commands_->GetSize()) {
+    const base::DictionaryValue* command_args = NULL;
+    if (!commands_->GetDictionary(next_command_, &command_args)) {
+      error_ = ComponentUnpacker::kDeltaBadCommands;
+      break;
+    }
+    const std::vector<base::FilePath> paths =
+        GetCommandPaths(*command_args, input_dir_, unpack_dir_);
+    bool conflicts = false;
+    for (size_t i = 0; i < paths.size(); ++i)
+      conflicts |= paths_in_flight_.count(paths[i]) > 0;
+    if (conflicts)
+      break;  // Resumes when the conflicting operation is done.
+
+    scoped_refptr<DeltaUpdateOp> operation = CreateDeltaUpdateOp(*command_args);
+    if (!operation) {
+      error_ = ComponentUnpacker::kDeltaUnsupportedCommand;
+      break;
+    }
+    if (!content::BrowserThread::GetBlockingPool()->
+            PostWorkerTaskWithShutdownBehavior(
+                FROM_HERE,
+                base::Bind(&ComponentPatcher::RunOperation,
+                           scoped_refptr<ComponentPatcher>(this),
+                           operation,
+                           command_args,
+                           paths),
+                base::SequencedWorkerPool::SKIP_ON_SHUTDOWN)) {
+      error_ = ComponentUnpacker::kDeltaOperationFailure;
+      break;
+    }
+    paths_in_flight_.insert(paths.begin(), paths.end());
+    ++operations_in_flight_;
+    ++next_command_;
   }
-  const base::DictionaryValue* command_args =
-      static_cast<base::DictionaryValue*>(*next_command_);
-  current_operation_ = CreateDeltaUpdateOp(*command_args);
-  if (!current_operation_) {
-    DonePatching(ComponentUnpacker::kDeltaUnsupportedCommand, 0);
+
+  if (operations_in_flight_ > 0)
     return;
+  if (error_ == ComponentUnpacker::kNone) {
+    if (next_command_ < commands_->GetSize())
+      return;
+    UMA_HISTOGRAM_TIMES("ComponentUpdater.DeltaPatchTime",
+                        base::TimeTicks::Now() - start_time_);
   }
-  current_operation_->Run(command_args,
-                          input_dir_,
-                          unpack_dir_,
-                          installer_,
-                          in_process_,
-                          base::Bind(&ComponentPatcher::DonePatchingFile,
-                                     scoped_refptr<ComponentPatcher>(this)),
-                          task_runner_);
+  DonePatching(error_, extended_error_);
 }
 
-void ComponentPatcher::DonePatchingFile(ComponentUnpacker::Error error,
-                                        int extended_error) {
-  if (error != ComponentUnpacker::kNone) {
-    DonePatching(error, extended_error);
-  } else {
-    ++next_command_;
-    PatchNextFile();
+void ComponentPatcher::RunOperation(
+    scoped_refptr<DeltaUpdateOp> operation,
+    const base::DictionaryValue* command_args,
+    const std::vector<base::FilePath>& paths) {
+  operation->Run(command_args,
+                 input_dir_,
+                 unpack_dir_,
+                 installer_,
+                 in_process_,
+                 base::Bind(&ComponentPatcher::DonePatchingFile,
+                            scoped_refptr<ComponentPatcher>(this),
+                            paths),
+                 task_runner_);
+}
+
+void ComponentPatcher::DonePatchingFile(
+    const std::vector<base::FilePath>& paths,
+    ComponentUnpacker::Error error,
+    int extended_error) {
+  DCHECK_GT(operations_in_flight_, 0U);
+  --operations_in_flight_;
+  for (size_t i = 0; i < paths.size(); ++i)
+    paths_in_flight_.erase(paths[i]);
+  if (error != ComponentUnpacker::kNone &&
+      error_ == ComponentUnpacker::kNone) {
+    error_ = error;
+    extended_error_ = extended_error;
   }
+  PatchNextFiles();
 }
 
 void ComponentPatcher::DonePatching(ComponentUnpacker::Error error,
                                     int extended_error) {
-  current_operation_ = NULL;
   task_runner_->PostTask(FROM_HERE,
                          base::Bind(callback_, error, extended_error));
   callback_.Reset();
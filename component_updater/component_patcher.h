@@ -27,15 +27,16 @@
 #ifndef CHROME_BROWSER_COMPONENT_UPDATER_COMPONENT_PATCHER_H_
 #define CHROME_BROWSER_COMPONENT_UPDATER_COMPONENT_PATCHER_H_
 
+#include <set>
+#include <vector>
+
 #include "base/callback_forward.h"
+#include "base/files/file_path.h"
 #include "base/memory/ref_counted.h"
+#include "base/time/time.h"
 #include "base/values.h"
 #include "chrome/browser/component_updater/component_unpacker.h"
 
-namespace base {
-class FilePath;
-}
-
 namespace component_updater {
 
 class ComponentInstaller;
@@ -49,8 +50,21 @@ enum PatchType {
 };
 
 // Encapsulates a task for applying a differential update to a component.
+//
+// The operations of the commands file are independent of each other unless
+// they write the same output file or consume the same patch file, so they are
+// run on the blocking pool, up to a few at a time, in the order of the
+// commands file. A command which touches a file used by an operation still in
+// flight waits for the operations in flight to finish. Once an operation
+// fails no more are started, and the patcher reports the first error as soon
+// as the operations in flight are done, so that the unpacker does not delete
+// the directories they are writing to.
 class ComponentPatcher : public base::RefCountedThreadSafe<ComponentPatcher> {
  public:
+  // The number of operations which may run at the same time, unless set
+  // otherwise for testing.
+  static const size_t kMaxParallelOperations;
+
   // Takes an unpacked differential CRX (|input_dir|) and a component installer,
   // and sets up the class to create a new (non-differential) unpacked CRX.
   // If |in_process| is true, patching will be done completely within the
@@ -68,6 +82,9 @@ class ComponentPatcher : public base::RefCountedThreadSafe<ComponentPatcher> {
   // encountered.
   void Start(const ComponentUnpacker::Callback& callback);
 
+  // Sets the number of operations which may run at the same time.
+  void SetMaxParallelOperationsForTesting(size_t max_parallel_operations);
+
  private:
   friend class base::RefCountedThreadSafe<ComponentPatcher>;
 
@@ -75,9 +92,20 @@ class ComponentPatcher : public base::RefCountedThreadSafe<ComponentPatcher> {
 
   void StartPatching();
 
-  void PatchNextFile();
+  // Starts the next operations of the commands file, as long as they do not
+  // conflict with the operations in flight, and reports the result once every
+  // operation has run or one of them failed.
+  void PatchNextFiles();
+
+  // Runs |operation| for |command_args| on a blocking pool thread.
+  void RunOperation(scoped_refptr<DeltaUpdateOp> operation,
+                    const base::DictionaryValue* command_args,
+                    const std::vector<base::FilePath>& paths);
 
-  void DonePatchingFile(ComponentUnpacker::Error error, int extended_error);
+  // Called on |task_runner_| when the operation which uses |paths| is done.
+  void DonePatchingFile(const std::vector<base::FilePath>& paths,
+                        ComponentUnpacker::Error error,
+                        int extended_error);
 
   void DonePatching(ComponentUnpacker::Error error, int extended_error);
 
@@ -87,8 +115,15 @@ class ComponentPatcher : public base::RefCountedThreadSafe<ComponentPatcher> {
   const bool in_process_;
   ComponentUnpacker::Callback callback_;
   scoped_ptr<base::ListValue> commands_;
-  base::ValueVector::const_iterator next_command_;
-  scoped_refptr<DeltaUpdateOp> current_operation_;
+  size_t next_command_;
+  size_t max_parallel_operations_;
+  size_t operations_in_flight_;
+  // The output and patch files of the operations in flight.
+  std::set<base::FilePath> paths_in_flight_;
+  // The first error reported by an operation.
+  ComponentUnpacker::Error error_;
+  int extended_error_;
+  base::TimeTicks start_time_;
   scoped_refptr<base::SequencedTaskRunner> task_runner_;
 
   DISALLOW_COPY_AND_ASSIGN(ComponentPatcher);
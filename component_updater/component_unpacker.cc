@@ -14,6 +14,7 @@
 #include "base/json/json_file_value_serializer.h"
 #include "base/location.h"
 #include "base/logging.h"
+#include "base/metrics/histogram.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/stringprintf.h"
 #include "base/values.h"
@@ -111,6 +112,7 @@ ComponentUnpacker::ComponentUnpacker(
       in_process_(in_process),
       error_(kNone),
       extended_error_(0),
+      max_parallel_operations_(0),
       task_runner_(task_runner) {
 }
 
@@ -140,10 +142,17 @@ bool ComponentUnpacker::UnpackInternal() {
 
 void ComponentUnpacker::Unpack(const Callback& callback) {
   callback_ = callback;
+  start_time_ = base::TimeTicks::Now();
   if (!UnpackInternal())
     Finish();
 }
 
+void ComponentUnpacker::SetMaxParallelOperationsForTesting(
+    size_t max_parallel_operations) {
+  DCHECK_GT(max_parallel_operations, 0U);
+  max_parallel_operations_ = max_parallel_operations;
+}
+
 bool ComponentUnpacker::Verify() {
   VLOG(1) << "Verifying component: " << path_.value();
   if (pk_hash_.empty() || path_.empty()) {
@@ -213,6 +222,10 @@ bool ComponentUnpacker::BeginPatching() {
                                     installer_,
                                     in_process_,
                                     task_runner_);
+    if (max_parallel_operations_) {
+      patcher_->SetMaxParallelOperationsForTesting(
+          max_parallel_operations_);
+    }
     task_runner_->PostTask(
         FROM_HERE,
         base::Bind(&ComponentPatcher::Start,
@@ -274,6 +287,13 @@ void ComponentUnpacker::Finish() {
     base::DeleteFile(unpack_diff_path_, true);
   if (!unpack_path_.empty())
     base::DeleteFile(unpack_path_, true);
+  if (error_ == kNone) {
+    const base::TimeDelta elapsed = base::TimeTicks::Now() - start_time_;
+    if (is_delta_)
+      UMA_HISTOGRAM_TIMES("ComponentUpdater.DeltaUnpackTime", elapsed);
+    else
+      UMA_HISTOGRAM_TIMES("ComponentUpdater.UnpackTime", elapsed);
+  }
   callback_.Run(error_, extended_error_);
 }
 
@@ -15,6 +15,7 @@
 #include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/sequenced_task_runner.h"
+#include "base/time/time.h"
 
 namespace component_updater {
 
@@ -104,6 +105,10 @@ class ComponentUnpacker : public base::RefCountedThreadSafe<ComponentUnpacker> {
   // package is a differential update. Calls |callback| with the result.
   void Unpack(const Callback& callback);
 
+  // Sets the number of delta update operations the patcher may run at the
+  // same time. Must be called before Unpack().
+  void SetMaxParallelOperationsForTesting(size_t max_parallel_operations);
+
  private:
   friend class base::RefCountedThreadSafe<ComponentUnpacker>;
 
@@ -136,6 +141,8 @@ class ComponentUnpacker : public base::RefCountedThreadSafe<ComponentUnpacker> {
   // If there is an error at any step, the remaining steps are skipped and
   // and Finish is called.
   // Finish is responsible for calling the callback provided in Start().
+  // Records how long the successful unpacks and installs took, from
+  // verification to the end of installation.
   void Finish();
 
   std::vector<uint8> pk_hash_;
@@ -150,7 +157,10 @@ class ComponentUnpacker : public base::RefCountedThreadSafe<ComponentUnpacker> {
   const bool in_process_;
   Error error_;
   int extended_error_;
+  // The patcher's default is used if this is 0.
+  size_t max_parallel_operations_;
   scoped_refptr<base::SequencedTaskRunner> task_runner_;
+  base::TimeTicks start_time_;
 
   DISALLOW_COPY_AND_ASSIGN(ComponentUnpacker);
 };
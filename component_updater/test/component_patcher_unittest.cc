@@ -7,6 +7,7 @@
 #include "base/file_util.h"
 #include "base/files/file_path.h"
 #include "base/files/scoped_temp_dir.h"
+#include "base/json/json_writer.h"
 #include "base/message_loop/message_loop.h"
 #include "base/path_service.h"
 #include "base/run_loop.h"
@@ -48,6 +49,15 @@ void TestCallback::Set(component_updater::ComponentUnpacker::Error error,
   called_ = true;
 }
 
+void SetAndQuit(TestCallback* callback,
+                const base::Closure& quit_closure,
+                component_updater::ComponentUnpacker::Error error,
+                int extra_code) {
+  EXPECT_FALSE(callback->called_);
+  callback->Set(error, extra_code);
+  quit_closure.Run();
+}
+
 }  // namespace
 
 namespace component_updater {
@@ -60,6 +70,17 @@ base::FilePath test_file(const char* file) {
   return path.AppendASCII("components").AppendASCII(file);
 }
 
+// Returns the arguments of a command writing |output|, whose contents must
+// be those of binary_output.bin.
+base::DictionaryValue* CreateCommand(const std::string& op,
+                                     const std::string& output) {
+  base::DictionaryValue* command_args = new base::DictionaryValue();
+  command_args->SetString("op", op);
+  command_args->SetString("output", output);
+  command_args->SetString("sha256", binary_output_hash);
+  return command_args;
+}
+
 }  // namespace
 
 ComponentPatcherOperationTest::ComponentPatcherOperationTest() {
@@ -206,4 +227,137 @@ TEST_F(ComponentPatcherOperationTest, CheckBsdiffOperation) {
       test_file("binary_output.bin")));
 }
 
+class ComponentPatcherTest : public ComponentPatcherOperationTest {
+ protected:
+  // Writes |commands| to the commands file of |input_dir_|.
+  void WriteCommands(const base::ListValue& commands) {
+    std::string json;
+    base::JSONWriter::Write(&commands, &json);
+    EXPECT_EQ(static_cast<int>(json.size()),
+              base::WriteFile(
+                  input_dir_.path().Append(FILE_PATH_LITERAL("commands.json")),
+                  json.data(),
+                  json.size()));
+  }
+
+  // Runs the commands file with up to |max_parallel_operations| operations
+  // at a time, and waits for the result.
+  void RunPatcher(size_t max_parallel_operations, TestCallback* callback) {
+    base::RunLoop run_loop;
+    scoped_refptr<ComponentPatcher> patcher =
+        new ComponentPatcher(input_dir_.path(),
+                             unpack_dir_.path(),
+                             installer_.get(),
+                             true,
+                             task_runner_);
+    patcher->SetMaxParallelOperationsForTesting(max_parallel_operations);
+    patcher->Start(base::Bind(&SetAndQuit,
+                              base::Unretained(callback),
+                              run_loop.QuitClosure()));
+    run_loop.Run();
+  }
+
+  bool OutputEquals(const char* output) {
+    return base::ContentsEqual(unpack_dir_.path().AppendASCII(output),
+                               test_file("binary_output.bin"));
+  }
+};
+
+// Verify that the operations of a commands file all run, whether one or
+// several at a time, including operations which share their output files.
+TEST_F(ComponentPatcherTest, CheckParallelOperations) {
+  EXPECT_TRUE(base::CopyFile(
+      test_file("binary_input.bin"),
+      installed_dir_.path().Append(FILE_PATH_LITERAL("binary_input.bin"))));
+  EXPECT_TRUE(base::CopyFile(
+      test_file("binary_output.bin"),
+      installed_dir_.path().Append(FILE_PATH_LITERAL("binary_output.bin"))));
+
+  const size_t kMaxParallelOperations[] = { 1, 2, 4 };
+  for (size_t i = 0; i < arraysize(kMaxParallelOperations); ++i) {
+    EXPECT_TRUE(base::CopyFile(
+        test_file("binary_output.bin"),
+        input_dir_.path().Append(FILE_PATH_LITERAL("binary_output.bin"))));
+    EXPECT_TRUE(base::CopyFile(test_file("binary_bsdiff_patch.bin"),
+                               input_dir_.path().Append(FILE_PATH_LITERAL(
+                                   "binary_bsdiff_patch.bin"))));
+    EXPECT_TRUE(base::CopyFile(test_file("binary_courgette_patch.bin"),
+                               input_dir_.path().Append(FILE_PATH_LITERAL(
+                                   "binary_courgette_patch.bin"))));
+
+    base::ListValue commands;
+    base::DictionaryValue* command_args = CreateCommand("create", "create.bin");
+    command_args->SetString("patch", "binary_output.bin");
+    commands.Append(command_args);
+    command_args = CreateCommand("copy", "dir/copy.bin");
+    command_args->SetString("input", "binary_output.bin");
+    commands.Append(command_args);
+    command_args = CreateCommand("bsdiff", "dir/bsdiff.bin");
+    command_args->SetString("input", "binary_input.bin");
+    command_args->SetString("patch", "binary_bsdiff_patch.bin");
+    commands.Append(command_args);
+    command_args = CreateCommand("courgette", "courgette.bin");
+    command_args->SetString("input", "binary_input.bin");
+    command_args->SetString("patch", "binary_courgette_patch.bin");
+    commands.Append(command_args);
+    // Writes the same output as the copy, so it must wait for it.
+    command_args = CreateCommand("copy", "dir/copy.bin");
+    command_args->SetString("input", "binary_output.bin");
+    commands.Append(command_args);
+    WriteCommands(commands);
+
+    TestCallback callback;
+    RunPatcher(kMaxParallelOperations[i], &callback);
+
+    EXPECT_TRUE(callback.called_);
+    EXPECT_EQ(ComponentUnpacker::kNone, callback.error_);
+    EXPECT_EQ(0, callback.extra_code_);
+    EXPECT_TRUE(OutputEquals("create.bin"));
+    EXPECT_TRUE(OutputEquals("dir/copy.bin"));
+    EXPECT_TRUE(OutputEquals("dir/bsdiff.bin"));
+    EXPECT_TRUE(OutputEquals("courgette.bin"));
+    EXPECT_TRUE(base::DeleteFile(unpack_dir_.path(), true));
+    EXPECT_TRUE(base::CreateDirectory(unpack_dir_.path()));
+  }
+}
+
+// Verify that the first failing operation is reported, once, and that no
+// operation starts after it.
+TEST_F(ComponentPatcherTest, CheckFailingOperation) {
+  EXPECT_TRUE(base::CopyFile(
+      test_file("binary_output.bin"),
+      installed_dir_.path().Append(FILE_PATH_LITERAL("binary_output.bin"))));
+
+  base::ListValue commands;
+  base::DictionaryValue* command_args = CreateCommand("copy", "first.bin");
+  command_args->SetString("input", "binary_output.bin");
+  commands.Append(command_args);
+  command_args = CreateCommand("copy", "missing.bin");
+  command_args->SetString("input", "missing.bin");
+  commands.Append(command_args);
+  commands.Append(CreateCommand("unknown", "unknown.bin"));
+  WriteCommands(commands);
+
+  TestCallback callback;
+  RunPatcher(1, &callback);
+
+  EXPECT_TRUE(callback.called_);
+  EXPECT_EQ(ComponentUnpacker::kDeltaOperationFailure, callback.error_);
+  EXPECT_TRUE(OutputEquals("first.bin"));
+  EXPECT_FALSE(base::PathExists(unpack_dir_.path().AppendASCII("unknown.bin")));
+}
+
+// Verify that a command which is not a dictionary fails the patch.
+TEST_F(ComponentPatcherTest, CheckBadCommands) {
+  base::ListValue commands;
+  commands.Append(new base::StringValue("copy"));
+  WriteCommands(commands);
+
+  TestCallback callback;
+  RunPatcher(4, &callback);
+
+  EXPECT_TRUE(callback.called_);
+  EXPECT_EQ(ComponentUnpacker::kDeltaBadCommands, callback.error_);
+}
+
 }  // namespace component_updater
@@ -0,0 +1,250 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/compiler_specific.h"
+#include "base/file_util.h"
+#include "base/files/file_path.h"
+#include "base/files/scoped_file.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_writer.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/run_loop.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "base/values.h"
+#include "chrome/browser/component_updater/component_patcher.h"
+#include "chrome/browser/component_updater/component_unpacker.h"
+#include "chrome/browser/component_updater/test/test_installer.h"
+#include "chrome/browser/test/base/synthetic_random.h"
+#include "content/public/browser/browser_thread.h"
+#include "content/public/test/test_browser_thread_bundle.h"
+#include "courgette/streams.h"
+#include "courgette/third_party/bsdiff.h"
+#include "crypto/rsa_private_key.h"
+#include "crypto/sha2.h"
+#include "crypto/signature_creator.h"
+#include "extensions/common/crx_file.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+#include "third_party/zlib/google/zip.h"
+
+namespace component_updater {
+
+namespace {
+
+const int kIterations = 5;
+
+// A PNaCl-like component: many sizable files, most of them changed by a
+// bsdiff patch and the others copied unchanged from the installation.
+const int kNumFiles = 32;
+const size_t kFileSize = 256 * 1024;
+
+// The magic number of a differential CRX.
+const char kDeltaCrxMagic[] = "CrOD";
+
+// Returns |size| bytes which differ for every |seed|.
+std::string MakeContents(int seed, size_t size) {
+  SyntheticRandom random(seed);
+  std::string contents(size, '\0');
+  for (size_t i = 0; i < size; ++i)
+    contents[i] = static_cast<char>(random.Next());
+  return contents;
+}
+
+bool WriteContents(const base::FilePath& path, const std::string& contents) {
+  return base::WriteFile(path, contents.data(), contents.size()) ==
+         static_cast<int>(contents.size());
+}
+
+// Returns the arguments of a command writing |output|, which must end up
+// with |contents|.
+base::DictionaryValue* CreateCommand(const std::string& op,
+                                     const std::string& output,
+                                     const std::string& contents) {
+  base::DictionaryValue* command_args = new base::DictionaryValue();
+  command_args->SetString("op", op);
+  command_args->SetString("output", output);
+  const std::string hash = crypto::SHA256HashString(contents);
+  command_args->SetString("sha256",
+                          base::HexEncode(hash.data(), hash.size()));
+  return command_args;
+}
+
+}  // namespace
+
+class ComponentUnpackerPerfTest : public testing::Test {
+ protected:
+  virtual void SetUp() OVERRIDE {
+    ASSERT_TRUE(installed_dir_.CreateUniqueTempDir());
+    ASSERT_TRUE(crx_dir_.CreateUniqueTempDir());
+    installer_.reset(new ReadOnlyTestInstaller(installed_dir_.path()));
+    task_runner_ = content::BrowserThread::GetMessageLoopProxyForThread(
+        content::BrowserThread::FILE);
+    ASSERT_NO_FATAL_FAILURE(WriteDeltaCrx());
+  }
+
+  // Installs the old version of the component, and writes the signed delta
+  // CRX which updates it to |crx_path_|.
+  void WriteDeltaCrx() {
+    base::ScopedTempDir delta_dir;
+    ASSERT_TRUE(delta_dir.CreateUniqueTempDir());
+
+    base::ListValue commands;
+    const std::string manifest("{\"name\": \"perf\", \"version\": \"2.0\"}");
+    ASSERT_TRUE(
+        WriteContents(delta_dir.path().AppendASCII("manifest.json"), manifest));
+    base::DictionaryValue* command_args =
+        CreateCommand("create", "manifest.json", manifest);
+    command_args->SetString("patch", "manifest.json");
+    commands.Append(command_args);
+
+    for (int i = 0; i < kNumFiles; ++i) {
+      const std::string name = base::StringPrintf("file%d.bin", i);
+      const std::string old_contents = MakeContents(i, kFileSize);
+      ASSERT_TRUE(
+          WriteContents(installed_dir_.path().AppendASCII(name), old_contents));
+      if (i % 4 == 0) {
+        command_args = CreateCommand("copy", name, old_contents);
+        command_args->SetString("input", name);
+        commands.Append(command_args);
+        continue;
+      }
+
+      // Change a stretch of every 64k of the file.
+      std::string new_contents = old_contents;
+      const std::string changes = MakeContents(kNumFiles + i, 4096);
+      for (size_t offset = 0; offset < kFileSize; offset += 64 * 1024)
+        new_contents.replace(offset, changes.size(), changes);
+
+      courgette::SourceStream old_stream;
+      courgette::SourceStream new_stream;
+      courgette::SinkStream patch_stream;
+      old_stream.Init(old_contents);
+      new_stream.Init(new_contents);
+      ASSERT_EQ(courgette::OK, courgette::CreateBinaryPatch(
+                                   &old_stream, &new_stream, &patch_stream));
+      const std::string patch_name = name + ".bsdiff";
+      ASSERT_TRUE(WriteContents(
+          delta_dir.path().AppendASCII(patch_name),
+          std::string(reinterpret_cast<const char*>(patch_stream.Buffer()),
+                      patch_stream.Length())));
+
+      command_args = CreateCommand("bsdiff", name, new_contents);
+      command_args->SetString("input", name);
+      command_args->SetString("patch", patch_name);
+      commands.Append(command_args);
+    }
+
+    std::string json;
+    base::JSONWriter::Write(&commands, &json);
+    ASSERT_TRUE(
+        WriteContents(delta_dir.path().AppendASCII("commands.json"), json));
+
+    const base::FilePath zip_path = crx_dir_.path().AppendASCII("delta.zip");
+    ASSERT_TRUE(zip::Zip(delta_dir.path(), zip_path, false));
+    std::string zip;
+    ASSERT_TRUE(base::ReadFileToString(zip_path, &zip));
+
+    scoped_ptr<crypto::RSAPrivateKey> key(crypto::RSAPrivateKey::Create(1024));
+    ASSERT_TRUE(key.get());
+    std::vector<uint8> public_key;
+    ASSERT_TRUE(key->ExportPublicKey(&public_key));
+    scoped_ptr<crypto::SignatureCreator> signature_creator(
+        crypto::SignatureCreator::Create(key.get()));
+    ASSERT_TRUE(signature_creator->Update(
+        reinterpret_cast<const uint8*>(zip.data()), zip.size()));
+    std::vector<uint8> signature;
+    ASSERT_TRUE(signature_creator->Final(&signature));
+
+    extensions::CrxFile::Error error;
+    scoped_ptr<extensions::CrxFile> crx(extensions::CrxFile::Create(
+        public_key.size(), signature.size(), &error));
+    ASSERT_TRUE(crx.get());
+    extensions::CrxFile::Header header = crx->header();
+    memcpy(header.magic, kDeltaCrxMagic, sizeof(header.magic));
+
+    crx_path_ = crx_dir_.path().AppendASCII("delta.crx");
+    base::ScopedFILE crx_file(base::OpenFile(crx_path_, "wb"));
+    ASSERT_TRUE(crx_file.get());
+    ASSERT_EQ(1U, fwrite(&header, sizeof(header), 1, crx_file.get()));
+    ASSERT_EQ(public_key.size(), fwrite(&public_key[0], 1, public_key.size(),
+                                        crx_file.get()));
+    ASSERT_EQ(signature.size(), fwrite(&signature[0], 1, signature.size(),
+                                       crx_file.get()));
+    ASSERT_EQ(zip.size(), fwrite(zip.data(), 1, zip.size(), crx_file.get()));
+
+    pk_hash_.resize(crypto::kSHA256Length);
+    crypto::SHA256HashString(
+        std::string(public_key.begin(), public_key.end()),
+        &pk_hash_[0], pk_hash_.size());
+  }
+
+  // Unpacks and installs the delta CRX with up to |max_parallel_operations|
+  // patch operations at a time, and returns how long it took.
+  base::TimeDelta Unpack(size_t max_parallel_operations) {
+    base::RunLoop run_loop;
+    ComponentUnpacker::Error error = ComponentUnpacker::kInvalidParams;
+    scoped_refptr<ComponentUnpacker> unpacker =
+        new ComponentUnpacker(pk_hash_,
+                              crx_path_,
+                              "fingerprint",
+                              installer_.get(),
+                              true,
+                              task_runner_);
+    unpacker->SetMaxParallelOperationsForTesting(max_parallel_operations);
+    const base::TimeTicks start = base::TimeTicks::HighResNow();
+    unpacker->Unpack(base::Bind(&ComponentUnpackerPerfTest::OnUnpacked,
+                                base::Unretained(&error),
+                                run_loop.QuitClosure()));
+    run_loop.Run();
+    const base::TimeDelta elapsed = base::TimeTicks::HighResNow() - start;
+    EXPECT_EQ(ComponentUnpacker::kNone, error);
+    return elapsed;
+  }
+
+  static void OnUnpacked(ComponentUnpacker::Error* result,
+                         const base::Closure& quit_closure,
+                         ComponentUnpacker::Error error,
+                         int extended_error) {
+    *result = error;
+    quit_closure.Run();
+  }
+
+  content::TestBrowserThreadBundle thread_bundle_;
+  base::ScopedTempDir installed_dir_;
+  base::ScopedTempDir crx_dir_;
+  scoped_ptr<ReadOnlyTestInstaller> installer_;
+  scoped_refptr<base::SequencedTaskRunner> task_runner_;
+  base::FilePath crx_path_;
+  std::vector<uint8> pk_hash_;
+};
+
+// Updating a multi-file component with a delta CRX: verify, unzip, patch and
+// install, with the patch operations run one at a time and in parallel.
+TEST_F(ComponentUnpackerPerfTest, DeltaUpdate) {
+  const size_t kMaxParallelOperations[] = {
+    1, ComponentPatcher::kMaxParallelOperations
+  };
+  for (size_t i = 0; i < arraysize(kMaxParallelOperations); ++i) {
+    base::TimeDelta elapsed;
+    for (int j = 0; j < kIterations; ++j)
+      elapsed += Unpack(kMaxParallelOperations[i]);
+    perf_test::PrintResult(
+        "component_delta_unpack",
+        "",
+        base::StringPrintf("%d_files_%d_workers",
+                           kNumFiles,
+                           static_cast<int>(kMaxParallelOperations[i])),
+        elapsed.InMillisecondsF() / kIterations,
+        "ms",
+        true);
+  }
+}
+
+}  // namespace component_updater
@@ -0,0 +1,143 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/content_settings/content_settings_rule_index.h"
+
+#include "base/strings/string_util.h"
+#include "chrome/common/content_settings_pattern.h"
+#include "url/gurl.h"
+#include "url/url_constants.h"
+
+namespace content_settings {
+
+namespace {
+
+const char kDomainWildcard[] = "[*.]";
+
+// Extracts the host of |pattern| from its string form, which looks like
+// "[scheme://][[*.]host][:port]" for everything but file: patterns.  Returns
+// false if the pattern can match any host, or its host can't be determined;
+// such rules are tested for every URL.
+bool GetPatternHost(const ContentSettingsPattern& pattern,
+                    std::string* host,
+                    bool* match_subdomains) {
+  if (pattern.MatchesAllHosts())
+    return false;
+
+  const std::string spec = pattern.ToString();
+  size_t start = 0;
+  const size_t scheme_end = spec.find(url::kStandardSchemeSeparator);
+  if (scheme_end != std::string::npos) {
+    if (spec.compare(0, scheme_end, url::kFileScheme) == 0)
+      return false;
+    start = scheme_end + strlen(url::kStandardSchemeSeparator);
+  }
+
+  *match_subdomains = spec.compare(start, arraysize(kDomainWildcard) - 1,
+                                   kDomainWildcard) == 0;
+  if (*match_subdomains)
+    start += arraysize(kDomainWildcard) - 1;
+
+  // IPv6 literals keep their brackets, as in GURL::host().
+  size_t end;
+  if (spec.compare(start, 1, "[") == 0) {
+    end = spec.find(']', start);
+    if (end == std::string::npos)
+      return false;
+    ++end;
+  } else {
+    end = spec.find_first_of(":/", start);
+    if (end == std::string::npos)
+      end = spec.length();
+  }
+
+  *host = StringToLowerASCII(spec.substr(start, end - start));
+  return !host->empty() && host->find('*') == std::string::npos;
+}
+
+}  // namespace
+
+RuleIndex::RuleIndex() {}
+
+RuleIndex::~RuleIndex() {}
+
+void RuleIndex::AddRule(const Rule& rule, SettingSource source) {
+  const size_t position = rules_.size();
+  rules_.push_back(rule);
+  sources_.push_back(source);
+
+  std::string host;
+  bool match_subdomains = false;
+  if (!GetPatternHost(rule.primary_pattern, &host, &match_subdomains))
+    any_host_.push_back(position);
+  else if (match_subdomains)
+    domain_hosts_[host].push_back(position);
+  else
+    exact_hosts_[host].push_back(position);
+}
+
+const Rule* RuleIndex::Find(const GURL& primary_url,
+                            const GURL& secondary_url,
+                            SettingSource* source) const {
+  size_t best =
+      FindInList(any_host_, rules_.size(), primary_url, secondary_url);
+
+  // Patterns match filesystem: URLs against their inner URL.
+  const GURL* host_url = &primary_url;
+  if (primary_url.SchemeIsFileSystem() && primary_url.inner_url())
+    host_url = primary_url.inner_url();
+  const std::string& host = host_url->host();
+  if (!host.empty()) {
+    FindForHost(host, primary_url, secondary_url, &best);
+    // Patterns don't keep the trailing dot of a fully qualified host.
+    if (host[host.length() - 1] == '.') {
+      FindForHost(host.substr(0, host.length() - 1), primary_url,
+                  secondary_url, &best);
+    }
+  }
+
+  if (best == rules_.size())
+    return NULL;
+  if (source)
+    *source = sources_[best];
+  return &rules_[best];
+}
+
+size_t RuleIndex::FindInList(const std::vector<size_t>& positions,
+                             size_t limit,
+                             const GURL& primary_url,
+                             const GURL& secondary_url) const {
+  for (size_t i = 0; i < positions.size() && positions[i] < limit; ++i) {
+    const Rule& rule = rules_[positions[i]];
+    if (rule.primary_pattern.Matches(primary_url) &&
+        rule.secondary_pattern.Matches(secondary_url)) {
+      return positions[i];
+    }
+  }
+  return limit;
+}
+
+void RuleIndex::FindForHost(const std::string& host,
+                            const GURL& primary_url,
+                            const GURL& secondary_url,
+                            size_t* best) const {
+  HostMap::const_iterator found = exact_hosts_.find(host);
+  if (found != exact_hosts_.end())
+    *best = FindInList(found->second, *best, primary_url, secondary_url);
+
+  if (domain_hosts_.empty())
+    return;
+
+  size_t start = 0;
+  while (start != std::string::npos) {
+    found = domain_hosts_.find(host.substr(start));
+    if (found != domain_hosts_.end())
+      *best = FindInList(found->second, *best, primary_url, secondary_url);
+    start = host.find('.', start);
+    if (start != std::string::npos)
+      ++start;
+  }
+}
+
+}  // namespace content_settings
@@ -0,0 +1,85 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_CONTENT_SETTINGS_CONTENT_SETTINGS_RULE_INDEX_H_
+#define CHROME_BROWSER_CONTENT_SETTINGS_CONTENT_SETTINGS_RULE_INDEX_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/containers/hash_tables.h"
+#include "base/memory/ref_counted.h"
+#include "chrome/browser/content_settings/content_settings_rule.h"
+#include "chrome/common/content_settings.h"
+
+class GURL;
+
+namespace content_settings {
+
+// An immutable list of the rules for one content type and resource
+// identifier, from all providers, in precedence order.  Rules are bucketed by
+// the host of their primary pattern, so a lookup only tests the patterns of
+// rules for the URL's host, its parent domains, and rules that match any host.
+// Domain patterns ("[*.]example.com") are found by looking up each label
+// suffix of the URL's host.
+//
+// The index is built on one thread, after which it may be used from any
+// thread.
+class RuleIndex : public base::RefCountedThreadSafe<RuleIndex> {
+ public:
+  RuleIndex();
+
+  // Appends |rule|, which has lower precedence than all rules added before.
+  // |source| is returned with the rule by Find().
+  void AddRule(const Rule& rule, SettingSource source);
+
+  // Returns the rule with the highest precedence whose patterns match
+  // |primary_url| and |secondary_url|, or NULL.  If a rule is found and
+  // |source| is not NULL, it is set to the source the rule was added with.
+  const Rule* Find(const GURL& primary_url,
+                   const GURL& secondary_url,
+                   SettingSource* source) const;
+
+  size_t size() const { return rules_.size(); }
+
+ private:
+  friend class base::RefCountedThreadSafe<RuleIndex>;
+
+  typedef base::hash_map<std::string, std::vector<size_t> > HostMap;
+
+  ~RuleIndex();
+
+  // Returns the first position in |positions| which is less than |limit| and
+  // whose rule matches the URLs, or |limit| if there is none.
+  size_t FindInList(const std::vector<size_t>& positions,
+                    size_t limit,
+                    const GURL& primary_url,
+                    const GURL& secondary_url) const;
+
+  // Looks up |host| and each of its parent domains, lowering |*best| to the
+  // first matching rule.
+  void FindForHost(const std::string& host,
+                   const GURL& primary_url,
+                   const GURL& secondary_url,
+                   size_t* best) const;
+
+  std::vector<Rule> rules_;
+  std::vector<SettingSource> sources_;
+
+  // Rules whose primary pattern may match any host.
+  std::vector<size_t> any_host_;
+
+  // Rules whose primary pattern matches exactly one host.
+  HostMap exact_hosts_;
+
+  // Rules whose primary pattern matches a domain and its subdomains.
+  HostMap domain_hosts_;
+
+  DISALLOW_COPY_AND_ASSIGN(RuleIndex);
+};
+
+}  // namespace content_settings
+
+#endif  // CHROME_BROWSER_CONTENT_SETTINGS_CONTENT_SETTINGS_RULE_INDEX_H_
@@ -0,0 +1,119 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "base/values.h"
+#include "chrome/browser/content_settings/content_settings_origin_identifier_value_map.h"
+#include "chrome/browser/content_settings/content_settings_rule.h"
+#include "chrome/browser/content_settings/content_settings_rule_index.h"
+#include "chrome/browser/test/base/synthetic_random.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+#include "url/gurl.h"
+
+namespace content_settings {
+
+namespace {
+
+const size_t kRuleCount = 10000;
+const size_t kLookupCount = 20000;
+
+// Exceptions as a user or policy would add them: mostly domains, some single
+// hosts and a few with a scheme and port.
+std::string MakePattern(size_t site, SyntheticRandom* random) {
+  switch (random->Next() % 4) {
+    case 0:
+      return base::StringPrintf("www.site%u.com", static_cast<unsigned>(site));
+    case 1:
+      return base::StringPrintf("http://site%u.com:8080",
+                                static_cast<unsigned>(site));
+    default:
+      return base::StringPrintf("[*.]site%u.com", static_cast<unsigned>(site));
+  }
+}
+
+}  // namespace
+
+TEST(ContentSettingsRuleIndexPerfTest, TenThousandRules) {
+  SyntheticRandom random;
+  OriginIdentifierValueMap map;
+  for (size_t i = 0; i < kRuleCount; ++i) {
+    map.SetValue(ContentSettingsPattern::FromString(MakePattern(i, &random)),
+                 ContentSettingsPattern::Wildcard(),
+                 CONTENT_SETTINGS_TYPE_JAVASCRIPT,
+                 std::string(),
+                 base::Value::CreateIntegerValue(CONTENT_SETTING_BLOCK));
+  }
+  map.SetValue(ContentSettingsPattern::Wildcard(),
+               ContentSettingsPattern::Wildcard(),
+               CONTENT_SETTINGS_TYPE_JAVASCRIPT,
+               std::string(),
+               base::Value::CreateIntegerValue(CONTENT_SETTING_ALLOW));
+
+  base::TimeTicks start = base::TimeTicks::HighResNow();
+  scoped_refptr<RuleIndex> index(new RuleIndex);
+  {
+    scoped_ptr<RuleIterator> rule_iterator(map.GetRuleIterator(
+        CONTENT_SETTINGS_TYPE_JAVASCRIPT, std::string(), NULL));
+    while (rule_iterator->HasNext())
+      index->AddRule(rule_iterator->Next(), SETTING_SOURCE_USER);
+  }
+  const base::TimeDelta build = base::TimeTicks::HighResNow() - start;
+  perf_test::PrintResult("content_settings_rule_index_build", "", "10k_rules",
+                         build.InMillisecondsF(), "ms", true);
+
+  // Half the lookups hit a site with an exception.
+  std::vector<GURL> urls;
+  for (size_t i = 0; i < kLookupCount; ++i) {
+    const size_t site = random.Next() % (2 * kRuleCount);
+    urls.push_back(GURL(base::StringPrintf(
+        "http://%s.site%u.com/page", random.Next() % 2 ? "www" : "cdn",
+        static_cast<unsigned>(site))));
+  }
+  const GURL secondary_url("http://www.example.com/");
+
+  size_t linear_blocked = 0;
+  start = base::TimeTicks::HighResNow();
+  for (size_t i = 0; i < urls.size(); ++i) {
+    const base::Value* value = map.GetValue(
+        urls[i], secondary_url, CONTENT_SETTINGS_TYPE_JAVASCRIPT,
+        std::string());
+    int setting = CONTENT_SETTING_DEFAULT;
+    if (value && value->GetAsInteger(&setting) &&
+        setting == CONTENT_SETTING_BLOCK) {
+      ++linear_blocked;
+    }
+  }
+  const base::TimeDelta linear = base::TimeTicks::HighResNow() - start;
+
+  size_t indexed_blocked = 0;
+  start = base::TimeTicks::HighResNow();
+  for (size_t i = 0; i < urls.size(); ++i) {
+    const Rule* rule = index->Find(urls[i], secondary_url, NULL);
+    int setting = CONTENT_SETTING_DEFAULT;
+    if (rule && rule->value->GetAsInteger(&setting) &&
+        setting == CONTENT_SETTING_BLOCK) {
+      ++indexed_blocked;
+    }
+  }
+  const base::TimeDelta indexed = base::TimeTicks::HighResNow() - start;
+
+  EXPECT_EQ(linear_blocked, indexed_blocked);
+  perf_test::PrintResult("content_settings_lookup", "_linear", "10k_rules",
+                         linear.InMicroseconds() /
+                             static_cast<double>(urls.size()),
+                         "us/lookup", true);
+  perf_test::PrintResult("content_settings_lookup", "_indexed", "10k_rules",
+                         indexed.InMicroseconds() /
+                             static_cast<double>(urls.size()),
+                         "us/lookup", true);
+}
+
+}  // namespace content_settings
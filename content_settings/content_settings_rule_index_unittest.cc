@@ -0,0 +1,147 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/content_settings/content_settings_rule_index.h"
+
+#include "base/memory/scoped_ptr.h"
+#include "base/values.h"
+#include "chrome/browser/content_settings/content_settings_origin_identifier_value_map.h"
+#include "chrome/browser/content_settings/content_settings_rule.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "url/gurl.h"
+
+namespace content_settings {
+
+namespace {
+
+const char* kPrimaryPatterns[] = {
+  "[*.]example.com",
+  "www.example.com",
+  "http://www.example.com:8080",
+  "https://[*.]example.com:443",
+  "[*.]mail.example.com",
+  "other.org",
+  "[::1]",
+  "192.168.1.1",
+  "file:///tmp/a.html",
+  "*",
+};
+
+const char* kSecondaryPatterns[] = {
+  "*",
+  "[*.]example.com",
+};
+
+const char* kUrls[] = {
+  "http://www.example.com/",
+  "http://www.example.com:8080/",
+  "https://www.example.com/",
+  "https://a.mail.example.com/",
+  "http://example.com./",
+  "http://notexample.com/",
+  "http://other.org/path",
+  "http://www.other.org/",
+  "http://[::1]:80/",
+  "http://192.168.1.1/",
+  "file:///tmp/a.html",
+  "file:///tmp/b.html",
+  "filesystem:http://www.example.com/temporary/file",
+  "chrome-extension://abcdefghijklmnop/",
+};
+
+// Builds a map holding one rule per pattern pair, and an index with the same
+// rules in the map's precedence order.
+scoped_refptr<RuleIndex> BuildRules(size_t primary_count,
+                                    OriginIdentifierValueMap* map) {
+  int value = 0;
+  for (size_t i = 0; i < primary_count; ++i) {
+    for (size_t j = 0; j < arraysize(kSecondaryPatterns); ++j) {
+      map->SetValue(ContentSettingsPattern::FromString(kPrimaryPatterns[i]),
+                    ContentSettingsPattern::FromString(kSecondaryPatterns[j]),
+                    CONTENT_SETTINGS_TYPE_IMAGES,
+                    std::string(),
+                    base::Value::CreateIntegerValue(value++));
+    }
+  }
+
+  scoped_refptr<RuleIndex> index(new RuleIndex);
+  scoped_ptr<RuleIterator> rule_iterator(
+      map->GetRuleIterator(CONTENT_SETTINGS_TYPE_IMAGES, std::string(), NULL));
+  while (rule_iterator->HasNext())
+    index->AddRule(rule_iterator->Next(), SETTING_SOURCE_USER);
+  return index;
+}
+
+}  // namespace
+
+TEST(ContentSettingsRuleIndexTest, Empty) {
+  scoped_refptr<RuleIndex> index(new RuleIndex);
+  EXPECT_EQ(0u, index->size());
+  EXPECT_EQ(NULL, index->Find(GURL("http://www.example.com/"),
+                              GURL("http://www.example.com/"), NULL));
+}
+
+TEST(ContentSettingsRuleIndexTest, Precedence) {
+  scoped_refptr<RuleIndex> index(new RuleIndex);
+  index->AddRule(Rule(ContentSettingsPattern::FromString("www.example.com"),
+                      ContentSettingsPattern::Wildcard(),
+                      base::Value::CreateIntegerValue(1)),
+                 SETTING_SOURCE_POLICY);
+  index->AddRule(Rule(ContentSettingsPattern::FromString("[*.]example.com"),
+                      ContentSettingsPattern::Wildcard(),
+                      base::Value::CreateIntegerValue(2)),
+                 SETTING_SOURCE_EXTENSION);
+  index->AddRule(Rule(ContentSettingsPattern::Wildcard(),
+                      ContentSettingsPattern::Wildcard(),
+                      base::Value::CreateIntegerValue(3)),
+                 SETTING_SOURCE_USER);
+  EXPECT_EQ(3u, index->size());
+
+  const GURL secondary_url("http://www.google.com/");
+  SettingSource source = SETTING_SOURCE_NONE;
+  const Rule* rule =
+      index->Find(GURL("http://www.example.com/"), secondary_url, &source);
+  ASSERT_TRUE(rule);
+  EXPECT_TRUE(base::FundamentalValue(1).Equals(rule->value.get()));
+  EXPECT_EQ(SETTING_SOURCE_POLICY, source);
+
+  rule = index->Find(GURL("http://a.example.com/"), secondary_url, &source);
+  ASSERT_TRUE(rule);
+  EXPECT_TRUE(base::FundamentalValue(2).Equals(rule->value.get()));
+  EXPECT_EQ(SETTING_SOURCE_EXTENSION, source);
+
+  rule = index->Find(GURL("http://notexample.com/"), secondary_url, &source);
+  ASSERT_TRUE(rule);
+  EXPECT_TRUE(base::FundamentalValue(3).Equals(rule->value.get()));
+  EXPECT_EQ(SETTING_SOURCE_USER, source);
+}
+
+// The index must find the same rule as testing every rule in order.
+TEST(ContentSettingsRuleIndexTest, MatchesLinearLookup) {
+  for (size_t count = 1; count <= arraysize(kPrimaryPatterns); ++count) {
+    OriginIdentifierValueMap map;
+    scoped_refptr<RuleIndex> index = BuildRules(count, &map);
+    EXPECT_EQ(count * arraysize(kSecondaryPatterns), index->size());
+
+    for (size_t i = 0; i < arraysize(kUrls); ++i) {
+      const GURL primary_url(kUrls[i]);
+      for (size_t j = 0; j < arraysize(kUrls); ++j) {
+        const GURL secondary_url(kUrls[j]);
+        const base::Value* expected = map.GetValue(
+            primary_url, secondary_url, CONTENT_SETTINGS_TYPE_IMAGES,
+            std::string());
+        const Rule* rule = index->Find(primary_url, secondary_url, NULL);
+        if (!expected) {
+          EXPECT_FALSE(rule) << kUrls[i] << " " << kUrls[j];
+          continue;
+        }
+        ASSERT_TRUE(rule) << kUrls[i] << " " << kUrls[j];
+        EXPECT_TRUE(expected->Equals(rule->value.get()))
+            << kUrls[i] << " " << kUrls[j];
+      }
+    }
+  }
+}
+
+}  // namespace content_settings
@@ -10,6 +10,7 @@
 #include "base/command_line.h"
 #include "base/prefs/pref_service.h"
 #include "base/stl_util.h"
+#include "base/strings/stringprintf.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
 #include "chrome/browser/chrome_notification_types.h"
@@ -22,6 +23,7 @@
 #include "chrome/browser/content_settings/content_settings_pref_provider.h"
 #include "chrome/browser/content_settings/content_settings_provider.h"
 #include "chrome/browser/content_settings/content_settings_rule.h"
+#include "chrome/browser/content_settings/content_settings_rule_index.h"
 #include "chrome/browser/content_settings/content_settings_utils.h"
 #include "chrome/browser/extensions/api/content_settings/content_settings_service.h"
 #include "chrome/browser/extensions/extension_service.h"
@@ -69,12 +71,26 @@ COMPILE_ASSERT(arraysize(kProviderSourceMap) ==
                    HostContentSettingsMap::NUM_PROVIDER_TYPES,
                kProviderSourceMap_has_incorrect_size);
 
+// Number of GetWebsiteSetting() results to cache.  Lookups for the same few
+// origins and types tend to be repeated for every resource of a page.
+const size_t kMaxCachedSettings = 256;
+
 // Returns true if the |content_type| supports a resource identifier.
 // Resource identifiers are supported (but not required) for plug-ins.
 bool SupportsResourceIdentifier(ContentSettingsType content_type) {
   return content_type == CONTENT_SETTINGS_TYPE_PLUGINS;
 }
 
+// Returns the part of |url| which content settings patterns match against,
+// for keying cached settings.  Patterns match the scheme, host and port, and
+// only match the path of file: URLs.  URLs without an origin are kept whole.
+std::string GetSettingCacheKey(const GURL& url) {
+  if (url.SchemeIsFile())
+    return url.spec();
+  const GURL origin = url.GetOrigin();
+  return origin.is_valid() ? origin.spec() : url.spec();
+}
+
 }  // namespace
 
 HostContentSettingsMap::HostContentSettingsMap(
@@ -84,7 +100,9 @@ HostContentSettingsMap::HostContentSettingsMap(
       used_from_thread_id_(base::PlatformThread::CurrentId()),
 #endif
       prefs_(prefs),
-      is_off_the_record_(incognito) {
+      is_off_the_record_(incognito),
+      cache_generation_(0),
+      setting_cache_(kMaxCachedSettings) {
   content_settings::ObservableProvider* policy_provider =
       new content_settings::PolicyProvider(prefs_);
   policy_provider->AddObserver(this);
@@ -106,6 +124,10 @@ HostContentSettingsMap::HostContentSettingsMap(
   }
 }
 
+HostContentSettingsMap::CachedSetting::CachedSetting() {}
+
+HostContentSettingsMap::CachedSetting::~CachedSetting() {}
+
 #if defined(ENABLE_EXTENSIONS)
 void HostContentSettingsMap::RegisterExtensionService(
     ExtensionService* extension_service) {
@@ -421,6 +443,13 @@ void HostContentSettingsMap::OnContentSettingChanged(
     const ContentSettingsPattern& secondary_pattern,
     ContentSettingsType content_type,
     std::string resource_identifier) {
+  {
+    base::AutoLock auto_lock(cache_lock_);
+    ++cache_generation_;
+    rule_indices_.clear();
+    setting_cache_.Clear();
+  }
+
   const ContentSettingsDetails details(primary_pattern,
                                        secondary_pattern,
                                        content_type,
@@ -595,35 +624,103 @@ base::Value* HostContentSettingsMap::GetWebsiteSetting(
     return base::Value::CreateIntegerValue(CONTENT_SETTING_ALLOW);
   }
 
-  ContentSettingsPattern* primary_pattern = NULL;
-  ContentSettingsPattern* secondary_pattern = NULL;
-  if (info) {
-    primary_pattern = &info->primary_pattern;
-    secondary_pattern = &info->secondary_pattern;
+  const std::string cache_key = base::StringPrintf(
+      "%d\n%s\n%s\n%s", content_type, resource_identifier.c_str(),
+      GetSettingCacheKey(primary_url).c_str(),
+      GetSettingCacheKey(secondary_url).c_str());
+  {
+    base::AutoLock auto_lock(cache_lock_);
+    SettingCache::iterator cached = setting_cache_.Get(cache_key);
+    if (cached != setting_cache_.end()) {
+      if (info)
+        *info = cached->second->info;
+      const base::Value* value = cached->second->value.get();
+      return value ? value->DeepCopy() : NULL;
+    }
+  }
+
+  int generation = 0;
+  scoped_refptr<content_settings::RuleIndex> rule_index =
+      GetRuleIndex(content_type, resource_identifier, &generation);
+
+  // The rules are in precedence order, so the first match applies.
+  scoped_ptr<base::Value> value;
+  content_settings::SettingInfo setting_info;
+  const content_settings::Rule* rule = rule_index->Find(
+      primary_url, secondary_url, &setting_info.source);
+  if (rule) {
+    value.reset(rule->value->DeepCopy());
+    setting_info.primary_pattern = rule->primary_pattern;
+    setting_info.secondary_pattern = rule->secondary_pattern;
+  } else {
+    setting_info.source = content_settings::SETTING_SOURCE_NONE;
   }
 
+  // The cache gets its own copy of the value, so that it is never shared
+  // with a caller.
+  scoped_ptr<CachedSetting> setting(new CachedSetting);
+  if (value)
+    setting->value.reset(value->DeepCopy());
+  setting->info = setting_info;
+  {
+    base::AutoLock auto_lock(cache_lock_);
+    if (generation == cache_generation_)
+      setting_cache_.Put(cache_key, setting.release());
+  }
+
+  if (info)
+    *info = setting_info;
+  return value.release();
+}
+
+scoped_refptr<content_settings::RuleIndex>
+HostContentSettingsMap::GetRuleIndex(
+    ContentSettingsType content_type,
+    const std::string& resource_identifier,
+    int* generation) const {
+  const RuleIndexMap::key_type key(content_type, resource_identifier);
+  {
+    base::AutoLock auto_lock(cache_lock_);
+    *generation = cache_generation_;
+    RuleIndexMap::const_iterator found = rule_indices_.find(key);
+    if (found != rule_indices_.end())
+      return found->second;
+  }
+
+  scoped_refptr<content_settings::RuleIndex> rule_index =
+      BuildRuleIndex(content_type, resource_identifier);
+
+  // Drop the rules if a provider changed while they were collected.
+  base::AutoLock auto_lock(cache_lock_);
+  if (*generation == cache_generation_)
+    rule_indices_[key] = rule_index;
+  return rule_index;
+}
+
+scoped_refptr<content_settings::RuleIndex>
+HostContentSettingsMap::BuildRuleIndex(
+    ContentSettingsType content_type,
+    const std::string& resource_identifier) const {
+  scoped_refptr<content_settings::RuleIndex> rule_index(
+      new content_settings::RuleIndex);
   // The list of |content_settings_providers_| is ordered according to their
   // precedence.
   for (ConstProviderIterator provider = content_settings_providers_.begin();
        provider != content_settings_providers_.end();
        ++provider) {
-    base::Value* value = content_settings::GetContentSettingValueAndPatterns(
-        provider->second, primary_url, secondary_url, content_type,
-        resource_identifier, is_off_the_record_,
-        primary_pattern, secondary_pattern);
-    if (value) {
-      if (info)
-        info->source = kProviderSourceMap[provider->first];
-      return value;
+    for (int incognito = is_off_the_record_ ? 1 : 0; incognito >= 0;
+         --incognito) {
+      // Each |RuleIterator| holds its provider's lock until it is destroyed.
+      scoped_ptr<content_settings::RuleIterator> rule_iterator(
+          provider->second->GetRuleIterator(
+              content_type, resource_identifier, incognito != 0));
+      while (rule_iterator->HasNext()) {
+        rule_index->AddRule(rule_iterator->Next(),
+                            kProviderSourceMap[provider->first]);
+      }
     }
   }
-
-  if (info) {
-    info->source = content_settings::SETTING_SOURCE_NONE;
-    info->primary_pattern = ContentSettingsPattern();
-    info->secondary_pattern = ContentSettingsPattern();
-  }
-  return NULL;
+  return rule_index;
 }
 
 // static
@@ -10,11 +10,15 @@
 
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "base/basictypes.h"
+#include "base/containers/mru_cache.h"
 #include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/prefs/pref_change_registrar.h"
+#include "base/synchronization/lock.h"
 #include "base/threading/platform_thread.h"
 #include "base/tuple.h"
 #include "chrome/browser/content_settings/content_settings_observer.h"
@@ -32,6 +36,7 @@ class Value;
 
 namespace content_settings {
 class ProviderInterface;
+class RuleIndex;
 }
 
 namespace user_prefs {
@@ -208,6 +213,22 @@ class HostContentSettingsMap
   typedef ProviderMap::iterator ProviderIterator;
   typedef ProviderMap::const_iterator ConstProviderIterator;
 
+  typedef std::map<std::pair<ContentSettingsType, std::string>,
+                   scoped_refptr<content_settings::RuleIndex> > RuleIndexMap;
+
+  // A result of GetWebsiteSetting(), without the whitelisted schemes. Only
+  // read and written under |cache_lock_|, and owned by the cache alone, so
+  // that callers on other threads only ever get copies of |value|.
+  struct CachedSetting {
+    CachedSetting();
+    ~CachedSetting();
+
+    // NULL if no rule matched.
+    scoped_ptr<base::Value> value;
+    content_settings::SettingInfo info;
+  };
+  typedef base::OwningMRUCache<std::string, CachedSetting*> SettingCache;
+
   virtual ~HostContentSettingsMap();
 
   ContentSetting GetDefaultContentSettingFromProvider(
@@ -236,6 +257,20 @@ class HostContentSettingsMap
   // it is not being called too late.
   void UsedContentSettingsProviders() const;
 
+  // Returns the rules of all providers for |content_type| and
+  // |resource_identifier|, building them on first use after a change.
+  // |generation| is set to the |cache_generation_| the rules belong to.
+  scoped_refptr<content_settings::RuleIndex> GetRuleIndex(
+      ContentSettingsType content_type,
+      const std::string& resource_identifier,
+      int* generation) const;
+
+  // Collects the rules for GetRuleIndex(), in the order GetWebsiteSetting()
+  // would try them: by provider, then incognito-only rules before the others.
+  scoped_refptr<content_settings::RuleIndex> BuildRuleIndex(
+      ContentSettingsType content_type,
+      const std::string& resource_identifier) const;
+
 #ifndef NDEBUG
   // This starts as the thread ID of the thread that constructs this
   // object, and remains until used by a different thread, at which
@@ -257,6 +292,21 @@ class HostContentSettingsMap
   // before any other uses of it.
   ProviderMap content_settings_providers_;
 
+  // Protects the caches below.  Rules are collected from the providers
+  // without holding it, so it is never held while a provider's lock is.
+  mutable base::Lock cache_lock_;
+
+  // Incremented by OnContentSettingChanged() when the caches are cleared.
+  // Results computed from rules of an older generation are not cached.
+  mutable int cache_generation_;
+
+  // Rules by content type and resource identifier.
+  mutable RuleIndexMap rule_indices_;
+
+  // Recent results of GetWebsiteSetting(), by the origins of the URLs,
+  // content type and resource identifier.
+  mutable SettingCache setting_cache_;
+
   DISALLOW_COPY_AND_ASSIGN(HostContentSettingsMap);
 };
 
@@ -3,12 +3,15 @@
 // found in the LICENSE file.
 
 #include "base/auto_reset.h"
+#include "base/bind.h"
 #include "base/command_line.h"
 #include "base/json/json_reader.h"
 #include "base/json/json_writer.h"
 #include "base/message_loop/message_loop.h"
 #include "base/prefs/pref_service.h"
 #include "base/prefs/scoped_user_pref_update.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/thread.h"
 #include "chrome/browser/content_settings/content_settings_details.h"
 #include "chrome/browser/content_settings/cookie_settings.h"
 #include "chrome/browser/content_settings/host_content_settings_map.h"
@@ -27,6 +30,21 @@ using content::BrowserThread;
 
 using ::testing::_;
 
+namespace {
+
+// Looks up the image setting of more hosts than the setting cache holds, so
+// that cached settings are evicted while they are being looked up.
+void LookUpImageSettings(HostContentSettingsMap* host_content_settings_map) {
+  for (int i = 0; i < 300; ++i) {
+    GURL url(base::StringPrintf("http://host%d.example.com/", i));
+    EXPECT_EQ(CONTENT_SETTING_BLOCK,
+              host_content_settings_map->GetContentSetting(
+                  url, url, CONTENT_SETTINGS_TYPE_IMAGES, std::string()));
+  }
+}
+
+}  // namespace
+
 class HostContentSettingsMapTest : public testing::Test {
  public:
   HostContentSettingsMapTest() : ui_thread_(BrowserThread::UI, &message_loop_) {
@@ -913,6 +931,75 @@ TEST_F(HostContentSettingsMapTest, GetContentSetting) {
                 embedder, host, CONTENT_SETTINGS_TYPE_IMAGES, std::string()));
 }
 
+// Cached settings are shared by URLs which patterns cannot tell apart, but
+// not by file: URLs with different paths.
+TEST_F(HostContentSettingsMapTest, CachedSettingsFollowPatterns) {
+  TestingProfile profile;
+  HostContentSettingsMap* host_content_settings_map =
+      profile.GetHostContentSettingsMap();
+
+  GURL page("http://www.example.com/page.html");
+  GURL image("http://www.example.com/images/1.png?size=2");
+  GURL other_port("http://www.example.com:8080/page.html");
+  host_content_settings_map->SetContentSetting(
+      ContentSettingsPattern::FromString("http://[*.]example.com:80"),
+      ContentSettingsPattern::Wildcard(),
+      CONTENT_SETTINGS_TYPE_IMAGES,
+      std::string(),
+      CONTENT_SETTING_BLOCK);
+  EXPECT_EQ(CONTENT_SETTING_BLOCK,
+            host_content_settings_map->GetContentSetting(
+                page, page, CONTENT_SETTINGS_TYPE_IMAGES, std::string()));
+  EXPECT_EQ(CONTENT_SETTING_BLOCK,
+            host_content_settings_map->GetContentSetting(
+                image, page, CONTENT_SETTINGS_TYPE_IMAGES, std::string()));
+  EXPECT_EQ(CONTENT_SETTING_ALLOW,
+            host_content_settings_map->GetContentSetting(
+                other_port, page, CONTENT_SETTINGS_TYPE_IMAGES,
+                std::string()));
+
+  GURL file1("file:///tmp/1.html");
+  GURL file2("file:///tmp/2.html");
+  host_content_settings_map->SetContentSetting(
+      ContentSettingsPattern::FromURLNoWildcard(file1),
+      ContentSettingsPattern::Wildcard(),
+      CONTENT_SETTINGS_TYPE_IMAGES,
+      std::string(),
+      CONTENT_SETTING_BLOCK);
+  EXPECT_EQ(CONTENT_SETTING_BLOCK,
+            host_content_settings_map->GetContentSetting(
+                file1, file1, CONTENT_SETTINGS_TYPE_IMAGES, std::string()));
+  EXPECT_EQ(CONTENT_SETTING_ALLOW,
+            host_content_settings_map->GetContentSetting(
+                file2, file2, CONTENT_SETTINGS_TYPE_IMAGES, std::string()));
+}
+
+// The settings cache is shared by the UI and IO threads, so looking up
+// settings on both at once must not share the cached values.
+TEST_F(HostContentSettingsMapTest, CachedSettingsAcrossThreads) {
+  TestingProfile profile;
+  HostContentSettingsMap* host_content_settings_map =
+      profile.GetHostContentSettingsMap();
+  host_content_settings_map->SetContentSetting(
+      ContentSettingsPattern::FromString("http://[*.]example.com"),
+      ContentSettingsPattern::Wildcard(),
+      CONTENT_SETTINGS_TYPE_IMAGES,
+      std::string(),
+      CONTENT_SETTING_BLOCK);
+
+  base::Thread thread("LookUpImageSettings");
+  ASSERT_TRUE(thread.Start());
+  for (int i = 0; i < 10; ++i) {
+    thread.message_loop()->PostTask(
+        FROM_HERE,
+        base::Bind(&LookUpImageSettings,
+                   base::Unretained(host_content_settings_map)));
+  }
+  for (int i = 0; i < 10; ++i)
+    LookUpImageSettings(host_content_settings_map);
+  thread.Stop();
+}
+
 TEST_F(HostContentSettingsMapTest, ShouldAllowAllContent) {
   TestingProfile profile;
   HostContentSettingsMap* host_content_settings_map =
@@ -1313,6 +1313,7 @@ bool ExtensionWebRequestEventRouter::AddEventListener(
     return false;
   }
   listeners_[profile][event_name].insert(listener);
+  RebuildListenerIndex(profile, event_name);
   return true;
 }
 
@@ -1346,10 +1347,34 @@ void ExtensionWebRequestEventRouter::RemoveEventListener(
   }
 
   listeners_[profile][event_name].erase(listener);
+  RebuildListenerIndex(profile, event_name);
 
   helpers::ClearCacheOnNavigation();
 }
 
+void ExtensionWebRequestEventRouter::RebuildListenerIndex(
+    void* profile,
+    const std::string& event_name) {
+  IndexedListenerMapForProfile& indexed_for_profile =
+      indexed_listeners_[profile];
+  const std::set<EventListener>& listeners = listeners_[profile][event_name];
+  if (listeners.empty()) {
+    indexed_for_profile.erase(event_name);
+    return;
+  }
+
+  // Elements of a std::set do not move, so the index can point at them until
+  // the next insertion or removal.
+  linked_ptr<IndexedListeners> indexed(new IndexedListeners);
+  for (std::set<EventListener>::const_iterator it = listeners.begin();
+       it != listeners.end(); ++it) {
+    indexed->index.Add(indexed->listeners.size(), it->filter.urls,
+                       it->filter.types, it->filter.tab_id);
+    indexed->listeners.push_back(&(*it));
+  }
+  indexed_for_profile[event_name] = indexed;
+}
+
 void ExtensionWebRequestEventRouter::RemoveWebViewEventListeners(
     void* profile,
     const std::string& extension_id,
@@ -1475,39 +1500,50 @@ void ExtensionWebRequestEventRouter::GetMatchingListenersImpl(
   if (is_web_view_guest)
     web_request_event_name.replace(0, sizeof(kWebRequest) - 1, kWebView);
 
-  std::set<EventListener>& listeners =
-      listeners_[profile][web_request_event_name];
-  for (std::set<EventListener>::iterator it = listeners.begin();
-       it != listeners.end(); ++it) {
-    if (!it->ipc_sender.get()) {
+  IndexedListenerMapForProfile& indexed_for_profile =
+      indexed_listeners_[profile];
+  IndexedListenerMapForProfile::const_iterator indexed =
+      indexed_for_profile.find(web_request_event_name);
+  if (indexed == indexed_for_profile.end())
+    return;
+
+  // Only the listeners whose resource type, tab and host filters can match
+  // are checked further.
+  std::vector<size_t> candidates;
+  indexed->second->index.GetCandidates(url, resource_type, tab_id,
+                                       &candidates);
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    const EventListener* listener = indexed->second->listeners[candidates[i]];
+    if (!listener->ipc_sender.get()) {
       // The IPC sender has been deleted. This listener will be removed soon
       // via a call to RemoveEventListener. For now, just skip it.
       continue;
     }
 
     if (is_web_view_guest &&
-        (it->embedder_process_id != web_view_info.embedder_process_id ||
-         it->webview_instance_id != web_view_info.instance_id))
+        (listener->embedder_process_id != web_view_info.embedder_process_id ||
+         listener->webview_instance_id != web_view_info.instance_id))
       continue;
 
-    if (!it->filter.urls.is_empty() && !it->filter.urls.MatchesURL(url))
+    const RequestFilter& filter = listener->filter;
+    if (!filter.urls.is_empty() && !filter.urls.MatchesURL(url))
       continue;
-    if (it->filter.tab_id != -1 && tab_id != it->filter.tab_id)
+    if (filter.tab_id != -1 && tab_id != filter.tab_id)
       continue;
-    if (it->filter.window_id != -1 && window_id != it->filter.window_id)
+    if (filter.window_id != -1 && window_id != filter.window_id)
       continue;
-    if (!it->filter.types.empty() &&
-        std::find(it->filter.types.begin(), it->filter.types.end(),
-                  resource_type) == it->filter.types.end())
+    if (!filter.types.empty() &&
+        std::find(filter.types.begin(), filter.types.end(),
+                  resource_type) == filter.types.end())
       continue;
 
     if (!is_web_view_guest && !WebRequestPermissions::CanExtensionAccessURL(
-            extension_info_map, it->extension_id, url, crosses_incognito,
+            extension_info_map, listener->extension_id, url, crosses_incognito,
             WebRequestPermissions::REQUIRE_HOST_PERMISSION))
       continue;
 
     bool blocking_listener =
-        (it->extra_info_spec &
+        (listener->extra_info_spec &
             (ExtraInfoSpec::BLOCKING | ExtraInfoSpec::ASYNC_BLOCKING)) != 0;
 
     // We do not want to notify extensions about XHR requests that are
@@ -1523,8 +1559,8 @@ void ExtensionWebRequestEventRouter::GetMatchingListenersImpl(
     if (blocking_listener && synchronous_xhr_from_extension)
       continue;
 
-    matching_listeners->push_back(&(*it));
-    *extra_info_spec |= it->extra_info_spec;
+    matching_listeners->push_back(listener);
+    *extra_info_spec |= listener->extra_info_spec;
   }
 }
 
@@ -11,12 +11,14 @@
 #include <string>
 #include <vector>
 
+#include "base/memory/linked_ptr.h"
 #include "base/memory/singleton.h"
 #include "base/memory/weak_ptr.h"
 #include "base/time/time.h"
 #include "chrome/browser/extensions/api/declarative/rules_registry_service.h"
 #include "chrome/browser/extensions/api/declarative_webrequest/request_stage.h"
 #include "chrome/browser/extensions/api/web_request/web_request_api_helpers.h"
+#include "chrome/browser/extensions/api/web_request/web_request_listener_index.h"
 #include "chrome/browser/extensions/api/web_request/web_request_permissions.h"
 #include "extensions/browser/browser_context_keyed_api_factory.h"
 #include "extensions/browser/event_router.h"
@@ -313,6 +315,15 @@ class ExtensionWebRequestEventRouter
   struct EventListener;
   typedef std::map<std::string, std::set<EventListener> > ListenerMapForProfile;
   typedef std::map<void*, ListenerMapForProfile> ListenerMap;
+  // The listeners to one event, in |listeners_| order, and a dispatch index
+  // over their filters.  Rebuilt whenever a listener is added or removed.
+  struct IndexedListeners {
+    std::vector<const EventListener*> listeners;
+    ExtensionWebRequestListenerIndex index;
+  };
+  typedef std::map<std::string, linked_ptr<IndexedListeners> >
+      IndexedListenerMapForProfile;
+  typedef std::map<void*, IndexedListenerMapForProfile> IndexedListenerMap;
   typedef std::map<uint64, BlockedRequest> BlockedRequestMap;
   // Map of request_id -> bit vector of EventTypes already signaled
   typedef std::map<uint64, int> SignaledRequestMap;
@@ -364,6 +375,10 @@ class ExtensionWebRequestEventRouter
       std::vector<const ExtensionWebRequestEventRouter::EventListener*>*
           matching_listeners);
 
+  // Rebuilds the entry in |indexed_listeners_| for |event_name| from
+  // |listeners_|.  Must be called after any change to the set of listeners.
+  void RebuildListenerIndex(void* profile, const std::string& event_name);
+
   // Decrements the count of event handlers blocking the given request. When the
   // count reaches 0, we stop blocking the request and proceed it using the
   // method requested by the extension with the highest precedence. Precedence
@@ -439,6 +454,10 @@ class ExtensionWebRequestEventRouter
   // are listening to that event.
   ListenerMap listeners_;
 
+  // Dispatch indices over |listeners_|, used to find the listeners for a
+  // request without checking every filter.
+  IndexedListenerMap indexed_listeners_;
+
   // A map of network requests that are waiting for at least one event handler
   // to respond.
   BlockedRequestMap blocked_requests_;
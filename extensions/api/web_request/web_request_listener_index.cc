@@ -0,0 +1,148 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/extensions/api/web_request/web_request_listener_index.h"
+
+#include <algorithm>
+
+#include "base/strings/string_util.h"
+#include "extensions/common/url_pattern.h"
+#include "extensions/common/url_pattern_set.h"
+#include "url/gurl.h"
+
+using extensions::URLPattern;
+using extensions::URLPatternSet;
+
+namespace {
+
+void AppendPositions(const std::vector<size_t>& source,
+                     std::vector<size_t>* positions) {
+  positions->insert(positions->end(), source.begin(), source.end());
+}
+
+}  // namespace
+
+ExtensionWebRequestListenerIndex::Bucket::Bucket() {}
+
+ExtensionWebRequestListenerIndex::Bucket::~Bucket() {}
+
+void ExtensionWebRequestListenerIndex::Bucket::Add(size_t position,
+                                                   const URLPatternSet& urls) {
+  if (urls.is_empty()) {
+    any_host.push_back(position);
+    return;
+  }
+
+  bool added_any_host = false;
+  for (URLPatternSet::const_iterator it = urls.begin(); it != urls.end();
+       ++it) {
+    // "*" matches every host.  An empty host without the wildcard (e.g.
+    // file:///*) only matches URLs without a host, and is indexed under "".
+    if (it->match_all_urls() ||
+        (it->host().empty() && it->match_subdomains())) {
+      if (!added_any_host)
+        any_host.push_back(position);
+      added_any_host = true;
+      continue;
+    }
+
+    // URL hosts are canonicalized to lower case.
+    HostMap& hosts = it->match_subdomains() ? subdomain_hosts : exact_hosts;
+    std::vector<size_t>& host_positions =
+        hosts[StringToLowerASCII(it->host())];
+    if (host_positions.empty() || host_positions.back() != position)
+      host_positions.push_back(position);
+  }
+}
+
+void ExtensionWebRequestListenerIndex::Bucket::GetCandidates(
+    const std::string& host,
+    std::vector<size_t>* positions) const {
+  AppendPositions(any_host, positions);
+
+  HostMap::const_iterator found = exact_hosts.find(host);
+  if (found != exact_hosts.end())
+    AppendPositions(found->second, positions);
+
+  if (host.empty() || subdomain_hosts.empty())
+    return;
+
+  // Try |host| and each of its parent domains.
+  size_t start = 0;
+  while (start != std::string::npos) {
+    found = subdomain_hosts.find(host.substr(start));
+    if (found != subdomain_hosts.end())
+      AppendPositions(found->second, positions);
+    start = host.find('.', start);
+    if (start != std::string::npos)
+      ++start;
+  }
+}
+
+ExtensionWebRequestListenerIndex::ExtensionWebRequestListenerIndex()
+    : size_(0) {
+}
+
+ExtensionWebRequestListenerIndex::~ExtensionWebRequestListenerIndex() {}
+
+void ExtensionWebRequestListenerIndex::Add(
+    size_t position,
+    const URLPatternSet& urls,
+    const std::vector<ResourceType::Type>& types,
+    int tab_id) {
+  ++size_;
+
+  // The tab is the most selective key, so listeners filtering on one are only
+  // indexed by it.
+  if (tab_id != -1) {
+    by_tab_[tab_id].Add(position, urls);
+    return;
+  }
+
+  if (types.empty()) {
+    all_types_.Add(position, urls);
+    return;
+  }
+
+  for (size_t i = 0; i < types.size(); ++i) {
+    if (types[i] >= 0 && types[i] < ResourceType::LAST_TYPE)
+      by_type_[types[i]].Add(position, urls);
+  }
+}
+
+void ExtensionWebRequestListenerIndex::Clear() {
+  all_types_ = Bucket();
+  for (size_t i = 0; i < arraysize(by_type_); ++i)
+    by_type_[i] = Bucket();
+  by_tab_.clear();
+  size_ = 0;
+}
+
+void ExtensionWebRequestListenerIndex::GetCandidates(
+    const GURL& url,
+    ResourceType::Type resource_type,
+    int tab_id,
+    std::vector<size_t>* positions) const {
+  positions->clear();
+
+  // URLPattern matches filesystem: URLs against their inner URL.
+  const GURL* host_url = &url;
+  if (url.SchemeIsFileSystem() && url.inner_url())
+    host_url = url.inner_url();
+  const std::string& host = host_url->host();
+
+  all_types_.GetCandidates(host, positions);
+  if (resource_type >= 0 && resource_type < ResourceType::LAST_TYPE)
+    by_type_[resource_type].GetCandidates(host, positions);
+  if (tab_id != -1) {
+    std::map<int, Bucket>::const_iterator found = by_tab_.find(tab_id);
+    if (found != by_tab_.end())
+      found->second.GetCandidates(host, positions);
+  }
+
+  // A listener can be found through several of its patterns or types.
+  std::sort(positions->begin(), positions->end());
+  positions->erase(std::unique(positions->begin(), positions->end()),
+                   positions->end());
+}
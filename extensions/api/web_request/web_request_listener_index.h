@@ -0,0 +1,94 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_EXTENSIONS_API_WEB_REQUEST_WEB_REQUEST_LISTENER_INDEX_H_
+#define CHROME_BROWSER_EXTENSIONS_API_WEB_REQUEST_WEB_REQUEST_LISTENER_INDEX_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/containers/hash_tables.h"
+#include "webkit/common/resource_type.h"
+
+class GURL;
+
+namespace extensions {
+class URLPatternSet;
+}
+
+// Dispatch index over the request filters of the listeners to one webRequest
+// event.  Listeners are identified by their position in the event's listener
+// list.  For a request, the index returns the listeners whose filters could
+// match its resource type, tab and host, without evaluating any URL patterns.
+// Listeners are indexed by tab if they filter on one, and by resource type and
+// pattern host otherwise.  Hosts are looked up once per label suffix, so a
+// pattern for "*.example.com" is found from "www.example.com".
+//
+// The candidates are a superset of the matching listeners; callers still
+// check the full filter (patterns, window, permissions) of each candidate.
+// The index is immutable between rebuilds, which happen when listeners are
+// added or removed.
+class ExtensionWebRequestListenerIndex {
+ public:
+  ExtensionWebRequestListenerIndex();
+  ~ExtensionWebRequestListenerIndex();
+
+  // Adds listener number |position| with the given filter.  |types| and
+  // |urls| match everything when empty, as does a |tab_id| of -1.
+  void Add(size_t position,
+           const extensions::URLPatternSet& urls,
+           const std::vector<ResourceType::Type>& types,
+           int tab_id);
+
+  // Removes all listeners.
+  void Clear();
+
+  // Sets |positions| to the listeners whose filters may match a request for
+  // |url| with |resource_type| from |tab_id|, in increasing order.
+  void GetCandidates(const GURL& url,
+                     ResourceType::Type resource_type,
+                     int tab_id,
+                     std::vector<size_t>* positions) const;
+
+  size_t size() const { return size_; }
+
+ private:
+  typedef base::hash_map<std::string, std::vector<size_t> > HostMap;
+
+  // Listeners sharing a resource type or tab, split by pattern host.
+  struct Bucket {
+    Bucket();
+    ~Bucket();
+
+    void Add(size_t position, const extensions::URLPatternSet& urls);
+    void GetCandidates(const std::string& host,
+                       std::vector<size_t>* positions) const;
+
+    // Listeners with a pattern that can match any host.
+    std::vector<size_t> any_host;
+
+    // Listeners with a pattern for exactly this host.
+    HostMap exact_hosts;
+
+    // Listeners with a pattern for this host and its subdomains.
+    HostMap subdomain_hosts;
+  };
+
+  // Listeners without resource type or tab filters.
+  Bucket all_types_;
+
+  // Listeners without a tab filter, by the resource types they accept.
+  Bucket by_type_[ResourceType::LAST_TYPE];
+
+  // Listeners limited to one tab.
+  std::map<int, Bucket> by_tab_;
+
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(ExtensionWebRequestListenerIndex);
+};
+
+#endif  // CHROME_BROWSER_EXTENSIONS_API_WEB_REQUEST_WEB_REQUEST_LISTENER_INDEX_H_
@@ -0,0 +1,168 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "chrome/browser/extensions/api/web_request/web_request_listener_index.h"
+#include "chrome/browser/test/base/synthetic_random.h"
+#include "extensions/common/url_pattern.h"
+#include "extensions/common/url_pattern_set.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+#include "url/gurl.h"
+
+using extensions::URLPattern;
+using extensions::URLPatternSet;
+
+namespace {
+
+const size_t kExtensionCounts[] = { 10, 100, 1000 };
+const size_t kRequestCount = 10000;
+const size_t kSiteCount = 500;
+
+// The events a request passes through, in order.  Each gets its own listener
+// mix, as extensions rarely listen to all of them.
+const char* kStages[] = {
+  "onBeforeRequest",
+  "onBeforeSendHeaders",
+  "onSendHeaders",
+  "onHeadersReceived",
+  "onResponseStarted",
+  "onCompleted",
+};
+
+const ResourceType::Type kResourceTypes[] = {
+  ResourceType::MAIN_FRAME,
+  ResourceType::SUB_FRAME,
+  ResourceType::STYLESHEET,
+  ResourceType::SCRIPT,
+  ResourceType::IMAGE,
+  ResourceType::XHR,
+};
+
+struct SyntheticListener {
+  URLPatternSet urls;
+  std::vector<ResourceType::Type> types;
+};
+
+struct SyntheticRequest {
+  GURL url;
+  ResourceType::Type type;
+};
+
+std::string SiteName(size_t site) {
+  return base::StringPrintf("site%u.example", static_cast<unsigned>(site));
+}
+
+// About a fifth of the listeners watch <all_urls>; the rest watch a few hosts
+// or domains.  Half filter on resource types.
+void BuildListeners(size_t count,
+                    SyntheticRandom* random,
+                    std::vector<SyntheticListener>* listeners) {
+  listeners->resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    SyntheticListener& listener = (*listeners)[i];
+    if (random->Next() % 5 == 0) {
+      listener.urls.AddPattern(
+          URLPattern(URLPattern::SCHEME_ALL, "<all_urls>"));
+    } else {
+      size_t patterns = 1 + random->Next() % 3;
+      for (size_t j = 0; j < patterns; ++j) {
+        const std::string site = SiteName(random->Next() % kSiteCount);
+        const std::string pattern = random->Next() % 2 ?
+            "*://*." + site + "/*" : "https://www." + site + "/*";
+        listener.urls.AddPattern(
+            URLPattern(URLPattern::SCHEME_ALL, pattern));
+      }
+    }
+    if (random->Next() % 2) {
+      listener.types.push_back(
+          kResourceTypes[random->Next() % arraysize(kResourceTypes)]);
+    }
+  }
+}
+
+void BuildRequests(SyntheticRandom* random,
+                   std::vector<SyntheticRequest>* requests) {
+  requests->resize(kRequestCount);
+  for (size_t i = 0; i < kRequestCount; ++i) {
+    (*requests)[i].url = GURL(base::StringPrintf(
+        "https://%s.%s/path/%u",
+        random->Next() % 2 ? "www" : "static",
+        SiteName(random->Next() % kSiteCount).c_str(),
+        static_cast<unsigned>(random->Next())));
+    (*requests)[i].type =
+        kResourceTypes[random->Next() % arraysize(kResourceTypes)];
+  }
+}
+
+// The filter check GetMatchingListenersImpl() does for each listener.
+bool Matches(const SyntheticListener& listener,
+             const SyntheticRequest& request) {
+  if (!listener.urls.is_empty() && !listener.urls.MatchesURL(request.url))
+    return false;
+  return listener.types.empty() ||
+      std::find(listener.types.begin(), listener.types.end(), request.type) !=
+          listener.types.end();
+}
+
+}  // namespace
+
+TEST(ExtensionWebRequestListenerIndexPerfTest, Dispatch) {
+  SyntheticRandom random(12345);
+  std::vector<SyntheticRequest> requests;
+  BuildRequests(&random, &requests);
+
+  for (size_t c = 0; c < arraysize(kExtensionCounts); ++c) {
+    for (size_t s = 0; s < arraysize(kStages); ++s) {
+      std::vector<SyntheticListener> listeners;
+      BuildListeners(kExtensionCounts[c], &random, &listeners);
+
+      ExtensionWebRequestListenerIndex index;
+      for (size_t i = 0; i < listeners.size(); ++i)
+        index.Add(i, listeners[i].urls, listeners[i].types, -1);
+
+      size_t linear_matches = 0;
+      base::TimeTicks start = base::TimeTicks::HighResNow();
+      for (size_t r = 0; r < requests.size(); ++r) {
+        for (size_t i = 0; i < listeners.size(); ++i) {
+          if (Matches(listeners[i], requests[r]))
+            ++linear_matches;
+        }
+      }
+      const base::TimeDelta linear = base::TimeTicks::HighResNow() - start;
+
+      size_t indexed_matches = 0;
+      std::vector<size_t> candidates;
+      start = base::TimeTicks::HighResNow();
+      for (size_t r = 0; r < requests.size(); ++r) {
+        index.GetCandidates(requests[r].url, requests[r].type, -1,
+                            &candidates);
+        for (size_t i = 0; i < candidates.size(); ++i) {
+          if (Matches(listeners[candidates[i]], requests[r]))
+            ++indexed_matches;
+        }
+      }
+      const base::TimeDelta indexed = base::TimeTicks::HighResNow() - start;
+
+      EXPECT_EQ(linear_matches, indexed_matches);
+
+      const std::string trace = base::StringPrintf(
+          "%s_%u", kStages[s], static_cast<unsigned>(kExtensionCounts[c]));
+      perf_test::PrintResult("webrequest_dispatch", "_linear", trace,
+                             linear.InMicroseconds() /
+                                 static_cast<double>(requests.size()),
+                             "us/request", true);
+      perf_test::PrintResult("webrequest_dispatch", "_indexed", trace,
+                             indexed.InMicroseconds() /
+                                 static_cast<double>(requests.size()),
+                             "us/request", true);
+    }
+  }
+}
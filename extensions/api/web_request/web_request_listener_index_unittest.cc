@@ -0,0 +1,176 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/extensions/api/web_request/web_request_listener_index.h"
+
+#include <algorithm>
+
+#include "extensions/common/url_pattern.h"
+#include "extensions/common/url_pattern_set.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "url/gurl.h"
+
+using extensions::URLPattern;
+using extensions::URLPatternSet;
+
+namespace {
+
+struct TestFilter {
+  const char* patterns[2];
+  ResourceType::Type type;  // LAST_TYPE for no type filter.
+  int tab_id;
+};
+
+const TestFilter kFilters[] = {
+  { { NULL, NULL }, ResourceType::LAST_TYPE, -1 },
+  { { "http://www.example.com/*", NULL }, ResourceType::LAST_TYPE, -1 },
+  { { "*://*.example.com/*", NULL }, ResourceType::IMAGE, -1 },
+  { { "<all_urls>", NULL }, ResourceType::LAST_TYPE, 5 },
+  { { "*://*/*", NULL }, ResourceType::SCRIPT, -1 },
+  { { "https://other.org/*", "*://*.example.com/*" },
+    ResourceType::LAST_TYPE, -1 },
+  { { "file:///*", NULL }, ResourceType::LAST_TYPE, -1 },
+  { { "http://127.0.0.1/*", NULL }, ResourceType::MAIN_FRAME, 7 },
+};
+
+class ExtensionWebRequestListenerIndexTest : public testing::Test {
+ protected:
+  virtual void SetUp() OVERRIDE {
+    for (size_t i = 0; i < arraysize(kFilters); ++i) {
+      URLPatternSet urls;
+      for (size_t j = 0; j < arraysize(kFilters[i].patterns); ++j) {
+        if (kFilters[i].patterns[j]) {
+          urls.AddPattern(
+              URLPattern(URLPattern::SCHEME_ALL, kFilters[i].patterns[j]));
+        }
+      }
+      std::vector<ResourceType::Type> types;
+      if (kFilters[i].type != ResourceType::LAST_TYPE)
+        types.push_back(kFilters[i].type);
+
+      index_.Add(i, urls, types, kFilters[i].tab_id);
+      urls_.push_back(urls);
+      types_.push_back(types);
+    }
+  }
+
+  // Returns the listeners whose filters match, checked one by one.
+  std::vector<size_t> GetMatches(const GURL& url,
+                                 ResourceType::Type resource_type,
+                                 int tab_id) {
+    std::vector<size_t> matches;
+    for (size_t i = 0; i < arraysize(kFilters); ++i) {
+      if (!urls_[i].is_empty() && !urls_[i].MatchesURL(url))
+        continue;
+      if (kFilters[i].tab_id != -1 && kFilters[i].tab_id != tab_id)
+        continue;
+      if (!types_[i].empty() &&
+          std::find(types_[i].begin(), types_[i].end(), resource_type) ==
+              types_[i].end()) {
+        continue;
+      }
+      matches.push_back(i);
+    }
+    return matches;
+  }
+
+  std::vector<size_t> GetCandidates(const GURL& url,
+                                    ResourceType::Type resource_type,
+                                    int tab_id) {
+    std::vector<size_t> candidates;
+    index_.GetCandidates(url, resource_type, tab_id, &candidates);
+    return candidates;
+  }
+
+  ExtensionWebRequestListenerIndex index_;
+  std::vector<URLPatternSet> urls_;
+  std::vector<std::vector<ResourceType::Type> > types_;
+};
+
+std::vector<size_t> Positions(size_t count, const size_t* positions) {
+  return std::vector<size_t>(positions, positions + count);
+}
+
+}  // namespace
+
+TEST_F(ExtensionWebRequestListenerIndexTest, Candidates) {
+  EXPECT_EQ(arraysize(kFilters), index_.size());
+
+  const size_t kWww[] = { 0, 1, 5 };
+  EXPECT_EQ(Positions(arraysize(kWww), kWww),
+            GetCandidates(GURL("http://www.example.com/a"),
+                          ResourceType::MAIN_FRAME, 1));
+
+  const size_t kWwwImageTab5[] = { 0, 1, 2, 3, 5 };
+  EXPECT_EQ(Positions(arraysize(kWwwImageTab5), kWwwImageTab5),
+            GetCandidates(GURL("http://www.example.com/a"),
+                          ResourceType::IMAGE, 5));
+
+  const size_t kDomainScript[] = { 0, 4, 5 };
+  EXPECT_EQ(Positions(arraysize(kDomainScript), kDomainScript),
+            GetCandidates(GURL("https://example.com/"),
+                          ResourceType::SCRIPT, -1));
+
+  // Subdomain patterns only match at label boundaries.
+  const size_t kOtherDomain[] = { 0 };
+  EXPECT_EQ(Positions(arraysize(kOtherDomain), kOtherDomain),
+            GetCandidates(GURL("http://notexample.com/"),
+                          ResourceType::MAIN_FRAME, -1));
+
+  const size_t kFile[] = { 0, 6 };
+  EXPECT_EQ(Positions(arraysize(kFile), kFile),
+            GetCandidates(GURL("file:///tmp/file.html"),
+                          ResourceType::MAIN_FRAME, -1));
+
+  // Requests without a known resource type only match unfiltered listeners.
+  const size_t kUnknownType[] = { 0, 1, 5 };
+  EXPECT_EQ(Positions(arraysize(kUnknownType), kUnknownType),
+            GetCandidates(GURL("http://www.example.com/a"),
+                          ResourceType::LAST_TYPE, -1));
+
+  index_.Clear();
+  EXPECT_EQ(0u, index_.size());
+  EXPECT_TRUE(GetCandidates(GURL("http://www.example.com/a"),
+                            ResourceType::MAIN_FRAME, -1).empty());
+}
+
+// The candidates must include every listener whose filter matches.
+TEST_F(ExtensionWebRequestListenerIndexTest, CandidatesIncludeMatches) {
+  const char* kUrls[] = {
+    "http://www.example.com/",
+    "https://a.b.example.com:8080/path?query",
+    "http://example.com./",
+    "https://other.org/",
+    "https://www.other.org/",
+    "http://127.0.0.1/",
+    "http://[::1]/",
+    "file:///etc/hosts",
+    "filesystem:http://www.example.com/temporary/file",
+    "data:text/plain,hello",
+    "about:blank",
+    "ftp://ftp.example.com/pub",
+  };
+  const ResourceType::Type kTypes[] = {
+    ResourceType::MAIN_FRAME,
+    ResourceType::IMAGE,
+    ResourceType::SCRIPT,
+    ResourceType::LAST_TYPE,
+  };
+  const int kTabs[] = { -1, 5, 7 };
+
+  for (size_t i = 0; i < arraysize(kUrls); ++i) {
+    const GURL url(kUrls[i]);
+    for (size_t j = 0; j < arraysize(kTypes); ++j) {
+      for (size_t k = 0; k < arraysize(kTabs); ++k) {
+        const std::vector<size_t> candidates =
+            GetCandidates(url, kTypes[j], kTabs[k]);
+        const std::vector<size_t> matches =
+            GetMatches(url, kTypes[j], kTabs[k]);
+        EXPECT_TRUE(std::includes(candidates.begin(), candidates.end(),
+                                  matches.begin(), matches.end()))
+            << kUrls[i] << " type " << kTypes[j] << " tab " << kTabs[k];
+      }
+    }
+  }
+}
@@ -422,9 +422,13 @@ void ExtensionService::Init() {
     // extension listens to onStartup and opens a window).
     SetReadyAndNotifyListeners();
   } else {
-    // LoadAllExtensions() calls OnLoadedInstalledExtensions().
+    // The installed extensions are created on the blocking pool while the
+    // component extensions load.  LoadAllExtensions() calls
+    // OnLoadedInstalledExtensions().
+    extensions::InstalledLoader installed_loader(this);
+    installed_loader.StartCreatingExtensions();
     component_loader_->LoadAll();
-    extensions::InstalledLoader(this).LoadAllExtensions();
+    installed_loader.LoadAllExtensions();
 
     ReconcileKnownDisabled();
 
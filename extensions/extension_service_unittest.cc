@@ -1299,6 +1299,85 @@ TEST_F(ExtensionServiceTest, LoadAllExtensionsFromDirectoryFail) {
       base::UTF16ToUTF8(GetErrors()[3]);
 };
 
+// Test that an extension whose manifest in the preferences is corrupt is
+// loaded from disk, in its original place, and that the manifest from disk
+// is written back to the preferences.
+TEST_F(ExtensionServiceTest, LoadAllExtensionsReloadsCorruptManifest) {
+  InitPluginService();
+  InitializeGoodInstalledExtensionService();
+
+  // A manifest with both a background page and background scripts is
+  // corrupt, and can not be created from the preferences.
+  SetPref(good1, "manifest.background.page",
+          new base::StringValue("background.html"), "background page");
+  base::ListValue* scripts = new base::ListValue();
+  scripts->Append(new base::StringValue("stale.js"));
+  SetPref(good1, "manifest.background.scripts", scripts, "background scripts");
+
+  service()->Init();
+
+  EXPECT_EQ(0u, GetErrors().size());
+  ASSERT_EQ(3u, loaded_.size());
+  EXPECT_EQ(std::string(good0), loaded_[0]->id());
+  EXPECT_EQ(std::string(good1), loaded_[1]->id());
+  EXPECT_EQ(std::string(good2), loaded_[2]->id());
+  EXPECT_EQ(loaded_[1]->GetResourceURL("background.html"),
+            extensions::BackgroundInfo::GetBackgroundURL(loaded_[1].get()));
+
+  const base::DictionaryValue* dict =
+      profile()->GetPrefs()->GetDictionary("extensions.settings");
+  ASSERT_TRUE(dict);
+  EXPECT_TRUE(dict->HasKey(std::string(good1) + ".manifest"));
+  EXPECT_FALSE(dict->HasKey(std::string(good1) +
+                            ".manifest.background.scripts"));
+}
+
+// Test that an extension whose manifest can not be reloaded from disk is
+// reported, and then created from the manifest in the preferences.
+TEST_F(ExtensionServiceTest, LoadAllExtensionsFallsBackOnReloadFailure) {
+  InitPluginService();
+  InitializeGoodInstalledExtensionService();
+
+  // Unpacked extensions are always reloaded, from their absolute path.
+  base::FilePath missing_path =
+      extensions_install_dir().AppendASCII("missing");
+  SetPrefInteg(good2, "location", Manifest::UNPACKED);
+  SetPref(good2, "path", new base::StringValue(missing_path.value()),
+          "path");
+
+  service()->Init();
+
+  ASSERT_EQ(1u, GetErrors().size());
+  EXPECT_TRUE(MatchPattern(base::UTF16ToUTF8(GetErrors()[0]),
+      "Could not load extension from '*'. *")) <<
+      base::UTF16ToUTF8(GetErrors()[0]);
+
+  ASSERT_EQ(3u, loaded_.size());
+  EXPECT_EQ(std::string(good0), loaded_[0]->id());
+  EXPECT_EQ(std::string(good1), loaded_[1]->id());
+  EXPECT_EQ(std::string(good2), loaded_[2]->id());
+  EXPECT_EQ(std::string("My extension 3"), loaded_[2]->name());
+  EXPECT_EQ(Manifest::UNPACKED, loaded_[2]->location());
+  EXPECT_EQ(missing_path, loaded_[2]->path());
+}
+
+// Test that extensions whose creation was started early are all loaded, in
+// order, by LoadAllExtensions().
+TEST_F(ExtensionServiceTest, LoadAllExtensionsAfterStartCreating) {
+  InitPluginService();
+  InitializeGoodInstalledExtensionService();
+
+  extensions::InstalledLoader installed_loader(service());
+  installed_loader.StartCreatingExtensions();
+  installed_loader.LoadAllExtensions();
+
+  EXPECT_EQ(0u, GetErrors().size());
+  ASSERT_EQ(3u, loaded_.size());
+  EXPECT_EQ(std::string(good0), loaded_[0]->id());
+  EXPECT_EQ(std::string(good1), loaded_[1]->id());
+  EXPECT_EQ(std::string(good2), loaded_[2]->id());
+}
+
 // Test various cases for delayed install because of missing imports.
 TEST_F(ExtensionServiceTest, PendingImports) {
   InitPluginService();
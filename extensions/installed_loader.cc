@@ -4,11 +4,19 @@
 
 #include "chrome/browser/extensions/installed_loader.h"
 
+#include <algorithm>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/bind.h"
 #include "base/files/file_path.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/metrics/histogram.h"
 #include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/synchronization/waitable_event.h"
 #include "base/threading/thread_restrictions.h"
+#include "base/time/time.h"
 #include "base/values.h"
 #include "chrome/browser/browser_process.h"
 #include "chrome/browser/extensions/extension_action_manager.h"
@@ -21,6 +29,7 @@
 #include "chrome/common/extensions/extension_constants.h"
 #include "chrome/common/extensions/manifest_url_handler.h"
 #include "chrome/common/pref_names.h"
+#include "content/public/browser/browser_thread.h"
 #include "content/public/browser/notification_service.h"
 #include "content/public/browser/user_metrics.h"
 #include "extensions/browser/api/runtime/runtime_api.h"
@@ -134,8 +143,154 @@ void RecordCreationFlags(const Extension* extension) {
   }
 }
 
+// Creates the extension for |info| from the manifest in the preferences.
+scoped_refptr<const Extension> CreateExtension(const ExtensionInfo& info,
+                                               int creation_flags,
+                                               std::string* error) {
+  if (!info.extension_manifest) {
+    *error = errors::kManifestUnreadable;
+    return NULL;
+  }
+  return Extension::Create(info.extension_path,
+                           info.extension_location,
+                           *info.extension_manifest,
+                           creation_flags,
+                           error);
+}
+
+// The maximum number of blocking pool tasks InstalledExtensionCreator creates
+// extensions on at once.
+const int kMaxParallelCreateTasks = 4;
+
+// An installed extension for InstalledExtensionCreator to create, and the
+// outcome.
+struct CreateRequest {
+  CreateRequest(const ExtensionInfo* info,
+                int creation_flags,
+                ManifestReloadReason reload_reason)
+      : info(info),
+        creation_flags(creation_flags),
+        reload_reason(reload_reason),
+        reloaded(false) {}
+
+  const ExtensionInfo* info;
+  int creation_flags;
+  // Unless NOT_NEEDED, the manifest is reloaded from disk rather than taken
+  // from the preferences.
+  ManifestReloadReason reload_reason;
+
+  scoped_refptr<const Extension> extension;
+  std::string error;
+  // Set if the manifest was reloaded from disk.
+  bool reloaded;
+  // Set if reloading the manifest failed. The extension is then created from
+  // the manifest in the preferences.
+  std::string reload_error;
+  base::TimeDelta create_time;
+};
+
 }  // namespace
 
+// Creates the installed extensions on the blocking pool. Up to
+// kMaxParallelCreateTasks tasks each take the next request until none are
+// left. Finish() takes the remaining requests on the UI thread as well, so it
+// never waits for a task which has not started, only for the requests being
+// created when it is called.
+class InstalledExtensionCreator
+    : public base::RefCountedThreadSafe<InstalledExtensionCreator> {
+ public:
+  InstalledExtensionCreator(
+      scoped_ptr<ExtensionPrefs::ExtensionsInfo> extensions_info,
+      std::vector<CreateRequest>* requests)
+      : extensions_info_(extensions_info.Pass()),
+        next_request_(0),
+        pending_requests_(0),
+        done_(false, false) {
+    requests_.swap(*requests);
+  }
+
+  // Posts the tasks which create the extensions.
+  void Start() {
+    DCHECK_CURRENTLY_ON(BrowserThread::UI);
+    base::subtle::NoBarrier_Store(
+        &pending_requests_,
+        static_cast<base::subtle::Atomic32>(requests_.size()));
+    const int num_tasks = std::min(kMaxParallelCreateTasks,
+                                   static_cast<int>(requests_.size()));
+    for (int i = 0; i < num_tasks; ++i) {
+      // If the blocking pool is gone, Finish() fulfills the requests.
+      BrowserThread::PostBlockingPoolTask(
+          FROM_HERE,
+          base::Bind(&InstalledExtensionCreator::FulfillRequests, this));
+    }
+  }
+
+  // Creates the extensions no task has taken yet, waits for the others, and
+  // returns the fulfilled requests.
+  const std::vector<CreateRequest>& Finish() {
+    DCHECK_CURRENTLY_ON(BrowserThread::UI);
+    {
+      // Reloading an extension reads files from disk.  Reloads should be very
+      // rare, and the extension service has to know about all extensions once
+      // LoadAllExtensions() returns, so a reload no task has taken yet is done
+      // here.  See crbug.com/37548 for details.
+      base::ThreadRestrictions::ScopedAllowIO allow_io;
+      FulfillRequests();
+    }
+    if (base::subtle::Acquire_Load(&pending_requests_)) {
+      // Extension creation never waits on the UI thread, so this can not
+      // deadlock.
+      base::ThreadRestrictions::ScopedAllowWait allow_wait;
+      done_.Wait();
+    }
+    return requests_;
+  }
+
+ private:
+  friend class base::RefCountedThreadSafe<InstalledExtensionCreator>;
+
+  ~InstalledExtensionCreator() {}
+
+  void FulfillRequests() {
+    const base::subtle::Atomic32 num_requests = requests_.size();
+    for (;;) {
+      const base::subtle::Atomic32 index =
+          base::subtle::NoBarrier_AtomicIncrement(&next_request_, 1) - 1;
+      if (index >= num_requests)
+        break;
+      Fulfill(&requests_[index]);
+      if (!base::subtle::Barrier_AtomicIncrement(&pending_requests_, -1))
+        done_.Signal();
+    }
+  }
+
+  static void Fulfill(CreateRequest* request) {
+    const base::TimeTicks start_time = base::TimeTicks::Now();
+    const ExtensionInfo& info = *request->info;
+    if (request->reload_reason != NOT_NEEDED) {
+      request->extension = file_util::LoadExtension(info.extension_path,
+                                                    info.extension_location,
+                                                    request->creation_flags,
+                                                    &request->reload_error);
+      request->reloaded = request->extension.get() != NULL;
+    }
+    if (!request->reloaded) {
+      request->extension =
+          CreateExtension(info, request->creation_flags, &request->error);
+    }
+    request->create_time = base::TimeTicks::Now() - start_time;
+  }
+
+  // Owns the ExtensionInfo of every request.
+  scoped_ptr<ExtensionPrefs::ExtensionsInfo> extensions_info_;
+  std::vector<CreateRequest> requests_;
+  base::subtle::Atomic32 next_request_;
+  base::subtle::Atomic32 pending_requests_;
+  base::WaitableEvent done_;
+
+  DISALLOW_COPY_AND_ASSIGN(InstalledExtensionCreator);
+};
+
 InstalledLoader::InstalledLoader(ExtensionService* extension_service)
     : extension_service_(extension_service),
       extension_registry_(ExtensionRegistry::Get(extension_service->profile())),
@@ -146,17 +301,16 @@ InstalledLoader::~InstalledLoader() {
 
 void InstalledLoader::Load(const ExtensionInfo& info, bool write_to_prefs) {
   std::string error;
-  scoped_refptr<const Extension> extension(NULL);
-  if (info.extension_manifest) {
-    extension = Extension::Create(
-        info.extension_path,
-        info.extension_location,
-        *info.extension_manifest,
-        GetCreationFlags(&info),
-        &error);
-  } else {
-    error = errors::kManifestUnreadable;
-  }
+  scoped_refptr<const Extension> extension(
+      CreateExtension(info, GetCreationFlags(&info), &error));
+  AddExtension(info, extension, error, write_to_prefs);
+}
+
+void InstalledLoader::AddExtension(const ExtensionInfo& info,
+                                   scoped_refptr<const Extension> extension,
+                                   const std::string& creation_error,
+                                   bool write_to_prefs) {
+  std::string error(creation_error);
 
   // Once installed, non-unpacked extensions cannot change their IDs (e.g., by
   // updating the 'key' field in their manifest).
@@ -204,18 +358,14 @@ void InstalledLoader::Load(const ExtensionInfo& info, bool write_to_prefs) {
   extension_service_->AddExtension(extension.get());
 }
 
-void InstalledLoader::LoadAllExtensions() {
+void InstalledLoader::StartCreatingExtensions() {
   CHECK(BrowserThread::CurrentlyOn(BrowserThread::UI));
+  DCHECK(!creator_.get());
 
-  base::TimeTicks start_time = base::TimeTicks::Now();
-
-  Profile* profile = extension_service_->profile();
   scoped_ptr<ExtensionPrefs::ExtensionsInfo> extensions_info(
       extension_prefs_->GetInstalledExtensionsInfo());
 
-  std::vector<int> reload_reason_counts(NUM_MANIFEST_RELOAD_REASONS, 0);
-  bool should_write_prefs = false;
-
+  std::vector<CreateRequest> requests;
   for (size_t i = 0; i < extensions_info->size(); ++i) {
     ExtensionInfo* info = extensions_info->at(i).get();
 
@@ -224,45 +374,58 @@ void InstalledLoader::LoadAllExtensions() {
     if (info->extension_location == Manifest::COMMAND_LINE)
       continue;
 
-    ManifestReloadReason reload_reason = ShouldReloadExtensionManifest(*info);
-    ++reload_reason_counts[reload_reason];
+    requests.push_back(CreateRequest(
+        info, GetCreationFlags(info), ShouldReloadExtensionManifest(*info)));
+  }
 
-    if (reload_reason != NOT_NEEDED) {
-      // Reloading an extension reads files from disk.  We do this on the
-      // UI thread because reloads should be very rare, and the complexity
-      // added by delaying the time when the extensions service knows about
-      // all extensions is significant.  See crbug.com/37548 for details.
-      // |allow_io| disables tests that file operations run on the file
-      // thread.
-      base::ThreadRestrictions::ScopedAllowIO allow_io;
+  creator_ = new InstalledExtensionCreator(extensions_info.Pass(), &requests);
+  creator_->Start();
+}
 
-      std::string error;
-      scoped_refptr<const Extension> extension(
-          file_util::LoadExtension(info->extension_path,
-                                   info->extension_location,
-                                   GetCreationFlags(info),
-                                   &error));
-
-      if (!extension.get()) {
-        ExtensionErrorReporter::GetInstance()->ReportLoadError(
-            info->extension_path,
-            error,
-            profile,
-            false);  // Be quiet.
-        continue;
-      }
+void InstalledLoader::LoadAllExtensions() {
+  CHECK(BrowserThread::CurrentlyOn(BrowserThread::UI));
+
+  base::TimeTicks start_time = base::TimeTicks::Now();
+
+  if (!creator_.get())
+    StartCreatingExtensions();
 
-      extensions_info->at(i)->extension_manifest.reset(
-          static_cast<base::DictionaryValue*>(
-              extension->manifest()->value()->DeepCopy()));
+  Profile* profile = extension_service_->profile();
+
+  // Parsing and validating the manifests, and reloading the few which need it
+  // from disk, happens on the blocking pool, several extensions at a time. The
+  // UI thread only creates those no task has taken yet, and adds the results.
+  base::TimeTicks create_start_time = base::TimeTicks::Now();
+  const std::vector<CreateRequest>& requests = creator_->Finish();
+  base::TimeDelta create_time = base::TimeTicks::Now() - create_start_time;
+
+  std::vector<int> reload_reason_counts(NUM_MANIFEST_RELOAD_REASONS, 0);
+  bool should_write_prefs = false;
+  base::TimeDelta serial_create_time;
+  for (size_t i = 0; i < requests.size(); ++i) {
+    const CreateRequest& request = requests[i];
+    ++reload_reason_counts[request.reload_reason];
+    serial_create_time += request.create_time;
+    if (request.reloaded)
       should_write_prefs = true;
+    if (!request.reload_error.empty()) {
+      ExtensionErrorReporter::GetInstance()->ReportLoadError(
+          request.info->extension_path,
+          request.reload_error,
+          profile,
+          false);  // Be quiet.
     }
   }
 
-  for (size_t i = 0; i < extensions_info->size(); ++i) {
-    if (extensions_info->at(i)->extension_location != Manifest::COMMAND_LINE)
-      Load(*extensions_info->at(i), should_write_prefs);
+  base::TimeTicks add_start_time = base::TimeTicks::Now();
+  for (size_t i = 0; i < requests.size(); ++i) {
+    AddExtension(*requests[i].info, requests[i].extension, requests[i].error,
+                 should_write_prefs);
   }
+  base::TimeDelta add_time = base::TimeTicks::Now() - add_start_time;
+
+  // The creator owns the ExtensionInfos of the requests.
+  creator_ = NULL;
 
   extension_service_->OnLoadedInstalledExtensions();
 
@@ -282,6 +445,13 @@ void InstalledLoader::LoadAllExtensions() {
 
   UMA_HISTOGRAM_TIMES("Extensions.LoadAllTime",
                       base::TimeTicks::Now() - start_time);
+  // How long the UI thread spent creating the extensions no task had taken
+  // and waiting for the others, how long creating them would have taken one
+  // after another, and how long adding them took.
+  UMA_HISTOGRAM_TIMES("Extensions.LoadAllCreateTime", create_time);
+  UMA_HISTOGRAM_TIMES("Extensions.LoadAllSerialCreateTime",
+                      serial_create_time);
+  UMA_HISTOGRAM_TIMES("Extensions.LoadAllAddTime", add_time);
 
   int app_user_count = 0;
   int app_external_count = 0;
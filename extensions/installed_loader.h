@@ -5,12 +5,19 @@
 #ifndef CHROME_BROWSER_EXTENSIONS_INSTALLED_LOADER_H_
 #define CHROME_BROWSER_EXTENSIONS_INSTALLED_LOADER_H_
 
+#include <string>
+
+#include "base/basictypes.h"
+#include "base/memory/ref_counted.h"
+
 class ExtensionService;
 
 namespace extensions {
 
+class Extension;
 class ExtensionPrefs;
 class ExtensionRegistry;
+class InstalledExtensionCreator;
 struct ExtensionInfo;
 
 // Loads installed extensions from the prefs.
@@ -22,10 +29,29 @@ class InstalledLoader {
   // Loads extension from prefs.
   void Load(const ExtensionInfo& info, bool write_to_prefs);
 
+  // Starts creating the installed extensions from their manifests on the
+  // blocking pool, several at a time, for LoadAllExtensions() to add.  Lets
+  // the caller do other startup work in the meantime.
+  void StartCreatingExtensions();
+
   // Loads all installed extensions (used by startup and testing code).
+  // Starts creating them if StartCreatingExtensions() was not called.  The
+  // extensions no blocking pool task has taken yet are created here, so this
+  // only waits for the few being created, and then adds them all.
+  // Extensions whose manifest had to be reloaded from disk are added as
+  // reloaded, the others are created from the manifest in the preferences.
   void LoadAllExtensions();
 
  private:
+  // Adds |extension|, which was created from |info|, to the extension service
+  // if it passes the checks done on every load. If |extension| is NULL, or
+  // fails the checks, the load error is reported instead. |creation_error| is
+  // the error from creating |extension|.
+  void AddExtension(const ExtensionInfo& info,
+                    scoped_refptr<const Extension> extension,
+                    const std::string& creation_error,
+                    bool write_to_prefs);
+
   // Returns the flags that should be used with Extension::Create() for an
   // extension that is already installed.
   int GetCreationFlags(const ExtensionInfo* info);
@@ -34,6 +60,12 @@ class InstalledLoader {
   ExtensionRegistry* extension_registry_;
 
   ExtensionPrefs* extension_prefs_;
+
+  // Creates the installed extensions between StartCreatingExtensions() and
+  // LoadAllExtensions().
+  scoped_refptr<InstalledExtensionCreator> creator_;
+
+  DISALLOW_COPY_AND_ASSIGN(InstalledLoader);
 };
 
 }  // namespace extensions
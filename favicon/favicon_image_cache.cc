@@ -0,0 +1,182 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/favicon/favicon_image_cache.h"
+
+#include <vector>
+
+#include "third_party/skia/include/core/SkBitmap.h"
+#include "ui/gfx/favicon_size.h"
+#include "ui/gfx/image/image.h"
+#include "ui/gfx/image/image_skia.h"
+#include "ui/gfx/image/image_skia_rep.h"
+
+namespace {
+
+// Approximate per-entry bookkeeping of the MRU list and index map nodes.
+const size_t kEntryOverhead = 8 * sizeof(void*);
+
+}  // namespace
+
+FaviconImageCache::Key::Key(const GURL& url,
+                            bool is_page_url,
+                            int icon_types,
+                            int desired_size_in_dip)
+    : url(url),
+      is_page_url(is_page_url),
+      icon_types(icon_types),
+      desired_size_in_dip(desired_size_in_dip) {
+}
+
+bool FaviconImageCache::Key::operator<(const Key& other) const {
+  if (url != other.url)
+    return url < other.url;
+  if (is_page_url != other.is_page_url)
+    return is_page_url < other.is_page_url;
+  if (icon_types != other.icon_types)
+    return icon_types < other.icon_types;
+  return desired_size_in_dip < other.desired_size_in_dip;
+}
+
+FaviconImageCache::Stats::Stats()
+    : hits(0),
+      misses(0),
+      evictions(0),
+      entry_count(0),
+      bytes(0),
+      max_bytes(0) {
+}
+
+FaviconImageCache::BucketData::BucketData()
+    : entries(EntryCache::NO_AUTO_EVICT) {
+}
+
+FaviconImageCache::BucketData::~BucketData() {}
+
+FaviconImageCache::FaviconImageCache(size_t max_small_bytes,
+                                     size_t max_large_bytes)
+    : generation_(0) {
+  buckets_[BUCKET_SMALL].stats.max_bytes = max_small_bytes;
+  buckets_[BUCKET_LARGE].stats.max_bytes = max_large_bytes;
+}
+
+FaviconImageCache::~FaviconImageCache() {}
+
+// static
+FaviconImageCache::Bucket FaviconImageCache::GetBucket(
+    int desired_size_in_dip) {
+  // A desired size of 0 asks for the largest bitmap.
+  if (desired_size_in_dip > 0 && desired_size_in_dip <= gfx::kFaviconSize)
+    return BUCKET_SMALL;
+  return BUCKET_LARGE;
+}
+
+// static
+size_t FaviconImageCache::GetImageBytes(const gfx::Image& image) {
+  if (image.IsEmpty())
+    return 0;
+  const std::vector<gfx::ImageSkiaRep> image_reps =
+      image.AsImageSkia().image_reps();
+  size_t bytes = 0;
+  for (size_t i = 0; i < image_reps.size(); ++i)
+    bytes += image_reps[i].sk_bitmap().getSize();
+  return bytes;
+}
+
+bool FaviconImageCache::Get(const Key& key,
+                            favicon_base::FaviconImageResult* result) {
+  BucketData* bucket = &buckets_[GetBucket(key.desired_size_in_dip)];
+  EntryCache::iterator iter = bucket->entries.Get(key);
+  if (iter == bucket->entries.end()) {
+    ++bucket->stats.misses;
+    return false;
+  }
+  ++bucket->stats.hits;
+  *result = iter->second.result;
+  return true;
+}
+
+void FaviconImageCache::Put(const Key& key,
+                            const favicon_base::FaviconImageResult& result,
+                            int generation) {
+  if (generation != generation_)
+    return;
+
+  BucketData* bucket = &buckets_[GetBucket(key.desired_size_in_dip)];
+  EntryCache::iterator existing = bucket->entries.Peek(key);
+  if (existing != bucket->entries.end())
+    Erase(bucket, existing);
+
+  Entry entry;
+  entry.result = result;
+  entry.bytes = EntryBytes(key, result);
+  if (entry.bytes > bucket->stats.max_bytes / 4)
+    return;
+  while (bucket->stats.bytes + entry.bytes > bucket->stats.max_bytes &&
+         !bucket->entries.empty()) {
+    Erase(bucket, --bucket->entries.end());
+    ++bucket->stats.evictions;
+  }
+  bucket->entries.Put(key, entry);
+  bucket->stats.bytes += entry.bytes;
+  bucket->stats.entry_count = bucket->entries.size();
+}
+
+void FaviconImageCache::Remove(const std::set<GURL>& page_urls,
+                               const std::set<GURL>& icon_urls) {
+  ++generation_;
+  for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+    BucketData* bucket = &buckets_[i];
+    for (EntryCache::iterator iter = bucket->entries.begin();
+         iter != bucket->entries.end();) {
+      const std::set<GURL>& urls =
+          iter->first.is_page_url ? page_urls : icon_urls;
+      if (urls.count(iter->first.url))
+        iter = Erase(bucket, iter);
+      else
+        ++iter;
+    }
+  }
+}
+
+void FaviconImageCache::RemoveIconURLEntries() {
+  ++generation_;
+  for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+    BucketData* bucket = &buckets_[i];
+    for (EntryCache::iterator iter = bucket->entries.begin();
+         iter != bucket->entries.end();) {
+      if (iter->first.is_page_url)
+        ++iter;
+      else
+        iter = Erase(bucket, iter);
+    }
+  }
+}
+
+void FaviconImageCache::Clear() {
+  ++generation_;
+  for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+    buckets_[i].entries.Clear();
+    buckets_[i].stats.bytes = 0;
+    buckets_[i].stats.entry_count = 0;
+  }
+}
+
+// static
+size_t FaviconImageCache::EntryBytes(
+    const Key& key,
+    const favicon_base::FaviconImageResult& result) {
+  return kEntryOverhead + sizeof(Key) + sizeof(Entry) +
+      key.url.spec().size() + result.icon_url.spec().size() +
+      GetImageBytes(result.image);
+}
+
+FaviconImageCache::EntryCache::iterator FaviconImageCache::Erase(
+    BucketData* bucket,
+    EntryCache::iterator iter) {
+  bucket->stats.bytes -= iter->second.bytes;
+  EntryCache::iterator next = bucket->entries.Erase(iter);
+  bucket->stats.entry_count = bucket->entries.size();
+  return next;
+}
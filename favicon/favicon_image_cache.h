@@ -0,0 +1,136 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_FAVICON_FAVICON_IMAGE_CACHE_H_
+#define CHROME_BROWSER_FAVICON_FAVICON_IMAGE_CACHE_H_
+
+#include <set>
+
+#include "base/basictypes.h"
+#include "base/containers/mru_cache.h"
+#include "components/favicon_base/favicon_types.h"
+#include "url/gurl.h"
+
+namespace gfx {
+class Image;
+}
+
+// A bounded, least-recently-used cache of the decoded images handed out by
+// FaviconService::GetFaviconImage() and GetFaviconImageForPageURL(), so that
+// the favicons the tab strip, bookmark bar, menus and NTP ask for over and
+// over are not read from the thumbnail database and decoded every time.
+//
+// Entries are split into two buckets by the requested size, each with its
+// own byte budget, so that a few touch icons can not evict every favicon.
+// Requests for empty results are cached too, as pages without a favicon are
+// asked about just as often.
+//
+// The cache has a generation which is bumped whenever entries are removed.
+// Results are inserted with the generation current when they were requested,
+// so a reply which raced with an invalidation is dropped instead of cached.
+class FaviconImageCache {
+ public:
+  enum Bucket {
+    // Requests for at most gfx::kFaviconSize DIP.
+    BUCKET_SMALL,
+    // Larger requests, and requests for the largest bitmap.
+    BUCKET_LARGE,
+    BUCKET_COUNT
+  };
+
+  // Identifies a request. |url| is a page URL if |is_page_url| is true and
+  // an icon URL otherwise. |icon_types| is a bitmask of
+  // favicon_base::IconType. The images hold a representation for each of
+  // favicon_base::GetFaviconScales(), which are fixed for the process, so the
+  // scale is not part of the key.
+  struct Key {
+    Key(const GURL& url,
+        bool is_page_url,
+        int icon_types,
+        int desired_size_in_dip);
+
+    bool operator<(const Key& other) const;
+
+    GURL url;
+    bool is_page_url;
+    int icon_types;
+    int desired_size_in_dip;
+  };
+
+  struct Stats {
+    Stats();
+
+    size_t hits;
+    size_t misses;
+    // Entries evicted to stay within the byte budget.
+    size_t evictions;
+    size_t entry_count;
+    size_t bytes;
+    size_t max_bytes;
+  };
+
+  // |max_small_bytes| and |max_large_bytes| bound the estimated memory held
+  // by the entries of BUCKET_SMALL and BUCKET_LARGE.
+  FaviconImageCache(size_t max_small_bytes, size_t max_large_bytes);
+  ~FaviconImageCache();
+
+  static Bucket GetBucket(int desired_size_in_dip);
+
+  // Returns the estimated memory held by the bitmaps of |image|.
+  static size_t GetImageBytes(const gfx::Image& image);
+
+  // Copies the entry for |key| to |result| and returns true if there is one.
+  bool Get(const Key& key, favicon_base::FaviconImageResult* result);
+
+  // Records |result| for |key| unless entries were removed since
+  // |generation|, evicting the least recently used entries of the bucket as
+  // needed to stay within its budget. Results which alone exceed a quarter of
+  // the budget are not cached.
+  void Put(const Key& key,
+           const favicon_base::FaviconImageResult& result,
+           int generation);
+
+  // Removes the entries for the pages in |page_urls| and the icons in
+  // |icon_urls|.
+  void Remove(const std::set<GURL>& page_urls,
+              const std::set<GURL>& icon_urls);
+
+  // Removes every entry keyed by an icon URL. Used when the bitmaps of
+  // unknown icons may have changed.
+  void RemoveIconURLEntries();
+
+  void Clear();
+
+  int generation() const { return generation_; }
+
+  const Stats& stats(Bucket bucket) const { return buckets_[bucket].stats; }
+
+ private:
+  struct Entry {
+    favicon_base::FaviconImageResult result;
+    size_t bytes;
+  };
+  typedef base::MRUCache<Key, Entry> EntryCache;
+
+  struct BucketData {
+    BucketData();
+    ~BucketData();
+
+    EntryCache entries;
+    Stats stats;
+  };
+
+  // Returns the estimated memory held for |key| and |result|.
+  static size_t EntryBytes(const Key& key,
+                           const favicon_base::FaviconImageResult& result);
+
+  EntryCache::iterator Erase(BucketData* bucket, EntryCache::iterator iter);
+
+  BucketData buckets_[BUCKET_COUNT];
+  int generation_;
+
+  DISALLOW_COPY_AND_ASSIGN(FaviconImageCache);
+};
+
+#endif  // CHROME_BROWSER_FAVICON_FAVICON_IMAGE_CACHE_H_
@@ -0,0 +1,219 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/favicon/favicon_image_cache.h"
+
+#include <set>
+#include <string>
+
+#include "testing/gtest/include/gtest/gtest.h"
+#include "third_party/skia/include/core/SkBitmap.h"
+#include "ui/gfx/favicon_size.h"
+#include "ui/gfx/image/image.h"
+#include "url/gurl.h"
+
+namespace {
+
+const int kLargeSize = 64;
+
+// Returns a result holding a |size| x |size| image from |icon_url|.
+favicon_base::FaviconImageResult CreateResult(const GURL& icon_url,
+                                              int size) {
+  SkBitmap bitmap;
+  bitmap.setConfig(SkBitmap::kARGB_8888_Config, size, size);
+  bitmap.allocPixels();
+  bitmap.eraseARGB(255, 0, 0, 255);
+
+  favicon_base::FaviconImageResult result;
+  result.image = gfx::Image::CreateFrom1xBitmap(bitmap);
+  result.icon_url = icon_url;
+  return result;
+}
+
+FaviconImageCache::Key PageKey(const std::string& url, int size) {
+  return FaviconImageCache::Key(GURL(url), true, favicon_base::FAVICON, size);
+}
+
+FaviconImageCache::Key IconKey(const std::string& url, int size) {
+  return FaviconImageCache::Key(GURL(url), false, favicon_base::FAVICON, size);
+}
+
+std::set<GURL> URLSet(const std::string& url) {
+  std::set<GURL> urls;
+  urls.insert(GURL(url));
+  return urls;
+}
+
+}  // namespace
+
+TEST(FaviconImageCacheTest, GetAndPut) {
+  FaviconImageCache cache(1024 * 1024, 1024 * 1024);
+  const GURL icon_url("http://a.com/favicon.ico");
+  favicon_base::FaviconImageResult result;
+  EXPECT_FALSE(cache.Get(PageKey("http://a.com/", gfx::kFaviconSize),
+                         &result));
+
+  cache.Put(PageKey("http://a.com/", gfx::kFaviconSize),
+            CreateResult(icon_url, gfx::kFaviconSize), cache.generation());
+  ASSERT_TRUE(cache.Get(PageKey("http://a.com/", gfx::kFaviconSize),
+                        &result));
+  EXPECT_EQ(icon_url, result.icon_url);
+  EXPECT_EQ(gfx::kFaviconSize, result.image.Width());
+
+  // The page URL, icon URL and size are all part of the key.
+  EXPECT_FALSE(cache.Get(IconKey("http://a.com/", gfx::kFaviconSize),
+                         &result));
+  EXPECT_FALSE(cache.Get(PageKey("http://a.com/", kLargeSize), &result));
+  EXPECT_FALSE(cache.Get(PageKey("http://b.com/", gfx::kFaviconSize),
+                         &result));
+
+  const FaviconImageCache::Stats& stats =
+      cache.stats(FaviconImageCache::BUCKET_SMALL);
+  EXPECT_EQ(1U, stats.hits);
+  EXPECT_EQ(3U, stats.misses);
+  EXPECT_EQ(1U, stats.entry_count);
+  EXPECT_LT(FaviconImageCache::GetImageBytes(result.image), stats.bytes);
+  EXPECT_EQ(1U, cache.stats(FaviconImageCache::BUCKET_LARGE).misses);
+}
+
+TEST(FaviconImageCacheTest, CachesEmptyResults) {
+  FaviconImageCache cache(1024 * 1024, 1024 * 1024);
+  cache.Put(PageKey("http://a.com/", gfx::kFaviconSize),
+            favicon_base::FaviconImageResult(), cache.generation());
+
+  favicon_base::FaviconImageResult result;
+  ASSERT_TRUE(cache.Get(PageKey("http://a.com/", gfx::kFaviconSize),
+                        &result));
+  EXPECT_TRUE(result.image.IsEmpty());
+}
+
+TEST(FaviconImageCacheTest, Buckets) {
+  EXPECT_EQ(FaviconImageCache::BUCKET_SMALL,
+            FaviconImageCache::GetBucket(gfx::kFaviconSize));
+  EXPECT_EQ(FaviconImageCache::BUCKET_LARGE,
+            FaviconImageCache::GetBucket(kLargeSize));
+  // A desired size of 0 asks for the largest bitmap.
+  EXPECT_EQ(FaviconImageCache::BUCKET_LARGE,
+            FaviconImageCache::GetBucket(0));
+}
+
+// Tests that each bucket evicts its least recently used entries, and only
+// its own.
+TEST(FaviconImageCacheTest, EvictsWithinBucket) {
+  const GURL icon_url("http://a.com/favicon.ico");
+
+  // Size the small bucket to hold four favicons.
+  size_t entry_bytes;
+  {
+    FaviconImageCache cache(1024 * 1024, 1024 * 1024);
+    cache.Put(PageKey("http://a.com/", gfx::kFaviconSize),
+              CreateResult(icon_url, gfx::kFaviconSize), cache.generation());
+    entry_bytes = cache.stats(FaviconImageCache::BUCKET_SMALL).bytes;
+  }
+  FaviconImageCache cache(4 * entry_bytes + entry_bytes / 2, 1024 * 1024);
+
+  cache.Put(PageKey("http://large.com/", kLargeSize),
+            CreateResult(icon_url, kLargeSize), cache.generation());
+  const char* const kPageURLs[] = {
+    "http://a.com/", "http://b.com/", "http://c.com/", "http://d.com/"
+  };
+  for (size_t i = 0; i < arraysize(kPageURLs); ++i) {
+    cache.Put(PageKey(kPageURLs[i], gfx::kFaviconSize),
+              CreateResult(icon_url, gfx::kFaviconSize), cache.generation());
+  }
+  EXPECT_EQ(4U, cache.stats(FaviconImageCache::BUCKET_SMALL).entry_count);
+
+  // Use a.com so that b.com is the least recently used.
+  favicon_base::FaviconImageResult result;
+  EXPECT_TRUE(cache.Get(PageKey("http://a.com/", gfx::kFaviconSize),
+                        &result));
+  cache.Put(PageKey("http://e.com/", gfx::kFaviconSize),
+            CreateResult(icon_url, gfx::kFaviconSize), cache.generation());
+
+  const FaviconImageCache::Stats& stats =
+      cache.stats(FaviconImageCache::BUCKET_SMALL);
+  EXPECT_EQ(4U, stats.entry_count);
+  EXPECT_EQ(1U, stats.evictions);
+  EXPECT_LE(stats.bytes, stats.max_bytes);
+  EXPECT_TRUE(cache.Get(PageKey("http://a.com/", gfx::kFaviconSize),
+                        &result));
+  EXPECT_FALSE(cache.Get(PageKey("http://b.com/", gfx::kFaviconSize),
+                         &result));
+  EXPECT_TRUE(cache.Get(PageKey("http://e.com/", gfx::kFaviconSize),
+                        &result));
+
+  // The large bucket was left alone.
+  EXPECT_TRUE(cache.Get(PageKey("http://large.com/", kLargeSize), &result));
+  EXPECT_EQ(0U, cache.stats(FaviconImageCache::BUCKET_LARGE).evictions);
+}
+
+TEST(FaviconImageCacheTest, SkipsOversizedResults) {
+  FaviconImageCache cache(1024, 1024);
+  cache.Put(PageKey("http://a.com/", gfx::kFaviconSize),
+            CreateResult(GURL("http://a.com/favicon.ico"), gfx::kFaviconSize),
+            cache.generation());
+  EXPECT_EQ(0U, cache.stats(FaviconImageCache::BUCKET_SMALL).entry_count);
+  EXPECT_EQ(0U, cache.stats(FaviconImageCache::BUCKET_SMALL).bytes);
+}
+
+TEST(FaviconImageCacheTest, Remove) {
+  FaviconImageCache cache(1024 * 1024, 1024 * 1024);
+  const GURL icon_url("http://a.com/favicon.ico");
+  cache.Put(PageKey("http://a.com/", gfx::kFaviconSize),
+            CreateResult(icon_url, gfx::kFaviconSize), cache.generation());
+  cache.Put(PageKey("http://a.com/", kLargeSize),
+            CreateResult(icon_url, kLargeSize), cache.generation());
+  cache.Put(PageKey("http://b.com/", gfx::kFaviconSize),
+            CreateResult(icon_url, gfx::kFaviconSize), cache.generation());
+  cache.Put(IconKey(icon_url.spec(), gfx::kFaviconSize),
+            CreateResult(icon_url, gfx::kFaviconSize), cache.generation());
+  cache.Put(IconKey("http://c.com/favicon.ico", gfx::kFaviconSize),
+            CreateResult(icon_url, gfx::kFaviconSize), cache.generation());
+
+  // Page URLs and icon URLs only remove the entries of their kind.
+  cache.Remove(URLSet("http://a.com/"), URLSet("http://a.com/"));
+  favicon_base::FaviconImageResult result;
+  EXPECT_FALSE(cache.Get(PageKey("http://a.com/", gfx::kFaviconSize),
+                         &result));
+  EXPECT_FALSE(cache.Get(PageKey("http://a.com/", kLargeSize), &result));
+  EXPECT_TRUE(cache.Get(PageKey("http://b.com/", gfx::kFaviconSize),
+                        &result));
+  EXPECT_TRUE(cache.Get(IconKey(icon_url.spec(), gfx::kFaviconSize),
+                        &result));
+  EXPECT_EQ(0U, cache.stats(FaviconImageCache::BUCKET_LARGE).bytes);
+
+  cache.Remove(std::set<GURL>(), URLSet(icon_url.spec()));
+  EXPECT_FALSE(cache.Get(IconKey(icon_url.spec(), gfx::kFaviconSize),
+                         &result));
+  EXPECT_TRUE(cache.Get(IconKey("http://c.com/favicon.ico",
+                                gfx::kFaviconSize),
+                        &result));
+
+  cache.RemoveIconURLEntries();
+  EXPECT_FALSE(cache.Get(IconKey("http://c.com/favicon.ico",
+                                 gfx::kFaviconSize),
+                         &result));
+  EXPECT_TRUE(cache.Get(PageKey("http://b.com/", gfx::kFaviconSize),
+                        &result));
+
+  cache.Clear();
+  EXPECT_FALSE(cache.Get(PageKey("http://b.com/", gfx::kFaviconSize),
+                         &result));
+  EXPECT_EQ(0U, cache.stats(FaviconImageCache::BUCKET_SMALL).entry_count);
+  EXPECT_EQ(0U, cache.stats(FaviconImageCache::BUCKET_SMALL).bytes);
+}
+
+// Tests that a result requested before an invalidation is not cached.
+TEST(FaviconImageCacheTest, DropsStaleResults) {
+  FaviconImageCache cache(1024 * 1024, 1024 * 1024);
+  const int generation = cache.generation();
+  cache.Remove(URLSet("http://a.com/"), std::set<GURL>());
+
+  cache.Put(PageKey("http://a.com/", gfx::kFaviconSize),
+            CreateResult(GURL("http://a.com/favicon.ico"), gfx::kFaviconSize),
+            generation);
+  favicon_base::FaviconImageResult result;
+  EXPECT_FALSE(cache.Get(PageKey("http://a.com/", gfx::kFaviconSize),
+                         &result));
+}
@@ -5,10 +5,14 @@
 #include "chrome/browser/favicon/favicon_service.h"
 
 #include <cmath>
+#include <set>
 
 #include "base/hash.h"
 #include "base/message_loop/message_loop_proxy.h"
+#include "chrome/browser/chrome_notification_types.h"
+#include "chrome/browser/favicon/favicon_changed_details.h"
 #include "chrome/browser/history/history_backend.h"
+#include "chrome/browser/history/history_notifications.h"
 #include "chrome/browser/history/history_service.h"
 #include "chrome/browser/history/history_service_factory.h"
 #include "chrome/browser/ui/webui/chrome_web_ui_controller_factory.h"
@@ -17,6 +21,8 @@
 #include "components/favicon_base/favicon_types.h"
 #include "components/favicon_base/favicon_util.h"
 #include "components/favicon_base/select_favicon_frames.h"
+#include "content/public/browser/notification_details.h"
+#include "content/public/browser/notification_source.h"
 #include "extensions/common/constants.h"
 #include "third_party/skia/include/core/SkBitmap.h"
 #include "ui/gfx/codec/png_codec.h"
@@ -27,6 +33,11 @@ using base::Bind;
 
 namespace {
 
+// The memory budgets of the FaviconImageCache buckets. A 16 DIP favicon takes
+// 5 KB at 1x and 2x, and a 64 DIP touch icon 80 KB.
+const size_t kMaxSmallImageCacheBytes = 512 * 1024;
+const size_t kMaxLargeImageCacheBytes = 2 * 1024 * 1024;
+
 void CancelOrRunFaviconResultsCallback(
     const base::CancelableTaskTracker::IsCanceledCallback& is_canceled,
     const favicon_base::FaviconResultsCallback& callback,
@@ -64,6 +75,13 @@ base::CancelableTaskTracker::TaskId GetFaviconForChromeURL(
   return id;
 }
 
+// Returns a set holding just |url|, for FaviconImageCache::Remove().
+std::set<GURL> SingleURLSet(const GURL& url) {
+  std::set<GURL> urls;
+  urls.insert(url);
+  return urls;
+}
+
 // Returns a vector of pixel edge sizes from |size_in_dip| and
 // favicon_base::GetFaviconScales().
 std::vector<int> GetPixelSizesForFaviconScales(int size_in_dip) {
@@ -80,7 +98,14 @@ std::vector<int> GetPixelSizesForFaviconScales(int size_in_dip) {
 FaviconService::FaviconService(Profile* profile)
     : history_service_(HistoryServiceFactory::GetForProfile(
           profile, Profile::EXPLICIT_ACCESS)),
-      profile_(profile) {
+      profile_(profile),
+      image_cache_(kMaxSmallImageCacheBytes, kMaxLargeImageCacheBytes) {
+  if (profile_) {
+    registrar_.Add(this, chrome::NOTIFICATION_FAVICON_CHANGED,
+                   content::Source<Profile>(profile_));
+    registrar_.Add(this, chrome::NOTIFICATION_HISTORY_URLS_DELETED,
+                   content::Source<Profile>(profile_));
+  }
 }
 
 // static
@@ -96,9 +121,16 @@ base::CancelableTaskTracker::TaskId FaviconService::GetFaviconImage(
     int desired_size_in_dip,
     const favicon_base::FaviconImageCallback& callback,
     base::CancelableTaskTracker* tracker) {
+  FaviconImageCache::Key cache_key(
+      icon_url, false, icon_type, desired_size_in_dip);
+  favicon_base::FaviconImageResult cached_result;
+  if (image_cache_.Get(cache_key, &cached_result))
+    return RunFaviconImageCallbackAsync(callback, cached_result, tracker);
+
   favicon_base::FaviconResultsCallback callback_runner =
       Bind(&FaviconService::RunFaviconImageCallbackWithBitmapResults,
-           base::Unretained(this), callback, desired_size_in_dip);
+           base::Unretained(this), callback, desired_size_in_dip, cache_key,
+           image_cache_.generation());
   if (history_service_) {
     std::vector<GURL> icon_urls;
     icon_urls.push_back(icon_url);
@@ -182,16 +214,33 @@ base::CancelableTaskTracker::TaskId FaviconService::GetFaviconImageForPageURL(
     const FaviconForPageURLParams& params,
     const favicon_base::FaviconImageCallback& callback,
     base::CancelableTaskTracker* tracker) {
+  FaviconImageCache::Key cache_key(
+      params.page_url, true, params.icon_types, params.desired_size_in_dip);
+  favicon_base::FaviconImageResult cached_result;
+  if (image_cache_.Get(cache_key, &cached_result))
+    return RunFaviconImageCallbackAsync(callback, cached_result, tracker);
+
   return GetFaviconForPageURLImpl(
       params,
       GetPixelSizesForFaviconScales(params.desired_size_in_dip),
       Bind(&FaviconService::RunFaviconImageCallbackWithBitmapResults,
            base::Unretained(this),
            callback,
-           params.desired_size_in_dip),
+           params.desired_size_in_dip,
+           cache_key,
+           image_cache_.generation()),
       tracker);
 }
 
+bool FaviconService::GetCachedFaviconImageForPageURL(
+    const FaviconForPageURLParams& params,
+    favicon_base::FaviconImageResult* result) {
+  return image_cache_.Get(
+      FaviconImageCache::Key(params.page_url, true, params.icon_types,
+                             params.desired_size_in_dip),
+      result);
+}
+
 base::CancelableTaskTracker::TaskId FaviconService::GetRawFaviconForPageURL(
     const FaviconForPageURLParams& params,
     float desired_favicon_scale,
@@ -279,6 +328,7 @@ void FaviconService::SetFaviconOutOfDateForPage(const GURL& page_url) {
 
 void FaviconService::CloneFavicon(const GURL& old_page_url,
                                   const GURL& new_page_url) {
+  image_cache_.Remove(SingleURLSet(new_page_url), std::set<GURL>());
   if (history_service_)
     history_service_->CloneFavicons(old_page_url, new_page_url);
 }
@@ -295,6 +345,9 @@ void FaviconService::MergeFavicon(
     favicon_base::IconType icon_type,
     scoped_refptr<base::RefCountedMemory> bitmap_data,
     const gfx::Size& pixel_size) {
+  // Drop the cached images now rather than when the history backend notifies
+  // about the change, so that requests made in between do not get them.
+  image_cache_.Remove(SingleURLSet(page_url), SingleURLSet(icon_url));
   if (history_service_) {
     history_service_->MergeFavicon(page_url, icon_url, icon_type, bitmap_data,
                                    pixel_size);
@@ -305,6 +358,8 @@ void FaviconService::SetFavicons(const GURL& page_url,
                                  const GURL& icon_url,
                                  favicon_base::IconType icon_type,
                                  const gfx::Image& image) {
+  // See MergeFavicon().
+  image_cache_.Remove(SingleURLSet(page_url), SingleURLSet(icon_url));
   if (!history_service_)
     return;
 
@@ -368,9 +423,53 @@ base::CancelableTaskTracker::TaskId FaviconService::GetFaviconForPageURLImpl(
   return RunWithEmptyResultAsync(callback, tracker);
 }
 
+void FaviconService::Observe(int type,
+                             const content::NotificationSource& source,
+                             const content::NotificationDetails& details) {
+  switch (type) {
+    case chrome::NOTIFICATION_FAVICON_CHANGED: {
+      // Only the pages are named, but the bitmaps of any icon may have been
+      // replaced too.
+      content::Details<FaviconChangedDetails> favicon_details(details);
+      image_cache_.Remove(favicon_details->urls, std::set<GURL>());
+      image_cache_.RemoveIconURLEntries();
+      break;
+    }
+    case chrome::NOTIFICATION_HISTORY_URLS_DELETED: {
+      content::Details<history::URLsDeletedDetails> deleted_details(details);
+      if (deleted_details->all_history) {
+        image_cache_.Clear();
+        break;
+      }
+      std::set<GURL> page_urls;
+      for (history::URLRows::const_iterator i = deleted_details->rows.begin();
+           i != deleted_details->rows.end(); ++i) {
+        page_urls.insert(i->url());
+      }
+      image_cache_.Remove(page_urls, deleted_details->favicon_urls);
+      break;
+    }
+    default:
+      NOTREACHED();
+      break;
+  }
+}
+
+base::CancelableTaskTracker::TaskId
+FaviconService::RunFaviconImageCallbackAsync(
+    const favicon_base::FaviconImageCallback& callback,
+    const favicon_base::FaviconImageResult& result,
+    base::CancelableTaskTracker* tracker) {
+  return tracker->PostTask(base::MessageLoopProxy::current().get(),
+                           FROM_HERE,
+                           Bind(callback, result));
+}
+
 void FaviconService::RunFaviconImageCallbackWithBitmapResults(
     const favicon_base::FaviconImageCallback& callback,
     int desired_size_in_dip,
+    const FaviconImageCache::Key& cache_key,
+    int cache_generation,
     const std::vector<favicon_base::FaviconRawBitmapResult>&
         favicon_bitmap_results) {
   favicon_base::FaviconImageResult image_result;
@@ -382,6 +481,7 @@ void FaviconService::RunFaviconImageCallbackWithBitmapResults(
 
   image_result.icon_url = image_result.image.IsEmpty() ?
       GURL() : favicon_bitmap_results[0].icon_url;
+  image_cache_.Put(cache_key, image_result, cache_generation);
   callback.Run(image_result);
 }
 
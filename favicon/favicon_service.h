@@ -11,9 +11,12 @@
 #include "base/containers/hash_tables.h"
 #include "base/memory/ref_counted.h"
 #include "base/task/cancelable_task_tracker.h"
+#include "chrome/browser/favicon/favicon_image_cache.h"
 #include "components/favicon_base/favicon_callback.h"
 #include "components/favicon_base/favicon_types.h"
 #include "components/keyed_service/core/keyed_service.h"
+#include "content/public/browser/notification_observer.h"
+#include "content/public/browser/notification_registrar.h"
 
 class GURL;
 class HistoryService;
@@ -21,8 +24,11 @@ struct ImportedFaviconUsage;
 class Profile;
 
 // The favicon service provides methods to access favicons. It calls the history
-// backend behind the scenes.
-class FaviconService : public KeyedService {
+// backend behind the scenes. The images returned by GetFaviconImage() and
+// GetFaviconImageForPageURL() are kept in a FaviconImageCache, which answers
+// repeated requests without going to the history backend.
+class FaviconService : public KeyedService,
+                       public content::NotificationObserver {
  public:
   explicit FaviconService(Profile* profile);
 
@@ -139,6 +145,13 @@ class FaviconService : public KeyedService {
       const favicon_base::FaviconImageCallback& callback,
       base::CancelableTaskTracker* tracker);
 
+  // Copies the result a GetFaviconImageForPageURL() request for |params|
+  // would have if it is cached, and returns true. Callers which can use the
+  // image right away should try this before issuing the request.
+  bool GetCachedFaviconImageForPageURL(
+      const FaviconForPageURLParams& params,
+      favicon_base::FaviconImageResult* result);
+
   base::CancelableTaskTracker::TaskId GetRawFaviconForPageURL(
       const FaviconForPageURLParams& params,
       float desired_favicon_scale,
@@ -215,12 +228,22 @@ class FaviconService : public KeyedService {
   bool WasUnableToDownloadFavicon(const GURL& icon_url) const;
   void ClearUnableToDownloadFavicons();
 
+  const FaviconImageCache& image_cache() const { return image_cache_; }
+
  private:
+  // content::NotificationObserver implementation.
+  virtual void Observe(int type,
+                       const content::NotificationSource& source,
+                       const content::NotificationDetails& details) OVERRIDE;
+
   typedef uint32 MissingFaviconURLHash;
   base::hash_set<MissingFaviconURLHash> missing_favicon_urls_;
   HistoryService* history_service_;
   Profile* profile_;
 
+  FaviconImageCache image_cache_;
+  content::NotificationRegistrar registrar_;
+
   // Helper function for GetFaviconImageForPageURL(), GetRawFaviconForPageURL()
   // and GetFaviconForPageURL().
   base::CancelableTaskTracker::TaskId GetFaviconForPageURLImpl(
@@ -231,14 +254,24 @@ class FaviconService : public KeyedService {
 
   // Intermediate callback for GetFaviconImage() and GetFaviconImageForPageURL()
   // so that history service can deal solely with FaviconResultsCallback.
-  // Builds favicon_base::FaviconImageResult from |favicon_bitmap_results| and
-  // runs |callback|.
+  // Builds favicon_base::FaviconImageResult from |favicon_bitmap_results|,
+  // caches it for |cache_key| unless |image_cache_| was invalidated since
+  // |cache_generation|, and runs |callback|.
   void RunFaviconImageCallbackWithBitmapResults(
       const favicon_base::FaviconImageCallback& callback,
       int desired_size_in_dip,
+      const FaviconImageCache::Key& cache_key,
+      int cache_generation,
       const std::vector<favicon_base::FaviconRawBitmapResult>&
           favicon_bitmap_results);
 
+  // Posts a task to run |callback| with |result|, which came from
+  // |image_cache_|.
+  base::CancelableTaskTracker::TaskId RunFaviconImageCallbackAsync(
+      const favicon_base::FaviconImageCallback& callback,
+      const favicon_base::FaviconImageResult& result,
+      base::CancelableTaskTracker* tracker);
+
   // Intermediate callback for GetRawFavicon() and GetRawFaviconForPageURL()
   // so that history service can deal solely with FaviconResultsCallback.
   // Resizes favicon_base::FaviconRawBitmapResult if necessary and runs
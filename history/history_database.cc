@@ -27,10 +27,16 @@ namespace {
 // Current version number. We write databases at the "current" version number,
 // but any previous version that can read the "compatible" one can make do with
 // our database without *too* many bad effects.
-const int kCurrentVersionNumber = 29;
+const int kCurrentVersionNumber = 30;
 const int kCompatibleVersionNumber = 16;
 const char kEarlyExpirationThresholdKey[] = "early_expiration_threshold";
 
+// The version of the url_words table's contents. Changing which words are
+// extracted from a URL and title only needs a new version, after which the
+// table is rebuilt on startup.
+const char kURLWordsVersionKey[] = "url_words_version";
+const int kURLWordsVersion = 1;
+
 }  // namespace
 
 HistoryDatabase::HistoryDatabase() {
@@ -84,11 +90,12 @@ sql::InitStatus HistoryDatabase::Init(const base::FilePath& history_name) {
   if (!meta_table_.Init(&db_, GetCurrentVersion(), kCompatibleVersionNumber))
     return sql::INIT_FAILURE;
   if (!CreateURLTable(false) || !InitVisitTable() ||
-      !InitKeywordSearchTermsTable() || !InitDownloadTable() ||
-      !InitSegmentTables())
+      !InitKeywordSearchTermsTable() || !InitURLWordsTable() ||
+      !InitDownloadTable() || !InitSegmentTables())
     return sql::INIT_FAILURE;
   CreateMainURLIndex();
   CreateKeywordSearchTermsIndices();
+  CreateURLWordsIndices();
 
   // TODO(benjhayden) Remove at some point.
   meta_table_.DeleteKey("next_download_id");
@@ -98,6 +105,9 @@ sql::InitStatus HistoryDatabase::Init(const base::FilePath& history_name) {
   if (version_status != sql::INIT_OK)
     return version_status;
 
+  if (!EnsureURLWordsValid())
+    return sql::INIT_FAILURE;
+
   return committer.Commit() ? sql::INIT_OK : sql::INIT_FAILURE;
 }
 
@@ -220,6 +230,8 @@ bool HistoryDatabase::RecreateAllTablesButURL() {
     return false;
 
   CreateKeywordSearchTermsIndices();
+
+  // The URL words describe the URL table, so they are kept.
   return true;
 }
 
@@ -431,6 +443,13 @@ sql::InitStatus HistoryDatabase::EnsureCurrentVersion() {
     meta_table_.SetVersionNumber(cur_version);
   }
 
+  if (cur_version == 29) {
+    // The url_words table was created empty by Init(). It has no version key
+    // yet, so EnsureURLWordsValid() fills it in.
+    cur_version++;
+    meta_table_.SetVersionNumber(cur_version);
+  }
+
   // When the version is too old, we just try to continue anyway, there should
   // not be a released product that makes a database too old for us to handle.
   LOG_IF(WARNING, cur_version < GetCurrentVersion()) <<
@@ -439,6 +458,19 @@ sql::InitStatus HistoryDatabase::EnsureCurrentVersion() {
   return sql::INIT_OK;
 }
 
+bool HistoryDatabase::EnsureURLWordsValid() {
+  int version = 0;
+  if (meta_table_.GetValue(kURLWordsVersionKey, &version) &&
+      version == kURLWordsVersion && URLWordsMatchURLTable()) {
+    return true;
+  }
+  if (!RebuildURLWordsTable()) {
+    LOG(WARNING) << "Unable to rebuild the history URL words";
+    return false;
+  }
+  return meta_table_.SetValue(kURLWordsVersionKey, kURLWordsVersion);
+}
+
 #if !defined(OS_WIN)
 void HistoryDatabase::MigrateTimeEpoch() {
   // Update all the times in the URLs and visits table in the main database.
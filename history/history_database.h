@@ -175,6 +175,11 @@ class HistoryDatabase : public DownloadDatabase,
   // may commit the transaction and start a new one if migration requires it.
   sql::InitStatus EnsureCurrentVersion();
 
+  // Rebuilds the URL words table if it was built by an older version of the
+  // word extraction, or if a build without the table has changed the URLs.
+  // Returns false if the table could not be rebuilt.
+  bool EnsureURLWordsValid();
+
 #if !defined(OS_WIN)
   // Converts the time epoch in the database from being 1970-based to being
   // 1601-based which corresponds to the change in Time.internal_value_.
@@ -21,6 +21,7 @@
 
 #include <algorithm>
 #include <string>
+#include <vector>
 
 #include "base/basictypes.h"
 #include "base/bind.h"
@@ -718,6 +719,83 @@ TEST_F(HistoryBackendDBTest, MigrateDownloadMimeType) {
   }
 }
 
+TEST_F(HistoryBackendDBTest, MigrateURLWords) {
+  ASSERT_NO_FATAL_FAILURE(CreateDBVersion(28));
+  {
+    sql::Connection db;
+    ASSERT_TRUE(db.Open(history_dir_.Append(chrome::kHistoryFilename)));
+    sql::Statement s(db.GetUniqueStatement(
+        "INSERT INTO urls (id, url, title, last_visit_time) VALUES "
+        "(?, ?, ?, ?)"));
+    s.BindInt64(0, 100);
+    s.BindString(1, "http://www.example.com/recipes");
+    s.BindString(2, "Chocolate Cake");
+    s.BindInt64(3, base::Time::Now().ToInternalValue());
+    ASSERT_TRUE(s.Run());
+  }
+  // Re-open the db using the HistoryDatabase, which should migrate to the
+  // current version, indexing the words of the existing URLs.
+  CreateBackendAndDatabase();
+  DeleteBackend();
+  {
+    // Re-open the db for manual manipulation.
+    sql::Connection db;
+    ASSERT_TRUE(db.Open(history_dir_.Append(chrome::kHistoryFilename)));
+    // The version should have been updated.
+    int cur_version = HistoryDatabase::GetCurrentVersion();
+    ASSERT_LE(30, cur_version);
+    {
+      sql::Statement s(db.GetUniqueStatement(
+          "SELECT value FROM meta WHERE key = 'version'"));
+      EXPECT_TRUE(s.Step());
+      EXPECT_EQ(cur_version, s.ColumnInt(0));
+    }
+    {
+      sql::Statement s(db.GetUniqueStatement(
+          "SELECT word FROM url_words WHERE url_id = 100 ORDER BY word"));
+      std::vector<std::string> words;
+      while (s.Step())
+        words.push_back(s.ColumnString(0));
+      const char* expected_words[] = {
+        "cake", "chocolate", "com", "example", "http", "recipes", "www"
+      };
+      EXPECT_EQ(std::vector<std::string>(
+                    expected_words,
+                    expected_words + arraysize(expected_words)),
+                words);
+    }
+  }
+}
+
+// A URL added by a build which predates the URL words table gets its words
+// the next time the database is opened.
+TEST_F(HistoryBackendDBTest, RebuildURLWordsAfterOlderBuild) {
+  CreateBackendAndDatabase();
+  DeleteBackend();
+  {
+    sql::Connection db;
+    ASSERT_TRUE(db.Open(history_dir_.Append(chrome::kHistoryFilename)));
+    sql::Statement s(db.GetUniqueStatement(
+        "INSERT INTO urls (id, url, title, last_visit_time) VALUES "
+        "(?, ?, ?, ?)"));
+    s.BindInt64(0, 100);
+    s.BindString(1, "http://www.example.com/recipes");
+    s.BindString(2, "Chocolate Cake");
+    s.BindInt64(3, base::Time::Now().ToInternalValue());
+    ASSERT_TRUE(s.Run());
+  }
+  CreateBackendAndDatabase();
+  DeleteBackend();
+  {
+    sql::Connection db;
+    ASSERT_TRUE(db.Open(history_dir_.Append(chrome::kHistoryFilename)));
+    sql::Statement s(db.GetUniqueStatement(
+        "SELECT COUNT(*) FROM url_words WHERE url_id = 100 AND word = 'cake'"));
+    ASSERT_TRUE(s.Step());
+    EXPECT_EQ(1, s.ColumnInt(0));
+  }
+}
+
 TEST_F(HistoryBackendDBTest, ConfirmDownloadRowCreateAndDelete) {
   // Create the DB.
   CreateBackendAndDatabase();
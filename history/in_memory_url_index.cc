@@ -14,6 +14,7 @@
 #include "chrome/browser/history/history_service_factory.h"
 #include "chrome/browser/history/url_database.h"
 #include "chrome/browser/history/url_index_private_data.h"
+#include "chrome/browser/omnibox/omnibox_field_trial.h"
 #include "chrome/browser/profiles/profile.h"
 #include "chrome/common/url_constants.h"
 #include "components/bookmarks/browser/bookmark_model.h"
@@ -33,6 +34,17 @@ void DeleteCacheFile(const base::FilePath& path) {
   base::DeleteFile(path, false);
 }
 
+// Unmaps |mapped_data| and deletes its file at |path|, if any, which can not
+// be done while it is mapped on Windows. Runs on the FILE thread, after any
+// AdoptMappedCache() task still reading |mapped_data|.
+void DropMappedCacheFile(scoped_refptr<URLIndexPrivateData> mapped_data,
+                         const base::FilePath& path) {
+  DCHECK(content::BrowserThread::CurrentlyOn(content::BrowserThread::FILE));
+  mapped_data->Clear();
+  if (!path.empty())
+    base::DeleteFile(path, false);
+}
+
 // Initializes a whitelist of URL schemes.
 void InitializeSchemeWhitelist(std::set<std::string>* whitelist) {
   DCHECK(whitelist);
@@ -97,6 +109,7 @@ InMemoryURLIndex::InMemoryURLIndex(Profile* profile,
       history_dir_(history_dir),
       languages_(languages),
       private_data_(new URLIndexPrivateData),
+      use_mapped_cache_(OmniboxFieldTrial::HQPUseMappedCacheValue()),
       restore_cache_observer_(NULL),
       save_cache_observer_(NULL),
       shutdown_(false),
@@ -118,6 +131,7 @@ InMemoryURLIndex::InMemoryURLIndex()
     : profile_(NULL),
       history_client_(NULL),
       private_data_(new URLIndexPrivateData),
+      use_mapped_cache_(OmniboxFieldTrial::HQPUseMappedCacheValue()),
       restore_cache_observer_(NULL),
       save_cache_observer_(NULL),
       shutdown_(false),
@@ -133,7 +147,10 @@ InMemoryURLIndex::~InMemoryURLIndex() {
 }
 
 void InMemoryURLIndex::Init() {
-  PostRestoreFromCacheFileTask();
+  if (use_mapped_cache_)
+    PostRestoreFromMappedCacheFileTask();
+  else
+    PostRestoreFromCacheFileTask();
 }
 
 void InMemoryURLIndex::ShutDown() {
@@ -141,15 +158,55 @@ void InMemoryURLIndex::ShutDown() {
   cache_reader_consumer_.CancelAllRequests();
   shutdown_ = true;
   base::FilePath path;
-  if (!GetCacheFilePath(&path))
+  base::FilePath mapped_path;
+  if (!GetCacheFilePath(&path) || !GetMappedCacheFilePath(&mapped_path))
     return;
+  if (private_data_->IsMapped()) {
+    // The mapped index was not converted yet. Converting it here would take
+    // time proportional to the history on the UI thread, and a failed
+    // conversion must not overwrite the file, so the mapped file is kept as
+    // is. The queued visits are missing from it until their URLs are visited
+    // again or the index is next rebuilt from history.
+    // Deleted URLs must not come back though, so if any were queued the file
+    // is dropped and the index is rebuilt from history at the next startup.
+    for (std::vector<PendingUpdate>::const_iterator iter =
+             pending_updates_.begin();
+         iter != pending_updates_.end(); ++iter) {
+      if (iter->deleted) {
+        ClearPrivateData();
+        break;
+      }
+    }
+    pending_updates_.clear();
+    needs_to_be_cached_ = false;
+    return;
+  }
   private_data_->CancelPendingUpdates();
-  URLIndexPrivateData::WritePrivateDataToCacheFileTask(private_data_, path);
+  if (use_mapped_cache_) {
+    URLIndexPrivateData::WritePrivateDataToMappedCacheFileTask(private_data_,
+                                                               mapped_path);
+    base::DeleteFile(path, false);
+  } else {
+    URLIndexPrivateData::WritePrivateDataToCacheFileTask(private_data_, path);
+    base::DeleteFile(mapped_path, false);
+  }
   needs_to_be_cached_ = false;
 }
 
 void InMemoryURLIndex::ClearPrivateData() {
-  private_data_->Clear();
+  if (!private_data_->IsMapped()) {
+    private_data_->Clear();
+    return;
+  }
+  // An AdoptMappedCache() task may still be reading the mapped data on the
+  // FILE thread, so it is unmapped there, after that task. Its file is
+  // deleted along with it, as it no longer reflects the history.
+  base::FilePath mapped_path;
+  GetMappedCacheFilePath(&mapped_path);
+  content::BrowserThread::PostTask(
+      content::BrowserThread::FILE, FROM_HERE,
+      base::Bind(&DropMappedCacheFile, private_data_, mapped_path));
+  private_data_ = new URLIndexPrivateData;
 }
 
 bool InMemoryURLIndex::GetCacheFilePath(base::FilePath* file_path) {
@@ -159,6 +216,13 @@ bool InMemoryURLIndex::GetCacheFilePath(base::FilePath* file_path) {
   return true;
 }
 
+bool InMemoryURLIndex::GetMappedCacheFilePath(base::FilePath* file_path) {
+  if (history_dir_.empty())
+    return false;
+  *file_path = history_dir_.Append(FILE_PATH_LITERAL("History Provider Index"));
+  return true;
+}
+
 // Querying --------------------------------------------------------------------
 
 ScoredHistoryMatches InMemoryURLIndex::HistoryItemsForTerms(
@@ -173,10 +237,15 @@ ScoredHistoryMatches InMemoryURLIndex::HistoryItemsForTerms(
       history_client_);
 }
 
+bool InMemoryURLIndex::GetIntersectionCacheStats(
+    URLIndexIntersectionCache::Stats* stats) const {
+  return private_data_->GetIntersectionCacheStats(stats);
+}
+
 // Updating --------------------------------------------------------------------
 
 void InMemoryURLIndex::DeleteURL(const GURL& url) {
-  private_data_->DeleteURL(url);
+  DeleteRow(URLRow(url));
 }
 
 void InMemoryURLIndex::Observe(int notification_type,
@@ -207,31 +276,61 @@ void InMemoryURLIndex::Observe(int notification_type,
 }
 
 void InMemoryURLIndex::OnURLVisited(const URLVisitedDetails* details) {
-  HistoryService* service =
-      HistoryServiceFactory::GetForProfile(profile_,
-                                           Profile::EXPLICIT_ACCESS);
-  needs_to_be_cached_ |= private_data_->UpdateURL(
-      service, details->row, languages_, scheme_whitelist_);
+  UpdateRow(details->row);
 }
 
 void InMemoryURLIndex::OnURLsModified(const URLsModifiedDetails* details) {
-  HistoryService* service =
-      HistoryServiceFactory::GetForProfile(profile_,
-                                           Profile::EXPLICIT_ACCESS);
   for (URLRows::const_iterator row = details->changed_urls.begin();
        row != details->changed_urls.end(); ++row)
-    needs_to_be_cached_ |=
-        private_data_->UpdateURL(service, *row, languages_, scheme_whitelist_);
+    UpdateRow(*row);
 }
 
 void InMemoryURLIndex::OnURLsDeleted(const URLsDeletedDetails* details) {
   if (details->all_history) {
     ClearPrivateData();
+    pending_updates_.clear();
     needs_to_be_cached_ = true;
   } else {
     for (URLRows::const_iterator row = details->rows.begin();
          row != details->rows.end(); ++row)
-      needs_to_be_cached_ |= private_data_->DeleteURL(row->url());
+      DeleteRow(*row);
+  }
+}
+
+void InMemoryURLIndex::UpdateRow(const URLRow& row) {
+  if (private_data_->IsMapped()) {
+    PendingUpdate update = { false, row };
+    pending_updates_.push_back(update);
+    needs_to_be_cached_ = true;
+    return;
+  }
+  HistoryService* service =
+      HistoryServiceFactory::GetForProfile(profile_,
+                                           Profile::EXPLICIT_ACCESS);
+  needs_to_be_cached_ |=
+      private_data_->UpdateURL(service, row, languages_, scheme_whitelist_);
+}
+
+void InMemoryURLIndex::DeleteRow(const URLRow& row) {
+  if (private_data_->IsMapped()) {
+    PendingUpdate update = { true, row };
+    pending_updates_.push_back(update);
+    needs_to_be_cached_ = true;
+    return;
+  }
+  needs_to_be_cached_ |= private_data_->DeleteURL(row.url());
+}
+
+void InMemoryURLIndex::ApplyPendingUpdates() {
+  DCHECK(!private_data_->IsMapped());
+  std::vector<PendingUpdate> updates;
+  updates.swap(pending_updates_);
+  for (std::vector<PendingUpdate>::const_iterator iter = updates.begin();
+       iter != updates.end(); ++iter) {
+    if (iter->deleted)
+      DeleteRow(iter->row);
+    else
+      UpdateRow(iter->row);
   }
 }
 
@@ -283,6 +382,59 @@ void InMemoryURLIndex::OnCacheLoadDone(
   }
 }
 
+void InMemoryURLIndex::PostRestoreFromMappedCacheFileTask() {
+  DCHECK(content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
+  TRACE_EVENT0("browser",
+               "InMemoryURLIndex::PostRestoreFromMappedCacheFileTask");
+
+  base::FilePath path;
+  if (!GetMappedCacheFilePath(&path) || shutdown_) {
+    PostRestoreFromCacheFileTask();
+    return;
+  }
+
+  content::BrowserThread::PostTaskAndReplyWithResult
+      <scoped_refptr<URLIndexPrivateData> >(
+      content::BrowserThread::FILE, FROM_HERE,
+      base::Bind(&URLIndexPrivateData::RestoreFromMappedFile, path),
+      base::Bind(&InMemoryURLIndex::OnMappedCacheLoadDone, AsWeakPtr()));
+}
+
+void InMemoryURLIndex::OnMappedCacheLoadDone(
+    scoped_refptr<URLIndexPrivateData> private_data) {
+  if (!private_data.get() || private_data->Empty() || shutdown_) {
+    // Fall back to the protobuf cache, if any, and then to a rebuild.
+    PostRestoreFromCacheFileTask();
+    return;
+  }
+  private_data_ = private_data;
+  restored_ = true;
+  if (restore_cache_observer_)
+    restore_cache_observer_->OnCacheRestoreFinished(true);
+  content::BrowserThread::PostTaskAndReplyWithResult
+      <scoped_refptr<URLIndexPrivateData> >(
+      content::BrowserThread::FILE, FROM_HERE,
+      base::Bind(&URLIndexPrivateData::AdoptMappedCache, private_data),
+      base::Bind(&InMemoryURLIndex::OnMappedCacheAdopted, AsWeakPtr()));
+}
+
+void InMemoryURLIndex::OnMappedCacheAdopted(
+    scoped_refptr<URLIndexPrivateData> private_data) {
+  // The mapped data may have been cleared or replaced in the meantime.
+  if (shutdown_ || !private_data_->IsMapped())
+    return;
+  if (private_data.get()) {
+    private_data_ = private_data;
+    ApplyPendingUpdates();
+    return;
+  }
+  // The file was corrupt beyond what the bounds checks could hide. Drop it
+  // and rebuild from history.
+  ClearPrivateData();
+  pending_updates_.clear();
+  OnCacheLoadDone(NULL);
+}
+
 // Restoring from the History DB -----------------------------------------------
 
 void InMemoryURLIndex::ScheduleRebuildFromHistory() {
@@ -322,8 +474,15 @@ void InMemoryURLIndex::RebuildFromHistory(HistoryDatabase* history_db) {
 
 void InMemoryURLIndex::PostSaveToCacheFileTask() {
   base::FilePath path;
-  if (!GetCacheFilePath(&path))
+  base::FilePath mapped_path;
+  if (!GetCacheFilePath(&path) || !GetMappedCacheFilePath(&mapped_path))
     return;
+  // Only one cache format is kept so that a stale file in the other format is
+  // never restored.
+  if (use_mapped_cache_)
+    std::swap(path, mapped_path);
+  content::BrowserThread::PostBlockingPoolTask(
+      FROM_HERE, base::Bind(DeleteCacheFile, mapped_path));
   // If there is anything in our private data then make a copy of it and tell
   // it to save itself to a file.
   if (private_data_.get() && !private_data_->Empty()) {
@@ -331,10 +490,13 @@ void InMemoryURLIndex::PostSaveToCacheFileTask() {
     // completion closure below.
     scoped_refptr<URLIndexPrivateData> private_data_copy =
         private_data_->Duplicate();
-    content::BrowserThread::PostTaskAndReplyWithResult<bool>(
-        content::BrowserThread::FILE, FROM_HERE,
+    base::Callback<bool(void)> write_task = use_mapped_cache_ ?
+        base::Bind(&URLIndexPrivateData::WritePrivateDataToMappedCacheFileTask,
+                   private_data_copy, path) :
         base::Bind(&URLIndexPrivateData::WritePrivateDataToCacheFileTask,
-                   private_data_copy, path),
+                   private_data_copy, path);
+    content::BrowserThread::PostTaskAndReplyWithResult<bool>(
+        content::BrowserThread::FILE, FROM_HERE, write_task,
         base::Bind(&InMemoryURLIndex::OnCacheSaveDone, AsWeakPtr()));
   } else {
     // If there is no data in our index then delete any existing cache file.
@@ -22,6 +22,7 @@
 #include "chrome/browser/history/history_types.h"
 #include "chrome/browser/history/in_memory_url_index_types.h"
 #include "chrome/browser/history/scored_history_match.h"
+#include "chrome/browser/history/url_index_intersection_cache.h"
 #include "content/public/browser/notification_observer.h"
 #include "content/public/browser/notification_registrar.h"
 #include "sql/connection.h"
@@ -111,7 +112,8 @@ class InMemoryURLIndex : public content::NotificationObserver,
   void Init();
 
   // Signals that any outstanding initialization should be canceled and
-  // flushes the cache to disk.
+  // flushes the cache to disk. A mapped cache which was not converted yet is
+  // left on disk, unless URLs were deleted in the meantime.
   void ShutDown();
 
   // Scans the history index and returns a vector with all scored, matching
@@ -128,6 +130,11 @@ class InMemoryURLIndex : public content::NotificationObserver,
   // Deletes the index entry, if any, for the given |url|.
   void DeleteURL(const GURL& url);
 
+  // Fills in |stats| for the index's intersection cache and returns true, or
+  // returns false if the cache is not enabled. Shown on chrome://omnibox.
+  bool GetIntersectionCacheStats(
+      URLIndexIntersectionCache::Stats* stats) const;
+
   // Sets the optional observers for completion of restoral and saving of the
   // index's private data.
   void set_restore_cache_observer(
@@ -177,7 +184,9 @@ class InMemoryURLIndex : public content::NotificationObserver,
   };
 
   // Initializes all index data members in preparation for restoring the index
-  // from the cache or a complete rebuild from the history database.
+  // from the cache or a complete rebuild from the history database. Mapped
+  // private data is replaced rather than cleared, and is unmapped on the FILE
+  // thread along with its file being deleted.
   void ClearPrivateData();
 
   // Constructs a file path for the cache file within the same directory where
@@ -186,10 +195,32 @@ class InMemoryURLIndex : public content::NotificationObserver,
   // provided as a hook for unit testing.)
   bool GetCacheFilePath(base::FilePath* file_path);
 
+  // As GetCacheFilePath() but for the memory-mapped cache file which is used
+  // instead of the protobuf cache when the HQPUseMappedCache field trial
+  // parameter is set.
+  bool GetMappedCacheFilePath(base::FilePath* file_path);
+
   // Restores the index's private data from the cache file stored in the
   // profile directory.
   void PostRestoreFromCacheFileTask();
 
+  // Maps the memory-mapped cache file and serves queries directly from it.
+  // Falls back to PostRestoreFromCacheFileTask() if the file cannot be used.
+  void PostRestoreFromMappedCacheFileTask();
+
+  // Installs the mapped |private_data| if it is usable and then posts a task
+  // to convert it to the regular in-memory representation, which is needed
+  // before the index can be updated.
+  void OnMappedCacheLoadDone(scoped_refptr<URLIndexPrivateData> private_data);
+
+  // Replaces the mapped private data with its in-memory conversion
+  // |private_data| and applies the history changes queued in the meantime.
+  // If the conversion failed the index is rebuilt from history.
+  void OnMappedCacheAdopted(scoped_refptr<URLIndexPrivateData> private_data);
+
+  // Applies, then clears, |pending_updates_|.
+  void ApplyPendingUpdates();
+
   // Schedules a history task to rebuild our private data from the history
   // database.
   void ScheduleRebuildFromHistory();
@@ -241,6 +272,11 @@ class InMemoryURLIndex : public content::NotificationObserver,
   void OnURLsModified(const URLsModifiedDetails* details);
   void OnURLsDeleted(const URLsDeletedDetails* details);
 
+  // Updates or deletes |row| in the index, or queues the change while the
+  // private data is still a read-only mapped cache.
+  void UpdateRow(const URLRow& row);
+  void DeleteRow(const URLRow& row);
+
   // Sets the directory wherein the cache file will be maintained.
   // For unit test usage only.
   void set_history_dir(const base::FilePath& dir_path) {
@@ -273,6 +309,17 @@ class InMemoryURLIndex : public content::NotificationObserver,
   // The index's durable private data.
   scoped_refptr<URLIndexPrivateData> private_data_;
 
+  // True if the index is cached using the memory-mapped file format.
+  bool use_mapped_cache_;
+
+  // History changes received while |private_data_| is a mapped cache, applied
+  // in order once it has been converted to its in-memory representation.
+  struct PendingUpdate {
+    bool deleted;
+    URLRow row;
+  };
+  std::vector<PendingUpdate> pending_updates_;
+
   // Observers to notify upon restoral or save of the private data cache.
   RestoreCacheObserver* restore_cache_observer_;
   SaveCacheObserver* save_cache_observer_;
@@ -14,6 +14,7 @@
 #include "base/strings/string16.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
+#include "base/threading/sequenced_worker_pool.h"
 #include "chrome/browser/bookmarks/bookmark_model_factory.h"
 #include "chrome/browser/chrome_notification_types.h"
 #include "chrome/browser/history/history_backend.h"
@@ -29,6 +30,7 @@
 #include "chrome/test/base/testing_profile.h"
 #include "components/bookmarks/test/bookmark_test_helpers.h"
 #include "components/history/core/browser/history_client.h"
+#include "content/public/browser/browser_thread.h"
 #include "content/public/browser/notification_details.h"
 #include "content/public/browser/notification_source.h"
 #include "content/public/test/test_browser_thread.h"
@@ -112,7 +114,24 @@ class InMemoryURLIndexTest : public testing::Test {
                const content::NotificationSource& source,
                const content::NotificationDetails& details);
   const std::set<std::string>& scheme_whitelist();
+  bool GetMappedCacheFilePath(base::FilePath* file_path) const;
+  void OnMappedCacheAdopted(scoped_refptr<URLIndexPrivateData> private_data);
+  size_t pending_update_count() const;
 
+  // Saves the index as a mapped cache file in |dir_path|, which becomes the
+  // history directory, and replaces the private data with a read-only view
+  // of the file, as if restored from it at startup. Returns the mapped data.
+  scoped_refptr<URLIndexPrivateData> UseMappedCache(
+      const base::FilePath& dir_path);
+
+  // Sends a URLS_MODIFIED notification for |row|.
+  void NotifyURLModified(const URLRow& row);
+
+  // Sends a URLS_DELETED notification for |row|.
+  void NotifyURLDeleted(const URLRow& row);
+
+  // Returns the number of matches for |term|.
+  size_t CountMatches(const std::string& term);
 
   // Pass-through functions to simplify our friendship with URLIndexPrivateData.
   bool UpdateURL(const URLRow& row);
@@ -180,6 +199,57 @@ const std::set<std::string>& InMemoryURLIndexTest::scheme_whitelist() {
   return url_index_->scheme_whitelist();
 }
 
+bool InMemoryURLIndexTest::GetMappedCacheFilePath(
+    base::FilePath* file_path) const {
+  DCHECK(file_path);
+  return url_index_->GetMappedCacheFilePath(file_path);
+}
+
+void InMemoryURLIndexTest::OnMappedCacheAdopted(
+    scoped_refptr<URLIndexPrivateData> private_data) {
+  url_index_->OnMappedCacheAdopted(private_data);
+}
+
+size_t InMemoryURLIndexTest::pending_update_count() const {
+  return url_index_->pending_updates_.size();
+}
+
+scoped_refptr<URLIndexPrivateData> InMemoryURLIndexTest::UseMappedCache(
+    const base::FilePath& dir_path) {
+  set_history_dir(dir_path);
+  base::FilePath mapped_path;
+  EXPECT_TRUE(GetMappedCacheFilePath(&mapped_path));
+  EXPECT_TRUE(URLIndexPrivateData::WritePrivateDataToMappedCacheFileTask(
+      url_index_->private_data_, mapped_path));
+  scoped_refptr<URLIndexPrivateData> mapped_data =
+      URLIndexPrivateData::RestoreFromMappedFile(mapped_path);
+  if (mapped_data.get())
+    url_index_->private_data_ = mapped_data;
+  return mapped_data;
+}
+
+void InMemoryURLIndexTest::NotifyURLModified(const URLRow& row) {
+  URLsModifiedDetails modified_details;
+  modified_details.changed_urls.push_back(row);
+  Observe(chrome::NOTIFICATION_HISTORY_URLS_MODIFIED,
+          content::Source<InMemoryURLIndexTest>(this),
+          content::Details<history::HistoryDetails>(&modified_details));
+}
+
+void InMemoryURLIndexTest::NotifyURLDeleted(const URLRow& row) {
+  URLsDeletedDetails deleted_details;
+  deleted_details.all_history = false;
+  deleted_details.rows.push_back(row);
+  Observe(chrome::NOTIFICATION_HISTORY_URLS_DELETED,
+          content::Source<InMemoryURLIndexTest>(this),
+          content::Details<history::HistoryDetails>(&deleted_details));
+}
+
+size_t InMemoryURLIndexTest::CountMatches(const std::string& term) {
+  return url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16(term), base::string16::npos, kMaxMatches).size();
+}
+
 bool InMemoryURLIndexTest::UpdateURL(const URLRow& row) {
   return GetPrivateData()->UpdateURL(
       history_service_, row, url_index_->languages_,
@@ -834,6 +904,32 @@ TEST_F(InMemoryURLIndexTest, TypedCharacterCaching) {
   CheckTerm(cache, ASCIIToUTF16("rec"));
 }
 
+TEST_F(InMemoryURLIndexTest, IntersectionCacheStats) {
+  URLIndexPrivateData* private_data = GetPrivateData();
+  private_data->use_posting_lists_ = true;
+  private_data->intersection_cache_.reset(
+      new URLIndexIntersectionCache(1024 * 1024));
+
+  // A one-word input is looked up once, under the word itself.
+  EXPECT_EQ(2U, CountMatches("drudge"));
+  URLIndexIntersectionCache::Stats stats;
+  ASSERT_TRUE(url_index_->GetIntersectionCacheStats(&stats));
+  EXPECT_EQ(0U, stats.hits);
+  EXPECT_EQ(1U, stats.misses);
+
+  EXPECT_EQ(2U, CountMatches("drudge"));
+  ASSERT_TRUE(url_index_->GetIntersectionCacheStats(&stats));
+  EXPECT_EQ(1U, stats.hits);
+  EXPECT_EQ(1U, stats.misses);
+
+  // A two-word input misses on the whole input and on the new word, and
+  // reuses the candidates cached for "drudge".
+  EXPECT_LE(1U, CountMatches("drudge report"));
+  ASSERT_TRUE(url_index_->GetIntersectionCacheStats(&stats));
+  EXPECT_EQ(2U, stats.hits);
+  EXPECT_EQ(3U, stats.misses);
+}
+
 TEST_F(InMemoryURLIndexTest, AddNewRows) {
   // Verify that the row we're going to add does not already exist.
   URLID new_row_id = 87654321;
@@ -1155,6 +1251,141 @@ TEST_F(InMemoryURLIndexTest, RebuildFromHistoryIfCacheOld) {
   ExpectPrivateDataEqual(*old_data.get(), new_data);
 }
 
+// Changes received while the index is a mapped cache are queued, and replayed
+// in order once the mapped data has been converted.
+TEST_F(InMemoryURLIndexTest, MappedCachePendingUpdates) {
+  base::ScopedTempDir temp_directory;
+  ASSERT_TRUE(temp_directory.CreateUniqueTempDir());
+  scoped_refptr<URLIndexPrivateData> mapped_data =
+      UseMappedCache(temp_directory.path());
+  ASSERT_TRUE(mapped_data.get());
+  ASSERT_TRUE(GetPrivateData()->IsMapped());
+
+  ScoredHistoryMatches matches = url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("DrudgeReport"), base::string16::npos, kMaxMatches);
+  ASSERT_EQ(1U, matches.size());
+  URLRow new_row(GURL("http://www.brokeandaloneinmanitoba.com/"), 87654321);
+  new_row.set_last_visit(base::Time::Now());
+  NotifyURLModified(new_row);
+  NotifyURLDeleted(matches[0].url_info);
+  EXPECT_EQ(2U, pending_update_count());
+
+  // The mapped data keeps answering queries as it was saved.
+  EXPECT_EQ(0U, CountMatches("brokeandalone"));
+  EXPECT_EQ(1U, CountMatches("DrudgeReport"));
+
+  OnMappedCacheAdopted(URLIndexPrivateData::AdoptMappedCache(mapped_data));
+  EXPECT_FALSE(GetPrivateData()->IsMapped());
+  EXPECT_EQ(0U, pending_update_count());
+  EXPECT_EQ(1U, CountMatches("brokeandalone"));
+  EXPECT_EQ(0U, CountMatches("DrudgeReport"));
+
+  // Must clear the history_dir_ to satisfy the dtor's DCHECK.
+  set_history_dir(base::FilePath());
+}
+
+// A mapped cache which can not be converted is dropped, along with the
+// changes queued for it, and its file is deleted.
+TEST_F(InMemoryURLIndexTest, MappedCacheAdoptionFailure) {
+  base::ScopedTempDir temp_directory;
+  ASSERT_TRUE(temp_directory.CreateUniqueTempDir());
+  ASSERT_TRUE(UseMappedCache(temp_directory.path()).get());
+  base::FilePath mapped_path;
+  ASSERT_TRUE(GetMappedCacheFilePath(&mapped_path));
+
+  URLRow new_row(GURL("http://www.brokeandaloneinmanitoba.com/"), 87654321);
+  new_row.set_last_visit(base::Time::Now());
+  NotifyURLModified(new_row);
+  EXPECT_EQ(1U, pending_update_count());
+
+  OnMappedCacheAdopted(NULL);
+  EXPECT_FALSE(GetPrivateData()->IsMapped());
+  EXPECT_TRUE(GetPrivateData()->Empty());
+  EXPECT_EQ(0U, pending_update_count());
+  message_loop_.RunUntilIdle();
+  EXPECT_FALSE(base::PathExists(mapped_path));
+
+  set_history_dir(base::FilePath());
+}
+
+// Clearing all history while the index is a mapped cache leaves the mapped
+// data to the FILE thread, where it may still be read by the conversion, and
+// the conversion's result is then ignored.
+TEST_F(InMemoryURLIndexTest, ClearAllHistoryWhileMapped) {
+  base::ScopedTempDir temp_directory;
+  ASSERT_TRUE(temp_directory.CreateUniqueTempDir());
+  scoped_refptr<URLIndexPrivateData> mapped_data =
+      UseMappedCache(temp_directory.path());
+  ASSERT_TRUE(mapped_data.get());
+  base::FilePath mapped_path;
+  ASSERT_TRUE(GetMappedCacheFilePath(&mapped_path));
+
+  URLsDeletedDetails deleted_details;
+  deleted_details.all_history = true;
+  Observe(chrome::NOTIFICATION_HISTORY_URLS_DELETED,
+          content::Source<InMemoryURLIndexTest>(this),
+          content::Details<history::HistoryDetails>(&deleted_details));
+  EXPECT_FALSE(GetPrivateData()->IsMapped());
+  EXPECT_TRUE(GetPrivateData()->Empty());
+  EXPECT_EQ(0U, CountMatches("DrudgeReport"));
+
+  // The FILE thread has not run yet, so the mapped data is still readable.
+  EXPECT_TRUE(mapped_data->IsMapped());
+  scoped_refptr<URLIndexPrivateData> adopted_data =
+      URLIndexPrivateData::AdoptMappedCache(mapped_data);
+  ASSERT_TRUE(adopted_data.get());
+  EXPECT_FALSE(adopted_data->Empty());
+  OnMappedCacheAdopted(adopted_data);
+  EXPECT_TRUE(GetPrivateData()->Empty());
+
+  message_loop_.RunUntilIdle();
+  EXPECT_FALSE(mapped_data->IsMapped());
+  EXPECT_FALSE(base::PathExists(mapped_path));
+
+  set_history_dir(base::FilePath());
+}
+
+// Shutting down before the mapped cache was converted leaves the file as it
+// was, rather than converting it on the UI thread.
+TEST_F(InMemoryURLIndexTest, ShutDownKeepsMappedCache) {
+  base::ScopedTempDir temp_directory;
+  ASSERT_TRUE(temp_directory.CreateUniqueTempDir());
+  ASSERT_TRUE(UseMappedCache(temp_directory.path()).get());
+  base::FilePath mapped_path;
+  ASSERT_TRUE(GetMappedCacheFilePath(&mapped_path));
+  std::string saved_contents;
+  ASSERT_TRUE(base::ReadFileToString(mapped_path, &saved_contents));
+
+  URLRow new_row(GURL("http://www.brokeandaloneinmanitoba.com/"), 87654321);
+  new_row.set_last_visit(base::Time::Now());
+  NotifyURLModified(new_row);
+  url_index_->ShutDown();
+
+  EXPECT_TRUE(GetPrivateData()->IsMapped());
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(mapped_path, &contents));
+  EXPECT_TRUE(contents == saved_contents);
+}
+
+// Deleted URLs must not come back from a mapped cache saved before they were
+// deleted, so shutting down with a queued deletion drops the file.
+TEST_F(InMemoryURLIndexTest, ShutDownDropsMappedCacheWithDeletions) {
+  base::ScopedTempDir temp_directory;
+  ASSERT_TRUE(temp_directory.CreateUniqueTempDir());
+  ASSERT_TRUE(UseMappedCache(temp_directory.path()).get());
+  base::FilePath mapped_path;
+  ASSERT_TRUE(GetMappedCacheFilePath(&mapped_path));
+
+  ScoredHistoryMatches matches = url_index_->HistoryItemsForTerms(
+      ASCIIToUTF16("DrudgeReport"), base::string16::npos, kMaxMatches);
+  ASSERT_EQ(1U, matches.size());
+  NotifyURLDeleted(matches[0].url_info);
+  url_index_->ShutDown();
+  message_loop_.RunUntilIdle();
+
+  EXPECT_FALSE(base::PathExists(mapped_path));
+}
+
 class InMemoryURLIndexCacheTest : public testing::Test {
  public:
   InMemoryURLIndexCacheTest() {}
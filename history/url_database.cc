@@ -6,6 +6,7 @@
 
 #include <algorithm>
 #include <limits>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -19,6 +20,19 @@
 
 namespace history {
 
+namespace {
+
+// GetTextMatches() looks the URL words candidates up one at a time by ID,
+// which costs several times as much per row as a sequential scan. When more
+// than 1/kFullScanCandidateDivisor of the URLs are candidates, as for queries
+// like "http" or "com", the whole table is scanned instead. The number of URLs
+// is estimated by the largest URL ID, which is read from the end of the table
+// rather than counted. Expired URLs make it an overestimate, which only makes
+// the URL words used a little more often.
+const size_t kFullScanCandidateDivisor = 4;
+
+}  // namespace
+
 const char URLDatabase::kURLRowFields[] = HISTORY_URL_ROW_FIELDS;
 const int URLDatabase::kNumURLRowFields = 9;
 
@@ -41,7 +55,8 @@ bool URLDatabase::URLEnumerator::GetNextURL(URLRow* r) {
 }
 
 URLDatabase::URLDatabase()
-    : has_keyword_search_terms_(false) {
+    : has_keyword_search_terms_(false),
+      has_url_words_(false) {
 }
 
 URLDatabase::~URLDatabase() {
@@ -116,6 +131,20 @@ URLID URLDatabase::GetRowForURL(const GURL& url, history::URLRow* info) {
 
 bool URLDatabase::UpdateURLRow(URLID url_id,
                                const history::URLRow& info) {
+  // Most updates only change the counts, so only re-index the words when the
+  // title changes.
+  base::string16 url;
+  bool title_changed = false;
+  if (has_url_words_) {
+    sql::Statement current(GetDB().GetCachedStatement(SQL_FROM_HERE,
+        "SELECT url, title FROM urls WHERE id=?"));
+    current.BindInt64(0, url_id);
+    if (current.Step()) {
+      url = current.ColumnString16(0);
+      title_changed = current.ColumnString16(1) != info.title();
+    }
+  }
+
   sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
       "UPDATE urls SET title=?,visit_count=?,typed_count=?,last_visit_time=?,"
         "hidden=?"
@@ -127,7 +156,10 @@ bool URLDatabase::UpdateURLRow(URLID url_id,
   statement.BindInt(4, info.hidden() ? 1 : 0);
   statement.BindInt64(5, url_id);
 
-  return statement.Run();
+  if (!statement.Run())
+    return false;
+
+  return !title_changed || SetURLWords(url_id, url, info.title());
 }
 
 URLID URLDatabase::AddURLInternal(const history::URLRow& info,
@@ -165,7 +197,14 @@ URLID URLDatabase::AddURLInternal(const history::URLRow& info,
             << " to table history.urls.";
     return 0;
   }
-  return GetDB().GetLastInsertRowId();
+  URLID url_id = GetDB().GetLastInsertRowId();
+
+  // The temporary table is indexed as a whole once it is committed.
+  if (has_url_words_ && !is_temporary) {
+    SetURLWords(url_id, base::UTF8ToUTF16(GURLToDatabaseURL(info.url())),
+                info.title());
+  }
+  return url_id;
 }
 
 bool URLDatabase::InsertOrUpdateURLRowByID(const history::URLRow& info) {
@@ -194,7 +233,12 @@ bool URLDatabase::InsertOrUpdateURLRowByID(const history::URLRow& info) {
   statement.BindInt64(5, info.last_visit().ToInternalValue());
   statement.BindInt(6, info.hidden() ? 1 : 0);
 
-  return statement.Run();
+  if (!statement.Run())
+    return false;
+
+  return !has_url_words_ ||
+      SetURLWords(info.id(), base::UTF8ToUTF16(GURLToDatabaseURL(info.url())),
+                  info.title());
 }
 
 bool URLDatabase::DeleteURLRow(URLID id) {
@@ -205,6 +249,9 @@ bool URLDatabase::DeleteURLRow(URLID id) {
   if (!statement.Run())
     return false;
 
+  if (has_url_words_ && !DeleteURLWords(id))
+    return false;
+
   // And delete any keyword visits.
   return !has_keyword_search_terms_ || DeleteKeywordSearchTermForURL(id);
 }
@@ -232,7 +279,8 @@ bool URLDatabase::CommitTemporaryURLTable() {
   // for the temporary table.
   CreateMainURLIndex();
 
-  return true;
+  // The URLs have new IDs, so their words have to be indexed again.
+  return !has_url_words_ || RebuildURLWordsTable();
 }
 
 bool URLDatabase::InitURLEnumeratorForEverything(URLEnumerator* enumerator) {
@@ -361,34 +409,192 @@ bool URLDatabase::GetTextMatches(const base::string16& query,
   query_parser_.ParseQueryNodes(query, &query_nodes.get());
 
   results->clear();
+  std::set<URLID> url_ids;
+  bool use_url_words =
+      has_url_words_ && GetURLWordsCandidates(query, &url_ids);
+  if (use_url_words && !url_ids.empty()) {
+    sql::Statement max_url_id(GetDB().GetCachedStatement(SQL_FROM_HERE,
+        "SELECT MAX(id) FROM urls"));
+    use_url_words = max_url_id.Step() &&
+        url_ids.size() * kFullScanCandidateDivisor <=
+            static_cast<size_t>(max_url_id.ColumnInt64(0));
+  }
+  if (!use_url_words) {
+    sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
+        "SELECT" HISTORY_URL_ROW_FIELDS "FROM urls WHERE hidden = 0"));
+    while (statement.Step())
+      AddRowIfTextMatches(statement, query_nodes.get(), results);
+    return !results->empty();
+  }
+
+  // The candidates only share a prefix of every query word, so they still
+  // have to be matched against the query like the rows of a full scan.
   sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
-      "SELECT" HISTORY_URL_ROW_FIELDS "FROM urls WHERE hidden = 0"));
+      "SELECT" HISTORY_URL_ROW_FIELDS "FROM urls WHERE id = ? AND hidden = 0"));
+  for (std::set<URLID>::const_iterator i = url_ids.begin();
+       i != url_ids.end(); ++i) {
+    statement.Reset(true);
+    statement.BindInt64(0, *i);
+    if (statement.Step())
+      AddRowIfTextMatches(statement, query_nodes.get(), results);
+  }
+  return !results->empty();
+}
+
+bool URLDatabase::InitURLWordsTable() {
+  has_url_words_ = true;
+  if (!GetDB().DoesTableExist("url_words")) {
+    if (!GetDB().Execute("CREATE TABLE url_words ("
+        "url_id INTEGER NOT NULL,"      // ID of the url.
+        "word LONGVARCHAR NOT NULL)"))  // A word of the url or title, in
+                                        // lower case.
+      return false;
+  }
+  return true;
+}
 
+bool URLDatabase::CreateURLWordsIndices() {
+  // For searching.
+  if (!GetDB().Execute(
+          "CREATE INDEX IF NOT EXISTS url_words_index1 ON url_words (word)")) {
+    return false;
+  }
+
+  // For deletion.
+  return GetDB().Execute(
+      "CREATE INDEX IF NOT EXISTS url_words_index2 ON url_words (url_id)");
+}
+
+bool URLDatabase::URLWordsMatchURLTable() {
+  DCHECK(has_url_words_);
+  // Both maximums are read from an index. They are 0 for empty tables.
+  sql::Statement max_url_id(GetDB().GetUniqueStatement(
+      "SELECT MAX(id) FROM urls"));
+  sql::Statement max_word_url_id(GetDB().GetUniqueStatement(
+      "SELECT MAX(url_id) FROM url_words"));
+  return max_url_id.Step() && max_word_url_id.Step() &&
+      max_url_id.ColumnInt64(0) == max_word_url_id.ColumnInt64(0);
+}
+
+bool URLDatabase::RebuildURLWordsTable() {
+  DCHECK(has_url_words_);
+  if (!GetDB().Execute("DELETE FROM url_words"))
+    return false;
+
+  sql::Statement statement(GetDB().GetUniqueStatement(
+      "SELECT id, url, title FROM urls"));
   while (statement.Step()) {
-    query_parser::QueryWordVector query_words;
-    base::string16 url = base::i18n::ToLower(statement.ColumnString16(1));
-    query_parser_.ExtractQueryWords(url, &query_words);
-    GURL gurl(url);
-    if (gurl.is_valid()) {
-      // Decode punycode to match IDN.
-      // |query_words| won't be shown to user - therefore we can use empty
-      // |languages| to reduce dependency (no need to call PrefService).
-      base::string16 ascii = base::ASCIIToUTF16(gurl.host());
-      base::string16 utf = net::IDNToUnicode(gurl.host(), std::string());
-      if (ascii != utf)
-        query_parser_.ExtractQueryWords(utf, &query_words);
+    if (!SetURLWords(statement.ColumnInt64(0), statement.ColumnString16(1),
+                     statement.ColumnString16(2))) {
+      return false;
     }
-    base::string16 title = base::i18n::ToLower(statement.ColumnString16(2));
-    query_parser_.ExtractQueryWords(title, &query_words);
-
-    if (query_parser_.DoesQueryMatch(query_words, query_nodes.get())) {
-      history::URLResult info;
-      FillURLRow(statement, &info);
-      if (info.url().is_valid())
-        results->push_back(info);
+  }
+  return statement.Succeeded();
+}
+
+void URLDatabase::ExtractURLWords(const base::string16& url,
+                                  const base::string16& title,
+                                  query_parser::QueryWordVector* words) {
+  base::string16 lower_url = base::i18n::ToLower(url);
+  query_parser_.ExtractQueryWords(lower_url, words);
+  GURL gurl(lower_url);
+  if (gurl.is_valid()) {
+    // Decode punycode to match IDN.
+    // |words| won't be shown to user - therefore we can use empty
+    // |languages| to reduce dependency (no need to call PrefService).
+    base::string16 ascii = base::ASCIIToUTF16(gurl.host());
+    base::string16 utf = net::IDNToUnicode(gurl.host(), std::string());
+    if (ascii != utf)
+      query_parser_.ExtractQueryWords(utf, words);
+  }
+  query_parser_.ExtractQueryWords(base::i18n::ToLower(title), words);
+}
+
+bool URLDatabase::SetURLWords(URLID url_id,
+                              const base::string16& url,
+                              const base::string16& title) {
+  if (!DeleteURLWords(url_id))
+    return false;
+
+  query_parser::QueryWordVector query_words;
+  ExtractURLWords(url, title, &query_words);
+  std::set<base::string16> words;
+  for (size_t i = 0; i < query_words.size(); ++i)
+    words.insert(query_words[i].word);
+  // Every URL gets at least one entry, so that URLWordsMatchURLTable() sees
+  // its ID. No query word matches an empty word.
+  if (words.empty())
+    words.insert(base::string16());
+
+  sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
+      "INSERT INTO url_words (url_id, word) VALUES (?,?)"));
+  for (std::set<base::string16>::const_iterator i = words.begin();
+       i != words.end(); ++i) {
+    statement.Reset(true);
+    statement.BindInt64(0, url_id);
+    statement.BindString16(1, *i);
+    if (!statement.Run())
+      return false;
+  }
+  return true;
+}
+
+bool URLDatabase::DeleteURLWords(URLID url_id) {
+  sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
+      "DELETE FROM url_words WHERE url_id=?"));
+  statement.BindInt64(0, url_id);
+  return statement.Run();
+}
+
+bool URLDatabase::GetURLWordsCandidates(const base::string16& query,
+                                        std::set<URLID>* url_ids) {
+  std::vector<base::string16> query_words;
+  query_parser_.ParseQueryWords(base::i18n::ToLower(query), &query_words);
+  if (query_words.empty())
+    return false;
+
+  // A row only matches if it has a word matching every query word, and a
+  // word matches when the query word is a prefix of it (or equal to it, which
+  // the prefix range also covers).
+  sql::Statement statement(GetDB().GetCachedStatement(SQL_FROM_HERE,
+      "SELECT DISTINCT url_id FROM url_words WHERE word >= ? AND word < ?"));
+  url_ids->clear();
+  for (size_t i = 0; i < query_words.size(); ++i) {
+    // To avoid doing a LIKE, the range is computed by incrementing the last
+    // character of the word.
+    base::string16 next_prefix = query_words[i];
+    next_prefix[next_prefix.size() - 1] =
+        next_prefix[next_prefix.size() - 1] + 1;
+    statement.Reset(true);
+    statement.BindString16(0, query_words[i]);
+    statement.BindString16(1, next_prefix);
+
+    std::set<URLID> word_url_ids;
+    while (statement.Step()) {
+      URLID url_id = statement.ColumnInt64(0);
+      if (i == 0 || url_ids->count(url_id))
+        word_url_ids.insert(url_id);
     }
+    url_ids->swap(word_url_ids);
+    if (url_ids->empty())
+      break;
+  }
+  return true;
+}
+
+void URLDatabase::AddRowIfTextMatches(
+    sql::Statement& statement,
+    const std::vector<query_parser::QueryNode*>& query_nodes,
+    URLRows* results) {
+  query_parser::QueryWordVector query_words;
+  ExtractURLWords(statement.ColumnString16(1), statement.ColumnString16(2),
+                  &query_words);
+  if (query_parser_.DoesQueryMatch(query_words, query_nodes)) {
+    history::URLResult info;
+    FillURLRow(statement, &info);
+    if (info.url().is_valid())
+      results->push_back(info);
   }
-  return !results->empty();
 }
 
 bool URLDatabase::InitKeywordSearchTermsTable() {
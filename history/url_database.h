@@ -5,6 +5,9 @@
 #ifndef CHROME_BROWSER_HISTORY_URL_DATABASE_H_
 #define CHROME_BROWSER_HISTORY_URL_DATABASE_H_
 
+#include <set>
+#include <vector>
+
 #include "base/basictypes.h"
 #include "chrome/browser/history/history_types.h"
 #include "components/query_parser/query_parser.h"
@@ -89,8 +92,9 @@ class URLDatabase {
   bool InsertOrUpdateURLRowByID(const URLRow& info);
 
   // Delete the row of the corresponding URL. Only the row in the URL table and
-  // corresponding keyword search terms will be deleted, not any other data that
-  // may refer to the URL row. Returns true if the row existed and was deleted.
+  // corresponding URL words and keyword search terms will be deleted, not any
+  // other data that may refer to the URL row. Returns true if the row existed
+  // and was deleted.
   bool DeleteURLRow(URLID id);
 
   // URL mass-deleting ---------------------------------------------------------
@@ -183,8 +187,10 @@ class URLDatabase {
 
   // History search ------------------------------------------------------------
 
-  // Performs a brute force search over the database to find any URLs or titles
-  // which match the |query| string.  Returns any matches in |results|.
+  // Finds any URLs or titles which match the |query| string.  Returns any
+  // matches in |results|.  When the URL words table exists and few of the URLs
+  // contain a prefix of every word in |query|, only those URLs are examined;
+  // otherwise this is a brute force search over the database.
   bool GetTextMatches(const base::string16& query, URLRows* results);
 
   // Keyword Search Terms ------------------------------------------------------
@@ -266,6 +272,26 @@ class URLDatabase {
   // Deletes the keyword search terms table.
   bool DropKeywordSearchTermsTable();
 
+  // Ensures the URL words table, which maps the lower case words of every
+  // URL and title to the URL's ID for GetTextMatches(), exists. Once this has
+  // been called the table is kept up to date as URLs are added, updated and
+  // deleted.
+  bool InitURLWordsTable();
+
+  // Creates the indices used for the URL words.
+  bool CreateURLWordsIndices();
+
+  // Returns true if the largest URL ID is the same in the URL words table as
+  // in the URL table. Builds which predate the URL words table can still open
+  // the database, and add URLs without words, which gives the URL table a
+  // larger ID, or delete URLs and leave their words behind, which gives the
+  // words a larger one.
+  bool URLWordsMatchURLTable();
+
+  // Replaces the contents of the URL words table with the words of every row
+  // in the URL table. Returns true on success.
+  bool RebuildURLWordsTable();
+
   // Inserts the given URL row into the URLs table, using the regular table
   // if is_temporary is false, or the temporary URL table if is temporary is
   // true. The current |id| of |info| will be ignored in both cases and a new ID
@@ -283,10 +309,43 @@ class URLDatabase {
   virtual sql::Connection& GetDB() = 0;
 
  private:
+  // Appends the lower case words of |url| and |title|, including the Unicode
+  // form of an IDN host, to |words|. These are the words GetTextMatches()
+  // matches a query against.
+  void ExtractURLWords(const base::string16& url,
+                       const base::string16& title,
+                       query_parser::QueryWordVector* words);
+
+  // Replaces the entries of |url_id| in the URL words table with the words of
+  // |url| and |title|. Returns true on success.
+  bool SetURLWords(URLID url_id,
+                   const base::string16& url,
+                   const base::string16& title);
+
+  // Deletes the entries of |url_id| from the URL words table.
+  bool DeleteURLWords(URLID url_id);
+
+  // Fills |url_ids| with the URLs whose words include a prefix match for
+  // every word of |query|, a superset of the URLs that match |query|. Returns
+  // false if |query| has no words to look up.
+  bool GetURLWordsCandidates(const base::string16& query,
+                             std::set<URLID>* url_ids);
+
+  // Appends the row |statement| is on to |results| if its words match
+  // |query_nodes|.
+  void AddRowIfTextMatches(
+      sql::Statement& statement,
+      const std::vector<query_parser::QueryNode*>& query_nodes,
+      URLRows* results);
+
   // True if InitKeywordSearchTermsTable() has been invoked. Not all subclasses
   // have keyword search terms.
   bool has_keyword_search_terms_;
 
+  // True if InitURLWordsTable() has been invoked. Subclasses without the table
+  // fall back to a full scan in GetTextMatches().
+  bool has_url_words_;
+
   query_parser::QueryParser query_parser_;
 
   DISALLOW_COPY_AND_ASSIGN(URLDatabase);
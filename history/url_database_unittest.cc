@@ -6,6 +6,7 @@
 #include "base/files/scoped_temp_dir.h"
 #include "base/path_service.h"
 #include "base/strings/string_util.h"
+#include "base/strings/stringprintf.h"
 #include "base/strings/utf_string_conversions.h"
 #include "chrome/browser/history/url_database.h"
 #include "sql/connection.h"
@@ -44,6 +45,19 @@ class URLDatabaseTest : public testing::Test,
     return db_;
   }
 
+  // Adds |count| URLs which share no words with the URLs of the text search
+  // tests, so that those URLs are few enough of the table for GetTextMatches()
+  // to use the URL words.
+  void AddUnrelatedURLs(size_t count, bool temporary) {
+    for (size_t i = 0; i < count; ++i) {
+      URLRow url_info(GURL(base::StringPrintf("http://unrelated%d.test/",
+                                              static_cast<int>(i))));
+      url_info.set_title(base::UTF8ToUTF16("Unrelated"));
+      url_info.set_last_visit(Time::Now());
+      EXPECT_NE(0, temporary ? AddTemporaryURL(url_info) : AddURL(url_info));
+    }
+  }
+
  private:
   // Test setup.
   virtual void SetUp() {
@@ -57,6 +71,8 @@ class URLDatabaseTest : public testing::Test,
     CreateMainURLIndex();
     InitKeywordSearchTermsTable();
     CreateKeywordSearchTermsIndices();
+    InitURLWordsTable();
+    CreateURLWordsIndices();
   }
   virtual void TearDown() {
     db_.Close();
@@ -212,6 +228,135 @@ TEST_F(URLDatabaseTest, DeleteURLDeletesKeywordSearchTermVisit) {
   ASSERT_EQ(0U, matches.size());
 }
 
+// Tests that text search finds URLs by the words of their URL and title, and
+// follows the URLs as they are updated and deleted.
+TEST_F(URLDatabaseTest, TextMatches) {
+  URLRow url_info1(GURL("http://www.example.com/recipes"));
+  url_info1.set_title(base::UTF8ToUTF16("Chocolate Cake"));
+  url_info1.set_last_visit(Time::Now());
+  URLID url_id1 = AddURL(url_info1);
+  ASSERT_NE(0, url_id1);
+
+  URLRow url_info2(GURL("http://www.example.org/dessert"));
+  url_info2.set_title(base::UTF8ToUTF16("Cheese cake"));
+  url_info2.set_last_visit(Time::Now());
+  URLID url_id2 = AddURL(url_info2);
+  ASSERT_NE(0, url_id2);
+
+  URLRow url_info3(GURL("http://www.example.net/"));
+  url_info3.set_title(base::UTF8ToUTF16("Hidden cake"));
+  url_info3.set_last_visit(Time::Now());
+  url_info3.set_hidden(true);
+  ASSERT_NE(0, AddURL(url_info3));
+
+  const size_t kUnrelatedURLCount = 20;
+  AddUnrelatedURLs(kUnrelatedURLCount, false);
+
+  // Matches are found by title and by URL, and never include hidden URLs.
+  URLRows results;
+  EXPECT_TRUE(GetTextMatches(base::UTF8ToUTF16("cake"), &results));
+  ASSERT_EQ(2U, results.size());
+  EXPECT_EQ(url_id1, results[0].id());
+  EXPECT_EQ(url_id2, results[1].id());
+
+  EXPECT_TRUE(GetTextMatches(base::UTF8ToUTF16("RECIPES"), &results));
+  ASSERT_EQ(1U, results.size());
+  EXPECT_EQ(url_id1, results[0].id());
+
+  // Every word of the query has to match, possibly as a prefix.
+  EXPECT_TRUE(GetTextMatches(base::UTF8ToUTF16("cheese cak"), &results));
+  ASSERT_EQ(1U, results.size());
+  EXPECT_EQ(url_id2, results[0].id());
+  EXPECT_FALSE(GetTextMatches(base::UTF8ToUTF16("cheese pie"), &results));
+  EXPECT_TRUE(results.empty());
+
+  // Words found in most URLs are matched by scanning every URL instead.
+  EXPECT_TRUE(GetTextMatches(base::UTF8ToUTF16("http"), &results));
+  EXPECT_EQ(kUnrelatedURLCount + 2, results.size());
+
+  // Phrases are matched as a whole.
+  EXPECT_FALSE(GetTextMatches(base::UTF8ToUTF16("\"cake cheese\""),
+                              &results));
+  EXPECT_TRUE(GetTextMatches(base::UTF8ToUTF16("\"cheese cake\""),
+                             &results));
+  ASSERT_EQ(1U, results.size());
+
+  // A new title replaces the words of the old one.
+  url_info2.set_title(base::UTF8ToUTF16("Apple pie"));
+  ASSERT_TRUE(UpdateURLRow(url_id2, url_info2));
+  EXPECT_FALSE(GetTextMatches(base::UTF8ToUTF16("cheese"), &results));
+  EXPECT_TRUE(GetTextMatches(base::UTF8ToUTF16("apple"), &results));
+  ASSERT_EQ(1U, results.size());
+  EXPECT_EQ(url_id2, results[0].id());
+
+  // Updates that keep the title keep the words.
+  url_info2.set_visit_count(3);
+  ASSERT_TRUE(UpdateURLRow(url_id2, url_info2));
+  EXPECT_TRUE(GetTextMatches(base::UTF8ToUTF16("apple"), &results));
+
+  // Deleted URLs are no longer found.
+  ASSERT_TRUE(DeleteURLRow(url_id1));
+  EXPECT_TRUE(GetTextMatches(base::UTF8ToUTF16("cake"), &results));
+  ASSERT_EQ(1U, results.size());
+  EXPECT_EQ(url_id2, results[0].id());
+  EXPECT_FALSE(GetTextMatches(base::UTF8ToUTF16("chocolate"), &results));
+}
+
+// Tests that the words of the URLs kept by a mass delete are indexed under
+// their new IDs.
+TEST_F(URLDatabaseTest, TextMatchesAfterTemporaryURLTable) {
+  URLRow url_info1(GURL("http://www.example.com/"));
+  url_info1.set_title(base::UTF8ToUTF16("Deleted page"));
+  url_info1.set_last_visit(Time::Now());
+  ASSERT_NE(0, AddURL(url_info1));
+
+  URLRow url_info2(GURL("http://www.example.org/"));
+  url_info2.set_title(base::UTF8ToUTF16("Kept page"));
+  url_info2.set_last_visit(Time::Now());
+  ASSERT_NE(0, AddURL(url_info2));
+
+  ASSERT_TRUE(CreateTemporaryURLTable());
+  URLID kept_id = AddTemporaryURL(url_info2);
+  ASSERT_NE(0, kept_id);
+  AddUnrelatedURLs(10, true);
+  ASSERT_TRUE(CommitTemporaryURLTable());
+
+  URLRows results;
+  EXPECT_TRUE(GetTextMatches(base::UTF8ToUTF16("page"), &results));
+  ASSERT_EQ(1U, results.size());
+  EXPECT_EQ(kept_id, results[0].id());
+  EXPECT_EQ(url_info2.url(), results[0].url());
+}
+
+// Tests that URLs added or deleted without their words, as by builds which
+// predate the URL words table, are detected.
+TEST_F(URLDatabaseTest, URLWordsMatchURLTable) {
+  EXPECT_TRUE(URLWordsMatchURLTable());
+
+  URLRow url_info(GURL("http://www.example.com/"));
+  url_info.set_last_visit(Time::Now());
+  URLID url_id = AddURL(url_info);
+  ASSERT_NE(0, url_id);
+  EXPECT_TRUE(URLWordsMatchURLTable());
+
+  // Added without words.
+  ASSERT_TRUE(GetDB().Execute(
+      "INSERT INTO urls (url, title) VALUES ('http://www.example.org/', '')"));
+  EXPECT_FALSE(URLWordsMatchURLTable());
+  ASSERT_TRUE(RebuildURLWordsTable());
+  EXPECT_TRUE(URLWordsMatchURLTable());
+  URLRows results;
+  EXPECT_TRUE(GetTextMatches(base::UTF8ToUTF16("example"), &results));
+  EXPECT_EQ(2U, results.size());
+
+  // Deleted leaving the words behind.
+  ASSERT_TRUE(GetDB().Execute(
+      "DELETE FROM urls WHERE url = 'http://www.example.org/'"));
+  EXPECT_FALSE(URLWordsMatchURLTable());
+  ASSERT_TRUE(RebuildURLWordsTable());
+  EXPECT_TRUE(URLWordsMatchURLTable());
+}
+
 TEST_F(URLDatabaseTest, EnumeratorForSignificant) {
   std::set<std::string> good_urls;
   // Add URLs which do and don't meet the criteria.
@@ -0,0 +1,110 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/url_index_intersection_cache.h"
+
+#include <algorithm>
+
+namespace history {
+
+namespace {
+
+// Approximate per-entry bookkeeping of the MRU list and index map nodes.
+const size_t kEntryOverhead = 8 * sizeof(void*);
+
+}  // namespace
+
+URLIndexIntersectionCache::Stats::Stats()
+    : hits(0),
+      misses(0),
+      stale_hits(0),
+      entry_count(0),
+      bytes(0),
+      max_bytes(0) {
+}
+
+URLIndexIntersectionCache::URLIndexIntersectionCache(size_t max_bytes)
+    : entries_(EntryCache::NO_AUTO_EVICT) {
+  stats_.max_bytes = max_bytes;
+}
+
+URLIndexIntersectionCache::~URLIndexIntersectionCache() {}
+
+// static
+base::string16 URLIndexIntersectionCache::KeyForWords(
+    const String16Vector& words) {
+  String16Vector sorted_words(words);
+  std::sort(sorted_words.begin(), sorted_words.end());
+  sorted_words.erase(std::unique(sorted_words.begin(), sorted_words.end()),
+                     sorted_words.end());
+  // Words never contain whitespace so a space is an unambiguous separator.
+  base::string16 key;
+  for (String16Vector::const_iterator iter = sorted_words.begin();
+       iter != sorted_words.end(); ++iter) {
+    if (!key.empty())
+      key.push_back(' ');
+    key.append(*iter);
+  }
+  return key;
+}
+
+bool URLIndexIntersectionCache::Lookup(const base::string16& key,
+                                       uint64 generation,
+                                       HistoryIDVector* history_ids) {
+  EntryCache::iterator iter = entries_.Get(key);
+  if (iter == entries_.end()) {
+    ++stats_.misses;
+    return false;
+  }
+  if (iter->second.generation != generation) {
+    ++stats_.stale_hits;
+    ++stats_.misses;
+    Erase(iter);
+    return false;
+  }
+  ++stats_.hits;
+  *history_ids = iter->second.history_ids;
+  return true;
+}
+
+void URLIndexIntersectionCache::Insert(const base::string16& key,
+                                       uint64 generation,
+                                       const HistoryIDVector& history_ids) {
+  EntryCache::iterator existing = entries_.Peek(key);
+  if (existing != entries_.end())
+    Erase(existing);
+
+  Entry entry;
+  entry.generation = generation;
+  entry.history_ids = history_ids;
+  const size_t entry_bytes = EntryBytes(key, entry);
+  if (entry_bytes > stats_.max_bytes / 4)
+    return;
+  while (stats_.bytes + entry_bytes > stats_.max_bytes && !entries_.empty())
+    Erase(--entries_.end());
+  entries_.Put(key, entry);
+  stats_.bytes += entry_bytes;
+  stats_.entry_count = entries_.size();
+}
+
+void URLIndexIntersectionCache::Clear() {
+  entries_.Clear();
+  stats_.bytes = 0;
+  stats_.entry_count = 0;
+}
+
+// static
+size_t URLIndexIntersectionCache::EntryBytes(const base::string16& key,
+                                             const Entry& entry) {
+  return kEntryOverhead + 2 * key.size() * sizeof(base::char16) +
+      entry.history_ids.size() * sizeof(HistoryID);
+}
+
+void URLIndexIntersectionCache::Erase(EntryCache::iterator iter) {
+  stats_.bytes -= EntryBytes(iter->first, iter->second);
+  entries_.Erase(iter);
+  stats_.entry_count = entries_.size();
+}
+
+}  // namespace history
@@ -0,0 +1,86 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_HISTORY_URL_INDEX_INTERSECTION_CACHE_H_
+#define CHROME_BROWSER_HISTORY_URL_INDEX_INTERSECTION_CACHE_H_
+
+#include "base/basictypes.h"
+#include "base/containers/mru_cache.h"
+#include "base/strings/string16.h"
+#include "chrome/browser/history/in_memory_url_index_types.h"
+#include "chrome/browser/history/url_index_posting_lists.h"
+
+namespace history {
+
+// A bounded, least-recently-used cache of the candidate history IDs found for
+// a set of search words, used by URLIndexPrivateData alongside its
+// prefix-only search term cache. Entries are keyed by the sorted, de-duplicated
+// words so that reordered terms share an entry, and single words are cached
+// on their own so that editing one term of a multi-term input only recomputes
+// that term. Backspacing lands on entries recorded while typing forward.
+//
+// Each entry is stamped with the index generation it was computed against.
+// The index bumps its generation whenever its contents change, which makes
+// every older entry a miss without having to walk the cache; stale entries
+// are dropped as they are encountered or age out.
+class URLIndexIntersectionCache {
+ public:
+  struct Stats {
+    Stats();
+
+    size_t hits;
+    size_t misses;
+    // Lookups which found an entry from an older index generation. These are
+    // also counted as misses.
+    size_t stale_hits;
+    size_t entry_count;
+    size_t bytes;
+    size_t max_bytes;
+  };
+
+  // |max_bytes| bounds the estimated heap held by the cached entries.
+  explicit URLIndexIntersectionCache(size_t max_bytes);
+  ~URLIndexIntersectionCache();
+
+  // Returns the key for |words|, independent of their order.
+  static base::string16 KeyForWords(const String16Vector& words);
+
+  // Copies the entry for |key| to |history_ids| and returns true if it was
+  // recorded at |generation|.
+  bool Lookup(const base::string16& key,
+              uint64 generation,
+              HistoryIDVector* history_ids);
+
+  // Records |history_ids| for |key| at |generation|, evicting the least
+  // recently used entries as needed to stay within the byte budget. Lists
+  // which alone exceed a quarter of the budget are not cached.
+  void Insert(const base::string16& key,
+              uint64 generation,
+              const HistoryIDVector& history_ids);
+
+  void Clear();
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  struct Entry {
+    uint64 generation;
+    HistoryIDVector history_ids;
+  };
+  typedef base::MRUCache<base::string16, Entry> EntryCache;
+
+  // Returns the estimated heap held for |key| and |entry|.
+  static size_t EntryBytes(const base::string16& key, const Entry& entry);
+
+  void Erase(EntryCache::iterator iter);
+
+  EntryCache entries_;
+  Stats stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(URLIndexIntersectionCache);
+};
+
+}  // namespace history
+
+#endif  // CHROME_BROWSER_HISTORY_URL_INDEX_INTERSECTION_CACHE_H_
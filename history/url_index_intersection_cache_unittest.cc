@@ -0,0 +1,84 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/url_index_intersection_cache.h"
+
+#include "base/strings/utf_string_conversions.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using base::ASCIIToUTF16;
+
+namespace history {
+
+namespace {
+
+HistoryIDVector MakeHistoryIDs(HistoryID first, size_t count) {
+  HistoryIDVector history_ids;
+  for (size_t i = 0; i < count; ++i)
+    history_ids.push_back(first + i);
+  return history_ids;
+}
+
+}  // namespace
+
+TEST(URLIndexIntersectionCacheTest, KeyIgnoresOrderAndDuplicates) {
+  String16Vector words;
+  words.push_back(ASCIIToUTF16("news"));
+  words.push_back(ASCIIToUTF16("bike"));
+  words.push_back(ASCIIToUTF16("news"));
+  String16Vector reordered;
+  reordered.push_back(ASCIIToUTF16("bike"));
+  reordered.push_back(ASCIIToUTF16("news"));
+  EXPECT_EQ(ASCIIToUTF16("bike news"),
+            URLIndexIntersectionCache::KeyForWords(words));
+  EXPECT_EQ(URLIndexIntersectionCache::KeyForWords(words),
+            URLIndexIntersectionCache::KeyForWords(reordered));
+}
+
+TEST(URLIndexIntersectionCacheTest, HitsAndGenerations) {
+  URLIndexIntersectionCache cache(64 * 1024);
+  HistoryIDVector history_ids;
+  const base::string16 key(ASCIIToUTF16("bike news"));
+  EXPECT_FALSE(cache.Lookup(key, 1, &history_ids));
+
+  cache.Insert(key, 1, MakeHistoryIDs(10, 3));
+  ASSERT_TRUE(cache.Lookup(key, 1, &history_ids));
+  EXPECT_EQ(MakeHistoryIDs(10, 3), history_ids);
+  EXPECT_EQ(1U, cache.stats().hits);
+  EXPECT_EQ(1U, cache.stats().misses);
+  EXPECT_EQ(1U, cache.stats().entry_count);
+  EXPECT_GT(cache.stats().bytes, 0U);
+
+  // A newer index generation makes the entry stale.
+  EXPECT_FALSE(cache.Lookup(key, 2, &history_ids));
+  EXPECT_EQ(1U, cache.stats().stale_hits);
+  EXPECT_EQ(0U, cache.stats().entry_count);
+  EXPECT_EQ(0U, cache.stats().bytes);
+}
+
+TEST(URLIndexIntersectionCacheTest, EvictsLeastRecentlyUsed) {
+  URLIndexIntersectionCache cache(1400);
+  HistoryIDVector history_ids;
+  cache.Insert(ASCIIToUTF16("a"), 1, MakeHistoryIDs(0, 32));
+  cache.Insert(ASCIIToUTF16("b"), 1, MakeHistoryIDs(0, 32));
+  cache.Insert(ASCIIToUTF16("c"), 1, MakeHistoryIDs(0, 32));
+  // Touch "a" so that "b" is the oldest.
+  EXPECT_TRUE(cache.Lookup(ASCIIToUTF16("a"), 1, &history_ids));
+  cache.Insert(ASCIIToUTF16("d"), 1, MakeHistoryIDs(0, 32));
+  cache.Insert(ASCIIToUTF16("e"), 1, MakeHistoryIDs(0, 32));
+  EXPECT_LE(cache.stats().bytes, cache.stats().max_bytes);
+  EXPECT_TRUE(cache.Lookup(ASCIIToUTF16("a"), 1, &history_ids));
+  EXPECT_FALSE(cache.Lookup(ASCIIToUTF16("b"), 1, &history_ids));
+  EXPECT_TRUE(cache.Lookup(ASCIIToUTF16("e"), 1, &history_ids));
+
+  // Lists too large for the budget are not cached at all.
+  cache.Insert(ASCIIToUTF16("f"), 1, MakeHistoryIDs(0, 1024));
+  EXPECT_FALSE(cache.Lookup(ASCIIToUTF16("f"), 1, &history_ids));
+
+  cache.Clear();
+  EXPECT_EQ(0U, cache.stats().entry_count);
+  EXPECT_EQ(0U, cache.stats().bytes);
+}
+
+}  // namespace history
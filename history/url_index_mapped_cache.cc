@@ -0,0 +1,512 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/url_index_mapped_cache.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/files/important_file_writer.h"
+#include "base/logging.h"
+#include "url/gurl.h"
+
+namespace history {
+
+namespace {
+
+// "HQPM" in little-endian order. A file written on a machine of the other
+// endianness fails the magic check and is rebuilt.
+const uint32 kMappedCacheMagic = 0x4d505148;
+
+// Bump whenever the layout below changes; older files are then ignored and
+// the index is rebuilt from the history database.
+const uint32 kMappedCacheVersion = 1;
+
+// Every section starts on this boundary so that its entries may be read in
+// place.
+const size_t kSectionAlignment = 8;
+
+struct CharEntry {
+  uint16 character;
+  uint16 padding;
+  uint32 word_ids_first;  // Index into the char word IDs section.
+  uint32 word_ids_count;
+};
+COMPILE_ASSERT(sizeof(CharEntry) == 12, char_entry_has_stable_layout);
+
+// Indexed by WordID.
+struct WordEntry {
+  uint32 text_first;  // Index into the UTF-16 text section.
+  uint32 text_length;
+  uint32 history_ids_first;  // Index into the word history IDs section.
+  uint32 history_ids_count;
+};
+COMPILE_ASSERT(sizeof(WordEntry) == 16, word_entry_has_stable_layout);
+
+// Sorted by history_id.
+struct RowEntry {
+  int64 history_id;
+  int64 last_visit;
+  int32 visit_count;
+  int32 typed_count;
+  uint32 url_first;  // Index into the UTF-8 text section.
+  uint32 url_length;
+  uint32 title_first;  // Index into the UTF-16 text section.
+  uint32 title_length;
+  uint32 visits_first;
+  uint32 visits_count;
+  uint32 url_starts_first;  // Index into the word starts section.
+  uint32 url_starts_count;
+  uint32 title_starts_first;
+  uint32 title_starts_count;
+};
+COMPILE_ASSERT(sizeof(RowEntry) == 64, row_entry_has_stable_layout);
+
+struct VisitEntry {
+  int64 visit_time;
+  int32 transition;
+  int32 padding;
+};
+COMPILE_ASSERT(sizeof(VisitEntry) == 16, visit_entry_has_stable_layout);
+
+// Appends |count| elements of |data| to |buffer|.
+template <typename T>
+void AppendArray(std::string* buffer, const T* data, size_t count) {
+  if (count)
+    buffer->append(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+void PadToAlignment(std::string* buffer) {
+  buffer->resize((buffer->size() + kSectionAlignment - 1) &
+                 ~(kSectionAlignment - 1));
+}
+
+}  // namespace
+
+struct URLIndexMappedCache::Section {
+  uint32 offset;  // In bytes from the start of the file.
+  uint32 count;  // In elements.
+};
+
+struct URLIndexMappedCache::Header {
+  uint32 magic;
+  uint32 version;
+  int64 last_rebuild_time;
+  Section chars;
+  Section char_word_ids;
+  Section words;
+  Section word_history_ids;
+  Section rows;
+  Section visits;
+  Section word_starts;
+  Section text16;
+  Section text8;
+};
+
+URLIndexMappedCache::URLIndexMappedCache() : header_(NULL) {
+}
+
+URLIndexMappedCache::~URLIndexMappedCache() {
+}
+
+// static
+scoped_ptr<URLIndexMappedCache> URLIndexMappedCache::Open(
+    const base::FilePath& path) {
+  scoped_ptr<URLIndexMappedCache> cache(new URLIndexMappedCache);
+  if (!cache->Initialize(path))
+    return scoped_ptr<URLIndexMappedCache>();
+  return cache.Pass();
+}
+
+bool URLIndexMappedCache::Initialize(const base::FilePath& path) {
+  COMPILE_ASSERT(sizeof(Header) == 88, header_has_stable_layout);
+  if (!file_.Initialize(path))
+    return false;
+  if (file_.length() < sizeof(Header))
+    return false;
+  header_ = reinterpret_cast<const Header*>(file_.data());
+  if (header_->magic != kMappedCacheMagic ||
+      header_->version != kMappedCacheVersion)
+    return false;
+
+  const struct {
+    const Section* section;
+    size_t element_size;
+  } sections[] = {
+    { &header_->chars, sizeof(CharEntry) },
+    { &header_->char_word_ids, sizeof(uint32) },
+    { &header_->words, sizeof(WordEntry) },
+    { &header_->word_history_ids, sizeof(int64) },
+    { &header_->rows, sizeof(RowEntry) },
+    { &header_->visits, sizeof(VisitEntry) },
+    { &header_->word_starts, sizeof(uint32) },
+    { &header_->text16, sizeof(base::char16) },
+    { &header_->text8, sizeof(char) },
+  };
+  for (size_t i = 0; i < arraysize(sections); ++i) {
+    const Section& section = *sections[i].section;
+    uint64 end = static_cast<uint64>(section.offset) +
+        static_cast<uint64>(section.count) * sections[i].element_size;
+    if (section.offset % kSectionAlignment != 0 || end > file_.length())
+      return false;
+  }
+  return true;
+}
+
+template <typename T>
+const T* URLIndexMappedCache::SectionData(const Section& section) const {
+  if (!section.count)
+    return NULL;
+  return reinterpret_cast<const T*>(file_.data() + section.offset);
+}
+
+// static
+bool URLIndexMappedCache::RangeInSection(const Section& section,
+                                         uint32 first,
+                                         uint32 count) {
+  return first <= section.count && count <= section.count - first;
+}
+
+// static
+bool URLIndexMappedCache::Write(const base::FilePath& path,
+                                base::Time last_time_rebuilt_from_history,
+                                const String16Vector& word_list,
+                                const CharWordIDMap& char_word_map,
+                                const WordIDHistoryMap& word_id_history_map,
+                                const HistoryInfoMap& history_info_map,
+                                const WordStartsMap& word_starts_map) {
+  std::vector<CharEntry> chars;
+  std::vector<uint32> char_word_ids;
+  for (CharWordIDMap::const_iterator iter = char_word_map.begin();
+       iter != char_word_map.end(); ++iter) {
+    CharEntry entry = { static_cast<uint16>(iter->first), 0,
+                        static_cast<uint32>(char_word_ids.size()),
+                        static_cast<uint32>(iter->second.size()) };
+    chars.push_back(entry);
+    char_word_ids.insert(char_word_ids.end(), iter->second.begin(),
+                         iter->second.end());
+  }
+
+  base::string16 text16;
+  std::vector<WordEntry> words;
+  std::vector<int64> word_history_ids;
+  words.reserve(word_list.size());
+  for (WordID word_id = 0; word_id < word_list.size(); ++word_id) {
+    WordEntry entry = { static_cast<uint32>(text16.size()),
+                        static_cast<uint32>(word_list[word_id].size()),
+                        static_cast<uint32>(word_history_ids.size()), 0 };
+    text16.append(word_list[word_id]);
+    WordIDHistoryMap::const_iterator history_pos =
+        word_id_history_map.find(word_id);
+    if (history_pos != word_id_history_map.end()) {
+      entry.history_ids_count =
+          static_cast<uint32>(history_pos->second.size());
+      word_history_ids.insert(word_history_ids.end(),
+                              history_pos->second.begin(),
+                              history_pos->second.end());
+    }
+    words.push_back(entry);
+  }
+
+  std::string text8;
+  std::vector<RowEntry> rows;
+  std::vector<VisitEntry> visits;
+  std::vector<uint32> word_starts;
+  rows.reserve(history_info_map.size());
+  for (HistoryInfoMap::const_iterator iter = history_info_map.begin();
+       iter != history_info_map.end(); ++iter) {
+    const URLRow& url_row = iter->second.url_row;
+    const std::string& url = url_row.url().spec();
+    RowEntry entry = {};
+    entry.history_id = iter->first;
+    entry.last_visit = url_row.last_visit().ToInternalValue();
+    entry.visit_count = url_row.visit_count();
+    entry.typed_count = url_row.typed_count();
+    entry.url_first = static_cast<uint32>(text8.size());
+    entry.url_length = static_cast<uint32>(url.size());
+    text8.append(url);
+    entry.title_first = static_cast<uint32>(text16.size());
+    entry.title_length = static_cast<uint32>(url_row.title().size());
+    text16.append(url_row.title());
+    entry.visits_first = static_cast<uint32>(visits.size());
+    entry.visits_count = static_cast<uint32>(iter->second.visits.size());
+    for (VisitInfoVector::const_iterator visit = iter->second.visits.begin();
+         visit != iter->second.visits.end(); ++visit) {
+      VisitEntry visit_entry = { visit->first.ToInternalValue(),
+                                 static_cast<int32>(visit->second), 0 };
+      visits.push_back(visit_entry);
+    }
+    WordStartsMap::const_iterator starts_pos =
+        word_starts_map.find(iter->first);
+    entry.url_starts_first = static_cast<uint32>(word_starts.size());
+    entry.title_starts_first = static_cast<uint32>(word_starts.size());
+    if (starts_pos != word_starts_map.end()) {
+      const RowWordStarts& row_starts = starts_pos->second;
+      entry.url_starts_count =
+          static_cast<uint32>(row_starts.url_word_starts_.size());
+      word_starts.insert(word_starts.end(),
+                         row_starts.url_word_starts_.begin(),
+                         row_starts.url_word_starts_.end());
+      entry.title_starts_first = static_cast<uint32>(word_starts.size());
+      entry.title_starts_count =
+          static_cast<uint32>(row_starts.title_word_starts_.size());
+      word_starts.insert(word_starts.end(),
+                         row_starts.title_word_starts_.begin(),
+                         row_starts.title_word_starts_.end());
+    }
+    rows.push_back(entry);
+  }
+
+  Header header = {};
+  header.magic = kMappedCacheMagic;
+  header.version = kMappedCacheVersion;
+  header.last_rebuild_time = last_time_rebuilt_from_history.ToInternalValue();
+  std::string buffer(sizeof(Header), '\0');
+
+#define APPEND_SECTION(name, data, count) \
+  PadToAlignment(&buffer); \
+  header.name.offset = static_cast<uint32>(buffer.size()); \
+  header.name.count = static_cast<uint32>(count); \
+  AppendArray(&buffer, (data), (count));
+
+  APPEND_SECTION(chars, chars.empty() ? NULL : &chars[0], chars.size());
+  APPEND_SECTION(char_word_ids,
+                 char_word_ids.empty() ? NULL : &char_word_ids[0],
+                 char_word_ids.size());
+  APPEND_SECTION(words, words.empty() ? NULL : &words[0], words.size());
+  APPEND_SECTION(word_history_ids,
+                 word_history_ids.empty() ? NULL : &word_history_ids[0],
+                 word_history_ids.size());
+  APPEND_SECTION(rows, rows.empty() ? NULL : &rows[0], rows.size());
+  APPEND_SECTION(visits, visits.empty() ? NULL : &visits[0], visits.size());
+  APPEND_SECTION(word_starts, word_starts.empty() ? NULL : &word_starts[0],
+                 word_starts.size());
+  APPEND_SECTION(text16, text16.data(), text16.size());
+  APPEND_SECTION(text8, text8.data(), text8.size());
+#undef APPEND_SECTION
+
+  if (buffer.size() > kuint32max) {
+    LOG(WARNING) << "InMemoryURLIndex mapped cache too large to write.";
+    return false;
+  }
+  buffer.replace(0, sizeof(Header), reinterpret_cast<const char*>(&header),
+                 sizeof(Header));
+  return base::ImportantFileWriter::WriteFileAtomically(path, buffer);
+}
+
+HistoryIDVector URLIndexMappedCache::HistoryIDsForTerm(
+    const base::string16& term) const {
+  if (term.empty())
+    return HistoryIDVector();
+
+  // Intersect the word lists of each character, shortest first.
+  const CharEntry* chars = SectionData<CharEntry>(header_->chars);
+  const CharEntry* chars_end = chars + header_->chars.count;
+  const uint32* char_word_ids = SectionData<uint32>(header_->char_word_ids);
+  std::vector<const CharEntry*> entries;
+  Char16Set term_chars = Char16SetFromString16(term);
+  for (Char16Set::const_iterator iter = term_chars.begin();
+       iter != term_chars.end(); ++iter) {
+    const CharEntry* pos = chars;
+    size_t count = header_->chars.count;
+    while (count > 0) {
+      size_t half = count / 2;
+      if (pos[half].character < *iter) {
+        pos += half + 1;
+        count -= half + 1;
+      } else {
+        count = half;
+      }
+    }
+    if (pos == chars_end || pos->character != *iter || !pos->word_ids_count ||
+        !RangeInSection(header_->char_word_ids, pos->word_ids_first,
+                        pos->word_ids_count))
+      return HistoryIDVector();
+    entries.push_back(pos);
+  }
+  for (size_t i = 1; i < entries.size(); ++i) {
+    for (size_t j = i;
+         j > 0 && entries[j]->word_ids_count < entries[j - 1]->word_ids_count;
+         --j)
+      std::swap(entries[j], entries[j - 1]);
+  }
+
+  const uint32* first_ids = char_word_ids + entries[0]->word_ids_first;
+  WordIDVector word_ids(first_ids, first_ids + entries[0]->word_ids_count);
+  WordIDVector char_ids;
+  WordIDVector scratch;
+  for (size_t i = 1; i < entries.size() && !word_ids.empty(); ++i) {
+    const uint32* ids = char_word_ids + entries[i]->word_ids_first;
+    char_ids.assign(ids, ids + entries[i]->word_ids_count);
+    IntersectSortedWordIDs(word_ids, char_ids, &scratch);
+    word_ids.swap(scratch);
+  }
+
+  // Keep the words which contain the term and union their history items.
+  const WordEntry* words = SectionData<WordEntry>(header_->words);
+  const int64* word_history_ids =
+      SectionData<int64>(header_->word_history_ids);
+  const base::char16* text16 = SectionData<base::char16>(header_->text16);
+  HistoryIDVector history_ids;
+  size_t matching_words = 0;
+  for (WordIDVector::const_iterator iter = word_ids.begin();
+       iter != word_ids.end(); ++iter) {
+    if (*iter >= header_->words.count)
+      continue;
+    const WordEntry& word = words[*iter];
+    if (!RangeInSection(header_->text16, word.text_first, word.text_length) ||
+        !RangeInSection(header_->word_history_ids, word.history_ids_first,
+                        word.history_ids_count))
+      continue;
+    if (term.length() > 1) {
+      const base::char16* text = text16 + word.text_first;
+      if (std::search(text, text + word.text_length, term.begin(),
+                      term.end()) == text + word.text_length)
+        continue;
+    }
+    const int64* ids = word_history_ids + word.history_ids_first;
+    history_ids.insert(history_ids.end(), ids, ids + word.history_ids_count);
+    ++matching_words;
+  }
+  if (matching_words > 1) {
+    std::sort(history_ids.begin(), history_ids.end());
+    history_ids.erase(std::unique(history_ids.begin(), history_ids.end()),
+                      history_ids.end());
+  }
+  return history_ids;
+}
+
+int URLIndexMappedCache::FindRow(HistoryID history_id) const {
+  const RowEntry* rows = SectionData<RowEntry>(header_->rows);
+  size_t low = 0;
+  size_t high = header_->rows.count;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (rows[middle].history_id < history_id)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  if (low == header_->rows.count || rows[low].history_id != history_id)
+    return -1;
+  return static_cast<int>(low);
+}
+
+bool URLIndexMappedCache::GetRow(HistoryID history_id,
+                                 HistoryInfoMapValue* value,
+                                 RowWordStarts* word_starts) const {
+  int index = FindRow(history_id);
+  return index >= 0 && GetRowAt(index, NULL, value, word_starts);
+}
+
+bool URLIndexMappedCache::GetRowFactors(HistoryID history_id,
+                                        int* typed_count,
+                                        int* visit_count,
+                                        base::Time* last_visit) const {
+  int index = FindRow(history_id);
+  if (index < 0)
+    return false;
+  const RowEntry& row = SectionData<RowEntry>(header_->rows)[index];
+  *typed_count = row.typed_count;
+  *visit_count = row.visit_count;
+  *last_visit = base::Time::FromInternalValue(row.last_visit);
+  return true;
+}
+
+size_t URLIndexMappedCache::word_slot_count() const {
+  return header_->words.count;
+}
+
+bool URLIndexMappedCache::WordText(WordID word_id,
+                                   base::string16* word) const {
+  if (word_id >= header_->words.count)
+    return false;
+  const WordEntry& entry = SectionData<WordEntry>(header_->words)[word_id];
+  if (!RangeInSection(header_->text16, entry.text_first, entry.text_length))
+    return false;
+  const base::char16* text =
+      SectionData<base::char16>(header_->text16) + entry.text_first;
+  word->assign(text, entry.text_length);
+  return true;
+}
+
+bool URLIndexMappedCache::GetWord(WordID word_id,
+                                  base::string16* word,
+                                  HistoryIDVector* history_ids) const {
+  if (!WordText(word_id, word))
+    return false;
+  const WordEntry& entry = SectionData<WordEntry>(header_->words)[word_id];
+  if (!RangeInSection(header_->word_history_ids, entry.history_ids_first,
+                      entry.history_ids_count))
+    return false;
+  history_ids->clear();
+  if (entry.history_ids_count) {
+    const int64* ids = SectionData<int64>(header_->word_history_ids) +
+        entry.history_ids_first;
+    history_ids->assign(ids, ids + entry.history_ids_count);
+  }
+  return true;
+}
+
+size_t URLIndexMappedCache::row_count() const {
+  return header_->rows.count;
+}
+
+bool URLIndexMappedCache::GetRowAt(size_t index,
+                                   HistoryID* history_id,
+                                   HistoryInfoMapValue* value,
+                                   RowWordStarts* word_starts) const {
+  if (index >= header_->rows.count)
+    return false;
+  const RowEntry& row = SectionData<RowEntry>(header_->rows)[index];
+  if (!RangeInSection(header_->text8, row.url_first, row.url_length) ||
+      !RangeInSection(header_->text16, row.title_first, row.title_length) ||
+      !RangeInSection(header_->visits, row.visits_first, row.visits_count) ||
+      !RangeInSection(header_->word_starts, row.url_starts_first,
+                      row.url_starts_count) ||
+      !RangeInSection(header_->word_starts, row.title_starts_first,
+                      row.title_starts_count))
+    return false;
+
+  if (history_id)
+    *history_id = row.history_id;
+  if (value) {
+    const char* url = SectionData<char>(header_->text8) + row.url_first;
+    URLRow url_row(GURL(std::string(url, row.url_length)), row.history_id);
+    url_row.set_visit_count(row.visit_count);
+    url_row.set_typed_count(row.typed_count);
+    url_row.set_last_visit(base::Time::FromInternalValue(row.last_visit));
+    if (row.title_length) {
+      const base::char16* title =
+          SectionData<base::char16>(header_->text16) + row.title_first;
+      url_row.set_title(base::string16(title, row.title_length));
+    }
+    value->url_row = url_row;
+    value->visits.clear();
+    const VisitEntry* visits =
+        SectionData<VisitEntry>(header_->visits) + row.visits_first;
+    for (uint32 i = 0; i < row.visits_count; ++i) {
+      value->visits.push_back(std::make_pair(
+          base::Time::FromInternalValue(visits[i].visit_time),
+          static_cast<content::PageTransition>(visits[i].transition)));
+    }
+  }
+  if (word_starts) {
+    const uint32* starts = SectionData<uint32>(header_->word_starts);
+    word_starts->url_word_starts_.assign(
+        starts + row.url_starts_first,
+        starts + row.url_starts_first + row.url_starts_count);
+    word_starts->title_word_starts_.assign(
+        starts + row.title_starts_first,
+        starts + row.title_starts_first + row.title_starts_count);
+  }
+  return true;
+}
+
+base::Time URLIndexMappedCache::last_time_rebuilt_from_history() const {
+  return base::Time::FromInternalValue(header_->last_rebuild_time);
+}
+
+}  // namespace history
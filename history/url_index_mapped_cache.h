@@ -0,0 +1,114 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_HISTORY_URL_INDEX_MAPPED_CACHE_H_
+#define CHROME_BROWSER_HISTORY_URL_INDEX_MAPPED_CACHE_H_
+
+#include "base/basictypes.h"
+#include "base/files/file_path.h"
+#include "base/files/memory_mapped_file.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/strings/string16.h"
+#include "base/time/time.h"
+#include "chrome/browser/history/in_memory_url_index_types.h"
+#include "chrome/browser/history/url_index_posting_lists.h"
+
+namespace history {
+
+// A read-only view of a HistoryQuick provider index stored in a flat,
+// versioned binary file which is memory-mapped rather than parsed. Opening
+// the file only validates its header and section bounds, so the cost of
+// answering the first query after startup does not depend on the size of the
+// history; pages of the file are faulted in as queries touch them.
+//
+// The file is made of fixed-width tables (characters, words, history rows,
+// visits and word starts) followed by UTF-16 and UTF-8 string pools. Every
+// reference from one table into another is bounds-checked when it is
+// followed, so a truncated or corrupt file yields no results rather than an
+// out-of-bounds read.
+//
+// The object is immutable once opened and may be read from any thread.
+class URLIndexMappedCache {
+ public:
+  ~URLIndexMappedCache();
+
+  // Maps the file at |path|. Returns NULL if the file is missing, has an
+  // unknown version or inconsistent section bounds.
+  static scoped_ptr<URLIndexMappedCache> Open(const base::FilePath& path);
+
+  // Serializes the given index data to |path|, replacing any existing file
+  // atomically so that a reader holding the previous file keeps a consistent
+  // view. Returns true on success.
+  static bool Write(const base::FilePath& path,
+                    base::Time last_time_rebuilt_from_history,
+                    const String16Vector& word_list,
+                    const CharWordIDMap& char_word_map,
+                    const WordIDHistoryMap& word_id_history_map,
+                    const HistoryInfoMap& history_info_map,
+                    const WordStartsMap& word_starts_map);
+
+  // Returns the ascending IDs of the history items containing a word which
+  // contains |term|, using the same rules as
+  // URLIndexPrivateData::HistoryIDsForTerm().
+  HistoryIDVector HistoryIDsForTerm(const base::string16& term) const;
+
+  // Fills in the indexed data for |history_id|. Returns false if the item is
+  // not in the file.
+  bool GetRow(HistoryID history_id,
+              HistoryInfoMapValue* value,
+              RowWordStarts* word_starts) const;
+
+  // Retrieves the fields used to rank candidates before scoring. Returns
+  // false if the item is not in the file.
+  bool GetRowFactors(HistoryID history_id,
+                     int* typed_count,
+                     int* visit_count,
+                     base::Time* last_visit) const;
+
+  // Sequential access used when adopting the file into memory. Word slots
+  // which were unused when the file was written have an empty word.
+  size_t word_slot_count() const;
+  bool GetWord(WordID word_id,
+               base::string16* word,
+               HistoryIDVector* history_ids) const;
+  size_t row_count() const;
+  bool GetRowAt(size_t index,
+                HistoryID* history_id,
+                HistoryInfoMapValue* value,
+                RowWordStarts* word_starts) const;
+
+  base::Time last_time_rebuilt_from_history() const;
+
+ private:
+  struct Header;
+  struct Section;
+
+  URLIndexMappedCache();
+
+  // Validates the header and the bounds of every section.
+  bool Initialize(const base::FilePath& path);
+
+  // Returns a pointer to the first element of |section| viewed as an array of
+  // T, or NULL if the section is empty.
+  template <typename T>
+  const T* SectionData(const Section& section) const;
+
+  // Returns true if [first, first + count) lies within |section|.
+  static bool RangeInSection(const Section& section, uint32 first,
+                             uint32 count);
+
+  // Returns the index of |history_id| in the row table or -1.
+  int FindRow(HistoryID history_id) const;
+
+  bool WordText(WordID word_id, base::string16* word) const;
+
+  base::MemoryMappedFile file_;
+  const Header* header_;
+
+  DISALLOW_COPY_AND_ASSIGN(URLIndexMappedCache);
+};
+
+}  // namespace history
+
+#endif  // CHROME_BROWSER_HISTORY_URL_INDEX_MAPPED_CACHE_H_
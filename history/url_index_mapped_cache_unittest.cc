@@ -0,0 +1,174 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/url_index_mapped_cache.h"
+
+#include <string>
+
+#include "base/file_util.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/strings/utf_string_conversions.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "url/gurl.h"
+
+using base::ASCIIToUTF16;
+
+namespace history {
+
+class URLIndexMappedCacheTest : public testing::Test {
+ protected:
+  virtual void SetUp() OVERRIDE;
+
+  // Writes the index built in SetUp() to |path_|.
+  bool WriteIndex();
+
+  base::ScopedTempDir temp_dir_;
+  base::FilePath path_;
+  base::Time rebuild_time_;
+  String16Vector word_list_;
+  CharWordIDMap char_word_map_;
+  WordIDHistoryMap word_id_history_map_;
+  HistoryInfoMap history_info_map_;
+  WordStartsMap word_starts_map_;
+};
+
+void URLIndexMappedCacheTest::SetUp() {
+  ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+  path_ = temp_dir_.path().AppendASCII("mapped_index");
+  rebuild_time_ = base::Time::Now();
+
+  // Two rows: "cat.com/dog" (id 3) and "act.com" (id 9). Word 1 is an unused
+  // slot.
+  const char* kWords[] = { "cat", "", "dog", "act", "com" };
+  for (size_t i = 0; i < arraysize(kWords); ++i) {
+    base::string16 word(ASCIIToUTF16(kWords[i]));
+    word_list_.push_back(word);
+    if (word.empty())
+      continue;
+    for (size_t j = 0; j < word.length(); ++j)
+      char_word_map_[word[j]].insert(i);
+  }
+  word_id_history_map_[0].insert(3);
+  word_id_history_map_[2].insert(3);
+  word_id_history_map_[3].insert(9);
+  word_id_history_map_[4].insert(3);
+  word_id_history_map_[4].insert(9);
+
+  URLRow cat(GURL("http://cat.com/dog"), 3);
+  cat.set_title(ASCIIToUTF16("Cat Dog"));
+  cat.set_visit_count(5);
+  cat.set_typed_count(2);
+  cat.set_last_visit(rebuild_time_ - base::TimeDelta::FromDays(1));
+  history_info_map_[3].url_row = cat;
+  history_info_map_[3].visits.push_back(
+      std::make_pair(cat.last_visit(), content::PAGE_TRANSITION_TYPED));
+  word_starts_map_[3].url_word_starts_.push_back(7);
+  word_starts_map_[3].url_word_starts_.push_back(11);
+  word_starts_map_[3].title_word_starts_.push_back(0);
+  word_starts_map_[3].title_word_starts_.push_back(4);
+
+  URLRow act(GURL("http://act.com/"), 9);
+  act.set_visit_count(1);
+  act.set_last_visit(rebuild_time_ - base::TimeDelta::FromDays(2));
+  history_info_map_[9].url_row = act;
+  word_starts_map_[9].url_word_starts_.push_back(7);
+}
+
+bool URLIndexMappedCacheTest::WriteIndex() {
+  return URLIndexMappedCache::Write(path_, rebuild_time_, word_list_,
+                                    char_word_map_, word_id_history_map_,
+                                    history_info_map_, word_starts_map_);
+}
+
+TEST_F(URLIndexMappedCacheTest, RoundTrip) {
+  ASSERT_TRUE(WriteIndex());
+  scoped_ptr<URLIndexMappedCache> cache(URLIndexMappedCache::Open(path_));
+  ASSERT_TRUE(cache);
+  EXPECT_EQ(rebuild_time_.ToInternalValue(),
+            cache->last_time_rebuilt_from_history().ToInternalValue());
+  EXPECT_EQ(word_list_.size(), cache->word_slot_count());
+  EXPECT_EQ(2U, cache->row_count());
+
+  base::string16 word;
+  HistoryIDVector history_ids;
+  ASSERT_TRUE(cache->GetWord(4, &word, &history_ids));
+  EXPECT_EQ(ASCIIToUTF16("com"), word);
+  ASSERT_EQ(2U, history_ids.size());
+  EXPECT_EQ(3, history_ids[0]);
+  EXPECT_EQ(9, history_ids[1]);
+  ASSERT_TRUE(cache->GetWord(1, &word, &history_ids));
+  EXPECT_TRUE(word.empty());
+  EXPECT_TRUE(history_ids.empty());
+  EXPECT_FALSE(cache->GetWord(5, &word, &history_ids));
+
+  HistoryInfoMapValue value;
+  RowWordStarts word_starts;
+  ASSERT_TRUE(cache->GetRow(3, &value, &word_starts));
+  EXPECT_EQ(GURL("http://cat.com/dog"), value.url_row.url());
+  EXPECT_EQ(ASCIIToUTF16("Cat Dog"), value.url_row.title());
+  EXPECT_EQ(3, value.url_row.id());
+  EXPECT_EQ(5, value.url_row.visit_count());
+  EXPECT_EQ(2, value.url_row.typed_count());
+  ASSERT_EQ(1U, value.visits.size());
+  EXPECT_EQ(content::PAGE_TRANSITION_TYPED, value.visits[0].second);
+  EXPECT_EQ(word_starts_map_[3].url_word_starts_,
+            word_starts.url_word_starts_);
+  EXPECT_EQ(word_starts_map_[3].title_word_starts_,
+            word_starts.title_word_starts_);
+  EXPECT_FALSE(cache->GetRow(4, &value, &word_starts));
+
+  int typed_count = 0;
+  int visit_count = 0;
+  base::Time last_visit;
+  ASSERT_TRUE(cache->GetRowFactors(9, &typed_count, &visit_count,
+                                   &last_visit));
+  EXPECT_EQ(0, typed_count);
+  EXPECT_EQ(1, visit_count);
+  EXPECT_EQ(history_info_map_[9].url_row.last_visit(), last_visit);
+}
+
+TEST_F(URLIndexMappedCacheTest, HistoryIDsForTerm) {
+  ASSERT_TRUE(WriteIndex());
+  scoped_ptr<URLIndexMappedCache> cache(URLIndexMappedCache::Open(path_));
+  ASSERT_TRUE(cache);
+
+  // "ct" appears in "act" only; "ca" in "cat" only; "c" in "cat", "act" and
+  // "com".
+  HistoryIDVector history_ids = cache->HistoryIDsForTerm(ASCIIToUTF16("ct"));
+  ASSERT_EQ(1U, history_ids.size());
+  EXPECT_EQ(9, history_ids[0]);
+  history_ids = cache->HistoryIDsForTerm(ASCIIToUTF16("ca"));
+  ASSERT_EQ(1U, history_ids.size());
+  EXPECT_EQ(3, history_ids[0]);
+  history_ids = cache->HistoryIDsForTerm(ASCIIToUTF16("c"));
+  ASSERT_EQ(2U, history_ids.size());
+  EXPECT_EQ(3, history_ids[0]);
+  EXPECT_EQ(9, history_ids[1]);
+  EXPECT_TRUE(cache->HistoryIDsForTerm(ASCIIToUTF16("tac")).empty());
+  EXPECT_TRUE(cache->HistoryIDsForTerm(ASCIIToUTF16("z")).empty());
+  EXPECT_TRUE(cache->HistoryIDsForTerm(base::string16()).empty());
+}
+
+TEST_F(URLIndexMappedCacheTest, RejectsDamagedFiles) {
+  EXPECT_FALSE(URLIndexMappedCache::Open(path_));
+
+  ASSERT_TRUE(WriteIndex());
+  std::string contents;
+  ASSERT_TRUE(base::ReadFileToString(path_, &contents));
+
+  // Truncated.
+  std::string truncated(contents.substr(0, contents.size() / 2));
+  ASSERT_EQ(static_cast<int>(truncated.size()),
+            base::WriteFile(path_, truncated.data(), truncated.size()));
+  EXPECT_FALSE(URLIndexMappedCache::Open(path_));
+
+  // Bad magic.
+  std::string bad_magic(contents);
+  bad_magic[0] ^= 0xff;
+  ASSERT_EQ(static_cast<int>(bad_magic.size()),
+            base::WriteFile(path_, bad_magic.data(), bad_magic.size()));
+  EXPECT_FALSE(URLIndexMappedCache::Open(path_));
+}
+
+}  // namespace history
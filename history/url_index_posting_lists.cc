@@ -0,0 +1,301 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/url_index_posting_lists.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace history {
+
+namespace {
+
+// When one posting list is this many times longer than the other, galloping
+// through the longer list beats a linear merge.
+const size_t kGallopRatio = 32;
+
+// Returns the first position at or after |begin| in |list| whose value is not
+// less than |value|, probing at exponentially increasing distances before
+// falling back to a binary search over the bracketed range.
+template <typename T>
+size_t GallopTo(const std::vector<T>& list, size_t begin, T value) {
+  size_t step = 1;
+  size_t end = begin;
+  while (end < list.size() && list[end] < value) {
+    begin = end + 1;
+    end += step;
+    step *= 2;
+  }
+  end = std::min(end, list.size());
+  return std::lower_bound(list.begin() + begin, list.begin() + end, value) -
+      list.begin();
+}
+
+template <typename T>
+void IntersectSorted(const std::vector<T>& a,
+                     const std::vector<T>& b,
+                     std::vector<T>* out) {
+  DCHECK(out);
+  DCHECK_NE(out, &a);
+  DCHECK_NE(out, &b);
+  out->clear();
+  const std::vector<T>& shorter = a.size() <= b.size() ? a : b;
+  const std::vector<T>& longer = a.size() <= b.size() ? b : a;
+  if (shorter.empty())
+    return;
+
+  if (shorter.size() * kGallopRatio < longer.size()) {
+    size_t pos = 0;
+    for (typename std::vector<T>::const_iterator iter = shorter.begin();
+         iter != shorter.end() && pos < longer.size(); ++iter) {
+      pos = GallopTo(longer, pos, *iter);
+      if (pos < longer.size() && longer[pos] == *iter)
+        out->push_back(*iter);
+    }
+    return;
+  }
+
+  // Branch-free merge: every iteration stores a candidate and advances the
+  // cursors by the comparison results, which keeps the loop free of
+  // mispredicted branches and lets the compiler vectorize the compares.
+  out->resize(shorter.size());
+  T* result = &(*out)[0];
+  const T* a_data = &a[0];
+  const T* b_data = &b[0];
+  const size_t a_size = a.size();
+  const size_t b_size = b.size();
+  size_t i = 0;
+  size_t j = 0;
+  size_t k = 0;
+  while (i < a_size && j < b_size) {
+    const T a_value = a_data[i];
+    const T b_value = b_data[j];
+    result[k] = a_value;
+    k += (a_value == b_value);
+    i += (a_value <= b_value);
+    j += (b_value <= a_value);
+  }
+  out->resize(k);
+}
+
+// Inserts |value| into the ascending |list| unless it is already present.
+template <typename T>
+void InsertSorted(std::vector<T>* list, T value) {
+  if (list->empty() || list->back() < value) {
+    list->push_back(value);
+    return;
+  }
+  typename std::vector<T>::iterator pos =
+      std::lower_bound(list->begin(), list->end(), value);
+  if (pos == list->end() || *pos != value)
+    list->insert(pos, value);
+}
+
+// Removes |value| from the ascending |list| if present.
+template <typename T>
+void EraseSorted(std::vector<T>* list, T value) {
+  typename std::vector<T>::iterator pos =
+      std::lower_bound(list->begin(), list->end(), value);
+  if (pos != list->end() && *pos == value)
+    list->erase(pos);
+}
+
+}  // namespace
+
+void IntersectSortedWordIDs(const WordIDVector& a,
+                            const WordIDVector& b,
+                            WordIDVector* out) {
+  IntersectSorted(a, b, out);
+}
+
+void IntersectSortedHistoryIDs(const HistoryIDVector& a,
+                               const HistoryIDVector& b,
+                               HistoryIDVector* out) {
+  IntersectSorted(a, b, out);
+}
+
+URLIndexPostingLists::URLIndexPostingLists() : word_count_(0) {
+}
+
+URLIndexPostingLists::~URLIndexPostingLists() {
+}
+
+void URLIndexPostingLists::AddWord(WordID word_id,
+                                   const base::string16& word) {
+  Char16Set characters = Char16SetFromString16(word);
+  for (Char16Set::const_iterator iter = characters.begin();
+       iter != characters.end(); ++iter)
+    InsertSorted(&char_word_lists_[*iter], word_id);
+}
+
+void URLIndexPostingLists::RemoveWord(WordID word_id,
+                                      const base::string16& word) {
+  Char16Set characters = Char16SetFromString16(word);
+  for (Char16Set::const_iterator iter = characters.begin();
+       iter != characters.end(); ++iter) {
+    CharWordLists::iterator char_pos = char_word_lists_.find(*iter);
+    if (char_pos == char_word_lists_.end())
+      continue;
+    EraseSorted(&char_pos->second, word_id);
+    if (char_pos->second.empty())
+      char_word_lists_.erase(char_pos);  // No longer in use.
+  }
+}
+
+void URLIndexPostingLists::AddHistoryForWord(WordID word_id,
+                                             HistoryID history_id) {
+  if (word_id >= word_history_lists_.size())
+    word_history_lists_.resize(word_id + 1);
+  HistoryIDVector& history_ids = word_history_lists_[word_id];
+  if (history_ids.empty())
+    ++word_count_;
+  InsertSorted(&history_ids, history_id);
+}
+
+bool URLIndexPostingLists::RemoveHistoryForWord(WordID word_id,
+                                                HistoryID history_id) {
+  if (word_id >= word_history_lists_.size())
+    return true;
+  HistoryIDVector& history_ids = word_history_lists_[word_id];
+  if (history_ids.empty())
+    return true;
+  EraseSorted(&history_ids, history_id);
+  if (!history_ids.empty())
+    return false;
+  // Release the storage; the slot may not be reused for a while.
+  HistoryIDVector().swap(history_ids);
+  --word_count_;
+  return true;
+}
+
+WordIDVector URLIndexPostingLists::WordIDsForChars(
+    const Char16Set& term_chars) const {
+  // Gather the posting list for each character, bailing out as soon as one
+  // character is missing, then intersect them shortest first so that the
+  // working set shrinks as quickly as possible.
+  std::vector<const WordIDVector*> lists;
+  lists.reserve(term_chars.size());
+  for (Char16Set::const_iterator iter = term_chars.begin();
+       iter != term_chars.end(); ++iter) {
+    CharWordLists::const_iterator char_pos = char_word_lists_.find(*iter);
+    if (char_pos == char_word_lists_.end() || char_pos->second.empty())
+      return WordIDVector();
+    lists.push_back(&char_pos->second);
+  }
+  if (lists.empty())
+    return WordIDVector();
+  for (size_t i = 1; i < lists.size(); ++i) {
+    for (size_t j = i; j > 0 && lists[j]->size() < lists[j - 1]->size(); --j)
+      std::swap(lists[j], lists[j - 1]);
+  }
+
+  WordIDVector word_ids(*lists[0]);
+  WordIDVector scratch;
+  for (size_t i = 1; i < lists.size() && !word_ids.empty(); ++i) {
+    IntersectSortedWordIDs(word_ids, *lists[i], &scratch);
+    word_ids.swap(scratch);
+  }
+  return word_ids;
+}
+
+HistoryIDVector URLIndexPostingLists::HistoryIDsForWords(
+    const WordIDVector& word_ids) const {
+  HistoryIDVector history_ids;
+  size_t total = 0;
+  for (WordIDVector::const_iterator iter = word_ids.begin();
+       iter != word_ids.end(); ++iter) {
+    if (*iter < word_history_lists_.size())
+      total += word_history_lists_[*iter].size();
+  }
+  history_ids.reserve(total);
+  for (WordIDVector::const_iterator iter = word_ids.begin();
+       iter != word_ids.end(); ++iter) {
+    if (*iter >= word_history_lists_.size())
+      continue;
+    const HistoryIDVector& word_history = word_history_lists_[*iter];
+    history_ids.insert(history_ids.end(), word_history.begin(),
+                       word_history.end());
+  }
+  if (word_ids.size() > 1) {
+    std::sort(history_ids.begin(), history_ids.end());
+    history_ids.erase(std::unique(history_ids.begin(), history_ids.end()),
+                      history_ids.end());
+  }
+  return history_ids;
+}
+
+void URLIndexPostingLists::ExportCharWordMap(
+    CharWordIDMap* char_word_map) const {
+  DCHECK(char_word_map);
+  char_word_map->clear();
+  for (CharWordLists::const_iterator iter = char_word_lists_.begin();
+       iter != char_word_lists_.end(); ++iter) {
+    (*char_word_map)[iter->first] =
+        WordIDSet(iter->second.begin(), iter->second.end());
+  }
+}
+
+void URLIndexPostingLists::ExportWordIDHistoryMap(
+    WordIDHistoryMap* word_id_history_map) const {
+  DCHECK(word_id_history_map);
+  word_id_history_map->clear();
+  for (size_t word_id = 0; word_id < word_history_lists_.size(); ++word_id) {
+    const HistoryIDVector& history_ids = word_history_lists_[word_id];
+    if (!history_ids.empty()) {
+      (*word_id_history_map)[word_id] =
+          HistoryIDSet(history_ids.begin(), history_ids.end());
+    }
+  }
+}
+
+void URLIndexPostingLists::ImportFrom(
+    const CharWordIDMap& char_word_map,
+    const WordIDHistoryMap& word_id_history_map) {
+  Clear();
+  // Both source containers are ordered, so the vectors come out sorted.
+  for (CharWordIDMap::const_iterator iter = char_word_map.begin();
+       iter != char_word_map.end(); ++iter) {
+    if (!iter->second.empty()) {
+      char_word_lists_[iter->first].assign(iter->second.begin(),
+                                           iter->second.end());
+    }
+  }
+  if (!word_id_history_map.empty())
+    word_history_lists_.resize(word_id_history_map.rbegin()->first + 1);
+  for (WordIDHistoryMap::const_iterator iter = word_id_history_map.begin();
+       iter != word_id_history_map.end(); ++iter) {
+    if (iter->second.empty())
+      continue;
+    word_history_lists_[iter->first].assign(iter->second.begin(),
+                                            iter->second.end());
+    ++word_count_;
+  }
+}
+
+size_t URLIndexPostingLists::EstimateMemoryUsage() const {
+  // Approximates each std::map node as its payload plus three pointers and a
+  // color word.
+  const size_t kMapNodeOverhead = 4 * sizeof(void*);
+  size_t bytes = 0;
+  for (CharWordLists::const_iterator iter = char_word_lists_.begin();
+       iter != char_word_lists_.end(); ++iter) {
+    bytes += sizeof(CharWordLists::value_type) + kMapNodeOverhead;
+    bytes += iter->second.capacity() * sizeof(WordID);
+  }
+  bytes += word_history_lists_.capacity() * sizeof(HistoryIDVector);
+  for (std::vector<HistoryIDVector>::const_iterator iter =
+       word_history_lists_.begin();
+       iter != word_history_lists_.end(); ++iter)
+    bytes += iter->capacity() * sizeof(HistoryID);
+  return bytes;
+}
+
+void URLIndexPostingLists::Clear() {
+  char_word_lists_.clear();
+  word_history_lists_.clear();
+  word_count_ = 0;
+}
+
+}  // namespace history
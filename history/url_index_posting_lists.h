@@ -0,0 +1,97 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_HISTORY_URL_INDEX_POSTING_LISTS_H_
+#define CHROME_BROWSER_HISTORY_URL_INDEX_POSTING_LISTS_H_
+
+#include <map>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/strings/string16.h"
+#include "chrome/browser/history/in_memory_url_index_types.h"
+
+namespace history {
+
+typedef std::vector<WordID> WordIDVector;
+
+// Sets |out| to the intersection of the ascending, duplicate-free vectors |a|
+// and |b|. When one input is much shorter than the other the longer one is
+// galloped through; otherwise a branch-free merge is used so that the inner
+// loop does not depend on the (unpredictable) comparison outcome. |out| may
+// not alias either input.
+void IntersectSortedWordIDs(const WordIDVector& a,
+                            const WordIDVector& b,
+                            WordIDVector* out);
+void IntersectSortedHistoryIDs(const HistoryIDVector& a,
+                               const HistoryIDVector& b,
+                               HistoryIDVector* out);
+
+// A compact alternative to the CharWordIDMap and WordIDHistoryMap used by
+// URLIndexPrivateData. Each posting list is kept as a sorted vector rather
+// than a std::set, so the index costs one machine word per posting instead of
+// a tree node, and queries walk contiguous memory. Because HistoryIDs and
+// recycled WordIDs are mostly handed out in increasing order, nearly all
+// insertions are appends.
+class URLIndexPostingLists {
+ public:
+  URLIndexPostingLists();
+  ~URLIndexPostingLists();
+
+  // Records that the word |word| has been assigned |word_id|, adding
+  // |word_id| to the posting list of each of its characters.
+  void AddWord(WordID word_id, const base::string16& word);
+
+  // Reverses AddWord(). Characters left without any words are dropped.
+  void RemoveWord(WordID word_id, const base::string16& word);
+
+  // Adds |history_id| to the posting list for |word_id|.
+  void AddHistoryForWord(WordID word_id, HistoryID history_id);
+
+  // Removes |history_id| from the posting list for |word_id|. Returns true if
+  // the word is no longer referenced by any history item.
+  bool RemoveHistoryForWord(WordID word_id, HistoryID history_id);
+
+  // Returns the ascending IDs of the words containing every character in
+  // |term_chars|, or an empty vector if there are none.
+  WordIDVector WordIDsForChars(const Char16Set& term_chars) const;
+
+  // Returns the ascending, duplicate-free union of the history posting lists
+  // of every word in |word_ids|.
+  HistoryIDVector HistoryIDsForWords(const WordIDVector& word_ids) const;
+
+  // Conversion to and from the node-based representation, which is still the
+  // format persisted in the InMemoryURLIndex cache file.
+  void ExportCharWordMap(CharWordIDMap* char_word_map) const;
+  void ExportWordIDHistoryMap(WordIDHistoryMap* word_id_history_map) const;
+  void ImportFrom(const CharWordIDMap& char_word_map,
+                  const WordIDHistoryMap& word_id_history_map);
+
+  // Returns the number of distinct characters and of referenced words.
+  size_t char_count() const { return char_word_lists_.size(); }
+  size_t word_count() const { return word_count_; }
+
+  // Returns an estimate of the heap memory held by the posting lists.
+  size_t EstimateMemoryUsage() const;
+
+  void Clear();
+  bool empty() const { return word_count_ == 0; }
+
+ private:
+  typedef std::map<base::char16, WordIDVector> CharWordLists;
+
+  // One posting list per character, holding the IDs of words containing it.
+  CharWordLists char_word_lists_;
+
+  // Posting lists of HistoryIDs indexed by WordID. Slots belonging to unused
+  // WordIDs are empty.
+  std::vector<HistoryIDVector> word_history_lists_;
+
+  // The number of non-empty entries in |word_history_lists_|.
+  size_t word_count_;
+};
+
+}  // namespace history
+
+#endif  // CHROME_BROWSER_HISTORY_URL_INDEX_POSTING_LISTS_H_
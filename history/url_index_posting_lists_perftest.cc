@@ -0,0 +1,303 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/memory/ref_counted.h"
+#include "base/strings/string16.h"
+#include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
+#include "chrome/browser/history/url_index_private_data.h"
+#include "chrome/browser/test/base/synthetic_random.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+#include "url/gurl.h"
+
+namespace history {
+
+namespace {
+
+const size_t kHistorySize = 100000;
+const size_t kLargeHistorySize = 200000;
+const size_t kVocabularySize = 20000;
+const size_t kTitleWords = 6;
+
+// Omnibox inputs replayed one keystroke at a time.
+const char* kTypedInputs[] = {
+  "goo",
+  "news sport",
+  "wiki mountain bike",
+  "docs spreadsheet q3",
+  "m",
+};
+
+// Broad inputs which match a large share of the history.
+const char* kBroadInputs[] = {
+  "a",
+  "e",
+  "go",
+  "ne",
+  "m",
+};
+
+// Edits replayed against the intersection cache: typing forward, backspacing,
+// retyping, reordering terms and changing a character mid-string.
+const char* kEditedInputs[] = {
+  "wiki mountain bike",
+  "wiki mountain b",
+  "wiki moun",
+  "wiki mountain",
+  "wiki mountain bike",
+  "bike wiki mountain",
+  "mountain bike wiki",
+  "wiki mxuntain bike",
+  "wiki mountain bike",
+  "news sport",
+  "news spo",
+  "sport news",
+};
+
+// Skews towards small values, roughly like word frequencies.
+size_t NextSkewed(SyntheticRandom* random, size_t limit) {
+  return (static_cast<size_t>(random->Next()) * random->Next()) % limit;
+}
+
+std::string MakeWord(SyntheticRandom* random) {
+  const char kLetters[] = "abcdefghijklmnopqrstuvwxyz";
+  std::string word;
+  size_t length = 3 + random->Next() % 7;
+  for (size_t i = 0; i < length; ++i)
+    word.push_back(kLetters[random->Next() % 26]);
+  return word;
+}
+
+// Approximates the heap held by a map of sets: one tree node per entry plus
+// one per key.
+template <typename MapOfSets>
+size_t EstimateMapOfSetsMemory(const MapOfSets& map) {
+  const size_t kNodeOverhead = 4 * sizeof(void*);
+  size_t bytes = 0;
+  for (typename MapOfSets::const_iterator iter = map.begin();
+       iter != map.end(); ++iter) {
+    bytes += sizeof(typename MapOfSets::value_type) + kNodeOverhead;
+    bytes += iter->second.size() *
+        (sizeof(typename MapOfSets::mapped_type::value_type) + kNodeOverhead);
+  }
+  return bytes;
+}
+
+}  // namespace
+
+class URLIndexPostingListsPerfTest : public testing::Test {
+ protected:
+  // Builds a synthetic index of |history_size| rows in the given layout.
+  scoped_refptr<URLIndexPrivateData> BuildIndex(bool use_posting_lists,
+                                                size_t history_size);
+
+  void ReplayKeystrokes(URLIndexPrivateData* private_data,
+                        const std::string& trace);
+
+  // Replays kEditedInputs, each preceded by its forward typing, and reports
+  // the mean and 95th percentile query time.
+  void ReplayEdits(URLIndexPrivateData* private_data,
+                   const std::string& trace);
+};
+
+scoped_refptr<URLIndexPrivateData> URLIndexPostingListsPerfTest::BuildIndex(
+    bool use_posting_lists,
+    size_t history_size) {
+  SyntheticRandom random;
+  std::vector<std::string> vocabulary;
+  for (size_t i = 0; i < kVocabularySize; ++i)
+    vocabulary.push_back(MakeWord(&random));
+
+  scoped_refptr<URLIndexPrivateData> private_data(new URLIndexPrivateData);
+  private_data->use_posting_lists_ = use_posting_lists;
+  const base::Time now = base::Time::Now();
+  for (size_t i = 1; i <= history_size; ++i) {
+    std::string url = base::StringPrintf(
+        "http://www.%s.com/%s/%s",
+        vocabulary[NextSkewed(&random, kVocabularySize / 4)].c_str(),
+        vocabulary[NextSkewed(&random, kVocabularySize)].c_str(),
+        vocabulary[NextSkewed(&random, kVocabularySize)].c_str());
+    std::string title;
+    for (size_t j = 0; j < kTitleWords; ++j) {
+      title += vocabulary[NextSkewed(&random, kVocabularySize)];
+      title += ' ';
+    }
+    URLRow row(GURL(url), static_cast<URLID>(i));
+    row.set_title(base::UTF8ToUTF16(title));
+    row.set_visit_count(1 + random.Next() % 20);
+    row.set_typed_count(random.Next() % 3);
+    row.set_last_visit(now - base::TimeDelta::FromHours(random.Next()));
+    private_data->history_info_map_[i].url_row = row;
+    RowWordStarts word_starts;
+    private_data->AddRowWordsToIndex(row, &word_starts, "en");
+    private_data->word_starts_map_[i] = word_starts;
+  }
+  return private_data;
+}
+
+void URLIndexPostingListsPerfTest::ReplayKeystrokes(
+    URLIndexPrivateData* private_data,
+    const std::string& trace) {
+  base::TimeDelta total;
+  base::TimeDelta worst;
+  size_t keystrokes = 0;
+  for (size_t i = 0; i < arraysize(kTypedInputs); ++i) {
+    const std::string input(kTypedInputs[i]);
+    for (size_t length = 1; length <= input.length(); ++length) {
+      base::TimeTicks start = base::TimeTicks::HighResNow();
+      private_data->HistoryItemsForTerms(
+          base::UTF8ToUTF16(input.substr(0, length)), base::string16::npos,
+          3, "en", NULL);
+      base::TimeDelta elapsed = base::TimeTicks::HighResNow() - start;
+      total += elapsed;
+      worst = std::max(worst, elapsed);
+      ++keystrokes;
+    }
+  }
+  perf_test::PrintResult("hqp_keystroke_mean", "", trace,
+                         total.InMillisecondsF() / keystrokes, "ms", true);
+  perf_test::PrintResult("hqp_keystroke_max", "", trace,
+                         worst.InMillisecondsF(), "ms", true);
+}
+
+void URLIndexPostingListsPerfTest::ReplayEdits(
+    URLIndexPrivateData* private_data,
+    const std::string& trace) {
+  std::vector<std::string> inputs;
+  const std::string first(kEditedInputs[0]);
+  for (size_t length = 1; length < first.length(); ++length)
+    inputs.push_back(first.substr(0, length));
+  inputs.insert(inputs.end(), kEditedInputs,
+                kEditedInputs + arraysize(kEditedInputs));
+
+  std::vector<double> times_ms;
+  double total_ms = 0;
+  for (std::vector<std::string>::const_iterator iter = inputs.begin();
+       iter != inputs.end(); ++iter) {
+    base::TimeTicks start = base::TimeTicks::HighResNow();
+    private_data->HistoryItemsForTerms(base::UTF8ToUTF16(*iter),
+                                       base::string16::npos, 3, "en", NULL);
+    double elapsed_ms =
+        (base::TimeTicks::HighResNow() - start).InMillisecondsF();
+    times_ms.push_back(elapsed_ms);
+    total_ms += elapsed_ms;
+  }
+  std::sort(times_ms.begin(), times_ms.end());
+  perf_test::PrintResult("hqp_edit_mean", "", trace,
+                         total_ms / times_ms.size(), "ms", true);
+  perf_test::PrintResult("hqp_edit_p95", "", trace,
+                         times_ms[times_ms.size() * 95 / 100], "ms", true);
+}
+
+TEST_F(URLIndexPostingListsPerfTest, Keystrokes) {
+  scoped_refptr<URLIndexPrivateData> maps(BuildIndex(false, kHistorySize));
+  scoped_refptr<URLIndexPrivateData> posting_lists(
+      BuildIndex(true, kHistorySize));
+  ASSERT_EQ(maps->word_map_.size(), posting_lists->word_map_.size());
+  EXPECT_TRUE(posting_lists->char_word_map_.empty());
+  EXPECT_TRUE(posting_lists->word_id_history_map_.empty());
+
+  perf_test::PrintResult(
+      "hqp_index_memory", "", "maps",
+      EstimateMapOfSetsMemory(maps->char_word_map_) +
+          EstimateMapOfSetsMemory(maps->word_id_history_map_),
+      "bytes", true);
+  perf_test::PrintResult("hqp_index_memory", "", "posting_lists",
+                         posting_lists->posting_lists_.EstimateMemoryUsage(),
+                         "bytes", true);
+
+  ReplayKeystrokes(maps.get(), "maps");
+  ReplayKeystrokes(posting_lists.get(), "posting_lists");
+
+  // Both layouts must agree on the candidates.
+  for (size_t i = 0; i < arraysize(kTypedInputs); ++i) {
+    base::string16 input(base::UTF8ToUTF16(kTypedInputs[i]));
+    ScoredHistoryMatches expected = maps->HistoryItemsForTerms(
+        input, base::string16::npos, 3, "en", NULL);
+    ScoredHistoryMatches actual = posting_lists->HistoryItemsForTerms(
+        input, base::string16::npos, 3, "en", NULL);
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t j = 0; j < expected.size(); ++j)
+      EXPECT_EQ(expected[j].url_info.id(), actual[j].url_info.id());
+  }
+}
+
+TEST_F(URLIndexPostingListsPerfTest, EditingKeystrokes) {
+  scoped_refptr<URLIndexPrivateData> private_data(
+      BuildIndex(true, kHistorySize));
+  private_data->intersection_cache_.reset();
+  ReplayEdits(private_data.get(), "no_cache");
+
+  const size_t kCacheBytes = 1024 * 1024;
+  private_data->intersection_cache_.reset(
+      new URLIndexIntersectionCache(kCacheBytes));
+  ReplayEdits(private_data.get(), "intersection_cache");
+  URLIndexIntersectionCache::Stats stats;
+  ASSERT_TRUE(private_data->GetIntersectionCacheStats(&stats));
+  EXPECT_GT(stats.hits, 0U);
+  EXPECT_LE(stats.bytes, kCacheBytes);
+  perf_test::PrintResult("hqp_intersection_cache_hit_rate", "",
+                         "intersection_cache",
+                         100.0 * stats.hits / (stats.hits + stats.misses),
+                         "percent", false);
+  perf_test::PrintResult("hqp_intersection_cache_bytes", "",
+                         "intersection_cache", stats.bytes, "bytes", false);
+}
+
+TEST_F(URLIndexPostingListsPerfTest, ChunkedScoring) {
+  scoped_refptr<URLIndexPrivateData> private_data(
+      BuildIndex(true, kLargeHistorySize));
+  for (int chunked = 0; chunked < 2; ++chunked) {
+    private_data->chunked_scoring_ = chunked != 0;
+    const std::string trace = chunked ? "chunked" : "serial";
+    base::TimeDelta total;
+    size_t candidates = 0;
+    for (size_t j = 0; j < arraysize(kBroadInputs); ++j) {
+      base::TimeTicks start = base::TimeTicks::HighResNow();
+      private_data->HistoryItemsForTerms(base::UTF8ToUTF16(kBroadInputs[j]),
+                                         base::string16::npos, 3, "en", NULL);
+      total += base::TimeTicks::HighResNow() - start;
+      candidates += private_data->post_filter_item_count_ ?
+          private_data->post_filter_item_count_ :
+          private_data->pre_filter_item_count_;
+    }
+    perf_test::PrintResult("hqp_broad_query_mean", "", trace,
+                           total.InMillisecondsF() / arraysize(kBroadInputs),
+                           "ms", true);
+    perf_test::PrintResult("hqp_broad_query_scored", "", trace,
+                           candidates / arraysize(kBroadInputs), "items",
+                           false);
+  }
+
+  // Chunked top-k selection must keep the same best scores as scoring the
+  // whole pool and sorting it.
+  const base::string16 input(base::UTF8ToUTF16("ne"));
+  String16Vector terms(1, input);
+  HistoryIDVector history_ids =
+      private_data->HistoryIDsFromPostingLists(terms);
+  ASSERT_GT(history_ids.size(), 1000U);
+  const base::Time now = base::Time::Now();
+  ScoredHistoryMatches serial = std::for_each(
+      history_ids.begin(), history_ids.end(),
+      URLIndexPrivateData::AddHistoryMatch(*private_data, "en", NULL, input,
+                                           terms, now)).ScoredMatches();
+  std::sort(serial.begin(), serial.end(),
+            ScoredHistoryMatch::MatchScoreGreater);
+  ScoredHistoryMatches chunked = private_data->ScoreHistoryItemsInChunks(
+      history_ids, 10, "en", NULL, input, terms, now);
+  std::sort(chunked.begin(), chunked.end(),
+            ScoredHistoryMatch::MatchScoreGreater);
+  ASSERT_EQ(std::min<size_t>(10, serial.size()), chunked.size());
+  for (size_t i = 0; i < chunked.size(); ++i)
+    EXPECT_EQ(serial[i].raw_score(), chunked[i].raw_score());
+}
+
+}  // namespace history
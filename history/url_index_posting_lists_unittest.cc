@@ -0,0 +1,131 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/history/url_index_posting_lists.h"
+
+#include "base/basictypes.h"
+#include "base/strings/utf_string_conversions.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using base::ASCIIToUTF16;
+
+namespace history {
+
+namespace {
+
+WordIDVector MakeWordIDs(const size_t* ids, size_t count) {
+  return WordIDVector(ids, ids + count);
+}
+
+}  // namespace
+
+TEST(URLIndexPostingListsTest, IntersectMerge) {
+  const size_t kA[] = {1, 3, 5, 7, 9, 11};
+  const size_t kB[] = {2, 3, 4, 7, 8, 11, 12};
+  const size_t kExpected[] = {3, 7, 11};
+  WordIDVector result;
+  IntersectSortedWordIDs(MakeWordIDs(kA, arraysize(kA)),
+                         MakeWordIDs(kB, arraysize(kB)), &result);
+  EXPECT_EQ(MakeWordIDs(kExpected, arraysize(kExpected)), result);
+
+  IntersectSortedWordIDs(MakeWordIDs(kA, arraysize(kA)), WordIDVector(),
+                         &result);
+  EXPECT_TRUE(result.empty());
+}
+
+TEST(URLIndexPostingListsTest, IntersectGallop) {
+  // A short list against a much longer one takes the galloping path.
+  HistoryIDVector longer;
+  for (HistoryID i = 0; i < 1000; ++i)
+    longer.push_back(i * 2);
+  HistoryIDVector shorter;
+  shorter.push_back(0);
+  shorter.push_back(5);
+  shorter.push_back(998);
+  shorter.push_back(1998);
+  shorter.push_back(5000);
+  HistoryIDVector result;
+  IntersectSortedHistoryIDs(shorter, longer, &result);
+  ASSERT_EQ(3U, result.size());
+  EXPECT_EQ(0, result[0]);
+  EXPECT_EQ(998, result[1]);
+  EXPECT_EQ(1998, result[2]);
+
+  // The argument order does not matter.
+  IntersectSortedHistoryIDs(longer, shorter, &result);
+  EXPECT_EQ(3U, result.size());
+}
+
+TEST(URLIndexPostingListsTest, AddAndRemove) {
+  URLIndexPostingLists lists;
+  EXPECT_TRUE(lists.empty());
+
+  lists.AddWord(0, ASCIIToUTF16("cat"));
+  lists.AddHistoryForWord(0, 10);
+  lists.AddHistoryForWord(0, 4);
+  lists.AddWord(1, ASCIIToUTF16("act"));
+  lists.AddHistoryForWord(1, 7);
+  lists.AddWord(2, ASCIIToUTF16("dog"));
+  lists.AddHistoryForWord(2, 4);
+  EXPECT_EQ(3U, lists.word_count());
+  EXPECT_EQ(6U, lists.char_count());
+
+  Char16Set chars;
+  chars.insert('a');
+  chars.insert('t');
+  WordIDVector word_ids = lists.WordIDsForChars(chars);
+  ASSERT_EQ(2U, word_ids.size());
+  EXPECT_EQ(0U, word_ids[0]);
+  EXPECT_EQ(1U, word_ids[1]);
+
+  HistoryIDVector history_ids = lists.HistoryIDsForWords(word_ids);
+  ASSERT_EQ(3U, history_ids.size());
+  EXPECT_EQ(4, history_ids[0]);
+  EXPECT_EQ(7, history_ids[1]);
+  EXPECT_EQ(10, history_ids[2]);
+
+  chars.insert('z');
+  EXPECT_TRUE(lists.WordIDsForChars(chars).empty());
+
+  EXPECT_FALSE(lists.RemoveHistoryForWord(0, 10));
+  EXPECT_TRUE(lists.RemoveHistoryForWord(0, 4));
+  lists.RemoveWord(0, ASCIIToUTF16("cat"));
+  EXPECT_EQ(2U, lists.word_count());
+  // 'c' is still used by "act".
+  EXPECT_EQ(6U, lists.char_count());
+  EXPECT_TRUE(lists.RemoveHistoryForWord(1, 7));
+  lists.RemoveWord(1, ASCIIToUTF16("act"));
+  EXPECT_EQ(3U, lists.char_count());
+}
+
+TEST(URLIndexPostingListsTest, ExportImport) {
+  URLIndexPostingLists lists;
+  lists.AddWord(0, ASCIIToUTF16("ab"));
+  lists.AddHistoryForWord(0, 1);
+  lists.AddHistoryForWord(0, 2);
+  lists.AddWord(3, ASCIIToUTF16("bc"));
+  lists.AddHistoryForWord(3, 2);
+
+  CharWordIDMap char_word_map;
+  WordIDHistoryMap word_id_history_map;
+  lists.ExportCharWordMap(&char_word_map);
+  lists.ExportWordIDHistoryMap(&word_id_history_map);
+  EXPECT_EQ(3U, char_word_map.size());
+  EXPECT_EQ(2U, char_word_map['b'].size());
+  ASSERT_EQ(2U, word_id_history_map.size());
+  EXPECT_EQ(2U, word_id_history_map[0].size());
+  EXPECT_EQ(1U, word_id_history_map[3].size());
+
+  URLIndexPostingLists restored;
+  restored.ImportFrom(char_word_map, word_id_history_map);
+  EXPECT_EQ(lists.word_count(), restored.word_count());
+  EXPECT_EQ(lists.char_count(), restored.char_count());
+  Char16Set chars;
+  chars.insert('b');
+  WordIDVector word_ids = restored.WordIDsForChars(chars);
+  EXPECT_EQ(2U, word_ids.size());
+  EXPECT_EQ(2U, restored.HistoryIDsForWords(word_ids).size());
+}
+
+}  // namespace history
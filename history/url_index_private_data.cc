@@ -23,6 +23,7 @@
 #include "chrome/browser/history/history_db_task.h"
 #include "chrome/browser/history/history_service.h"
 #include "chrome/browser/history/in_memory_url_index.h"
+#include "chrome/browser/omnibox/omnibox_field_trial.h"
 #include "components/bookmarks/browser/bookmark_utils.h"
 #include "components/history/core/browser/history_client.h"
 #include "net/base/net_util.h"
@@ -73,6 +74,19 @@ bool LengthGreater(const base::string16& string_a,
   return string_a.length() > string_b.length();
 }
 
+// Returns true if an index last rebuilt from the history database at
+// |last_time_rebuilt| should be rebuilt rather than restored from a cache.
+bool CacheRebuildIsDue(base::Time last_time_rebuilt) {
+  const base::TimeDelta rebuilt_ago = base::Time::Now() - last_time_rebuilt;
+  // Rebuild if the cache is more than a week old or, somehow, from some time
+  // in the future. It's probably a good time to rebuild the index from
+  // history to allow synced entries to now appear, expired entries to
+  // disappear, etc. Allow one day in the future to make the cache not rebuild
+  // on simple system clock changes such as time zone changes.
+  return (rebuilt_ago > base::TimeDelta::FromDays(7)) ||
+      (rebuilt_ago < base::TimeDelta::FromDays(-1));
+}
+
 
 // UpdateRecentVisitsFromHistoryDBTask -----------------------------------------
 
@@ -139,11 +153,18 @@ UpdateRecentVisitsFromHistoryDBTask::~UpdateRecentVisitsFromHistoryDBTask() {
 // URLIndexPrivateData ---------------------------------------------------------
 
 URLIndexPrivateData::URLIndexPrivateData()
-    : restored_cache_version_(0),
+    : index_generation_(0),
+      chunked_scoring_(OmniboxFieldTrial::HQPChunkedScoringValue()),
+      use_posting_lists_(OmniboxFieldTrial::HQPUsePostingListsValue()),
+      restored_cache_version_(0),
       saved_cache_version_(kCurrentCacheFileVersion),
       pre_filter_item_count_(0),
       post_filter_item_count_(0),
       post_scoring_item_count_(0) {
+  const size_t cache_bytes =
+      OmniboxFieldTrial::HQPIntersectionCacheBytesValue();
+  if (cache_bytes)
+    intersection_cache_.reset(new URLIndexIntersectionCache(cache_bytes));
 }
 
 ScoredHistoryMatches URLIndexPrivateData::HistoryItemsForTerms(
@@ -180,43 +201,61 @@ ScoredHistoryMatches URLIndexPrivateData::HistoryItemsForTerms(
 
   // Do nothing if we have indexed no words (probably because we've not been
   // initialized yet) or the search string has no words.
-  if (word_list_.empty() || lower_words.empty()) {
+  if ((word_list_.empty() && !mapped_cache_) || lower_words.empty()) {
     search_term_cache_.clear();  // Invalidate the term cache.
     return scored_items;
   }
 
-  // Reset used_ flags for search_term_cache_. We use a basic mark-and-sweep
-  // approach.
-  ResetSearchTermCache();
-
-  HistoryIDSet history_id_set = HistoryIDSetFromWords(lower_words);
+  // Gather the candidates in ascending HistoryID order, reusing those found
+  // for the same words, in any order, if they are still current.
+  HistoryIDVector history_ids;
+  base::string16 intersection_key;
+  if (intersection_cache_)
+    intersection_key = URLIndexIntersectionCache::KeyForWords(lower_words);
+  if (!intersection_cache_ ||
+      !intersection_cache_->Lookup(intersection_key, index_generation_,
+                                   &history_ids)) {
+    if (use_posting_lists_ || mapped_cache_) {
+      history_ids = HistoryIDsFromPostingLists(lower_words);
+    } else {
+      // Reset used_ flags for search_term_cache_. We use a basic
+      // mark-and-sweep approach.
+      ResetSearchTermCache();
+      HistoryIDSet history_id_set = HistoryIDSetFromWords(lower_words);
+      history_ids.assign(history_id_set.begin(), history_id_set.end());
+    }
+    if (intersection_cache_) {
+      intersection_cache_->Insert(intersection_key, index_generation_,
+                                  history_ids);
+    }
+  }
 
   // Trim the candidate pool if it is large. Note that we do not filter out
   // items that do not contain the search terms as proper substrings -- doing
   // so is the performance-costly operation we are trying to avoid in order
   // to maintain omnibox responsiveness.
+  // Scoring in chunks bounds the memory held for the matches, not the time
+  // spent scoring, which still happens on this thread, so the limit is the
+  // same either way.
   const size_t kItemsToScoreLimit = 500;
-  pre_filter_item_count_ = history_id_set.size();
+  pre_filter_item_count_ = history_ids.size();
   // If we trim the results set we do not want to cache the results for next
   // time as the user's ultimately desired result could easily be eliminated
   // in this early rough filter.
   bool was_trimmed = (pre_filter_item_count_ > kItemsToScoreLimit);
   if (was_trimmed) {
-    HistoryIDVector history_ids;
-    std::copy(history_id_set.begin(), history_id_set.end(),
-              std::back_inserter(history_ids));
     // Trim down the set by sorting by typed-count, visit-count, and last
     // visit.
     HistoryItemFactorGreater
-        item_factor_functor(history_info_map_);
+        item_factor_functor(history_info_map_, mapped_cache_.get());
     std::partial_sort(history_ids.begin(),
                       history_ids.begin() + kItemsToScoreLimit,
                       history_ids.end(),
                       item_factor_functor);
-    history_id_set.clear();
-    std::copy(history_ids.begin(), history_ids.begin() + kItemsToScoreLimit,
-              std::inserter(history_id_set, history_id_set.end()));
-    post_filter_item_count_ = history_id_set.size();
+    history_ids.resize(kItemsToScoreLimit);
+    // Score the survivors in HistoryID order, as for an untrimmed pool.
+    std::sort(history_ids.begin(), history_ids.end());
+    post_filter_item_count_ = history_ids.size();
   }
 
   // Pass over all of the candidates filtering out any without a proper
@@ -242,9 +281,15 @@ ScoredHistoryMatches URLIndexPrivateData::HistoryItemsForTerms(
     // but this is such a rare edge case that it's not worth the time.
     return scored_items;
   }
-  scored_items = std::for_each(history_id_set.begin(), history_id_set.end(),
-      AddHistoryMatch(*this, languages, history_client, lower_raw_string,
-                      lower_raw_terms, base::Time::Now())).ScoredMatches();
+  if (chunked_scoring_) {
+    scored_items = ScoreHistoryItemsInChunks(
+        history_ids, max_matches, languages, history_client, lower_raw_string,
+        lower_raw_terms, base::Time::Now());
+  } else {
+    scored_items = std::for_each(history_ids.begin(), history_ids.end(),
+        AddHistoryMatch(*this, languages, history_client, lower_raw_string,
+                        lower_raw_terms, base::Time::Now())).ScoredMatches();
+  }
 
   // Select and sort only the top |max_matches| results.
   if (scored_items.size() > max_matches) {
@@ -285,6 +330,7 @@ bool URLIndexPrivateData::UpdateURL(
   // indexed and it qualifies then it gets indexed. If it is already
   // indexed and still qualifies then it gets updated, otherwise it
   // is deleted from the index.
+  DCHECK(!mapped_cache_);
   bool row_was_updated = false;
   URLID row_id = row.id();
   HistoryInfoMap::iterator row_pos = history_info_map_.find(row_id);
@@ -328,8 +374,10 @@ bool URLIndexPrivateData::UpdateURL(
     RemoveRowFromIndex(row);
     row_was_updated = true;
   }
-  if (row_was_updated)
+  if (row_was_updated) {
     search_term_cache_.clear();  // This invalidates the cache.
+    ++index_generation_;
+  }
   return row_was_updated;
 }
 
@@ -377,6 +425,7 @@ class HistoryInfoMapItemHasURL {
 };
 
 bool URLIndexPrivateData::DeleteURL(const GURL& url) {
+  DCHECK(!mapped_cache_);
   // Find the matching entry in the history_info_map_.
   HistoryInfoMap::iterator pos = std::find_if(
       history_info_map_.begin(),
@@ -386,6 +435,7 @@ bool URLIndexPrivateData::DeleteURL(const GURL& url) {
     return false;
   RemoveRowFromIndex(pos->second.url_row);
   search_term_cache_.clear();  // This invalidates the cache.
+  ++index_generation_;
   return true;
 }
 
@@ -421,7 +471,7 @@ scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::RestoreFromFile(
   UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLWords",
                              restored_data->word_map_.size());
   UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLChars",
-                             restored_data->char_word_map_.size());
+                             restored_data->IndexedCharCount());
   if (restored_data->Empty())
     return NULL;  // 'No data' is the same as a failed reload.
   return restored_data;
@@ -455,7 +505,7 @@ scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::RebuildFromHistory(
   UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLWords",
                              rebuilt_data->word_map_.size());
   UMA_HISTOGRAM_COUNTS_10000("History.InMemoryURLChars",
-                             rebuilt_data->char_word_map_.size());
+                             rebuilt_data->IndexedCharCount());
   return rebuilt_data;
 }
 
@@ -468,18 +518,114 @@ bool URLIndexPrivateData::WritePrivateDataToCacheFileTask(
   return private_data->SaveToFile(file_path);
 }
 
+// static
+scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::RestoreFromMappedFile(
+    const base::FilePath& file_path) {
+  base::TimeTicks beginning_time = base::TimeTicks::Now();
+  scoped_ptr<URLIndexMappedCache> mapped_cache(
+      URLIndexMappedCache::Open(file_path));
+  if (!mapped_cache)
+    return NULL;
+  if (CacheRebuildIsDue(mapped_cache->last_time_rebuilt_from_history()))
+    return NULL;
+
+  scoped_refptr<URLIndexPrivateData> restored_data(new URLIndexPrivateData);
+  restored_data->last_time_rebuilt_from_history_ =
+      mapped_cache->last_time_rebuilt_from_history();
+  restored_data->mapped_cache_ = mapped_cache.Pass();
+  UMA_HISTOGRAM_TIMES("History.InMemoryURLIndexRestoreMappedCacheTime",
+                      base::TimeTicks::Now() - beginning_time);
+  if (restored_data->Empty())
+    return NULL;  // 'No data' is the same as a failed reload.
+  return restored_data;
+}
+
+// static
+scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::AdoptMappedCache(
+    scoped_refptr<URLIndexPrivateData> mapped_data) {
+  DCHECK(mapped_data.get());
+  DCHECK(mapped_data->mapped_cache_);
+  base::TimeTicks beginning_time = base::TimeTicks::Now();
+  const URLIndexMappedCache& mapped_cache = *mapped_data->mapped_cache_;
+  scoped_refptr<URLIndexPrivateData> adopted_data(new URLIndexPrivateData);
+  adopted_data->use_posting_lists_ = mapped_data->use_posting_lists_;
+  adopted_data->last_time_rebuilt_from_history_ =
+      mapped_data->last_time_rebuilt_from_history_;
+
+  // Words, and through them the char/word and word/history mappings.
+  base::string16 word;
+  HistoryIDVector history_ids;
+  for (WordID word_id = 0; word_id < mapped_cache.word_slot_count();
+       ++word_id) {
+    if (!mapped_cache.GetWord(word_id, &word, &history_ids))
+      return NULL;
+    if (word.empty() || history_ids.empty()) {
+      adopted_data->word_list_.push_back(base::string16());
+      adopted_data->available_words_.insert(word_id);
+      continue;
+    }
+    adopted_data->word_list_.push_back(word);
+    adopted_data->word_map_[word] = word_id;
+    for (HistoryIDVector::const_iterator iter = history_ids.begin();
+         iter != history_ids.end(); ++iter)
+      adopted_data->AddToHistoryIDWordMap(*iter, word_id);
+    if (adopted_data->use_posting_lists_) {
+      adopted_data->posting_lists_.AddWord(word_id, word);
+      for (HistoryIDVector::const_iterator iter = history_ids.begin();
+           iter != history_ids.end(); ++iter)
+        adopted_data->posting_lists_.AddHistoryForWord(word_id, *iter);
+    } else {
+      adopted_data->word_id_history_map_[word_id] =
+          HistoryIDSet(history_ids.begin(), history_ids.end());
+      Char16Set characters = Char16SetFromString16(word);
+      for (Char16Set::const_iterator iter = characters.begin();
+           iter != characters.end(); ++iter)
+        adopted_data->char_word_map_[*iter].insert(word_id);
+    }
+  }
+
+  // History items and their word starts.
+  for (size_t i = 0; i < mapped_cache.row_count(); ++i) {
+    HistoryID history_id;
+    HistoryInfoMapValue value;
+    RowWordStarts word_starts;
+    if (!mapped_cache.GetRowAt(i, &history_id, &value, &word_starts))
+      return NULL;
+    adopted_data->history_info_map_[history_id] = value;
+    adopted_data->word_starts_map_[history_id] = word_starts;
+  }
+
+  UMA_HISTOGRAM_TIMES("History.InMemoryURLIndexAdoptMappedCacheTime",
+                      base::TimeTicks::Now() - beginning_time);
+  if (adopted_data->Empty())
+    return NULL;
+  return adopted_data;
+}
+
+// static
+bool URLIndexPrivateData::WritePrivateDataToMappedCacheFileTask(
+    scoped_refptr<URLIndexPrivateData> private_data,
+    const base::FilePath& file_path) {
+  DCHECK(private_data.get());
+  DCHECK(!file_path.empty());
+  return private_data->SaveToMappedFile(file_path);
+}
+
 void URLIndexPrivateData::CancelPendingUpdates() {
   recent_visits_consumer_.CancelAllRequests();
 }
 
 scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::Duplicate() const {
+  DCHECK(!mapped_cache_);
   scoped_refptr<URLIndexPrivateData> data_copy = new URLIndexPrivateData;
+  data_copy->use_posting_lists_ = use_posting_lists_;
   data_copy->last_time_rebuilt_from_history_ = last_time_rebuilt_from_history_;
   data_copy->word_list_ = word_list_;
   data_copy->available_words_ = available_words_;
   data_copy->word_map_ = word_map_;
   data_copy->char_word_map_ = char_word_map_;
   data_copy->word_id_history_map_ = word_id_history_map_;
+  data_copy->posting_lists_ = posting_lists_;
   data_copy->history_id_word_map_ = history_id_word_map_;
   data_copy->history_info_map_ = history_info_map_;
   data_copy->word_starts_map_ = word_starts_map_;
@@ -492,16 +638,30 @@ scoped_refptr<URLIndexPrivateData> URLIndexPrivateData::Duplicate() const {
 }
 
 bool URLIndexPrivateData::Empty() const {
-  return history_info_map_.empty();
+  return history_info_map_.empty() &&
+      (!mapped_cache_ || mapped_cache_->row_count() == 0);
+}
+
+bool URLIndexPrivateData::GetIntersectionCacheStats(
+    URLIndexIntersectionCache::Stats* stats) const {
+  if (!intersection_cache_)
+    return false;
+  *stats = intersection_cache_->stats();
+  return true;
 }
 
 void URLIndexPrivateData::Clear() {
+  mapped_cache_.reset();
+  if (intersection_cache_)
+    intersection_cache_->Clear();
+  ++index_generation_;
   last_time_rebuilt_from_history_ = base::Time();
   word_list_.clear();
   available_words_.clear();
   word_map_.clear();
   char_word_map_.clear();
   word_id_history_map_.clear();
+  posting_lists_.Clear();
   history_id_word_map_.clear();
   history_info_map_.clear();
   word_starts_map_.clear();
@@ -648,6 +808,66 @@ HistoryIDSet URLIndexPrivateData::HistoryIDsForTerm(
   return history_id_set;
 }
 
+HistoryIDVector URLIndexPrivateData::HistoryIDsFromPostingLists(
+    const String16Vector& unsorted_words) {
+  // As in HistoryIDSetFromWords(), intersect the candidates for each word,
+  // longest word first. The posting lists are cheap enough to intersect that
+  // the search term cache is not consulted.
+  String16Vector words(unsorted_words);
+  std::sort(words.begin(), words.end(), LengthGreater);
+  // Single words are cached too so that editing one term of a multi-term
+  // input only recomputes that term. The key of a one-word input is the word
+  // itself, which the caller has just looked up, so it is not looked up again.
+  const bool cache_terms = intersection_cache_ && words.size() > 1;
+  HistoryIDVector history_ids;
+  HistoryIDVector scratch;
+  for (String16Vector::const_iterator iter = words.begin();
+       iter != words.end(); ++iter) {
+    HistoryIDVector term_history_ids;
+    if (!cache_terms ||
+        !intersection_cache_->Lookup(*iter, index_generation_,
+                                     &term_history_ids)) {
+      term_history_ids = HistoryIDsForTermFromPostingLists(*iter);
+      if (cache_terms) {
+        intersection_cache_->Insert(*iter, index_generation_,
+                                    term_history_ids);
+      }
+    }
+    if (term_history_ids.empty())
+      return HistoryIDVector();
+    if (iter == words.begin()) {
+      history_ids.swap(term_history_ids);
+    } else {
+      IntersectSortedHistoryIDs(history_ids, term_history_ids, &scratch);
+      history_ids.swap(scratch);
+      if (history_ids.empty())
+        break;
+    }
+  }
+  return history_ids;
+}
+
+HistoryIDVector URLIndexPrivateData::HistoryIDsForTermFromPostingLists(
+    const base::string16& term) const {
+  if (mapped_cache_)
+    return mapped_cache_->HistoryIDsForTerm(term);
+  if (term.empty())
+    return HistoryIDVector();
+  WordIDVector word_ids =
+      posting_lists_.WordIDsForChars(Char16SetFromString16(term));
+  if (term.length() > 1) {
+    // Keep only the words which contain the term as a proper substring.
+    WordIDVector::iterator kept = word_ids.begin();
+    for (WordIDVector::const_iterator iter = word_ids.begin();
+         iter != word_ids.end(); ++iter) {
+      if (word_list_[*iter].find(term) != base::string16::npos)
+        *kept++ = *iter;
+    }
+    word_ids.erase(kept, word_ids.end());
+  }
+  return posting_lists_.HistoryIDsForWords(word_ids);
+}
+
 WordIDSet URLIndexPrivateData::WordIDSetForTermChars(
     const Char16Set& term_chars) {
   WordIDSet word_id_set;
@@ -757,6 +977,7 @@ void URLIndexPrivateData::AddRowWordsToIndex(const URLRow& row,
     AddWordToIndex(*word_iter, history_id);
 
   search_term_cache_.clear();  // Invalidate the term cache.
+  ++index_generation_;
 }
 
 void URLIndexPrivateData::AddWordToIndex(const base::string16& term,
@@ -779,11 +1000,17 @@ void URLIndexPrivateData::AddWordHistory(const base::string16& term,
     available_words_.erase(word_id);
   }
   word_map_[term] = word_id;
+  AddToHistoryIDWordMap(history_id, word_id);
+
+  if (use_posting_lists_) {
+    posting_lists_.AddHistoryForWord(word_id, history_id);
+    posting_lists_.AddWord(word_id, term);
+    return;
+  }
 
   HistoryIDSet history_id_set;
   history_id_set.insert(history_id);
   word_id_history_map_[word_id] = history_id_set;
-  AddToHistoryIDWordMap(history_id, word_id);
 
   // For each character in the newly added word (i.e. a word that is not
   // already in the word index), add the word to the character index.
@@ -807,6 +1034,11 @@ void URLIndexPrivateData::AddWordHistory(const base::string16& term,
 
 void URLIndexPrivateData::UpdateWordHistory(WordID word_id,
                                             HistoryID history_id) {
+  if (use_posting_lists_) {
+    posting_lists_.AddHistoryForWord(word_id, history_id);
+    AddToHistoryIDWordMap(history_id, word_id);
+    return;
+  }
   WordIDHistoryMap::iterator history_pos = word_id_history_map_.find(word_id);
   DCHECK(history_pos != word_id_history_map_.end());
   HistoryIDSet& history_id_set(history_pos->second);
@@ -845,24 +1077,30 @@ void URLIndexPrivateData::RemoveRowWordsFromIndex(const URLRow& row) {
   for (WordIDSet::iterator word_id_iter = word_id_set.begin();
        word_id_iter != word_id_set.end(); ++word_id_iter) {
     WordID word_id = *word_id_iter;
-    word_id_history_map_[word_id].erase(history_id);
-    if (!word_id_history_map_[word_id].empty())
-      continue;  // The word is still in use.
-
-    // The word is no longer in use. Reconcile any changes to character usage.
-    base::string16 word = word_list_[word_id];
-    Char16Set characters = Char16SetFromString16(word);
-    for (Char16Set::iterator uni_char_iter = characters.begin();
-         uni_char_iter != characters.end(); ++uni_char_iter) {
-      base::char16 uni_char = *uni_char_iter;
-      char_word_map_[uni_char].erase(word_id);
-      if (char_word_map_[uni_char].empty())
-        char_word_map_.erase(uni_char);  // No longer in use.
+    if (use_posting_lists_) {
+      if (!posting_lists_.RemoveHistoryForWord(word_id, history_id))
+        continue;  // The word is still in use.
+      posting_lists_.RemoveWord(word_id, word_list_[word_id]);
+    } else {
+      word_id_history_map_[word_id].erase(history_id);
+      if (!word_id_history_map_[word_id].empty())
+        continue;  // The word is still in use.
+
+      // The word is no longer in use. Reconcile any changes to character
+      // usage.
+      Char16Set characters = Char16SetFromString16(word_list_[word_id]);
+      for (Char16Set::iterator uni_char_iter = characters.begin();
+           uni_char_iter != characters.end(); ++uni_char_iter) {
+        base::char16 uni_char = *uni_char_iter;
+        char_word_map_[uni_char].erase(word_id);
+        if (char_word_map_[uni_char].empty())
+          char_word_map_.erase(uni_char);  // No longer in use.
+      }
+      word_id_history_map_.erase(word_id);
     }
 
     // Complete the removal of references to the word.
-    word_id_history_map_.erase(word_id);
-    word_map_.erase(word);
+    word_map_.erase(word_list_[word_id]);
     word_list_[word_id] = base::string16();
     available_words_.insert(word_id);
   }
@@ -894,6 +1132,31 @@ bool URLIndexPrivateData::SaveToFile(const base::FilePath& file_path) {
   return true;
 }
 
+bool URLIndexPrivateData::SaveToMappedFile(const base::FilePath& file_path) {
+  DCHECK(!mapped_cache_);
+  base::TimeTicks beginning_time = base::TimeTicks::Now();
+  CharWordIDMap exported_char_word_map;
+  WordIDHistoryMap exported_word_id_history_map;
+  const CharWordIDMap* char_word_map = &char_word_map_;
+  const WordIDHistoryMap* word_id_history_map = &word_id_history_map_;
+  if (use_posting_lists_) {
+    posting_lists_.ExportCharWordMap(&exported_char_word_map);
+    posting_lists_.ExportWordIDHistoryMap(&exported_word_id_history_map);
+    char_word_map = &exported_char_word_map;
+    word_id_history_map = &exported_word_id_history_map;
+  }
+  if (!URLIndexMappedCache::Write(file_path, last_time_rebuilt_from_history_,
+                                  word_list_, *char_word_map,
+                                  *word_id_history_map, history_info_map_,
+                                  word_starts_map_)) {
+    LOG(WARNING) << "Failed to write " << file_path.value();
+    return false;
+  }
+  UMA_HISTOGRAM_TIMES("History.InMemoryURLIndexSaveMappedCacheTime",
+                      base::TimeTicks::Now() - beginning_time);
+  return true;
+}
+
 void URLIndexPrivateData::SavePrivateData(
     InMemoryURLIndexCacheItem* cache) const {
   DCHECK(cache);
@@ -936,12 +1199,19 @@ void URLIndexPrivateData::SaveWordMap(InMemoryURLIndexCacheItem* cache) const {
 
 void URLIndexPrivateData::SaveCharWordMap(
     InMemoryURLIndexCacheItem* cache) const {
-  if (char_word_map_.empty())
+  // The cache file format is shared by both index layouts.
+  CharWordIDMap exported_char_word_map;
+  const CharWordIDMap* char_word_map = &char_word_map_;
+  if (use_posting_lists_) {
+    posting_lists_.ExportCharWordMap(&exported_char_word_map);
+    char_word_map = &exported_char_word_map;
+  }
+  if (char_word_map->empty())
     return;
   CharWordMapItem* map_item = cache->mutable_char_word_map();
-  map_item->set_item_count(char_word_map_.size());
-  for (CharWordIDMap::const_iterator iter = char_word_map_.begin();
-       iter != char_word_map_.end(); ++iter) {
+  map_item->set_item_count(char_word_map->size());
+  for (CharWordIDMap::const_iterator iter = char_word_map->begin();
+       iter != char_word_map->end(); ++iter) {
     CharWordMapEntry* map_entry = map_item->add_char_word_map_entry();
     map_entry->set_char_16(iter->first);
     const WordIDSet& word_id_set(iter->second);
@@ -954,12 +1224,18 @@ void URLIndexPrivateData::SaveCharWordMap(
 
 void URLIndexPrivateData::SaveWordIDHistoryMap(
     InMemoryURLIndexCacheItem* cache) const {
-  if (word_id_history_map_.empty())
+  WordIDHistoryMap exported_word_id_history_map;
+  const WordIDHistoryMap* word_id_history_map = &word_id_history_map_;
+  if (use_posting_lists_) {
+    posting_lists_.ExportWordIDHistoryMap(&exported_word_id_history_map);
+    word_id_history_map = &exported_word_id_history_map;
+  }
+  if (word_id_history_map->empty())
     return;
   WordIDHistoryMapItem* map_item = cache->mutable_word_id_history_map();
-  map_item->set_item_count(word_id_history_map_.size());
-  for (WordIDHistoryMap::const_iterator iter = word_id_history_map_.begin();
-       iter != word_id_history_map_.end(); ++iter) {
+  map_item->set_item_count(word_id_history_map->size());
+  for (WordIDHistoryMap::const_iterator iter = word_id_history_map->begin();
+       iter != word_id_history_map->end(); ++iter) {
     WordIDHistoryMapEntry* map_entry =
         map_item->add_word_id_history_map_entry();
     map_entry->set_word_id(iter->first);
@@ -1032,17 +1308,8 @@ bool URLIndexPrivateData::RestorePrivateData(
     const std::string& languages) {
   last_time_rebuilt_from_history_ =
       base::Time::FromInternalValue(cache.last_rebuild_timestamp());
-  const base::TimeDelta rebuilt_ago =
-      base::Time::Now() - last_time_rebuilt_from_history_;
-  if ((rebuilt_ago > base::TimeDelta::FromDays(7)) ||
-      (rebuilt_ago < base::TimeDelta::FromDays(-1))) {
-    // Cache is more than a week old or, somehow, from some time in the future.
-    // It's probably a good time to rebuild the index from history to
-    // allow synced entries to now appear, expired entries to disappear, etc.
-    // Allow one day in the future to make the cache not rebuild on simple
-    // system clock changes such as time zone changes.
+  if (CacheRebuildIsDue(last_time_rebuilt_from_history_))
     return false;
-  }
   if (cache.has_version()) {
     if (cache.version() < kCurrentCacheFileVersion) {
       // Don't try to restore an old format cache file.  (This will cause
@@ -1052,9 +1319,18 @@ bool URLIndexPrivateData::RestorePrivateData(
     }
     restored_cache_version_ = cache.version();
   }
-  return RestoreWordList(cache) && RestoreWordMap(cache) &&
-      RestoreCharWordMap(cache) && RestoreWordIDHistoryMap(cache) &&
-      RestoreHistoryInfoMap(cache) && RestoreWordStartsMap(cache, languages);
+  if (!(RestoreWordList(cache) && RestoreWordMap(cache) &&
+        RestoreCharWordMap(cache) && RestoreWordIDHistoryMap(cache) &&
+        RestoreHistoryInfoMap(cache) &&
+        RestoreWordStartsMap(cache, languages)))
+    return false;
+  if (use_posting_lists_) {
+    // Move the restored maps into the posting lists.
+    posting_lists_.ImportFrom(char_word_map_, word_id_history_map_);
+    char_word_map_.clear();
+    word_id_history_map_.clear();
+  }
+  return true;
 }
 
 bool URLIndexPrivateData::RestoreWordList(
@@ -1235,6 +1511,11 @@ bool URLIndexPrivateData::RestoreWordStartsMap(
   return true;
 }
 
+size_t URLIndexPrivateData::IndexedCharCount() const {
+  return use_posting_lists_ ?
+      posting_lists_.char_count() : char_word_map_.size();
+}
+
 // static
 bool URLIndexPrivateData::URLSchemeIsWhitelisted(
     const GURL& gurl,
@@ -1243,6 +1524,41 @@ bool URLIndexPrivateData::URLSchemeIsWhitelisted(
 }
 
 
+// Chunked scoring -------------------------------------------------------------
+
+ScoredHistoryMatches URLIndexPrivateData::ScoreHistoryItemsInChunks(
+    const HistoryIDVector& history_ids,
+    size_t max_matches,
+    const std::string& languages,
+    HistoryClient* history_client,
+    const base::string16& lower_raw_string,
+    const String16Vector& lower_raw_terms,
+    base::Time now) const {
+  // The best matches so far are kept at the front of |scored_items|, and
+  // each chunk's matches are appended behind them before selecting again, so
+  // no more than |max_matches| plus a chunk's worth of matches are held.
+  const size_t kItemsPerChunk = 256;
+  ScoredHistoryMatches scored_items;
+  for (size_t begin = 0; begin < history_ids.size();
+       begin += kItemsPerChunk) {
+    const size_t end = std::min(begin + kItemsPerChunk, history_ids.size());
+    ScoredHistoryMatches chunk_items = std::for_each(
+        history_ids.begin() + begin, history_ids.begin() + end,
+        AddHistoryMatch(*this, languages, history_client, lower_raw_string,
+                        lower_raw_terms, now)).ScoredMatches();
+    scored_items.insert(scored_items.end(), chunk_items.begin(),
+                        chunk_items.end());
+    if (scored_items.size() > max_matches) {
+      std::partial_sort(scored_items.begin(),
+                        scored_items.begin() + max_matches,
+                        scored_items.end(),
+                        ScoredHistoryMatch::MatchScoreGreater);
+      scored_items.resize(max_matches);
+    }
+  }
+  return scored_items;
+}
+
 // SearchTermCacheItem ---------------------------------------------------------
 
 URLIndexPrivateData::SearchTermCacheItem::SearchTermCacheItem(
@@ -1295,28 +1611,43 @@ URLIndexPrivateData::AddHistoryMatch::~AddHistoryMatch() {}
 
 void URLIndexPrivateData::AddHistoryMatch::operator()(
     const HistoryID history_id) {
+  if (private_data_.mapped_cache_) {
+    HistoryInfoMapValue value;
+    RowWordStarts word_starts;
+    if (private_data_.mapped_cache_->GetRow(history_id, &value, &word_starts))
+      ScoreHistoryItem(value.url_row, value.visits, word_starts);
+    return;
+  }
   HistoryInfoMap::const_iterator hist_pos =
       private_data_.history_info_map_.find(history_id);
   if (hist_pos != private_data_.history_info_map_.end()) {
-    const URLRow& hist_item = hist_pos->second.url_row;
-    const VisitInfoVector& visits = hist_pos->second.visits;
     WordStartsMap::const_iterator starts_pos =
         private_data_.word_starts_map_.find(history_id);
     DCHECK(starts_pos != private_data_.word_starts_map_.end());
-    ScoredHistoryMatch match(hist_item, visits, languages_, lower_string_,
-                             lower_terms_, lower_terms_to_word_starts_offsets_,
-                             starts_pos->second, now_, history_client_);
-    if (match.raw_score() > 0)
-      scored_matches_.push_back(match);
+    ScoreHistoryItem(hist_pos->second.url_row, hist_pos->second.visits,
+                     starts_pos->second);
   }
 }
 
+void URLIndexPrivateData::AddHistoryMatch::ScoreHistoryItem(
+    const URLRow& row,
+    const VisitInfoVector& visits,
+    const RowWordStarts& word_starts) {
+  ScoredHistoryMatch match(row, visits, languages_, lower_string_,
+                           lower_terms_, lower_terms_to_word_starts_offsets_,
+                           word_starts, now_, history_client_);
+  if (match.raw_score() > 0)
+    scored_matches_.push_back(match);
+}
+
 
 // URLIndexPrivateData::HistoryItemFactorGreater -------------------------------
 
 URLIndexPrivateData::HistoryItemFactorGreater::HistoryItemFactorGreater(
-    const HistoryInfoMap& history_info_map)
-    : history_info_map_(history_info_map) {
+    const HistoryInfoMap& history_info_map,
+    const URLIndexMappedCache* mapped_cache)
+    : history_info_map_(history_info_map),
+      mapped_cache_(mapped_cache) {
 }
 
 URLIndexPrivateData::HistoryItemFactorGreater::~HistoryItemFactorGreater() {}
@@ -1324,6 +1655,19 @@ URLIndexPrivateData::HistoryItemFactorGreater::~HistoryItemFactorGreater() {}
 bool URLIndexPrivateData::HistoryItemFactorGreater::operator()(
     const HistoryID h1,
     const HistoryID h2) {
+  if (mapped_cache_) {
+    int typed1, visits1, typed2, visits2;
+    base::Time last_visit1, last_visit2;
+    if (!mapped_cache_->GetRowFactors(h1, &typed1, &visits1, &last_visit1))
+      return false;
+    if (!mapped_cache_->GetRowFactors(h2, &typed2, &visits2, &last_visit2))
+      return true;
+    if (typed1 != typed2)
+      return typed1 > typed2;
+    if (visits1 != visits2)
+      return visits1 > visits2;
+    return last_visit1 > last_visit2;
+  }
   HistoryInfoMap::const_iterator entry1(history_info_map_.find(h1));
   if (entry1 == history_info_map_.end())
     return false;
@@ -11,11 +11,15 @@
 #include "base/files/file_path.h"
 #include "base/gtest_prod_util.h"
 #include "base/memory/ref_counted.h"
+#include "base/memory/scoped_ptr.h"
 #include "chrome/browser/common/cancelable_request.h"
 #include "chrome/browser/history/history_service.h"
 #include "chrome/browser/history/in_memory_url_index_cache.pb.h"
 #include "chrome/browser/history/in_memory_url_index_types.h"
 #include "chrome/browser/history/scored_history_match.h"
+#include "chrome/browser/history/url_index_intersection_cache.h"
+#include "chrome/browser/history/url_index_mapped_cache.h"
+#include "chrome/browser/history/url_index_posting_lists.h"
 
 class HistoryQuickProviderTest;
 
@@ -131,6 +135,35 @@ class URLIndexPrivateData
       scoped_refptr<URLIndexPrivateData> private_data,
       const base::FilePath& file_path);
 
+  // Constructs a new object which answers queries directly from the
+  // memory-mapped cache file at |path| (see URLIndexMappedCache). Only the
+  // file's header is examined, so this takes the same time whatever the size
+  // of the history. The returned object cannot be updated; see
+  // AdoptMappedCache(). Returns NULL on failure or if the cache is due to be
+  // rebuilt from history. This function should be run on the file thread.
+  static scoped_refptr<URLIndexPrivateData> RestoreFromMappedFile(
+      const base::FilePath& path);
+
+  // Returns an updatable, fully in-memory copy of |mapped_data|, which must
+  // have been returned by RestoreFromMappedFile(). Returns NULL if the file
+  // proves to be inconsistent. This function should be run on the file
+  // thread.
+  static scoped_refptr<URLIndexPrivateData> AdoptMappedCache(
+      scoped_refptr<URLIndexPrivateData> mapped_data);
+
+  // Writes |private_data| as a mapped cache file to |file_path| and returns
+  // success.
+  static bool WritePrivateDataToMappedCacheFileTask(
+      scoped_refptr<URLIndexPrivateData> private_data,
+      const base::FilePath& file_path);
+
+  // Returns true if this object is a read-only view of a mapped cache file.
+  bool IsMapped() const { return mapped_cache_.get() != NULL; }
+
+  // Fills in |stats| and returns true if the intersection cache is enabled.
+  bool GetIntersectionCacheStats(
+      URLIndexIntersectionCache::Stats* stats) const;
+
   // Stops all pending updates to recent visits fields.  This should be
   // called during shutdown.
   void CancelPendingUpdates();
@@ -152,6 +185,7 @@ class URLIndexPrivateData
   friend class AddHistoryMatch;
   friend class ::HistoryQuickProviderTest;
   friend class InMemoryURLIndexTest;
+  friend class URLIndexPostingListsPerfTest;
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, CacheSaveRestore);
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, HugeResultSet);
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, ReadVisitsFromHistory);
@@ -161,6 +195,9 @@ class URLIndexPrivateData
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, TypedCharacterCaching);
   FRIEND_TEST_ALL_PREFIXES(InMemoryURLIndexTest, WhitelistedURLs);
   FRIEND_TEST_ALL_PREFIXES(LimitedInMemoryURLIndexTest, Initialization);
+  FRIEND_TEST_ALL_PREFIXES(URLIndexPostingListsPerfTest, EditingKeystrokes);
+  FRIEND_TEST_ALL_PREFIXES(URLIndexPostingListsPerfTest, Keystrokes);
+  FRIEND_TEST_ALL_PREFIXES(URLIndexPostingListsPerfTest, ChunkedScoring);
 
   // Support caching of term results so that we can optimize searches which
   // build upon a previous search. Each entry in this map represents one
@@ -210,6 +247,11 @@ class URLIndexPrivateData
     ScoredHistoryMatches ScoredMatches() const { return scored_matches_; }
 
    private:
+    // Scores the history item |row| and keeps it if the score is positive.
+    void ScoreHistoryItem(const URLRow& row,
+                          const VisitInfoVector& visits,
+                          const RowWordStarts& word_starts);
+
     const URLIndexPrivateData& private_data_;
     const std::string& languages_;
     HistoryClient* history_client_;
@@ -225,15 +267,31 @@ class URLIndexPrivateData
   class HistoryItemFactorGreater
       : public std::binary_function<HistoryID, HistoryID, void> {
    public:
-    explicit HistoryItemFactorGreater(const HistoryInfoMap& history_info_map);
+    // |mapped_cache|, if not NULL, is consulted instead of
+    // |history_info_map|.
+    HistoryItemFactorGreater(const HistoryInfoMap& history_info_map,
+                             const URLIndexMappedCache* mapped_cache);
     ~HistoryItemFactorGreater();
 
     bool operator()(const HistoryID h1, const HistoryID h2);
 
    private:
     const history::HistoryInfoMap& history_info_map_;
+    const URLIndexMappedCache* mapped_cache_;
   };
 
+  // Scores |history_ids| on the calling thread a chunk at a time, keeping
+  // only the best |max_matches| matches seen so far. Returns at most
+  // |max_matches| matches.
+  ScoredHistoryMatches ScoreHistoryItemsInChunks(
+      const HistoryIDVector& history_ids,
+      size_t max_matches,
+      const std::string& languages,
+      HistoryClient* history_client,
+      const base::string16& lower_raw_string,
+      const String16Vector& lower_raw_terms,
+      base::Time now) const;
+
   // URL History indexing support functions.
 
   // Composes a set of history item IDs by intersecting the set for each word
@@ -244,6 +302,14 @@ class URLIndexPrivateData
   // ids for the given term given in |term|.
   HistoryIDSet HistoryIDsForTerm(const base::string16& term);
 
+  // Equivalents of HistoryIDSetFromWords() and HistoryIDsForTerm() used when
+  // |use_posting_lists_| is set or the data is mapped. The results are in
+  // ascending order.
+  HistoryIDVector HistoryIDsFromPostingLists(
+      const String16Vector& unsorted_words);
+  HistoryIDVector HistoryIDsForTermFromPostingLists(
+      const base::string16& term) const;
+
   // Given a set of Char16s, finds words containing those characters.
   WordIDSet WordIDSetForTermChars(const Char16Set& term_chars);
 
@@ -300,6 +366,10 @@ class URLIndexPrivateData
   // directory.  Called by WritePrivateDataToCacheFileTask.
   bool SaveToFile(const base::FilePath& file_path);
 
+  // Writes the index private data as a mapped cache file. Called by
+  // WritePrivateDataToMappedCacheFileTask.
+  bool SaveToMappedFile(const base::FilePath& file_path);
+
   // Encode a data structure into the protobuf |cache|.
   void SavePrivateData(imui::InMemoryURLIndexCacheItem* cache) const;
   void SaveWordList(imui::InMemoryURLIndexCacheItem* cache) const;
@@ -322,6 +392,9 @@ class URLIndexPrivateData
   bool RestoreWordStartsMap(const imui::InMemoryURLIndexCacheItem& cache,
                             const std::string& languages);
 
+  // Returns the number of distinct characters in the index.
+  size_t IndexedCharCount() const;
+
   // Determines if |gurl| has a whitelisted scheme and returns true if so.
   static bool URLSchemeIsWhitelisted(const GURL& gurl,
                                      const std::set<std::string>& whitelist);
@@ -329,9 +402,31 @@ class URLIndexPrivateData
   // Cache of search terms.
   SearchTermCacheMap search_term_cache_;
 
+  // Cache of candidates for whole inputs and single words, NULL unless the
+  // HQPIntersectionCacheBytes omnibox field trial parameter is set. Entries
+  // are stamped with |index_generation_|, which is bumped whenever the
+  // indexed words or rows change.
+  scoped_ptr<URLIndexIntersectionCache> intersection_cache_;
+  uint64 index_generation_;
+
+  // True if candidates are scored in chunks, keeping only the best matches
+  // seen so far rather than every match. Set from the HQPChunkedScoring
+  // omnibox field trial parameter.
+  bool chunked_scoring_;
+
   // Allows canceling pending requests to update recent visits information.
   CancelableRequestConsumer recent_visits_consumer_;
 
+  // True if the char/word and word/history mappings are held in
+  // |posting_lists_| rather than in |char_word_map_| and
+  // |word_id_history_map_|, which then stay empty. Set from the
+  // HQPUsePostingLists omnibox field trial parameter.
+  bool use_posting_lists_;
+
+  // If not NULL, the read-only cache file from which queries are answered.
+  // The cached data members below are then all empty.
+  scoped_ptr<URLIndexMappedCache> mapped_cache_;
+
   // Start of data members that are cached -------------------------------------
 
   // The version of the cache file most recently used to restore this instance
@@ -369,6 +464,10 @@ class URLIndexPrivateData
   // used in the history database) of history items in which the word occurs.
   WordIDHistoryMap word_id_history_map_;
 
+  // The sorted-vector equivalent of |char_word_map_| and
+  // |word_id_history_map_|, populated only if |use_posting_lists_|.
+  URLIndexPostingLists posting_lists_;
+
   // A one-to-many mapping from a HistoryID to all WordIDs of words that occur
   // in the URL and/or page title of the history item referenced by that
   // HistoryID.
@@ -39,6 +39,17 @@ const int64 kMinimumImageSize = 200 * 1024;    // 200 KB
 const int64 kMinimumAudioSize = 500 * 1024;    // 500 KB
 const int64 kMinimumVideoSize = 1024 * 1024;   // 1 MB
 
+// The number of folders scanned at once. Scanning mostly waits on the disk, so
+// this is not tied to the number of processors.
+const size_t kMaxParallelScans = 4;
+
+// A worker returns to the UI thread once it has read this many directory
+// entries, so that idle workers can take the folders it has found. When
+// workers are idle for lack of folders, the smaller batch size is used so that
+// they get some sooner.
+const size_t kMaxEntriesPerBatch = 4096;
+const size_t kMinEntriesPerBatch = 256;
+
 const int kPrunedPaths[] = {
 #if defined(OS_WIN)
   base::DIR_IE_INTERNET_CACHE,
@@ -175,10 +186,17 @@ class MediaFolderFinder::Worker {
   explicit Worker(const std::vector<base::FilePath>& graylisted_folders);
   ~Worker();
 
-  // Scans |path| and return the results.
-  WorkerReply ScanFolder(const base::FilePath& path);
+  // Scans |path| and its subfolders, depth first, until |max_entries|
+  // directory entries have been read, and returns the results.
+  WorkerReply ScanFolders(const base::FilePath& path, size_t max_entries);
 
  private:
+  // Scans |path| into |scan_result| and |new_folders|. Returns the number of
+  // directory entries read.
+  size_t ScanFolder(const base::FilePath& path,
+                    MediaGalleryScanResult* scan_result,
+                    std::vector<base::FilePath>* new_folders);
+
   void MakeFolderPathsAbsolute();
 
   bool folder_paths_are_absolute_;
@@ -212,8 +230,9 @@ MediaFolderFinder::Worker::~Worker() {
   DCHECK(sequence_checker_.CalledOnValidSequencedThread());
 }
 
-MediaFolderFinder::WorkerReply MediaFolderFinder::Worker::ScanFolder(
-    const base::FilePath& path) {
+MediaFolderFinder::WorkerReply MediaFolderFinder::Worker::ScanFolders(
+    const base::FilePath& path,
+    size_t max_entries) {
   DCHECK(sequence_checker_.CalledOnValidSequencedThread());
   CHECK(IsValidScanPath(path));
 
@@ -221,11 +240,38 @@ MediaFolderFinder::WorkerReply MediaFolderFinder::Worker::ScanFolder(
     MakeFolderPathsAbsolute();
 
   WorkerReply reply;
+  std::vector<base::FilePath> folders_to_scan(1, path);
+  size_t entries = 0;
+  while (!folders_to_scan.empty() && entries < max_entries) {
+    base::FilePath folder = folders_to_scan.back();
+    folders_to_scan.pop_back();
+
+    MediaGalleryScanResult scan_result;
+    std::vector<base::FilePath> new_folders;
+    entries += ScanFolder(folder, &scan_result, &new_folders);
+    if (!IsEmptyScanResult(scan_result))
+      reply.results[folder] = scan_result;
+
+    // Push new folders to |folders_to_scan| in reverse order.
+    std::copy(new_folders.rbegin(), new_folders.rend(),
+              std::back_inserter(folders_to_scan));
+  }
+  reply.new_folders.swap(folders_to_scan);
+  return reply;
+}
+
+size_t MediaFolderFinder::Worker::ScanFolder(
+    const base::FilePath& path,
+    MediaGalleryScanResult* scan_result,
+    std::vector<base::FilePath>* new_folders) {
+  DCHECK(sequence_checker_.CalledOnValidSequencedThread());
+
+  size_t entries = 0;
   bool folder_meets_size_requirement = false;
   bool is_graylisted_folder = false;
   base::FilePath abspath = base::MakeAbsoluteFilePath(path);
   if (abspath.empty())
-    return reply;
+    return entries;
 
   for (size_t i = 0; i < graylisted_folders_.size(); ++i) {
     if (abspath == graylisted_folders_[i] ||
@@ -244,6 +290,7 @@ MediaFolderFinder::WorkerReply MediaFolderFinder::Worker::ScanFolder(
 #endif
       );  // NOLINT
   while (!enumerator.Next().empty()) {
+    ++entries;
     base::FileEnumerator::FileInfo file_info = enumerator.GetInfo();
     base::FilePath full_path = path.Append(file_info.GetName());
     if (MediaPathFilter::ShouldSkip(full_path))
@@ -263,7 +310,7 @@ MediaFolderFinder::WorkerReply MediaFolderFinder::Worker::ScanFolder(
       }
 
       if (!is_pruned_folder)
-        reply.new_folders.push_back(full_path);
+        new_folders->push_back(full_path);
       continue;
     }
 
@@ -277,7 +324,7 @@ MediaFolderFinder::WorkerReply MediaFolderFinder::Worker::ScanFolder(
     if (type == MEDIA_GALLERY_SCAN_FILE_TYPE_UNKNOWN)
       continue;
 
-    CountScanResult(type, &reply.scan_result);
+    CountScanResult(type, scan_result);
     if (!folder_meets_size_requirement) {
       folder_meets_size_requirement =
           FileMeetsSizeRequirement(type, file_info.GetSize());
@@ -285,8 +332,8 @@ MediaFolderFinder::WorkerReply MediaFolderFinder::Worker::ScanFolder(
   }
   // Make sure there is at least 1 file above a size threshold.
   if (!folder_meets_size_requirement)
-    reply.scan_result = MediaGalleryScanResult();
-  return reply;
+    *scan_result = MediaGalleryScanResult();
+  return entries;
 }
 
 void MediaFolderFinder::Worker::MakeFolderPathsAbsolute() {
@@ -316,19 +363,16 @@ MediaFolderFinder::MediaFolderFinder(
       graylisted_folders_(
           extensions::file_system_api::GetGrayListedDirectories()),
       scan_state_(SCAN_STATE_NOT_STARTED),
-      worker_(new Worker(graylisted_folders_)),
       has_roots_for_testing_(false),
       weak_factory_(this) {
   DCHECK_CURRENTLY_ON(BrowserThread::UI);
-
-  base::SequencedWorkerPool* pool = BrowserThread::GetBlockingPool();
-  worker_task_runner_ = pool->GetSequencedTaskRunner(pool->GetSequenceToken());
+  CreateWorkers(kMaxParallelScans);
 }
 
 MediaFolderFinder::~MediaFolderFinder() {
   DCHECK_CURRENTLY_ON(BrowserThread::UI);
 
-  worker_task_runner_->DeleteSoon(FROM_HERE, worker_);
+  DeleteWorkers();
 
   if (scan_state_ == SCAN_STATE_FINISHED)
     return;
@@ -350,6 +394,13 @@ void MediaFolderFinder::StartScan() {
       roots_for_testing_);
 }
 
+void MediaFolderFinder::SetProgressCallback(
+    const MediaFolderFinderProgressCallback& callback) {
+  DCHECK_CURRENTLY_ON(BrowserThread::UI);
+  DCHECK_EQ(SCAN_STATE_NOT_STARTED, scan_state_);
+  progress_callback_ = callback;
+}
+
 const std::vector<base::FilePath>&
 MediaFolderFinder::graylisted_folders() const {
   return graylisted_folders_;
@@ -364,6 +415,35 @@ void MediaFolderFinder::SetRootsForTesting(
   roots_for_testing_ = roots;
 }
 
+void MediaFolderFinder::SetMaxParallelScansForTesting(
+    size_t max_parallel_scans) {
+  DCHECK_CURRENTLY_ON(BrowserThread::UI);
+  DCHECK_EQ(SCAN_STATE_NOT_STARTED, scan_state_);
+  DCHECK_GT(max_parallel_scans, 0U);
+
+  DeleteWorkers();
+  CreateWorkers(max_parallel_scans);
+}
+
+void MediaFolderFinder::CreateWorkers(size_t count) {
+  DCHECK(workers_.empty());
+  base::SequencedWorkerPool* pool = BrowserThread::GetBlockingPool();
+  for (size_t i = 0; i < count; ++i) {
+    worker_task_runners_.push_back(
+        pool->GetSequencedTaskRunner(pool->GetSequenceToken()));
+    workers_.push_back(new Worker(graylisted_folders_));
+    idle_workers_.push_back(i);
+  }
+}
+
+void MediaFolderFinder::DeleteWorkers() {
+  for (size_t i = 0; i < workers_.size(); ++i)
+    worker_task_runners_[i]->DeleteSoon(FROM_HERE, workers_[i]);
+  workers_.clear();
+  worker_task_runners_.clear();
+  idle_workers_.clear();
+}
+
 void MediaFolderFinder::OnInitialized(
     const std::vector<base::FilePath>& roots) {
   DCHECK_EQ(SCAN_STATE_STARTED, scan_state_);
@@ -401,44 +481,65 @@ void MediaFolderFinder::OnInitialized(
 
   std::copy(valid_roots.begin(), valid_roots.end(),
             std::back_inserter(folders_to_scan_));
-  ScanFolder();
+  ScanFolders();
 }
 
-void MediaFolderFinder::ScanFolder() {
+void MediaFolderFinder::ScanFolders() {
   DCHECK_CURRENTLY_ON(BrowserThread::UI);
   DCHECK_EQ(SCAN_STATE_STARTED, scan_state_);
 
-  if (folders_to_scan_.empty()) {
+  if (folders_to_scan_.empty() && idle_workers_.size() == workers_.size()) {
     scan_state_ = SCAN_STATE_FINISHED;
     results_callback_.Run(true /* success? */, results_);
     return;
   }
 
-  base::FilePath folder_to_scan = folders_to_scan_.back();
-  folders_to_scan_.pop_back();
-  base::PostTaskAndReplyWithResult(
-      worker_task_runner_, FROM_HERE,
-      base::Bind(&Worker::ScanFolder,
-                 base::Unretained(worker_),
-                 folder_to_scan),
-      base::Bind(&MediaFolderFinder::GotScanResults,
-                 weak_factory_.GetWeakPtr(),
-                 folder_to_scan));
+  while (!folders_to_scan_.empty() && !idle_workers_.empty()) {
+    size_t worker_index = idle_workers_.back();
+    idle_workers_.pop_back();
+    base::FilePath folder_to_scan = folders_to_scan_.back();
+    folders_to_scan_.pop_back();
+
+    // If there are not enough folders left for the other idle workers, come
+    // back soon with more.
+    size_t max_entries = folders_to_scan_.size() < idle_workers_.size() ?
+        kMinEntriesPerBatch : kMaxEntriesPerBatch;
+    base::PostTaskAndReplyWithResult(
+        worker_task_runners_[worker_index].get(), FROM_HERE,
+        base::Bind(&Worker::ScanFolders,
+                   base::Unretained(workers_[worker_index]),
+                   folder_to_scan,
+                   max_entries),
+        base::Bind(&MediaFolderFinder::GotScanResults,
+                   weak_factory_.GetWeakPtr(),
+                   worker_index));
+  }
 }
 
-void MediaFolderFinder::GotScanResults(const base::FilePath& path,
+void MediaFolderFinder::GotScanResults(size_t worker_index,
                                        const WorkerReply& reply) {
   DCHECK_CURRENTLY_ON(BrowserThread::UI);
   DCHECK_EQ(SCAN_STATE_STARTED, scan_state_);
-  DCHECK(!path.empty());
-  CHECK(!ContainsKey(results_, path));
+  DCHECK_LT(worker_index, workers_.size());
 
-  if (!IsEmptyScanResult(reply.scan_result))
-    results_[path] = reply.scan_result;
+  for (MediaFolderFinderResults::const_iterator it = reply.results.begin();
+       it != reply.results.end(); ++it) {
+    CHECK(!ContainsKey(results_, it->first));
+    results_[it->first] = it->second;
+  }
 
   // Push new folders to the |folders_to_scan_| in reverse order.
   std::copy(reply.new_folders.rbegin(), reply.new_folders.rend(),
             std::back_inserter(folders_to_scan_));
+  idle_workers_.push_back(worker_index);
+
+  if (!reply.results.empty() && !progress_callback_.is_null()) {
+    // Running the callback may delete |this|.
+    base::WeakPtr<MediaFolderFinder> weak_this = weak_factory_.GetWeakPtr();
+    progress_callback_.Run(reply.results);
+    if (!weak_this)
+      return;
+  }
 
-  ScanFolder();
+  ScanFolders();
 }
@@ -16,7 +16,10 @@
 #include "chrome/browser/media_galleries/media_scan_types.h"
 
 // MediaFolderFinder scans local hard drives and look for folders that contain
-// media files.
+// media files. Up to kMaxParallelScans folders are scanned at once, each by a
+// worker on its own blocking SequencedTaskRunner. A worker scans the subfolders
+// of its folder in a batch, up to a number of directory entries, and returns
+// the subfolders it has not got to, so that idle workers can take them.
 class MediaFolderFinder {
  public:
   // Key: path to a folder
@@ -30,6 +33,11 @@ class MediaFolderFinder {
                               const MediaFolderFinderResults& /*results*/)>
       MediaFolderFinderResultsCallback;
 
+  // |results| holds the folders found by one batch of scans. A folder is never
+  // reported twice.
+  typedef base::Callback<void(const MediaFolderFinderResults& /*results*/)>
+      MediaFolderFinderProgressCallback;
+
   // |callback| will get called when the scan finishes. If the object is deleted
   // before it finishes, the scan will stop and |callback| will get called with
   // success = false.
@@ -41,9 +49,15 @@ class MediaFolderFinder {
   // Start the scan.
   virtual void StartScan();
 
+  // |callback| gets the results as they are found, before the final results
+  // are passed to the MediaFolderFinderResultsCallback. Must be called before
+  // StartScan().
+  void SetProgressCallback(const MediaFolderFinderProgressCallback& callback);
+
   const std::vector<base::FilePath>& graylisted_folders() const;
 
  private:
+  friend class MediaFolderFinderPerfTest;
   friend class MediaFolderFinderTest;
   friend class MediaGalleriesPlatformAppBrowserTest;
 
@@ -52,7 +66,9 @@ class MediaFolderFinder {
     WorkerReply();
     ~WorkerReply();
 
-    MediaGalleryScanResult scan_result;
+    // The non-empty results of the folders scanned.
+    MediaFolderFinderResults results;
+    // Folders found but not scanned yet.
     std::vector<base::FilePath> new_folders;
   };
 
@@ -64,25 +80,36 @@ class MediaFolderFinder {
 
   void SetRootsForTesting(const std::vector<base::FilePath>& roots);
 
+  // Limits the number of folders scanned at once to |max_parallel_scans|.
+  void SetMaxParallelScansForTesting(size_t max_parallel_scans);
+
+  void CreateWorkers(size_t count);
+  void DeleteWorkers();
+
   void OnInitialized(const std::vector<base::FilePath>& roots);
 
-  // Scan a folder from |folders_to_scan_|.
-  void ScanFolder();
+  // Give folders from |folders_to_scan_| to the idle workers, or finish the
+  // scan if there are none left to scan.
+  void ScanFolders();
 
-  // Callback that handles the |reply| from |worker_| for a scanned |path|.
-  void GotScanResults(const base::FilePath& path, const WorkerReply& reply);
+  // Callback that handles the |reply| from the worker at |worker_index|.
+  void GotScanResults(size_t worker_index, const WorkerReply& reply);
 
   const MediaFolderFinderResultsCallback results_callback_;
+  MediaFolderFinderProgressCallback progress_callback_;
   MediaFolderFinderResults results_;
 
   std::vector<base::FilePath> graylisted_folders_;
   std::vector<base::FilePath> folders_to_scan_;
   ScanState scan_state_;
 
-  scoped_refptr<base::SequencedTaskRunner> worker_task_runner_;
+  // The workers, and the task runners they live on, by index. Owned by
+  // MediaFolderFinder, but each lives on its task runner.
+  std::vector<scoped_refptr<base::SequencedTaskRunner> > worker_task_runners_;
+  std::vector<Worker*> workers_;
 
-  // Owned by MediaFolderFinder, but lives on |worker_task_runner_|.
-  Worker* worker_;
+  // Indices of the workers that are not scanning.
+  std::vector<size_t> idle_workers_;
 
   // Set of roots to scan for testing.
   bool has_roots_for_testing_;
@@ -0,0 +1,119 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/media_galleries/media_folder_finder.h"
+
+#include <string>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/file_util.h"
+#include "base/files/file_path.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/run_loop.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "content/public/test/test_browser_thread_bundle.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+namespace {
+
+// The synthetic tree has kTreeFanout subfolders per folder, kTreeDepth levels
+// deep, and kFilesPerFolder files in every folder, one in four of them
+// images.
+const int kTreeFanout = 8;
+const int kTreeDepth = 3;
+const int kFilesPerFolder = 24;
+
+const size_t kMaxParallelScans[] = { 1, 2, 4, 8 };
+
+}  // namespace
+
+class MediaFolderFinderPerfTest : public testing::Test {
+ public:
+  MediaFolderFinderPerfTest() : num_folders_(0) {}
+
+  virtual void SetUp() OVERRIDE {
+    ASSERT_TRUE(tree_dir_.CreateUniqueTempDir());
+    CreateTree(tree_dir_.path(), kTreeDepth);
+  }
+
+ protected:
+  // Fills |path| with files, and with subfolders down to |depth| levels.
+  void CreateTree(const base::FilePath& path, int depth) {
+    ++num_folders_;
+    for (int i = 0; i < kFilesPerFolder; ++i) {
+      const std::string name = base::StringPrintf(
+          i % 4 ? "document%d.txt" : "image%d.jpg", i);
+      ASSERT_EQ(1, base::WriteFile(path.AppendASCII(name), "x", 1));
+    }
+    if (!depth)
+      return;
+    for (int i = 0; i < kTreeFanout; ++i) {
+      base::FilePath folder = path.AppendASCII(base::StringPrintf("dir%d", i));
+      ASSERT_TRUE(base::CreateDirectory(folder));
+      CreateTree(folder, depth - 1);
+    }
+  }
+
+  // Scans the tree with |max_parallel_scans| workers, and returns how long it
+  // took.
+  base::TimeDelta Scan(size_t max_parallel_scans) {
+    base::RunLoop run_loop;
+    MediaFolderFinder finder(
+        base::Bind(&MediaFolderFinderPerfTest::OnScanFinished,
+                   base::Unretained(this), run_loop.QuitClosure()));
+    finder.SetRootsForTesting(
+        std::vector<base::FilePath>(1, tree_dir_.path()));
+    finder.SetMaxParallelScansForTesting(max_parallel_scans);
+
+    const base::TimeTicks start = base::TimeTicks::HighResNow();
+    finder.StartScan();
+    run_loop.Run();
+    return base::TimeTicks::HighResNow() - start;
+  }
+
+  int num_folders() const { return num_folders_; }
+
+ private:
+  void OnScanFinished(
+      const base::Closure& quit_closure,
+      bool success,
+      const MediaFolderFinder::MediaFolderFinderResults& results) {
+    if (!success)
+      return;
+    // The images are too small for their folders to count.
+    EXPECT_TRUE(results.empty());
+    quit_closure.Run();
+  }
+
+  content::TestBrowserThreadBundle thread_bundle_;
+  base::ScopedTempDir tree_dir_;
+  int num_folders_;
+
+  DISALLOW_COPY_AND_ASSIGN(MediaFolderFinderPerfTest);
+};
+
+TEST_F(MediaFolderFinderPerfTest, ScanTree) {
+  const std::string trace = base::StringPrintf(
+      "%d_folders_%d_files", num_folders(), num_folders() * kFilesPerFolder);
+  for (size_t i = 0; i < arraysize(kMaxParallelScans); ++i) {
+    // Warm the disk cache so that every run reads the same way.
+    if (i == 0)
+      Scan(kMaxParallelScans[i]);
+
+    base::TimeDelta elapsed = Scan(kMaxParallelScans[i]);
+    perf_test::PrintResult(
+        "media_folder_finder_scan",
+        base::StringPrintf("_%u_workers",
+                           static_cast<unsigned>(kMaxParallelScans[i])),
+        trace, elapsed.InMillisecondsF(), "ms", true);
+    perf_test::PrintResult(
+        "media_folder_finder_folders_per_second",
+        base::StringPrintf("_%u_workers",
+                           static_cast<unsigned>(kMaxParallelScans[i])),
+        trace, num_folders() / elapsed.InSecondsF(), "folders/s", true);
+  }
+}
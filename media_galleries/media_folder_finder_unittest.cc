@@ -12,6 +12,7 @@
 #include "base/file_util.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/run_loop.h"
+#include "base/stl_util.h"
 #include "base/strings/stringprintf.h"
 #include "base/test/scoped_path_override.h"
 #include "base/threading/sequenced_worker_pool.h"
@@ -56,6 +57,18 @@ class MediaFolderFinderTest : public testing::Test {
     media_folder_finder_->StartScan();
   }
 
+  // Records the results reported by the progress callback in
+  // |progress_results_|.
+  void RecordProgress() {
+    media_folder_finder_->SetProgressCallback(
+        base::Bind(&MediaFolderFinderTest::OnGotProgress,
+                   base::Unretained(this)));
+  }
+
+  void SetMaxParallelScans(size_t max_parallel_scans) {
+    media_folder_finder_->SetMaxParallelScansForTesting(max_parallel_scans);
+  }
+
   void DeleteMediaFolderFinder() {
     EXPECT_TRUE(media_folder_finder_.get() != NULL);
     media_folder_finder_.reset();
@@ -65,6 +78,10 @@ class MediaFolderFinderTest : public testing::Test {
     return received_results_;
   }
 
+  const MediaFolderFinder::MediaFolderFinderResults& progress_results() const {
+    return progress_results_;
+  }
+
   const base::FilePath& fake_dir() const {
     return fake_dir_.path();
   }
@@ -147,6 +164,18 @@ class MediaFolderFinderTest : public testing::Test {
   }
 
  private:
+  void OnGotProgress(
+      const MediaFolderFinder::MediaFolderFinderResults& results) {
+    EXPECT_FALSE(received_results_);
+    for (MediaFolderFinder::MediaFolderFinderResults::const_iterator it =
+             results.begin();
+         it != results.end(); ++it) {
+      EXPECT_FALSE(ContainsKey(progress_results_, it->first))
+          << it->first.value();
+      progress_results_[it->first] = it->second;
+    }
+  }
+
   void OnGotResults(
       bool success,
       const MediaFolderFinder::MediaFolderFinderResults& results) {
@@ -189,6 +218,7 @@ class MediaFolderFinderTest : public testing::Test {
 
   bool expected_success_;
   MediaFolderFinder::MediaFolderFinderResults expected_results_;
+  MediaFolderFinder::MediaFolderFinderResults progress_results_;
   bool received_results_;
 
   DISALLOW_COPY_AND_ASSIGN(MediaFolderFinderTest);
@@ -409,3 +439,66 @@ TEST_F(MediaFolderFinderTest, Graylist) {
   RunLoopUntilReceivedCallback();
   DeleteMediaFolderFinder();
 }
+
+// Folders with more entries than a worker reads in a batch are split between
+// the workers, and the results are the same however many there are.
+TEST_F(MediaFolderFinderTest, ScanInParallel) {
+  MediaFolderFinder::MediaFolderFinderResults expected_results;
+  std::vector<base::FilePath> folders;
+  folders.push_back(fake_dir());
+
+  for (int i = 0; i < 4; ++i) {
+    base::FilePath dir = fake_dir().AppendASCII(base::StringPrintf("dir%d", i));
+    for (int j = 0; j < 100; ++j)
+      CreateTestDir(dir.AppendASCII(base::StringPrintf("empty%d", j)));
+    for (int j = 0; j < 2; ++j) {
+      CreateTestFile(dir.AppendASCII(base::StringPrintf("media%d", j)),
+                     MEDIA_GALLERY_SCAN_FILE_TYPE_IMAGE, 1, true,
+                     &expected_results);
+    }
+  }
+
+  const size_t kMaxParallelScans[] = { 1, 3 };
+  for (size_t i = 0; i < arraysize(kMaxParallelScans); ++i) {
+    CreateMediaFolderFinder(folders, true, expected_results);
+    SetMaxParallelScans(kMaxParallelScans[i]);
+    StartScan();
+    RunLoopUntilReceivedCallback();
+    DeleteMediaFolderFinder();
+  }
+}
+
+TEST_F(MediaFolderFinderTest, ReportsProgress) {
+  MediaFolderFinder::MediaFolderFinderResults expected_results;
+  std::vector<base::FilePath> folders;
+  folders.push_back(fake_dir());
+
+  base::FilePath dir1 = fake_dir().AppendASCII("dir1");
+  base::FilePath dir2 = fake_dir().AppendASCII("dir2");
+  base::FilePath dir2_3 = dir2.AppendASCII("dir2_3");
+  CreateTestFile(dir1, MEDIA_GALLERY_SCAN_FILE_TYPE_IMAGE, 1, true,
+                 &expected_results);
+  CreateTestFile(dir2_3, MEDIA_GALLERY_SCAN_FILE_TYPE_AUDIO, 2, true,
+                 &expected_results);
+  CreateTestFile(dir2, MEDIA_GALLERY_SCAN_FILE_TYPE_UNKNOWN, 1, true,
+                 &expected_results);
+
+  CreateMediaFolderFinder(folders, true, expected_results);
+  RecordProgress();
+  StartScan();
+  RunLoopUntilReceivedCallback();
+  DeleteMediaFolderFinder();
+
+  // The progress adds up to the final results.
+  ASSERT_EQ(expected_results.size(), progress_results().size());
+  for (MediaFolderFinder::MediaFolderFinderResults::const_iterator it =
+           expected_results.begin();
+       it != expected_results.end(); ++it) {
+    ASSERT_TRUE(ContainsKey(progress_results(), it->first));
+    const MediaGalleryScanResult& actual =
+        progress_results().find(it->first)->second;
+    EXPECT_EQ(it->second.image_count, actual.image_count);
+    EXPECT_EQ(it->second.audio_count, actual.audio_count);
+    EXPECT_EQ(it->second.video_count, actual.video_count);
+  }
+}
@@ -341,6 +341,10 @@ void MediaScanManager::StartScan(Profile* profile,
   } else {
     folder_finder_.reset(testing_folder_finder_factory_.Run(callback));
   }
+  folder_finder_->SetProgressCallback(
+      base::Bind(&MediaScanManager::OnScanProgress,
+                 weak_factory_.GetWeakPtr()));
+  scan_progress_ = MediaGalleryScanResult();
   scan_start_time_ = base::Time::Now();
   folder_finder_->StartScan();
 }
@@ -481,6 +485,32 @@ bool MediaScanManager::ScanInProgress() const {
   return false;
 }
 
+void MediaScanManager::OnScanProgress(
+    const MediaFolderFinder::MediaFolderFinderResults& found_folders) {
+  DCHECK_CURRENTLY_ON(content::BrowserThread::UI);
+  for (MediaFolderFinder::MediaFolderFinderResults::const_iterator it =
+           found_folders.begin(); it != found_folders.end(); ++it) {
+    scan_progress_.audio_count += it->second.audio_count;
+    scan_progress_.image_count += it->second.image_count;
+    scan_progress_.video_count += it->second.video_count;
+  }
+
+  for (ScanObserverMap::iterator scans_for_profile = observers_.begin();
+       scans_for_profile != observers_.end();
+       ++scans_for_profile) {
+    // Copied, as observers may cancel their scans.
+    ScanningExtensionIdSet scanning_extensions =
+        scans_for_profile->second.scanning_extensions;
+    for (ScanningExtensionIdSet::const_iterator extension_id_it =
+             scanning_extensions.begin();
+         extension_id_it != scanning_extensions.end();
+         ++extension_id_it) {
+      scans_for_profile->second.observer->OnScanProgress(*extension_id_it,
+                                                         scan_progress_);
+    }
+  }
+}
+
 void MediaScanManager::OnScanCompleted(
     bool success,
     const MediaFolderFinder::MediaFolderFinderResults& found_folders) {
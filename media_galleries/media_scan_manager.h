@@ -83,6 +83,11 @@ class MediaScanManager : public extensions::ExtensionRegistryObserver {
 
   bool ScanInProgress() const;
 
+  // Adds the files in |found_folders| to |scan_progress_| and reports it to
+  // the observers of the scanning extensions.
+  void OnScanProgress(
+      const MediaFolderFinder::MediaFolderFinderResults& found_folders);
+
   void OnScanCompleted(
       bool success,
       const MediaFolderFinder::MediaFolderFinderResults& found_folders);
@@ -95,6 +100,9 @@ class MediaScanManager : public extensions::ExtensionRegistryObserver {
 
   base::Time scan_start_time_;
 
+  // The media files found so far by |folder_finder_|.
+  MediaGalleryScanResult scan_progress_;
+
   // If not NULL, used to create |folder_finder_|. Used for testing.
   MediaFolderFinderFactory testing_folder_finder_factory_;
 
@@ -14,6 +14,11 @@ class MediaScanManagerObserver {
  public:
   virtual void OnScanStarted(const std::string& extension_id) {}
   virtual void OnScanCancelled(const std::string& extension_id) {}
+  // |file_counts| is the number of media files found so far, before any of
+  // the processing that OnScanFinished()'s counts go through.
+  virtual void OnScanProgress(
+      const std::string& extension_id,
+      const MediaGalleryScanResult& file_counts) {}
   virtual void OnScanFinished(
       const std::string& extension_id,
       int gallery_count,
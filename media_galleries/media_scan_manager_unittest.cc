@@ -96,6 +96,7 @@ class MediaScanManagerTest : public MediaScanManagerObserver,
       : find_folders_start_count_(0),
         find_folders_destroy_count_(0),
         find_folders_success_(false),
+        progress_count_(0),
         expected_gallery_count_(0),
         profile_(new TestingProfile()) {}
 
@@ -217,6 +218,14 @@ class MediaScanManagerTest : public MediaScanManagerObserver,
     return find_folders_destroy_count_;
   }
 
+  int progress_count() const {
+    return progress_count_;
+  }
+
+  const MediaGalleryScanResult& progress_file_counts() const {
+    return progress_file_counts_;
+  }
+
   void CheckFileCounts(MediaGalleryPrefId pref_id, int audio_count,
                        int image_count, int video_count) {
     if (!ContainsKey(known_galleries(), pref_id)) {
@@ -231,6 +240,14 @@ class MediaScanManagerTest : public MediaScanManagerObserver,
   }
 
   // MediaScanManagerObserver implementation.
+  virtual void OnScanProgress(
+      const std::string& extension_id,
+      const MediaGalleryScanResult& file_counts) OVERRIDE {
+    EXPECT_EQ(extension_->id(), extension_id);
+    ++progress_count_;
+    progress_file_counts_ = file_counts;
+  }
+
   virtual void OnScanFinished(
       const std::string& extension_id,
       int gallery_count,
@@ -255,6 +272,9 @@ class MediaScanManagerTest : public MediaScanManagerObserver,
   void OnFindFoldersStarted(
       MediaFolderFinder::MediaFolderFinderResultsCallback callback) {
     find_folders_start_count_++;
+    // Report the results as progress first, as MediaFolderFinder does.
+    if (find_folders_success_ && !find_folders_results_.empty())
+      media_scan_manager_->OnScanProgress(find_folders_results_);
     callback.Run(find_folders_success_, find_folders_results_);
   }
 
@@ -269,6 +289,9 @@ class MediaScanManagerTest : public MediaScanManagerObserver,
   bool find_folders_success_;
   MediaFolderFinder::MediaFolderFinderResults find_folders_results_;
 
+  int progress_count_;
+  MediaGalleryScanResult progress_file_counts_;
+
   int expected_gallery_count_;
   MediaGalleryScanResult expected_file_counts_;
 
@@ -315,6 +338,28 @@ TEST_F(MediaScanManagerTest, SingleResult) {
   EXPECT_EQ(galleries_before + 1, gallery_count());
 }
 
+TEST_F(MediaScanManagerTest, ReportsProgress) {
+  MediaGalleryScanResult file_counts;
+  file_counts.audio_count = 1;
+  file_counts.image_count = 2;
+  file_counts.video_count = 3;
+  base::FilePath path;
+  MakeTestFolder("found_media_folder", &path);
+
+  MediaFolderFinder::MediaFolderFinderResults found_folders;
+  found_folders[path] = file_counts;
+  SetFindFoldersResults(true, found_folders);
+
+  SetExpectedScanResults(1 /*gallery_count*/, file_counts);
+  StartScan();
+
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(1, progress_count());
+  EXPECT_EQ(1, progress_file_counts().audio_count);
+  EXPECT_EQ(2, progress_file_counts().image_count);
+  EXPECT_EQ(3, progress_file_counts().video_count);
+}
+
 // Generally test that it includes directories with sufficient density
 // and excludes others.
 //
@@ -9,6 +9,7 @@
 #include <vector>
 
 #include "base/base_paths.h"
+#include "base/bind.h"
 #include "base/debug/trace_event.h"
 #include "base/logging.h"
 #include "base/metrics/histogram.h"
@@ -25,6 +26,7 @@
 #include "chrome/browser/net/chrome_extensions_network_delegate.h"
 #include "chrome/browser/net/client_hints.h"
 #include "chrome/browser/net/connect_interceptor.h"
+#include "chrome/browser/net/content_length_batcher.h"
 #include "chrome/browser/performance_monitor/performance_monitor.h"
 #include "chrome/browser/prerender/prerender_tracker.h"
 #include "chrome/browser/profiles/profile_manager.h"
@@ -294,6 +296,9 @@ ChromeNetworkDelegate::ChromeNetworkDelegate(
       domain_reliability_monitor_(NULL),
       received_content_length_(0),
       original_content_length_(0),
+      content_length_batcher_(new ContentLengthBatcher(
+          base::Bind(&ChromeNetworkDelegate::StoreContentLength,
+                     base::Unretained(this)))),
       first_request_(true),
       prerender_tracker_(NULL),
       data_reduction_proxy_params_(NULL) {
@@ -302,7 +307,9 @@ ChromeNetworkDelegate::ChromeNetworkDelegate(
       ChromeExtensionsNetworkDelegate::Create(event_router));
 }
 
-ChromeNetworkDelegate::~ChromeNetworkDelegate() {}
+ChromeNetworkDelegate::~ChromeNetworkDelegate() {
+  content_length_batcher_->Flush();
+}
 
 void ChromeNetworkDelegate::set_extension_info_map(
     extensions::InfoMap* extension_info_map) {
@@ -805,10 +812,19 @@ void ChromeNetworkDelegate::AccumulateContentLength(
     data_reduction_proxy::DataReductionProxyRequestType request_type) {
   DCHECK_GE(received_content_length, 0);
   DCHECK_GE(original_content_length, 0);
+  content_length_batcher_->Add(received_content_length,
+                               original_content_length,
+                               request_type);
+  received_content_length_ += received_content_length;
+  original_content_length_ += original_content_length;
+}
+
+void ChromeNetworkDelegate::StoreContentLength(
+    int received_content_length,
+    int original_content_length,
+    data_reduction_proxy::DataReductionProxyRequestType request_type) {
   StoreAccumulatedContentLength(received_content_length,
                                 original_content_length,
                                 request_type,
                                 reinterpret_cast<Profile*>(profile_));
-  received_content_length_ += received_content_length;
-  original_content_length_ += original_content_length;
 }
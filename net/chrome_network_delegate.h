@@ -18,6 +18,7 @@
 
 class ChromeExtensionsNetworkDelegate;
 class ClientHints;
+class ContentLengthBatcher;
 class CookieSettings;
 class PrefService;
 template<class T> class PrefMember;
@@ -205,6 +206,13 @@ class ChromeNetworkDelegate : public net::NetworkDelegate {
       int64 original_payload_byte_count,
       data_reduction_proxy::DataReductionProxyRequestType request_type);
 
+  // Posts a batch of content lengths from |content_length_batcher_| to the UI
+  // thread to update the daily content length prefs.
+  void StoreContentLength(
+      int received_content_length,
+      int original_content_length,
+      data_reduction_proxy::DataReductionProxyRequestType request_type);
+
   scoped_ptr<ChromeExtensionsNetworkDelegate> extensions_delegate_;
 
   void* profile_;
@@ -242,6 +250,9 @@ class ChromeNetworkDelegate : public net::NetworkDelegate {
   // Total original size of all content before it was transferred.
   int64 original_content_length_;
 
+  // Batches the content lengths of completed requests for the prefs.
+  scoped_ptr<ContentLengthBatcher> content_length_batcher_;
+
   scoped_ptr<ClientHints> client_hints_;
 
   bool first_request_;
@@ -0,0 +1,101 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/net/content_length_batcher.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/logging.h"
+#include "base/time/clock.h"
+#include "base/time/default_clock.h"
+
+namespace {
+
+// How long content lengths are held before they are handed over.
+const int kFlushIntervalSeconds = 30;
+
+// Requests completing this close to the end of a local day are handed over
+// right away, and the flush timer fires before this margin, so that no
+// request is counted for the next day.
+const int kDayEndMarginSeconds = 5;
+
+}  // namespace
+
+ContentLengthBatcher::ContentLengths::ContentLengths()
+    : received(0),
+      original(0) {
+}
+
+ContentLengthBatcher::ContentLengthBatcher(const FlushCallback& flush_callback)
+    : flush_callback_(flush_callback),
+      clock_(new base::DefaultClock()),
+      flush_timer_(new base::Timer(false, false)) {
+}
+
+ContentLengthBatcher::~ContentLengthBatcher() {}
+
+void ContentLengthBatcher::Add(
+    int64 received_content_length,
+    int64 original_content_length,
+    data_reduction_proxy::DataReductionProxyRequestType request_type) {
+  DCHECK_GE(received_content_length, 0);
+  DCHECK_GE(original_content_length, 0);
+  const base::Time now = clock_->Now();
+  const base::Time day = now.LocalMidnight();
+  if (!batches_.empty() && day != batch_day_)
+    Flush();
+  batch_day_ = day;
+
+  ContentLengths* lengths = &batches_[request_type];
+  lengths->received += received_content_length;
+  lengths->original += original_content_length;
+
+  const base::TimeDelta day_end_margin =
+      base::TimeDelta::FromSeconds(kDayEndMarginSeconds);
+  if ((now + day_end_margin).LocalMidnight() != day) {
+    Flush();
+    return;
+  }
+  if (!flush_timer_->IsRunning()) {
+    // Any time 36 hours after a midnight is on the next day, even across a
+    // daylight saving time change.
+    const base::Time next_day =
+        (day + base::TimeDelta::FromHours(36)).LocalMidnight();
+    const base::TimeDelta delay =
+        std::min(base::TimeDelta::FromSeconds(kFlushIntervalSeconds),
+                 next_day - day_end_margin - now);
+    flush_timer_->Start(FROM_HERE,
+                        delay,
+                        base::Bind(&ContentLengthBatcher::Flush,
+                                   base::Unretained(this)));
+  }
+}
+
+void ContentLengthBatcher::Flush() {
+  flush_timer_->Stop();
+  BatchMap batches;
+  batches.swap(batches_);
+  for (BatchMap::iterator it = batches.begin(); it != batches.end(); ++it) {
+    int64 received = it->second.received;
+    int64 original = it->second.original;
+    do {
+      const int received_chunk =
+          static_cast<int>(std::min<int64>(received, kint32max));
+      const int original_chunk =
+          static_cast<int>(std::min<int64>(original, kint32max));
+      flush_callback_.Run(received_chunk, original_chunk, it->first);
+      received -= received_chunk;
+      original -= original_chunk;
+    } while (received > 0 || original > 0);
+  }
+}
+
+void ContentLengthBatcher::SetClockForTesting(scoped_ptr<base::Clock> clock) {
+  clock_ = clock.Pass();
+}
+
+void ContentLengthBatcher::SetTimerForTesting(scoped_ptr<base::Timer> timer) {
+  flush_timer_ = timer.Pass();
+}
@@ -0,0 +1,84 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_NET_CONTENT_LENGTH_BATCHER_H_
+#define CHROME_BROWSER_NET_CONTENT_LENGTH_BATCHER_H_
+
+#include <map>
+
+#include "base/basictypes.h"
+#include "base/callback.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+#include "components/data_reduction_proxy/browser/data_reduction_proxy_metrics.h"
+
+namespace base {
+class Clock;
+}
+
+// Sums up the content lengths of completed requests on the IO thread and
+// hands them to a callback in batches, so that the daily content length prefs
+// are updated every few seconds instead of once per request.
+//
+// A batch only holds requests which completed on the same local day, as the
+// prefs attribute the lengths to the day on which they are updated. A batch
+// is handed over as soon as a request completes on a later day, and in the
+// last seconds of a day every request is handed over right away, and the
+// flush timer always fires before those last seconds, so that the update
+// still happens on the day the request completed.
+class ContentLengthBatcher {
+ public:
+  // Called with the summed content lengths of a request type. Lengths which
+  // do not fit an int are split over several calls.
+  typedef base::Callback<void(
+      int received_content_length,
+      int original_content_length,
+      data_reduction_proxy::DataReductionProxyRequestType request_type)>
+          FlushCallback;
+
+  explicit ContentLengthBatcher(const FlushCallback& flush_callback);
+  ~ContentLengthBatcher();
+
+  // Adds the content lengths of a request which completed now. Starts the
+  // flush timer if it is not running yet.
+  void Add(int64 received_content_length,
+           int64 original_content_length,
+           data_reduction_proxy::DataReductionProxyRequestType request_type);
+
+  // Hands the content lengths added since the last flush to the callback.
+  void Flush();
+
+  // Returns true if there are content lengths waiting for a flush.
+  bool HasPendingContentLength() const { return !batches_.empty(); }
+
+  void SetClockForTesting(scoped_ptr<base::Clock> clock);
+  void SetTimerForTesting(scoped_ptr<base::Timer> timer);
+
+ private:
+  struct ContentLengths {
+    ContentLengths();
+
+    int64 received;
+    int64 original;
+  };
+  typedef std::map<data_reduction_proxy::DataReductionProxyRequestType,
+                   ContentLengths> BatchMap;
+
+  FlushCallback flush_callback_;
+  scoped_ptr<base::Clock> clock_;
+
+  // The content lengths added since the last flush, and the local midnight
+  // starting the day on which they were added.
+  BatchMap batches_;
+  base::Time batch_day_;
+
+  // Flushes the batch once it is kFlushIntervalSeconds old, or right before
+  // the day ends, whichever comes first.
+  scoped_ptr<base::Timer> flush_timer_;
+
+  DISALLOW_COPY_AND_ASSIGN(ContentLengthBatcher);
+};
+
+#endif  // CHROME_BROWSER_NET_CONTENT_LENGTH_BATCHER_H_
@@ -0,0 +1,168 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/net/content_length_batcher.h"
+
+#include <vector>
+
+#include "base/bind.h"
+#include "base/message_loop/message_loop.h"
+#include "base/test/simple_test_clock.h"
+#include "base/time/time.h"
+#include "base/timer/mock_timer.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using data_reduction_proxy::DataReductionProxyRequestType;
+
+namespace {
+
+struct FlushedContentLength {
+  int received;
+  int original;
+  DataReductionProxyRequestType request_type;
+};
+
+// Returns the local time |hour|:|minute|:|second| on 2014-06-10.
+base::Time LocalTime(int hour, int minute, int second) {
+  base::Time::Exploded exploded = { 2014, 6, 2, 10, hour, minute, second, 0 };
+  return base::Time::FromLocalExploded(exploded);
+}
+
+}  // namespace
+
+class ContentLengthBatcherTest : public testing::Test {
+ protected:
+  ContentLengthBatcherTest()
+      : clock_(new base::SimpleTestClock()),
+        timer_(new base::MockTimer(false, false)),
+        batcher_(base::Bind(&ContentLengthBatcherTest::OnFlush,
+                            base::Unretained(this))) {
+    batcher_.SetClockForTesting(scoped_ptr<base::Clock>(clock_));
+    batcher_.SetTimerForTesting(scoped_ptr<base::Timer>(timer_));
+    clock_->SetNow(LocalTime(12, 0, 0));
+  }
+
+  void OnFlush(int received,
+               int original,
+               DataReductionProxyRequestType request_type) {
+    FlushedContentLength flushed = { received, original, request_type };
+    flushed_.push_back(flushed);
+  }
+
+  base::MessageLoopForIO message_loop_;
+  // Owned by |batcher_|.
+  base::SimpleTestClock* clock_;
+  base::MockTimer* timer_;
+  ContentLengthBatcher batcher_;
+  std::vector<FlushedContentLength> flushed_;
+};
+
+// Tests that many completions are handed over as one update per request
+// type, with nothing lost.
+TEST_F(ContentLengthBatcherTest, BatchesCompletions) {
+  const int kCompletions = 100000;
+  for (int i = 0; i < kCompletions; ++i) {
+    batcher_.Add(100, i % 2 ? 300 : 100,
+                 i % 2 ? data_reduction_proxy::VIA_DATA_REDUCTION_PROXY
+                       : data_reduction_proxy::HTTPS);
+  }
+  EXPECT_TRUE(flushed_.empty());
+  EXPECT_TRUE(batcher_.HasPendingContentLength());
+
+  batcher_.Flush();
+  EXPECT_FALSE(batcher_.HasPendingContentLength());
+  ASSERT_EQ(2U, flushed_.size());
+  int64 received = 0;
+  int64 original = 0;
+  for (size_t i = 0; i < flushed_.size(); ++i) {
+    received += flushed_[i].received;
+    original += flushed_[i].original;
+    if (flushed_[i].request_type == data_reduction_proxy::HTTPS)
+      EXPECT_EQ(flushed_[i].received, flushed_[i].original);
+  }
+  EXPECT_EQ(100 * kCompletions, received);
+  EXPECT_EQ(200 * kCompletions, original);
+
+  // Nothing is handed over twice.
+  batcher_.Flush();
+  EXPECT_EQ(2U, flushed_.size());
+}
+
+// Tests that content lengths from an earlier day are handed over before any
+// from a later day are added.
+TEST_F(ContentLengthBatcherTest, FlushesOnNewDay) {
+  clock_->SetNow(LocalTime(23, 0, 0));
+  batcher_.Add(100, 200, data_reduction_proxy::HTTPS);
+  EXPECT_TRUE(flushed_.empty());
+
+  clock_->Advance(base::TimeDelta::FromHours(2));
+  batcher_.Add(10, 20, data_reduction_proxy::HTTPS);
+  ASSERT_EQ(1U, flushed_.size());
+  EXPECT_EQ(100, flushed_[0].received);
+  EXPECT_EQ(200, flushed_[0].original);
+
+  batcher_.Flush();
+  ASSERT_EQ(2U, flushed_.size());
+  EXPECT_EQ(10, flushed_[1].received);
+  EXPECT_EQ(20, flushed_[1].original);
+}
+
+// Tests that requests completing right before midnight are not held.
+TEST_F(ContentLengthBatcherTest, FlushesAtEndOfDay) {
+  clock_->SetNow(LocalTime(23, 59, 0));
+  batcher_.Add(100, 200, data_reduction_proxy::HTTPS);
+  EXPECT_TRUE(flushed_.empty());
+
+  clock_->SetNow(LocalTime(23, 59, 58));
+  batcher_.Add(10, 20, data_reduction_proxy::HTTPS);
+  ASSERT_EQ(1U, flushed_.size());
+  EXPECT_EQ(110, flushed_[0].received);
+  EXPECT_EQ(220, flushed_[0].original);
+  EXPECT_FALSE(batcher_.HasPendingContentLength());
+}
+
+// Tests that a batch opened shortly before midnight is flushed by the timer
+// before the day ends.
+TEST_F(ContentLengthBatcherTest, TimerFlushesBeforeMidnight) {
+  clock_->SetNow(LocalTime(23, 59, 40));
+  const base::Time midnight =
+      (clock_->Now() + base::TimeDelta::FromHours(1)).LocalMidnight();
+  batcher_.Add(100, 200, data_reduction_proxy::HTTPS);
+  EXPECT_TRUE(flushed_.empty());
+  ASSERT_TRUE(timer_->IsRunning());
+
+  clock_->Advance(timer_->GetCurrentDelay());
+  timer_->Fire();
+  ASSERT_EQ(1U, flushed_.size());
+  EXPECT_EQ(100, flushed_[0].received);
+  EXPECT_EQ(200, flushed_[0].original);
+  EXPECT_LT(clock_->Now(), midnight);
+  EXPECT_FALSE(batcher_.HasPendingContentLength());
+}
+
+// Tests that the timer flushes a batch after the usual interval during the
+// day.
+TEST_F(ContentLengthBatcherTest, TimerFlushesAfterInterval) {
+  batcher_.Add(100, 200, data_reduction_proxy::HTTPS);
+  ASSERT_TRUE(timer_->IsRunning());
+  EXPECT_EQ(base::TimeDelta::FromSeconds(30), timer_->GetCurrentDelay());
+
+  timer_->Fire();
+  EXPECT_EQ(1U, flushed_.size());
+  EXPECT_FALSE(timer_->IsRunning());
+}
+
+// Tests that totals which do not fit an int are split over several updates.
+TEST_F(ContentLengthBatcherTest, SplitsLargeTotals) {
+  const int64 kLength = 1024 * 1024 * 1024;
+  for (int i = 0; i < 3; ++i)
+    batcher_.Add(kLength, kLength / 2, data_reduction_proxy::HTTPS);
+  batcher_.Flush();
+
+  ASSERT_EQ(2U, flushed_.size());
+  EXPECT_EQ(3 * kLength,
+            static_cast<int64>(flushed_[0].received) + flushed_[1].received);
+  EXPECT_EQ(3 * kLength / 2,
+            static_cast<int64>(flushed_[0].original) + flushed_[1].original);
+}
@@ -400,6 +400,34 @@ bool OmniboxFieldTrial::HQPAllowMatchInSchemeValue() {
       kHQPAllowMatchInSchemeRule) == "true";
 }
 
+bool OmniboxFieldTrial::HQPUsePostingListsValue() {
+  return chrome_variations::GetVariationParamValue(
+      kBundledExperimentFieldTrialName,
+      kHQPUsePostingListsRule) == "true";
+}
+
+bool OmniboxFieldTrial::HQPUseMappedCacheValue() {
+  return chrome_variations::GetVariationParamValue(
+      kBundledExperimentFieldTrialName,
+      kHQPUseMappedCacheRule) == "true";
+}
+
+size_t OmniboxFieldTrial::HQPIntersectionCacheBytesValue() {
+  std::string cache_bytes_str = chrome_variations::GetVariationParamValue(
+      kBundledExperimentFieldTrialName, kHQPIntersectionCacheBytesRule);
+  size_t cache_bytes;
+  if (cache_bytes_str.empty() ||
+      !base::StringToSizeT(cache_bytes_str, &cache_bytes))
+    return 0;
+  return cache_bytes;
+}
+
+bool OmniboxFieldTrial::HQPChunkedScoringValue() {
+  return chrome_variations::GetVariationParamValue(
+      kBundledExperimentFieldTrialName,
+      kHQPChunkedScoringRule) == "true";
+}
+
 bool OmniboxFieldTrial::BookmarksIndexURLsValue() {
   return chrome_variations::GetVariationParamValue(
       kBundledExperimentFieldTrialName,
@@ -441,6 +469,12 @@ const char OmniboxFieldTrial::kHQPBookmarkValueRule[] =
 const char OmniboxFieldTrial::kHQPAllowMatchInTLDRule[] = "HQPAllowMatchInTLD";
 const char OmniboxFieldTrial::kHQPAllowMatchInSchemeRule[] =
     "HQPAllowMatchInScheme";
+const char OmniboxFieldTrial::kHQPUsePostingListsRule[] =
+    "HQPUsePostingLists";
+const char OmniboxFieldTrial::kHQPUseMappedCacheRule[] = "HQPUseMappedCache";
+const char OmniboxFieldTrial::kHQPIntersectionCacheBytesRule[] =
+    "HQPIntersectionCacheBytes";
+const char OmniboxFieldTrial::kHQPChunkedScoringRule[] = "HQPChunkedScoring";
 const char OmniboxFieldTrial::kZeroSuggestRule[] = "ZeroSuggest";
 const char OmniboxFieldTrial::kZeroSuggestVariantRule[] = "ZeroSuggestVariant";
 const char OmniboxFieldTrial::kBookmarksIndexURLsRule[] = "BookmarksIndexURLs";
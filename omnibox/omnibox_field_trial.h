@@ -262,6 +262,45 @@ class OmniboxFieldTrial {
   // match in scheme experiment isn't active.
   static bool HQPAllowMatchInSchemeValue();
 
+  // ---------------------------------------------------------
+  // For the HQPUsePostingLists experiment that's part of the
+  // bundled omnibox field trial.
+
+  // Returns true if the HistoryQuick provider's index should store its
+  // char/word and word/history mappings as sorted vectors (see
+  // history::URLIndexPostingLists) rather than as maps of sets.  Returns
+  // false if the posting lists experiment isn't active.
+  static bool HQPUsePostingListsValue();
+
+  // ---------------------------------------------------------
+  // For the HQPUseMappedCache experiment that's part of the
+  // bundled omnibox field trial.
+
+  // Returns true if the HistoryQuick provider's index should be saved as,
+  // and restored from, a memory-mapped cache file (see
+  // history::URLIndexMappedCache) rather than a protocol buffer.  Returns
+  // false if the mapped cache experiment isn't active.
+  static bool HQPUseMappedCacheValue();
+
+  // ---------------------------------------------------------
+  // For the HQPIntersectionCacheBytes experiment that's part of the
+  // bundled omnibox field trial.
+
+  // Returns the number of bytes of candidate lists the HistoryQuick
+  // provider's index may keep in its intersection cache (see
+  // history::URLIndexIntersectionCache).  Returns 0, meaning no cache, if the
+  // intersection cache experiment isn't active.
+  static size_t HQPIntersectionCacheBytesValue();
+
+  // ---------------------------------------------------------
+  // For the HQPChunkedScoring experiment that's part of the
+  // bundled omnibox field trial.
+
+  // Returns true if the HistoryQuick provider's index should score large
+  // candidate pools in chunks, keeping only the best matches seen so far.
+  // Returns false if the chunked scoring experiment isn't active.
+  static bool HQPChunkedScoringValue();
+
   // ---------------------------------------------------------
   // For the BookmarksIndexURLs experiment that's part of the
   // bundled omnibox field trial.
@@ -323,6 +362,10 @@ class OmniboxFieldTrial {
   static const char kHQPDiscountFrecencyWhenFewVisitsRule[];
   static const char kHQPAllowMatchInTLDRule[];
   static const char kHQPAllowMatchInSchemeRule[];
+  static const char kHQPUsePostingListsRule[];
+  static const char kHQPUseMappedCacheRule[];
+  static const char kHQPIntersectionCacheBytesRule[];
+  static const char kHQPChunkedScoringRule[];
   static const char kZeroSuggestRule[];
   static const char kZeroSuggestVariantRule[];
   static const char kBookmarksIndexURLsRule[];
@@ -30,6 +30,8 @@ const char kEventDb[] = "Events";
 const char kStateDb[] = "Configuration";
 const char kActiveIntervalDb[] = "Active Interval";
 const char kMetricDb[] = "Metrics";
+const char kMetricSeriesDb[] = "Metric Series";
+const char kMetricRollupDb[] = "Metric Rollups";
 const double kDefaultMaxValue = 0.0;
 
 // If the db is quiet for this number of minutes, then it is considered down.
@@ -54,6 +56,12 @@ double StringToDouble(const std::string& s) {
   return value;
 }
 
+base::Time KeyTimeToTime(const std::string& key_time) {
+  int64 time = 0;
+  base::StringToInt64(key_time, &time);
+  return base::Time::FromInternalValue(time);
+}
+
 // Returns an event from the given JSON string; the scoped_ptr will be NULL if
 // we are unable to properly parse the JSON.
 scoped_ptr<Event> EventFromJSON(const std::string& data) {
@@ -87,6 +95,12 @@ base::Time Database::SystemClock::GetTime() {
 
 // Static
 scoped_ptr<Database> Database::Create(base::FilePath path) {
+  return Create(path, METRIC_STORAGE_ROWS);
+}
+
+// Static
+scoped_ptr<Database> Database::Create(base::FilePath path,
+                                      MetricStorage metric_storage) {
   CHECK(!content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
   if (path.empty()) {
     CHECK(PathService::Get(chrome::DIR_USER_DATA, &path));
@@ -95,7 +109,7 @@ scoped_ptr<Database> Database::Create(base::FilePath path) {
   scoped_ptr<Database> database;
   if (!base::DirectoryExists(path) && !base::CreateDirectory(path))
     return database.Pass();
-  database.reset(new Database(path));
+  database.reset(new Database(path, metric_storage));
 
   // If the database did not initialize correctly, return a NULL scoped_ptr.
   if (!database->valid_)
@@ -234,12 +248,71 @@ bool Database::AddMetric(const std::string& activity,
   recent_map_[recent_map_key] = recent_key;
   leveldb::Status recent_status =
       recent_db_->Put(write_options_, recent_key, metric.ValueAsString());
-  leveldb::Status metric_status =
-      metric_db_->Put(write_options_, metric_key, metric.ValueAsString());
+  bool metric_success = false;
+  if (metric_storage_ == METRIC_STORAGE_SERIES) {
+    metric_success = AddMetricToSeries(activity, metric);
+  } else {
+    std::string value = metric.ValueAsString();
+    metric_bytes_written_ += metric_key.size() + value.size();
+    metric_success = metric_db_->Put(write_options_, metric_key, value).ok();
+  }
 
   bool max_value_success =
       UpdateMaxValue(activity, metric.type, metric.ValueAsString());
-  return recent_status.ok() && metric_status.ok() && max_value_success;
+  return recent_status.ok() && metric_success && max_value_success;
+}
+
+bool Database::AddMetricToSeries(const std::string& activity,
+                                 const Metric& metric) {
+  std::string series_key =
+      key_builder_->CreateRecentMapKey(metric.type, activity);
+  linked_ptr<OpenSeriesBlock>& open_block = open_blocks_[series_key];
+  if (!open_block.get() || !open_block->block.CanAppend(metric.time)) {
+    open_block.reset(new OpenSeriesBlock);
+    open_block->key =
+        key_builder_->CreateMetricKey(metric.time, metric.type, activity);
+  }
+  open_block->block.Append(metric.time, metric.value);
+  metric_bytes_written_ +=
+      open_block->key.size() + open_block->block.data().size();
+  leveldb::Status metric_status = metric_db_->Put(
+      write_options_, open_block->key, open_block->block.data());
+
+  leveldb::WriteBatch rollups;
+  for (int i = 0; i < ROLLUP_NUMBER_OF_RESOLUTIONS; ++i) {
+    UpdateRollup(series_key, activity, metric,
+                 static_cast<MetricRollupResolution>(i), &rollups);
+  }
+  leveldb::Status rollup_status = rollup_db_->Write(write_options_, &rollups);
+  return metric_status.ok() && rollup_status.ok();
+}
+
+void Database::UpdateRollup(const std::string& series_key,
+                            const std::string& activity,
+                            const Metric& metric,
+                            MetricRollupResolution resolution,
+                            leveldb::WriteBatch* batch) {
+  base::Time bucket_start = GetRollupBucketStart(resolution, metric.time);
+  std::string rollup_key = key_builder_->CreateRollupKey(
+      resolution, bucket_start, metric.type, activity);
+  OpenRollup& open_rollup =
+      open_rollups_[series_key + static_cast<char>('0' + resolution)];
+  if (open_rollup.key != rollup_key) {
+    // Moving to another bucket; it has data already if the database was
+    // reopened, or if |metric| is older than the previous metric.
+    open_rollup.key = rollup_key;
+    open_rollup.rollup = MetricRollup(bucket_start);
+    std::string value;
+    if (rollup_db_->Get(read_options_, rollup_key, &value).ok() &&
+        !open_rollup.rollup.Decode(value)) {
+      LOG(ERROR) << "Found bad rollup in the database. Replacing it.";
+      open_rollup.rollup = MetricRollup(bucket_start);
+    }
+  }
+  open_rollup.rollup.AddValue(metric.value);
+  std::string value = open_rollup.rollup.Encode();
+  metric_bytes_written_ += rollup_key.size() + value.size();
+  batch->Put(rollup_key, value);
 }
 
 bool Database::UpdateMaxValue(const std::string& activity,
@@ -295,6 +368,13 @@ Database::MetricTypeSet Database::GetActiveMetrics(const base::Time& start,
   for (possible_it = possible_metrics.begin();
        possible_it != possible_metrics.end();
        ++possible_it) {
+    if (metric_storage_ == METRIC_STORAGE_SERIES) {
+      MetricVectorMap stats;
+      GetSeriesStats(*possible_it, NULL, start, end, &stats);
+      if (!stats.empty())
+        active_metrics.insert(*possible_it);
+      continue;
+    }
     std::string metric_start_key =
         key_builder_->CreateMetricKey(start, *possible_it,std::string());
     std::string metric_end_key =
@@ -360,6 +440,17 @@ scoped_ptr<Database::MetricVector> Database::GetStatsForActivityAndMetric(
     const base::Time& start,
     const base::Time& end) {
   CHECK(!content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
+  if (metric_storage_ == METRIC_STORAGE_SERIES) {
+    MetricVectorMap stats;
+    GetSeriesStats(metric_type, &activity, start, end, &stats);
+    MetricVectorMap::iterator it = stats.find(activity);
+    if (it == stats.end())
+      return make_scoped_ptr(new MetricVector());
+    scoped_ptr<MetricVector> results(new MetricVector());
+    results->swap(*it->second);
+    return results.Pass();
+  }
+
   scoped_ptr<MetricVector> results(new MetricVector());
   std::string start_key =
       key_builder_->CreateMetricKey(start, metric_type, activity);
@@ -395,6 +486,11 @@ Database::MetricVectorMap Database::GetStatsForMetricByActivity(
     const base::Time& end) {
   CHECK(!content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
   MetricVectorMap results;
+  if (metric_storage_ == METRIC_STORAGE_SERIES) {
+    GetSeriesStats(metric_type, NULL, start, end, &results);
+    return results;
+  }
+
   std::string start_key =
       key_builder_->CreateMetricKey(start, metric_type, std::string());
   std::string end_key =
@@ -424,11 +520,111 @@ Database::MetricVectorMap Database::GetStatsForMetricByActivity(
   return results;
 }
 
-Database::Database(const base::FilePath& path)
+scoped_ptr<Database::MetricRollupVector>
+Database::GetRollupsForActivityAndMetric(const std::string& activity,
+                                         MetricType metric_type,
+                                         MetricRollupResolution resolution,
+                                         const base::Time& start,
+                                         const base::Time& end) {
+  CHECK(!content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
+  scoped_ptr<MetricRollupVector> results(new MetricRollupVector());
+  if (end < start)
+    return results.Pass();
+  base::Time first_bucket_start = GetRollupBucketStart(resolution, start);
+  base::Time last_bucket_start = GetRollupBucketStart(resolution, end);
+
+  if (metric_storage_ == METRIC_STORAGE_ROWS) {
+    // Aggregate the samples of every bucket in the range.
+    base::Time last_bucket_end = last_bucket_start +
+        GetRollupBucketDuration(resolution) -
+        base::TimeDelta::FromMicroseconds(1);
+    scoped_ptr<MetricVector> stats = GetStatsForActivityAndMetric(
+        activity, metric_type, first_bucket_start, last_bucket_end);
+    for (MetricVector::const_iterator it = stats->begin();
+         it != stats->end(); ++it) {
+      base::Time bucket_start = GetRollupBucketStart(resolution, it->time);
+      if (results->empty() || results->back().start != bucket_start)
+        results->push_back(MetricRollup(bucket_start));
+      results->back().AddValue(it->value);
+    }
+    return results.Pass();
+  }
+
+  std::string start_key = key_builder_->CreateRollupKey(
+      resolution, first_bucket_start, metric_type, std::string());
+  std::string end_key = key_builder_->CreateRollupKey(
+      resolution, last_bucket_start, metric_type, activity);
+  leveldb::WriteBatch invalid_entries;
+  scoped_ptr<leveldb::Iterator> it(rollup_db_->NewIterator(read_options_));
+  for (it->Seek(start_key);
+       it->Valid() && it->key().ToString() <= end_key;
+       it->Next()) {
+    RollupKey split_key = key_builder_->SplitRollupKey(it->key().ToString());
+    if (split_key.activity != activity)
+      continue;
+    MetricRollup rollup(KeyTimeToTime(split_key.time));
+    if (!rollup.Decode(it->value().ToString())) {
+      invalid_entries.Delete(it->key());
+      LOG(ERROR) << "Found bad rollup in the database. Erasing it.";
+      continue;
+    }
+    results->push_back(rollup);
+  }
+  rollup_db_->Write(write_options_, &invalid_entries);
+  return results.Pass();
+}
+
+void Database::GetSeriesStats(MetricType metric_type,
+                              const std::string* activity,
+                              const base::Time& start,
+                              const base::Time& end,
+                              MetricVectorMap* results) {
+  // A block starts at most an hour before the samples it holds.
+  base::Time first_block_start =
+      GetRollupBucketStart(ROLLUP_HOUR, start) - base::TimeDelta::FromHours(1);
+  if (first_block_start < base::Time())
+    first_block_start = base::Time();
+  std::string start_key = key_builder_->CreateMetricKey(
+      first_block_start, metric_type, std::string());
+  // Any key of a block starting at or before |end| sorts before this one.
+  std::string end_key = key_builder_->CreateMetricKey(
+      end + base::TimeDelta::FromMicroseconds(1), metric_type, std::string());
+
+  leveldb::WriteBatch invalid_entries;
+  MetricSeriesBlock block;
+  scoped_ptr<leveldb::Iterator> it(metric_db_->NewIterator(read_options_));
+  for (it->Seek(start_key);
+       it->Valid() && it->key().ToString() < end_key;
+       it->Next()) {
+    MetricKey split_key = key_builder_->SplitMetricKey(it->key().ToString());
+    if (activity && split_key.activity != *activity)
+      continue;
+    if (!block.Parse(it->value().ToString())) {
+      invalid_entries.Delete(it->key());
+      LOG(ERROR) << "Found bad metric block in the database. Type: "
+                 << metric_type << ", Time: " << split_key.time
+                 << ". Erasing it from the database.";
+      continue;
+    }
+    MetricVector samples;
+    block.GetSamples(metric_type, start, end, &samples);
+    if (samples.empty())
+      continue;
+    linked_ptr<MetricVector>& stats = (*results)[split_key.activity];
+    if (!stats.get())
+      stats.reset(new MetricVector());
+    stats->insert(stats->end(), samples.begin(), samples.end());
+  }
+  metric_db_->Write(write_options_, &invalid_entries);
+}
+
+Database::Database(const base::FilePath& path, MetricStorage metric_storage)
     : key_builder_(new KeyBuilder()),
       path_(path),
       read_options_(leveldb::ReadOptions()),
       write_options_(leveldb::WriteOptions()),
+      metric_storage_(metric_storage),
+      metric_bytes_written_(0),
       valid_(false) {
   if (!InitDBs())
     return;
@@ -460,12 +656,23 @@ bool Database::InitDBs() {
   active_interval_db_ = SafelyOpenDatabase(open_options,
                                            kActiveIntervalDb,
                                            true);  // fix if damaged
-  metric_db_ = SafelyOpenDatabase(open_options,
-                                  kMetricDb,
-                                  true);  // fix if damaged
   event_db_ = SafelyOpenDatabase(open_options,
                                  kEventDb,
                                  true);  // fix if damaged
+  if (metric_storage_ == METRIC_STORAGE_SERIES) {
+    metric_db_ = SafelyOpenDatabase(open_options,
+                                    kMetricSeriesDb,
+                                    true);  // fix if damaged
+    rollup_db_ = SafelyOpenDatabase(open_options,
+                                    kMetricRollupDb,
+                                    true);  // fix if damaged
+    if (!rollup_db_)
+      return false;
+  } else {
+    metric_db_ = SafelyOpenDatabase(open_options,
+                                    kMetricDb,
+                                    true);  // fix if damaged
+  }
   return recent_db_ && max_value_db_ && state_db_ &&
          active_interval_db_ && metric_db_ && event_db_;
 }
@@ -538,6 +745,9 @@ scoped_ptr<leveldb::DB> Database::SafelyOpenDatabase(
 bool Database::Close() {
   CHECK(!content::BrowserThread::CurrentlyOn(content::BrowserThread::UI));
   metric_db_.reset();
+  rollup_db_.reset();
+  open_blocks_.clear();
+  open_rollups_.clear();
   event_db_.reset();
   recent_db_.reset();
   max_value_db_.reset();
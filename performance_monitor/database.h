@@ -17,8 +17,13 @@
 #include "chrome/browser/performance_monitor/constants.h"
 #include "chrome/browser/performance_monitor/event.h"
 #include "chrome/browser/performance_monitor/metric.h"
+#include "chrome/browser/performance_monitor/metric_series.h"
 #include "third_party/leveldatabase/src/include/leveldb/db.h"
 
+namespace leveldb {
+class WriteBatch;
+}
+
 namespace performance_monitor {
 
 struct TimeRange {
@@ -96,6 +101,27 @@ class DatabaseTestHelper;
 // interval.
 // Key: Metric - Time - Activity
 // Value: Statistic
+//
+// The Metric DB above is used with METRIC_STORAGE_ROWS. With
+// METRIC_STORAGE_SERIES the samples are instead stored as time series, with
+// rollups of them, in the following two databases:
+//
+// Metric Series DB:
+// Stores the statistics in blocks of up to one clock hour of consecutive
+// samples for a (metric, activity) pair, compressed as described in
+// MetricSeriesBlock. |open_blocks_| keeps the block being filled for each pair;
+// it is rewritten on every insert. A query reads one block per hour of the
+// time range, starting with the hour before it, as that block may hold samples
+// within the range.
+// Key: Metric - Time of first sample - Activity
+// Value: MetricSeriesBlock
+//
+// Metric Rollup DB:
+// Stores the minimum, maximum and mean of the statistics per minute and per
+// hour, updated on every insert. Queries over weeks read these rather than
+// every sample.
+// Key: Metric - Resolution - Start of bucket - Activity
+// Value: MetricRollup
 class Database {
  public:
   typedef std::set<EventType> EventTypeSet;
@@ -103,6 +129,15 @@ class Database {
   typedef std::set<MetricType> MetricTypeSet;
   typedef std::vector<Metric> MetricVector;
   typedef std::map<std::string, linked_ptr<MetricVector> > MetricVectorMap;
+  typedef std::vector<MetricRollup> MetricRollupVector;
+
+  // How the metric samples are stored; see the class comment. Databases in
+  // the two modes keep their samples apart, so reopening a database in the
+  // other mode does not see the samples written before.
+  enum MetricStorage {
+    METRIC_STORAGE_ROWS,
+    METRIC_STORAGE_SERIES
+  };
 
   static const char kDatabaseSequenceToken[];
 
@@ -118,6 +153,8 @@ class Database {
   virtual ~Database();
 
   static scoped_ptr<Database> Create(base::FilePath path);
+  static scoped_ptr<Database> Create(base::FilePath path,
+                                     MetricStorage metric_storage);
 
   // A "state" value is anything that can only have one value at a time, and
   // usually describes the state of the browser eg. version.
@@ -224,6 +261,27 @@ class Database {
         metric_type, base::Time(), clock_->GetTime());
   }
 
+  // Returns the rollups at |resolution| of the given |metric_type| and
+  // |activity|, for the buckets which start between the start of the bucket
+  // containing |start| and |end|. The first and last rollups may include
+  // samples outside of the time range. With METRIC_STORAGE_ROWS the rollups
+  // are computed from the samples.
+  scoped_ptr<MetricRollupVector> GetRollupsForActivityAndMetric(
+      const std::string& activity,
+      MetricType metric_type,
+      MetricRollupResolution resolution,
+      const base::Time& start,
+      const base::Time& end);
+
+  scoped_ptr<MetricRollupVector> GetRollupsForActivityAndMetric(
+      MetricType metric_type,
+      MetricRollupResolution resolution,
+      const base::Time& start,
+      const base::Time& end) {
+    return GetRollupsForActivityAndMetric(kProcessChromeAggregate, metric_type,
+                                          resolution, start, end);
+  }
+
   // Returns the active time intervals that overlap with the time interval
   // defined by |start| and |end|.
   std::vector<TimeRange> GetActiveIntervals(const base::Time& start,
@@ -231,6 +289,13 @@ class Database {
 
   base::FilePath path() const { return path_; }
 
+  MetricStorage metric_storage() const { return metric_storage_; }
+
+  // The number of bytes of keys and values written to store metric samples
+  // (and their rollups) since the database was opened. The recent and max
+  // value databases, which are the same in both modes, are not counted.
+  int64 metric_bytes_written() const { return metric_bytes_written_; }
+
   void set_clock(scoped_ptr<Clock> clock) {
     clock_ = clock.Pass();
   }
@@ -241,6 +306,23 @@ class Database {
   typedef std::map<std::string, std::string> RecentMap;
   typedef std::map<std::string, double> MaxValueMap;
 
+  // The block of the Metric Series DB being filled for a (metric, activity)
+  // pair, and its key.
+  struct OpenSeriesBlock {
+    std::string key;
+    MetricSeriesBlock block;
+  };
+  typedef std::map<std::string, linked_ptr<OpenSeriesBlock> >
+      OpenSeriesBlockMap;
+
+  // The rollup of the Metric Rollup DB being updated for a (metric, activity)
+  // pair at one resolution, and its key.
+  struct OpenRollup {
+    std::string key;
+    MetricRollup rollup;
+  };
+  typedef std::map<std::string, OpenRollup> OpenRollupMap;
+
   // By default, the database uses a clock that simply returns the current time.
   class SystemClock : public Clock {
    public:
@@ -249,7 +331,7 @@ class Database {
     virtual base::Time GetTime() OVERRIDE;
   };
 
-  explicit Database(const base::FilePath& path);
+  Database(const base::FilePath& path, MetricStorage metric_storage);
 
   bool InitDBs();
 
@@ -276,6 +358,26 @@ class Database {
                       MetricType metric,
                       const std::string& value);
 
+  // Appends |metric| to the open block of its series, and updates its rollups.
+  bool AddMetricToSeries(const std::string& activity, const Metric& metric);
+
+  // Adds |metric| to the rollup at |resolution| in |batch|. |series_key|
+  // identifies the (metric, activity) pair.
+  void UpdateRollup(const std::string& series_key,
+                    const std::string& activity,
+                    const Metric& metric,
+                    MetricRollupResolution resolution,
+                    leveldb::WriteBatch* batch);
+
+  // Adds the samples of |metric_type| taken between |start| and |end| in the
+  // Metric Series DB to |results|, keyed by activity. Only the samples of
+  // |activity| are added if it is not NULL.
+  void GetSeriesStats(MetricType metric_type,
+                      const std::string* activity,
+                      const base::Time& start,
+                      const base::Time& end,
+                      MetricVectorMap* results);
+
   scoped_ptr<KeyBuilder> key_builder_;
 
   // A mapping of id,metric to the last inserted key for those parameters
@@ -285,6 +387,9 @@ class Database {
 
   MaxValueMap max_value_map_;
 
+  OpenSeriesBlockMap open_blocks_;
+  OpenRollupMap open_rollups_;
+
   // The directory where all the databases will reside.
   base::FilePath path_;
 
@@ -304,13 +409,21 @@ class Database {
 
   scoped_ptr<leveldb::DB> active_interval_db_;
 
+  // The Metric DB or, with METRIC_STORAGE_SERIES, the Metric Series DB.
   scoped_ptr<leveldb::DB> metric_db_;
 
+  // Only opened with METRIC_STORAGE_SERIES.
+  scoped_ptr<leveldb::DB> rollup_db_;
+
   scoped_ptr<leveldb::DB> event_db_;
 
   leveldb::ReadOptions read_options_;
   leveldb::WriteOptions write_options_;
 
+  const MetricStorage metric_storage_;
+
+  int64 metric_bytes_written_;
+
   // Indicates whether or not the database successfully initialized. If false,
   // the Create() call will return NULL.
   bool valid_;
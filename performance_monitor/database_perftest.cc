@@ -0,0 +1,169 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+
+#include "base/file_util.h"
+#include "base/files/file_path.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/memory/scoped_ptr.h"
+#include "base/time/time.h"
+#include "chrome/browser/performance_monitor/database.h"
+#include "chrome/browser/performance_monitor/metric.h"
+#include "chrome/browser/test/base/synthetic_random.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+namespace performance_monitor {
+
+namespace {
+
+// PerformanceMonitor gathers its metrics every two minutes; simulate four
+// weeks of them.
+const int kSampleIntervalMinutes = 2;
+const int kDays = 28;
+
+const MetricType kMetricTypes[] = {
+  METRIC_CPU_USAGE,
+  METRIC_PRIVATE_MEMORY_USAGE,
+  METRIC_SHARED_MEMORY_USAGE
+};
+
+// The size of a sample without any overhead: its time and its value.
+const double kRawSampleBytes = sizeof(int64) + sizeof(double);
+
+// A clock that returns the time it is set to.
+class SettableClock : public Database::Clock {
+ public:
+  SettableClock() {}
+  virtual ~SettableClock() {}
+
+  virtual base::Time GetTime() OVERRIDE { return time_; }
+
+  void set_time(const base::Time& time) { time_ = time; }
+
+ private:
+  base::Time time_;
+
+  DISALLOW_COPY_AND_ASSIGN(SettableClock);
+};
+
+}  // namespace
+
+class PerformanceMonitorDatabasePerfTest : public testing::Test {
+ public:
+  PerformanceMonitorDatabasePerfTest() {}
+
+  virtual void SetUp() OVERRIDE {
+    ASSERT_TRUE(database_dir_.CreateUniqueTempDir());
+    start_ = base::Time::Now() - base::TimeDelta::FromDays(kDays);
+  }
+
+ protected:
+  // Writes kDays of samples of every metric in kMetricTypes to a database
+  // using |metric_storage|, and reports how long it took and how much was
+  // written.
+  void RunTest(Database::MetricStorage metric_storage,
+               const std::string& trace) {
+    const base::FilePath path = database_dir_.path().AppendASCII(trace);
+    scoped_ptr<Database> database = Database::Create(path, metric_storage);
+    ASSERT_TRUE(database.get());
+    SettableClock* clock = new SettableClock;
+    database->set_clock(scoped_ptr<Database::Clock>(clock));
+
+    // CPU usage varies from sample to sample, while memory usage changes
+    // rarely and then by whole pages.
+    SyntheticRandom random(1);
+    double private_memory = 100 * 1024 * 1024;
+    double shared_memory = 20 * 1024 * 1024;
+    const base::TimeDelta interval =
+        base::TimeDelta::FromMinutes(kSampleIntervalMinutes);
+    const base::Time end = start_ + base::TimeDelta::FromDays(kDays);
+    int num_samples = 0;
+    const base::TimeTicks write_start = base::TimeTicks::HighResNow();
+    for (base::Time time = start_; time < end; time += interval) {
+      clock->set_time(time);
+      if (random.Next() % 8 == 0)
+        private_memory += 4096 * (static_cast<int>(random.Next() % 64) - 32);
+      if (random.Next() % 32 == 0)
+        shared_memory += 4096 * (static_cast<int>(random.Next() % 16) - 8);
+      const double values[] = {
+        (random.Next() % 10000) / 100.0,
+        private_memory,
+        shared_memory
+      };
+      for (size_t i = 0; i < arraysize(kMetricTypes); ++i) {
+        ASSERT_TRUE(database->AddMetric(
+            Metric(kMetricTypes[i], time, values[i])));
+        ++num_samples;
+      }
+    }
+    const base::TimeDelta write_time =
+        base::TimeTicks::HighResNow() - write_start;
+
+    const double amplification =
+        database->metric_bytes_written() / (num_samples * kRawSampleBytes);
+    perf_test::PrintResult("performance_monitor_db_write", "", trace,
+                           write_time.InMillisecondsF(), "ms", true);
+    perf_test::PrintResult("performance_monitor_db_write_amplification", "",
+                           trace, amplification, "x", true);
+
+    MeasureQueries(database.get(), end, trace);
+    database.reset();
+    perf_test::PrintResult("performance_monitor_db_disk_usage", "", trace,
+                           base::ComputeDirectorySize(path) / 1024, "KB",
+                           true);
+  }
+
+  // Reports the latency of reading one and four weeks of CPU usage, and of
+  // the hourly rollups of four weeks.
+  void MeasureQueries(Database* database,
+                      const base::Time& end,
+                      const std::string& trace) {
+    base::TimeTicks query_start = base::TimeTicks::HighResNow();
+    scoped_ptr<Database::MetricVector> stats =
+        database->GetStatsForActivityAndMetric(
+            METRIC_CPU_USAGE, end - base::TimeDelta::FromDays(7), end);
+    base::TimeDelta week_time = base::TimeTicks::HighResNow() - query_start;
+    EXPECT_FALSE(stats->empty());
+
+    query_start = base::TimeTicks::HighResNow();
+    stats = database->GetStatsForActivityAndMetric(METRIC_CPU_USAGE, start_,
+                                                   end);
+    base::TimeDelta month_time = base::TimeTicks::HighResNow() - query_start;
+    EXPECT_EQ(static_cast<size_t>(kDays * 24 * 60 / kSampleIntervalMinutes),
+              stats->size());
+
+    query_start = base::TimeTicks::HighResNow();
+    scoped_ptr<Database::MetricRollupVector> rollups =
+        database->GetRollupsForActivityAndMetric(
+            METRIC_CPU_USAGE, ROLLUP_HOUR, start_, end);
+    base::TimeDelta rollup_time = base::TimeTicks::HighResNow() - query_start;
+    EXPECT_GE(rollups->size(), static_cast<size_t>(kDays * 24));
+
+    perf_test::PrintResult("performance_monitor_db_query", "_1_week", trace,
+                           week_time.InMillisecondsF(), "ms", true);
+    perf_test::PrintResult("performance_monitor_db_query", "_4_weeks", trace,
+                           month_time.InMillisecondsF(), "ms", true);
+    perf_test::PrintResult("performance_monitor_db_query",
+                           "_4_weeks_hourly_rollups", trace,
+                           rollup_time.InMillisecondsF(), "ms", true);
+  }
+
+  base::ScopedTempDir database_dir_;
+  base::Time start_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(PerformanceMonitorDatabasePerfTest);
+};
+
+TEST_F(PerformanceMonitorDatabasePerfTest, Rows) {
+  RunTest(Database::METRIC_STORAGE_ROWS, "rows");
+}
+
+TEST_F(PerformanceMonitorDatabasePerfTest, Series) {
+  RunTest(Database::METRIC_STORAGE_SERIES, "series");
+}
+
+}  // namespace performance_monitor
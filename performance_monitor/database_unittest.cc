@@ -88,6 +88,9 @@ class TestingClock : public Database::Clock {
   explicit TestingClock(const TestingClock& other)
       : counter_(other.counter_) {
   }
+  explicit TestingClock(const base::Time& start)
+      : counter_(start.ToInternalValue()) {
+  }
   virtual ~TestingClock() {}
   virtual base::Time GetTime() OVERRIDE {
     return base::Time::FromInternalValue(++counter_);
@@ -185,6 +188,48 @@ class PerformanceMonitorDatabaseMetricTest : public ::testing::Test {
   std::string activity_;
 };
 
+// Stores the metrics as time series. The metrics are added with times an hour
+// apart, so that each is in its own block, and the clock is a day ahead of
+// them.
+class PerformanceMonitorDatabaseSeriesTest : public ::testing::Test {
+ protected:
+  PerformanceMonitorDatabaseSeriesTest() {
+    start_ = base::Time() + base::TimeDelta::FromHours(400000);
+    clock_ = new TestingClock(start_ + base::TimeDelta::FromDays(1));
+    CHECK(temp_dir_.CreateUniqueTempDir());
+    db_ = Database::Create(temp_dir_.path(), Database::METRIC_STORAGE_SERIES);
+    CHECK(db_.get());
+    db_->set_clock(scoped_ptr<Database::Clock>(clock_));
+    activity_ = std::string("A");
+  }
+
+  virtual void SetUp() {
+    ASSERT_TRUE(db_.get());
+    PopulateDB();
+  }
+
+  void PopulateDB() {
+    db_->AddMetric(kProcessChromeAggregate,
+                   Metric(METRIC_CPU_USAGE, TimeAt(0), 50.5));
+    db_->AddMetric(activity_,
+                   Metric(METRIC_CPU_USAGE, TimeAt(1), 13.1));
+    db_->AddMetric(kProcessChromeAggregate,
+                   Metric(METRIC_PRIVATE_MEMORY_USAGE, TimeAt(2), 1000000.0));
+    db_->AddMetric(activity_,
+                   Metric(METRIC_PRIVATE_MEMORY_USAGE, TimeAt(3), 3000000.0));
+  }
+
+  base::Time TimeAt(int hours) {
+    return start_ + base::TimeDelta::FromHours(hours);
+  }
+
+  scoped_ptr<Database> db_;
+  Database::Clock* clock_;
+  base::ScopedTempDir temp_dir_;
+  std::string activity_;
+  base::Time start_;
+};
+
 ////// PerformanceMonitorDatabaseSetupTests ////////////////////////////////////
 TEST(PerformanceMonitorDatabaseSetupTest, OpenClose) {
   base::ScopedTempDir temp_dir;
@@ -531,4 +576,215 @@ TEST_F(PerformanceMonitorDatabaseMetricTest, GetRange) {
   ASSERT_EQ(9, stats[1].value);
 }
 
+////// PerformanceMonitorDatabaseSeriesTests ///////////////////////////////////
+TEST_F(PerformanceMonitorDatabaseSeriesTest, GetActiveMetrics) {
+  Database::MetricTypeSet active_metrics =
+      db_->GetActiveMetrics(start_, TimeAt(4));
+  Database::MetricTypeSet expected_metrics;
+  expected_metrics.insert(METRIC_CPU_USAGE);
+  expected_metrics.insert(METRIC_PRIVATE_MEMORY_USAGE);
+  EXPECT_EQ(expected_metrics, active_metrics);
+
+  active_metrics = db_->GetActiveMetrics(TimeAt(2), TimeAt(4));
+  expected_metrics.erase(METRIC_CPU_USAGE);
+  EXPECT_EQ(expected_metrics, active_metrics);
+
+  // The most recent CPU sample is after the range, so the series are read.
+  active_metrics = db_->GetActiveMetrics(
+      start_, TimeAt(0) + base::TimeDelta::FromMinutes(30));
+  expected_metrics.clear();
+  expected_metrics.insert(METRIC_CPU_USAGE);
+  EXPECT_EQ(expected_metrics, active_metrics);
+}
+
+TEST_F(PerformanceMonitorDatabaseSeriesTest, GetStatsForActivityAndMetric) {
+  Database::MetricVector stats = *db_->GetStatsForActivityAndMetric(
+      activity_, METRIC_CPU_USAGE, start_, TimeAt(4));
+  ASSERT_EQ(1u, stats.size());
+  EXPECT_EQ(13.1, stats[0].value);
+  EXPECT_EQ(TimeAt(1), stats[0].time);
+
+  // Later samples within the hour go to the same block.
+  for (int i = 1; i <= 10; ++i) {
+    db_->AddMetric(activity_,
+                   Metric(METRIC_CPU_USAGE,
+                          TimeAt(1) + base::TimeDelta::FromMinutes(i), i));
+  }
+  stats = *db_->GetStatsForActivityAndMetric(
+      activity_, METRIC_CPU_USAGE, TimeAt(1) + base::TimeDelta::FromMinutes(3),
+      TimeAt(1) + base::TimeDelta::FromMinutes(5));
+  ASSERT_EQ(3u, stats.size());
+  EXPECT_EQ(3, stats[0].value);
+  EXPECT_EQ(4, stats[1].value);
+  EXPECT_EQ(5, stats[2].value);
+
+  stats = *db_->GetStatsForActivityAndMetric(METRIC_PRIVATE_MEMORY_USAGE,
+                                            start_, TimeAt(4));
+  ASSERT_EQ(1u, stats.size());
+  EXPECT_EQ(1000000, stats[0].value);
+  stats = *db_->GetStatsForActivityAndMetric(activity_, METRIC_CPU_USAGE,
+                                            TimeAt(2), TimeAt(4));
+  EXPECT_TRUE(stats.empty());
+}
+
+TEST_F(PerformanceMonitorDatabaseSeriesTest, GetStatsForMetricByActivity) {
+  Database::MetricVectorMap stats_map = db_->GetStatsForMetricByActivity(
+      METRIC_CPU_USAGE, start_, TimeAt(4));
+  ASSERT_EQ(2u, stats_map.size());
+  linked_ptr<Database::MetricVector> stats = stats_map[activity_];
+  ASSERT_EQ(1u, stats->size());
+  EXPECT_EQ(13.1, stats->at(0).value);
+  stats = stats_map[kProcessChromeAggregate];
+  ASSERT_EQ(1u, stats->size());
+  EXPECT_EQ(50.5, stats->at(0).value);
+  stats_map = db_->GetStatsForMetricByActivity(
+      METRIC_CPU_USAGE, TimeAt(2), TimeAt(4));
+  EXPECT_EQ(0u, stats_map.size());
+}
+
+// A range spanning several hours reads every block, including the block that
+// started before the range.
+TEST_F(PerformanceMonitorDatabaseSeriesTest, GetRangeAcrossBlocks) {
+  base::Time time = TimeAt(10) + base::TimeDelta::FromMinutes(30);
+  for (int i = 0; i < 200; ++i) {
+    db_->AddMetric(Metric(METRIC_SHARED_MEMORY_USAGE, time, i));
+    time += base::TimeDelta::FromMinutes(2);
+  }
+  Database::MetricVector stats = *db_->GetStatsForActivityAndMetric(
+      METRIC_SHARED_MEMORY_USAGE, TimeAt(11), TimeAt(15));
+  // The samples from 60 to 300 minutes after TimeAt(10), inclusive.
+  ASSERT_EQ(121u, stats.size());
+  for (size_t i = 0; i < stats.size(); ++i) {
+    EXPECT_EQ(TimeAt(11) + base::TimeDelta::FromMinutes(2 * i),
+              stats[i].time);
+    EXPECT_EQ(15 + static_cast<double>(i), stats[i].value);
+  }
+}
+
+TEST_F(PerformanceMonitorDatabaseSeriesTest, GetRollups) {
+  base::Time hour = TimeAt(10);
+  const double kValues[] = { 4.0, 8.0, 3.0, 5.0, 10.0 };
+  const int kSeconds[] = { 0, 20, 40, 60, 3599 };
+  for (size_t i = 0; i < arraysize(kValues); ++i) {
+    db_->AddMetric(activity_,
+                   Metric(METRIC_SHARED_MEMORY_USAGE,
+                          hour + base::TimeDelta::FromSeconds(kSeconds[i]),
+                          kValues[i]));
+  }
+  db_->AddMetric(activity_,
+                 Metric(METRIC_SHARED_MEMORY_USAGE, TimeAt(11), 100.0));
+
+  scoped_ptr<Database::MetricRollupVector> rollups =
+      db_->GetRollupsForActivityAndMetric(activity_,
+                                          METRIC_SHARED_MEMORY_USAGE,
+                                          ROLLUP_MINUTE, hour, TimeAt(11));
+  ASSERT_EQ(4u, rollups->size());
+  EXPECT_EQ(hour, rollups->at(0).start);
+  EXPECT_EQ(3, rollups->at(0).count);
+  EXPECT_EQ(3.0, rollups->at(0).min);
+  EXPECT_EQ(8.0, rollups->at(0).max);
+  EXPECT_EQ(5.0, rollups->at(0).mean());
+  EXPECT_EQ(hour + base::TimeDelta::FromMinutes(1), rollups->at(1).start);
+  EXPECT_EQ(1, rollups->at(1).count);
+  EXPECT_EQ(hour + base::TimeDelta::FromMinutes(59), rollups->at(2).start);
+  EXPECT_EQ(TimeAt(11), rollups->at(3).start);
+
+  rollups = db_->GetRollupsForActivityAndMetric(
+      activity_, METRIC_SHARED_MEMORY_USAGE, ROLLUP_HOUR,
+      hour + base::TimeDelta::FromMinutes(30), TimeAt(12));
+  ASSERT_EQ(2u, rollups->size());
+  EXPECT_EQ(hour, rollups->at(0).start);
+  EXPECT_EQ(5, rollups->at(0).count);
+  EXPECT_EQ(3.0, rollups->at(0).min);
+  EXPECT_EQ(10.0, rollups->at(0).max);
+  EXPECT_EQ(6.0, rollups->at(0).mean());
+  EXPECT_EQ(1, rollups->at(1).count);
+  EXPECT_EQ(100.0, rollups->at(1).mean());
+
+  // Other activities have their own rollups.
+  rollups = db_->GetRollupsForActivityAndMetric(
+      METRIC_SHARED_MEMORY_USAGE, ROLLUP_HOUR, hour, TimeAt(12));
+  EXPECT_TRUE(rollups->empty());
+  rollups = db_->GetRollupsForActivityAndMetric(
+      METRIC_CPU_USAGE, ROLLUP_HOUR, start_, TimeAt(12));
+  ASSERT_EQ(1u, rollups->size());
+  EXPECT_EQ(50.5, rollups->at(0).max);
+}
+
+// The rows schema computes the same rollups from the samples.
+TEST_F(PerformanceMonitorDatabaseMetricTest, GetRollups) {
+  base::Time hour = base::Time() + base::TimeDelta::FromHours(400000);
+  db_->AddMetric(Metric(METRIC_SHARED_MEMORY_USAGE, hour, 4.0));
+  db_->AddMetric(Metric(METRIC_SHARED_MEMORY_USAGE,
+                        hour + base::TimeDelta::FromMinutes(30), 8.0));
+  db_->AddMetric(Metric(METRIC_SHARED_MEMORY_USAGE,
+                        hour + base::TimeDelta::FromHours(1), 1.0));
+  scoped_ptr<Database::MetricRollupVector> rollups =
+      db_->GetRollupsForActivityAndMetric(
+          METRIC_SHARED_MEMORY_USAGE, ROLLUP_HOUR,
+          hour + base::TimeDelta::FromMinutes(45),
+          hour + base::TimeDelta::FromHours(1));
+  ASSERT_EQ(2u, rollups->size());
+  EXPECT_EQ(hour, rollups->at(0).start);
+  EXPECT_EQ(2, rollups->at(0).count);
+  EXPECT_EQ(4.0, rollups->at(0).min);
+  EXPECT_EQ(8.0, rollups->at(0).max);
+  EXPECT_EQ(1, rollups->at(1).count);
+}
+
+// Samples and rollups added after reopening the database are added to those
+// stored before.
+TEST_F(PerformanceMonitorDatabaseSeriesTest, Reopen) {
+  DatabaseTestHelper helper(db_.get());
+  db_->AddMetric(Metric(METRIC_CPU_USAGE,
+                        TimeAt(0) + base::TimeDelta::FromMinutes(1), 20.0));
+  ASSERT_TRUE(helper.Close());
+  db_.reset();
+
+  db_ = Database::Create(temp_dir_.path(), Database::METRIC_STORAGE_SERIES);
+  ASSERT_TRUE(db_.get());
+  db_->set_clock(scoped_ptr<Database::Clock>(new TestingClock(TimeAt(24))));
+  db_->AddMetric(Metric(METRIC_CPU_USAGE,
+                        TimeAt(0) + base::TimeDelta::FromMinutes(2), 30.0));
+
+  Database::MetricVector stats = *db_->GetStatsForActivityAndMetric(
+      METRIC_CPU_USAGE, start_, TimeAt(1));
+  ASSERT_EQ(3u, stats.size());
+  EXPECT_EQ(50.5, stats[0].value);
+  EXPECT_EQ(20.0, stats[1].value);
+  EXPECT_EQ(30.0, stats[2].value);
+
+  scoped_ptr<Database::MetricRollupVector> rollups =
+      db_->GetRollupsForActivityAndMetric(METRIC_CPU_USAGE, ROLLUP_HOUR,
+                                          start_, TimeAt(1));
+  ASSERT_EQ(1u, rollups->size());
+  EXPECT_EQ(3, rollups->at(0).count);
+  EXPECT_EQ(20.0, rollups->at(0).min);
+  EXPECT_EQ(50.5, rollups->at(0).max);
+
+  // Databases in the rows schema do not see the series.
+  db_.reset();
+  db_ = Database::Create(temp_dir_.path());
+  ASSERT_TRUE(db_.get());
+  db_->set_clock(scoped_ptr<Database::Clock>(new TestingClock()));
+  EXPECT_TRUE(db_->GetStatsForActivityAndMetric(METRIC_CPU_USAGE, start_,
+                                                TimeAt(1))->empty());
+}
+
+TEST_F(PerformanceMonitorDatabaseSeriesTest, InvalidBlocks) {
+  DatabaseTestHelper helper(db_.get());
+  size_t original_number_of_entries = helper.GetNumberOfMetricEntries();
+  Metric invalid_metric(METRIC_CPU_USAGE, TimeAt(0), 5.0);
+  ASSERT_TRUE(helper.AddInvalidMetric(activity_, invalid_metric));
+  ASSERT_EQ(original_number_of_entries + 1u, helper.GetNumberOfMetricEntries());
+
+  Database::MetricVector stats = *db_->GetStatsForActivityAndMetric(
+      activity_, METRIC_CPU_USAGE, base::Time(), clock_->GetTime());
+  ASSERT_EQ(1u, stats.size());
+  EXPECT_EQ(13.1, stats[0].value);
+
+  // The block should have been deleted from the database.
+  ASSERT_EQ(original_number_of_entries, helper.GetNumberOfMetricEntries());
+}
+
 }  // namespace performance_monitor
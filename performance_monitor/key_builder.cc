@@ -45,6 +45,11 @@ METRIC_NETWORK_BYTES_READ_KEY_CHAR = 42,
 METRIC_NUMBER_OF_METRICS_KEY_CHAR = 255,
 };
 
+enum RollupResolutionKeyChar {
+ROLLUP_MINUTE_KEY_CHAR = 35,
+ROLLUP_HOUR_KEY_CHAR = 36,
+};
+
 enum EventKeyChar {
 EVENT_UNDEFINED_KEY_CHAR = 34,
 EVENT_EXTENSION_INSTALL_KEY_CHAR = 35,
@@ -86,6 +91,26 @@ enum MetricKeyPosition {
   METRIC_ACTIVITY  // The unique identifier for the activity.
 };
 
+// The position of different elements in the key for the rollup db.
+enum RollupKeyPosition {
+  ROLLUP_TYPE,  // The unique identifier for the metric.
+  ROLLUP_RESOLUTION,  // The resolution of the rollup.
+  ROLLUP_TIME,  // The start of the time bucket rolled up.
+  ROLLUP_ACTIVITY  // The unique identifier for the activity.
+};
+
+int RollupResolutionToKeyChar(MetricRollupResolution resolution) {
+  switch (resolution) {
+    case ROLLUP_MINUTE:
+      return ROLLUP_MINUTE_KEY_CHAR;
+    case ROLLUP_HOUR:
+      return ROLLUP_HOUR_KEY_CHAR;
+    default:
+      NOTREACHED();
+      return ROLLUP_MINUTE_KEY_CHAR;
+  }
+}
+
 }  // namespace
 
 RecentKey::RecentKey(const std::string& recent_time,
@@ -106,6 +131,15 @@ MetricKey::MetricKey(const std::string& metric_time,
 MetricKey::~MetricKey() {
 }
 
+RollupKey::RollupKey(const std::string& rollup_time,
+                     MetricType rollup_type,
+                     const std::string& rollup_activity)
+    : time(rollup_time), type(rollup_type), activity(rollup_activity) {
+}
+
+RollupKey::~RollupKey() {
+}
+
 KeyBuilder::KeyBuilder() {
   PopulateKeyMaps();
 }
@@ -216,6 +250,18 @@ std::string KeyBuilder::CreateMaxValueKey(const MetricType type,
                             kDelimiter, activity.c_str());
 }
 
+std::string KeyBuilder::CreateRollupKey(
+    const MetricRollupResolution resolution,
+    const base::Time& time,
+    const MetricType type,
+    const std::string& activity) {
+  return base::StringPrintf("%c%c%c%c%016" PRId64 "%c%s",
+                            metric_type_to_metric_key_char_[type],
+                            kDelimiter, RollupResolutionToKeyChar(resolution),
+                            kDelimiter, time.ToInternalValue(),
+                            kDelimiter, activity.c_str());
+}
+
 EventType KeyBuilder::EventKeyToEventType(const std::string& event_key) {
   std::vector<std::string> split;
   base::SplitString(event_key, kDelimiter, &split);
@@ -244,4 +290,14 @@ MetricKey KeyBuilder::SplitMetricKey(const std::string& key) {
                    split[METRIC_ACTIVITY]);
 }
 
+RollupKey KeyBuilder::SplitRollupKey(const std::string& key) {
+  std::vector<std::string> split;
+  base::SplitString(key, kDelimiter, &split);
+  DCHECK(split[ROLLUP_TYPE].size() == 1);
+  return RollupKey(split[ROLLUP_TIME],
+                   metric_key_char_to_metric_type_[
+                       static_cast<int>(split[ROLLUP_TYPE].at(0))],
+                   split[ROLLUP_ACTIVITY]);
+}
+
 }  // namespace performance_monitor
@@ -9,6 +9,7 @@
 
 #include "chrome/browser/performance_monitor/event.h"
 #include "chrome/browser/performance_monitor/metric.h"
+#include "chrome/browser/performance_monitor/metric_series.h"
 
 namespace performance_monitor {
 
@@ -45,6 +46,17 @@ struct MetricKey {
   const std::string activity;
 };
 
+struct RollupKey {
+  RollupKey(const std::string& rollup_time,
+            MetricType rollup_type,
+            const std::string& rollup_activity);
+  ~RollupKey();
+
+  const std::string time;
+  const MetricType type;
+  const std::string activity;
+};
+
 // This class is responsible for building the keys which are used internally by
 // PerformanceMonitor's database. These keys should only be referenced by the
 // database, and should not be used externally.
@@ -79,9 +91,16 @@ class KeyBuilder {
   std::string CreateMaxValueKey(const MetricType type,
                                 const std::string& activity);
 
+  // Key Schema: <Metric>-<Resolution>-<Time>-<Activity>
+  std::string CreateRollupKey(const MetricRollupResolution resolution,
+                              const base::Time& time,
+                              const MetricType type,
+                              const std::string& activity);
+
   EventType EventKeyToEventType(const std::string& key);
   RecentKey SplitRecentKey(const std::string& key);
   MetricKey SplitMetricKey(const std::string& key);
+  RollupKey SplitRollupKey(const std::string& key);
 
  private:
   // Populate the maps from [Event, Metric]Type to key characters.
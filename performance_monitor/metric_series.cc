@@ -0,0 +1,320 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/performance_monitor/metric_series.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+namespace performance_monitor {
+
+namespace {
+
+const uint8 kBlockVersion = 1;
+
+// The version, the number of samples and the first sample.
+const size_t kBlockSizeOffset = 1;
+const size_t kBlockFirstTimeOffset = 5;
+const size_t kBlockFirstValueOffset = 13;
+const size_t kBlockHeaderSize = 21;
+
+// The number of samples, the sum, the minimum and the maximum.
+const size_t kRollupSize = 4 * 8;
+
+void PutFixed32(uint32 value, std::string* out) {
+  for (int i = 0; i < 4; ++i)
+    out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+void PutFixed64(uint64 value, std::string* out) {
+  for (int i = 0; i < 8; ++i)
+    out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+}
+
+uint32 GetFixed32(const char* data) {
+  uint32 value = 0;
+  for (int i = 0; i < 4; ++i)
+    value |= static_cast<uint32>(static_cast<uint8>(data[i])) << (8 * i);
+  return value;
+}
+
+uint64 GetFixed64(const char* data) {
+  uint64 value = 0;
+  for (int i = 0; i < 8; ++i)
+    value |= static_cast<uint64>(static_cast<uint8>(data[i])) << (8 * i);
+  return value;
+}
+
+void PutVarint64(uint64 value, std::string* out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out->push_back(static_cast<char>(value));
+}
+
+bool GetVarint64(const std::string& data, size_t* offset, uint64* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64 && *offset < data.size(); shift += 7) {
+    const uint8 byte = static_cast<uint8>(data[(*offset)++]);
+    *value |= static_cast<uint64>(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+uint64 ZigZagEncode(int64 value) {
+  return (static_cast<uint64>(value) << 1) ^ static_cast<uint64>(value >> 63);
+}
+
+int64 ZigZagDecode(uint64 value) {
+  return static_cast<int64>(value >> 1) ^ -static_cast<int64>(value & 1);
+}
+
+uint64 DoubleToBits(double value) {
+  uint64 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+double BitsToDouble(uint64 bits) {
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// Differences are computed on unsigned values so that they wrap rather than
+// overflow; they are only ever added back the same way.
+int64 Difference(int64 a, int64 b) {
+  return static_cast<int64>(static_cast<uint64>(a) - static_cast<uint64>(b));
+}
+
+int64 Sum(int64 a, int64 b) {
+  return static_cast<int64>(static_cast<uint64>(a) + static_cast<uint64>(b));
+}
+
+void PutXorBits(uint64 xor_bits, std::string* out) {
+  int leading = 0;
+  while (leading < 8 && !((xor_bits >> (8 * (7 - leading))) & 0xff))
+    ++leading;
+  int trailing = 0;
+  while (trailing < 8 - leading && !((xor_bits >> (8 * trailing)) & 0xff))
+    ++trailing;
+  const int length = 8 - leading - trailing;
+  out->push_back(static_cast<char>((leading << 4) | length));
+  for (int i = 0; i < length; ++i) {
+    out->push_back(
+        static_cast<char>((xor_bits >> (8 * (7 - leading - i))) & 0xff));
+  }
+}
+
+bool GetXorBits(const std::string& data, size_t* offset, uint64* xor_bits) {
+  if (*offset >= data.size())
+    return false;
+  const uint8 control = static_cast<uint8>(data[(*offset)++]);
+  const int leading = control >> 4;
+  const int length = control & 0x0f;
+  if (leading + length > 8 ||
+      data.size() - *offset < static_cast<size_t>(length)) {
+    return false;
+  }
+  *xor_bits = 0;
+  for (int i = 0; i < length; ++i) {
+    *xor_bits |= static_cast<uint64>(static_cast<uint8>(data[(*offset)++]))
+        << (8 * (7 - leading - i));
+  }
+  return true;
+}
+
+// Decodes the block |data| into |times| and |value_bits|. Returns false if
+// |data| is not a valid block.
+bool DecodeBlock(const std::string& data,
+                 std::vector<int64>* times,
+                 std::vector<uint64>* value_bits) {
+  if (data.size() < kBlockHeaderSize ||
+      static_cast<uint8>(data[0]) != kBlockVersion) {
+    return false;
+  }
+  const uint32 size = GetFixed32(data.data() + kBlockSizeOffset);
+  if (size == 0 || size > MetricSeriesBlock::kMaxSamples)
+    return false;
+
+  times->reserve(size);
+  value_bits->reserve(size);
+  times->push_back(
+      static_cast<int64>(GetFixed64(data.data() + kBlockFirstTimeOffset)));
+  value_bits->push_back(GetFixed64(data.data() + kBlockFirstValueOffset));
+
+  size_t offset = kBlockHeaderSize;
+  int64 delta = 0;
+  for (uint32 i = 1; i < size; ++i) {
+    uint64 delta_change = 0;
+    uint64 xor_bits = 0;
+    if (!GetVarint64(data, &offset, &delta_change) ||
+        !GetXorBits(data, &offset, &xor_bits)) {
+      return false;
+    }
+    delta = Sum(delta, ZigZagDecode(delta_change));
+    times->push_back(Sum(times->back(), delta));
+    value_bits->push_back(value_bits->back() ^ xor_bits);
+  }
+  return offset == data.size();
+}
+
+}  // namespace
+
+base::TimeDelta GetRollupBucketDuration(MetricRollupResolution resolution) {
+  switch (resolution) {
+    case ROLLUP_MINUTE:
+      return base::TimeDelta::FromMinutes(1);
+    case ROLLUP_HOUR:
+      return base::TimeDelta::FromHours(1);
+    default:
+      NOTREACHED();
+      return base::TimeDelta::FromMinutes(1);
+  }
+}
+
+base::Time GetRollupBucketStart(MetricRollupResolution resolution,
+                                const base::Time& time) {
+  const int64 duration = GetRollupBucketDuration(resolution).InMicroseconds();
+  int64 start = time.ToInternalValue();
+  start -= start % duration;
+  if (start > time.ToInternalValue())
+    start -= duration;
+  return base::Time::FromInternalValue(start);
+}
+
+MetricRollup::MetricRollup() : count(0), sum(0.0), min(0.0), max(0.0) {
+}
+
+MetricRollup::MetricRollup(const base::Time& bucket_start)
+    : start(bucket_start), count(0), sum(0.0), min(0.0), max(0.0) {
+}
+
+MetricRollup::~MetricRollup() {
+}
+
+void MetricRollup::AddValue(double value) {
+  if (!count) {
+    min = value;
+    max = value;
+  } else {
+    min = std::min(min, value);
+    max = std::max(max, value);
+  }
+  sum += value;
+  ++count;
+}
+
+std::string MetricRollup::Encode() const {
+  std::string data;
+  data.reserve(kRollupSize);
+  PutFixed64(static_cast<uint64>(count), &data);
+  PutFixed64(DoubleToBits(sum), &data);
+  PutFixed64(DoubleToBits(min), &data);
+  PutFixed64(DoubleToBits(max), &data);
+  return data;
+}
+
+bool MetricRollup::Decode(const std::string& data) {
+  if (data.size() != kRollupSize)
+    return false;
+  count = static_cast<int64>(GetFixed64(data.data()));
+  sum = BitsToDouble(GetFixed64(data.data() + 8));
+  min = BitsToDouble(GetFixed64(data.data() + 16));
+  max = BitsToDouble(GetFixed64(data.data() + 24));
+  return count > 0;
+}
+
+MetricSeriesBlock::MetricSeriesBlock()
+    : size_(0),
+      first_time_(0),
+      last_time_(0),
+      last_delta_(0),
+      last_value_bits_(0) {
+}
+
+MetricSeriesBlock::~MetricSeriesBlock() {
+}
+
+bool MetricSeriesBlock::Parse(const std::string& data) {
+  std::vector<int64> times;
+  std::vector<uint64> value_bits;
+  data_.clear();
+  size_ = 0;
+  if (!DecodeBlock(data, &times, &value_bits))
+    return false;
+
+  data_ = data;
+  size_ = times.size();
+  first_time_ = times.front();
+  last_time_ = times.back();
+  last_delta_ =
+      size_ > 1 ? Difference(times[size_ - 1], times[size_ - 2]) : 0;
+  last_value_bits_ = value_bits.back();
+  return true;
+}
+
+bool MetricSeriesBlock::CanAppend(const base::Time& time) const {
+  if (empty())
+    return true;
+  return size_ < kMaxSamples &&
+         time.ToInternalValue() >= last_time_ &&
+         GetRollupBucketStart(ROLLUP_HOUR, time) ==
+             GetRollupBucketStart(ROLLUP_HOUR,
+                                  base::Time::FromInternalValue(first_time_));
+}
+
+void MetricSeriesBlock::Append(const base::Time& time, double value) {
+  DCHECK(CanAppend(time));
+  const int64 time_value = time.ToInternalValue();
+  const uint64 value_bits = DoubleToBits(value);
+
+  if (empty()) {
+    data_.push_back(static_cast<char>(kBlockVersion));
+    PutFixed32(1, &data_);
+    PutFixed64(static_cast<uint64>(time_value), &data_);
+    PutFixed64(value_bits, &data_);
+    first_time_ = time_value;
+    last_delta_ = 0;
+  } else {
+    const int64 delta = Difference(time_value, last_time_);
+    PutVarint64(ZigZagEncode(Difference(delta, last_delta_)), &data_);
+    PutXorBits(value_bits ^ last_value_bits_, &data_);
+    last_delta_ = delta;
+  }
+  last_time_ = time_value;
+  last_value_bits_ = value_bits;
+  ++size_;
+
+  // Update the sample count in place.
+  std::string size;
+  PutFixed32(static_cast<uint32>(size_), &size);
+  data_.replace(kBlockSizeOffset, size.size(), size);
+}
+
+void MetricSeriesBlock::GetSamples(MetricType type,
+                                   const base::Time& start,
+                                   const base::Time& end,
+                                   std::vector<Metric>* metrics) const {
+  if (empty())
+    return;
+  std::vector<int64> times;
+  std::vector<uint64> value_bits;
+  bool valid = DecodeBlock(data_, &times, &value_bits);
+  DCHECK(valid);
+  for (size_t i = 0; i < times.size(); ++i) {
+    const base::Time time = base::Time::FromInternalValue(times[i]);
+    if (time < start || time > end)
+      continue;
+    metrics->push_back(Metric(type, time, BitsToDouble(value_bits[i])));
+  }
+}
+
+}  // namespace performance_monitor
@@ -0,0 +1,120 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_PERFORMANCE_MONITOR_METRIC_SERIES_H_
+#define CHROME_BROWSER_PERFORMANCE_MONITOR_METRIC_SERIES_H_
+
+#include <string>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/time/time.h"
+#include "chrome/browser/performance_monitor/metric.h"
+
+namespace performance_monitor {
+
+// The resolutions at which rollups of the metrics are kept.
+enum MetricRollupResolution {
+  ROLLUP_MINUTE,
+  ROLLUP_HOUR,
+
+  ROLLUP_NUMBER_OF_RESOLUTIONS
+};
+
+// Returns the length of the buckets of time at |resolution|.
+base::TimeDelta GetRollupBucketDuration(MetricRollupResolution resolution);
+
+// Returns the start of the bucket at |resolution| that contains |time|.
+base::Time GetRollupBucketStart(MetricRollupResolution resolution,
+                                const base::Time& time);
+
+// The minimum, maximum and mean of the samples of a metric within one bucket
+// of time.
+struct MetricRollup {
+  MetricRollup();
+  explicit MetricRollup(const base::Time& bucket_start);
+  ~MetricRollup();
+
+  void AddValue(double value);
+
+  double mean() const { return count ? sum / count : 0.0; }
+
+  // Serializes the aggregated values, but not |start|, which the database
+  // keeps in the key. Decode() returns false if |data| is not the output of
+  // Encode().
+  std::string Encode() const;
+  bool Decode(const std::string& data);
+
+  base::Time start;
+  int64 count;
+  double sum;
+  double min;
+  double max;
+};
+
+// A block of consecutive samples of one metric for one activity. A block
+// covers at most one clock hour and kMaxSamples samples, and is stored as a
+// single database value, so that reading a range of time touches one key per
+// hour rather than one per sample.
+//
+// The samples are compressed as they are appended:
+//   uint8   format version
+//   uint32  number of samples
+//   int64   time of the first sample
+//   uint64  bits of the first value
+// followed, for every other sample, by
+//   varint  zigzag encoded change of the delta between sample times
+//   uint8   the number of leading zero bytes (high nibble) and of significant
+//           bytes (low nibble) of the XOR of the value's bits with the bits of
+//           the previous value
+//   bytes   those significant bytes, most significant first.
+// A sample taken on a regular schedule whose value did not change takes two
+// bytes.
+class MetricSeriesBlock {
+ public:
+  static const size_t kMaxSamples = 256;
+
+  MetricSeriesBlock();
+  ~MetricSeriesBlock();
+
+  // Replaces the samples of the block with those of the encoded block |data|.
+  // Returns false, leaving the block empty, if |data| is not a valid block.
+  bool Parse(const std::string& data);
+
+  // Returns true if a sample taken at |time| can be appended to the block:
+  // the samples of a block are in time order, and all within one clock hour.
+  bool CanAppend(const base::Time& time) const;
+
+  // Appends a sample. CanAppend() must be true for |time|.
+  void Append(const base::Time& time, double value);
+
+  // Appends the samples taken between |start| and |end| (inclusive) to
+  // |metrics|, as metrics of type |type|.
+  void GetSamples(MetricType type,
+                  const base::Time& start,
+                  const base::Time& end,
+                  std::vector<Metric>* metrics) const;
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+
+  // The encoded block.
+  const std::string& data() const { return data_; }
+
+ private:
+  std::string data_;
+  size_t size_;
+
+  // The state the next sample is encoded against.
+  int64 first_time_;
+  int64 last_time_;
+  int64 last_delta_;
+  uint64 last_value_bits_;
+
+  DISALLOW_COPY_AND_ASSIGN(MetricSeriesBlock);
+};
+
+}  // namespace performance_monitor
+
+#endif  // CHROME_BROWSER_PERFORMANCE_MONITOR_METRIC_SERIES_H_
@@ -0,0 +1,170 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/performance_monitor/metric_series.h"
+
+#include <vector>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace performance_monitor {
+
+namespace {
+
+// The start of an hour.
+base::Time HourStart() {
+  return base::Time() + base::TimeDelta::FromHours(400000);
+}
+
+}  // namespace
+
+TEST(MetricSeriesBlockTest, RoundTrip) {
+  base::Time start = HourStart();
+  const double kValues[] = { 13.1, 13.1, 0.0, 1e9, 4.5, 4.5, 100.0 };
+  const int64 kOffsets[] = { 0, 10, 20, 21, 500, 100000, 100001 };
+
+  MetricSeriesBlock block;
+  EXPECT_TRUE(block.empty());
+  for (size_t i = 0; i < arraysize(kValues); ++i) {
+    base::Time time = start + base::TimeDelta::FromMicroseconds(kOffsets[i]);
+    ASSERT_TRUE(block.CanAppend(time));
+    block.Append(time, kValues[i]);
+  }
+  EXPECT_EQ(arraysize(kValues), block.size());
+
+  MetricSeriesBlock parsed;
+  ASSERT_TRUE(parsed.Parse(block.data()));
+  EXPECT_EQ(block.size(), parsed.size());
+  std::vector<Metric> metrics;
+  parsed.GetSamples(METRIC_CPU_USAGE, base::Time(),
+                    start + base::TimeDelta::FromHours(1), &metrics);
+  ASSERT_EQ(arraysize(kValues), metrics.size());
+  for (size_t i = 0; i < arraysize(kValues); ++i) {
+    EXPECT_EQ(METRIC_CPU_USAGE, metrics[i].type);
+    EXPECT_EQ(start + base::TimeDelta::FromMicroseconds(kOffsets[i]),
+              metrics[i].time);
+    EXPECT_EQ(kValues[i], metrics[i].value);
+  }
+
+  // A parsed block can be appended to, and gets the same encoding.
+  base::Time time = start + base::TimeDelta::FromMicroseconds(100002);
+  block.Append(time, 7.0);
+  parsed.Append(time, 7.0);
+  EXPECT_EQ(block.data(), parsed.data());
+}
+
+TEST(MetricSeriesBlockTest, GetSamplesInRange) {
+  base::Time start = HourStart();
+  MetricSeriesBlock block;
+  for (int i = 0; i < 10; ++i)
+    block.Append(start + base::TimeDelta::FromMinutes(i), i);
+
+  std::vector<Metric> metrics;
+  block.GetSamples(METRIC_CPU_USAGE, start + base::TimeDelta::FromMinutes(3),
+                   start + base::TimeDelta::FromMinutes(5), &metrics);
+  ASSERT_EQ(3u, metrics.size());
+  EXPECT_EQ(3, metrics[0].value);
+  EXPECT_EQ(5, metrics[2].value);
+
+  metrics.clear();
+  block.GetSamples(METRIC_CPU_USAGE, start + base::TimeDelta::FromMinutes(10),
+                   start + base::TimeDelta::FromHours(1), &metrics);
+  EXPECT_TRUE(metrics.empty());
+}
+
+// Samples taken on a regular schedule with an unchanged value take two bytes.
+TEST(MetricSeriesBlockTest, CompressesRegularSamples) {
+  base::Time start = HourStart();
+  MetricSeriesBlock block;
+  // The second sample sets the interval.
+  block.Append(start, 42.0);
+  block.Append(start + base::TimeDelta::FromMinutes(2), 42.0);
+  size_t size = block.data().size();
+  for (int i = 2; i < 30; ++i)
+    block.Append(start + base::TimeDelta::FromMinutes(2 * i), 42.0);
+  EXPECT_EQ(size + 2 * 28, block.data().size());
+}
+
+TEST(MetricSeriesBlockTest, CanAppend) {
+  base::Time start = HourStart();
+  MetricSeriesBlock block;
+  EXPECT_TRUE(block.CanAppend(start - base::TimeDelta::FromMinutes(1)));
+  block.Append(start + base::TimeDelta::FromMinutes(30), 1.0);
+
+  // Samples are in time order.
+  EXPECT_TRUE(block.CanAppend(start + base::TimeDelta::FromMinutes(30)));
+  EXPECT_FALSE(block.CanAppend(start + base::TimeDelta::FromMinutes(29)));
+
+  // And within the clock hour of the first sample.
+  EXPECT_TRUE(block.CanAppend(start + base::TimeDelta::FromMinutes(59)));
+  EXPECT_FALSE(block.CanAppend(start + base::TimeDelta::FromMinutes(60)));
+
+  // And there are at most kMaxSamples of them.
+  while (block.size() < MetricSeriesBlock::kMaxSamples)
+    block.Append(start + base::TimeDelta::FromMinutes(30), 1.0);
+  EXPECT_FALSE(block.CanAppend(start + base::TimeDelta::FromMinutes(30)));
+}
+
+TEST(MetricSeriesBlockTest, RejectsInvalidData) {
+  MetricSeriesBlock block;
+  EXPECT_FALSE(block.Parse(std::string()));
+  EXPECT_FALSE(block.Parse("fake_block"));
+
+  base::Time start = HourStart();
+  MetricSeriesBlock valid;
+  for (int i = 0; i < 5; ++i)
+    valid.Append(start + base::TimeDelta::FromSeconds(i * i), i * 1.5);
+
+  // Truncated, extended, and with the wrong version.
+  const std::string& data = valid.data();
+  EXPECT_FALSE(block.Parse(data.substr(0, data.size() - 1)));
+  EXPECT_FALSE(block.Parse(data + '\0'));
+  std::string bad_version = data;
+  bad_version[0] = 2;
+  EXPECT_FALSE(block.Parse(bad_version));
+  EXPECT_TRUE(block.empty());
+
+  EXPECT_TRUE(block.Parse(data));
+  EXPECT_EQ(5u, block.size());
+}
+
+TEST(MetricRollupTest, AddValue) {
+  base::Time start = HourStart();
+  MetricRollup rollup(start);
+  rollup.AddValue(4.0);
+  rollup.AddValue(-1.0);
+  rollup.AddValue(3.0);
+  EXPECT_EQ(start, rollup.start);
+  EXPECT_EQ(3, rollup.count);
+  EXPECT_EQ(-1.0, rollup.min);
+  EXPECT_EQ(4.0, rollup.max);
+  EXPECT_EQ(2.0, rollup.mean());
+}
+
+TEST(MetricRollupTest, EncodeDecode) {
+  MetricRollup rollup;
+  rollup.AddValue(0.25);
+  rollup.AddValue(1e12);
+
+  MetricRollup decoded;
+  ASSERT_TRUE(decoded.Decode(rollup.Encode()));
+  EXPECT_EQ(rollup.count, decoded.count);
+  EXPECT_EQ(rollup.sum, decoded.sum);
+  EXPECT_EQ(rollup.min, decoded.min);
+  EXPECT_EQ(rollup.max, decoded.max);
+
+  EXPECT_FALSE(decoded.Decode("fake_rollup"));
+  EXPECT_FALSE(decoded.Decode(MetricRollup().Encode()));
+}
+
+TEST(MetricRollupTest, BucketStart) {
+  base::Time start = HourStart();
+  base::Time time = start + base::TimeDelta::FromSeconds(150);
+  EXPECT_EQ(start, GetRollupBucketStart(ROLLUP_HOUR, time));
+  EXPECT_EQ(start + base::TimeDelta::FromMinutes(2),
+            GetRollupBucketStart(ROLLUP_MINUTE, time));
+  EXPECT_EQ(start, GetRollupBucketStart(ROLLUP_MINUTE, start));
+}
+
+}  // namespace performance_monitor
@@ -6,6 +6,7 @@
 
 #include <math.h>
 
+#include <algorithm>
 #include <vector>
 
 #include "base/bind.h"
@@ -63,12 +64,190 @@ enum DatabaseAction {
 
 namespace predictors {
 
+// A character trie over the user texts in the cache.  Each node holds the
+// entries whose user text ends there, sorted by URL.  While the user types,
+// each lookup usually extends the text of the one before by a character, so a
+// lookup resumes from the node for the longest prefix it shares with the
+// previous one.
+class AutocompleteActionPredictor::UserTextTrie {
+ public:
+  UserTextTrie();
+  ~UserTextTrie();
+
+  void Add(DBCacheMap::iterator entry);
+  void Remove(DBCacheMap::iterator entry);
+  void Clear();
+
+  // Sets |entry| to the entry for |user_text| and |url|.  Returns false if
+  // there is none.
+  bool Find(const base::string16& user_text,
+            const GURL& url,
+            DBCacheMap::const_iterator* entry) const;
+
+ private:
+  static const int kNoNode = -1;
+
+  struct Node {
+    explicit Node(base::char16 character);
+    ~Node();
+
+    base::char16 character;
+    int first_child;
+    int next_sibling;
+    DBCacheEntries entries;
+  };
+
+  static bool EntryURLLess(DBCacheMap::iterator entry, const GURL& url);
+
+  // Returns the child of |node| for |character|, or kNoNode.
+  int FindChild(int node, base::char16 character) const;
+
+  // Returns the node for |user_text|, adding it and its parents as needed.
+  int AddNode(const base::string16& user_text);
+
+  // Returns the node for |user_text|, or kNoNode.  |last_text_| and
+  // |last_path_| are updated for the next lookup.
+  int FindNode(const base::string16& user_text) const;
+
+  // The root is |nodes_[0]|.  Nodes are only removed by Clear().
+  std::vector<Node> nodes_;
+
+  // The text of the last lookup, and the nodes for its prefixes:
+  // |last_path_[i]| is the node for its first i characters.  The path ends
+  // early if the trie does.
+  mutable base::string16 last_text_;
+  mutable std::vector<int> last_path_;
+
+  DISALLOW_COPY_AND_ASSIGN(UserTextTrie);
+};
+
+AutocompleteActionPredictor::UserTextTrie::Node::Node(base::char16 character)
+    : character(character),
+      first_child(kNoNode),
+      next_sibling(kNoNode) {
+}
+
+AutocompleteActionPredictor::UserTextTrie::Node::~Node() {
+}
+
+AutocompleteActionPredictor::UserTextTrie::UserTextTrie() {
+  Clear();
+}
+
+AutocompleteActionPredictor::UserTextTrie::~UserTextTrie() {
+}
+
+void AutocompleteActionPredictor::UserTextTrie::Add(
+    DBCacheMap::iterator entry) {
+  DBCacheEntries& entries = nodes_[AddNode(entry->first.user_text)].entries;
+  DBCacheEntries::iterator it = std::lower_bound(
+      entries.begin(), entries.end(), entry->first.url, &EntryURLLess);
+  DCHECK(it == entries.end() || (*it)->first.url != entry->first.url);
+  entries.insert(it, entry);
+}
+
+void AutocompleteActionPredictor::UserTextTrie::Remove(
+    DBCacheMap::iterator entry) {
+  int node = 0;
+  const base::string16& user_text = entry->first.user_text;
+  for (size_t i = 0; i < user_text.length() && node != kNoNode; ++i)
+    node = FindChild(node, user_text[i]);
+  DCHECK(node != kNoNode);
+  if (node == kNoNode)
+    return;
+
+  DBCacheEntries& entries = nodes_[node].entries;
+  DBCacheEntries::iterator it = std::lower_bound(
+      entries.begin(), entries.end(), entry->first.url, &EntryURLLess);
+  DCHECK(it != entries.end() && *it == entry);
+  if (it != entries.end() && *it == entry)
+    entries.erase(it);
+}
+
+void AutocompleteActionPredictor::UserTextTrie::Clear() {
+  nodes_.clear();
+  nodes_.push_back(Node(0));
+  last_text_.clear();
+  last_path_.assign(1, 0);
+}
+
+bool AutocompleteActionPredictor::UserTextTrie::Find(
+    const base::string16& user_text,
+    const GURL& url,
+    DBCacheMap::const_iterator* entry) const {
+  const int node = FindNode(user_text);
+  if (node == kNoNode)
+    return false;
+
+  const DBCacheEntries& entries = nodes_[node].entries;
+  DBCacheEntries::const_iterator it = std::lower_bound(
+      entries.begin(), entries.end(), url, &EntryURLLess);
+  if (it == entries.end() || (*it)->first.url != url)
+    return false;
+  *entry = *it;
+  return true;
+}
+
+// static
+bool AutocompleteActionPredictor::UserTextTrie::EntryURLLess(
+    DBCacheMap::iterator entry,
+    const GURL& url) {
+  return entry->first.url < url;
+}
+
+int AutocompleteActionPredictor::UserTextTrie::FindChild(
+    int node,
+    base::char16 character) const {
+  for (int child = nodes_[node].first_child; child != kNoNode;
+       child = nodes_[child].next_sibling) {
+    if (nodes_[child].character == character)
+      return child;
+  }
+  return kNoNode;
+}
+
+int AutocompleteActionPredictor::UserTextTrie::AddNode(
+    const base::string16& user_text) {
+  int node = 0;
+  for (size_t i = 0; i < user_text.length(); ++i) {
+    int child = FindChild(node, user_text[i]);
+    if (child == kNoNode) {
+      child = static_cast<int>(nodes_.size());
+      nodes_.push_back(Node(user_text[i]));
+      nodes_[child].next_sibling = nodes_[node].first_child;
+      nodes_[node].first_child = child;
+    }
+    node = child;
+  }
+  return node;
+}
+
+int AutocompleteActionPredictor::UserTextTrie::FindNode(
+    const base::string16& user_text) const {
+  const size_t limit = std::min(user_text.length(), last_path_.size() - 1);
+  size_t common = 0;
+  while (common < limit && user_text[common] == last_text_[common])
+    ++common;
+  last_path_.resize(common + 1);
+  last_text_ = user_text;
+
+  int node = last_path_.back();
+  for (size_t i = common; i < user_text.length(); ++i) {
+    node = FindChild(node, user_text[i]);
+    if (node == kNoNode)
+      return kNoNode;
+    last_path_.push_back(node);
+  }
+  return node;
+}
+
 const int AutocompleteActionPredictor::kMaximumDaysToKeepEntry = 14;
 
 AutocompleteActionPredictor::AutocompleteActionPredictor(Profile* profile)
     : profile_(profile),
       main_profile_predictor_(NULL),
       incognito_predictor_(NULL),
+      user_text_trie_(new UserTextTrie),
       initialized_(false) {
   if (profile_->IsOffTheRecord()) {
     main_profile_predictor_ = AutocompleteActionPredictorFactory::GetForProfile(
@@ -291,6 +470,8 @@ void AutocompleteActionPredictor::DeleteAllRows() {
 
   db_cache_.clear();
   db_id_cache_.clear();
+  user_text_trie_->Clear();
+  url_index_.clear();
 
   if (table_.get()) {
     content::BrowserThread::PostTask(content::BrowserThread::DB, FROM_HERE,
@@ -309,16 +490,16 @@ void AutocompleteActionPredictor::DeleteRowsWithURLs(
 
   std::vector<AutocompleteActionPredictorTable::Row::Id> id_list;
 
-  for (DBCacheMap::iterator it = db_cache_.begin(); it != db_cache_.end();) {
-    if (std::find_if(rows.begin(), rows.end(),
-        history::URLRow::URLRowHasURL(it->first.url)) != rows.end()) {
-      const DBIdCacheMap::iterator id_it = db_id_cache_.find(it->first);
-      DCHECK(id_it != db_id_cache_.end());
-      id_list.push_back(id_it->second);
-      db_id_cache_.erase(id_it);
-      db_cache_.erase(it++);
-    } else {
-      ++it;
+  for (history::URLRows::const_iterator row_it = rows.begin();
+       row_it != rows.end(); ++row_it) {
+    URLIndexMap::iterator url_it = url_index_.find(row_it->url().spec());
+    if (url_it == url_index_.end())
+      continue;
+    // Removing the last entry for the URL erases |url_it|.
+    const DBCacheEntries entries = url_it->second;
+    for (DBCacheEntries::const_iterator it = entries.begin();
+         it != entries.end(); ++it) {
+      RemoveFromCaches(*it, &id_list);
     }
   }
 
@@ -433,8 +614,7 @@ void AutocompleteActionPredictor::AddAndUpdateRows(
 
     DCHECK(db_cache_.find(key) == db_cache_.end());
 
-    db_cache_[key] = value;
-    db_id_cache_[key] = it->id;
+    AddToCaches(key, value, it->id);
     UMA_HISTOGRAM_ENUMERATION("AutocompleteActionPredictor.DatabaseAction",
                               DATABASE_ACTION_ADD, DATABASE_ACTION_COUNT);
   }
@@ -467,13 +647,15 @@ void AutocompleteActionPredictor::CreateCaches(
   DCHECK(db_cache_.empty());
   DCHECK(db_id_cache_.empty());
 
+  // The rows come sorted by key, so each insert is hinted to go at the end.
   for (std::vector<AutocompleteActionPredictorTable::Row>::const_iterator it =
        rows->begin(); it != rows->end(); ++it) {
     const DBCacheKey key = { it->user_text, it->url };
     const DBCacheValue value = { it->number_of_hits, it->number_of_misses };
-    db_cache_[key] = value;
-    db_id_cache_[key] = it->id;
+    db_cache_.insert(db_cache_.end(), std::make_pair(key, value));
+    db_id_cache_.insert(db_id_cache_.end(), std::make_pair(key, it->id));
   }
+  IndexCaches();
 
   // If the history service is ready, delete any old or invalid entries.
   HistoryService* history_service =
@@ -531,21 +713,24 @@ void AutocompleteActionPredictor::DeleteOldIdsFromCaches(
   DCHECK(id_list);
 
   id_list->clear();
-  for (DBCacheMap::iterator it = db_cache_.begin(); it != db_cache_.end();) {
+  // Entries are checked a URL at a time, so each URL is only looked up once.
+  DBCacheEntries entries_to_delete;
+  for (URLIndexMap::const_iterator url_it = url_index_.begin();
+       url_it != url_index_.end(); ++url_it) {
+    const DBCacheEntries& entries = url_it->second;
+    DCHECK(!entries.empty());
     history::URLRow url_row;
-
-    if ((url_db->GetRowForURL(it->first.url, &url_row) == 0) ||
+    if ((url_db->GetRowForURL(entries.front()->first.url, &url_row) == 0) ||
         ((base::Time::Now() - url_row.last_visit()).InDays() >
          kMaximumDaysToKeepEntry)) {
-      const DBIdCacheMap::iterator id_it = db_id_cache_.find(it->first);
-      DCHECK(id_it != db_id_cache_.end());
-      id_list->push_back(id_it->second);
-      db_id_cache_.erase(id_it);
-      db_cache_.erase(it++);
-    } else {
-      ++it;
+      entries_to_delete.insert(entries_to_delete.end(), entries.begin(),
+                               entries.end());
     }
   }
+  for (DBCacheEntries::const_iterator it = entries_to_delete.begin();
+       it != entries_to_delete.end(); ++it) {
+    RemoveFromCaches(*it, id_list);
+  }
 }
 
 void AutocompleteActionPredictor::CopyFromMainProfile() {
@@ -557,6 +742,7 @@ void AutocompleteActionPredictor::CopyFromMainProfile() {
 
   db_cache_ = main_profile_predictor_->db_cache_;
   db_id_cache_ = main_profile_predictor_->db_id_cache_;
+  IndexCaches();
   FinishInitialization();
 }
 
@@ -579,14 +765,12 @@ double AutocompleteActionPredictor::CalculateConfidence(
     const base::string16& user_text,
     const AutocompleteMatch& match,
     bool* is_in_db) const {
-  const DBCacheKey key = { user_text, match.destination_url };
-
   *is_in_db = false;
   if (user_text.length() < kMinimumUserTextLength)
     return 0.0;
 
-  const DBCacheMap::const_iterator iter = db_cache_.find(key);
-  if (iter == db_cache_.end())
+  DBCacheMap::const_iterator iter;
+  if (!user_text_trie_->Find(user_text, match.destination_url, &iter))
     return 0.0;
 
   *is_in_db = true;
@@ -603,6 +787,47 @@ double AutocompleteActionPredictor::CalculateConfidenceForDbEntry(
   return number_of_hits / (number_of_hits + value.number_of_misses);
 }
 
+void AutocompleteActionPredictor::AddToCaches(
+    const DBCacheKey& key,
+    const DBCacheValue& value,
+    const AutocompleteActionPredictorTable::Row::Id& id) {
+  std::pair<DBCacheMap::iterator, bool> inserted =
+      db_cache_.insert(std::make_pair(key, value));
+  DCHECK(inserted.second);
+  db_id_cache_[key] = id;
+  user_text_trie_->Add(inserted.first);
+  url_index_[key.url.spec()].push_back(inserted.first);
+}
+
+void AutocompleteActionPredictor::RemoveFromCaches(
+    DBCacheMap::iterator it,
+    std::vector<AutocompleteActionPredictorTable::Row::Id>* id_list) {
+  const DBIdCacheMap::iterator id_it = db_id_cache_.find(it->first);
+  DCHECK(id_it != db_id_cache_.end());
+  id_list->push_back(id_it->second);
+  db_id_cache_.erase(id_it);
+
+  user_text_trie_->Remove(it);
+  URLIndexMap::iterator url_it = url_index_.find(it->first.url.spec());
+  DCHECK(url_it != url_index_.end());
+  DBCacheEntries& entries = url_it->second;
+  entries.erase(std::find(entries.begin(), entries.end(), it));
+  if (entries.empty())
+    url_index_.erase(url_it);
+
+  db_cache_.erase(it);
+}
+
+void AutocompleteActionPredictor::IndexCaches() {
+  user_text_trie_->Clear();
+  url_index_.clear();
+  for (DBCacheMap::iterator it = db_cache_.begin(); it != db_cache_.end();
+       ++it) {
+    user_text_trie_->Add(it);
+    url_index_[it->first.url.spec()].push_back(it);
+  }
+}
+
 AutocompleteActionPredictor::TransitionalMatch::TransitionalMatch() {
 }
 
@@ -6,7 +6,10 @@
 #define CHROME_BROWSER_PREDICTORS_AUTOCOMPLETE_ACTION_PREDICTOR_H_
 
 #include <map>
+#include <string>
+#include <vector>
 
+#include "base/containers/hash_tables.h"
 #include "base/gtest_prod_util.h"
 #include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
@@ -114,6 +117,7 @@ class AutocompleteActionPredictor
 
  private:
   friend class AutocompleteActionPredictorTest;
+  friend class AutocompleteActionPredictorPerfTest;
   friend class ::PredictorsHandler;
 
   struct TransitionalMatch {
@@ -150,6 +154,11 @@ class AutocompleteActionPredictor
   typedef std::map<DBCacheKey, DBCacheValue> DBCacheMap;
   typedef std::map<DBCacheKey, AutocompleteActionPredictorTable::Row::Id>
       DBIdCacheMap;
+  typedef std::vector<DBCacheMap::iterator> DBCacheEntries;
+  // Maps the spec of each URL in |db_cache_| to its entries.
+  typedef base::hash_map<std::string, DBCacheEntries> URLIndexMap;
+
+  class UserTextTrie;
 
   static const int kMaximumDaysToKeepEntry;
 
@@ -215,6 +224,21 @@ class AutocompleteActionPredictor
   // Calculates the confidence for an entry in the DBCacheMap.
   double CalculateConfidenceForDbEntry(DBCacheMap::const_iterator iter) const;
 
+  // Adds an entry to the local caches and their indices.  |key| must not be
+  // in the caches yet.
+  void AddToCaches(const DBCacheKey& key,
+                   const DBCacheValue& value,
+                   const AutocompleteActionPredictorTable::Row::Id& id);
+
+  // Removes the entry at |it| from the local caches and their indices, and
+  // appends its row id to |id_list|.
+  void RemoveFromCaches(
+      DBCacheMap::iterator it,
+      std::vector<AutocompleteActionPredictorTable::Row::Id>* id_list);
+
+  // Rebuilds the indices from |db_cache_|.
+  void IndexCaches();
+
   Profile* profile_;
 
   // Set when this is a predictor for an incognito profile.
@@ -244,6 +268,12 @@ class AutocompleteActionPredictor
   DBCacheMap db_cache_;
   DBIdCacheMap db_id_cache_;
 
+  // Indices of |db_cache_|, to find the entries for the text being typed
+  // without searching the whole cache, and to visit each URL once when
+  // deleting rows.
+  scoped_ptr<UserTextTrie> user_text_trie_;
+  URLIndexMap url_index_;
+
   bool initialized_;
 
   DISALLOW_COPY_AND_ASSIGN(AutocompleteActionPredictor);
@@ -0,0 +1,193 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+#include <vector>
+
+#include "base/guid.h"
+#include "base/message_loop/message_loop.h"
+#include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
+#include "chrome/browser/autocomplete/autocomplete_match.h"
+#include "chrome/browser/predictors/autocomplete_action_predictor.h"
+#include "chrome/browser/test/base/synthetic_random.h"
+#include "chrome/test/base/testing_profile.h"
+#include "content/public/test/test_browser_thread.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+using content::BrowserThread;
+
+namespace predictors {
+
+namespace {
+
+const size_t kEntryCount = 50 * 1000;
+const size_t kTypedQueryCount = 2000;
+const size_t kMatchesPerKeystroke = 5;
+const size_t kSiteCount = 5000;
+const size_t kDeletedURLCount = 100;
+
+std::string SiteName(size_t site) {
+  return base::StringPrintf("site%ukey", static_cast<unsigned>(site));
+}
+
+GURL SiteURL(size_t site) {
+  return GURL("http://www." + SiteName(site) + ".com/");
+}
+
+}  // namespace
+
+class AutocompleteActionPredictorPerfTest : public testing::Test {
+ public:
+  AutocompleteActionPredictorPerfTest()
+      : ui_thread_(BrowserThread::UI, &loop_),
+        db_thread_(BrowserThread::DB, &loop_),
+        file_thread_(BrowserThread::FILE, &loop_),
+        profile_(new TestingProfile()),
+        predictor_(new AutocompleteActionPredictor(profile_.get())) {
+  }
+
+  virtual ~AutocompleteActionPredictorPerfTest() {
+    predictor_.reset(NULL);
+    profile_.reset(NULL);
+    loop_.RunUntilIdle();
+  }
+
+  virtual void SetUp() {
+    predictor_->CreateLocalCachesFromDatabase();
+    ASSERT_TRUE(profile_->CreateHistoryService(true, false));
+    profile_->BlockUntilHistoryProcessesPendingRequests();
+    ASSERT_TRUE(predictor_->initialized_);
+  }
+
+  virtual void TearDown() {
+    profile_->DestroyHistoryService();
+    predictor_->Shutdown();
+  }
+
+ protected:
+  // Learns every prefix of the name of each site in turn, the way typing them
+  // in and navigating would, until there are kEntryCount entries.
+  void LearnEntries() {
+    SyntheticRandom random;
+    AutocompleteActionPredictorTable::Rows rows;
+    for (size_t site = 0; rows.size() < kEntryCount; ++site) {
+      const std::string name = SiteName(site);
+      AutocompleteActionPredictorTable::Row row;
+      row.url = SiteURL(site);
+      for (size_t i = 1; i <= name.length() && rows.size() < kEntryCount;
+           ++i) {
+        row.id = base::GenerateGUID();
+        row.user_text = base::ASCIIToUTF16(name.substr(0, i));
+        row.number_of_hits = random.Next() % 6;
+        row.number_of_misses = random.Next() % 3;
+        rows.push_back(row);
+      }
+    }
+    predictor_->AddAndUpdateRows(rows,
+                                 AutocompleteActionPredictorTable::Rows());
+  }
+
+  const AutocompleteActionPredictor::DBCacheMap& db_cache() const {
+    return predictor_->db_cache_;
+  }
+
+  void DeleteRowsWithURLs(const history::URLRows& rows) {
+    predictor_->DeleteRowsWithURLs(rows);
+  }
+
+  // Returns whether there is an entry for |user_text| and |match|.
+  bool IsInDb(const base::string16& user_text,
+              const AutocompleteMatch& match) {
+    bool is_in_db = false;
+    predictor_->CalculateConfidence(user_text, match, &is_in_db);
+    return is_in_db;
+  }
+
+ private:
+  base::MessageLoop loop_;
+  content::TestBrowserThread ui_thread_;
+  content::TestBrowserThread db_thread_;
+  content::TestBrowserThread file_thread_;
+  scoped_ptr<TestingProfile> profile_;
+  scoped_ptr<AutocompleteActionPredictor> predictor_;
+};
+
+// Replays typing queries a character at a time, asking for the confidence of
+// a few matches at each keystroke, as the omnibox does.
+TEST_F(AutocompleteActionPredictorPerfTest, KeystrokeReplay) {
+  LearnEntries();
+  ASSERT_EQ(kEntryCount, db_cache().size());
+
+  SyntheticRandom random;
+  std::vector<base::string16> keystrokes;
+  for (size_t i = 0; i < kTypedQueryCount; ++i) {
+    const std::string name = SiteName(random.Next() % kSiteCount);
+    for (size_t j = 1; j <= name.length(); ++j)
+      keystrokes.push_back(base::ASCIIToUTF16(name.substr(0, j)));
+  }
+  std::vector<AutocompleteMatch> site_matches(kSiteCount);
+  for (size_t i = 0; i < kSiteCount; ++i) {
+    site_matches[i].type = AutocompleteMatchType::HISTORY_URL;
+    site_matches[i].destination_url = SiteURL(i);
+  }
+
+  // The lookup CalculateConfidence() used to do.
+  size_t map_found = 0;
+  base::TimeTicks start = base::TimeTicks::HighResNow();
+  for (size_t i = 0; i < keystrokes.size(); ++i) {
+    for (size_t j = 0; j < kMatchesPerKeystroke; ++j) {
+      const AutocompleteActionPredictor::DBCacheKey key = {
+        keystrokes[i], site_matches[(i + j * 7) % kSiteCount].destination_url
+      };
+      if (db_cache().find(key) != db_cache().end())
+        ++map_found;
+    }
+  }
+  const base::TimeDelta map_time = base::TimeTicks::HighResNow() - start;
+
+  size_t trie_found = 0;
+  start = base::TimeTicks::HighResNow();
+  for (size_t i = 0; i < keystrokes.size(); ++i) {
+    for (size_t j = 0; j < kMatchesPerKeystroke; ++j) {
+      if (IsInDb(keystrokes[i], site_matches[(i + j * 7) % kSiteCount]))
+        ++trie_found;
+    }
+  }
+  const base::TimeDelta trie_time = base::TimeTicks::HighResNow() - start;
+
+  EXPECT_EQ(map_found, trie_found);
+  const double lookups =
+      static_cast<double>(keystrokes.size() * kMatchesPerKeystroke);
+  perf_test::PrintResult("autocomplete_action_predictor_lookup", "_map",
+                         "50k_entries",
+                         map_time.InMicroseconds() / lookups,
+                         "us/lookup", true);
+  perf_test::PrintResult("autocomplete_action_predictor_lookup", "_trie",
+                         "50k_entries",
+                         trie_time.InMicroseconds() / lookups,
+                         "us/lookup", true);
+}
+
+TEST_F(AutocompleteActionPredictorPerfTest, DeleteRowsWithURLs) {
+  LearnEntries();
+  ASSERT_EQ(kEntryCount, db_cache().size());
+
+  history::URLRows rows;
+  for (size_t i = 0; i < kDeletedURLCount; ++i)
+    rows.push_back(history::URLRow(SiteURL(i * (kSiteCount / 100))));
+
+  const base::TimeTicks start = base::TimeTicks::HighResNow();
+  DeleteRowsWithURLs(rows);
+  const base::TimeDelta elapsed = base::TimeTicks::HighResNow() - start;
+
+  EXPECT_GT(kEntryCount, db_cache().size());
+  perf_test::PrintResult("autocomplete_action_predictor_delete_urls", "",
+                         "50k_entries_100_urls", elapsed.InMillisecondsF(),
+                         "ms", true);
+}
+
+}  // namespace predictors
@@ -97,9 +97,12 @@ void AutocompleteActionPredictorTable::GetAllRows(Rows* row_buffer) {
 
   row_buffer->clear();
 
+  // Rows are returned in the order of the predictor's cache, so that it can
+  // be built by appending.
   sql::Statement statement(DB()->GetCachedStatement(SQL_FROM_HERE,
       base::StringPrintf(
-          "SELECT * FROM %s", kAutocompletePredictorTableName).c_str()));
+          "SELECT * FROM %s ORDER BY user_text, url",
+          kAutocompletePredictorTableName).c_str()));
   if (!statement.is_valid())
     return;
 
@@ -63,6 +63,7 @@ class AutocompleteActionPredictorTable : public PredictorTableBase {
 
   // DB thread functions.
   void GetRow(const Row::Id& id, Row* row);
+  // Returns the rows sorted by user text, then URL.
   void GetAllRows(Rows* row_buffer);
   void AddRow(const Row& row);
   void UpdateRow(const Row& row);
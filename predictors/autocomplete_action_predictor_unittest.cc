@@ -381,4 +381,45 @@ TEST_F(AutocompleteActionPredictorTest, RecommendActionSearch) {
   }
 }
 
+// Lookups resume from the previous lookup's text, so look the entries up as
+// if typing, deleting and retyping.
+TEST_F(AutocompleteActionPredictorTest, RecommendActionWhileTyping) {
+  ASSERT_NO_FATAL_FAILURE(AddAllRows());
+
+  AutocompleteMatch match;
+  match.type = AutocompleteMatchType::HISTORY_URL;
+
+  const size_t kOrder[] = { 0, 1, 2, 3, 7, 2, 0, 8, 1, 5, 4, 0, 3 };
+  for (size_t i = 0; i < arraysize(kOrder); ++i) {
+    const TestUrlInfo& test_row = test_url_db[kOrder[i]];
+    match.destination_url = test_row.url;
+    EXPECT_EQ(test_row.expected_action,
+              predictor()->RecommendAction(test_row.user_text, match))
+        << "Unexpected action for " << match.destination_url;
+
+    // Another URL typed with the same text is not in the cache.
+    match.destination_url = GURL("http://www.testsite.com/z.html");
+    EXPECT_EQ(AutocompleteActionPredictor::ACTION_NONE,
+              predictor()->RecommendAction(test_row.user_text, match));
+  }
+
+  // Deleted entries are no longer found, and the others still are.
+  history::URLRows rows(1, history::URLRow(test_url_db[3].url));
+  DeleteRowsWithURLs(rows);
+  for (size_t i = 0; i < arraysize(kOrder); ++i) {
+    const TestUrlInfo& test_row = test_url_db[kOrder[i]];
+    match.destination_url = test_row.url;
+    EXPECT_EQ(kOrder[i] == 3 ? AutocompleteActionPredictor::ACTION_NONE :
+                               test_row.expected_action,
+              predictor()->RecommendAction(test_row.user_text, match))
+        << "Unexpected action for " << match.destination_url;
+  }
+
+  // Entries added again are found.
+  AddRow(test_url_db[3]);
+  match.destination_url = test_url_db[3].url;
+  EXPECT_EQ(test_url_db[3].expected_action,
+            predictor()->RecommendAction(test_url_db[3].user_text, match));
+}
+
 }  // namespace predictors
@@ -8,7 +8,6 @@
 
 #include <algorithm>
 #include <map>
-#include <set>
 #include <string>
 #include <utility>
 
@@ -28,6 +27,7 @@
 #include "chrome/browser/prerender/prerender_histograms.h"
 #include "chrome/browser/prerender/prerender_manager.h"
 #include "chrome/browser/prerender/prerender_util.h"
+#include "chrome/browser/prerender/prerender_visit_transition_model.h"
 #include "chrome/browser/profiles/profile.h"
 #include "chrome/browser/safe_browsing/database_manager.h"
 #include "chrome/browser/safe_browsing/safe_browsing_service.h"
@@ -237,9 +237,9 @@ class GetVisitHistoryTask : public history::HistoryDBTask {
 // Maximum visit history to retrieve from the visit database.
 const int kMaxVisitHistory = 100 * 1000;
 
-// Visit history size at which to trigger pruning, and number of items to prune.
-const int kVisitHistoryPruneThreshold = 120 * 1000;
-const int kVisitHistoryPruneAmount = 20 * 1000;
+// Number of visits to keep in memory.  The oldest visit is dropped as each
+// new one is added.
+const size_t kVisitHistorySize = 120 * 1000;
 
 const int kMinLocalPredictionTimeMs = 500;
 
@@ -468,11 +468,10 @@ void PrerenderLocalPredictor::OnAddVisit(const history::BriefVisitInfo& info) {
   RecordEvent(EVENT_ADD_VISIT);
   if (!visit_history_.get())
     return;
-  visit_history_->push_back(info);
-  if (static_cast<int>(visit_history_->size()) > kVisitHistoryPruneThreshold) {
-    visit_history_->erase(visit_history_->begin(),
-                          visit_history_->begin() + kVisitHistoryPruneAmount);
-  }
+  visit_history_->AddVisit(
+      info,
+      !ShouldExcludeTransitionForPrediction(info.transition),
+      !IsFormSubmit(info.transition));
   RecordEvent(EVENT_ADD_VISIT_INITIALIZED);
   if (current_prerender_.get() &&
       current_prerender_->url_id == info.url_id &&
@@ -489,63 +488,33 @@ void PrerenderLocalPredictor::OnAddVisit(const history::BriefVisitInfo& info) {
   if (ShouldExcludeTransitionForPrediction(info.transition))
     return;
   RecordEvent(EVENT_ADD_VISIT_RELEVANT_TRANSITION);
-  base::TimeDelta max_age =
-      base::TimeDelta::FromMilliseconds(GetMaxLocalPredictionTimeMs());
-  base::TimeDelta min_age =
-      base::TimeDelta::FromMilliseconds(kMinLocalPredictionTimeMs);
-  std::set<URLID> next_urls_currently_found;
-  std::map<URLID, int> next_urls_num_found;
-  int num_occurrences_of_current_visit = 0;
-  base::Time last_visited;
+  const int num_occurrences_of_current_visit =
+      visit_history_->GetVisitCount(info.url_id);
   scoped_ptr<CandidatePrerenderInfo> lookup_info(
       new CandidatePrerenderInfo(info.url_id));
-  const vector<history::BriefVisitInfo>& visits = *(visit_history_.get());
-  for (int i = 0; i < static_cast<int>(visits.size()); i++) {
-    if (!ShouldExcludeTransitionForPrediction(visits[i].transition)) {
-      if (visits[i].url_id == info.url_id) {
-        last_visited = visits[i].time;
-        num_occurrences_of_current_visit++;
-        next_urls_currently_found.clear();
-        continue;
-      }
-      if (!last_visited.is_null() &&
-          last_visited > visits[i].time - max_age &&
-          last_visited < visits[i].time - min_age) {
-        if (!IsFormSubmit(visits[i].transition))
-          next_urls_currently_found.insert(visits[i].url_id);
-      }
-    }
-    if (i == static_cast<int>(visits.size()) - 1 ||
-        visits[i+1].url_id == info.url_id) {
-      for (std::set<URLID>::iterator it = next_urls_currently_found.begin();
-           it != next_urls_currently_found.end();
-           ++it) {
-        std::pair<std::map<URLID, int>::iterator, bool> insert_ret =
-            next_urls_num_found.insert(std::pair<URLID, int>(*it, 0));
-        std::map<URLID, int>::iterator num_found_it = insert_ret.first;
-        num_found_it->second++;
-      }
-    }
-  }
-
   if (num_occurrences_of_current_visit > 1) {
     RecordEvent(EVENT_ADD_VISIT_RELEVANT_TRANSITION_REPEAT_URL);
   } else {
     RecordEvent(EVENT_ADD_VISIT_RELEVANT_TRANSITION_NEW_URL);
   }
 
-  for (std::map<URLID, int>::const_iterator it = next_urls_num_found.begin();
-       it != next_urls_num_found.end();
-       ++it) {
-    // Only consider a candidate next page for prerendering if it was viewed
-    // at least twice, and at least 10% of the time.
-    if (num_occurrences_of_current_visit > 0 &&
-        it->second > 1 &&
-        it->second * 10 >= num_occurrences_of_current_visit) {
-      RecordEvent(EVENT_ADD_VISIT_IDENTIFIED_PRERENDER_CANDIDATE);
-      double priority = static_cast<double>(it->second) /
-          static_cast<double>(num_occurrences_of_current_visit);
-      lookup_info->MaybeAddCandidateURLFromLocalData(it->first, priority);
+  const VisitTransitionModel::SuccessorCounts* next_urls_num_found =
+      visit_history_->GetSuccessors(info.url_id);
+  if (next_urls_num_found) {
+    for (VisitTransitionModel::SuccessorCounts::const_iterator it =
+             next_urls_num_found->begin();
+         it != next_urls_num_found->end();
+         ++it) {
+      // Only consider a candidate next page for prerendering if it was viewed
+      // at least twice, and at least 10% of the time.
+      if (num_occurrences_of_current_visit > 0 &&
+          it->second > 1 &&
+          it->second * 10 >= num_occurrences_of_current_visit) {
+        RecordEvent(EVENT_ADD_VISIT_IDENTIFIED_PRERENDER_CANDIDATE);
+        double priority = static_cast<double>(it->second) /
+            static_cast<double>(num_occurrences_of_current_visit);
+        lookup_info->MaybeAddCandidateURLFromLocalData(it->first, priority);
+      }
     }
   }
 
@@ -974,9 +943,19 @@ void PrerenderLocalPredictor::OnGetInitialVisitHistory(
   DCHECK(BrowserThread::CurrentlyOn(BrowserThread::UI));
   DCHECK(!visit_history_.get());
   RecordEvent(EVENT_INIT_SUCCEEDED);
+  visit_history_.reset(new VisitTransitionModel(
+      kVisitHistorySize,
+      base::TimeDelta::FromMilliseconds(kMinLocalPredictionTimeMs),
+      base::TimeDelta::FromMilliseconds(GetMaxLocalPredictionTimeMs())));
   // Since the visit history has descending timestamps, we must reverse it.
-  visit_history_.reset(new vector<history::BriefVisitInfo>(
-      visit_history->rbegin(), visit_history->rend()));
+  for (vector<history::BriefVisitInfo>::const_reverse_iterator it =
+           visit_history->rbegin();
+       it != visit_history->rend(); ++it) {
+    visit_history_->AddVisit(
+        *it,
+        !ShouldExcludeTransitionForPrediction(it->transition),
+        !IsFormSubmit(it->transition));
+  }
 }
 
 HistoryService* PrerenderLocalPredictor::GetHistoryIfExists() const {
@@ -36,6 +36,7 @@ namespace prerender {
 
 class PrerenderHandle;
 class PrerenderManager;
+class VisitTransitionModel;
 
 // PrerenderLocalPredictor maintains local browsing history to make prerender
 // predictions.
@@ -217,7 +218,8 @@ class PrerenderLocalPredictor : public history::VisitDatabaseObserver,
 
   CancelableRequestConsumer history_db_consumer_;
 
-  scoped_ptr<std::vector<history::BriefVisitInfo> > visit_history_;
+  // Recent visits, and which URLs tend to follow each other.
+  scoped_ptr<VisitTransitionModel> visit_history_;
 
   scoped_ptr<PrerenderProperties> current_prerender_;
   scoped_ptr<PrerenderProperties> last_swapped_in_prerender_;
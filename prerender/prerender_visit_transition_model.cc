@@ -0,0 +1,123 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/prerender/prerender_visit_transition_model.h"
+
+#include <algorithm>
+
+#include "base/logging.h"
+
+using history::URLID;
+
+namespace prerender {
+
+VisitTransitionModel::Visit::Visit() : url_id(0), relevant(false) {}
+
+VisitTransitionModel::Visit::~Visit() {}
+
+VisitTransitionModel::URLStats::URLStats() : visit_count(0), last_visit(-1) {}
+
+VisitTransitionModel::URLStats::~URLStats() {}
+
+VisitTransitionModel::VisitTransitionModel(size_t max_visits,
+                                           base::TimeDelta min_age,
+                                           base::TimeDelta max_age)
+    : max_visits_(max_visits),
+      min_age_(min_age),
+      max_age_(max_age),
+      first_visit_(0),
+      next_visit_(0) {
+  DCHECK_GT(max_visits_, 0u);
+}
+
+VisitTransitionModel::~VisitTransitionModel() {}
+
+void VisitTransitionModel::AddVisit(const history::BriefVisitInfo& visit,
+                                    bool relevant,
+                                    bool can_follow) {
+  if (size() == max_visits_)
+    EvictOldestVisit();
+
+  // Forget the visits too old for this visit, or any later one, to follow.
+  while (!recent_visits_.empty() &&
+         (recent_visits_.front() < first_visit_ ||
+          VisitAt(recent_visits_.front()).time <= visit.time - max_age_)) {
+    recent_visits_.pop_front();
+  }
+
+  if (relevant && can_follow)
+    CountSuccessor(visit);
+
+  const int64 sequence = next_visit_++;
+  if (ring_.size() < max_visits_)
+    ring_.push_back(Visit());
+  Visit& new_visit = VisitAt(sequence);
+  new_visit.url_id = visit.url_id;
+  new_visit.time = visit.time;
+  new_visit.relevant = relevant;
+  DCHECK(new_visit.successors.empty());
+  if (!relevant)
+    return;
+
+  URLStats& stats = url_stats_[visit.url_id];
+  ++stats.visit_count;
+  stats.last_visit = sequence;
+  recent_visits_.push_back(sequence);
+}
+
+int VisitTransitionModel::GetVisitCount(URLID url_id) const {
+  URLStatsMap::const_iterator it = url_stats_.find(url_id);
+  return it == url_stats_.end() ? 0 : it->second.visit_count;
+}
+
+const VisitTransitionModel::SuccessorCounts*
+VisitTransitionModel::GetSuccessors(URLID url_id) const {
+  URLStatsMap::const_iterator it = url_stats_.find(url_id);
+  if (it == url_stats_.end() || it->second.successors.empty())
+    return NULL;
+  return &it->second.successors;
+}
+
+void VisitTransitionModel::CountSuccessor(
+    const history::BriefVisitInfo& visit) {
+  for (std::deque<int64>::const_iterator it = recent_visits_.begin();
+       it != recent_visits_.end(); ++it) {
+    Visit& earlier = VisitAt(*it);
+    if (earlier.url_id == visit.url_id ||
+        earlier.time >= visit.time - min_age_) {
+      continue;
+    }
+    URLStats& stats = url_stats_[earlier.url_id];
+    if (stats.last_visit != *it)
+      continue;
+    if (std::find(earlier.successors.begin(), earlier.successors.end(),
+                  visit.url_id) != earlier.successors.end()) {
+      continue;
+    }
+    earlier.successors.push_back(visit.url_id);
+    ++stats.successors[visit.url_id];
+  }
+}
+
+void VisitTransitionModel::EvictOldestVisit() {
+  Visit& oldest = VisitAt(first_visit_);
+  if (oldest.relevant) {
+    URLStatsMap::iterator stats_it = url_stats_.find(oldest.url_id);
+    DCHECK(stats_it != url_stats_.end());
+    URLStats& stats = stats_it->second;
+    for (size_t i = 0; i < oldest.successors.size(); ++i) {
+      SuccessorCounts::iterator count_it =
+          stats.successors.find(oldest.successors[i]);
+      DCHECK(count_it != stats.successors.end());
+      if (--count_it->second == 0)
+        stats.successors.erase(count_it);
+    }
+    if (--stats.visit_count == 0)
+      url_stats_.erase(stats_it);
+  }
+  oldest.successors.clear();
+  ++first_visit_;
+}
+
+}  // namespace prerender
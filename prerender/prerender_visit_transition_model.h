@@ -0,0 +1,119 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_PRERENDER_PRERENDER_VISIT_TRANSITION_MODEL_H_
+#define CHROME_BROWSER_PRERENDER_PRERENDER_VISIT_TRANSITION_MODEL_H_
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/containers/hash_tables.h"
+#include "base/time/time.h"
+#include "chrome/browser/history/history_types.h"
+
+namespace prerender {
+
+// VisitTransitionModel keeps the most recent visits in a ring buffer, along
+// with, for each URL, how often it was visited and how often each other URL
+// was visited shortly after it.  A URL B follows a visit to A if it is
+// visited more than |min_age| and less than |max_age| after it, and before A
+// is visited again.  B is counted once per visit to A, however often it was
+// visited in between.
+//
+// The counts are updated as visits are added and evicted, so adding a visit
+// only looks at the visits of the last |max_age|, independently of how many
+// visits are kept.  Visits must be added in chronological order.
+class VisitTransitionModel {
+ public:
+  // Maps the URLs which followed a URL to the number of its visits they
+  // followed.
+  typedef std::map<history::URLID, int> SuccessorCounts;
+
+  VisitTransitionModel(size_t max_visits,
+                       base::TimeDelta min_age,
+                       base::TimeDelta max_age);
+  ~VisitTransitionModel();
+
+  // Adds |visit|, evicting the oldest visit if there are |max_visits|.  A
+  // visit that is not |relevant| (e.g. a back/forward navigation) only takes
+  // up space in the history.  A relevant visit that is not |can_follow| (e.g.
+  // a form submission) is counted as a visit to its URL, but not as
+  // following any other URL.
+  void AddVisit(const history::BriefVisitInfo& visit,
+                bool relevant,
+                bool can_follow);
+
+  // Returns the number of relevant visits to |url_id| in the history.
+  int GetVisitCount(history::URLID url_id) const;
+
+  // Returns the URLs which followed visits to |url_id|, or NULL if there are
+  // none.  The result is invalidated by AddVisit().
+  const SuccessorCounts* GetSuccessors(history::URLID url_id) const;
+
+  // Number of visits in the history, relevant or not.
+  size_t size() const {
+    return static_cast<size_t>(next_visit_ - first_visit_);
+  }
+
+ private:
+  struct Visit {
+    Visit();
+    ~Visit();
+
+    history::URLID url_id;
+    base::Time time;
+    bool relevant;
+    // The URLs counted as following this visit.
+    std::vector<history::URLID> successors;
+  };
+
+  struct URLStats {
+    URLStats();
+    ~URLStats();
+
+    int visit_count;
+    // Sequence number of the most recent relevant visit.
+    int64 last_visit;
+    SuccessorCounts successors;
+  };
+
+  typedef base::hash_map<history::URLID, URLStats> URLStatsMap;
+
+  Visit& VisitAt(int64 sequence) {
+    return ring_[static_cast<size_t>(sequence % max_visits_)];
+  }
+
+  // Counts |visit| as following the last visit of every URL visited in the
+  // window before it.
+  void CountSuccessor(const history::BriefVisitInfo& visit);
+
+  // Removes the oldest visit and everything counted for it.
+  void EvictOldestVisit();
+
+  const size_t max_visits_;
+  const base::TimeDelta min_age_;
+  const base::TimeDelta max_age_;
+
+  // Visits are numbered in the order they are added.  The visits from
+  // |first_visit_| to |next_visit_| are in the ring buffer, which grows up to
+  // |max_visits_| entries.
+  std::vector<Visit> ring_;
+  int64 first_visit_;
+  int64 next_visit_;
+
+  // Sequence numbers of the relevant visits of the last |max_age_|, oldest
+  // first.  Any of them may have been superseded by a later visit to the same
+  // URL, or evicted.
+  std::deque<int64> recent_visits_;
+
+  URLStatsMap url_stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(VisitTransitionModel);
+};
+
+}  // namespace prerender
+
+#endif  // CHROME_BROWSER_PRERENDER_PRERENDER_VISIT_TRANSITION_MODEL_H_
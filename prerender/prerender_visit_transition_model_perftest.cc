@@ -0,0 +1,145 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "chrome/browser/prerender/prerender_visit_transition_model.h"
+#include "chrome/browser/test/base/synthetic_random.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+using history::URLID;
+
+namespace prerender {
+
+namespace {
+
+const size_t kHistorySizes[] = { 1000, 10 * 1000, 120 * 1000 };
+const size_t kMeasuredVisits = 1000;
+const int kURLCount = 5000;
+const int kMinAgeMs = 500;
+const int kMaxAgeMs = 180 * 1000;
+
+// Browsing mostly moves between a few pages of the same site, with a jump to
+// another site now and then.  Visits are a few seconds apart.
+class SyntheticVisits {
+ public:
+  SyntheticVisits() : url_id_(1), time_(base::Time::UnixEpoch()) {}
+
+  history::BriefVisitInfo Next() {
+    if (random_.Next() % 8 == 0) {
+      url_id_ = 1 + random_.Next() % kURLCount;
+    } else {
+      const URLID site = (url_id_ - 1) / 10 * 10;
+      url_id_ = 1 + site + random_.Next() % 10;
+    }
+    time_ += base::TimeDelta::FromMilliseconds(random_.Next() % 20000);
+    history::BriefVisitInfo visit;
+    visit.url_id = url_id_;
+    visit.time = time_;
+    visit.transition = content::PAGE_TRANSITION_LINK;
+    return visit;
+  }
+
+ private:
+  SyntheticRandom random_;
+  URLID url_id_;
+  base::Time time_;
+};
+
+// Counts the successors of |url_id| by scanning all of |visits|, the way
+// PrerenderLocalPredictor::OnAddVisit() used to.
+int CountByScanning(const std::vector<history::BriefVisitInfo>& visits,
+                    URLID url_id,
+                    std::map<URLID, int>* successors) {
+  const base::TimeDelta min_age = base::TimeDelta::FromMilliseconds(kMinAgeMs);
+  const base::TimeDelta max_age = base::TimeDelta::FromMilliseconds(kMaxAgeMs);
+  std::set<URLID> found;
+  int visit_count = 0;
+  base::Time last_visited;
+  for (size_t i = 0; i < visits.size(); ++i) {
+    if (visits[i].url_id == url_id) {
+      last_visited = visits[i].time;
+      ++visit_count;
+      found.clear();
+      continue;
+    }
+    if (!last_visited.is_null() &&
+        last_visited > visits[i].time - max_age &&
+        last_visited < visits[i].time - min_age) {
+      found.insert(visits[i].url_id);
+    }
+    if (i + 1 == visits.size() || visits[i + 1].url_id == url_id) {
+      for (std::set<URLID>::const_iterator it = found.begin();
+           it != found.end(); ++it) {
+        ++(*successors)[*it];
+      }
+    }
+  }
+  return visit_count;
+}
+
+}  // namespace
+
+TEST(VisitTransitionModelPerfTest, ReplayVisits) {
+  for (size_t s = 0; s < arraysize(kHistorySizes); ++s) {
+    const size_t history_size = kHistorySizes[s];
+    SyntheticVisits stream;
+    std::vector<history::BriefVisitInfo> visits;
+    VisitTransitionModel model(
+        history_size,
+        base::TimeDelta::FromMilliseconds(kMinAgeMs),
+        base::TimeDelta::FromMilliseconds(kMaxAgeMs));
+    for (size_t i = 0; i < history_size; ++i) {
+      visits.push_back(stream.Next());
+      model.AddVisit(visits.back(), true, true);
+    }
+    std::vector<history::BriefVisitInfo> measured;
+    for (size_t i = 0; i < kMeasuredVisits; ++i)
+      measured.push_back(stream.Next());
+
+    size_t scanned_candidates = 0;
+    base::TimeTicks start = base::TimeTicks::HighResNow();
+    for (size_t i = 0; i < measured.size(); ++i) {
+      visits.erase(visits.begin());
+      visits.push_back(measured[i]);
+      std::map<URLID, int> successors;
+      CountByScanning(visits, measured[i].url_id, &successors);
+      scanned_candidates += successors.size();
+    }
+    const base::TimeDelta scanning = base::TimeTicks::HighResNow() - start;
+
+    size_t model_candidates = 0;
+    start = base::TimeTicks::HighResNow();
+    for (size_t i = 0; i < measured.size(); ++i) {
+      model.AddVisit(measured[i], true, true);
+      model.GetVisitCount(measured[i].url_id);
+      const VisitTransitionModel::SuccessorCounts* successors =
+          model.GetSuccessors(measured[i].url_id);
+      if (successors)
+        model_candidates += successors->size();
+    }
+    const base::TimeDelta incremental = base::TimeTicks::HighResNow() - start;
+
+    EXPECT_EQ(scanned_candidates, model_candidates);
+    const std::string trace = base::StringPrintf(
+        "%u_visits", static_cast<unsigned>(history_size));
+    perf_test::PrintResult("prerender_local_predictor_visit", "_scan", trace,
+                           scanning.InMicroseconds() /
+                               static_cast<double>(measured.size()),
+                           "us/visit", true);
+    perf_test::PrintResult("prerender_local_predictor_visit", "_incremental",
+                           trace,
+                           incremental.InMicroseconds() /
+                               static_cast<double>(measured.size()),
+                           "us/visit", true);
+  }
+}
+
+}  // namespace prerender
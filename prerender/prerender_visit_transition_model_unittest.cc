@@ -0,0 +1,172 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/prerender/prerender_visit_transition_model.h"
+
+#include <set>
+#include <vector>
+
+#include "chrome/browser/test/base/synthetic_random.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+using history::URLID;
+
+namespace prerender {
+
+namespace {
+
+const int kMinAgeMs = 500;
+const int kMaxAgeMs = 5000;
+
+struct TestVisit {
+  history::BriefVisitInfo info;
+  bool can_follow;
+};
+
+history::BriefVisitInfo MakeVisit(URLID url_id, int time_ms) {
+  history::BriefVisitInfo visit;
+  visit.url_id = url_id;
+  visit.time = base::Time::UnixEpoch() +
+      base::TimeDelta::FromMilliseconds(time_ms);
+  visit.transition = content::PAGE_TRANSITION_LINK;
+  return visit;
+}
+
+// Counts the visits to |url_id| and the URLs that followed them by scanning
+// all of |visits|, the way the local predictor used to.
+int CountByScanning(const std::vector<TestVisit>& visits,
+                    URLID url_id,
+                    VisitTransitionModel::SuccessorCounts* successors) {
+  const base::TimeDelta min_age = base::TimeDelta::FromMilliseconds(kMinAgeMs);
+  const base::TimeDelta max_age = base::TimeDelta::FromMilliseconds(kMaxAgeMs);
+  std::set<URLID> found;
+  int visit_count = 0;
+  base::Time last_visited;
+  for (size_t i = 0; i < visits.size(); ++i) {
+    const history::BriefVisitInfo& visit = visits[i].info;
+    if (visit.url_id == url_id) {
+      last_visited = visit.time;
+      ++visit_count;
+      found.clear();
+      continue;
+    }
+    if (!last_visited.is_null() &&
+        last_visited > visit.time - max_age &&
+        last_visited < visit.time - min_age &&
+        visits[i].can_follow) {
+      found.insert(visit.url_id);
+    }
+    if (i + 1 == visits.size() || visits[i + 1].info.url_id == url_id) {
+      for (std::set<URLID>::const_iterator it = found.begin();
+           it != found.end(); ++it) {
+        ++(*successors)[*it];
+      }
+    }
+  }
+  return visit_count;
+}
+
+}  // namespace
+
+TEST(VisitTransitionModelTest, CountsSuccessors) {
+  VisitTransitionModel model(
+      100,
+      base::TimeDelta::FromMilliseconds(kMinAgeMs),
+      base::TimeDelta::FromMilliseconds(kMaxAgeMs));
+  EXPECT_EQ(0, model.GetVisitCount(1));
+  EXPECT_EQ(NULL, model.GetSuccessors(1));
+
+  // 2 follows 1 twice.  3 is visited too soon after 1, and 4 too late.
+  model.AddVisit(MakeVisit(1, 0), true, true);
+  model.AddVisit(MakeVisit(3, 100), true, true);
+  model.AddVisit(MakeVisit(2, 1000), true, true);
+  model.AddVisit(MakeVisit(2, 2000), true, true);
+  model.AddVisit(MakeVisit(4, 6000), true, true);
+  model.AddVisit(MakeVisit(1, 10000), true, true);
+  model.AddVisit(MakeVisit(2, 11000), true, true);
+
+  EXPECT_EQ(2, model.GetVisitCount(1));
+  const VisitTransitionModel::SuccessorCounts* successors =
+      model.GetSuccessors(1);
+  ASSERT_TRUE(successors);
+  ASSERT_EQ(1u, successors->size());
+  EXPECT_EQ(2, successors->find(2)->second);
+  EXPECT_EQ(7u, model.size());
+}
+
+TEST(VisitTransitionModelTest, IgnoresIrrelevantVisits) {
+  VisitTransitionModel model(
+      100,
+      base::TimeDelta::FromMilliseconds(kMinAgeMs),
+      base::TimeDelta::FromMilliseconds(kMaxAgeMs));
+  model.AddVisit(MakeVisit(1, 0), true, true);
+  // A back navigation neither counts as a visit nor as following 1, and a
+  // form submission only counts as a visit.
+  model.AddVisit(MakeVisit(2, 1000), false, true);
+  model.AddVisit(MakeVisit(3, 1000), true, false);
+
+  EXPECT_EQ(1, model.GetVisitCount(1));
+  EXPECT_EQ(0, model.GetVisitCount(2));
+  EXPECT_EQ(1, model.GetVisitCount(3));
+  EXPECT_EQ(NULL, model.GetSuccessors(1));
+  EXPECT_EQ(3u, model.size());
+}
+
+TEST(VisitTransitionModelTest, EvictsOldestVisits) {
+  VisitTransitionModel model(
+      3,
+      base::TimeDelta::FromMilliseconds(kMinAgeMs),
+      base::TimeDelta::FromMilliseconds(kMaxAgeMs));
+  model.AddVisit(MakeVisit(1, 0), true, true);
+  model.AddVisit(MakeVisit(2, 1000), true, true);
+  EXPECT_EQ(1u, model.GetSuccessors(1)->size());
+
+  model.AddVisit(MakeVisit(3, 2000), true, true);
+  model.AddVisit(MakeVisit(4, 3000), true, true);
+  EXPECT_EQ(3u, model.size());
+  EXPECT_EQ(0, model.GetVisitCount(1));
+  EXPECT_EQ(NULL, model.GetSuccessors(1));
+  EXPECT_EQ(1, model.GetVisitCount(2));
+  EXPECT_EQ(2u, model.GetSuccessors(2)->size());
+}
+
+// The counts must match scanning the visits in the history after every visit,
+// while visits are evicted.
+TEST(VisitTransitionModelTest, MatchesScanning) {
+  const size_t kMaxVisits = 50;
+  VisitTransitionModel model(
+      kMaxVisits,
+      base::TimeDelta::FromMilliseconds(kMinAgeMs),
+      base::TimeDelta::FromMilliseconds(kMaxAgeMs));
+  std::vector<TestVisit> visits;
+  SyntheticRandom random(1);
+  int time_ms = 0;
+  for (int i = 0; i < 1000; ++i) {
+    const uint32 value = random.Next();
+    time_ms += value % 2000;
+    TestVisit visit;
+    visit.info = MakeVisit(1 + value % 7, time_ms);
+    visit.can_follow = value % 11 != 0;
+    model.AddVisit(visit.info, true, visit.can_follow);
+    visits.push_back(visit);
+    if (visits.size() > kMaxVisits)
+      visits.erase(visits.begin());
+
+    for (URLID url_id = 1; url_id <= 7; ++url_id) {
+      VisitTransitionModel::SuccessorCounts expected;
+      EXPECT_EQ(CountByScanning(visits, url_id, &expected),
+                model.GetVisitCount(url_id));
+      const VisitTransitionModel::SuccessorCounts* successors =
+          model.GetSuccessors(url_id);
+      if (expected.empty())
+        EXPECT_EQ(NULL, successors);
+      else if (successors)
+        EXPECT_TRUE(expected == *successors) << "visit " << i;
+      else
+        ADD_FAILURE() << "visit " << i;
+    }
+  }
+}
+
+}  // namespace prerender
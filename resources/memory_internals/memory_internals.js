@@ -35,6 +35,7 @@ var MainView = (function() {
 
       this.updateSnapshot(browser['processes']);
       this.updateExtensions(browser['extensions']);
+      this.updateFaviconCaches(browser['favicon_caches']);
     },
 
     /**
@@ -127,6 +128,58 @@ var MainView = (function() {
         }
         row.setAttribute('class', 'extension');
       }
+    },
+
+    /**
+     * Update favicon cache information table.
+     * @param {Object} caches statistics of the favicon image caches.
+     */
+    updateFaviconCaches: function(caches) {
+      // Remove existing information.
+      var size =
+          $('favicon-cache-view').getElementsByClassName('favicon-cache')
+              .length;
+      for (var i = 0; i < size; ++i) {
+        $('favicon-cache-view').deleteRow(-1);
+      }
+
+      var template = $('favicon-cache-template').childNodes;
+      for (var c in caches) {
+        var cache = caches[c];
+
+        var row = $('favicon-cache-view').insertRow(-1);
+        // We skip |template[0]|, because it is a (invalid) Text object.
+        for (var i = 1; i < template.length; ++i) {
+          var value = '---';
+          switch (template[i].className) {
+          case 'favicon-cache-profile':
+            value = HTMLEscape(cache['profile']);
+            break;
+          case 'favicon-cache-bucket':
+            value = cache['bucket'];
+            break;
+          case 'favicon-cache-hit-rate':
+            value = cache['hit_rate'].toFixed(1);
+            break;
+          case 'favicon-cache-lookups':
+            value = cache['hits'] + ' / ' + cache['misses'];
+            break;
+          case 'favicon-cache-entries':
+            value = cache['entries'];
+            break;
+          case 'favicon-cache-evictions':
+            value = cache['evictions'];
+            break;
+          case 'favicon-cache-memory':
+            value = cache['memory'] + '<br>/ ' + cache['memory_limit'];
+            break;
+          }
+          var col = row.insertCell(-1);
+          col.innerHTML = value;
+          col.className = template[i].className;
+        }
+        row.setAttribute('class', 'favicon-cache');
+      }
     }
   };
 
@@ -306,6 +306,21 @@ define('main', [
             result.is_typed_host;
       }
       output.appendChild(p3);
+      var cacheStats = result.hqp_intersection_cache_stats;
+      if (cacheStats) {
+        // Only present when the HistoryQuick provider's intersection cache
+        // is enabled.
+        var lookups = cacheStats.hits + cacheStats.misses;
+        var hitRate = lookups ?
+            (100 * cacheStats.hits / lookups).toFixed(1) + '%' : 'n/a';
+        var p4 = document.createElement('p');
+        p4.textContent = 'HQP intersection cache: hit rate = ' + hitRate +
+            ' (' + cacheStats.hits + ' hits, ' + cacheStats.misses +
+            ' misses, ' + cacheStats.stale_hits + ' stale), ' +
+            cacheStats.entry_count + ' entries, ' + cacheStats.bytes +
+            ' of ' + cacheStats.max_bytes + ' bytes';
+        output.appendChild(p4);
+      }
     }
 
     // Combined results go after the lines below.
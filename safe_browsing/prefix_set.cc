@@ -12,6 +12,14 @@
 #include "base/md5.h"
 #include "base/metrics/histogram.h"
 #include "base/metrics/sparse_histogram.h"
+#include "build/build_config.h"
+
+// SSE2 is part of x86-64, and 32-bit builds enable it explicitly.
+#if defined(ARCH_CPU_X86_FAMILY) && \
+    (defined(ARCH_CPU_64_BITS) || defined(__SSE2__))
+#define PREFIX_SET_USE_SSE2
+#include <emmintrin.h>
+#endif
 
 namespace {
 
@@ -85,12 +93,6 @@ size_t EstimateFinalCount(SBPrefix current_prefix, size_t current_count) {
 
 namespace safe_browsing {
 
-// For |std::upper_bound()| to find a prefix w/in a vector of pairs.
-// static
-bool PrefixSet::PrefixLess(const IndexPair& a, const IndexPair& b) {
-  return a.first < b.first;
-}
-
 PrefixSet::PrefixSet() {
 }
 
@@ -101,40 +103,153 @@ PrefixSet::PrefixSet(IndexVector* index,
   index_.swap(*index);
   deltas_.swap(*deltas);
   full_hashes_.swap(*full_hashes);
+  BuildBlockTree();
 }
 
 PrefixSet::~PrefixSet() {}
 
-bool PrefixSet::PrefixExists(SBPrefix prefix) const {
+void PrefixSet::BuildBlockTree() {
+  block_tree_.clear();
+  block_tree_blocks_.clear();
   if (index_.empty())
-    return false;
+    return;
+
+  const size_t block_count =
+      (index_.size() + kIndexBlockSize - 1) / kIndexBlockSize;
+  block_tree_.resize(block_count + 1);
+  block_tree_blocks_.resize(block_count + 1);
+  size_t block = 0;
+  FillBlockTree(1, &block);
+  DCHECK_EQ(block_count, block);
+}
+
+void PrefixSet::FillBlockTree(size_t node, size_t* block) {
+  if (node >= block_tree_.size())
+    return;
 
-  // Find the first position after |prefix| in |index_|.
-  IndexVector::const_iterator iter =
-      std::upper_bound(index_.begin(), index_.end(),
-                       IndexPair(prefix, 0), PrefixLess);
+  FillBlockTree(2 * node, block);
+  block_tree_[node] = index_[*block * kIndexBlockSize].first;
+  block_tree_blocks_[node] = static_cast<uint32>(*block);
+  ++*block;
+  FillBlockTree(2 * node + 1, block);
+}
 
-  // |prefix| comes before anything that's in the set.
-  if (iter == index_.begin())
+bool PrefixSet::FindIndexEntry(SBPrefix prefix, size_t* index_pos) const {
+  if (index_.empty())
+    return false;
+  DCHECK_GT(block_tree_.size(), 1U);
+
+  // Walk down the tree, going right while the node's prefix is not greater
+  // than |prefix|.  The top levels share a few cache lines, so only the last
+  // few steps are likely to miss.
+  const size_t tree_size = block_tree_.size();
+  size_t node = 1;
+  while (node < tree_size)
+    node = 2 * node + (block_tree_[node] <= prefix ? 1 : 0);
+
+  // Back out of the trailing right turns and the left turn before them, which
+  // leaves the first node greater than |prefix|.  No such node leaves zero.
+  while (node & 1)
+    node >>= 1;
+  node >>= 1;
+
+  size_t block;
+  if (node == 0) {
+    block = tree_size - 2;
+  } else if (block_tree_blocks_[node] == 0) {
+    // |prefix| comes before anything that's in the set.
     return false;
+  } else {
+    block = block_tree_blocks_[node] - 1;
+  }
 
-  // Capture the upper bound of our target entry's deltas.
-  const size_t bound = (iter == index_.end() ? deltas_.size() : iter->second);
+  // Find the entry within the block.
+  size_t pos = block * kIndexBlockSize;
+  const size_t block_end = std::min(pos + kIndexBlockSize, index_.size());
+  while (pos + 1 < block_end && index_[pos + 1].first <= prefix)
+    ++pos;
+  DCHECK_LE(index_[pos].first, prefix);
 
-  // Back up to the entry our target is in.
-  --iter;
+  *index_pos = pos;
+  return true;
+}
 
-  // All prefixes in |index_| are in the set.
-  SBPrefix current = iter->first;
-  if (current == prefix)
-    return true;
+// static
+bool PrefixSet::RunContainsScalar(const uint16* deltas, size_t count,
+                                  uint32 target) {
+  uint32 current = 0;
+  for (size_t i = 0; i < count && current < target; ++i) {
+    current += deltas[i];
+  }
+  return current == target;
+}
+
+// static
+bool PrefixSet::RunContains(const uint16* deltas, size_t count,
+                            uint32 target) {
+#if defined(PREFIX_SET_USE_SSE2)
+  // The comparisons are signed, so only use SSE2 when no running sum or
+  // target can reach 2^31.  Runs are limited to kMaxRun, so this is always
+  // true for sets built by |PrefixSetBuilder|.
+  if (count < 32768 && target < 0x80000000U) {
+    // The empty run sums to zero.
+    if (target == 0)
+      return true;
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i targets = _mm_set1_epi32(static_cast<int32>(target));
+    __m128i carry = zero;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+      // Widen eight deltas to 32 bits and turn each half into running sums.
+      const __m128i d =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(deltas + i));
+      __m128i lo = _mm_unpacklo_epi16(d, zero);
+      lo = _mm_add_epi32(lo, _mm_slli_si128(lo, 4));
+      lo = _mm_add_epi32(lo, _mm_slli_si128(lo, 8));
+      lo = _mm_add_epi32(lo, carry);
+      carry = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 3, 3, 3));
+      __m128i hi = _mm_unpackhi_epi16(d, zero);
+      hi = _mm_add_epi32(hi, _mm_slli_si128(hi, 4));
+      hi = _mm_add_epi32(hi, _mm_slli_si128(hi, 8));
+      hi = _mm_add_epi32(hi, carry);
+      carry = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 3, 3, 3));
+
+      const __m128i matches = _mm_or_si128(_mm_cmpeq_epi32(lo, targets),
+                                           _mm_cmpeq_epi32(hi, targets));
+      if (_mm_movemask_epi8(matches))
+        return true;
+      // The sums never decrease, so once one passes |target| nothing after it
+      // can match.
+      if (_mm_movemask_epi8(_mm_cmpgt_epi32(carry, targets)))
+        return false;
+    }
 
-  // Scan forward accumulating deltas while a match is possible.
-  for (size_t di = iter->second; di < bound && current < prefix; ++di) {
-    current += deltas_[di];
+    uint32 current = static_cast<uint32>(_mm_cvtsi128_si32(carry));
+    for (; i < count && current < target; ++i) {
+      current += deltas[i];
+    }
+    return current == target;
   }
+#endif
+  return RunContainsScalar(deltas, count, target);
+}
 
-  return current == prefix;
+bool PrefixSet::PrefixExists(SBPrefix prefix) const {
+  size_t ii;
+  if (!FindIndexEntry(prefix, &ii))
+    return false;
+
+  // All prefixes in |index_| are in the set.
+  const SBPrefix base = index_[ii].first;
+  if (base == prefix)
+    return true;
+
+  const size_t begin = index_[ii].second;
+  const size_t end = DeltasEnd(ii);
+  if (begin >= end)
+    return false;
+  return RunContains(&deltas_[begin], end - begin, prefix - base);
 }
 
 bool PrefixSet::Exists(const SBFullHash& hash) const {
@@ -145,6 +260,51 @@ bool PrefixSet::Exists(const SBFullHash& hash) const {
   return PrefixExists(hash.prefix);
 }
 
+void PrefixSet::GetPrefixHits(const std::vector<SBFullHash>& hashes,
+                              std::vector<SBPrefix>* prefix_hits) const {
+  // Visit the prefixes in sorted order, remembering where each came from.
+  std::vector<std::pair<SBPrefix, size_t> > prefixes;
+  prefixes.reserve(hashes.size());
+  for (size_t i = 0; i < hashes.size(); ++i) {
+    prefixes.push_back(std::make_pair(hashes[i].prefix, i));
+  }
+  std::sort(prefixes.begin(), prefixes.end());
+
+  // |current| is the prefix reached by decoding the deltas of |index_[ii]| up
+  // to |di|.  Later prefixes in the same run continue from there.
+  std::vector<bool> hits(hashes.size(), false);
+  bool in_run = false;
+  size_t ii = 0;
+  size_t di = 0;
+  size_t run_end = 0;
+  SBPrefix current = 0;
+  for (size_t i = 0; i < prefixes.size(); ++i) {
+    const SBPrefix prefix = prefixes[i].first;
+    if (!in_run ||
+        (ii + 1 < index_.size() && index_[ii + 1].first <= prefix)) {
+      if (!FindIndexEntry(prefix, &ii))
+        continue;
+      in_run = true;
+      current = index_[ii].first;
+      di = index_[ii].second;
+      run_end = DeltasEnd(ii);
+    }
+    while (di < run_end && current < prefix) {
+      current += deltas_[di++];
+    }
+    if (current == prefix)
+      hits[prefixes[i].second] = true;
+  }
+
+  for (size_t i = 0; i < hashes.size(); ++i) {
+    if (hits[i] ||
+        std::binary_search(full_hashes_.begin(), full_hashes_.end(),
+                           hashes[i], SBFullHashLess)) {
+      prefix_hits->push_back(hashes[i].prefix);
+    }
+  }
+}
+
 void PrefixSet::GetPrefixes(std::vector<SBPrefix>* prefixes) const {
   prefixes->reserve(index_.size() + deltas_.size());
 
@@ -416,6 +576,7 @@ scoped_ptr<PrefixSet> PrefixSetBuilder::GetPrefixSet(
   // Precisely size |index_| for read-only.  It's 50k-60k, so minor savings, but
   // they're almost free.
   PrefixSet::IndexVector(prefix_set_->index_).swap(prefix_set_->index_);
+  prefix_set_->BuildBlockTree();
 
   prefix_set_->full_hashes_ = hashes;
   std::sort(prefix_set_->full_hashes_.begin(), prefix_set_->full_hashes_.end(),
@@ -37,6 +37,14 @@
 // 2^16 apart, which would need 512k (versus 256k to store the raw
 // data).
 //
+// Lookups do not search |index_| directly.  Every kIndexBlockSize-th index
+// prefix, one per cache line of |index_|, is copied into a small search tree
+// laid out in breadth-first (Eytzinger) order.  The upper levels of the tree
+// share a few cache lines, so a lookup walks the tree, scans one block of
+// |index_|, then decodes one run of deltas.  On SSE2 the run is decoded eight
+// deltas at a time.  The tree is derived from |index_| when the set is built
+// or loaded and is not stored on disk.
+//
 // The on-disk format looks like:
 //         4 byte magic number
 //         4 byte version number
@@ -70,6 +78,14 @@ class PrefixSet {
   // |hash.prefix| is one of the prefixes passed to the set's builder.
   bool Exists(const SBFullHash& hash) const;
 
+  // Appends to |prefix_hits| the prefix of each item in |hashes| for which
+  // Exists() is true, in the order of |hashes|.  This is meant for checking
+  // all the host/path combinations of a URL together.  The hashes are looked
+  // up in prefix order, so the set is walked forward once, and a run holding
+  // several of them is decoded only once.
+  void GetPrefixHits(const std::vector<SBFullHash>& hashes,
+                     std::vector<SBPrefix>* prefix_hits) const;
+
   // Persist the set on disk.
   static scoped_ptr<PrefixSet> LoadFile(const base::FilePath& filter_name);
   bool WriteFile(const base::FilePath& filter_name) const;
@@ -86,6 +102,7 @@ class PrefixSet {
   FRIEND_TEST_ALL_PREFIXES(PrefixSetTest, OneElement);
   FRIEND_TEST_ALL_PREFIXES(PrefixSetTest, ReadWrite);
   FRIEND_TEST_ALL_PREFIXES(PrefixSetTest, ReadWriteSigned);
+  FRIEND_TEST_ALL_PREFIXES(PrefixSetTest, RunContains);
   FRIEND_TEST_ALL_PREFIXES(PrefixSetTest, Version3);
 
   FRIEND_TEST_ALL_PREFIXES(SafeBrowsingStoreFileTest, BasicStore);
@@ -103,10 +120,13 @@ class PrefixSet {
   // for |Exists()| under control.
   static const size_t kMaxRun = 100;
 
+  // Number of |index_| entries per block of the search tree.  Eight
+  // |IndexPair|s fill a 64-byte cache line.
+  static const size_t kIndexBlockSize = 8;
+
   // Helpers to make |index_| easier to deal with.
   typedef std::pair<SBPrefix, uint32> IndexPair;
   typedef std::vector<IndexPair> IndexVector;
-  static bool PrefixLess(const IndexPair& a, const IndexPair& b);
 
   // Helper to let |PrefixSetBuilder| add a run of data.  |index_prefix| is
   // added to |index_|, with the other elements added into |deltas_|.
@@ -117,6 +137,31 @@ class PrefixSet {
   // Provided for testing purposes.
   bool PrefixExists(SBPrefix prefix) const;
 
+  // Rebuild |block_tree_| and |block_tree_blocks_| from |index_|.
+  void BuildBlockTree();
+
+  // Helper for |BuildBlockTree()|.  Fills the subtree rooted at |node| in
+  // order, starting with block |*block|.
+  void FillBlockTree(size_t node, size_t* block);
+
+  // Find the last entry in |index_| whose prefix is not greater than |prefix|,
+  // returning its position in |*index_pos|.  Returns |false| if |prefix| comes
+  // before everything in the set.
+  bool FindIndexEntry(SBPrefix prefix, size_t* index_pos) const;
+
+  // The end of the deltas for |index_[index_pos]|.
+  size_t DeltasEnd(size_t index_pos) const {
+    return index_pos + 1 < index_.size() ?
+        index_[index_pos + 1].second : deltas_.size();
+  }
+
+  // |true| if one of the running sums of |deltas[0..count)| is |target|.  The
+  // sums only increase, so the scan stops once they pass |target|.  Uses SSE2
+  // where available, falling back to |RunContainsScalar()|.
+  static bool RunContains(const uint16* deltas, size_t count, uint32 target);
+  static bool RunContainsScalar(const uint16* deltas, size_t count,
+                                uint32 target);
+
   // Regenerate the vector of prefixes passed to the constructor into
   // |prefixes|.  Prefixes will be added in sorted order.  Useful for testing.
   void GetPrefixes(std::vector<SBPrefix>* prefixes) const;
@@ -143,6 +188,13 @@ class PrefixSet {
   // Full hashes ordered by SBFullHashLess.
   std::vector<SBFullHash> full_hashes_;
 
+  // Search tree over the first prefix of each block of |index_|, in
+  // breadth-first order from position 1 (position 0 is unused).  The children
+  // of node k are 2k and 2k+1.  |block_tree_blocks_| holds the block number
+  // of each node.
+  std::vector<SBPrefix> block_tree_;
+  std::vector<uint32> block_tree_blocks_;
+
   DISALLOW_COPY_AND_ASSIGN(PrefixSet);
 };
 
@@ -631,6 +631,110 @@ TEST_F(PrefixSetTest, FullHashBuild) {
   EXPECT_FALSE(prefix_set->PrefixExists(kHash6.prefix));
 }
 
+// Test that the batch lookup agrees with Exists(), and reports hits in the
+// order of the input.
+TEST_F(PrefixSetTest, GetPrefixHits) {
+  const SBFullHash kHash1 = SBFullHashForString("one");
+  const SBFullHash kHash2 = SBFullHashForString("two");
+  std::vector<SBFullHash> full_hashes;
+  full_hashes.push_back(kHash1);
+  full_hashes.push_back(kHash2);
+
+  PrefixSetBuilder builder(shared_prefixes_);
+  scoped_ptr<PrefixSet> prefix_set = builder.GetPrefixSet(full_hashes);
+
+  // Look up each prefix with its neighbors, plus the full hashes, in an order
+  // which does not match the set's.
+  std::vector<SBFullHash> hashes;
+  hashes.push_back(kHash2);
+  for (size_t i = shared_prefixes_.size(); i > 0; --i) {
+    SBFullHash hash = kHash1;
+    hash.prefix = shared_prefixes_[i - 1] + 1;
+    hashes.push_back(hash);
+    hash.prefix = shared_prefixes_[i - 1];
+    hashes.push_back(hash);
+    hashes.push_back(hash);
+    hash.prefix = shared_prefixes_[i - 1] - 1;
+    hashes.push_back(hash);
+  }
+  hashes.push_back(kHash1);
+
+  std::vector<SBPrefix> expected;
+  for (size_t i = 0; i < hashes.size(); ++i) {
+    if (prefix_set->Exists(hashes[i]))
+      expected.push_back(hashes[i].prefix);
+  }
+  EXPECT_GE(expected.size(), 2 * shared_prefixes_.size() + 2);
+
+  std::vector<SBPrefix> prefix_hits;
+  prefix_set->GetPrefixHits(hashes, &prefix_hits);
+  EXPECT_EQ(expected, prefix_hits);
+
+  // Prefixes before and after everything in the set.
+  hashes.clear();
+  SBFullHash hash = kHash1;
+  hash.prefix = 0;
+  hashes.push_back(hash);
+  hash.prefix = ~static_cast<SBPrefix>(0);
+  hashes.push_back(hash);
+  expected.clear();
+  for (size_t i = 0; i < hashes.size(); ++i) {
+    if (prefix_set->Exists(hashes[i]))
+      expected.push_back(hashes[i].prefix);
+  }
+  prefix_hits.clear();
+  prefix_set->GetPrefixHits(hashes, &prefix_hits);
+  EXPECT_EQ(expected, prefix_hits);
+
+  // An empty set has no hits.
+  scoped_ptr<PrefixSet> empty_set = PrefixSetBuilder().GetPrefixSetNoHashes();
+  prefix_hits.clear();
+  empty_set->GetPrefixHits(hashes, &prefix_hits);
+  EXPECT_TRUE(prefix_hits.empty());
+}
+
+// Test that the vectorized run decoder matches the plain loop, including for
+// runs which do not fill whole vectors and runs containing zero deltas.
+TEST_F(PrefixSetTest, RunContains) {
+  for (size_t count = 0; count <= 2 * PrefixSet::kMaxRun; ++count) {
+    std::vector<uint16> deltas(count + 1);
+    for (size_t i = 0; i < count; ++i) {
+      deltas[i] = static_cast<uint16>(base::RandUint64());
+      if (i % 7 == 0)
+        deltas[i] &= 0xFF;
+      if (i % 11 == 0)
+        deltas[i] = 0;
+    }
+
+    uint32 total = 0;
+    for (size_t i = 0; i < count; ++i) {
+      total += deltas[i];
+    }
+
+    // Check every sum, its neighbors, and a sample of other values.
+    std::vector<uint32> targets;
+    uint32 sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+      sum += deltas[i];
+      targets.push_back(sum - 1);
+      targets.push_back(sum);
+      targets.push_back(sum + 1);
+    }
+    for (size_t i = 0; i < 100; ++i) {
+      targets.push_back(static_cast<uint32>(base::RandUint64() % (total + 2)));
+    }
+    targets.push_back(0x7FFFFFFFU);
+    targets.push_back(0x80000000U);
+    targets.push_back(~0U);
+
+    for (size_t i = 0; i < targets.size(); ++i) {
+      EXPECT_EQ(PrefixSet::RunContainsScalar(&deltas[0], count, targets[i]),
+                PrefixSet::RunContains(&deltas[0], count, targets[i]))
+          << "count " << count << ", target " << targets[i];
+    }
+  }
+}
+
 // Test that a version 1 file is discarded on read.
 TEST_F(PrefixSetTest, ReadSigned) {
   base::FilePath filename;
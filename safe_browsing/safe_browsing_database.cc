@@ -446,9 +446,56 @@ void SafeBrowsingDatabase::RecordFailure(FailureType failure_type) {
                             FAILURE_DATABASE_MAX);
 }
 
+SafeBrowsingDatabaseNew::SharedPrefixSet::SharedPrefixSet(
+    scoped_ptr<safe_browsing::PrefixSet> prefix_set)
+    : prefix_set_(prefix_set.Pass()) {
+  DCHECK(prefix_set_.get());
+}
+
+SafeBrowsingDatabaseNew::SharedPrefixSet::~SharedPrefixSet() {}
+
+SafeBrowsingDatabaseNew::PrefixMissCache::PrefixMissCache() {}
+
+SafeBrowsingDatabaseNew::PrefixMissCache::~PrefixMissCache() {}
+
+void SafeBrowsingDatabaseNew::PrefixMissCache::Insert(
+    const std::vector<SBPrefix>& prefixes) {
+  for (size_t i = 0; i < prefixes.size(); ++i) {
+    Shard& shard = shards_[prefixes[i] % kShardCount];
+    base::AutoLock locked(shard.lock);
+    shard.prefixes.insert(prefixes[i]);
+  }
+}
+
+bool SafeBrowsingDatabaseNew::PrefixMissCache::Contains(
+    SBPrefix prefix) const {
+  const Shard& shard = shards_[prefix % kShardCount];
+  base::AutoLock locked(shard.lock);
+  return shard.prefixes.count(prefix) > 0;
+}
+
+void SafeBrowsingDatabaseNew::PrefixMissCache::Clear() {
+  for (size_t i = 0; i < kShardCount; ++i) {
+    base::AutoLock locked(shards_[i].lock);
+    shards_[i].prefixes.clear();
+  }
+}
+
+size_t SafeBrowsingDatabaseNew::PrefixMissCache::size() const {
+  size_t count = 0;
+  for (size_t i = 0; i < kShardCount; ++i) {
+    base::AutoLock locked(shards_[i].lock);
+    count += shards_[i].prefixes.size();
+  }
+  return count;
+}
+
 SafeBrowsingDatabaseNew::SafeBrowsingDatabaseNew()
     : creation_loop_(base::MessageLoop::current()),
       browse_store_(new SafeBrowsingStoreFile),
+      csd_whitelist_(new SharedWhitelist),
+      download_whitelist_(new SharedWhitelist),
+      ip_blacklist_(new SharedIPBlacklist),
       reset_factory_(this),
       corruption_detected_(false),
       change_detected_(false) {
@@ -477,6 +524,9 @@ SafeBrowsingDatabaseNew::SafeBrowsingDatabaseNew(
       extension_blacklist_store_(extension_blacklist_store),
       side_effect_free_whitelist_store_(side_effect_free_whitelist_store),
       ip_blacklist_store_(ip_blacklist_store),
+      csd_whitelist_(new SharedWhitelist),
+      download_whitelist_(new SharedWhitelist),
+      ip_blacklist_(new SharedIPBlacklist),
       reset_factory_(this),
       corruption_detected_(false) {
   DCHECK(browse_store_.get());
@@ -514,8 +564,8 @@ void SafeBrowsingDatabaseNew::Init(const base::FilePath& filename_base) {
     // contention on the lock...
     base::AutoLock locked(lookup_lock_);
     cached_browse_hashes_.clear();
-    LoadPrefixSet();
   }
+  LoadPrefixSet();
 
   if (download_store_.get()) {
     download_store_->Init(
@@ -576,13 +626,18 @@ void SafeBrowsingDatabaseNew::Init(const base::FilePath& filename_base) {
     // Only use the prefix set if database is present and non-empty.
     if (GetFileSizeOrZero(side_effect_free_whitelist_filename)) {
       const base::TimeTicks before = base::TimeTicks::Now();
-      side_effect_free_whitelist_prefix_set_ =
+      scoped_ptr<safe_browsing::PrefixSet> prefix_set =
           safe_browsing::PrefixSet::LoadFile(
               side_effect_free_whitelist_prefix_set_filename);
       UMA_HISTOGRAM_TIMES("SB2.SideEffectFreeWhitelistPrefixSetLoad",
                           base::TimeTicks::Now() - before);
-      if (!side_effect_free_whitelist_prefix_set_.get())
+      if (prefix_set.get()) {
+        scoped_refptr<SharedPrefixSet> shared(
+            new SharedPrefixSet(prefix_set.Pass()));
+        SwapShared(&side_effect_free_whitelist_prefix_set_, &shared);
+      } else {
         RecordFailure(FAILURE_SIDE_EFFECT_FREE_WHITELIST_PREFIX_SET_READ);
+      }
     }
   } else {
     // Delete any files of the side-effect free sidelist that may be around
@@ -618,14 +673,19 @@ bool SafeBrowsingDatabaseNew::ResetDatabase() {
   if (!Delete())
     return false;
 
-  // Reset objects in memory.
+  // Reset objects in memory.  The old lookup structures are released after
+  // the lock, when these go out of scope.
+  scoped_refptr<SharedPrefixSet> browse_prefix_set;
+  scoped_refptr<SharedPrefixSet> side_effect_free_whitelist_prefix_set;
+  scoped_refptr<SharedIPBlacklist> ip_blacklist(new SharedIPBlacklist);
   {
     base::AutoLock locked(lookup_lock_);
     cached_browse_hashes_.clear();
-    prefix_miss_cache_.clear();
-    browse_prefix_set_.reset();
-    side_effect_free_whitelist_prefix_set_.reset();
-    ip_blacklist_.clear();
+    prefix_miss_cache_.Clear();
+    browse_prefix_set_.swap(browse_prefix_set);
+    side_effect_free_whitelist_prefix_set_.swap(
+        side_effect_free_whitelist_prefix_set);
+    ip_blacklist_.swap(ip_blacklist);
   }
   // Wants to acquire the lock itself.
   WhitelistEverything(&csd_whitelist_);
@@ -646,24 +706,25 @@ bool SafeBrowsingDatabaseNew::ContainsBrowseUrl(
   if (full_hashes.empty())
     return false;
 
-  // This function is called on the I/O thread, prevent changes to
-  // filter and caches.
-  base::AutoLock locked(lookup_lock_);
+  // This function is called on the I/O thread.  The prefix set it searches
+  // is not changed while it holds a reference, so updates can swap in a new
+  // one without waiting for it.
+  scoped_refptr<SharedPrefixSet> browse_prefix_set =
+      GetShared(browse_prefix_set_);
 
   // |browse_prefix_set_| is empty until it is either read from disk, or the
   // first update populates it.  Bail out without a hit if not yet
   // available.
-  if (!browse_prefix_set_.get())
+  if (!browse_prefix_set.get())
     return false;
 
+  // Check all of the URL's host/path combinations in one pass over the set.
+  browse_prefix_set->prefix_set().GetPrefixHits(full_hashes, prefix_hits);
+
   size_t miss_count = 0;
-  for (size_t i = 0; i < full_hashes.size(); ++i) {
-    if (browse_prefix_set_->Exists(full_hashes[i])) {
-      const SBPrefix prefix = full_hashes[i].prefix;
-      prefix_hits->push_back(prefix);
-      if (prefix_miss_cache_.count(prefix) > 0)
-        ++miss_count;
-    }
+  for (size_t i = 0; i < prefix_hits->size(); ++i) {
+    if (prefix_miss_cache_.Contains((*prefix_hits)[i]))
+      ++miss_count;
   }
 
   // If all the prefixes are cached as 'misses', don't issue a GetHash.
@@ -672,6 +733,7 @@ bool SafeBrowsingDatabaseNew::ContainsBrowseUrl(
 
   // Find matching cached gethash responses.
   std::sort(prefix_hits->begin(), prefix_hits->end());
+  base::AutoLock locked(lookup_lock_);
   GetCachedFullHashesForBrowse(*prefix_hits, cached_browse_hashes_, cache_hits);
 
   return true;
@@ -700,13 +762,14 @@ bool SafeBrowsingDatabaseNew::ContainsCsdWhitelistedUrl(const GURL& url) {
   DCHECK(BrowserThread::CurrentlyOn(BrowserThread::IO));
   std::vector<SBFullHash> full_hashes;
   BrowseFullHashesToCheck(url, true, &full_hashes);
-  return ContainsWhitelistedHashes(csd_whitelist_, full_hashes);
+  return ContainsWhitelistedHashes(*GetShared(csd_whitelist_), full_hashes);
 }
 
 bool SafeBrowsingDatabaseNew::ContainsDownloadWhitelistedUrl(const GURL& url) {
   std::vector<SBFullHash> full_hashes;
   BrowseFullHashesToCheck(url, true, &full_hashes);
-  return ContainsWhitelistedHashes(download_whitelist_, full_hashes);
+  return ContainsWhitelistedHashes(*GetShared(download_whitelist_),
+                                   full_hashes);
 }
 
 bool SafeBrowsingDatabaseNew::ContainsExtensionPrefixes(
@@ -733,16 +796,17 @@ bool SafeBrowsingDatabaseNew::ContainsSideEffectFreeWhitelistUrl(
     url_to_check +=  "?" + query;
   SBFullHash full_hash = SBFullHashForString(url_to_check);
 
-  // This function can be called on any thread, so lock against any changes
-  base::AutoLock locked(lookup_lock_);
+  // This function can be called on any thread.
+  scoped_refptr<SharedPrefixSet> prefix_set =
+      GetShared(side_effect_free_whitelist_prefix_set_);
 
   // |side_effect_free_whitelist_prefix_set_| is empty until it is either read
   // from disk, or the first update populates it.  Bail out without a hit if
   // not yet available.
-  if (!side_effect_free_whitelist_prefix_set_.get())
+  if (!prefix_set.get())
     return false;
 
-  return side_effect_free_whitelist_prefix_set_->Exists(full_hash);
+  return prefix_set->prefix_set().Exists(full_hash);
 }
 
 bool SafeBrowsingDatabaseNew::ContainsMalwareIP(const std::string& ip_address) {
@@ -755,9 +819,9 @@ bool SafeBrowsingDatabaseNew::ContainsMalwareIP(const std::string& ip_address) {
     return false;  // better safe than sorry.
 
   // This function can be called from any thread.
-  base::AutoLock locked(lookup_lock_);
-  for (IPBlacklist::const_iterator it = ip_blacklist_.begin();
-       it != ip_blacklist_.end();
+  scoped_refptr<SharedIPBlacklist> ip_blacklist = GetShared(ip_blacklist_);
+  for (IPBlacklist::const_iterator it = ip_blacklist->data.begin();
+       it != ip_blacklist->data.end();
        ++it) {
     const std::string& mask = it->first;
     DCHECK_EQ(mask.size(), ip_number.size());
@@ -782,18 +846,19 @@ bool SafeBrowsingDatabaseNew::ContainsDownloadWhitelistedString(
     const std::string& str) {
   std::vector<SBFullHash> hashes;
   hashes.push_back(SBFullHashForString(str));
-  return ContainsWhitelistedHashes(download_whitelist_, hashes);
+  return ContainsWhitelistedHashes(*GetShared(download_whitelist_), hashes);
 }
 
+// static
 bool SafeBrowsingDatabaseNew::ContainsWhitelistedHashes(
-    const SBWhitelist& whitelist,
+    const SharedWhitelist& whitelist,
     const std::vector<SBFullHash>& hashes) {
-  base::AutoLock l(lookup_lock_);
-  if (whitelist.second)
+  if (whitelist.data.second)
     return true;
+  const std::vector<SBFullHash>& full_hashes = whitelist.data.first;
   for (std::vector<SBFullHash>::const_iterator it = hashes.begin();
        it != hashes.end(); ++it) {
-    if (std::binary_search(whitelist.first.begin(), whitelist.first.end(),
+    if (std::binary_search(full_hashes.begin(), full_hashes.end(),
                            *it, SBFullHashLess)) {
       return true;
     }
@@ -940,14 +1005,14 @@ void SafeBrowsingDatabaseNew::CacheHashResults(
     const base::TimeDelta& cache_lifetime) {
   const base::Time expire_after = base::Time::Now() + cache_lifetime;
 
-  // This is called on the I/O thread, lock against updates.
-  base::AutoLock locked(lookup_lock_);
-
   if (full_hits.empty()) {
-    prefix_miss_cache_.insert(prefixes.begin(), prefixes.end());
+    prefix_miss_cache_.Insert(prefixes);
     return;
   }
 
+  // This is called on the I/O thread, lock against updates.
+  base::AutoLock locked(lookup_lock_);
+
   const size_t orig_size = cached_browse_hashes_.size();
   for (std::vector<SBFullHashResult>::const_iterator iter = full_hits.begin();
        iter != full_hits.end(); ++iter) {
@@ -1155,7 +1220,7 @@ void SafeBrowsingDatabaseNew::UpdateFinished(bool update_succeeded) {
 void SafeBrowsingDatabaseNew::UpdateWhitelistStore(
     const base::FilePath& store_filename,
     SafeBrowsingStore* store,
-    SBWhitelist* whitelist) {
+    scoped_refptr<SharedWhitelist>* whitelist) {
   if (!store)
     return;
 
@@ -1230,10 +1295,11 @@ void SafeBrowsingDatabaseNew::UpdateBrowseStore() {
     full_hash_results.push_back(add_full_hashes[i].full_hash);
   }
 
-  scoped_ptr<safe_browsing::PrefixSet>
-      prefix_set(builder.GetPrefixSet(full_hash_results));
+  scoped_refptr<SharedPrefixSet> prefix_set(
+      new SharedPrefixSet(builder.GetPrefixSet(full_hash_results)));
 
-  // Swap in the newly built filter and cache.
+  // Swap in the newly built filter and cache.  Lookups still using the old
+  // filter keep it alive until they finish.
   {
     base::AutoLock locked(lookup_lock_);
 
@@ -1243,7 +1309,7 @@ void SafeBrowsingDatabaseNew::UpdateBrowseStore() {
     // at the earlier point.  I believe that is fail-safe as-is (the
     // hash will be fetched again).
     cached_browse_hashes_.clear();
-    prefix_miss_cache_.clear();
+    prefix_miss_cache_.Clear();
     browse_prefix_set_.swap(prefix_set);
   }
 
@@ -1288,22 +1354,20 @@ void SafeBrowsingDatabaseNew::UpdateSideEffectFreeWhitelistStore() {
     RecordFailure(FAILURE_SIDE_EFFECT_FREE_WHITELIST_UPDATE_FINISH);
     return;
   }
-  scoped_ptr<safe_browsing::PrefixSet>
-      prefix_set(builder.GetPrefixSetNoHashes());
+  scoped_refptr<SharedPrefixSet> prefix_set(
+      new SharedPrefixSet(builder.GetPrefixSetNoHashes()));
 
   // Swap in the newly built prefix set.
-  {
-    base::AutoLock locked(lookup_lock_);
-    side_effect_free_whitelist_prefix_set_.swap(prefix_set);
-  }
+  SwapShared(&side_effect_free_whitelist_prefix_set_, &prefix_set);
 
   const base::FilePath side_effect_free_whitelist_filename =
       SideEffectFreeWhitelistDBFilename(filename_base_);
   const base::FilePath side_effect_free_whitelist_prefix_set_filename =
       PrefixSetForFilename(side_effect_free_whitelist_filename);
   const base::TimeTicks before = base::TimeTicks::Now();
-  const bool write_ok = side_effect_free_whitelist_prefix_set_->WriteFile(
-      side_effect_free_whitelist_prefix_set_filename);
+  const bool write_ok =
+      side_effect_free_whitelist_prefix_set_->prefix_set().WriteFile(
+          side_effect_free_whitelist_prefix_set_filename);
   UMA_HISTOGRAM_TIMES("SB2.SideEffectFreePrefixSetWrite",
                       base::TimeTicks::Now() - before);
 
@@ -1388,12 +1452,16 @@ void SafeBrowsingDatabaseNew::LoadPrefixSet() {
   base::DeleteFile(bloom_filter_filename, false);
 
   const base::TimeTicks before = base::TimeTicks::Now();
-  browse_prefix_set_ = safe_browsing::PrefixSet::LoadFile(
-      browse_prefix_set_filename);
+  scoped_ptr<safe_browsing::PrefixSet> prefix_set =
+      safe_browsing::PrefixSet::LoadFile(browse_prefix_set_filename);
   UMA_HISTOGRAM_TIMES("SB2.PrefixSetLoad", base::TimeTicks::Now() - before);
 
-  if (!browse_prefix_set_.get())
+  if (!prefix_set.get()) {
     RecordFailure(FAILURE_BROWSE_PREFIX_SET_READ);
+    return;
+  }
+  scoped_refptr<SharedPrefixSet> shared(new SharedPrefixSet(prefix_set.Pass()));
+  SwapShared(&browse_prefix_set_, &shared);
 }
 
 bool SafeBrowsingDatabaseNew::Delete() {
@@ -1482,7 +1550,7 @@ void SafeBrowsingDatabaseNew::WritePrefixSet() {
       PrefixSetForFilename(browse_filename);
 
   const base::TimeTicks before = base::TimeTicks::Now();
-  const bool write_ok = browse_prefix_set_->WriteFile(
+  const bool write_ok = browse_prefix_set_->prefix_set().WriteFile(
       browse_prefix_set_filename);
   UMA_HISTOGRAM_TIMES("SB2.PrefixSetWrite", base::TimeTicks::Now() - before);
 
@@ -1498,15 +1566,16 @@ void SafeBrowsingDatabaseNew::WritePrefixSet() {
 #endif
 }
 
-void SafeBrowsingDatabaseNew::WhitelistEverything(SBWhitelist* whitelist) {
-  base::AutoLock locked(lookup_lock_);
-  whitelist->second = true;
-  whitelist->first.clear();
+void SafeBrowsingDatabaseNew::WhitelistEverything(
+    scoped_refptr<SharedWhitelist>* whitelist) {
+  scoped_refptr<SharedWhitelist> everything(new SharedWhitelist);
+  everything->data.second = true;
+  SwapShared(whitelist, &everything);
 }
 
 void SafeBrowsingDatabaseNew::LoadWhitelist(
     const std::vector<SBAddFullHash>& full_hashes,
-    SBWhitelist* whitelist) {
+    scoped_refptr<SharedWhitelist>* whitelist) {
   DCHECK_EQ(creation_loop_, base::MessageLoop::current());
   if (full_hashes.size() > kMaxWhitelistSize) {
     WhitelistEverything(whitelist);
@@ -1527,9 +1596,9 @@ void SafeBrowsingDatabaseNew::LoadWhitelist(
     // The kill switch is whitelisted hence we whitelist all URLs.
     WhitelistEverything(whitelist);
   } else {
-    base::AutoLock locked(lookup_lock_);
-    whitelist->second = false;
-    whitelist->first.swap(new_whitelist);
+    scoped_refptr<SharedWhitelist> shared(new SharedWhitelist);
+    shared->data.first.swap(new_whitelist);
+    SwapShared(whitelist, &shared);
   }
 }
 
@@ -1569,17 +1638,18 @@ void SafeBrowsingDatabaseNew::LoadIpBlacklist(
     new_blacklist[mask].insert(hashed_ip_prefix);
   }
 
-  base::AutoLock locked(lookup_lock_);
-  ip_blacklist_.swap(new_blacklist);
+  scoped_refptr<SharedIPBlacklist> shared(new SharedIPBlacklist);
+  shared->data.swap(new_blacklist);
+  SwapShared(&ip_blacklist_, &shared);
 }
 
 bool SafeBrowsingDatabaseNew::IsMalwareIPMatchKillSwitchOn() {
   SBFullHash malware_kill_switch = SBFullHashForString(kMalwareIPKillSwitchUrl);
   std::vector<SBFullHash> full_hashes;
   full_hashes.push_back(malware_kill_switch);
-  return ContainsWhitelistedHashes(csd_whitelist_, full_hashes);
+  return ContainsWhitelistedHashes(*GetShared(csd_whitelist_), full_hashes);
 }
 
 bool SafeBrowsingDatabaseNew::IsCsdWhitelistKillSwitchOn() {
-  return csd_whitelist_.second;
+  return GetShared(csd_whitelist_)->data.second;
 }
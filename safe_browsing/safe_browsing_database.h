@@ -13,6 +13,7 @@
 #include "base/containers/hash_tables.h"
 #include "base/files/file_path.h"
 #include "base/gtest_prod_util.h"
+#include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/memory/weak_ptr.h"
 #include "base/synchronization/lock.h"
@@ -349,10 +350,77 @@ class SafeBrowsingDatabaseNew : public SafeBrowsingDatabase {
   // IPv6 IP prefix using SHA-1.
   typedef std::map<std::string, base::hash_set<std::string> > IPBlacklist;
 
+  // The structures used by lookups are immutable once published.  A lookup
+  // takes a reference under |lookup_lock_| and then searches without holding
+  // any lock, so lookups never wait on each other or on an update.  Updates
+  // build a replacement and swap the pointer under |lookup_lock_|.  The old
+  // structure is freed when its last reader drops it.
+  typedef base::RefCountedData<SBWhitelist> SharedWhitelist;
+  typedef base::RefCountedData<IPBlacklist> SharedIPBlacklist;
+
+  class SharedPrefixSet : public base::RefCountedThreadSafe<SharedPrefixSet> {
+   public:
+    explicit SharedPrefixSet(scoped_ptr<safe_browsing::PrefixSet> prefix_set);
+
+    const safe_browsing::PrefixSet& prefix_set() const { return *prefix_set_; }
+
+   private:
+    friend class base::RefCountedThreadSafe<SharedPrefixSet>;
+    ~SharedPrefixSet();
+
+    const scoped_ptr<safe_browsing::PrefixSet> prefix_set_;
+
+    DISALLOW_COPY_AND_ASSIGN(SharedPrefixSet);
+  };
+
+  // A set of prefixes split into shards by their low bits, each shard with
+  // its own lock, so that lookups on different threads rarely contend.
+  class PrefixMissCache {
+   public:
+    PrefixMissCache();
+    ~PrefixMissCache();
+
+    void Insert(const std::vector<SBPrefix>& prefixes);
+    bool Contains(SBPrefix prefix) const;
+    void Clear();
+
+    size_t size() const;
+    bool empty() const { return size() == 0; }
+
+   private:
+    static const size_t kShardCount = 16;
+
+    struct Shard {
+      mutable base::Lock lock;
+      std::set<SBPrefix> prefixes;
+    };
+
+    Shard shards_[kShardCount];
+
+    DISALLOW_COPY_AND_ASSIGN(PrefixMissCache);
+  };
+
+  // Returns the current value of |shared|, which must be one of the members
+  // above, read under |lookup_lock_|.
+  template <class T>
+  scoped_refptr<T> GetShared(const scoped_refptr<T>& shared) {
+    base::AutoLock locked(lookup_lock_);
+    return shared;
+  }
+
+  // Publishes |*replacement| as the new value of |*shared|.  The previous
+  // value is left in |*replacement|, to be released outside of the lock.
+  template <class T>
+  void SwapShared(scoped_refptr<T>* shared, scoped_refptr<T>* replacement) {
+    base::AutoLock locked(lookup_lock_);
+    shared->swap(*replacement);
+  }
+
   // Returns true if the whitelist is disabled or if any of the given hashes
-  // matches the whitelist.
-  bool ContainsWhitelistedHashes(const SBWhitelist& whitelist,
-                                 const std::vector<SBFullHash>& hashes);
+  // matches the whitelist.  |whitelist| is read without locking, so it should
+  // come from |GetShared()|.
+  static bool ContainsWhitelistedHashes(const SharedWhitelist& whitelist,
+                                        const std::vector<SBFullHash>& hashes);
 
   // Return the browse_store_, download_store_, download_whitelist_store or
   // csd_whitelist_store_ based on list_id.
@@ -371,11 +439,11 @@ class SafeBrowsingDatabaseNew : public SafeBrowsingDatabase {
   // of hashes is too large or if the kill switch URL is on the whitelist
   // we will whitelist everything.
   void LoadWhitelist(const std::vector<SBAddFullHash>& full_hashes,
-                     SBWhitelist* whitelist);
+                     scoped_refptr<SharedWhitelist>* whitelist);
 
   // Call this method if an error occured with the given whitelist.  This will
   // result in all lookups to the whitelist to return true.
-  void WhitelistEverything(SBWhitelist* whitelist);
+  void WhitelistEverything(scoped_refptr<SharedWhitelist>* whitelist);
 
   // Parses the IP blacklist from the given full-length hashes.
   void LoadIpBlacklist(const std::vector<SBAddFullHash>& full_hashes);
@@ -406,7 +474,7 @@ class SafeBrowsingDatabaseNew : public SafeBrowsingDatabase {
   void UpdateSideEffectFreeWhitelistStore();
   void UpdateWhitelistStore(const base::FilePath& store_filename,
                             SafeBrowsingStore* store,
-                            SBWhitelist* whitelist);
+                            scoped_refptr<SharedWhitelist>* whitelist);
   void UpdateIpBlacklistStore();
 
   // Used to verify that various calls are made from the thread the
@@ -414,8 +482,9 @@ class SafeBrowsingDatabaseNew : public SafeBrowsingDatabase {
   base::MessageLoop* creation_loop_;
 
   // Lock for protecting access to variables that may be used on the
-  // IO thread.  This includes |prefix_set_|, |cached_browse_hashes_|,
-  // |prefix_miss_cache_|, |csd_whitelist_|.
+  // IO thread.  This guards |cached_browse_hashes_| and the pointers to the
+  // shared lookup structures, but not the structures themselves.  It is only
+  // ever held for a pointer copy or swap, or a scan of the hash cache.
   base::Lock lookup_lock_;
 
   // The base filename passed to Init(), used to generate the store and prefix
@@ -446,12 +515,12 @@ class SafeBrowsingDatabaseNew : public SafeBrowsingDatabase {
   // For IP blacklist.
   scoped_ptr<SafeBrowsingStore> ip_blacklist_store_;
 
-  SBWhitelist csd_whitelist_;
-  SBWhitelist download_whitelist_;
+  scoped_refptr<SharedWhitelist> csd_whitelist_;
+  scoped_refptr<SharedWhitelist> download_whitelist_;
   SBWhitelist extension_blacklist_;
 
   // The IP blacklist should be small.  At most a couple hundred IPs.
-  IPBlacklist ip_blacklist_;
+  scoped_refptr<SharedIPBlacklist> ip_blacklist_;
 
   // Store items from CacheHashResults(), ordered by hash for efficient
   // scanning.  Discarded on next update.
@@ -459,8 +528,8 @@ class SafeBrowsingDatabaseNew : public SafeBrowsingDatabase {
 
   // Cache of prefixes that returned empty results (no full hash
   // match) to |CacheHashResults()|.  Cached to prevent asking for
-  // them every time.  Cleared on next update.
-  std::set<SBPrefix> prefix_miss_cache_;
+  // them every time.  Cleared on next update.  Has its own locking.
+  PrefixMissCache prefix_miss_cache_;
 
   // Used to schedule resetting the database because of corruption.
   base::WeakPtrFactory<SafeBrowsingDatabaseNew> reset_factory_;
@@ -475,10 +544,10 @@ class SafeBrowsingDatabaseNew : public SafeBrowsingDatabase {
   bool change_detected_;
 
   // Used to check if a prefix was in the browse database.
-  scoped_ptr<safe_browsing::PrefixSet> browse_prefix_set_;
+  scoped_refptr<SharedPrefixSet> browse_prefix_set_;
 
   // Used to check if a prefix was in the browse database.
-  scoped_ptr<safe_browsing::PrefixSet> side_effect_free_whitelist_prefix_set_;
+  scoped_refptr<SharedPrefixSet> side_effect_free_whitelist_prefix_set_;
 };
 
 #endif  // CHROME_BROWSER_SAFE_BROWSING_SAFE_BROWSING_DATABASE_H_
@@ -6,12 +6,14 @@
 
 #include "base/file_util.h"
 #include "base/files/scoped_temp_dir.h"
+#include "base/atomicops.h"
 #include "base/logging.h"
 #include "base/memory/scoped_vector.h"
 #include "base/message_loop/message_loop.h"
 #include "base/sha1.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/string_split.h"
+#include "base/threading/simple_thread.h"
 #include "base/time/time.h"
 #include "chrome/browser/safe_browsing/chunk.pb.h"
 #include "chrome/browser/safe_browsing/safe_browsing_database.h"
@@ -221,6 +223,32 @@ class ScopedLogMessageIgnorer {
   }
 };
 
+// Repeatedly looks up a URL until told to stop, as the IO thread would while
+// the database thread applies updates.
+class BrowseLookupDelegate : public base::DelegateSimpleThread::Delegate {
+ public:
+  BrowseLookupDelegate(SafeBrowsingDatabase* database, const GURL& url)
+      : database_(database), url_(url), stop_(0), lookup_count_(0) {}
+
+  virtual void Run() OVERRIDE {
+    std::vector<SBPrefix> prefix_hits;
+    std::vector<SBFullHashResult> cache_hits;
+    while (!base::subtle::Acquire_Load(&stop_)) {
+      database_->ContainsBrowseUrl(url_, &prefix_hits, &cache_hits);
+      ++lookup_count_;
+    }
+  }
+
+  void Stop() { base::subtle::Release_Store(&stop_, 1); }
+  size_t lookup_count() const { return lookup_count_; }
+
+ private:
+  SafeBrowsingDatabase* database_;
+  const GURL url_;
+  base::subtle::Atomic32 stop_;
+  size_t lookup_count_;
+};
+
 }  // namespace
 
 class SafeBrowsingDatabaseTest : public PlatformTest {
@@ -1686,3 +1714,54 @@ TEST_F(SafeBrowsingDatabaseTest, ContainsBrowseURL) {
   EXPECT_FALSE(database_->ContainsBrowseUrl(
       GURL(std::string("http://") + kExampleFine), &prefix_hits, &cache_hits));
 }
+
+// Test that lookups on other threads see either the old or the new prefix set
+// while updates swap them, and that the final state is visible afterwards.
+TEST_F(SafeBrowsingDatabaseTest, ContainsBrowseUrlDuringUpdates) {
+  const GURL kEvilUrl("http://www.evil.com/malware.html");
+  BrowseLookupDelegate delegate1(database_.get(), kEvilUrl);
+  BrowseLookupDelegate delegate2(database_.get(), kEvilUrl);
+  base::DelegateSimpleThread thread1(&delegate1, "BrowseLookup1");
+  base::DelegateSimpleThread thread2(&delegate2, "BrowseLookup2");
+  thread1.Start();
+  thread2.Start();
+
+  std::vector<SBListChunkRanges> lists;
+  for (int i = 1; i <= 10; ++i) {
+    ASSERT_TRUE(database_->UpdateStarted(&lists));
+    ScopedVector<SBChunkData> chunks;
+    chunks.push_back(AddChunkPrefixValue(i, "www.evil.com/malware.html"));
+    database_->InsertChunks(safe_browsing_util::kMalwareList, chunks.get());
+    if (i > 1)
+      AddDelChunk(safe_browsing_util::kMalwareList, i - 1);
+    database_->UpdateFinished(true);
+
+    std::vector<SBPrefix> prefix_misses;
+    prefix_misses.push_back(SBPrefixForString("www.evil.com/malware.html"));
+    database_->CacheHashResults(prefix_misses,
+                                std::vector<SBFullHashResult>(),
+                                kCacheLifetime);
+  }
+
+  delegate1.Stop();
+  delegate2.Stop();
+  thread1.Join();
+  thread2.Join();
+  EXPECT_GT(delegate1.lookup_count(), 0U);
+  EXPECT_GT(delegate2.lookup_count(), 0U);
+
+  // The last update left the prefix in place, but it is cached as a miss.
+  std::vector<SBPrefix> prefix_hits;
+  std::vector<SBFullHashResult> cache_hits;
+  EXPECT_FALSE(database_->ContainsBrowseUrl(kEvilUrl, &prefix_hits,
+                                            &cache_hits));
+  ASSERT_EQ(1U, prefix_hits.size());
+  EXPECT_EQ(SBPrefixForString("www.evil.com/malware.html"), prefix_hits[0]);
+
+  // Another update clears the miss cache.
+  ASSERT_TRUE(database_->UpdateStarted(&lists));
+  AddDelChunk(safe_browsing_util::kMalwareList, 5);
+  database_->UpdateFinished(true);
+  EXPECT_TRUE(database_->ContainsBrowseUrl(kEvilUrl, &prefix_hits,
+                                           &cache_hits));
+}
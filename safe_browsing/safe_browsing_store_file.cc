@@ -4,11 +4,16 @@
 
 #include "chrome/browser/safe_browsing/safe_browsing_store_file.h"
 
+#include <limits>
+
 #include "base/file_util.h"
+#include "base/files/memory_mapped_file.h"
 #include "base/files/scoped_file.h"
 #include "base/md5.h"
+#include "base/memory/scoped_ptr.h"
 #include "base/metrics/histogram.h"
 #include "base/metrics/sparse_histogram.h"
+#include "third_party/zlib/zlib.h"
 
 namespace {
 
@@ -20,7 +25,9 @@ const int32 kFileMagic = 0x600D71FE;
 // Version 6: aad08754/r2814 by erikkay@google.com on 2008-10-02 (sqlite)
 // Version 7: 6afe28a5/r37435 by shess@chromium.org on 2010-01-28
 // Version 8: d3dd0715/r259791 by shess@chromium.org on 2014-03-27
-const int32 kFileVersion = 8;
+// Version 9: CRC-32 block checksums in place of MD5, for mapped reads, and
+//            shards padded to whole blocks so they can be updated in place.
+const int32 kFileVersion = 9;
 
 // ReadAndVerifyHeader() returns this in case of error.
 const int32 kInvalidVersion = -1;
@@ -60,9 +67,20 @@ struct FileHeaderV8 {
   // specialized read/write?
 };
 
+// Header at the front of a version 9 file.  The header, the chunk lists and
+// the header checksum are padded to |header_size| bytes, a whole number of
+// checksum blocks, so that the chunk lists can grow in place.
+struct FileHeaderV9 {
+  int32 magic, version;
+  uint32 add_chunk_count, sub_chunk_count;
+  uint32 shard_stride;
+  uint32 header_size;
+};
+
 union FileHeader {
   struct FileHeaderV7 v7;
   struct FileHeaderV8 v8;
+  struct FileHeaderV9 v9;
 };
 
 // Header for each chunk in the chunk-accumulation file.
@@ -77,6 +95,30 @@ struct ShardHeader {
   uint32 add_hash_count, sub_hash_count;
 };
 
+// Header for each shard of a version 9 file.  Each shard starts a slot of
+// whole checksum blocks, and its data is followed by zero padding up to
+// |slot_size|, leaving room for the shard to grow in place.
+struct ShardSlotHeader {
+  ShardHeader shard;
+  uint32 slot_size;  // Bytes in the slot, including this header.
+};
+
+// Starting with version 9, the file is checksummed in blocks of this size
+// rather than with a running MD5.  This lets updates read the file through a
+// memory mapping, verifying each block the first time it is reached, and
+// rewrite a shard's slot without touching the checksums of other slots.
+const size_t kChecksumBlockSize = 4 * 1024;
+
+// Newly written header and shard slots have this fraction of their data size
+// to spare, rounded up to a whole block, so that most updates fit in place.
+const size_t kSlotSlackDivisor = 8;
+
+// Trailer at the end of a version 9 file, following the block checksums.
+struct FileTrailerV9 {
+  uint32 block_count;
+  uint32 trailer_checksum;  // CRC-32 of the block checksums and |block_count|.
+};
+
 // Enumerate different format-change events for histogramming
 // purposes.  DO NOT CHANGE THE ORDERING OF THESE VALUES.
 enum FormatEventType {
@@ -127,6 +169,50 @@ bool FileRewind(FILE* fp) {
   return rv == 0;
 }
 
+// Accumulates a CRC-32 for each |kChecksumBlockSize| block of data written to
+// a version 9 file.  The final block may be short.
+class BlockChecksummer {
+ public:
+  BlockChecksummer()
+      : block_checksum_(crc32(0L, Z_NULL, 0)),
+        block_bytes_(0) {
+  }
+
+  void Update(const void* data, size_t size) {
+    const Bytef* bytes = static_cast<const Bytef*>(data);
+    while (size > 0) {
+      const size_t c = std::min(size, kChecksumBlockSize - block_bytes_);
+      block_checksum_ = crc32(block_checksum_, bytes, static_cast<uInt>(c));
+      block_bytes_ += c;
+      bytes += c;
+      size -= c;
+      if (block_bytes_ == kChecksumBlockSize)
+        FinishBlock();
+    }
+  }
+
+  // Returns the checksums of every block written, including a partial final
+  // block.  No more data should be added afterwards.
+  const std::vector<uint32>& Finish() {
+    if (block_bytes_)
+      FinishBlock();
+    return block_checksums_;
+  }
+
+ private:
+  void FinishBlock() {
+    block_checksums_.push_back(static_cast<uint32>(block_checksum_));
+    block_checksum_ = crc32(0L, Z_NULL, 0);
+    block_bytes_ = 0;
+  }
+
+  std::vector<uint32> block_checksums_;
+  uLong block_checksum_;
+  size_t block_bytes_;
+
+  DISALLOW_COPY_AND_ASSIGN(BlockChecksummer);
+};
+
 // Read from |fp| into |item|, and fold the input data into the
 // checksum in |context|, if non-NULL.  Return true on success.
 template <class T>
@@ -143,19 +229,16 @@ bool ReadItem(T* item, FILE* fp, base::MD5Context* context) {
   return true;
 }
 
-// Write |item| to |fp|, and fold the output data into the checksum in
-// |context|, if non-NULL.  Return true on success.
+// Write |item| to |fp|, and fold the output data into the block checksums in
+// |checksummer|, if non-NULL.  Return true on success.
 template <class T>
-bool WriteItem(const T& item, FILE* fp, base::MD5Context* context) {
+bool WriteItem(const T& item, FILE* fp, BlockChecksummer* checksummer) {
   const size_t ret = fwrite(&item, sizeof(T), 1, fp);
   if (ret != 1)
     return false;
 
-  if (context) {
-    base::MD5Update(context,
-                    base::StringPiece(reinterpret_cast<const char*>(&item),
-                                      sizeof(T)));
-  }
+  if (checksummer)
+    checksummer->Update(&item, sizeof(T));
 
   return true;
 }
@@ -182,23 +265,74 @@ bool ReadToContainer(CT* values, size_t count, FILE* fp,
 }
 
 // Write values between |beg| and |end| to |fp|, and fold the data into the
-// checksum in |context|, if non-NULL.  Returns true if all items successful.
+// block checksums in |checksummer|, if non-NULL.  Returns true if all items
+// successful.
 template <typename CTI>
 bool WriteRange(const CTI& beg, const CTI& end,
-                FILE* fp, base::MD5Context* context) {
+                FILE* fp, BlockChecksummer* checksummer) {
   for (CTI iter = beg; iter != end; ++iter) {
-    if (!WriteItem(*iter, fp, context))
+    if (!WriteItem(*iter, fp, checksummer))
       return false;
   }
   return true;
 }
 
-// Write all of |values| to |fp|, and fold the data into the checksum
-// in |context|, if non-NULL.  Returns true if all items successful.
+// Write all of |values| to |fp|, and fold the data into the block checksums in
+// |checksummer|, if non-NULL.  Returns true if all items successful.
 template <typename CT>
 bool WriteContainer(const CT& values, FILE* fp,
-                    base::MD5Context* context) {
-  return WriteRange(values.begin(), values.end(), fp, context);
+                    BlockChecksummer* checksummer) {
+  return WriteRange(values.begin(), values.end(), fp, checksummer);
+}
+
+// Append the bytes of |item| to |buffer|.
+template <class T>
+void AppendItem(const T& item, std::vector<uint8>* buffer) {
+  const uint8* bytes = reinterpret_cast<const uint8*>(&item);
+  buffer->insert(buffer->end(), bytes, bytes + sizeof(T));
+}
+
+// Append values between |beg| and |end| to |buffer|.
+template <typename CTI>
+void AppendRange(const CTI& beg, const CTI& end, std::vector<uint8>* buffer) {
+  for (CTI iter = beg; iter != end; ++iter)
+    AppendItem(*iter, buffer);
+}
+
+// Returns the size of a header or shard slot holding |used| bytes of data,
+// with room to grow.
+size_t SlotSizeFor(size_t used) {
+  const size_t size = used + used / kSlotSlackDivisor;
+  const size_t blocks =
+      std::max<size_t>(1, (size + kChecksumBlockSize - 1) / kChecksumBlockSize);
+  return blocks * kChecksumBlockSize;
+}
+
+// Pads |buffer|, which starts a header or shard slot, with zeros to
+// |slot_size| bytes.  If |slot_size| is 0 a size with room to grow is picked.
+// Returns false if |buffer| does not fit.
+bool PadToSlot(size_t slot_size, std::vector<uint8>* buffer) {
+  if (!slot_size)
+    slot_size = SlotSizeFor(buffer->size());
+  if (buffer->size() > slot_size)
+    return false;
+  buffer->resize(slot_size, 0);
+  return true;
+}
+
+// Returns the bytes used by a version 9 shard holding |header|'s items.
+size_t ShardBytes(const ShardHeader& header) {
+  return sizeof(ShardSlotHeader) +
+      header.add_prefix_count * sizeof(SBAddPrefix) +
+      header.sub_prefix_count * sizeof(SBSubPrefix) +
+      header.add_hash_count * sizeof(SBAddFullHash) +
+      header.sub_hash_count * sizeof(SBSubFullHash);
+}
+
+// Returns the bytes used by a version 9 header with the given chunk lists.
+size_t HeaderBytes(size_t add_chunk_count, size_t sub_chunk_count) {
+  return sizeof(FileHeaderV9) +
+      (add_chunk_count + sub_chunk_count) * sizeof(int32) + sizeof(uint32);
 }
 
 // Delete the chunks in |deleted| from |chunks|.
@@ -295,7 +429,7 @@ int ReadAndVerifyHeader(const base::FilePath& filename,
 
     add_chunks_count = header->v7.add_chunk_count;
     sub_chunks_count = header->v7.sub_chunk_count;
-  } else if (header->v8.version == kFileVersion) {
+  } else if (header->v8.version == 8) {
     version = 8;
     add_chunks_count = header->v8.add_chunk_count;
     sub_chunks_count = header->v8.sub_chunk_count;
@@ -317,40 +451,410 @@ int ReadAndVerifyHeader(const base::FilePath& filename,
   return version;
 }
 
-// Helper function to write out the initial header and chunks-contained data.
-// Rewinds |fp|, initializes |context|, then writes a file header and
-// |add_chunks| and |sub_chunks|.
-bool WriteHeader(uint32 out_stride,
-                 const std::set<int32>& add_chunks,
-                 const std::set<int32>& sub_chunks,
-                 FILE* fp,
-                 base::MD5Context* context) {
-  if (!FileRewind(fp))
+// Serializes a version 9 header for |out_stride|, |add_chunks| and
+// |sub_chunks|, followed by the header checksum, into |buffer|, padded to
+// |header_size| bytes.  If |header_size| is 0 a size with room for the chunk
+// lists to grow is picked.  Returns false if the data does not fit.
+bool SerializeHeader(uint32 out_stride,
+                     const std::set<int32>& add_chunks,
+                     const std::set<int32>& sub_chunks,
+                     size_t header_size,
+                     std::vector<uint8>* buffer) {
+  const size_t used = HeaderBytes(add_chunks.size(), sub_chunks.size());
+  if (!header_size)
+    header_size = SlotSizeFor(used);
+  if (used > header_size)
     return false;
 
-  base::MD5Init(context);
-  FileHeaderV8 header;
+  FileHeaderV9 header;
   header.magic = kFileMagic;
   header.version = kFileVersion;
   header.add_chunk_count = add_chunks.size();
   header.sub_chunk_count = sub_chunks.size();
   header.shard_stride = out_stride;
-  if (!WriteItem(header, fp, context))
+  header.header_size = header_size;
+
+  buffer->clear();
+  buffer->reserve(header_size);
+  AppendItem(header, buffer);
+  AppendRange(add_chunks.begin(), add_chunks.end(), buffer);
+  AppendRange(sub_chunks.begin(), sub_chunks.end(), buffer);
+
+  const uint32 header_checksum = static_cast<uint32>(
+      crc32(crc32(0L, Z_NULL, 0), &(*buffer)[0],
+            static_cast<uInt>(buffer->size())));
+  AppendItem(header_checksum, buffer);
+  return PadToSlot(header_size, buffer);
+}
+
+// Appends |buffer| to the new file |fp|, folding it into |checksummer|.
+bool WriteBuffer(const std::vector<uint8>& buffer,
+                 FILE* fp,
+                 BlockChecksummer* checksummer) {
+  if (buffer.empty())
+    return true;
+  if (fwrite(&buffer[0], 1, buffer.size(), fp) != buffer.size())
     return false;
+  checksummer->Update(&buffer[0], buffer.size());
+  return true;
+}
 
-  if (!WriteContainer(add_chunks, fp, context) ||
-      !WriteContainer(sub_chunks, fp, context))
+// Overwrites the whole checksum blocks at |offset| in |fp| with |buffer|, and
+// updates their checksums in |block_checksums|.
+bool OverwriteBlocks(const std::vector<uint8>& buffer,
+                     size_t offset,
+                     FILE* fp,
+                     std::vector<uint32>* block_checksums) {
+  DCHECK_EQ(0u, offset % kChecksumBlockSize);
+  DCHECK_EQ(0u, buffer.size() % kChecksumBlockSize);
+  if (buffer.empty())
+    return true;
+  if (fseek(fp, static_cast<long>(offset), SEEK_SET) != 0 ||
+      fwrite(&buffer[0], 1, buffer.size(), fp) != buffer.size()) {
     return false;
+  }
+  for (size_t i = 0; i < buffer.size(); i += kChecksumBlockSize) {
+    const size_t block = (offset + i) / kChecksumBlockSize;
+    if (block >= block_checksums->size())
+      return false;
+    (*block_checksums)[block] = static_cast<uint32>(
+        crc32(crc32(0L, Z_NULL, 0), &buffer[i],
+              static_cast<uInt>(kChecksumBlockSize)));
+  }
+  return true;
+}
 
-  // Write out the header digest.
-  base::MD5Digest header_digest;
-  base::MD5IntermediateFinal(&header_digest, context);
-  if (!WriteItem(header_digest, fp, context))
+// Writes |block_checksums| and the trailer which ends a version 9 file at the
+// current position of |fp|.
+bool WriteTrailer(const std::vector<uint32>& block_checksums, FILE* fp) {
+  if (!WriteContainer(block_checksums, fp, NULL))
     return false;
 
-  return true;
+  FileTrailerV9 trailer;
+  trailer.block_count = block_checksums.size();
+  uLong checksum = crc32(0L, Z_NULL, 0);
+  if (!block_checksums.empty()) {
+    checksum = crc32(checksum,
+                     reinterpret_cast<const Bytef*>(&block_checksums[0]),
+                     block_checksums.size() * sizeof(uint32));
+  }
+  checksum = crc32(checksum, reinterpret_cast<const Bytef*>(&trailer),
+                   sizeof(trailer.block_count));
+  trailer.trailer_checksum = static_cast<uint32>(checksum);
+  return WriteItem(trailer, fp, NULL);
+}
+
+// Returns the version of the file open as |fp|, or kInvalidVersion if it does
+// not start with a store header.  Leaves |fp| rewound.
+int PeekFileVersion(FILE* fp) {
+  FileHeaderV8 header;
+  if (!FileRewind(fp) || !ReadItem(&header, fp, NULL) || !FileRewind(fp))
+    return kInvalidVersion;
+  if (header.magic != kFileMagic)
+    return kInvalidVersion;
+  return header.version;
 }
 
+// Returns true if any of the |count| items at |items| belong to a chunk in
+// |del_set|.
+template <class T>
+bool HasDeletedChunk(const T* items, size_t count,
+                     const base::hash_set<int32>& del_set) {
+  if (del_set.empty())
+    return false;
+  for (size_t i = 0; i < count; ++i) {
+    if (del_set.count(items[i].chunk_id) > 0)
+      return true;
+  }
+  return false;
+}
+
+// A shard of a mapped version 9 file.  The item pointers point into the
+// mapping, so the shard is only valid while its MappedStoreReader is alive.
+struct MappedShard {
+  // True if the shard holds items from chunks in |add_del_cache| or
+  // |sub_del_cache|, which processing would remove.
+  bool HasDeletedChunks(const base::hash_set<int32>& add_del_cache,
+                        const base::hash_set<int32>& sub_del_cache) const {
+    return
+        HasDeletedChunk(add_prefixes, header.add_prefix_count,
+                        add_del_cache) ||
+        HasDeletedChunk(sub_prefixes, header.sub_prefix_count,
+                        sub_del_cache) ||
+        HasDeletedChunk(add_full_hashes, header.add_hash_count,
+                        add_del_cache) ||
+        HasDeletedChunk(sub_full_hashes, header.sub_hash_count,
+                        sub_del_cache);
+  }
+
+  // Write the shard's slot to |fp| exactly as stored, folding it into
+  // |checksummer|.
+  bool WriteTo(FILE* fp, BlockChecksummer* checksummer) const {
+    if (fwrite(data, 1, slot_size, fp) != slot_size)
+      return false;
+    checksummer->Update(data, slot_size);
+    return true;
+  }
+
+  ShardHeader header;
+  const SBAddPrefix* add_prefixes;
+  const SBSubPrefix* sub_prefixes;
+  const SBAddFullHash* add_full_hashes;
+  const SBSubFullHash* sub_full_hashes;
+
+  // The stored bytes of the shard's slot, starting with its header, and the
+  // slot's offset in the file.
+  const uint8* data;
+  size_t slot_size;
+  size_t offset;
+};
+
+// Reads a version 9 file through a memory mapping.  Reading is sequential, and
+// each checksum block is verified when the read position first reaches it, so
+// data is checked just before it is used without a separate pass over the
+// file.
+class MappedStoreReader {
+ public:
+  MappedStoreReader()
+      : data_(NULL),
+        data_size_(0),
+        block_checksums_(NULL),
+        verified_blocks_(0),
+        pos_(0),
+        checksum_failed_(false) {
+  }
+
+  // Maps |filename| and checks the block checksums against the trailer.  A
+  // damaged trailer still lets the header be read, as the header has its own
+  // checksum, but fails every block verification.
+  bool Open(const base::FilePath& filename) {
+    if (!file_.Initialize(filename))
+      return false;
+    data_ = file_.data();
+
+    // Everything in the file is a multiple of 4 bytes, which also keeps the
+    // item pointers handed out by ReadShard() aligned.
+    const size_t length = file_.length();
+    if (length < sizeof(FileHeaderV9) + sizeof(FileTrailerV9) ||
+        length % sizeof(uint32) != 0) {
+      return false;
+    }
+
+    if (!ReadTrailer(length)) {
+      data_size_ = length;
+      block_checksums_ = NULL;
+      checksum_failed_ = true;
+    }
+    return true;
+  }
+
+  // Reads the header and chunk lists into |header|, |add_chunks| and
+  // |sub_chunks|, and skips to the first shard.  Only the header checksum is
+  // verified, so an update can be started without paging in the rest of the
+  // file.
+  bool ReadHeader(FileHeaderV9* header,
+                  std::set<int32>* add_chunks,
+                  std::set<int32>* sub_chunks) {
+    DCHECK_EQ(0u, pos_);
+
+    const FileHeaderV9* file_header = NULL;
+    if (!ReadArray(&file_header, 1, false))
+      return false;
+    if (file_header->magic != kFileMagic ||
+        file_header->version != kFileVersion) {
+      return false;
+    }
+
+    const int32* file_add_chunks = NULL;
+    const int32* file_sub_chunks = NULL;
+    const uint32* header_checksum = NULL;
+    if (!ReadArray(&file_add_chunks, file_header->add_chunk_count, false) ||
+        !ReadArray(&file_sub_chunks, file_header->sub_chunk_count, false) ||
+        !ReadArray(&header_checksum, 1, false)) {
+      return false;
+    }
+
+    const uLong checksum =
+        crc32(crc32(0L, Z_NULL, 0), data_,
+              static_cast<uInt>(pos_ - sizeof(*header_checksum)));
+    if (static_cast<uint32>(checksum) != *header_checksum) {
+      RecordFormatEvent(FORMAT_EVENT_HEADER_CHECKSUM_FAILURE);
+      return false;
+    }
+
+    if (!IsSlotSize(file_header->header_size, 0) ||
+        file_header->header_size < pos_) {
+      return false;
+    }
+
+    *header = *file_header;
+    add_chunks->insert(file_add_chunks,
+                       file_add_chunks + file_header->add_chunk_count);
+    sub_chunks->insert(file_sub_chunks,
+                       file_sub_chunks + file_header->sub_chunk_count);
+    pos_ = file_header->header_size;
+    return true;
+  }
+
+  // Reads the next shard into |shard|, verifying the blocks of its slot.
+  bool ReadShard(MappedShard* shard) {
+    const size_t begin = pos_;
+    const ShardSlotHeader* header = NULL;
+    if (!ReadArray(&header, 1, true))
+      return false;
+    if (!IsSlotSize(header->slot_size, begin) ||
+        ShardBytes(header->shard) > header->slot_size) {
+      return false;
+    }
+    shard->header = header->shard;
+    if (!ReadArray(&shard->add_prefixes, header->shard.add_prefix_count,
+                   true) ||
+        !ReadArray(&shard->sub_prefixes, header->shard.sub_prefix_count,
+                   true) ||
+        !ReadArray(&shard->add_full_hashes, header->shard.add_hash_count,
+                   true) ||
+        !ReadArray(&shard->sub_full_hashes, header->shard.sub_hash_count,
+                   true)) {
+      return false;
+    }
+    shard->data = data_ + begin;
+    shard->slot_size = header->slot_size;
+    shard->offset = begin;
+    pos_ = begin + header->slot_size;
+    return VerifyThrough(pos_);
+  }
+
+  // Reads the headers of the |count| shards from the current position into
+  // |headers|, without verifying them or moving the read position.  Used to
+  // decide how to update the file before reading it.
+  bool PeekShardHeaders(size_t count, std::vector<ShardSlotHeader>* headers) {
+    size_t pos = pos_;
+    for (size_t i = 0; i < count; ++i) {
+      if (sizeof(ShardSlotHeader) > data_size_ - pos)
+        return false;
+      ShardSlotHeader header;
+      memcpy(&header, data_ + pos, sizeof(header));
+      if (!IsSlotSize(header.slot_size, pos) ||
+          ShardBytes(header.shard) > header.slot_size) {
+        return false;
+      }
+      headers->push_back(header);
+      pos += header.slot_size;
+    }
+    return pos == data_size_;
+  }
+
+  // The current block checksums.  Only valid if every shard has been read.
+  std::vector<uint32> block_checksums() const {
+    DCHECK(block_checksums_);
+    return std::vector<uint32>(
+        block_checksums_, block_checksums_ + data_size_ / kChecksumBlockSize);
+  }
+
+  // Bytes of data before the block checksums.
+  size_t data_size() const {
+    return data_size_;
+  }
+
+  // Writes the data before the block checksums to |fp|, as stored.
+  bool WriteDataTo(FILE* fp) const {
+    return fwrite(data_, 1, data_size_, fp) == data_size_;
+  }
+
+  // Verifies every block which has not been read yet.
+  bool VerifyAll() {
+    return VerifyThrough(data_size_);
+  }
+
+  // True once everything before the block checksums has been read.
+  bool AtEnd() const {
+    return pos_ == data_size_;
+  }
+
+  // True if a read failed because a block did not match its checksum.
+  bool checksum_failed() const {
+    return checksum_failed_;
+  }
+
+ private:
+  // Points |*items| at the next |count| items and advances past them,
+  // verifying any blocks they reach into if |verify| is set.
+  template <class T>
+  bool ReadArray(const T** items, size_t count, bool verify) {
+    if (count > (data_size_ - pos_) / sizeof(T))
+      return false;
+    const size_t end = pos_ + count * sizeof(T);
+    if (verify && !VerifyThrough(end))
+      return false;
+    *items = reinterpret_cast<const T*>(data_ + pos_);
+    pos_ = end;
+    return true;
+  }
+
+  // Locates the block checksums of the |length| byte file through its trailer
+  // and checks them.
+  bool ReadTrailer(size_t length) {
+    FileTrailerV9 trailer;
+    memcpy(&trailer, data_ + length - sizeof(trailer), sizeof(trailer));
+    const size_t available = length - sizeof(trailer);
+    if (trailer.block_count > available / sizeof(uint32))
+      return false;
+    data_size_ = available - trailer.block_count * sizeof(uint32);
+    if (data_size_ % kChecksumBlockSize != 0 ||
+        trailer.block_count != data_size_ / kChecksumBlockSize) {
+      return false;
+    }
+    block_checksums_ = reinterpret_cast<const uint32*>(data_ + data_size_);
+
+    const uLong checksum =
+        crc32(crc32(0L, Z_NULL, 0), data_ + data_size_,
+              static_cast<uInt>(length - sizeof(trailer.trailer_checksum) -
+                                data_size_));
+    return static_cast<uint32>(checksum) == trailer.trailer_checksum;
+  }
+
+  // True if |size| is a valid size for a slot starting at |begin|: a non-zero
+  // number of whole blocks which ends within the data.
+  bool IsSlotSize(size_t size, size_t begin) const {
+    return size > 0 && size % kChecksumBlockSize == 0 &&
+        begin <= data_size_ && size <= data_size_ - begin;
+  }
+
+  // Verifies the checksums of blocks up to and including the one holding the
+  // byte before |end|.
+  bool VerifyThrough(size_t end) {
+    if (!block_checksums_) {
+      checksum_failed_ = true;
+      return false;
+    }
+    while (verified_blocks_ * kChecksumBlockSize < end) {
+      const size_t offset = verified_blocks_ * kChecksumBlockSize;
+      const size_t size = std::min(kChecksumBlockSize, data_size_ - offset);
+      const uLong checksum = crc32(crc32(0L, Z_NULL, 0), data_ + offset,
+                                   static_cast<uInt>(size));
+      if (static_cast<uint32>(checksum) != block_checksums_[verified_blocks_]) {
+        checksum_failed_ = true;
+        return false;
+      }
+      ++verified_blocks_;
+    }
+    return true;
+  }
+
+  base::MemoryMappedFile file_;
+  const uint8* data_;
+
+  // Bytes of data before the block checksums.
+  size_t data_size_;
+  const uint32* block_checksums_;
+
+  size_t verified_blocks_;
+  size_t pos_;
+  bool checksum_failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(MappedStoreReader);
+};
+
 // Return |true| if the range is sorted by the given comparator.
 template <typename CTI, typename LESS>
 bool sorted(CTI beg, CTI end, LESS less) {
@@ -418,6 +922,14 @@ class StateInternalPos {
         sub_hashes_iter_(sub_hashes_iter) {
   }
 
+  // True if no data lies between the receiver and |end|.
+  bool IsEmptyRange(const StateInternalPos& end) const {
+    return add_prefixes_iter_ == end.add_prefixes_iter_ &&
+        sub_prefixes_iter_ == end.sub_prefixes_iter_ &&
+        add_hashes_iter_ == end.add_hashes_iter_ &&
+        sub_hashes_iter_ == end.sub_hashes_iter_;
+  }
+
   SBAddPrefixes::iterator add_prefixes_iter_;
   SBSubPrefixes::iterator sub_prefixes_iter_;
   std::vector<SBAddFullHash>::iterator add_hashes_iter_;
@@ -445,6 +957,19 @@ class StateInternal {
         ReadToContainer(&sub_full_hashes_, sub_hash_count, fp, context);
   }
 
+  // Append the data of |shard|.
+  void AppendShard(const MappedShard& shard) {
+    const ShardHeader& header = shard.header;
+    add_prefixes_.insert(add_prefixes_.end(), shard.add_prefixes,
+                         shard.add_prefixes + header.add_prefix_count);
+    sub_prefixes_.insert(sub_prefixes_.end(), shard.sub_prefixes,
+                         shard.sub_prefixes + header.sub_prefix_count);
+    add_full_hashes_.insert(add_full_hashes_.end(), shard.add_full_hashes,
+                            shard.add_full_hashes + header.add_hash_count);
+    sub_full_hashes_.insert(sub_full_hashes_.end(), shard.sub_full_hashes,
+                            shard.sub_full_hashes + header.sub_hash_count);
+  }
+
   void ClearData() {
     add_prefixes_.clear();
     sub_prefixes_.clear();
@@ -523,10 +1048,18 @@ class StateInternal {
                          shard_max, prefix_bounder<SBSubFullHash>));
   }
 
-  // Write a shard header and data for the shard starting at |beg| and ending at
-  // the element before |end|.
-  bool WriteShard(const StateInternalPos& beg, const StateInternalPos& end,
-                  FILE* fp, base::MD5Context* context) {
+  // An iterator pointing just after the receiver's data.
+  StateInternalPos StateEnd() {
+    return StateInternalPos(add_prefixes_.end(),
+                            sub_prefixes_.end(),
+                            add_full_hashes_.end(),
+                            sub_full_hashes_.end());
+  }
+
+  // The item counts of the shard starting at |beg| and ending at the element
+  // before |end|.
+  static ShardHeader ShardCounts(const StateInternalPos& beg,
+                                 const StateInternalPos& end) {
     ShardHeader shard_header;
     shard_header.add_prefix_count =
         end.add_prefixes_iter_ - beg.add_prefixes_iter_;
@@ -536,17 +1069,34 @@ class StateInternal {
         end.add_hashes_iter_ - beg.add_hashes_iter_;
     shard_header.sub_hash_count =
         end.sub_hashes_iter_ - beg.sub_hashes_iter_;
+    return shard_header;
+  }
 
-    return
-        WriteItem(shard_header, fp, context) &&
-        WriteRange(beg.add_prefixes_iter_, end.add_prefixes_iter_,
-                   fp, context) &&
-        WriteRange(beg.sub_prefixes_iter_, end.sub_prefixes_iter_,
-                   fp, context) &&
-        WriteRange(beg.add_hashes_iter_, end.add_hashes_iter_,
-                   fp, context) &&
-        WriteRange(beg.sub_hashes_iter_, end.sub_hashes_iter_,
-                   fp, context);
+  // Serialize a shard header and data for the shard starting at |beg| and
+  // ending at the element before |end| into |buffer|, padded to |slot_size|
+  // bytes.  If |slot_size| is 0 a size with room for the shard to grow is
+  // picked.  Returns false if the shard does not fit.
+  static bool SerializeShard(const StateInternalPos& beg,
+                             const StateInternalPos& end,
+                             size_t slot_size,
+                             std::vector<uint8>* buffer) {
+    ShardSlotHeader header;
+    header.shard = ShardCounts(beg, end);
+    const size_t used = ShardBytes(header.shard);
+    if (!slot_size)
+      slot_size = SlotSizeFor(used);
+    if (used > slot_size)
+      return false;
+    header.slot_size = slot_size;
+
+    buffer->clear();
+    buffer->reserve(slot_size);
+    AppendItem(header, buffer);
+    AppendRange(beg.add_prefixes_iter_, end.add_prefixes_iter_, buffer);
+    AppendRange(beg.sub_prefixes_iter_, end.sub_prefixes_iter_, buffer);
+    AppendRange(beg.add_hashes_iter_, end.add_hashes_iter_, buffer);
+    AppendRange(beg.sub_hashes_iter_, end.sub_hashes_iter_, buffer);
+    return PadToSlot(slot_size, buffer);
   }
 
   SBAddPrefixes add_prefixes_;
@@ -561,6 +1111,37 @@ bool IsPowerOfTwo(const T& val) {
   return val && (val & (val - 1)) == 0;
 }
 
+// ReadDbStateHelper() for version 9 files.
+bool ReadMappedDbStateHelper(const base::FilePath& filename,
+                             StateInternal* db_state) {
+  MappedStoreReader reader;
+  FileHeaderV9 header;
+  std::set<int32> add_chunks;
+  std::set<int32> sub_chunks;
+  if (!reader.Open(filename) ||
+      !reader.ReadHeader(&header, &add_chunks, &sub_chunks)) {
+    return false;
+  }
+
+  // Read until the shard start overflows, always at least one pass.
+  uint64 in_min = 0;
+  uint64 in_stride = header.shard_stride;
+  if (!in_stride)
+    in_stride = kMaxShardStride;
+  if (!IsPowerOfTwo(in_stride))
+    return false;
+
+  do {
+    MappedShard shard;
+    if (!reader.ReadShard(&shard))
+      return false;
+    db_state->AppendShard(shard);
+    in_min += in_stride;
+  } while (in_min <= kMaxSBPrefix);
+
+  return reader.AtEnd();
+}
+
 // Helper to read the entire database state, used by GetAddPrefixes() and
 // GetAddFullHashes().  Those functions are generally used only for smaller
 // files.  Returns false in case of errors reading the data.
@@ -570,6 +1151,11 @@ bool ReadDbStateHelper(const base::FilePath& filename,
   if (file.get() == NULL)
     return false;
 
+  if (PeekFileVersion(file.get()) == kFileVersion) {
+    file.reset();
+    return ReadMappedDbStateHelper(filename, db_state);
+  }
+
   std::set<int32> add_chunks;
   std::set<int32> sub_chunks;
 
@@ -628,6 +1214,82 @@ bool ReadDbStateHelper(const base::FilePath& filename,
   return static_cast<int64>(ftell(file.get())) == size;
 }
 
+// Merges the sorted update data in |new_state| into the shards of the version
+// 9 file read by |reader|, whose shards are |stride| wide, and overwrites each
+// shard which changes in its slot in |fp|, a copy of the file, updating
+// |block_checksums|.  The caller has checked that every shard fits its slot.
+// Fails once more than |shard_limit| slots would be overwritten.  The
+// processed add prefixes and full hashes are handed to |builder| and
+// |add_full_hashes_result|.  Returns false on failure, after which |fp| may be
+// partially updated.
+bool UpdateShardsInPlace(MappedStoreReader* reader,
+                         uint64 stride,
+                         StateInternal* new_state,
+                         const base::hash_set<int32>& add_del_cache,
+                         const base::hash_set<int32>& sub_del_cache,
+                         size_t shard_limit,
+                         FILE* fp,
+                         std::vector<uint32>* block_checksums,
+                         safe_browsing::PrefixSetBuilder* builder,
+                         std::vector<SBAddFullHash>* add_full_hashes_result,
+                         size_t* add_prefix_count,
+                         size_t* sub_prefix_count) {
+  StateInternalPos new_pos = new_state->StateBegin();
+  StateInternal db_state;
+  std::vector<uint8> buffer;
+  uint64 shard_min = 0;
+  do {
+    const SBPrefix shard_max = static_cast<SBPrefix>(shard_min + stride - 1);
+    const StateInternalPos new_end = new_state->ShardEnd(new_pos, shard_max);
+
+    MappedShard shard;
+    if (!reader->ReadShard(&shard))
+      return false;
+
+    if (new_pos.IsEmptyRange(new_end) &&
+        !shard.HasDeletedChunks(add_del_cache, sub_del_cache)) {
+      // Already-processed data does not change when processed again, so the
+      // shard is left as stored.
+      for (size_t i = 0; i < shard.header.add_prefix_count; ++i) {
+        builder->AddPrefix(shard.add_prefixes[i].prefix);
+      }
+      add_full_hashes_result->insert(
+          add_full_hashes_result->end(), shard.add_full_hashes,
+          shard.add_full_hashes + shard.header.add_hash_count);
+      *add_prefix_count += shard.header.add_prefix_count;
+      *sub_prefix_count += shard.header.sub_prefix_count;
+    } else {
+      db_state.ClearData();
+      db_state.AppendShard(shard);
+      db_state.MergeDataAndProcess(new_pos, new_end,
+                                   add_del_cache, sub_del_cache);
+
+      for (size_t i = 0; i < db_state.add_prefixes_.size(); ++i) {
+        builder->AddPrefix(db_state.add_prefixes_[i].prefix);
+      }
+      add_full_hashes_result->insert(add_full_hashes_result->end(),
+                                     db_state.add_full_hashes_.begin(),
+                                     db_state.add_full_hashes_.end());
+      *add_prefix_count += db_state.add_prefixes_.size();
+      *sub_prefix_count += db_state.sub_prefixes_.size();
+
+      if (!shard_limit--)
+        return false;
+      if (!StateInternal::SerializeShard(db_state.StateBegin(),
+                                         db_state.StateEnd(),
+                                         shard.slot_size, &buffer) ||
+          !OverwriteBlocks(buffer, shard.offset, fp, block_checksums)) {
+        return false;
+      }
+    }
+
+    new_pos = new_end;
+    shard_min += stride;
+  } while (shard_min <= kMaxSBPrefix);
+
+  return reader->AtEnd();
+}
+
 }  // namespace
 
 // static
@@ -657,7 +1319,10 @@ void SafeBrowsingStoreFile::CheckForOriginalAndDelete(
 }
 
 SafeBrowsingStoreFile::SafeBrowsingStoreFile()
-    : chunks_written_(0), empty_(false), corruption_seen_(false) {}
+    : chunks_written_(0),
+      empty_(false),
+      corruption_seen_(false),
+      in_place_shard_limit_(std::numeric_limits<size_t>::max()) {}
 
 SafeBrowsingStoreFile::~SafeBrowsingStoreFile() {
   Close();
@@ -682,6 +1347,16 @@ bool SafeBrowsingStoreFile::CheckValidity() {
   if (!file_.get())
     return true;
 
+  // Version 9 files are verified block by block through a mapping.
+  if (PeekFileVersion(file_.get()) == kFileVersion) {
+    MappedStoreReader reader;
+    if (!reader.Open(filename_) || !reader.VerifyAll()) {
+      RecordFormatEvent(FORMAT_EVENT_VALIDITY_CHECKSUM_FAILURE);
+      return OnCorruptDatabase();
+    }
+    return true;
+  }
+
   if (!FileRewind(file_.get()))
     return OnCorruptDatabase();
 
@@ -841,6 +1516,22 @@ bool SafeBrowsingStoreFile::BeginUpdate() {
     return true;
   }
 
+  if (PeekFileVersion(file.get()) == kFileVersion) {
+    MappedStoreReader reader;
+    FileHeaderV9 header;
+    if (!reader.Open(filename_) ||
+        !reader.ReadHeader(&header, &add_chunks_cache_, &sub_chunks_cache_)) {
+      // Close the file so that it can be deleted.
+      file.reset();
+
+      return OnCorruptDatabase();
+    }
+
+    file_.swap(file);
+    new_file_.swap(new_file);
+    return true;
+  }
+
   base::MD5Context context;
   FileHeader header;
   const int version =
@@ -964,28 +1655,61 @@ bool SafeBrowsingStoreFile::DoUpdate(
   uint64 out_stride = kMaxShardStride;
   uint64 process_stride = 0;
 
-  // The header info is only used later if |!empty_|.  The v8 read loop only
-  // needs |in_stride|, while v7 needs to refer to header information.
+  // The header info is only used later if |!empty_|.  The v8 and v9 read loops
+  // only need |in_stride|, while v7 needs to refer to header information.
+  // Version 9 files are read through |reader| rather than |file_|.
   base::MD5Context in_context;
   int version = kInvalidVersion;
   FileHeader header;
+  scoped_ptr<MappedStoreReader> reader;
+
+  // The size of the original file's data, and for version 9 files the headers
+  // of its shards.  The room version 9 slots leave to grow is not counted.
+  int64 original_size = 0;
+  std::vector<ShardSlotHeader> in_shards;
 
   if (!empty_) {
     DCHECK(file_.get());
 
-    version = ReadAndVerifyHeader(filename_, &header,
-                                  &add_chunks_cache_, &sub_chunks_cache_,
-                                  file_.get(), &in_context);
-    if (version == kInvalidVersion)
-      return OnCorruptDatabase();
+    if (PeekFileVersion(file_.get()) == kFileVersion) {
+      reader.reset(new MappedStoreReader);
+      if (!reader->Open(filename_) ||
+          !reader->ReadHeader(&header.v9,
+                              &add_chunks_cache_, &sub_chunks_cache_)) {
+        return OnCorruptDatabase();
+      }
+      version = kFileVersion;
+    } else {
+      version = ReadAndVerifyHeader(filename_, &header,
+                                    &add_chunks_cache_, &sub_chunks_cache_,
+                                    file_.get(), &in_context);
+      if (version == kInvalidVersion)
+        return OnCorruptDatabase();
+    }
 
-    if (version == 8 && header.v8.shard_stride)
+    // Versions 8 and 9 share the start of the header.
+    if (version >= 8 && header.v8.shard_stride)
       in_stride = header.v8.shard_stride;
 
     // The header checksum should have prevented this case, but the code will be
     // broken if this is not correct.
     if (!IsPowerOfTwo(in_stride))
       return OnCorruptDatabase();
+
+    if (version == kFileVersion) {
+      if (!reader->PeekShardHeaders(
+              static_cast<size_t>(kMaxShardStride / in_stride), &in_shards)) {
+        if (reader->checksum_failed())
+          RecordFormatEvent(FORMAT_EVENT_UPDATE_CHECKSUM_FAILURE);
+        return OnCorruptDatabase();
+      }
+      original_size = HeaderBytes(header.v9.add_chunk_count,
+                                  header.v9.sub_chunk_count);
+      for (size_t i = 0; i < in_shards.size(); ++i)
+        original_size += ShardBytes(in_shards[i].shard);
+    } else if (!base::GetFileSize(filename_, &original_size)) {
+      return OnCorruptDatabase();
+    }
   }
 
   // We no longer need to track deleted chunks.
@@ -994,10 +1718,6 @@ bool SafeBrowsingStoreFile::DoUpdate(
 
   // Calculate |out_stride| to break the file down into reasonable shards.
   {
-    int64 original_size = 0;
-    if (!empty_ && !base::GetFileSize(filename_, &original_size))
-      return OnCorruptDatabase();
-
     // Approximate the final size as everything.  Subs and deletes will reduce
     // the size, but modest over-sharding won't hurt much.
     int64 shard_size = original_size + update_size;
@@ -1014,6 +1734,88 @@ bool SafeBrowsingStoreFile::DoUpdate(
     DCHECK(IsPowerOfTwo(out_stride));
   }
 
+  // A version 9 file whose shards line up with the output shards is updated in
+  // place if the new header and every merged shard fit their slots.  Merging
+  // and processing only remove items other than the update's, so a shard's
+  // stored size plus its update data bounds its new size.  A file whose block
+  // checksums could not be found is left to fail in the full rewrite.
+  bool update_in_place =
+      version == kFileVersion && !reader->checksum_failed() &&
+      in_stride == out_stride &&
+      HeaderBytes(add_chunks_cache_.size(), sub_chunks_cache_.size()) <=
+          header.v9.header_size;
+  if (update_in_place) {
+    StateInternalPos pos = new_state.StateBegin();
+    uint64 shard_min = 0;
+    for (size_t i = 0; update_in_place && i < in_shards.size(); ++i) {
+      const SBPrefix shard_max =
+          static_cast<SBPrefix>(shard_min + in_stride - 1);
+      const StateInternalPos end = new_state.ShardEnd(pos, shard_max);
+      const size_t update_bytes =
+          ShardBytes(StateInternal::ShardCounts(pos, end)) -
+          sizeof(ShardSlotHeader);
+      update_in_place = ShardBytes(in_shards[i].shard) + update_bytes <=
+          in_shards[i].slot_size;
+      pos = end;
+      shard_min += in_stride;
+    }
+  }
+
+  if (update_in_place) {
+    // Copy the original data over the update data in |new_file_|, which has
+    // already been read, and update the copy.  The original file is only
+    // replaced once the copy is complete, so a failure part of the way
+    // through leaves it intact.
+    if (!FileRewind(new_file_.get()) ||
+        !reader->WriteDataTo(new_file_.get())) {
+      return false;
+    }
+
+    std::vector<uint32> block_checksums = reader->block_checksums();
+    size_t add_prefix_count = 0;
+    size_t sub_prefix_count = 0;
+    if (!UpdateShardsInPlace(reader.get(), in_stride, &new_state,
+                             add_del_cache_, sub_del_cache_,
+                             in_place_shard_limit_, new_file_.get(),
+                             &block_checksums, builder,
+                             add_full_hashes_result, &add_prefix_count,
+                             &sub_prefix_count)) {
+      if (reader->checksum_failed()) {
+        RecordFormatEvent(FORMAT_EVENT_UPDATE_CHECKSUM_FAILURE);
+        return OnCorruptDatabase();
+      }
+      return false;
+    }
+
+    // Rewrite the header for the new chunk lists, then the block checksums,
+    // which only match once everything else is in place.
+    std::vector<uint8> buffer;
+    if (!SerializeHeader(static_cast<uint32>(in_stride), add_chunks_cache_,
+                         sub_chunks_cache_, header.v9.header_size, &buffer) ||
+        !OverwriteBlocks(buffer, 0, new_file_.get(), &block_checksums) ||
+        fseek(new_file_.get(), static_cast<long>(reader->data_size()),
+              SEEK_SET) != 0 ||
+        !WriteTrailer(block_checksums, new_file_.get()) ||
+        !base::TruncateFile(new_file_.get())) {
+      return false;
+    }
+
+    // Close the files and swizzle the copy into place.
+    reader.reset();
+    file_.reset();
+    new_file_.reset();
+    if (!base::DeleteFile(filename_, false) &&
+        base::PathExists(filename_))
+      return false;
+
+    if (!base::Move(TemporaryFileForFilename(filename_), filename_))
+      return false;
+
+    UMA_HISTOGRAM_COUNTS("SB2.AddPrefixes", add_prefix_count);
+    UMA_HISTOGRAM_COUNTS("SB2.SubPrefixes", sub_prefix_count);
+    return true;
+  }
+
   // Outer loop strides by the max of the input stride (to read integral shards)
   // and the output stride (to write integral shards).
   process_stride = std::max(in_stride, out_stride);
@@ -1021,10 +1823,21 @@ bool SafeBrowsingStoreFile::DoUpdate(
   DCHECK_EQ(0u, process_stride % in_stride);
   DCHECK_EQ(0u, process_stride % out_stride);
 
-  // Start writing the new data to |new_file_|.
-  base::MD5Context out_context;
-  if (!WriteHeader(out_stride, add_chunks_cache_, sub_chunks_cache_,
-                   new_file_.get(), &out_context)) {
+  // Already-processed data does not change when processed again, so a v9 shard
+  // with no update data and no items from deleted chunks can be copied straight
+  // from the mapping, slot and all.  That needs input and output shards to line
+  // up.
+  const bool copy_unchanged_shards =
+      version == kFileVersion && in_stride == out_stride;
+
+  // Start writing the new data to |new_file_|, over the update data which has
+  // already been read.
+  BlockChecksummer out_checksummer;
+  std::vector<uint8> buffer;
+  if (!FileRewind(new_file_.get()) ||
+      !SerializeHeader(static_cast<uint32>(out_stride), add_chunks_cache_,
+                       sub_chunks_cache_, 0, &buffer) ||
+      !WriteBuffer(buffer, new_file_.get(), &out_checksummer)) {
     return false;
   }
 
@@ -1052,6 +1865,10 @@ bool SafeBrowsingStoreFile::DoUpdate(
     // Drop the data from previous pass.
     db_state.ClearData();
 
+    // The update data which falls in the current shard.
+    const StateInternalPos new_end = new_state.ShardEnd(new_pos, process_max);
+    bool shard_copied = false;
+
     // Fill the processing shard with one or more input shards.
     if (!empty_) {
       if (version == 7) {
@@ -1068,7 +1885,7 @@ bool SafeBrowsingStoreFile::DoUpdate(
 
         // v7 data is not sorted correctly.
         db_state.SortData();
-      } else {
+      } else if (version == 8) {
         do {
           ShardHeader shard_header;
           if (!ReadItem(&shard_header, file_.get(), &in_context))
@@ -1081,19 +1898,52 @@ bool SafeBrowsingStoreFile::DoUpdate(
                                    file_.get(), &in_context))
             return OnCorruptDatabase();
 
+          in_min += in_stride;
+        } while (in_min <= kMaxSBPrefix && in_min < process_max);
+      } else {
+        do {
+          MappedShard shard;
+          if (!reader->ReadShard(&shard)) {
+            if (reader->checksum_failed())
+              RecordFormatEvent(FORMAT_EVENT_UPDATE_CHECKSUM_FAILURE);
+            return OnCorruptDatabase();
+          }
+
+          if (copy_unchanged_shards && new_pos.IsEmptyRange(new_end) &&
+              !shard.HasDeletedChunks(add_del_cache_, sub_del_cache_)) {
+            if (!shard.WriteTo(new_file_.get(), &out_checksummer))
+              return false;
+
+            for (size_t i = 0; i < shard.header.add_prefix_count; ++i) {
+              builder->AddPrefix(shard.add_prefixes[i].prefix);
+            }
+            add_full_hashes_result->insert(
+                add_full_hashes_result->end(), shard.add_full_hashes,
+                shard.add_full_hashes + shard.header.add_hash_count);
+            add_prefix_count += shard.header.add_prefix_count;
+            sub_prefix_count += shard.header.sub_prefix_count;
+            shard_copied = true;
+          } else {
+            db_state.AppendShard(shard);
+          }
+
           in_min += in_stride;
         } while (in_min <= kMaxSBPrefix && in_min < process_max);
       }
     }
 
+    // A copied shard was the only input and output shard of this pass.
+    if (shard_copied) {
+      out_min += out_stride;
+      process_min += process_stride;
+      continue;
+    }
+
     // Shard the update data to match the database data, then merge the update
     // data and process the results.
-    {
-      StateInternalPos new_end = new_state.ShardEnd(new_pos, process_max);
-      db_state.MergeDataAndProcess(new_pos, new_end,
-                                   add_del_cache_, sub_del_cache_);
-      new_pos = new_end;
-    }
+    db_state.MergeDataAndProcess(new_pos, new_end,
+                                 add_del_cache_, sub_del_cache_);
+    new_pos = new_end;
 
     // Collect the processed data for return to caller.
     for (size_t i = 0; i < db_state.add_prefixes_.size(); ++i) {
@@ -1112,8 +1962,10 @@ bool SafeBrowsingStoreFile::DoUpdate(
       DCHECK_GT(out_max, out_min);
 
       StateInternalPos out_end = db_state.ShardEnd(out_pos, out_max);
-      if (!db_state.WriteShard(out_pos, out_end, new_file_.get(), &out_context))
+      if (!StateInternal::SerializeShard(out_pos, out_end, 0, &buffer) ||
+          !WriteBuffer(buffer, new_file_.get(), &out_checksummer)) {
         return false;
+      }
       out_pos = out_end;
 
       out_min += out_stride;
@@ -1125,7 +1977,15 @@ bool SafeBrowsingStoreFile::DoUpdate(
 
   // Verify the overall checksum.
   if (!empty_) {
-    if (!ReadAndVerifyChecksum(file_.get(), &in_context)) {
+    if (reader.get()) {
+      // Every block was verified as it was read, so just check that all of
+      // the data was consumed.
+      if (!reader->AtEnd())
+        return OnCorruptDatabase();
+
+      // Unmap the input file as well.
+      reader.reset();
+    } else if (!ReadAndVerifyChecksum(file_.get(), &in_context)) {
       RecordFormatEvent(FORMAT_EVENT_UPDATE_CHECKSUM_FAILURE);
       return OnCorruptDatabase();
     }
@@ -1137,10 +1997,8 @@ bool SafeBrowsingStoreFile::DoUpdate(
   }
   DCHECK(!file_.get());
 
-  // Write the overall checksum.
-  base::MD5Digest out_digest;
-  base::MD5Final(&out_digest, &out_context);
-  if (!WriteItem(out_digest, new_file_.get(), NULL))
+  // Write the block checksums.
+  if (!WriteTrailer(out_checksummer.Finish(), new_file_.get()))
     return false;
 
   // Trim any excess left over from the temporary chunk data.
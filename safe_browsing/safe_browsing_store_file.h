@@ -25,6 +25,8 @@
 // uint32 sub_chunk_count;  // Ditto.
 // uint32 shard_stride;     // SBPrefix space covered per shard.
 //                          // 0==entire space in one shard.
+// uint32 header_size;      // Bytes up to the first shard, a whole number of
+//                          // blocks.
 // // Sorted by chunk_id.
 // array[add_chunk_count] {
 //   int32 chunk_id;
@@ -33,7 +35,8 @@
 // array[sub_chunk_count] {
 //   int32 chunk_id;
 // }
-// MD5Digest header_checksum;  // Checksum over preceeding data.
+// uint32 header_checksum;  // CRC-32 over preceeding data.
+// zero padding to header_size;
 //
 // // Sorted by prefix, then add chunk_id, then hash, both within shards and
 // // overall.
@@ -42,6 +45,8 @@
 //   uint32 sub_prefix_count;
 //   uint32 add_hash_count;
 //   uint32 sub_hash_count;
+//   uint32 slot_size;      // Bytes in the shard, including this header and
+//                          // the padding, a whole number of blocks.
 //   array[add_prefix_count] {
 //     int32 chunk_id;
 //     uint32 prefix;
@@ -61,8 +66,14 @@
 //     int32 add_chunk_id;
 //     char[32] add_full_hash;
 //   }
+//   zero padding to slot_size;
 // }
-// MD5Digest checksum;      // Checksum over entire file.
+// // CRC-32 of each 4k block of the preceeding data.
+// array[block_count] {
+//   uint32 block_checksum;
+// }
+// uint32 block_count;
+// uint32 trailer_checksum;  // CRC-32 of |block_checksum|s and |block_count|.
 //
 // The checksums are used to allow writing the file without doing an expensive
 // fsync().  Since the data can be re-fetched, failing the checksum is not
@@ -72,6 +83,16 @@
 // The |header_checksum| is present to guarantee valid header and chunk data for
 // updates.  Only that part of the file needs to be read to post the update.
 //
+// The file is read through a memory mapping, and each block is verified when
+// it is first reached, so an update reads the file once without copying it
+// through stdio.  The header and each shard are written with room to grow,
+// so that most updates can rewrite only the shards they change, in place in a
+// copy of the file, and then the header and the block checksums, leaving the
+// rest of the data as it was.  The copy is renamed over the original file, so
+// an update which fails partway through leaves the original intact.  Versions
+// 7 and 8, which used MD5 checksums and were streamed, are still read; they
+// are rewritten in the current format by the next update.
+//
 // |shard_stride| breaks the file into approximately-equal portions, allowing
 // updates to stream from one file to another with modest memory usage.  It is
 // dynamic to adjust to different file sizes without adding excessive overhead.
@@ -114,13 +135,25 @@
 // - Write new chunks to the temp file.
 // - When the transaction is finished:
 //   - Read the update data from the temp file into memory.
-//   - Overwrite the temp file with new header data.
-//   - Until done:
-//     - Read shards of the original file's data into memory.
-//     - Merge from the update data.
-//     - Write shards to the temp file.
-//   - Delete original file.
-//   - Rename temp file to original filename.
+//   - If the shard layout is unchanged and every shard fits its slot:
+//     - Overwrite the temp file with a copy of the original file's data.
+//     - Until done:
+//       - Map shards of the original file's data.
+//       - If a shard has update data or something to delete, merge it in
+//         memory and overwrite its slot in the temp file.
+//     - Overwrite the header and write the block checksums.
+//     - Delete original file.
+//     - Rename temp file to original filename.
+//   - Otherwise:
+//     - Overwrite the temp file with new header data.
+//     - Until done:
+//       - Map shards of the original file's data.
+//       - If a shard has no update data and nothing to delete, copy it as-is.
+//       - Otherwise, copy it into memory, merge from the update data and
+//         write shards to the temp file.
+//     - Write the block checksums.
+//     - Delete original file.
+//     - Rename temp file to original filename.
 
 class SafeBrowsingStoreFile : public SafeBrowsingStore {
  public:
@@ -177,6 +210,12 @@ class SafeBrowsingStoreFile : public SafeBrowsingStore {
     return base::FilePath(filename.value() + FILE_PATH_LITERAL("_new"));
   }
 
+  // Makes an update which rewrites shards in place fail once it has
+  // overwritten |limit| of them, to test recovery from a partial update.
+  void SetInPlaceShardLimitForTesting(size_t limit) {
+    in_place_shard_limit_ = limit;
+  }
+
   // Delete any on-disk files, including the permanent storage.
   static bool DeleteStore(const base::FilePath& basename);
 
@@ -266,6 +305,10 @@ class SafeBrowsingStoreFile : public SafeBrowsingStore {
   // TODO(shess): Remove with format-migration support.
   bool corruption_seen_;
 
+  // The number of shards an in-place update may overwrite before it fails.
+  // Only changed by tests.
+  size_t in_place_shard_limit_;
+
   DISALLOW_COPY_AND_ASSIGN(SafeBrowsingStoreFile);
 };
 
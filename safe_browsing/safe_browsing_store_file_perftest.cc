@@ -0,0 +1,256 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/bind.h"
+#include "base/file_util.h"
+#include "base/files/scoped_file.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/md5.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_util.h"
+#include "base/time/time.h"
+#include "chrome/browser/safe_browsing/safe_browsing_store_file.h"
+#include "chrome/browser/test/base/synthetic_random.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+namespace safe_browsing {
+
+namespace {
+
+// Roughly the size of a populated browse store.
+const size_t kPrefixCount = 1000000;
+const int32 kChunkCount = 100;
+
+// Prefixes added by the small update.
+const size_t kUpdatePrefixCount = 100;
+
+// The shard stride the store picks for a file of this size.
+const uint32 kShardStride = 1 << 25;
+
+// Layout of a version 8 file, which the store no longer writes.
+const int32 kFileMagic = 0x600D71FE;
+struct FileHeaderV8 {
+  int32 magic, version;
+  uint32 add_chunk_count, sub_chunk_count;
+  uint32 shard_stride;
+};
+struct ShardHeader {
+  uint32 add_prefix_count, sub_prefix_count;
+  uint32 add_hash_count, sub_hash_count;
+};
+
+template <class T>
+void WriteMD5Item(const T& item, FILE* fp, base::MD5Context* context) {
+  ASSERT_EQ(1U, fwrite(&item, sizeof(item), 1, fp));
+  base::MD5Update(context, base::StringPiece(
+      reinterpret_cast<const char*>(&item), sizeof(item)));
+}
+
+// Writes |add_prefixes|, which must be sorted, as a version 8 file: streamed
+// shards with MD5 checksums over the header and over the whole file.
+void WriteVersion8Store(const base::FilePath& path,
+                        const std::vector<SBAddPrefix>& add_prefixes) {
+  base::ScopedFILE file(base::OpenFile(path, "wb"));
+  ASSERT_TRUE(file.get());
+
+  base::MD5Context context;
+  base::MD5Init(&context);
+  FileHeaderV8 header;
+  header.magic = kFileMagic;
+  header.version = 8;
+  header.add_chunk_count = kChunkCount;
+  header.sub_chunk_count = 0;
+  header.shard_stride = kShardStride;
+  WriteMD5Item(header, file.get(), &context);
+  for (int32 chunk_id = 1; chunk_id <= kChunkCount; ++chunk_id)
+    WriteMD5Item(chunk_id, file.get(), &context);
+  base::MD5Digest digest;
+  base::MD5IntermediateFinal(&digest, &context);
+  WriteMD5Item(digest, file.get(), &context);
+
+  std::vector<SBAddPrefix>::const_iterator iter = add_prefixes.begin();
+  uint64 shard_min = 0;
+  do {
+    const uint64 shard_end = shard_min + kShardStride;
+    std::vector<SBAddPrefix>::const_iterator end = iter;
+    while (end != add_prefixes.end() && end->prefix < shard_end)
+      ++end;
+
+    ShardHeader shard_header;
+    shard_header.add_prefix_count = end - iter;
+    shard_header.sub_prefix_count = 0;
+    shard_header.add_hash_count = 0;
+    shard_header.sub_hash_count = 0;
+    WriteMD5Item(shard_header, file.get(), &context);
+    for (; iter != end; ++iter)
+      WriteMD5Item(*iter, file.get(), &context);
+
+    shard_min = shard_end;
+  } while (shard_min <= static_cast<SBPrefix>(~0));
+
+  base::MD5Final(&digest, &context);
+  WriteMD5Item(digest, file.get(), NULL);
+}
+
+#if defined(OS_LINUX)
+// Returns the value of |field| in /proc/self/status, in kilobytes.
+int64 ReadProcStatusKilobytes(const std::string& field) {
+  std::string status;
+  if (!base::ReadFileToString(base::FilePath("/proc/self/status"), &status))
+    return 0;
+  size_t pos = status.find(field + ":");
+  if (pos == std::string::npos)
+    return 0;
+  pos += field.size() + 1;
+  const size_t end = status.find(" kB", pos);
+  std::string value_string;
+  base::TrimWhitespaceASCII(status.substr(pos, end - pos), base::TRIM_ALL,
+                            &value_string);
+  int64 value = 0;
+  base::StringToInt64(value_string, &value);
+  return value;
+}
+
+// Returns the bytes this process has passed to write calls, from
+// /proc/self/io.
+int64 ReadBytesWritten() {
+  std::string io;
+  if (!base::ReadFileToString(base::FilePath("/proc/self/io"), &io))
+    return 0;
+  const std::string kField = "wchar:";
+  size_t pos = io.find(kField);
+  if (pos == std::string::npos)
+    return 0;
+  pos += kField.size();
+  std::string value_string;
+  base::TrimWhitespaceASCII(io.substr(pos, io.find('\n', pos) - pos),
+                            base::TRIM_ALL, &value_string);
+  int64 value = 0;
+  base::StringToInt64(value_string, &value);
+  return value;
+}
+#endif
+
+}  // namespace
+
+class SafeBrowsingStoreFilePerfTest : public testing::Test {
+ protected:
+  virtual void SetUp() OVERRIDE {
+    ASSERT_TRUE(temp_dir_.CreateUniqueTempDir());
+    filename_ = temp_dir_.path().AppendASCII("SafeBrowsingPerfStore");
+    v8_filename_ = temp_dir_.path().AppendASCII("Version8");
+    v9_filename_ = temp_dir_.path().AppendASCII("Version9");
+
+    SyntheticRandom random;
+    std::vector<SBAddPrefix> add_prefixes;
+    for (size_t i = 0; i < kPrefixCount; ++i) {
+      add_prefixes.push_back(SBAddPrefix(
+          1 + static_cast<int32>(i % kChunkCount), random.NextUint32()));
+    }
+    std::sort(add_prefixes.begin(), add_prefixes.end(),
+              SBAddPrefixLess<SBAddPrefix, SBAddPrefix>);
+    WriteVersion8Store(v8_filename_, add_prefixes);
+
+    // The first update of a version 8 file rewrites it in the current format.
+    ASSERT_TRUE(base::CopyFile(v8_filename_, filename_));
+    scoped_ptr<SafeBrowsingStoreFile> store(OpenStore());
+    ASSERT_TRUE(store->BeginUpdate());
+    PrefixSetBuilder builder;
+    std::vector<SBAddFullHash> add_full_hashes_result;
+    ASSERT_TRUE(store->FinishUpdate(&builder, &add_full_hashes_result));
+    ASSERT_TRUE(base::CopyFile(filename_, v9_filename_));
+  }
+
+  scoped_ptr<SafeBrowsingStoreFile> OpenStore() {
+    scoped_ptr<SafeBrowsingStoreFile> store(new SafeBrowsingStoreFile());
+    store->Init(filename_,
+                base::Bind(&SafeBrowsingStoreFilePerfTest::OnCorruption,
+                           base::Unretained(this)));
+    return store.Pass();
+  }
+
+  void OnCorruption() {
+    ADD_FAILURE() << "Store corrupted";
+  }
+
+  // Copies |source| into place, applies an update which adds |add_count|
+  // prefixes and deletes |deleted_chunk| if non-zero, then reports the wall
+  // time, the growth in peak resident memory and the bytes written under
+  // |trace|.
+  void MeasureUpdate(const base::FilePath& source,
+                     const std::string& modifier,
+                     const std::string& trace,
+                     size_t add_count,
+                     int32 deleted_chunk) {
+    ASSERT_TRUE(base::CopyFile(source, filename_));
+    scoped_ptr<SafeBrowsingStoreFile> store(OpenStore());
+
+#if defined(OS_LINUX)
+    // Reset the peak so that it only covers the update.
+    base::WriteFile(base::FilePath("/proc/self/clear_refs"), "5", 1);
+    const int64 rss_before = ReadProcStatusKilobytes("VmRSS");
+    const int64 written_before = ReadBytesWritten();
+#endif
+
+    const base::TimeTicks start = base::TimeTicks::HighResNow();
+    ASSERT_TRUE(store->BeginUpdate());
+    if (add_count) {
+      const int32 chunk_id = kChunkCount + 1;
+      SyntheticRandom random;
+      ASSERT_TRUE(store->BeginChunk());
+      store->SetAddChunk(chunk_id);
+      for (size_t i = 0; i < add_count; ++i)
+        ASSERT_TRUE(store->WriteAddPrefix(chunk_id, random.NextUint32() >> 8));
+      ASSERT_TRUE(store->FinishChunk());
+    }
+    if (deleted_chunk)
+      store->DeleteAddChunk(deleted_chunk);
+    PrefixSetBuilder builder;
+    std::vector<SBAddFullHash> add_full_hashes_result;
+    ASSERT_TRUE(store->FinishUpdate(&builder, &add_full_hashes_result));
+    const base::TimeDelta elapsed = base::TimeTicks::HighResNow() - start;
+
+    perf_test::PrintResult("sb_store_update", modifier, trace,
+                           elapsed.InMillisecondsF(), "ms", true);
+#if defined(OS_LINUX)
+    perf_test::PrintResult(
+        "sb_store_update_peak_rss_growth", modifier, trace,
+        static_cast<size_t>(ReadProcStatusKilobytes("VmHWM") - rss_before),
+        "kb", false);
+    perf_test::PrintResult(
+        "sb_store_update_written", modifier, trace,
+        static_cast<size_t>((ReadBytesWritten() - written_before) / 1024),
+        "kb", false);
+#endif
+  }
+
+  void MeasureUpdates(const base::FilePath& source,
+                      const std::string& modifier) {
+    MeasureUpdate(source, modifier, "empty", 0, 0);
+    MeasureUpdate(source, modifier, "small_add", kUpdatePrefixCount, 0);
+    MeasureUpdate(source, modifier, "chunk_delete", 0, kChunkCount);
+  }
+
+  base::ScopedTempDir temp_dir_;
+  base::FilePath filename_;
+  base::FilePath v8_filename_;
+  base::FilePath v9_filename_;
+};
+
+// Compares updates of a version 8 file, which is streamed through stdio and
+// MD5, with updates of the same data in the mapped, block-checksummed version
+// 9 layout.  The small update's prefixes are confined to the low end of the
+// prefix space, so a version 9 update only rewrites the few shards they land
+// in, in place, while version 8 rewrites the whole file.
+TEST_F(SafeBrowsingStoreFilePerfTest, Update) {
+  MeasureUpdates(v8_filename_, "_v8");
+  MeasureUpdates(v9_filename_, "_v9");
+}
+
+}  // namespace safe_browsing
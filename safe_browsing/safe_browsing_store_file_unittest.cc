@@ -8,7 +8,6 @@
 #include "base/file_util.h"
 #include "base/files/scoped_file.h"
 #include "base/files/scoped_temp_dir.h"
-#include "base/md5.h"
 #include "base/path_service.h"
 #include "chrome/common/chrome_paths.h"
 #include "testing/gtest/include/gtest/gtest.h"
@@ -490,9 +489,14 @@ TEST_F(SafeBrowsingStoreFileTest, DetectsCorruption) {
     EXPECT_FALSE(corruption_detected_);
   }
 
-  // Corrupt the store.
+  // Corrupt the store, at the chunk id of the first add prefix.  It follows
+  // the padded header and the first shard's header, which are both 5 uint32s.
   base::ScopedFILE file(base::OpenFile(filename_, "rb+"));
-  const long kOffset = 60;
+  const long kHeaderSizeOffset = 5 * sizeof(uint32);
+  EXPECT_EQ(fseek(file.get(), kHeaderSizeOffset, SEEK_SET), 0);
+  uint32 header_size = 0;
+  EXPECT_EQ(fread(&header_size, sizeof(header_size), 1, file.get()), 1U);
+  const long kOffset = header_size + 5 * sizeof(uint32);
   EXPECT_EQ(fseek(file.get(), kOffset, SEEK_SET), 0);
   const uint32 kZero = 0;
   uint32 previous = kZero;
@@ -591,8 +595,8 @@ TEST_F(SafeBrowsingStoreFileTest, CheckValidityChecksum) {
   PopulateStore();
   EXPECT_TRUE(base::PathExists(filename_));
 
-  // An offset from the end of the file which is in the checksum.
-  const int kOffset = -static_cast<int>(sizeof(base::MD5Digest));
+  // An offset from the end of the file which is in the trailer.
+  const int kOffset = -static_cast<int>(2 * sizeof(uint32));
 
   {
     base::ScopedFILE file(base::OpenFile(filename_, "rb+"));
@@ -606,6 +610,259 @@ TEST_F(SafeBrowsingStoreFileTest, CheckValidityChecksum) {
   EXPECT_TRUE(store_->CancelUpdate());
 }
 
+// Corrupt a checksum block past the first.  The header still checks out, so
+// the damage is caught when the block is reached.
+TEST_F(SafeBrowsingStoreFileTest, CheckValidityLaterBlock) {
+  // Enough prefixes for the file to span several checksum blocks.
+  const size_t kPrefixCount = 20000;
+
+  ASSERT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->BeginChunk());
+  store_->SetAddChunk(kAddChunk1);
+  for (size_t i = 0; i < kPrefixCount; ++i) {
+    EXPECT_TRUE(store_->WriteAddPrefix(kAddChunk1, static_cast<SBPrefix>(i)));
+  }
+  EXPECT_TRUE(store_->FinishChunk());
+  {
+    safe_browsing::PrefixSetBuilder builder;
+    std::vector<SBAddFullHash> add_full_hashes_result;
+    EXPECT_TRUE(store_->FinishUpdate(&builder, &add_full_hashes_result));
+  }
+
+  const long kOffset = 100 * 1024;
+  int64 size = 0;
+  ASSERT_TRUE(base::GetFileSize(filename_, &size));
+  ASSERT_GT(size, kOffset);
+  {
+    base::ScopedFILE file(base::OpenFile(filename_, "rb+"));
+    EXPECT_EQ(0, fseek(file.get(), kOffset, SEEK_SET));
+    EXPECT_GE(fputs("hello", file.get()), 0);
+  }
+
+  ASSERT_TRUE(store_->BeginUpdate());
+  EXPECT_FALSE(corruption_detected_);
+  EXPECT_FALSE(store_->CheckValidity());
+  EXPECT_TRUE(corruption_detected_);
+  EXPECT_TRUE(store_->CancelUpdate());
+
+  // An update fails when it reaches the damaged block.
+  corruption_detected_ = false;
+  ASSERT_TRUE(store_->BeginUpdate());
+  EXPECT_FALSE(corruption_detected_);
+  {
+    safe_browsing::PrefixSetBuilder builder;
+    std::vector<SBAddFullHash> add_full_hashes_result;
+    EXPECT_FALSE(store_->FinishUpdate(&builder, &add_full_hashes_result));
+  }
+  EXPECT_TRUE(corruption_detected_);
+}
+
+// Test that an update to a sharded store keeps the shards it has no data for,
+// and that chunk deletions still reach those shards.
+TEST_F(SafeBrowsingStoreFileTest, UpdateKeepsUntouchedShards) {
+  // Enough prefixes spread over the prefix space to need several shards.
+  const size_t kPrefixCount = 20000;
+  const SBPrefix kPrefixStep = kMaxSBPrefix / kPrefixCount;
+
+  ASSERT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->BeginChunk());
+  store_->SetAddChunk(kAddChunk1);
+  for (size_t i = 0; i < kPrefixCount; ++i) {
+    EXPECT_TRUE(store_->WriteAddPrefix(kAddChunk1,
+                                       static_cast<SBPrefix>(i * kPrefixStep)));
+  }
+  EXPECT_TRUE(store_->WriteAddHash(kAddChunk1, kHash1));
+  EXPECT_TRUE(store_->FinishChunk());
+  {
+    safe_browsing::PrefixSetBuilder builder;
+    std::vector<SBAddFullHash> add_full_hashes_result;
+    EXPECT_TRUE(store_->FinishUpdate(&builder, &add_full_hashes_result));
+  }
+  const uint32 shard_stride = ReadStride();
+  ASSERT_NE(0u, shard_stride);
+
+  // Add a prefix to the first shard only.
+  const SBPrefix kNewPrefix = 1;
+  ASSERT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->BeginChunk());
+  store_->SetAddChunk(kAddChunk2);
+  EXPECT_TRUE(store_->WriteAddPrefix(kAddChunk2, kNewPrefix));
+  EXPECT_TRUE(store_->FinishChunk());
+  {
+    safe_browsing::PrefixSetBuilder builder;
+    std::vector<SBAddFullHash> add_full_hashes_result;
+    EXPECT_TRUE(store_->FinishUpdate(&builder, &add_full_hashes_result));
+
+    std::vector<SBPrefix> prefixes_result;
+    builder.GetPrefixSetNoHashes()->GetPrefixes(&prefixes_result);
+    EXPECT_EQ(kPrefixCount + 1, prefixes_result.size());
+    ASSERT_EQ(1U, add_full_hashes_result.size());
+    EXPECT_TRUE(SBFullHashEqual(kHash1, add_full_hashes_result[0].full_hash));
+  }
+  EXPECT_EQ(shard_stride, ReadStride());
+
+  SBAddPrefixes add_prefixes;
+  EXPECT_TRUE(store_->GetAddPrefixes(&add_prefixes));
+  EXPECT_EQ(kPrefixCount + 1, add_prefixes.size());
+
+  // Delete the first chunk, which has items in every shard.
+  ASSERT_TRUE(store_->BeginUpdate());
+  store_->DeleteAddChunk(kAddChunk1);
+  {
+    safe_browsing::PrefixSetBuilder builder;
+    std::vector<SBAddFullHash> add_full_hashes_result;
+    EXPECT_TRUE(store_->FinishUpdate(&builder, &add_full_hashes_result));
+
+    std::vector<SBPrefix> prefixes_result;
+    builder.GetPrefixSetNoHashes()->GetPrefixes(&prefixes_result);
+    ASSERT_EQ(1U, prefixes_result.size());
+    EXPECT_EQ(kNewPrefix, prefixes_result[0]);
+    EXPECT_TRUE(add_full_hashes_result.empty());
+  }
+  EXPECT_FALSE(corruption_detected_);
+}
+
+// Test that an update whose data fits the stored shards rewrites them in
+// place, leaving the file's size alone.
+TEST_F(SafeBrowsingStoreFileTest, UpdateInPlace) {
+  PopulateStore();
+  int64 original_size = 0;
+  ASSERT_TRUE(base::GetFileSize(filename_, &original_size));
+
+  ASSERT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->BeginChunk());
+  store_->SetAddChunk(kAddChunk3);
+  EXPECT_TRUE(store_->WriteAddPrefix(kAddChunk3, kHash5.prefix));
+  EXPECT_TRUE(store_->FinishChunk());
+  store_->DeleteAddChunk(kAddChunk2);
+  {
+    safe_browsing::PrefixSetBuilder builder;
+    std::vector<SBAddFullHash> add_full_hashes_result;
+    EXPECT_TRUE(store_->FinishUpdate(&builder, &add_full_hashes_result));
+
+    std::vector<SBPrefix> prefixes_result;
+    builder.GetPrefixSetNoHashes()->GetPrefixes(&prefixes_result);
+    EXPECT_EQ(3U, prefixes_result.size());
+    EXPECT_TRUE(add_full_hashes_result.empty());
+  }
+  EXPECT_FALSE(corruption_detected_);
+  EXPECT_FALSE(base::PathExists(
+      SafeBrowsingStoreFile::TemporaryFileForFilename(filename_)));
+
+  int64 size = 0;
+  ASSERT_TRUE(base::GetFileSize(filename_, &size));
+  EXPECT_EQ(original_size, size);
+
+  SBAddPrefixes add_prefixes;
+  EXPECT_TRUE(store_->GetAddPrefixes(&add_prefixes));
+  ASSERT_EQ(3U, add_prefixes.size());
+  EXPECT_EQ(kAddChunk1, add_prefixes[0].chunk_id);
+  EXPECT_EQ(kHash1.prefix, add_prefixes[0].prefix);
+  EXPECT_EQ(kAddChunk3, add_prefixes[1].chunk_id);
+  EXPECT_EQ(kHash5.prefix, add_prefixes[1].prefix);
+  EXPECT_EQ(kAddChunk1, add_prefixes[2].chunk_id);
+  EXPECT_EQ(kHash2.prefix, add_prefixes[2].prefix);
+
+  std::vector<SBAddFullHash> add_hashes;
+  EXPECT_TRUE(store_->GetAddFullHashes(&add_hashes));
+  EXPECT_TRUE(add_hashes.empty());
+
+  // The rewritten blocks and chunk lists check out.
+  ASSERT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->CheckValidity());
+  EXPECT_TRUE(store_->CheckAddChunk(kAddChunk3));
+  EXPECT_FALSE(store_->CheckAddChunk(kAddChunk2));
+  EXPECT_TRUE(store_->CancelUpdate());
+  EXPECT_FALSE(corruption_detected_);
+}
+
+// Test that an in-place update which fails part of the way through leaves the
+// stored data as it was.
+TEST_F(SafeBrowsingStoreFileTest, UpdateInPlaceFailure) {
+  // Enough prefixes spread over the prefix space to need several shards.
+  const size_t kPrefixCount = 20000;
+  const SBPrefix kPrefixStep = kMaxSBPrefix / kPrefixCount;
+
+  ASSERT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->BeginChunk());
+  store_->SetAddChunk(kAddChunk1);
+  for (size_t i = 0; i < kPrefixCount; ++i) {
+    EXPECT_TRUE(store_->WriteAddPrefix(kAddChunk1,
+                                       static_cast<SBPrefix>(i * kPrefixStep)));
+  }
+  EXPECT_TRUE(store_->FinishChunk());
+  {
+    safe_browsing::PrefixSetBuilder builder;
+    std::vector<SBAddFullHash> add_full_hashes_result;
+    EXPECT_TRUE(store_->FinishUpdate(&builder, &add_full_hashes_result));
+  }
+  int64 original_size = 0;
+  ASSERT_TRUE(base::GetFileSize(filename_, &original_size));
+
+  // Deleting the chunk changes every shard, and the update fails after the
+  // first.
+  store_->SetInPlaceShardLimitForTesting(1);
+  ASSERT_TRUE(store_->BeginUpdate());
+  store_->DeleteAddChunk(kAddChunk1);
+  {
+    safe_browsing::PrefixSetBuilder builder;
+    std::vector<SBAddFullHash> add_full_hashes_result;
+    EXPECT_FALSE(store_->FinishUpdate(&builder, &add_full_hashes_result));
+  }
+  EXPECT_FALSE(corruption_detected_);
+
+  int64 size = 0;
+  ASSERT_TRUE(base::GetFileSize(filename_, &size));
+  EXPECT_EQ(original_size, size);
+
+  SBAddPrefixes add_prefixes;
+  EXPECT_TRUE(store_->GetAddPrefixes(&add_prefixes));
+  EXPECT_EQ(kPrefixCount, add_prefixes.size());
+
+  ASSERT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->CheckValidity());
+  EXPECT_TRUE(store_->CheckAddChunk(kAddChunk1));
+  EXPECT_TRUE(store_->CancelUpdate());
+  EXPECT_FALSE(corruption_detected_);
+}
+
+// Test that an update which outgrows a shard's slot rewrites the file.
+TEST_F(SafeBrowsingStoreFileTest, UpdateOutgrowsSlot) {
+  PopulateStore();
+  int64 original_size = 0;
+  ASSERT_TRUE(base::GetFileSize(filename_, &original_size));
+
+  // Far more than the slack of the small store's single shard.
+  const size_t kPrefixCount = 2000;
+  ASSERT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->BeginChunk());
+  store_->SetAddChunk(kAddChunk3);
+  for (size_t i = 0; i < kPrefixCount; ++i) {
+    EXPECT_TRUE(store_->WriteAddPrefix(kAddChunk3, static_cast<SBPrefix>(i)));
+  }
+  EXPECT_TRUE(store_->FinishChunk());
+  {
+    safe_browsing::PrefixSetBuilder builder;
+    std::vector<SBAddFullHash> add_full_hashes_result;
+    EXPECT_TRUE(store_->FinishUpdate(&builder, &add_full_hashes_result));
+    EXPECT_EQ(1U, add_full_hashes_result.size());
+  }
+  EXPECT_FALSE(corruption_detected_);
+
+  int64 size = 0;
+  ASSERT_TRUE(base::GetFileSize(filename_, &size));
+  EXPECT_GT(size, original_size);
+
+  SBAddPrefixes add_prefixes;
+  EXPECT_TRUE(store_->GetAddPrefixes(&add_prefixes));
+  EXPECT_EQ(kPrefixCount + 2, add_prefixes.size());
+
+  ASSERT_TRUE(store_->BeginUpdate());
+  EXPECT_TRUE(store_->CheckValidity());
+  EXPECT_TRUE(store_->CancelUpdate());
+  EXPECT_FALSE(corruption_detected_);
+}
+
 TEST_F(SafeBrowsingStoreFileTest, GetAddPrefixesAndHashes) {
   ASSERT_TRUE(store_->BeginUpdate());
 
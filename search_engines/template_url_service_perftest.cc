@@ -0,0 +1,126 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/strings/stringprintf.h"
+#include "base/strings/utf_string_conversions.h"
+#include "base/time/time.h"
+#include "chrome/browser/search_engines/template_url.h"
+#include "chrome/browser/search_engines/template_url_service.h"
+#include "chrome/browser/search_engines/template_url_service_test_util.h"
+#include "chrome/browser/test/base/synthetic_random.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+namespace {
+
+const size_t kEngineCount = 5000;
+const size_t kTypedKeywordCount = 2000;
+
+typedef std::map<base::string16, TemplateURL*> KeywordMap;
+
+std::string EngineKeyword(size_t engine) {
+  return base::StringPrintf("engine%u.example.com",
+                            static_cast<unsigned>(engine));
+}
+
+// The ordering FindMatchingKeywords() used to pass to std::equal_range(),
+// where the prefix is the element with a NULL TemplateURL.
+class LessWithPrefix {
+ public:
+  bool operator()(const KeywordMap::value_type& elem1,
+                  const KeywordMap::value_type& elem2) const {
+    return (elem1.second == NULL) ?
+        (elem2.first.compare(0, elem1.first.length(), elem1.first) > 0) :
+        (elem1.first < elem2.first);
+  }
+};
+
+}  // namespace
+
+class TemplateURLServicePerfTest : public testing::Test {
+ public:
+  TemplateURLServicePerfTest() {}
+
+  virtual void SetUp() OVERRIDE {
+    test_util_.SetUp();
+  }
+
+  virtual void TearDown() OVERRIDE {
+    test_util_.TearDown();
+  }
+
+ protected:
+  TemplateURLService* model() { return test_util_.model(); }
+
+  TemplateURLServiceTestUtil test_util_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(TemplateURLServicePerfTest);
+};
+
+// Replays typing keywords a character at a time, finding the engines whose
+// keywords begin with the text at each keystroke, as the keyword provider
+// does.
+TEST_F(TemplateURLServicePerfTest, KeystrokeReplay) {
+  test_util_.VerifyLoad();
+  for (size_t i = 0; i < kEngineCount; ++i) {
+    TemplateURLData data;
+    data.short_name = base::ASCIIToUTF16(base::StringPrintf(
+        "Engine %u", static_cast<unsigned>(i)));
+    data.SetKeyword(base::ASCIIToUTF16(EngineKeyword(i)));
+    data.SetURL("http://" + EngineKeyword(i) + "/?q={searchTerms}");
+    model()->Add(new TemplateURL(data));
+  }
+
+  KeywordMap keywords;
+  const TemplateURLService::TemplateURLVector template_urls =
+      model()->GetTemplateURLs();
+  for (size_t i = 0; i < template_urls.size(); ++i)
+    keywords[template_urls[i]->keyword()] = template_urls[i];
+  ASSERT_LE(kEngineCount, keywords.size());
+
+  SyntheticRandom random;
+  std::vector<base::string16> keystrokes;
+  for (size_t i = 0; i < kTypedKeywordCount; ++i) {
+    const std::string keyword = EngineKeyword(random.Next() % kEngineCount);
+    for (size_t j = 1; j <= keyword.length(); ++j)
+      keystrokes.push_back(base::ASCIIToUTF16(keyword.substr(0, j)));
+  }
+
+  TemplateURL* const kNullTemplateURL = NULL;
+  size_t range_matches = 0;
+  base::TimeTicks start = base::TimeTicks::HighResNow();
+  for (size_t i = 0; i < keystrokes.size(); ++i) {
+    const std::pair<KeywordMap::const_iterator, KeywordMap::const_iterator>
+        match_range(std::equal_range(
+            keywords.begin(), keywords.end(),
+            KeywordMap::value_type(keystrokes[i], kNullTemplateURL),
+            LessWithPrefix()));
+    range_matches += std::distance(match_range.first, match_range.second);
+  }
+  const base::TimeDelta range_time = base::TimeTicks::HighResNow() - start;
+
+  size_t model_matches = 0;
+  start = base::TimeTicks::HighResNow();
+  for (size_t i = 0; i < keystrokes.size(); ++i) {
+    TemplateURLService::TemplateURLVector matches;
+    model()->FindMatchingKeywords(keystrokes[i], false, &matches);
+    model_matches += matches.size();
+  }
+  const base::TimeDelta model_time = base::TimeTicks::HighResNow() - start;
+
+  EXPECT_EQ(range_matches, model_matches);
+  const double lookups = static_cast<double>(keystrokes.size());
+  perf_test::PrintResult("template_url_service_find_keywords", "_equal_range",
+                         "5k_engines", range_time.InMicroseconds() / lookups,
+                         "us/keystroke", true);
+  perf_test::PrintResult("template_url_service_find_keywords", "_lower_bound",
+                         "5k_engines", model_time.InMicroseconds() / lookups,
+                         "us/keystroke", true);
+}
@@ -510,6 +510,55 @@ TEST_F(TemplateURLServiceTest, AddSameKeywordWithExtensionPresent) {
             model()->GetTemplateURLForKeyword(ASCIIToUTF16("keyword_")));
 }
 
+TEST_F(TemplateURLServiceTest, FindMatchingKeywords) {
+  test_util_.VerifyLoad();
+  AddKeywordWithDate("name1", "zz", "http://zz/{searchTerms}", std::string(),
+                     std::string(), std::string(), true, "UTF-8", Time(),
+                     Time());
+  AddKeywordWithDate("name2", "zzb", "http://zzb/{searchTerms}",
+                     std::string(), std::string(), std::string(), true,
+                     "UTF-8", Time(), Time());
+  AddKeywordWithDate("name3", "zza", "http://zza/", std::string(),
+                     std::string(), std::string(), true, "UTF-8", Time(),
+                     Time());
+  AddKeywordWithDate("name4", "zy", "http://zy/{searchTerms}", std::string(),
+                     std::string(), std::string(), true, "UTF-8", Time(),
+                     Time());
+  AddKeywordWithDate("name5", "zzba", "http://zzba/{searchTerms}",
+                     std::string(), std::string(), std::string(), true,
+                     "UTF-8", Time(), Time());
+
+  TemplateURLService::TemplateURLVector matches;
+  model()->FindMatchingKeywords(ASCIIToUTF16("zz"), false, &matches);
+  ASSERT_EQ(4u, matches.size());
+  EXPECT_EQ(ASCIIToUTF16("zz"), matches[0]->keyword());
+  EXPECT_EQ(ASCIIToUTF16("zza"), matches[1]->keyword());
+  EXPECT_EQ(ASCIIToUTF16("zzb"), matches[2]->keyword());
+  EXPECT_EQ(ASCIIToUTF16("zzba"), matches[3]->keyword());
+
+  // zza does not support replacement.
+  matches.clear();
+  model()->FindMatchingKeywords(ASCIIToUTF16("zz"), true, &matches);
+  ASSERT_EQ(3u, matches.size());
+  EXPECT_EQ(ASCIIToUTF16("zz"), matches[0]->keyword());
+  EXPECT_EQ(ASCIIToUTF16("zzb"), matches[1]->keyword());
+  EXPECT_EQ(ASCIIToUTF16("zzba"), matches[2]->keyword());
+
+  matches.clear();
+  model()->FindMatchingKeywords(ASCIIToUTF16("zzb"), false, &matches);
+  ASSERT_EQ(2u, matches.size());
+  EXPECT_EQ(ASCIIToUTF16("zzb"), matches[0]->keyword());
+  EXPECT_EQ(ASCIIToUTF16("zzba"), matches[1]->keyword());
+
+  // Keywords the prefix sorts between, and prefixes longer than any keyword,
+  // do not match.
+  matches.clear();
+  model()->FindMatchingKeywords(ASCIIToUTF16("zzaa"), false, &matches);
+  EXPECT_TRUE(matches.empty());
+  model()->FindMatchingKeywords(ASCIIToUTF16("zx"), false, &matches);
+  EXPECT_TRUE(matches.empty());
+}
+
 TEST_F(TemplateURLServiceTest, ClearBrowsingData_Keywords) {
   Time now = Time::Now();
   TimeDelta one_day = TimeDelta::FromDays(1);
@@ -4,6 +4,7 @@
 
 #include "chrome/browser/sessions/session_backend.h"
 
+#include <algorithm>
 #include <limits>
 
 #include "base/file_util.h"
@@ -43,11 +44,23 @@ class SessionFileReader {
   explicit SessionFileReader(const base::FilePath& path)
       : errored_(false),
         buffer_(SessionBackend::kFileReadBufferSize, 0),
+        owned_file_(new base::File(
+            path, base::File::FLAG_OPEN | base::File::FLAG_READ)),
+        file_(owned_file_.get()),
         buffer_position_(0),
         available_count_(0) {
-    file_.reset(new base::File(
-        path, base::File::FLAG_OPEN | base::File::FLAG_READ));
   }
+
+  // Reads from |file|, which must be positioned at its start and outlive the
+  // reader.
+  explicit SessionFileReader(base::File* file)
+      : errored_(false),
+        buffer_(SessionBackend::kFileReadBufferSize, 0),
+        file_(file),
+        buffer_position_(0),
+        available_count_(0) {
+  }
+
   // Reads the contents of the file specified in the constructor, returning
   // true on success. It is up to the caller to free all SessionCommands
   // added to commands.
@@ -73,8 +86,9 @@ class SessionFileReader {
   // As we read from the file, data goes here.
   std::string buffer_;
 
-  // The file.
-  scoped_ptr<base::File> file_;
+  // The file, and its owner if it was opened by the reader.
+  scoped_ptr<base::File> owned_file_;
+  base::File* file_;
 
   // Position in buffer_ of the data.
   size_t buffer_position_;
@@ -195,16 +209,25 @@ static const char* kLastTabSessionFileName = "Last Tabs";
 static const char* kCurrentSessionFileName = "Current Session";
 static const char* kLastSessionFileName = "Last Session";
 
+// Suffix of the file the current file is compacted into.
+static const base::FilePath::CharType kCompactSessionFileExtension[] =
+    FILE_PATH_LITERAL("compact");
+
 // static
 const int SessionBackend::kFileReadBufferSize = 1024;
 
+// static
+const size_t SessionBackend::kMinCommandsPerCompaction = 250;
+
 SessionBackend::SessionBackend(BaseSessionService::SessionType type,
                                const base::FilePath& path_to_dir)
     : type_(type),
       path_to_dir_(path_to_dir),
       last_session_valid_(false),
       inited_(false),
-      empty_file_(true) {
+      empty_file_(true),
+      snapshot_command_count_(0),
+      commands_since_compaction_(0) {
   // NOTE: this is invoked on the main thread, don't do file access here.
 }
 
@@ -230,14 +253,29 @@ void SessionBackend::AppendCommands(
       !current_session_file_->IsValid()) {
     ResetFile();
   }
+  for (std::vector<SessionCommand*>::const_iterator i = commands->begin();
+       i != commands->end(); ++i) {
+    const size_type total_size =
+        static_cast<size_type>((*i)->size()) + sizeof(id_type);
+    if (type_ == BaseSessionService::TAB_RESTORE)
+      UMA_HISTOGRAM_COUNTS("TabRestore.command_size", total_size);
+    else
+      UMA_HISTOGRAM_COUNTS("SessionRestore.command_size", total_size);
+  }
   // Need to check current_session_file_ again, ResetFile may fail.
   if (current_session_file_.get() && current_session_file_->IsValid() &&
       !AppendCommandsToFile(current_session_file_.get(), *commands)) {
     current_session_file_.reset(NULL);
   }
   empty_file_ = false;
+  if (reset_first)
+    snapshot_command_count_ = commands->size();
+  else
+    commands_since_compaction_ += commands->size();
   STLDeleteElements(commands);
   delete commands;
+
+  MaybeCompactCurrentFile();
 }
 
 void SessionBackend::ReadLastSessionCommands(
@@ -297,42 +335,54 @@ void SessionBackend::MoveCurrentSessionToLastSession() {
 bool SessionBackend::ReadCurrentSessionCommandsImpl(
     std::vector<SessionCommand*>* commands) {
   Init();
-  SessionFileReader file_reader(GetCurrentSessionPath());
-  return file_reader.Read(type_, commands);
+  if (!current_session_file_.get() || !current_session_file_->IsValid()) {
+    SessionFileReader file_reader(GetCurrentSessionPath());
+    return file_reader.Read(type_, commands);
+  }
+
+  // The current file is opened exclusively, so read it through our handle and
+  // return to the end for the next append.
+  if (current_session_file_->Seek(base::File::FROM_BEGIN, 0) != 0) {
+    current_session_file_.reset(NULL);
+    return false;
+  }
+  SessionFileReader file_reader(current_session_file_.get());
+  const bool read = file_reader.Read(type_, commands);
+  if (current_session_file_->Seek(base::File::FROM_END, 0) < 0)
+    current_session_file_.reset(NULL);
+  return read;
 }
 
 bool SessionBackend::AppendCommandsToFile(base::File* file,
     const std::vector<SessionCommand*>& commands) {
+  // Serialize all the commands first, so the batch takes a single write.
+  std::string buffer;
+  size_t buffer_size = 0;
+  for (std::vector<SessionCommand*>::const_iterator i = commands.begin();
+       i != commands.end(); ++i) {
+    buffer_size += sizeof(size_type) + sizeof(id_type) + (*i)->size();
+  }
+  buffer.reserve(buffer_size);
   for (std::vector<SessionCommand*>::const_iterator i = commands.begin();
        i != commands.end(); ++i) {
-    int wrote;
     const size_type content_size = static_cast<size_type>((*i)->size());
-    const size_type total_size =  content_size + sizeof(id_type);
-    if (type_ == BaseSessionService::TAB_RESTORE)
-      UMA_HISTOGRAM_COUNTS("TabRestore.command_size", total_size);
-    else
-      UMA_HISTOGRAM_COUNTS("SessionRestore.command_size", total_size);
-    wrote = file->WriteAtCurrentPos(reinterpret_cast<const char*>(&total_size),
-                                    sizeof(total_size));
-    if (wrote != sizeof(total_size)) {
-      NOTREACHED() << "error writing";
-      return false;
-    }
-    id_type command_id = (*i)->id();
-    wrote = file->WriteAtCurrentPos(reinterpret_cast<char*>(&command_id),
-                                    sizeof(command_id));
-    if (wrote != sizeof(command_id)) {
-      NOTREACHED() << "error writing";
-      return false;
-    }
-    if (content_size > 0) {
-      wrote = file->WriteAtCurrentPos(reinterpret_cast<char*>((*i)->contents()),
-                                      content_size);
-      if (wrote != content_size) {
-        NOTREACHED() << "error writing";
-        return false;
-      }
-    }
+    const size_type total_size = content_size + sizeof(id_type);
+    const id_type command_id = (*i)->id();
+    buffer.append(reinterpret_cast<const char*>(&total_size),
+                  sizeof(total_size));
+    buffer.append(reinterpret_cast<const char*>(&command_id),
+                  sizeof(command_id));
+    if (content_size > 0)
+      buffer.append((*i)->contents(), content_size);
+  }
+  if (buffer.empty())
+    return true;
+
+  const int wrote = file->WriteAtCurrentPos(buffer.data(),
+                                            static_cast<int>(buffer.size()));
+  if (wrote != static_cast<int>(buffer.size())) {
+    NOTREACHED() << "error writing";
+    return false;
   }
 #if defined(OS_CHROMEOS)
   file->Flush();
@@ -340,6 +390,74 @@ bool SessionBackend::AppendCommandsToFile(base::File* file,
   return true;
 }
 
+void SessionBackend::MaybeCompactCurrentFile() {
+  if (compact_commands_callback_.is_null() || !current_session_file_.get() ||
+      !current_session_file_->IsValid()) {
+    return;
+  }
+  if (commands_since_compaction_ <
+      std::max(kMinCommandsPerCompaction, snapshot_command_count_)) {
+    return;
+  }
+  // Wait for another full interval if compacting fails.
+  commands_since_compaction_ = 0;
+  CompactCurrentFile();
+}
+
+bool SessionBackend::CompactCurrentFile() {
+  TimeTicks start_time = TimeTicks::Now();
+  ScopedVector<SessionCommand> commands;
+  if (!ReadCurrentSessionCommandsImpl(&(commands.get())))
+    return false;
+  compact_commands_callback_.Run(&(commands.get()));
+
+  // Flush the compacted file before renaming it, so that after a crash one of
+  // the two files is complete.
+  const base::FilePath current_session_path = GetCurrentSessionPath();
+  const base::FilePath compact_session_path = GetCompactSessionPath();
+  scoped_ptr<base::File> compact_file(
+      OpenAndWriteHeader(compact_session_path));
+  if (!compact_file.get() ||
+      !AppendCommandsToFile(compact_file.get(), commands.get()) ||
+      !compact_file->Flush()) {
+    compact_file.reset();
+    base::DeleteFile(compact_session_path, false);
+    return false;
+  }
+  compact_file.reset();
+
+  current_session_file_.reset(NULL);
+  const bool replaced =
+      base::ReplaceFile(compact_session_path, current_session_path, NULL);
+  if (!replaced)
+    base::DeleteFile(compact_session_path, false);
+
+  current_session_file_.reset(OpenForAppend(current_session_path));
+  if (!current_session_file_.get()) {
+    // Start the file over; the commands we have describe the whole session.
+    ResetFile();
+    if (!current_session_file_.get() ||
+        !AppendCommandsToFile(current_session_file_.get(), commands.get())) {
+      current_session_file_.reset(NULL);
+      return false;
+    }
+    empty_file_ = false;
+  } else if (!replaced) {
+    return false;
+  }
+
+  snapshot_command_count_ = commands.size();
+  commands_since_compaction_ = 0;
+  if (type_ == BaseSessionService::TAB_RESTORE) {
+    UMA_HISTOGRAM_TIMES("TabRestore.compact_session_file_time",
+                        TimeTicks::Now() - start_time);
+  } else {
+    UMA_HISTOGRAM_TIMES("SessionRestore.compact_session_file_time",
+                        TimeTicks::Now() - start_time);
+  }
+  return true;
+}
+
 SessionBackend::~SessionBackend() {
   if (current_session_file_.get()) {
     // Destructor performs file IO because file is open in sync mode.
@@ -365,14 +483,18 @@ void SessionBackend::ResetFile() {
   if (!current_session_file_.get())
     current_session_file_.reset(OpenAndWriteHeader(GetCurrentSessionPath()));
   empty_file_ = true;
+  snapshot_command_count_ = 0;
+  commands_since_compaction_ = 0;
 }
 
 base::File* SessionBackend::OpenAndWriteHeader(const base::FilePath& path) {
   DCHECK(!path.empty());
+  // The file is also opened for reading so it can be compacted.
   scoped_ptr<base::File> file(new base::File(
       path,
-      base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_WRITE |
-      base::File::FLAG_EXCLUSIVE_WRITE | base::File::FLAG_EXCLUSIVE_READ));
+      base::File::FLAG_CREATE_ALWAYS | base::File::FLAG_READ |
+      base::File::FLAG_WRITE | base::File::FLAG_EXCLUSIVE_WRITE |
+      base::File::FLAG_EXCLUSIVE_READ));
   if (!file->IsValid())
     return NULL;
   FileHeader header;
@@ -385,6 +507,18 @@ base::File* SessionBackend::OpenAndWriteHeader(const base::FilePath& path) {
   return file.release();
 }
 
+base::File* SessionBackend::OpenForAppend(const base::FilePath& path) {
+  DCHECK(!path.empty());
+  scoped_ptr<base::File> file(new base::File(
+      path,
+      base::File::FLAG_OPEN | base::File::FLAG_READ |
+      base::File::FLAG_WRITE | base::File::FLAG_EXCLUSIVE_WRITE |
+      base::File::FLAG_EXCLUSIVE_READ));
+  if (!file->IsValid() || file->Seek(base::File::FROM_END, 0) < 0)
+    return NULL;
+  return file.release();
+}
+
 base::FilePath SessionBackend::GetLastSessionPath() {
   base::FilePath path = path_to_dir_;
   if (type_ == BaseSessionService::TAB_RESTORE)
@@ -402,3 +536,7 @@ base::FilePath SessionBackend::GetCurrentSessionPath() {
     path = path.AppendASCII(kCurrentSessionFileName);
   return path;
 }
+
+base::FilePath SessionBackend::GetCompactSessionPath() {
+  return GetCurrentSessionPath().AddExtension(kCompactSessionFileExtension);
+}
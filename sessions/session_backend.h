@@ -7,6 +7,7 @@
 
 #include <vector>
 
+#include "base/callback.h"
 #include "base/memory/ref_counted.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/task/cancelable_task_tracker.h"
@@ -30,15 +31,33 @@ class File;
 // BaseSessionService. A command consists of a unique id and a stream of bytes.
 // SessionBackend does not use the id in anyway, that is used by
 // BaseSessionService.
+//
+// The current file is a log: a reset writes a snapshot of the session, and
+// later commands are appended to it. If the service supplies a
+// CompactCommandsCallback, the backend periodically replaces the file with
+// a compacted copy of its commands, so the log stays proportional to the
+// session's state rather than its history. Compaction happens on the backend
+// thread; the compacted file is written and flushed next to the current file
+// and then renamed over it.
 class SessionBackend : public base::RefCountedThreadSafe<SessionBackend> {
  public:
   typedef SessionCommand::id_type id_type;
   typedef SessionCommand::size_type size_type;
 
+  // Replaces the commands in the vector with an equivalent, shorter list,
+  // deleting the commands it drops. Run on the backend thread.
+  typedef base::Callback<void(std::vector<SessionCommand*>*)>
+      CompactCommandsCallback;
+
   // Initial size of the buffer used in reading the file. This is exposed
   // for testing.
   static const int kFileReadBufferSize;
 
+  // The current file is compacted once this many commands, or as many as
+  // the last snapshot held if that is more, have been appended to it. This is
+  // exposed for testing.
+  static const size_t kMinCommandsPerCompaction;
+
   // Creates a SessionBackend. This method is invoked on the MAIN thread,
   // and does no IO. The real work is done from Init, which is invoked on
   // the file thread.
@@ -56,6 +75,12 @@ class SessionBackend : public base::RefCountedThreadSafe<SessionBackend> {
   void Init();
   bool inited() const { return inited_; }
 
+  // Sets the callback used to compact the current file. Must be called before
+  // the backend is used on the backend thread.
+  void set_compact_commands_callback(const CompactCommandsCallback& callback) {
+    compact_commands_callback_ = callback;
+  }
+
   // Appends the specified commands to the current file. If reset_first is
   // true the the current file is recreated.
   //
@@ -107,10 +132,22 @@ class SessionBackend : public base::RefCountedThreadSafe<SessionBackend> {
   // the file is returned.
   base::File* OpenAndWriteHeader(const base::FilePath& path);
 
-  // Appends the specified commands to the specified file.
+  // Opens an existing file for appending. On success a handle to the file,
+  // positioned at its end, is returned.
+  base::File* OpenForAppend(const base::FilePath& path);
+
+  // Appends the specified commands to the specified file, with one write.
   bool AppendCommandsToFile(base::File* file,
                             const std::vector<SessionCommand*>& commands);
 
+  // Compacts the current file if enough commands were appended since it was
+  // last written as a whole.
+  void MaybeCompactCurrentFile();
+
+  // Rewrites the current file with its commands as compacted by
+  // |compact_commands_callback_|. Returns true if the file was replaced.
+  bool CompactCurrentFile();
+
   const BaseSessionService::SessionType type_;
 
   // Returns the path to the last file.
@@ -119,6 +156,10 @@ class SessionBackend : public base::RefCountedThreadSafe<SessionBackend> {
   // Returns the path to the current file.
   base::FilePath GetCurrentSessionPath();
 
+  // Returns the path the compacted current file is written to before it
+  // replaces the current file.
+  base::FilePath GetCompactSessionPath();
+
   // Directory files are relative to.
   const base::FilePath path_to_dir_;
 
@@ -135,6 +176,14 @@ class SessionBackend : public base::RefCountedThreadSafe<SessionBackend> {
   // If true, the file is empty (no commands have been added to it).
   bool empty_file_;
 
+  // See set_compact_commands_callback(). May be null.
+  CompactCommandsCallback compact_commands_callback_;
+
+  // Number of commands the current file held after it was last reset or
+  // compacted, and the number appended since.
+  size_t snapshot_command_count_;
+  size_t commands_since_compaction_;
+
   DISALLOW_COPY_AND_ASSIGN(SessionBackend);
 };
 
@@ -2,6 +2,9 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <set>
+
+#include "base/bind.h"
 #include "base/file_util.h"
 #include "base/files/scoped_temp_dir.h"
 #include "base/stl_util.h"
@@ -28,6 +31,20 @@ SessionCommand* CreateCommandFromData(const TestData& data) {
   return command;
 }
 
+// Compacts by keeping only the last command with each id.
+void KeepLastCommandOfEachId(std::vector<SessionCommand*>* commands) {
+  std::set<SessionCommand::id_type> seen_ids;
+  std::vector<SessionCommand*> compacted;
+  for (std::vector<SessionCommand*>::reverse_iterator i = commands->rbegin();
+       i != commands->rend(); ++i) {
+    if (seen_ids.insert((*i)->id()).second)
+      compacted.insert(compacted.begin(), *i);
+    else
+      delete *i;
+  }
+  commands->swap(compacted);
+}
+
 }  // namespace
 
 class SessionBackendTest : public testing::Test {
@@ -201,3 +218,60 @@ TEST_F(SessionBackendTest, Truncate) {
 
   STLDeleteElements(&commands);
 }
+
+// Appends enough commands to compact the file, and makes sure the compacted
+// file is used for the commands that follow.
+TEST_F(SessionBackendTest, Compaction) {
+  scoped_refptr<SessionBackend> backend(
+      new SessionBackend(BaseSessionService::SESSION_RESTORE, path_));
+  backend->set_compact_commands_callback(
+      base::Bind(&KeepLastCommandOfEachId));
+
+  struct TestData data[] = {
+    { 1, "a" },
+    { 2, "b" },
+    { 3, "c" },
+  };
+  std::vector<SessionCommand*> commands;
+  for (size_t i = 0; i + 1 < SessionBackend::kMinCommandsPerCompaction; ++i)
+    commands.push_back(CreateCommandFromData(data[i % arraysize(data)]));
+  backend->AppendCommands(new SessionCommands(commands), false);
+  commands.clear();
+
+  // Not compacted yet.
+  ASSERT_TRUE(backend->ReadCurrentSessionCommandsImpl(&commands));
+  EXPECT_EQ(SessionBackend::kMinCommandsPerCompaction - 1, commands.size());
+  STLDeleteElements(&commands);
+
+  // One more command reaches the threshold, leaving the last command of each
+  // id in the file.
+  struct TestData last_data = { 4, "d" };
+  commands.push_back(CreateCommandFromData(last_data));
+  backend->AppendCommands(new SessionCommands(commands), false);
+  commands.clear();
+  EXPECT_FALSE(base::PathExists(path_.AppendASCII("Current Session.compact")));
+  ASSERT_TRUE(backend->ReadCurrentSessionCommandsImpl(&commands));
+  EXPECT_EQ(arraysize(data) + 1, commands.size());
+  STLDeleteElements(&commands);
+
+  // Commands keep being appended after the compacted ones.
+  struct TestData next_data = { 5, "e" };
+  commands.push_back(CreateCommandFromData(next_data));
+  backend->AppendCommands(new SessionCommands(commands), false);
+  commands.clear();
+
+  backend = NULL;
+  backend = new SessionBackend(BaseSessionService::SESSION_RESTORE, path_);
+  ASSERT_TRUE(backend->ReadLastSessionCommandsImpl(&commands));
+  ASSERT_EQ(arraysize(data) + 2, commands.size());
+  // The compacted commands keep the order their last copies were written in.
+  const size_t first_kept =
+      SessionBackend::kMinCommandsPerCompaction - 1 - arraysize(data);
+  for (size_t i = 0; i < arraysize(data); ++i) {
+    AssertCommandEqualsData(data[(first_kept + i) % arraysize(data)],
+                            commands[i]);
+  }
+  AssertCommandEqualsData(last_data, commands[arraysize(data)]);
+  AssertCommandEqualsData(next_data, commands[arraysize(data) + 1]);
+  STLDeleteElements(&commands);
+}
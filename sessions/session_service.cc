@@ -84,8 +84,10 @@ static const SessionCommand::id_type kCommandSetTabUserAgentOverride = 18;
 static const SessionCommand::id_type kCommandSessionStorageAssociated = 19;
 static const SessionCommand::id_type kCommandSetActiveWindow = 20;
 
-// Every kWritesPerReset commands triggers recreating the file.
-static const int kWritesPerReset = 250;
+// Every kWritesPerReset commands triggers recreating the file from the
+// browsers. The backend compacts the file in between, so this only bounds how
+// many navigations of each tab are kept.
+static const int kWritesPerReset = 2500;
 
 namespace {
 
@@ -137,6 +139,29 @@ struct PinnedStatePayload {
   bool pinned_state;
 };
 
+// Identifies the state a command sets, for SessionService::CompactCommands():
+// the command id, the tab or window, and for navigations the navigation index
+// and the number of later kCommandTabNavigationPathPrunedFromFront commands
+// for the tab, which renumber the navigations.
+typedef std::pair<std::pair<SessionCommand::id_type, SessionID::id_type>,
+                  std::pair<int, int> > CommandKey;
+
+// Reads the id and index that pickled commands start with.
+bool ReadPickledIdAndIndex(const SessionCommand& command,
+                           SessionID::id_type* id,
+                           int* index) {
+  scoped_ptr<Pickle> pickle(command.PayloadAsPickle());
+  PickleIterator iterator(*pickle);
+  return pickle->ReadInt(&iterator, id) && pickle->ReadInt(&iterator, index);
+}
+
+// Reads the id that pickled commands start with.
+bool ReadPickledId(const SessionCommand& command, SessionID::id_type* id) {
+  scoped_ptr<Pickle> pickle(command.PayloadAsPickle());
+  PickleIterator iterator(*pickle);
+  return pickle->ReadInt(&iterator, id);
+}
+
 // Returns the show state to store to disk based |state|.
 ui::WindowShowState AdjustShowState(ui::WindowShowState state) {
   switch (state) {
@@ -546,6 +571,9 @@ void SessionService::Save() {
 }
 
 void SessionService::Init() {
+  backend()->set_compact_commands_callback(
+      base::Bind(&SessionService::CompactCommands));
+
   // Register for the notifications we're interested in.
   registrar_.Add(this, content::NOTIFICATION_NAV_LIST_PRUNED,
                  content::NotificationService::AllSources());
@@ -1442,6 +1470,149 @@ void SessionService::ScheduleReset() {
   StartSaveTimer();
 }
 
+// static
+void SessionService::CompactCommands(std::vector<SessionCommand*>* commands) {
+  // Walk backwards, so that by the time a command is seen, the commands that
+  // make it redundant have been.
+  std::set<CommandKey> keys_set_later;
+  std::set<SessionID::id_type> closed_tabs;
+  std::set<SessionID::id_type> closed_windows;
+  std::map<SessionID::id_type, int> front_prune_counts;
+  std::vector<bool> keep(commands->size(), false);
+
+  for (size_t i = commands->size(); i-- > 0;) {
+    const SessionCommand& command = *(*commands)[i];
+    // The tab or window the command applies to, if any.
+    SessionID::id_type tab_id = 0;
+    SessionID::id_type window_id = 0;
+    bool for_tab = false;
+    bool for_window = false;
+    bool sets_state = true;
+    int navigation_index = 0;
+    switch (command.id()) {
+      case kCommandSetTabWindow: {
+        SessionID::id_type payload[2];
+        if (!command.GetPayload(payload, sizeof(payload)))
+          return;
+        tab_id = payload[1];
+        for_tab = true;
+        break;
+      }
+      case kCommandSetWindowBounds3: {
+        WindowBoundsPayload3 payload;
+        if (!command.GetPayload(&payload, sizeof(payload)))
+          return;
+        window_id = payload.window_id;
+        for_window = true;
+        break;
+      }
+      case kCommandSetTabIndexInWindow:
+      case kCommandSetSelectedNavigationIndex:
+      case kCommandTabNavigationPathPrunedFromBack:
+      case kCommandTabNavigationPathPrunedFromFront:
+      case kCommandSetSelectedTabInIndex:
+      case kCommandSetWindowType: {
+        IDAndIndexPayload payload;
+        if (!command.GetPayload(&payload, sizeof(payload)))
+          return;
+        if (command.id() == kCommandSetSelectedTabInIndex ||
+            command.id() == kCommandSetWindowType) {
+          window_id = payload.id;
+          for_window = true;
+        } else {
+          tab_id = payload.id;
+          for_tab = true;
+        }
+        // Pruning depends on the navigations before it, so always keep it.
+        if (command.id() == kCommandTabNavigationPathPrunedFromBack ||
+            command.id() == kCommandTabNavigationPathPrunedFromFront) {
+          sets_state = false;
+        }
+        break;
+      }
+      case kCommandUpdateTabNavigation:
+        if (!ReadPickledIdAndIndex(command, &tab_id, &navigation_index))
+          return;
+        for_tab = true;
+        break;
+      case kCommandSetPinnedState: {
+        PinnedStatePayload payload;
+        if (!command.GetPayload(&payload, sizeof(payload)))
+          return;
+        tab_id = payload.tab_id;
+        for_tab = true;
+        break;
+      }
+      case kCommandSetWindowAppName:
+        if (!ReadPickledId(command, &window_id))
+          return;
+        for_window = true;
+        break;
+      case kCommandSetExtensionAppID:
+      case kCommandSetTabUserAgentOverride:
+      case kCommandSessionStorageAssociated:
+        if (!ReadPickledId(command, &tab_id))
+          return;
+        for_tab = true;
+        break;
+      case kCommandTabClosed:
+      case kCommandWindowClosed: {
+        // Restoring a close deletes everything known about the tab or window,
+        // so the close and all commands for it before are dropped. Later
+        // commands for the same id start from scratch either way.
+        ClosedPayload payload;
+        if (!command.GetPayload(&payload, sizeof(payload)))
+          return;
+        if (command.id() == kCommandTabClosed)
+          closed_tabs.insert(payload.id);
+        else
+          closed_windows.insert(payload.id);
+        continue;
+      }
+      case kCommandSetActiveWindow: {
+        // Applies to the session, even if the window is closed later.
+        ActiveWindowPayload payload;
+        if (!command.GetPayload(&payload, sizeof(payload)))
+          return;
+        break;
+      }
+      default:
+        // Obsolete or unknown commands; leave the file alone.
+        return;
+    }
+
+    if ((for_tab && closed_tabs.count(tab_id)) ||
+        (for_window && closed_windows.count(window_id))) {
+      continue;
+    }
+
+    if (command.id() == kCommandTabNavigationPathPrunedFromFront)
+      ++front_prune_counts[tab_id];
+
+    if (sets_state) {
+      const int front_prune_count =
+          command.id() == kCommandUpdateTabNavigation ?
+              front_prune_counts[tab_id] : 0;
+      const CommandKey key(std::make_pair(command.id(),
+                                          for_tab ? tab_id : window_id),
+                           std::make_pair(navigation_index,
+                                          front_prune_count));
+      if (!keys_set_later.insert(key).second)
+        continue;
+    }
+    keep[i] = true;
+  }
+
+  std::vector<SessionCommand*> compacted;
+  for (size_t i = 0; i < commands->size(); ++i) {
+    if (keep[i])
+      compacted.push_back((*commands)[i]);
+    else
+      delete (*commands)[i];
+  }
+  commands->swap(compacted);
+}
+
 bool SessionService::ReplacePendingCommand(SessionCommand* command) {
   // We optimize page navigations, which can happen quite frequently and
   // are expensive. And activation is like Highlander, there can only be one!
@@ -205,6 +205,7 @@ class SessionService : public BaseSessionService,
   // Allow tests to access our innards for testing purposes.
   FRIEND_TEST_ALL_PREFIXES(SessionServiceTest, RestoreActivation1);
   FRIEND_TEST_ALL_PREFIXES(SessionServiceTest, RestoreActivation2);
+  FRIEND_TEST_ALL_PREFIXES(SessionServiceTest, CompactCommands);
   FRIEND_TEST_ALL_PREFIXES(NoStartupWindowTest, DontInitSessionServiceForApps);
 
   typedef std::map<SessionID::id_type, std::pair<int, int> > IdToRange;
@@ -381,6 +382,14 @@ class SessionService : public BaseSessionService,
   // from the state of the browser.
   void ScheduleReset();
 
+  // Replaces |commands| with a shorter list that restores to the same
+  // session, deleting the commands it drops. Commands setting state that a
+  // later command sets again are dropped, as are all commands for a tab or
+  // window before it was closed. |commands| is left as is if it contains a
+  // command that can't be read. This is the backend's CompactCommandsCallback,
+  // and runs on the backend thread.
+  static void CompactCommands(std::vector<SessionCommand*>* commands);
+
   // Searches for a pending command that can be replaced with command.
   // If one is found, pending command is removed, command is added to
   // the pending commands and true is returned.
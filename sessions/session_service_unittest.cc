@@ -297,6 +297,86 @@ TEST_F(SessionServiceTest, Pruning) {
   helper_.AssertNavigationEquals(nav1, tab->navigations[2]);
 }
 
+// Compacting the commands of a session must restore the same session.
+TEST_F(SessionServiceTest, CompactCommands) {
+  SessionID tab_id;
+  SessionID tab2_id;
+
+  SerializedNavigationEntry nav1 =
+      SerializedNavigationEntryTestHelper::CreateNavigation(
+          "http://google.com", "abc");
+  SerializedNavigationEntry nav2 =
+      SerializedNavigationEntryTestHelper::CreateNavigation(
+          "http://google2.com", "abcd");
+
+  helper_.PrepareTabInWindow(window_id, tab_id, 0, true);
+  for (int i = 0; i < 6; ++i) {
+    SerializedNavigationEntry* nav = (i % 2) == 0 ? &nav1 : &nav2;
+    nav->set_index(i);
+    UpdateNavigation(window_id, tab_id, *nav, true);
+  }
+  service()->TabNavigationPathPrunedFromBack(window_id, tab_id, 4);
+  service()->TabNavigationPathPrunedFromFront(window_id, tab_id, 1);
+  nav2.set_index(3);
+  UpdateNavigation(window_id, tab_id, nav2, true);
+  nav1.set_index(1);
+  UpdateNavigation(window_id, tab_id, nav1, true);
+  service()->SetPinnedState(window_id, tab_id, true);
+  service()->SetPinnedState(window_id, tab_id, false);
+  service()->SetPinnedState(window_id, tab_id, true);
+
+  nav2.set_index(0);
+  helper_.PrepareTabInWindow(window_id, tab2_id, 1, false);
+  UpdateNavigation(window_id, tab2_id, nav2, true);
+  service()->TabClosed(window_id, tab2_id, false);
+
+  // Forces closing the file, then reads it back.
+  helper_.SetService(NULL);
+  helper_.SetService(new SessionService(path_));
+  ScopedVector<SessionCommand> commands;
+  backend()->ReadLastSessionCommandsImpl(&(commands.get()));
+
+  ScopedVector<SessionCommand> compacted_commands;
+  for (size_t i = 0; i < commands.size(); ++i) {
+    SessionCommand* command =
+        new SessionCommand(commands[i]->id(), commands[i]->size());
+    memcpy(command->contents(), commands[i]->contents(), commands[i]->size());
+    compacted_commands.push_back(command);
+  }
+  SessionService::CompactCommands(&(compacted_commands.get()));
+  EXPECT_LT(compacted_commands.size(), commands.size());
+
+  ScopedVector<SessionWindow> windows;
+  SessionID::id_type active_window_id = 0;
+  service()->RestoreSessionFromCommands(
+      commands.get(), &(windows.get()), &active_window_id);
+  ScopedVector<SessionWindow> compacted_windows;
+  SessionID::id_type compacted_active_window_id = 0;
+  service()->RestoreSessionFromCommands(
+      compacted_commands.get(), &(compacted_windows.get()),
+      &compacted_active_window_id);
+
+  EXPECT_EQ(active_window_id, compacted_active_window_id);
+  ASSERT_EQ(1U, windows.size());
+  ASSERT_EQ(1U, compacted_windows.size());
+  EXPECT_EQ(windows[0]->selected_tab_index,
+            compacted_windows[0]->selected_tab_index);
+  ASSERT_EQ(1U, windows[0]->tabs.size());
+  ASSERT_EQ(1U, compacted_windows[0]->tabs.size());
+
+  const SessionTab* tab = windows[0]->tabs[0];
+  const SessionTab* compacted_tab = compacted_windows[0]->tabs[0];
+  EXPECT_TRUE(tab->pinned);
+  EXPECT_EQ(tab->pinned, compacted_tab->pinned);
+  helper_.AssertTabEquals(window_id, tab_id, tab->tab_visual_index,
+                          tab->current_navigation_index,
+                          tab->navigations.size(), *compacted_tab);
+  for (size_t i = 0; i < tab->navigations.size(); ++i) {
+    helper_.AssertNavigationEquals(tab->navigations[i],
+                                   compacted_tab->navigations[i]);
+  }
+}
+
 TEST_F(SessionServiceTest, TwoWindows) {
   SessionID window2_id;
   SessionID tab1_id;
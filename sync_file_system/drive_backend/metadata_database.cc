@@ -9,6 +9,7 @@
 
 #include "base/bind.h"
 #include "base/callback.h"
+#include "base/command_line.h"
 #include "base/file_util.h"
 #include "base/files/file_path.h"
 #include "base/location.h"
@@ -27,6 +28,7 @@
 #include "chrome/browser/sync_file_system/drive_backend/metadata_database.pb.h"
 #include "chrome/browser/sync_file_system/drive_backend/metadata_database_index.h"
 #include "chrome/browser/sync_file_system/drive_backend/metadata_database_index_interface.h"
+#include "chrome/browser/sync_file_system/drive_backend/metadata_database_index_on_disk.h"
 #include "chrome/browser/sync_file_system/drive_backend/metadata_db_migration_util.h"
 #include "chrome/browser/sync_file_system/logger.h"
 #include "chrome/browser/sync_file_system/syncable_file_system_util.h"
@@ -42,6 +44,35 @@ namespace drive_backend {
 
 namespace {
 
+// A command switch to keep the indexes of MetadataDatabase in its LevelDB
+// instead of on memory.
+const char kEnableSyncFSOnDiskIndex[] = "enable-syncfs-on-disk-index";
+
+bool IsOnDiskIndexEnabled() {
+  return CommandLine::ForCurrentProcess()->HasSwitch(kEnableSyncFSOnDiskIndex);
+}
+
+// Appends the operations of the batches it iterates over to |batch_|.
+class WriteBatchAppender : public leveldb::WriteBatch::Handler {
+ public:
+  explicit WriteBatchAppender(leveldb::WriteBatch* batch) : batch_(batch) {}
+  virtual ~WriteBatchAppender() {}
+
+  virtual void Put(const leveldb::Slice& key,
+                   const leveldb::Slice& value) OVERRIDE {
+    batch_->Put(key, value);
+  }
+
+  virtual void Delete(const leveldb::Slice& key) OVERRIDE {
+    batch_->Delete(key);
+  }
+
+ private:
+  leveldb::WriteBatch* batch_;
+
+  DISALLOW_COPY_AND_ASSIGN(WriteBatchAppender);
+};
+
 bool IsAppRoot(const FileTracker& tracker) {
   return tracker.tracker_kind() == TRACKER_KIND_APP_ROOT ||
       tracker.tracker_kind() == TRACKER_KIND_DISABLED_APP_ROOT;
@@ -106,17 +137,20 @@ scoped_ptr<FileTracker> CreateInitialAppRootTracker(
   return app_root_tracker.Pass();
 }
 
+// Writes |batch| to |db| and hands it back to |callback| with the result.
 void WriteOnFileTaskRunner(
     leveldb::DB* db,
     scoped_ptr<leveldb::WriteBatch> batch,
     scoped_refptr<base::SequencedTaskRunner> worker_task_runner,
-    const SyncStatusCallback& callback) {
+    const base::Callback<void(scoped_ptr<leveldb::WriteBatch>,
+                              SyncStatusCode)>& callback) {
   DCHECK(db);
   DCHECK(batch);
   leveldb::Status status = db->Write(leveldb::WriteOptions(), batch.get());
   worker_task_runner->PostTask(
       FROM_HERE,
-      base::Bind(callback, LevelDBStatusToSyncStatusCode(status)));
+      base::Bind(callback, base::Passed(&batch),
+                 LevelDBStatusToSyncStatusCode(status)));
 }
 
 std::string GetTrackerTitle(const FileTracker& tracker) {
@@ -272,6 +306,31 @@ SyncStatusCode ReadDatabaseContents(leveldb::DB* db,
   return SYNC_STATUS_OK;
 }
 
+SyncStatusCode ReadServiceMetadata(leveldb::DB* db,
+                                   DatabaseContents* contents) {
+  base::ThreadRestrictions::AssertIOAllowed();
+  DCHECK(db);
+  DCHECK(contents);
+
+  std::string value;
+  leveldb::Status status =
+      db->Get(leveldb::ReadOptions(), kServiceMetadataKey, &value);
+  if (status.IsNotFound())
+    return SYNC_STATUS_OK;
+  if (!status.ok())
+    return LevelDBStatusToSyncStatusCode(status);
+
+  scoped_ptr<ServiceMetadata> service_metadata(new ServiceMetadata);
+  if (!service_metadata->ParseFromString(value)) {
+    util::Log(logging::LOG_WARNING, FROM_HERE,
+              "Failed to parse SyncServiceMetadata");
+    return SYNC_STATUS_OK;
+  }
+
+  contents->service_metadata = service_metadata.Pass();
+  return SYNC_STATUS_OK;
+}
+
 SyncStatusCode InitializeServiceMetadata(DatabaseContents* contents,
                                          leveldb::WriteBatch* batch) {
   if (!contents->service_metadata) {
@@ -618,15 +677,18 @@ struct MetadataDatabase::CreateParam {
   scoped_refptr<base::SequencedTaskRunner> worker_task_runner;
   scoped_refptr<base::SequencedTaskRunner> file_task_runner;
   base::FilePath database_path;
+  bool enable_on_disk_index;
   leveldb::Env* env_override;
 
   CreateParam(base::SequencedTaskRunner* worker_task_runner,
               base::SequencedTaskRunner* file_task_runner,
               const base::FilePath& database_path,
+              bool enable_on_disk_index,
               leveldb::Env* env_override)
       : worker_task_runner(worker_task_runner),
         file_task_runner(file_task_runner),
         database_path(database_path),
+        enable_on_disk_index(enable_on_disk_index),
         env_override(env_override) {
   }
 };
@@ -646,6 +708,7 @@ void MetadataDatabase::Create(base::SequencedTaskRunner* worker_task_runner,
           worker_task_runner,
           file_task_runner,
           database_path,
+          IsOnDiskIndexEnabled(),
           env_override))),
       callback));
 }
@@ -653,11 +716,12 @@ void MetadataDatabase::Create(base::SequencedTaskRunner* worker_task_runner,
 // static
 SyncStatusCode MetadataDatabase::CreateForTesting(
     scoped_ptr<leveldb::DB> db,
+    bool enable_on_disk_index,
     scoped_ptr<MetadataDatabase>* metadata_database_out) {
   scoped_ptr<MetadataDatabase> metadata_database(
       new MetadataDatabase(base::MessageLoopProxy::current(),
                            base::MessageLoopProxy::current(),
-                           base::FilePath(), NULL));
+                           base::FilePath(), enable_on_disk_index, NULL));
   metadata_database->db_ = db.Pass();
   SyncStatusCode status =
       metadata_database->InitializeOnFileTaskRunner();
@@ -667,6 +731,14 @@ SyncStatusCode MetadataDatabase::CreateForTesting(
 }
 
 MetadataDatabase::~MetadataDatabase() {
+  // Queued batches must be written before |db_| is deleted.
+  if (!pending_callbacks_.empty() || failed_batch_) {
+    // |index_| goes away with this instance, so the writes in flight need not
+    // stay readable.
+    if (write_in_flight_)
+      index_->OnPendingWritesCommitted();
+    PostPendingWrites();
+  }
   file_task_runner_->DeleteSoon(FROM_HERE, db_.release());
 }
 
@@ -1529,12 +1601,16 @@ MetadataDatabase::MetadataDatabase(
     base::SequencedTaskRunner* worker_task_runner,
     base::SequencedTaskRunner* file_task_runner,
     const base::FilePath& database_path,
+    bool enable_on_disk_index,
     leveldb::Env* env_override)
     : worker_task_runner_(worker_task_runner),
       file_task_runner_(file_task_runner),
       database_path_(database_path),
       env_override_(env_override),
       largest_known_change_id_(0),
+      enable_on_disk_index_(enable_on_disk_index),
+      flush_scheduled_(false),
+      write_in_flight_(false),
       weak_ptr_factory_(this) {
   DCHECK(worker_task_runner);
   DCHECK(file_task_runner);
@@ -1548,6 +1624,7 @@ void MetadataDatabase::CreateOnFileTaskRunner(
       new MetadataDatabase(create_param->worker_task_runner.get(),
                            create_param->file_task_runner.get(),
                            create_param->database_path,
+                           create_param->enable_on_disk_index,
                            create_param->env_override));
   SyncStatusCode status =
       metadata_database->InitializeOnFileTaskRunner();
@@ -1584,8 +1661,17 @@ SyncStatusCode MetadataDatabase::InitializeOnFileTaskRunner() {
       return status;
   }
 
+  // Once the on-disk index is built, only ServiceMetadata is needed to start.
+  // Otherwise, read all records to build the indexes.
+  const bool has_on_disk_index =
+      MetadataDatabaseIndexOnDisk::HasIndexes(db_.get());
+  const bool read_all_records = !enable_on_disk_index_ || !has_on_disk_index;
+
   DatabaseContents contents;
-  status = ReadDatabaseContents(db_.get(), &contents);
+  if (read_all_records)
+    status = ReadDatabaseContents(db_.get(), &contents);
+  else
+    status = ReadServiceMetadata(db_.get(), &contents);
   if (status != SYNC_STATUS_OK)
     return status;
 
@@ -1594,9 +1680,16 @@ SyncStatusCode MetadataDatabase::InitializeOnFileTaskRunner() {
   if (status != SYNC_STATUS_OK)
     return status;
 
-  status = RemoveUnreachableItems(&contents, &batch);
-  if (status != SYNC_STATUS_OK)
-    return status;
+  if (read_all_records) {
+    status = RemoveUnreachableItems(&contents, &batch);
+    if (status != SYNC_STATUS_OK)
+      return status;
+  }
+
+  if (enable_on_disk_index_ && !has_on_disk_index)
+    MetadataDatabaseIndexOnDisk::BuildIndexes(contents, &batch);
+  else if (!enable_on_disk_index_ && has_on_disk_index)
+    MetadataDatabaseIndexOnDisk::RemoveIndexes(db_.get(), &batch);
 
   status = LevelDBStatusToSyncStatusCode(
       db_->Write(leveldb::WriteOptions(), &batch));
@@ -1612,7 +1705,10 @@ void MetadataDatabase::BuildIndexes(DatabaseContents* contents) {
 
   service_metadata_ = contents->service_metadata.Pass();
   UpdateLargestKnownChangeID(service_metadata_->largest_change_id());
-  index_.reset(new MetadataDatabaseIndex(contents));
+  if (enable_on_disk_index_)
+    index_.reset(new MetadataDatabaseIndexOnDisk(db_.get()));
+  else
+    index_.reset(new MetadataDatabaseIndex(contents));
 }
 
 void MetadataDatabase::CreateTrackerForParentAndFileID(
@@ -1875,13 +1971,90 @@ void MetadataDatabase::WriteToDatabase(scoped_ptr<leveldb::WriteBatch> batch,
     return;
   }
 
+  pending_batches_.push_back(batch.release());
+  pending_callbacks_.push_back(callback);
+  if (flush_scheduled_ || write_in_flight_)
+    return;
+
+  flush_scheduled_ = true;
+  worker_task_runner_->PostTask(
+      FROM_HERE,
+      base::Bind(&MetadataDatabase::FlushPendingWrites,
+                 weak_ptr_factory_.GetWeakPtr()));
+}
+
+void MetadataDatabase::FlushPendingWrites() {
+  DCHECK(worker_sequence_checker_.CalledOnValidSequencedThread());
+
+  flush_scheduled_ = false;
+  if (write_in_flight_ || pending_callbacks_.empty())
+    return;
+  PostPendingWrites();
+}
+
+void MetadataDatabase::PostPendingWrites() {
+  DCHECK(failed_batch_ || !pending_batches_.empty());
+
+  // A batch which failed to be written goes first, so that the newer batches
+  // override it.
+  scoped_ptr<leveldb::WriteBatch> batch(failed_batch_.Pass());
+  if (!batch && pending_batches_.size() == 1) {
+    batch.reset(pending_batches_.front());
+    pending_batches_.weak_clear();
+  } else {
+    if (!batch)
+      batch.reset(new leveldb::WriteBatch);
+    WriteBatchAppender appender(batch.get());
+    for (size_t i = 0; i < pending_batches_.size(); ++i) {
+      leveldb::Status status = pending_batches_[i]->Iterate(&appender);
+      DCHECK(status.ok());
+    }
+    pending_batches_.clear();
+  }
+  index_->AppendPendingWritesToBatch(batch.get());
+
+  std::vector<SyncStatusCallback> callbacks;
+  callbacks.swap(pending_callbacks_);
+  write_in_flight_ = true;
   file_task_runner_->PostTask(
       FROM_HERE,
       base::Bind(&WriteOnFileTaskRunner,
                  base::Unretained(db_.get()),
                  base::Passed(&batch),
                  worker_task_runner_,
-                 callback));
+                 base::Bind(&MetadataDatabase::DidFlushPendingWrites,
+                            weak_ptr_factory_.GetWeakPtr(),
+                            callbacks)));
+}
+
+// static
+void MetadataDatabase::DidFlushPendingWrites(
+    base::WeakPtr<MetadataDatabase> metadata_database,
+    const std::vector<SyncStatusCallback>& callbacks,
+    scoped_ptr<leveldb::WriteBatch> batch,
+    SyncStatusCode status) {
+  if (metadata_database) {
+    DCHECK(metadata_database->write_in_flight_);
+    if (status == SYNC_STATUS_OK) {
+      metadata_database->index_->OnPendingWritesCommitted();
+    } else {
+      // The in-memory state already has the changes, so keep the index
+      // entries readable and write the batch again with the next one.
+      util::Log(logging::LOG_WARNING, FROM_HERE,
+                "Failed to write MetadataDatabase: %s",
+                SyncStatusCodeToString(status));
+      metadata_database->index_->OnPendingWritesFailed();
+      metadata_database->failed_batch_ = batch.Pass();
+    }
+    metadata_database->write_in_flight_ = false;
+
+    // Write the batches queued during the write at once.
+    if (!metadata_database->pending_callbacks_.empty())
+      metadata_database->PostPendingWrites();
+  }
+
+  for (size_t i = 0; i < callbacks.size(); ++i)
+    callbacks[i].Run(status);
 }
 
 scoped_ptr<base::ListValue> MetadataDatabase::DumpFiles(
@@ -149,6 +149,7 @@ class MetadataDatabase {
                      const CreateCallback& callback);
   static SyncStatusCode CreateForTesting(
       scoped_ptr<leveldb::DB> db,
+      bool enable_on_disk_index,
       scoped_ptr<MetadataDatabase>* metadata_database_out);
 
   ~MetadataDatabase();
@@ -361,6 +362,7 @@ class MetadataDatabase {
   MetadataDatabase(base::SequencedTaskRunner* worker_task_runner,
                    base::SequencedTaskRunner* file_task_runner,
                    const base::FilePath& database_path,
+                   bool enable_on_disk_index,
                    leveldb::Env* env_override);
   static void CreateOnFileTaskRunner(
       scoped_ptr<CreateParam> create_param,
@@ -407,9 +409,20 @@ class MetadataDatabase {
                             UpdateOption option,
                             leveldb::WriteBatch* batch);
 
+  // Queues |batch| to be written to the database together with other batches
+  // queued before the write runs, and runs |callback| once it is written.
   void WriteToDatabase(scoped_ptr<leveldb::WriteBatch> batch,
                        const SyncStatusCallback& callback);
 
+  // Writes the queued batches and the pending index entries as one batch.
+  void FlushPendingWrites();
+  void PostPendingWrites();
+  static void DidFlushPendingWrites(
+      base::WeakPtr<MetadataDatabase> metadata_database,
+      const std::vector<SyncStatusCallback>& callbacks,
+      scoped_ptr<leveldb::WriteBatch> batch,
+      SyncStatusCode status);
+
   bool HasNewerFileMetadata(const std::string& file_id, int64 change_id);
 
   scoped_ptr<base::ListValue> DumpTrackers();
@@ -437,6 +450,17 @@ class MetadataDatabase {
   int64 largest_known_change_id_;
 
   scoped_ptr<MetadataDatabaseIndexInterface> index_;
+  bool enable_on_disk_index_;
+
+  // Batches queued by WriteToDatabase() and their callbacks.  While a write
+  // is running, new batches wait for it and are written together after it.
+  ScopedVector<leveldb::WriteBatch> pending_batches_;
+  std::vector<SyncStatusCallback> pending_callbacks_;
+  // The last written batch if the write failed.  Its callbacks got the error,
+  // and it is written again before the next queued batches.
+  scoped_ptr<leveldb::WriteBatch> failed_batch_;
+  bool flush_scheduled_;
+  bool write_in_flight_;
 
   base::WeakPtrFactory<MetadataDatabase> weak_ptr_factory_;
 
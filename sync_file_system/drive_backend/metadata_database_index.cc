@@ -250,6 +250,15 @@ std::vector<std::string> MetadataDatabaseIndex::GetAllMetadataIDs() const {
   return result;
 }
 
+void MetadataDatabaseIndex::AppendPendingWritesToBatch(
+    leveldb::WriteBatch* batch) {
+  // All indexes are on memory, so there is nothing to write.
+}
+
+void MetadataDatabaseIndex::OnPendingWritesCommitted() {}
+
+void MetadataDatabaseIndex::OnPendingWritesFailed() {}
+
 void MetadataDatabaseIndex::AddToAppIDIndex(
     const FileTracker& new_tracker) {
   if (!IsAppRoot(new_tracker))
@@ -80,6 +80,9 @@ class MetadataDatabaseIndex : public MetadataDatabaseIndexInterface {
   virtual std::vector<std::string> GetRegisteredAppIDs() const OVERRIDE;
   virtual std::vector<int64> GetAllTrackerIDs() const OVERRIDE;
   virtual std::vector<std::string> GetAllMetadataIDs() const OVERRIDE;
+  virtual void AppendPendingWritesToBatch(leveldb::WriteBatch* batch) OVERRIDE;
+  virtual void OnPendingWritesCommitted() OVERRIDE;
+  virtual void OnPendingWritesFailed() OVERRIDE;
 
  private:
   typedef base::ScopedPtrHashMap<std::string, FileMetadata> MetadataByID;
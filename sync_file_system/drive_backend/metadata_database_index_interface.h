@@ -10,6 +10,10 @@
 
 #include "base/memory/scoped_ptr.h"
 
+namespace leveldb {
+class WriteBatch;
+}
+
 namespace sync_file_system {
 namespace drive_backend {
 
@@ -100,6 +104,21 @@ class MetadataDatabaseIndexInterface {
   virtual std::vector<int64> GetAllTrackerIDs() const = 0;
   virtual std::vector<std::string> GetAllMetadataIDs() const = 0;
 
+  // Adds the index entries changed since the last call to |batch|, so that
+  // they are written together with the records they index.  The caller must
+  // call OnPendingWritesCommitted() once |batch| is written before calling
+  // this again.
+  virtual void AppendPendingWritesToBatch(leveldb::WriteBatch* batch) = 0;
+
+  // Called when the batch passed to the last AppendPendingWritesToBatch() is
+  // written to the database.
+  virtual void OnPendingWritesCommitted() = 0;
+
+  // Called instead of OnPendingWritesCommitted() if writing that batch failed.
+  // The index entries stay readable, and the next AppendPendingWritesToBatch()
+  // adds them again.
+  virtual void OnPendingWritesFailed() = 0;
+
  private:
   DISALLOW_COPY_AND_ASSIGN(MetadataDatabaseIndexInterface);
 };
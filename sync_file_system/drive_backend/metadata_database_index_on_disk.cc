@@ -0,0 +1,760 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/sync_file_system/drive_backend/metadata_database_index_on_disk.h"
+
+#include "base/logging.h"
+#include "base/stl_util.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_util.h"
+#include "chrome/browser/sync_file_system/drive_backend/drive_backend_constants.h"
+#include "chrome/browser/sync_file_system/drive_backend/metadata_database.h"
+#include "chrome/browser/sync_file_system/drive_backend/metadata_database.pb.h"
+#include "chrome/browser/sync_file_system/logger.h"
+#include "third_party/leveldatabase/src/include/leveldb/db.h"
+#include "third_party/leveldatabase/src/include/leveldb/iterator.h"
+#include "third_party/leveldatabase/src/include/leveldb/write_batch.h"
+
+// LevelDB keys of the index entries.  "\0" separates the parts of a key, and
+// the value is empty unless noted.
+//   APP_ROOT: <app_id>                          -> <tracker_id>
+//   TRACKER_FILE: <file_id>\0<tracker_id>
+//   ACTIVE_FILE: <file_id>                      -> <active tracker_id>
+//   MULTI_FILE: <file_id>
+//   TRACKER_PATH: <parent_id>\0<title>\0<tracker_id>
+//   ACTIVE_PATH: <parent_id>\0<title>           -> <active tracker_id>
+//   MULTI_PATH: <parent_id>\0<title>
+//   DIRTY: <tracker_id>
+// MULTI_FILE and MULTI_PATH mark the files and non-empty paths that have
+// multiple trackers.
+
+namespace sync_file_system {
+namespace drive_backend {
+
+namespace {
+
+const char kIndexVersionKey[] = "INDEX_VERSION";
+const char kCurrentIndexVersion[] = "1";
+
+const char kAppRootIDByAppIDKeyPrefix[] = "APP_ROOT: ";
+const char kTrackerIDByFileIDKeyPrefix[] = "TRACKER_FILE: ";
+const char kActiveTrackerIDByFileIDKeyPrefix[] = "ACTIVE_FILE: ";
+const char kMultiTrackerByFileIDKeyPrefix[] = "MULTI_FILE: ";
+const char kTrackerIDByParentAndTitleKeyPrefix[] = "TRACKER_PATH: ";
+const char kActiveTrackerIDByParentAndTitleKeyPrefix[] = "ACTIVE_PATH: ";
+const char kMultiBackingParentAndTitleKeyPrefix[] = "MULTI_PATH: ";
+const char kDirtyIDKeyPrefix[] = "DIRTY: ";
+
+const char* const kIndexKeyPrefixes[] = {
+  kAppRootIDByAppIDKeyPrefix,
+  kTrackerIDByFileIDKeyPrefix,
+  kActiveTrackerIDByFileIDKeyPrefix,
+  kMultiTrackerByFileIDKeyPrefix,
+  kTrackerIDByParentAndTitleKeyPrefix,
+  kActiveTrackerIDByParentAndTitleKeyPrefix,
+  kMultiBackingParentAndTitleKeyPrefix,
+  kDirtyIDKeyPrefix,
+};
+
+const char kKeySeparator = '\0';
+
+bool IsAppRoot(const FileTracker& tracker) {
+  return tracker.tracker_kind() == TRACKER_KIND_APP_ROOT ||
+      tracker.tracker_kind() == TRACKER_KIND_DISABLED_APP_ROOT;
+}
+
+std::string GetTrackerTitle(const FileTracker& tracker) {
+  if (tracker.has_synced_details())
+    return tracker.synced_details().title();
+  return std::string();
+}
+
+std::string GenerateFileMetadataKey(const std::string& file_id) {
+  return kFileMetadataKeyPrefix + file_id;
+}
+
+std::string GenerateFileTrackerKey(int64 tracker_id) {
+  return kFileTrackerKeyPrefix + base::Int64ToString(tracker_id);
+}
+
+std::string GenerateAppRootIDByAppIDKey(const std::string& app_id) {
+  return kAppRootIDByAppIDKeyPrefix + app_id;
+}
+
+std::string GenerateTrackerIDByFileIDKeyPrefix(const std::string& file_id) {
+  std::string key = kTrackerIDByFileIDKeyPrefix + file_id;
+  key.push_back(kKeySeparator);
+  return key;
+}
+
+std::string GenerateTrackerIDByFileIDKey(const std::string& file_id,
+                                         int64 tracker_id) {
+  return GenerateTrackerIDByFileIDKeyPrefix(file_id) +
+      base::Int64ToString(tracker_id);
+}
+
+std::string GenerateActiveTrackerIDByFileIDKey(const std::string& file_id) {
+  return kActiveTrackerIDByFileIDKeyPrefix + file_id;
+}
+
+std::string GenerateMultiTrackerKey(const std::string& file_id) {
+  return kMultiTrackerByFileIDKeyPrefix + file_id;
+}
+
+std::string GenerateParentAndTitle(int64 parent_id, const std::string& title) {
+  std::string parent_and_title = base::Int64ToString(parent_id);
+  parent_and_title.push_back(kKeySeparator);
+  return parent_and_title + title;
+}
+
+std::string GenerateTrackerIDsByParentIDKeyPrefix(int64 parent_id) {
+  std::string key =
+      kTrackerIDByParentAndTitleKeyPrefix + base::Int64ToString(parent_id);
+  key.push_back(kKeySeparator);
+  return key;
+}
+
+std::string GenerateTrackerIDByParentAndTitleKeyPrefix(
+    int64 parent_id,
+    const std::string& title) {
+  std::string key = kTrackerIDByParentAndTitleKeyPrefix +
+      GenerateParentAndTitle(parent_id, title);
+  key.push_back(kKeySeparator);
+  return key;
+}
+
+std::string GenerateTrackerIDByParentAndTitleKey(int64 parent_id,
+                                                 const std::string& title,
+                                                 int64 tracker_id) {
+  return GenerateTrackerIDByParentAndTitleKeyPrefix(parent_id, title) +
+      base::Int64ToString(tracker_id);
+}
+
+std::string GenerateActiveTrackerIDByParentAndTitleKey(
+    int64 parent_id,
+    const std::string& title) {
+  return kActiveTrackerIDByParentAndTitleKeyPrefix +
+      GenerateParentAndTitle(parent_id, title);
+}
+
+std::string GenerateMultiBackingParentAndTitleKey(int64 parent_id,
+                                                  const std::string& title) {
+  return kMultiBackingParentAndTitleKeyPrefix +
+      GenerateParentAndTitle(parent_id, title);
+}
+
+std::string GenerateDirtyIDKey(int64 tracker_id) {
+  return kDirtyIDKeyPrefix + base::Int64ToString(tracker_id);
+}
+
+bool IsRecordKey(const std::string& key) {
+  return StartsWithASCII(key, kFileMetadataKeyPrefix, true) ||
+      StartsWithASCII(key, kFileTrackerKeyPrefix, true);
+}
+
+// Returns the index entries that refer to |tracker|.
+void GetIndexEntries(const FileTracker& tracker,
+                     std::map<std::string, std::string>* entries) {
+  const int64 tracker_id = tracker.tracker_id();
+  const std::string tracker_id_string = base::Int64ToString(tracker_id);
+  const std::string& file_id = tracker.file_id();
+  const int64 parent_id = tracker.parent_tracker_id();
+  const std::string title = GetTrackerTitle(tracker);
+
+  if (IsAppRoot(tracker)) {
+    DCHECK(tracker.active());
+    (*entries)[GenerateAppRootIDByAppIDKey(tracker.app_id())] =
+        tracker_id_string;
+  }
+
+  (*entries)[GenerateTrackerIDByFileIDKey(file_id, tracker_id)] =
+      std::string();
+  (*entries)[GenerateTrackerIDByParentAndTitleKey(
+      parent_id, title, tracker_id)] = std::string();
+  if (tracker.active()) {
+    (*entries)[GenerateActiveTrackerIDByFileIDKey(file_id)] =
+        tracker_id_string;
+    (*entries)[GenerateActiveTrackerIDByParentAndTitleKey(parent_id, title)] =
+        tracker_id_string;
+  }
+
+  if (tracker.dirty())
+    (*entries)[GenerateDirtyIDKey(tracker_id)] = std::string();
+}
+
+// Reads the keys that start with |prefix| from |db| into |suffixes|, with
+// |prefix| removed.
+void ReadKeySuffixes(leveldb::DB* db,
+                     const std::string& prefix,
+                     std::set<std::string>* suffixes) {
+  scoped_ptr<leveldb::Iterator> itr(db->NewIterator(leveldb::ReadOptions()));
+  for (itr->Seek(prefix); itr->Valid(); itr->Next()) {
+    leveldb::Slice key = itr->key();
+    if (!key.starts_with(prefix))
+      break;
+    key.remove_prefix(prefix.size());
+    suffixes->insert(key.ToString());
+  }
+}
+
+}  // namespace
+
+MetadataDatabaseIndexOnDisk::WriteOverlay::WriteOverlay() {}
+MetadataDatabaseIndexOnDisk::WriteOverlay::~WriteOverlay() {}
+
+void MetadataDatabaseIndexOnDisk::WriteOverlay::Put(const std::string& key,
+                                                    const std::string& value) {
+  puts[key] = value;
+  deletes.erase(key);
+}
+
+void MetadataDatabaseIndexOnDisk::WriteOverlay::Delete(
+    const std::string& key) {
+  puts.erase(key);
+  deletes.insert(key);
+}
+
+void MetadataDatabaseIndexOnDisk::WriteOverlay::Clear() {
+  puts.clear();
+  deletes.clear();
+}
+
+MetadataDatabaseIndexOnDisk::MetadataDatabaseIndexOnDisk(leveldb::DB* db)
+    : db_(db) {
+  DCHECK(db_);
+  DCHECK(HasIndexes(db_));
+
+  std::set<std::string> dirty_ids;
+  ReadKeySuffixes(db_, kDirtyIDKeyPrefix, &dirty_ids);
+  for (std::set<std::string>::const_iterator itr = dirty_ids.begin();
+       itr != dirty_ids.end(); ++itr) {
+    int64 tracker_id = kInvalidTrackerID;
+    if (!base::StringToInt64(*itr, &tracker_id)) {
+      util::Log(logging::LOG_WARNING, FROM_HERE,
+                "Failed to parse a dirty TrackerID");
+      continue;
+    }
+    dirty_trackers_.insert(tracker_id);
+  }
+}
+
+MetadataDatabaseIndexOnDisk::~MetadataDatabaseIndexOnDisk() {}
+
+// static
+bool MetadataDatabaseIndexOnDisk::HasIndexes(leveldb::DB* db) {
+  std::string value;
+  leveldb::Status status =
+      db->Get(leveldb::ReadOptions(), kIndexVersionKey, &value);
+  return status.ok() && value == kCurrentIndexVersion;
+}
+
+// static
+void MetadataDatabaseIndexOnDisk::BuildIndexes(
+    const DatabaseContents& contents,
+    leveldb::WriteBatch* batch) {
+  std::map<std::string, size_t> tracker_count_by_file_id;
+  std::map<ParentIDAndTitle, size_t> tracker_count_by_path;
+
+  for (size_t i = 0; i < contents.file_trackers.size(); ++i) {
+    const FileTracker& tracker = *contents.file_trackers[i];
+    IndexEntries entries;
+    GetIndexEntries(tracker, &entries);
+    for (IndexEntries::const_iterator itr = entries.begin();
+         itr != entries.end(); ++itr)
+      batch->Put(itr->first, itr->second);
+
+    ++tracker_count_by_file_id[tracker.file_id()];
+    ++tracker_count_by_path[ParentIDAndTitle(tracker.parent_tracker_id(),
+                                             GetTrackerTitle(tracker))];
+  }
+
+  for (std::map<std::string, size_t>::const_iterator itr =
+           tracker_count_by_file_id.begin();
+       itr != tracker_count_by_file_id.end(); ++itr) {
+    if (itr->second > 1)
+      batch->Put(GenerateMultiTrackerKey(itr->first), std::string());
+  }
+
+  for (std::map<ParentIDAndTitle, size_t>::const_iterator itr =
+           tracker_count_by_path.begin();
+       itr != tracker_count_by_path.end(); ++itr) {
+    if (itr->second > 1 && !itr->first.title.empty()) {
+      batch->Put(GenerateMultiBackingParentAndTitleKey(itr->first.parent_id,
+                                                       itr->first.title),
+                 std::string());
+    }
+  }
+
+  batch->Put(kIndexVersionKey, kCurrentIndexVersion);
+}
+
+// static
+void MetadataDatabaseIndexOnDisk::RemoveIndexes(leveldb::DB* db,
+                                                leveldb::WriteBatch* batch) {
+  for (size_t i = 0; i < arraysize(kIndexKeyPrefixes); ++i) {
+    std::set<std::string> suffixes;
+    ReadKeySuffixes(db, kIndexKeyPrefixes[i], &suffixes);
+    for (std::set<std::string>::const_iterator itr = suffixes.begin();
+         itr != suffixes.end(); ++itr)
+      batch->Delete(kIndexKeyPrefixes[i] + *itr);
+  }
+  batch->Delete(kIndexVersionKey);
+}
+
+const FileMetadata* MetadataDatabaseIndexOnDisk::GetFileMetadata(
+    const std::string& file_id) const {
+  FileMetadata* metadata = metadata_cache_.get(file_id);
+  if (metadata)
+    return metadata;
+
+  std::string value;
+  if (!Get(GenerateFileMetadataKey(file_id), &value))
+    return NULL;
+
+  scoped_ptr<FileMetadata> parsed(new FileMetadata);
+  if (!parsed->ParseFromString(value)) {
+    util::Log(logging::LOG_WARNING, FROM_HERE,
+              "Failed to parse a FileMetadata");
+    return NULL;
+  }
+
+  metadata = parsed.get();
+  metadata_cache_.set(file_id, parsed.Pass());
+  return metadata;
+}
+
+const FileTracker* MetadataDatabaseIndexOnDisk::GetFileTracker(
+    int64 tracker_id) const {
+  FileTracker* tracker = tracker_cache_.get(tracker_id);
+  if (tracker)
+    return tracker;
+
+  std::string value;
+  if (!Get(GenerateFileTrackerKey(tracker_id), &value))
+    return NULL;
+
+  scoped_ptr<FileTracker> parsed(new FileTracker);
+  if (!parsed->ParseFromString(value)) {
+    util::Log(logging::LOG_WARNING, FROM_HERE,
+              "Failed to parse a Tracker");
+    return NULL;
+  }
+
+  tracker = parsed.get();
+  tracker_cache_.set(tracker_id, parsed.Pass());
+  return tracker;
+}
+
+void MetadataDatabaseIndexOnDisk::StoreFileMetadata(
+    scoped_ptr<FileMetadata> metadata) {
+  DCHECK(metadata);
+  const std::string file_id = metadata->file_id();
+
+  std::string value;
+  bool success = metadata->SerializeToString(&value);
+  DCHECK(success);
+  pending_writes_.Put(GenerateFileMetadataKey(file_id), value);
+  metadata_cache_.set(file_id, metadata.Pass());
+}
+
+void MetadataDatabaseIndexOnDisk::StoreFileTracker(
+    scoped_ptr<FileTracker> tracker) {
+  DCHECK(tracker);
+  const int64 tracker_id = tracker->tracker_id();
+  const std::string& file_id = tracker->file_id();
+  const int64 parent_id = tracker->parent_tracker_id();
+  const std::string title = GetTrackerTitle(*tracker);
+
+  const FileTracker* old_tracker = GetFileTracker(tracker_id);
+  IndexEntries old_entries;
+  IndexEntries new_entries;
+  GetIndexEntries(*tracker, &new_entries);
+  if (!old_tracker) {
+    DVLOG(3) << "Adding new tracker: " << tracker_id << " " << title;
+
+    UpdateIndexEntries(old_entries, new_entries);
+    UpdateMultiTrackerEntry(file_id);
+    UpdateMultiBackingEntry(parent_id, title);
+    if (tracker->dirty())
+      dirty_trackers_.insert(tracker_id);
+  } else {
+    DVLOG(3) << "Updating tracker: " << tracker_id << " " << title;
+
+    DCHECK_EQ(old_tracker->file_id(), file_id);
+    DCHECK_EQ(old_tracker->parent_tracker_id(), parent_id);
+    const std::string old_title = GetTrackerTitle(*old_tracker);
+    const bool was_dirty = old_tracker->dirty();
+
+    GetIndexEntries(*old_tracker, &old_entries);
+    UpdateIndexEntries(old_entries, new_entries);
+    if (old_title != title) {
+      UpdateMultiBackingEntry(parent_id, old_title);
+      UpdateMultiBackingEntry(parent_id, title);
+    }
+
+    if (!was_dirty && tracker->dirty()) {
+      dirty_trackers_.insert(tracker_id);
+    } else if (was_dirty && !tracker->dirty()) {
+      dirty_trackers_.erase(tracker_id);
+      demoted_dirty_trackers_.erase(tracker_id);
+    }
+  }
+
+  std::string value;
+  bool success = tracker->SerializeToString(&value);
+  DCHECK(success);
+  pending_writes_.Put(GenerateFileTrackerKey(tracker_id), value);
+  tracker_cache_.set(tracker_id, tracker.Pass());
+}
+
+void MetadataDatabaseIndexOnDisk::RemoveFileMetadata(
+    const std::string& file_id) {
+  pending_writes_.Delete(GenerateFileMetadataKey(file_id));
+  metadata_cache_.erase(file_id);
+}
+
+void MetadataDatabaseIndexOnDisk::RemoveFileTracker(int64 tracker_id) {
+  const FileTracker* tracker = GetFileTracker(tracker_id);
+  if (!tracker) {
+    NOTREACHED();
+    return;
+  }
+
+  const std::string file_id = tracker->file_id();
+  const int64 parent_id = tracker->parent_tracker_id();
+  const std::string title = GetTrackerTitle(*tracker);
+  DVLOG(3) << "Removing tracker: " << tracker_id << " " << title;
+
+  IndexEntries old_entries;
+  GetIndexEntries(*tracker, &old_entries);
+  UpdateIndexEntries(old_entries, IndexEntries());
+  UpdateMultiTrackerEntry(file_id);
+  UpdateMultiBackingEntry(parent_id, title);
+  dirty_trackers_.erase(tracker_id);
+  demoted_dirty_trackers_.erase(tracker_id);
+
+  pending_writes_.Delete(GenerateFileTrackerKey(tracker_id));
+  tracker_cache_.erase(tracker_id);
+}
+
+TrackerIDSet MetadataDatabaseIndexOnDisk::GetFileTrackerIDsByFileID(
+    const std::string& file_id) const {
+  return GetTrackerIDSet(GenerateTrackerIDByFileIDKeyPrefix(file_id),
+                         GenerateActiveTrackerIDByFileIDKey(file_id));
+}
+
+int64 MetadataDatabaseIndexOnDisk::GetAppRootTracker(
+    const std::string& app_id) const {
+  std::string value;
+  int64 tracker_id = kInvalidTrackerID;
+  if (!Get(GenerateAppRootIDByAppIDKey(app_id), &value) ||
+      !base::StringToInt64(value, &tracker_id))
+    return kInvalidTrackerID;
+  return tracker_id;
+}
+
+TrackerIDSet MetadataDatabaseIndexOnDisk::GetFileTrackerIDsByParentAndTitle(
+    int64 parent_tracker_id,
+    const std::string& title) const {
+  return GetTrackerIDSet(
+      GenerateTrackerIDByParentAndTitleKeyPrefix(parent_tracker_id, title),
+      GenerateActiveTrackerIDByParentAndTitleKey(parent_tracker_id, title));
+}
+
+std::vector<int64> MetadataDatabaseIndexOnDisk::GetFileTrackerIDsByParent(
+    int64 parent_tracker_id) const {
+  std::vector<int64> result;
+  const std::set<std::string> titles_and_ids = GetKeySuffixes(
+      GenerateTrackerIDsByParentIDKeyPrefix(parent_tracker_id));
+  for (std::set<std::string>::const_iterator itr = titles_and_ids.begin();
+       itr != titles_and_ids.end(); ++itr) {
+    const size_t separator = itr->rfind(kKeySeparator);
+    int64 tracker_id = kInvalidTrackerID;
+    if (separator == std::string::npos ||
+        !base::StringToInt64(itr->substr(separator + 1), &tracker_id)) {
+      NOTREACHED();
+      continue;
+    }
+    result.push_back(tracker_id);
+  }
+  return result;
+}
+
+std::string MetadataDatabaseIndexOnDisk::PickMultiTrackerFileID() const {
+  const std::set<std::string> file_ids =
+      GetKeySuffixes(kMultiTrackerByFileIDKeyPrefix);
+  if (file_ids.empty())
+    return std::string();
+  return *file_ids.begin();
+}
+
+ParentIDAndTitle MetadataDatabaseIndexOnDisk::PickMultiBackingFilePath() const {
+  const std::set<std::string> paths =
+      GetKeySuffixes(kMultiBackingParentAndTitleKeyPrefix);
+  for (std::set<std::string>::const_iterator itr = paths.begin();
+       itr != paths.end(); ++itr) {
+    const size_t separator = itr->find(kKeySeparator);
+    int64 parent_id = kInvalidTrackerID;
+    if (separator == std::string::npos ||
+        !base::StringToInt64(itr->substr(0, separator), &parent_id)) {
+      NOTREACHED();
+      continue;
+    }
+    return ParentIDAndTitle(parent_id, itr->substr(separator + 1));
+  }
+  return ParentIDAndTitle(kInvalidTrackerID, std::string());
+}
+
+int64 MetadataDatabaseIndexOnDisk::PickDirtyTracker() const {
+  if (dirty_trackers_.empty())
+    return kInvalidTrackerID;
+  return *dirty_trackers_.begin();
+}
+
+void MetadataDatabaseIndexOnDisk::DemoteDirtyTracker(int64 tracker_id) {
+  if (dirty_trackers_.erase(tracker_id))
+    demoted_dirty_trackers_.insert(tracker_id);
+}
+
+bool MetadataDatabaseIndexOnDisk::HasDemotedDirtyTracker() const {
+  return !demoted_dirty_trackers_.empty();
+}
+
+void MetadataDatabaseIndexOnDisk::PromoteDemotedDirtyTrackers() {
+  dirty_trackers_.insert(demoted_dirty_trackers_.begin(),
+                         demoted_dirty_trackers_.end());
+  demoted_dirty_trackers_.clear();
+}
+
+size_t MetadataDatabaseIndexOnDisk::CountDirtyTracker() const {
+  return dirty_trackers_.size() + demoted_dirty_trackers_.size();
+}
+
+size_t MetadataDatabaseIndexOnDisk::CountFileMetadata() const {
+  return GetKeySuffixes(kFileMetadataKeyPrefix).size();
+}
+
+size_t MetadataDatabaseIndexOnDisk::CountFileTracker() const {
+  return GetKeySuffixes(kFileTrackerKeyPrefix).size();
+}
+
+std::vector<std::string>
+MetadataDatabaseIndexOnDisk::GetRegisteredAppIDs() const {
+  const std::set<std::string> app_ids =
+      GetKeySuffixes(kAppRootIDByAppIDKeyPrefix);
+  return std::vector<std::string>(app_ids.begin(), app_ids.end());
+}
+
+std::vector<int64> MetadataDatabaseIndexOnDisk::GetAllTrackerIDs() const {
+  std::vector<int64> result;
+  const std::set<std::string> tracker_ids =
+      GetKeySuffixes(kFileTrackerKeyPrefix);
+  for (std::set<std::string>::const_iterator itr = tracker_ids.begin();
+       itr != tracker_ids.end(); ++itr) {
+    int64 tracker_id = kInvalidTrackerID;
+    if (!base::StringToInt64(*itr, &tracker_id)) {
+      util::Log(logging::LOG_WARNING, FROM_HERE,
+                "Failed to parse TrackerID");
+      continue;
+    }
+    result.push_back(tracker_id);
+  }
+  return result;
+}
+
+std::vector<std::string>
+MetadataDatabaseIndexOnDisk::GetAllMetadataIDs() const {
+  const std::set<std::string> file_ids =
+      GetKeySuffixes(kFileMetadataKeyPrefix);
+  return std::vector<std::string>(file_ids.begin(), file_ids.end());
+}
+
+void MetadataDatabaseIndexOnDisk::AppendPendingWritesToBatch(
+    leveldb::WriteBatch* batch) {
+  DCHECK(in_flight_writes_.puts.empty());
+  DCHECK(in_flight_writes_.deletes.empty());
+
+  // The records are in the batches of MetadataDatabase already.
+  for (std::map<std::string, std::string>::const_iterator itr =
+           pending_writes_.puts.begin();
+       itr != pending_writes_.puts.end(); ++itr) {
+    if (!IsRecordKey(itr->first))
+      batch->Put(itr->first, itr->second);
+  }
+  for (std::set<std::string>::const_iterator itr =
+           pending_writes_.deletes.begin();
+       itr != pending_writes_.deletes.end(); ++itr) {
+    if (!IsRecordKey(*itr))
+      batch->Delete(*itr);
+  }
+
+  // Keep the writes readable until they reach the database.
+  std::swap(pending_writes_.puts, in_flight_writes_.puts);
+  std::swap(pending_writes_.deletes, in_flight_writes_.deletes);
+
+  metadata_cache_.clear();
+  tracker_cache_.clear();
+}
+
+void MetadataDatabaseIndexOnDisk::OnPendingWritesCommitted() {
+  in_flight_writes_.Clear();
+}
+
+void MetadataDatabaseIndexOnDisk::OnPendingWritesFailed() {
+  // Move the failed writes back under the pending ones, which are newer.
+  for (std::map<std::string, std::string>::const_iterator itr =
+           in_flight_writes_.puts.begin();
+       itr != in_flight_writes_.puts.end(); ++itr) {
+    if (!ContainsKey(pending_writes_.puts, itr->first) &&
+        !ContainsKey(pending_writes_.deletes, itr->first))
+      pending_writes_.puts[itr->first] = itr->second;
+  }
+  for (std::set<std::string>::const_iterator itr =
+           in_flight_writes_.deletes.begin();
+       itr != in_flight_writes_.deletes.end(); ++itr) {
+    if (!ContainsKey(pending_writes_.puts, *itr))
+      pending_writes_.deletes.insert(*itr);
+  }
+  in_flight_writes_.Clear();
+}
+
+bool MetadataDatabaseIndexOnDisk::Get(const std::string& key,
+                                      std::string* value) const {
+  const WriteOverlay* overlays[] = { &pending_writes_, &in_flight_writes_ };
+  for (size_t i = 0; i < arraysize(overlays); ++i) {
+    std::map<std::string, std::string>::const_iterator found =
+        overlays[i]->puts.find(key);
+    if (found != overlays[i]->puts.end()) {
+      *value = found->second;
+      return true;
+    }
+    if (ContainsKey(overlays[i]->deletes, key))
+      return false;
+  }
+
+  leveldb::Status status = db_->Get(leveldb::ReadOptions(), key, value);
+  if (!status.ok() && !status.IsNotFound()) {
+    util::Log(logging::LOG_WARNING, FROM_HERE,
+              "Failed to read %s", key.c_str());
+  }
+  return status.ok();
+}
+
+std::set<std::string> MetadataDatabaseIndexOnDisk::GetKeySuffixes(
+    const std::string& prefix) const {
+  std::set<std::string> suffixes;
+  ReadKeySuffixes(db_, prefix, &suffixes);
+
+  // Apply the older writes first.
+  const WriteOverlay* overlays[] = { &in_flight_writes_, &pending_writes_ };
+  for (size_t i = 0; i < arraysize(overlays); ++i) {
+    for (std::map<std::string, std::string>::const_iterator itr =
+             overlays[i]->puts.lower_bound(prefix);
+         itr != overlays[i]->puts.end() &&
+             StartsWithASCII(itr->first, prefix, true);
+         ++itr)
+      suffixes.insert(itr->first.substr(prefix.size()));
+    for (std::set<std::string>::const_iterator itr =
+             overlays[i]->deletes.lower_bound(prefix);
+         itr != overlays[i]->deletes.end() &&
+             StartsWithASCII(*itr, prefix, true);
+         ++itr)
+      suffixes.erase(itr->substr(prefix.size()));
+  }
+  return suffixes;
+}
+
+void MetadataDatabaseIndexOnDisk::PutIndexEntry(const std::string& key,
+                                                const std::string& value) {
+  std::string old_value;
+  if (Get(key, &old_value) && old_value == value)
+    return;
+  DVLOG(3) << "  Put index entry: " << key;
+  pending_writes_.Put(key, value);
+}
+
+void MetadataDatabaseIndexOnDisk::DeleteIndexEntry(const std::string& key) {
+  std::string old_value;
+  if (!Get(key, &old_value))
+    return;
+  DVLOG(3) << "  Delete index entry: " << key;
+  pending_writes_.Delete(key);
+}
+
+void MetadataDatabaseIndexOnDisk::UpdateIndexEntries(
+    const IndexEntries& old_entries,
+    const IndexEntries& new_entries) {
+  for (IndexEntries::const_iterator itr = old_entries.begin();
+       itr != old_entries.end(); ++itr) {
+    if (ContainsKey(new_entries, itr->first))
+      continue;
+
+    // Active tracker entries may have been taken over by another tracker.
+    std::string value;
+    if (Get(itr->first, &value) && value == itr->second)
+      DeleteIndexEntry(itr->first);
+  }
+
+  for (IndexEntries::const_iterator itr = new_entries.begin();
+       itr != new_entries.end(); ++itr) {
+    IndexEntries::const_iterator found = old_entries.find(itr->first);
+    if (found == old_entries.end() || found->second != itr->second)
+      PutIndexEntry(itr->first, itr->second);
+  }
+}
+
+void MetadataDatabaseIndexOnDisk::UpdateMultiTrackerEntry(
+    const std::string& file_id) {
+  const std::string key = GenerateMultiTrackerKey(file_id);
+  if (GetKeySuffixes(GenerateTrackerIDByFileIDKeyPrefix(file_id)).size() > 1)
+    PutIndexEntry(key, std::string());
+  else
+    DeleteIndexEntry(key);
+}
+
+void MetadataDatabaseIndexOnDisk::UpdateMultiBackingEntry(
+    int64 parent_id,
+    const std::string& title) {
+  if (title.empty())
+    return;
+
+  const std::string key =
+      GenerateMultiBackingParentAndTitleKey(parent_id, title);
+  if (GetKeySuffixes(GenerateTrackerIDByParentAndTitleKeyPrefix(
+          parent_id, title)).size() > 1)
+    PutIndexEntry(key, std::string());
+  else
+    DeleteIndexEntry(key);
+}
+
+TrackerIDSet MetadataDatabaseIndexOnDisk::GetTrackerIDSet(
+    const std::string& ids_prefix,
+    const std::string& active_tracker_key) const {
+  std::string value;
+  int64 active_tracker_id = kInvalidTrackerID;
+  if (Get(active_tracker_key, &value) &&
+      !base::StringToInt64(value, &active_tracker_id)) {
+    NOTREACHED();
+    active_tracker_id = kInvalidTrackerID;
+  }
+
+  TrackerIDSet trackers;
+  const std::set<std::string> tracker_ids = GetKeySuffixes(ids_prefix);
+  for (std::set<std::string>::const_iterator itr = tracker_ids.begin();
+       itr != tracker_ids.end(); ++itr) {
+    int64 tracker_id = kInvalidTrackerID;
+    if (!base::StringToInt64(*itr, &tracker_id)) {
+      NOTREACHED();
+      continue;
+    }
+    if (tracker_id == active_tracker_id)
+      trackers.InsertActiveTracker(tracker_id);
+    else
+      trackers.InsertInactiveTracker(tracker_id);
+  }
+  return trackers;
+}
+
+}  // namespace drive_backend
+}  // namespace sync_file_system
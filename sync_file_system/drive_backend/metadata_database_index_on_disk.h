@@ -0,0 +1,151 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_SYNC_FILE_SYSTEM_DRIVE_BACKEND_METADATA_DATABASE_INDEX_ON_DISK_H_
+#define CHROME_BROWSER_SYNC_FILE_SYSTEM_DRIVE_BACKEND_METADATA_DATABASE_INDEX_ON_DISK_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "base/containers/scoped_ptr_hash_map.h"
+#include "chrome/browser/sync_file_system/drive_backend/metadata_database_index_interface.h"
+#include "chrome/browser/sync_file_system/drive_backend/tracker_id_set.h"
+
+namespace leveldb {
+class DB;
+class WriteBatch;
+}
+
+namespace sync_file_system {
+namespace drive_backend {
+
+class FileMetadata;
+class FileTracker;
+struct DatabaseContents;
+
+// Maintains indexes of MetadataDatabase in its LevelDB, next to the
+// FileMetadata and FileTracker records, and reads both lazily.  Only dirty
+// trackers and the records touched since the last write are kept on memory.
+//
+// Changes are visible to the getters right away, but reach the database only
+// through AppendPendingWritesToBatch().  MetadataDatabase puts the records
+// themselves into its own batches, so only index entries are added there.
+//
+// Pointers returned by GetFileMetadata() and GetFileTracker() are valid until
+// the same item is stored or removed, or AppendPendingWritesToBatch() is
+// called.
+class MetadataDatabaseIndexOnDisk : public MetadataDatabaseIndexInterface {
+ public:
+  explicit MetadataDatabaseIndexOnDisk(leveldb::DB* db);
+  virtual ~MetadataDatabaseIndexOnDisk();
+
+  // Returns true if |db| has the index entries written by BuildIndexes().
+  static bool HasIndexes(leveldb::DB* db);
+
+  // Adds the index entries for |contents|, which must be the whole contents
+  // of the database, to |batch|.
+  static void BuildIndexes(const DatabaseContents& contents,
+                           leveldb::WriteBatch* batch);
+
+  // Adds deletions of all index entries in |db| to |batch|, so that stale
+  // indexes are not used if the on-disk index is enabled again later.
+  static void RemoveIndexes(leveldb::DB* db, leveldb::WriteBatch* batch);
+
+  // MetadataDatabaseIndexInterface overrides.
+  virtual const FileMetadata* GetFileMetadata(
+      const std::string& file_id) const OVERRIDE;
+  virtual const FileTracker* GetFileTracker(int64 tracker_id) const OVERRIDE;
+  virtual void StoreFileMetadata(scoped_ptr<FileMetadata> metadata) OVERRIDE;
+  virtual void StoreFileTracker(scoped_ptr<FileTracker> tracker) OVERRIDE;
+  virtual void RemoveFileMetadata(const std::string& file_id) OVERRIDE;
+  virtual void RemoveFileTracker(int64 tracker_id) OVERRIDE;
+  virtual TrackerIDSet GetFileTrackerIDsByFileID(
+      const std::string& file_id) const OVERRIDE;
+  virtual int64 GetAppRootTracker(const std::string& app_id) const OVERRIDE;
+  virtual TrackerIDSet GetFileTrackerIDsByParentAndTitle(
+      int64 parent_tracker_id,
+      const std::string& title) const OVERRIDE;
+  virtual std::vector<int64> GetFileTrackerIDsByParent(
+      int64 parent_tracker_id) const OVERRIDE;
+  virtual std::string PickMultiTrackerFileID() const OVERRIDE;
+  virtual ParentIDAndTitle PickMultiBackingFilePath() const OVERRIDE;
+  virtual int64 PickDirtyTracker() const OVERRIDE;
+  virtual void DemoteDirtyTracker(int64 tracker_id) OVERRIDE;
+  virtual bool HasDemotedDirtyTracker() const OVERRIDE;
+  virtual void PromoteDemotedDirtyTrackers() OVERRIDE;
+  virtual size_t CountDirtyTracker() const OVERRIDE;
+  virtual size_t CountFileMetadata() const OVERRIDE;
+  virtual size_t CountFileTracker() const OVERRIDE;
+  virtual std::vector<std::string> GetRegisteredAppIDs() const OVERRIDE;
+  virtual std::vector<int64> GetAllTrackerIDs() const OVERRIDE;
+  virtual std::vector<std::string> GetAllMetadataIDs() const OVERRIDE;
+  virtual void AppendPendingWritesToBatch(leveldb::WriteBatch* batch) OVERRIDE;
+  virtual void OnPendingWritesCommitted() OVERRIDE;
+  virtual void OnPendingWritesFailed() OVERRIDE;
+
+ private:
+  typedef base::ScopedPtrHashMap<std::string, FileMetadata> MetadataByID;
+  typedef base::ScopedPtrHashMap<int64, FileTracker> TrackerByID;
+  typedef std::map<std::string, std::string> IndexEntries;
+  typedef std::set<int64> DirtyTrackers;
+
+  // Writes that are not committed to the database yet.  |puts| and |deletes|
+  // never share a key.
+  struct WriteOverlay {
+    std::map<std::string, std::string> puts;
+    std::set<std::string> deletes;
+
+    WriteOverlay();
+    ~WriteOverlay();
+
+    void Put(const std::string& key, const std::string& value);
+    void Delete(const std::string& key);
+    void Clear();
+  };
+
+  // Reads |key| from the overlays or the database.  Returns false if |key|
+  // does not exist.
+  bool Get(const std::string& key, std::string* value) const;
+
+  // Returns the keys that start with |prefix|, with |prefix| removed.
+  std::set<std::string> GetKeySuffixes(const std::string& prefix) const;
+
+  // Puts or deletes an index entry, unless the entry is already so.
+  void PutIndexEntry(const std::string& key, const std::string& value);
+  void DeleteIndexEntry(const std::string& key);
+
+  // Replaces the index entries of a tracker, |old_entries|, by |new_entries|.
+  void UpdateIndexEntries(const IndexEntries& old_entries,
+                          const IndexEntries& new_entries);
+
+  // Adds or removes the markers of files with multiple trackers and of paths
+  // with multiple trackers, as the trackers of |file_id| or of |parent_id|
+  // and |title| changed.
+  void UpdateMultiTrackerEntry(const std::string& file_id);
+  void UpdateMultiBackingEntry(int64 parent_id, const std::string& title);
+
+  TrackerIDSet GetTrackerIDSet(const std::string& ids_prefix,
+                               const std::string& active_tracker_key) const;
+
+  leveldb::DB* db_;  // Not owned.
+
+  WriteOverlay pending_writes_;
+  WriteOverlay in_flight_writes_;
+
+  // Parsed records, so that returned pointers stay valid.
+  mutable MetadataByID metadata_cache_;
+  mutable TrackerByID tracker_cache_;
+
+  DirtyTrackers dirty_trackers_;
+  DirtyTrackers demoted_dirty_trackers_;
+
+  DISALLOW_COPY_AND_ASSIGN(MetadataDatabaseIndexOnDisk);
+};
+
+}  // namespace drive_backend
+}  // namespace sync_file_system
+
+#endif  // CHROME_BROWSER_SYNC_FILE_SYSTEM_DRIVE_BACKEND_METADATA_DATABASE_INDEX_ON_DISK_H_
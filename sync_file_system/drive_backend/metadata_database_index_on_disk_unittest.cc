@@ -0,0 +1,384 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/sync_file_system/drive_backend/metadata_database_index_on_disk.h"
+
+#include <algorithm>
+
+#include "base/files/scoped_temp_dir.h"
+#include "base/strings/string_number_conversions.h"
+#include "chrome/browser/sync_file_system/drive_backend/drive_backend_constants.h"
+#include "chrome/browser/sync_file_system/drive_backend/drive_backend_util.h"
+#include "chrome/browser/sync_file_system/drive_backend/metadata_database.h"
+#include "chrome/browser/sync_file_system/drive_backend/metadata_database.pb.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "third_party/leveldatabase/src/helpers/memenv/memenv.h"
+#include "third_party/leveldatabase/src/include/leveldb/db.h"
+#include "third_party/leveldatabase/src/include/leveldb/env.h"
+#include "third_party/leveldatabase/src/include/leveldb/write_batch.h"
+
+namespace sync_file_system {
+namespace drive_backend {
+
+namespace {
+
+const int64 kSyncRootTrackerID = 1;
+const int64 kAppRootTrackerID = 2;
+const int64 kFileTrackerID = 3;
+const int64 kPlaceholderTrackerID = 4;
+
+scoped_ptr<FileMetadata> CreateFolderMetadata(const std::string& file_id,
+                                              const std::string& title) {
+  FileDetails details;
+  details.set_title(title);
+  details.set_file_kind(FILE_KIND_FOLDER);
+  details.set_missing(false);
+
+  scoped_ptr<FileMetadata> metadata(new FileMetadata);
+  metadata->set_file_id(file_id);
+  *metadata->mutable_details() = details;
+
+  return metadata.Pass();
+}
+
+scoped_ptr<FileMetadata> CreateFileMetadata(const std::string& file_id,
+                                            const std::string& title,
+                                            const std::string& md5) {
+  FileDetails details;
+  details.set_title(title);
+  details.set_file_kind(FILE_KIND_FILE);
+  details.set_missing(false);
+  details.set_md5(md5);
+
+  scoped_ptr<FileMetadata> metadata(new FileMetadata);
+  metadata->set_file_id(file_id);
+  *metadata->mutable_details() = details;
+
+  return metadata.Pass();
+}
+
+scoped_ptr<FileTracker> CreateTracker(const FileMetadata& metadata,
+                                      int64 tracker_id,
+                                      const FileTracker* parent_tracker) {
+  scoped_ptr<FileTracker> tracker(new FileTracker);
+  tracker->set_tracker_id(tracker_id);
+  if (parent_tracker)
+    tracker->set_parent_tracker_id(parent_tracker->tracker_id());
+  tracker->set_file_id(metadata.file_id());
+  if (parent_tracker)
+    tracker->set_app_id(parent_tracker->app_id());
+  tracker->set_tracker_kind(TRACKER_KIND_REGULAR);
+  *tracker->mutable_synced_details() = metadata.details();
+  tracker->set_dirty(false);
+  tracker->set_active(true);
+  tracker->set_needs_folder_listing(false);
+  return tracker.Pass();
+}
+
+scoped_ptr<FileTracker> CreatePlaceholderTracker(
+    const std::string& file_id,
+    int64 tracker_id,
+    const FileTracker* parent_tracker) {
+  scoped_ptr<FileTracker> tracker(new FileTracker);
+  tracker->set_tracker_id(tracker_id);
+  if (parent_tracker)
+    tracker->set_parent_tracker_id(parent_tracker->tracker_id());
+  tracker->set_file_id(file_id);
+  if (parent_tracker)
+    tracker->set_app_id(parent_tracker->app_id());
+  tracker->set_tracker_kind(TRACKER_KIND_REGULAR);
+  tracker->set_dirty(true);
+  tracker->set_active(false);
+  tracker->set_needs_folder_listing(false);
+  return tracker.Pass();
+}
+
+scoped_ptr<DatabaseContents> CreateTestDatabaseContents() {
+  scoped_ptr<DatabaseContents> contents(new DatabaseContents);
+
+  scoped_ptr<FileMetadata> sync_root_metadata =
+      CreateFolderMetadata("sync_root_folder_id",
+                           "Chrome Syncable FileSystem");
+  scoped_ptr<FileTracker> sync_root_tracker =
+      CreateTracker(*sync_root_metadata, kSyncRootTrackerID, NULL);
+
+  scoped_ptr<FileMetadata> app_root_metadata =
+      CreateFolderMetadata("app_root_folder_id", "app_id");
+  scoped_ptr<FileTracker> app_root_tracker =
+      CreateTracker(*app_root_metadata, kAppRootTrackerID,
+                    sync_root_tracker.get());
+  app_root_tracker->set_app_id("app_id");
+  app_root_tracker->set_tracker_kind(TRACKER_KIND_APP_ROOT);
+
+  scoped_ptr<FileMetadata> file_metadata =
+      CreateFileMetadata("file_id", "file", "file_md5");
+  scoped_ptr<FileTracker> file_tracker =
+      CreateTracker(*file_metadata, kFileTrackerID, app_root_tracker.get());
+
+  scoped_ptr<FileTracker> placeholder_tracker =
+      CreatePlaceholderTracker("unsynced_file_id", kPlaceholderTrackerID,
+                               app_root_tracker.get());
+
+  contents->file_metadata.push_back(sync_root_metadata.release());
+  contents->file_trackers.push_back(sync_root_tracker.release());
+  contents->file_metadata.push_back(app_root_metadata.release());
+  contents->file_trackers.push_back(app_root_tracker.release());
+  contents->file_metadata.push_back(file_metadata.release());
+  contents->file_trackers.push_back(file_tracker.release());
+  contents->file_trackers.push_back(placeholder_tracker.release());
+  return contents.Pass();
+}
+
+}  // namespace
+
+class MetadataDatabaseIndexOnDiskTest : public testing::Test {
+ public:
+  virtual ~MetadataDatabaseIndexOnDiskTest() {}
+
+  virtual void SetUp() OVERRIDE {
+    ASSERT_TRUE(database_dir_.CreateUniqueTempDir());
+    in_memory_env_.reset(leveldb::NewMemEnv(leveldb::Env::Default()));
+
+    leveldb::Options options;
+    options.create_if_missing = true;
+    options.max_open_files = 0;  // Use minimum.
+    options.env = in_memory_env_.get();
+    leveldb::DB* db = NULL;
+    ASSERT_TRUE(leveldb::DB::Open(
+        options, database_dir_.path().AsUTF8Unsafe(), &db).ok());
+    db_.reset(db);
+
+    // Write the test contents and their indexes, as MetadataDatabase does
+    // when it builds the on-disk index.
+    scoped_ptr<DatabaseContents> contents = CreateTestDatabaseContents();
+    leveldb::WriteBatch batch;
+    for (size_t i = 0; i < contents->file_metadata.size(); ++i)
+      PutFileMetadataToBatch(*contents->file_metadata[i], &batch);
+    for (size_t i = 0; i < contents->file_trackers.size(); ++i)
+      PutFileTrackerToBatch(*contents->file_trackers[i], &batch);
+    MetadataDatabaseIndexOnDisk::BuildIndexes(*contents, &batch);
+    ASSERT_TRUE(db_->Write(leveldb::WriteOptions(), &batch).ok());
+
+    index_.reset(new MetadataDatabaseIndexOnDisk(db_.get()));
+  }
+
+  virtual void TearDown() OVERRIDE {
+    index_.reset();
+    db_.reset();
+    in_memory_env_.reset();
+  }
+
+ protected:
+  // Writes |records| with the pending index entries, as MetadataDatabase does.
+  void CommitPendingWrites(leveldb::WriteBatch* records) {
+    index_->AppendPendingWritesToBatch(records);
+    ASSERT_TRUE(db_->Write(leveldb::WriteOptions(), records).ok());
+    index_->OnPendingWritesCommitted();
+  }
+
+  void ReloadIndex() {
+    index_.reset(new MetadataDatabaseIndexOnDisk(db_.get()));
+  }
+
+  base::ScopedTempDir database_dir_;
+  scoped_ptr<leveldb::Env> in_memory_env_;
+  scoped_ptr<leveldb::DB> db_;
+  scoped_ptr<MetadataDatabaseIndexOnDisk> index_;
+};
+
+TEST_F(MetadataDatabaseIndexOnDiskTest, GetEntryTest) {
+  EXPECT_FALSE(index_->GetFileMetadata(std::string()));
+  EXPECT_FALSE(index_->GetFileTracker(kInvalidTrackerID));
+
+  const FileTracker* tracker = index_->GetFileTracker(kFileTrackerID);
+  ASSERT_TRUE(tracker);
+  EXPECT_EQ(kFileTrackerID, tracker->tracker_id());
+  EXPECT_EQ("file_id", tracker->file_id());
+
+  const FileMetadata* metadata = index_->GetFileMetadata("file_id");
+  ASSERT_TRUE(metadata);
+  EXPECT_EQ("file_id", metadata->file_id());
+
+  EXPECT_EQ(3u, index_->CountFileMetadata());
+  EXPECT_EQ(4u, index_->CountFileTracker());
+}
+
+TEST_F(MetadataDatabaseIndexOnDiskTest, IndexLookUpTest) {
+  TrackerIDSet trackers = index_->GetFileTrackerIDsByFileID("file_id");
+  EXPECT_EQ(1u, trackers.size());
+  EXPECT_TRUE(trackers.has_active());
+  EXPECT_EQ(kFileTrackerID, trackers.active_tracker());
+
+  int64 app_root_tracker_id = index_->GetAppRootTracker("app_id");
+  EXPECT_EQ(kAppRootTrackerID, app_root_tracker_id);
+
+  trackers = index_->GetFileTrackerIDsByParentAndTitle(
+      app_root_tracker_id, "file");
+  EXPECT_EQ(1u, trackers.size());
+  EXPECT_TRUE(trackers.has_active());
+  EXPECT_EQ(kFileTrackerID, trackers.active_tracker());
+
+  std::vector<int64> children =
+      index_->GetFileTrackerIDsByParent(app_root_tracker_id);
+  std::sort(children.begin(), children.end());
+  ASSERT_EQ(2u, children.size());
+  EXPECT_EQ(kFileTrackerID, children[0]);
+  EXPECT_EQ(kPlaceholderTrackerID, children[1]);
+
+  EXPECT_TRUE(index_->PickMultiTrackerFileID().empty());
+  EXPECT_EQ(kInvalidTrackerID,
+            index_->PickMultiBackingFilePath().parent_id);
+  EXPECT_EQ(kPlaceholderTrackerID, index_->PickDirtyTracker());
+  EXPECT_EQ(1u, index_->CountDirtyTracker());
+
+  std::vector<std::string> app_ids = index_->GetRegisteredAppIDs();
+  ASSERT_EQ(1u, app_ids.size());
+  EXPECT_EQ("app_id", app_ids[0]);
+}
+
+TEST_F(MetadataDatabaseIndexOnDiskTest, UpdateTest) {
+  index_->DemoteDirtyTracker(kPlaceholderTrackerID);
+  EXPECT_EQ(kInvalidTrackerID, index_->PickDirtyTracker());
+  index_->PromoteDemotedDirtyTrackers();
+  EXPECT_EQ(kPlaceholderTrackerID, index_->PickDirtyTracker());
+
+  int64 new_tracker_id = 100;
+  scoped_ptr<FileTracker> new_tracker =
+      CreateTracker(*index_->GetFileMetadata("file_id"),
+                    new_tracker_id,
+                    index_->GetFileTracker(kAppRootTrackerID));
+  new_tracker->set_active(false);
+  index_->StoreFileTracker(new_tracker.Pass());
+
+  EXPECT_EQ("file_id", index_->PickMultiTrackerFileID());
+  EXPECT_EQ(ParentIDAndTitle(kAppRootTrackerID, std::string("file")),
+            index_->PickMultiBackingFilePath());
+  EXPECT_EQ(kFileTrackerID,
+            index_->GetFileTrackerIDsByFileID("file_id").active_tracker());
+
+  index_->RemoveFileMetadata("file_id");
+  index_->RemoveFileTracker(kFileTrackerID);
+
+  EXPECT_FALSE(index_->GetFileMetadata("file_id"));
+  EXPECT_FALSE(index_->GetFileTracker(kFileTrackerID));
+  EXPECT_TRUE(index_->PickMultiTrackerFileID().empty());
+  EXPECT_EQ(kInvalidTrackerID,
+            index_->PickMultiBackingFilePath().parent_id);
+  EXPECT_FALSE(
+      index_->GetFileTrackerIDsByFileID("file_id").has_active());
+}
+
+// Changes must stay visible while they are written, and be read back from
+// the database once they are.
+TEST_F(MetadataDatabaseIndexOnDiskTest, PendingWritesTest) {
+  leveldb::WriteBatch batch;
+  scoped_ptr<FileTracker> tracker(
+      new FileTracker(*index_->GetFileTracker(kPlaceholderTrackerID)));
+  tracker->set_dirty(false);
+  PutFileTrackerToBatch(*tracker, &batch);
+  index_->StoreFileTracker(tracker.Pass());
+  PutFileTrackerDeletionToBatch(kFileTrackerID, &batch);
+  index_->RemoveFileTracker(kFileTrackerID);
+
+  EXPECT_EQ(0u, index_->CountDirtyTracker());
+  EXPECT_EQ(3u, index_->CountFileTracker());
+
+  // Nothing is written to the database until the batch is committed.
+  std::string value;
+  EXPECT_TRUE(db_->Get(leveldb::ReadOptions(),
+                       kFileTrackerKeyPrefix + base::Int64ToString(
+                           kFileTrackerID),
+                       &value).ok());
+
+  index_->AppendPendingWritesToBatch(&batch);
+  EXPECT_FALSE(index_->GetFileTracker(kFileTrackerID));
+  EXPECT_TRUE(index_->GetFileTrackerIDsByFileID("file_id").empty());
+  EXPECT_FALSE(index_->GetFileTracker(kPlaceholderTrackerID)->dirty());
+
+  ASSERT_TRUE(db_->Write(leveldb::WriteOptions(), &batch).ok());
+  index_->OnPendingWritesCommitted();
+  EXPECT_FALSE(index_->GetFileTracker(kFileTrackerID));
+  EXPECT_TRUE(index_->GetFileTrackerIDsByFileID("file_id").empty());
+
+  ReloadIndex();
+  EXPECT_FALSE(index_->GetFileTracker(kFileTrackerID));
+  EXPECT_TRUE(index_->GetFileTrackerIDsByFileID("file_id").empty());
+  EXPECT_EQ(kInvalidTrackerID, index_->PickDirtyTracker());
+  EXPECT_EQ(3u, index_->CountFileTracker());
+  EXPECT_EQ(1u, index_->GetFileTrackerIDsByParent(kAppRootTrackerID).size());
+}
+
+// Changes whose write failed must stay visible, and be written by the next
+// batch.
+TEST_F(MetadataDatabaseIndexOnDiskTest, FailedWritesTest) {
+  leveldb::WriteBatch records;
+  PutFileTrackerDeletionToBatch(kFileTrackerID, &records);
+  index_->RemoveFileTracker(kFileTrackerID);
+
+  // The write of |failed_batch| fails, and MetadataDatabase keeps its records
+  // to write them again.
+  leveldb::WriteBatch failed_batch(records);
+  index_->AppendPendingWritesToBatch(&failed_batch);
+  index_->OnPendingWritesFailed();
+  EXPECT_FALSE(index_->GetFileTracker(kFileTrackerID));
+  EXPECT_TRUE(index_->GetFileTrackerIDsByFileID("file_id").empty());
+
+  CommitPendingWrites(&records);
+  EXPECT_FALSE(index_->GetFileTracker(kFileTrackerID));
+
+  ReloadIndex();
+  EXPECT_FALSE(index_->GetFileTracker(kFileTrackerID));
+  EXPECT_TRUE(index_->GetFileTrackerIDsByFileID("file_id").empty());
+  EXPECT_EQ(3u, index_->CountFileTracker());
+}
+
+TEST_F(MetadataDatabaseIndexOnDiskTest, ActivationTest) {
+  // Move the active tracker of "file_id" to a new tracker.  The new one is
+  // activated first, so the old one must not drop its entries.
+  leveldb::WriteBatch batch;
+  const int64 new_tracker_id = 100;
+  scoped_ptr<FileTracker> new_tracker =
+      CreateTracker(*index_->GetFileMetadata("file_id"),
+                    new_tracker_id,
+                    index_->GetFileTracker(kSyncRootTrackerID));
+  PutFileTrackerToBatch(*new_tracker, &batch);
+  index_->StoreFileTracker(new_tracker.Pass());
+
+  scoped_ptr<FileTracker> old_tracker(
+      new FileTracker(*index_->GetFileTracker(kFileTrackerID)));
+  old_tracker->set_active(false);
+  PutFileTrackerToBatch(*old_tracker, &batch);
+  index_->StoreFileTracker(old_tracker.Pass());
+  CommitPendingWrites(&batch);
+
+  ReloadIndex();
+  TrackerIDSet trackers = index_->GetFileTrackerIDsByFileID("file_id");
+  EXPECT_EQ(2u, trackers.size());
+  EXPECT_EQ(new_tracker_id, trackers.active_tracker());
+  EXPECT_FALSE(index_->GetFileTrackerIDsByParentAndTitle(
+      kAppRootTrackerID, "file").has_active());
+  EXPECT_EQ(new_tracker_id, index_->GetFileTrackerIDsByParentAndTitle(
+      kSyncRootTrackerID, "file").active_tracker());
+  EXPECT_EQ("file_id", index_->PickMultiTrackerFileID());
+}
+
+TEST_F(MetadataDatabaseIndexOnDiskTest, RemoveIndexesTest) {
+  EXPECT_TRUE(MetadataDatabaseIndexOnDisk::HasIndexes(db_.get()));
+
+  index_.reset();
+  leveldb::WriteBatch batch;
+  MetadataDatabaseIndexOnDisk::RemoveIndexes(db_.get(), &batch);
+  ASSERT_TRUE(db_->Write(leveldb::WriteOptions(), &batch).ok());
+  EXPECT_FALSE(MetadataDatabaseIndexOnDisk::HasIndexes(db_.get()));
+
+  // Only the records are left.
+  size_t num_entries = 0;
+  scoped_ptr<leveldb::Iterator> itr(db_->NewIterator(leveldb::ReadOptions()));
+  for (itr->SeekToFirst(); itr->Valid(); itr->Next())
+    ++num_entries;
+  EXPECT_EQ(3u + 4u, num_entries);
+}
+
+}  // namespace drive_backend
+}  // namespace sync_file_system
@@ -0,0 +1,224 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string>
+
+#include "base/files/file_path.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/message_loop/message_loop.h"
+#include "base/process/process.h"
+#include "base/process/process_metrics.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+#include "chrome/browser/sync_file_system/drive_backend/drive_backend_constants.h"
+#include "chrome/browser/sync_file_system/drive_backend/drive_backend_util.h"
+#include "chrome/browser/sync_file_system/drive_backend/metadata_database.h"
+#include "chrome/browser/sync_file_system/drive_backend/metadata_database.pb.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+#include "third_party/leveldatabase/src/include/leveldb/db.h"
+#include "third_party/leveldatabase/src/include/leveldb/write_batch.h"
+
+namespace sync_file_system {
+namespace drive_backend {
+
+namespace {
+
+const size_t kTrackerCounts[] = { 1000, 10 * 1000, 100 * 1000 };
+const size_t kFilesPerFolder = 100;
+
+const int64 kSyncRootTrackerID = 1;
+const int64 kAppRootTrackerID = 2;
+
+scoped_ptr<FileMetadata> CreateMetadata(const std::string& file_id,
+                                        const std::string& title,
+                                        FileKind file_kind) {
+  scoped_ptr<FileMetadata> metadata(new FileMetadata);
+  metadata->set_file_id(file_id);
+  FileDetails* details = metadata->mutable_details();
+  details->set_title(title);
+  details->set_file_kind(file_kind);
+  details->set_missing(false);
+  if (file_kind == FILE_KIND_FILE)
+    details->set_md5("md5_" + file_id);
+  return metadata.Pass();
+}
+
+scoped_ptr<FileTracker> CreateTracker(const FileMetadata& metadata,
+                                      int64 tracker_id,
+                                      int64 parent_tracker_id) {
+  scoped_ptr<FileTracker> tracker(new FileTracker);
+  tracker->set_tracker_id(tracker_id);
+  tracker->set_parent_tracker_id(parent_tracker_id);
+  tracker->set_file_id(metadata.file_id());
+  tracker->set_app_id("app_id");
+  tracker->set_tracker_kind(TRACKER_KIND_REGULAR);
+  *tracker->mutable_synced_details() = metadata.details();
+  tracker->set_dirty(false);
+  tracker->set_active(true);
+  tracker->set_needs_folder_listing(false);
+  return tracker.Pass();
+}
+
+void PutFileToBatch(const FileMetadata& metadata,
+                    const FileTracker& tracker,
+                    leveldb::WriteBatch* batch) {
+  PutFileMetadataToBatch(metadata, batch);
+  PutFileTrackerToBatch(tracker, batch);
+}
+
+size_t GetWorkingSetKB() {
+  base::ProcessHandle handle = base::Process::Current().handle();
+  scoped_ptr<base::ProcessMetrics> metrics(
+#if !defined(OS_MACOSX)
+      base::ProcessMetrics::CreateProcessMetrics(handle)
+#else
+      // Getting stats only for the current process is enough, so NULL is fine.
+      base::ProcessMetrics::CreateProcessMetrics(handle, NULL)
+#endif
+  );
+  return metrics->GetWorkingSetSize() / 1024;
+}
+
+}  // namespace
+
+class MetadataDatabasePerfTest : public testing::Test {
+ public:
+  MetadataDatabasePerfTest() {}
+
+  virtual void SetUp() OVERRIDE {
+    ASSERT_TRUE(database_dir_.CreateUniqueTempDir());
+  }
+
+ protected:
+  scoped_ptr<leveldb::DB> OpenDatabase(const base::FilePath& path) {
+    leveldb::Options options;
+    options.create_if_missing = true;
+    options.max_open_files = 0;  // Use minimum.
+    leveldb::DB* db = NULL;
+    EXPECT_TRUE(leveldb::DB::Open(options, path.AsUTF8Unsafe(), &db).ok());
+    return make_scoped_ptr(db);
+  }
+
+  // Writes a sync-root, an app-root and |num_trackers| - 2 trackers under
+  // it, in folders of kFilesPerFolder files.
+  void PopulateDatabase(const base::FilePath& path, size_t num_trackers) {
+    scoped_ptr<leveldb::DB> db = OpenDatabase(path);
+    ASSERT_TRUE(db);
+
+    leveldb::WriteBatch batch;
+    ASSERT_TRUE(db->Put(leveldb::WriteOptions(), kDatabaseVersionKey,
+                        base::Int64ToString(kCurrentDatabaseVersion)).ok());
+
+    scoped_ptr<FileMetadata> sync_root = CreateMetadata(
+        "sync_root_folder_id", kSyncRootFolderTitle, FILE_KIND_FOLDER);
+    scoped_ptr<FileTracker> sync_root_tracker =
+        CreateTracker(*sync_root, kSyncRootTrackerID, kInvalidTrackerID);
+    sync_root_tracker->clear_app_id();
+    PutFileToBatch(*sync_root, *sync_root_tracker, &batch);
+
+    scoped_ptr<FileMetadata> app_root = CreateMetadata(
+        "app_root_folder_id", "app_id", FILE_KIND_FOLDER);
+    scoped_ptr<FileTracker> app_root_tracker =
+        CreateTracker(*app_root, kAppRootTrackerID, kSyncRootTrackerID);
+    app_root_tracker->set_tracker_kind(TRACKER_KIND_APP_ROOT);
+    PutFileToBatch(*app_root, *app_root_tracker, &batch);
+
+    int64 tracker_id = kAppRootTrackerID + 1;
+    int64 folder_tracker_id = kAppRootTrackerID;
+    for (size_t i = 2; i < num_trackers; ++i) {
+      const std::string number = base::Uint64ToString(i);
+      const bool is_folder = (i - 2) % (kFilesPerFolder + 1) == 0;
+      scoped_ptr<FileMetadata> metadata = CreateMetadata(
+          "file_id_" + number, "title_" + number,
+          is_folder ? FILE_KIND_FOLDER : FILE_KIND_FILE);
+      const int64 parent_tracker_id =
+          is_folder ? kAppRootTrackerID : folder_tracker_id;
+      scoped_ptr<FileTracker> tracker =
+          CreateTracker(*metadata, tracker_id, parent_tracker_id);
+      PutFileToBatch(*metadata, *tracker, &batch);
+      if (is_folder)
+        folder_tracker_id = tracker_id;
+      ++tracker_id;
+    }
+
+    ServiceMetadata service_metadata;
+    service_metadata.set_largest_change_id(1);
+    service_metadata.set_sync_root_tracker_id(kSyncRootTrackerID);
+    service_metadata.set_next_tracker_id(tracker_id);
+    PutServiceMetadataToBatch(service_metadata, &batch);
+
+    ASSERT_TRUE(db->Write(leveldb::WriteOptions(), &batch).ok());
+  }
+
+  // Creates a MetadataDatabase on the database at |path|.  Returns the time it
+  // took in |elapsed|, and the growth of the working set while the
+  // MetadataDatabase is alive in |memory_kb|.
+  void MeasureInitialization(const base::FilePath& path,
+                             bool enable_on_disk_index,
+                             base::TimeDelta* elapsed,
+                             size_t* memory_kb) {
+    scoped_ptr<leveldb::DB> db = OpenDatabase(path);
+    ASSERT_TRUE(db);
+
+    const size_t memory_before = GetWorkingSetKB();
+    const base::TimeTicks start = base::TimeTicks::HighResNow();
+    scoped_ptr<MetadataDatabase> metadata_database;
+    ASSERT_EQ(SYNC_STATUS_OK,
+              MetadataDatabase::CreateForTesting(
+                  db.Pass(), enable_on_disk_index, &metadata_database));
+    *elapsed = base::TimeTicks::HighResNow() - start;
+    const size_t memory_after = GetWorkingSetKB();
+    *memory_kb = memory_after > memory_before ?
+        memory_after - memory_before : 0;
+
+    EXPECT_TRUE(metadata_database->HasSyncRoot());
+    metadata_database.reset();
+    message_loop_.RunUntilIdle();
+  }
+
+  base::MessageLoop message_loop_;
+  base::ScopedTempDir database_dir_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MetadataDatabasePerfTest);
+};
+
+TEST_F(MetadataDatabasePerfTest, Initialization) {
+  for (size_t i = 0; i < arraysize(kTrackerCounts); ++i) {
+    const size_t num_trackers = kTrackerCounts[i];
+    const std::string trace = base::StringPrintf(
+        "%u_trackers", static_cast<unsigned>(num_trackers));
+    const base::FilePath path = database_dir_.path().AppendASCII(trace);
+    PopulateDatabase(path, num_trackers);
+
+    base::TimeDelta on_memory_time;
+    size_t on_memory_kb = 0;
+    MeasureInitialization(path, false, &on_memory_time, &on_memory_kb);
+
+    // The first initialization with the on-disk index builds it.
+    base::TimeDelta build_time;
+    size_t build_kb = 0;
+    MeasureInitialization(path, true, &build_time, &build_kb);
+
+    base::TimeDelta on_disk_time;
+    size_t on_disk_kb = 0;
+    MeasureInitialization(path, true, &on_disk_time, &on_disk_kb);
+
+    perf_test::PrintResult("metadata_database_init", "_on_memory", trace,
+                           on_memory_time.InMillisecondsF(), "ms", true);
+    perf_test::PrintResult("metadata_database_init", "_on_disk_build", trace,
+                           build_time.InMillisecondsF(), "ms", true);
+    perf_test::PrintResult("metadata_database_init", "_on_disk", trace,
+                           on_disk_time.InMillisecondsF(), "ms", true);
+    perf_test::PrintResult("metadata_database_memory", "_on_memory", trace,
+                           on_memory_kb, "KB", true);
+    perf_test::PrintResult("metadata_database_memory", "_on_disk", trace,
+                           on_disk_kb, "KB", true);
+  }
+}
+
+}  // namespace drive_backend
+}  // namespace sync_file_system
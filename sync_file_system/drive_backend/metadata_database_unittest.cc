@@ -465,6 +465,7 @@ class MetadataDatabaseTest : public testing::Test {
     ASSERT_EQ(SYNC_STATUS_OK,
               MetadataDatabase::CreateForTesting(
                   metadata_database_->db_.Pass(),
+                  false /* enable_on_disk_index */,
                   &metadata_database_2));
     metadata_database_->db_ = metadata_database_2->db_.Pass();
 
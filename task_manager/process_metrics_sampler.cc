@@ -0,0 +1,279 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/task_manager/process_metrics_sampler.h"
+
+#include "base/bind.h"
+#include "base/process/process_metrics.h"
+#include "base/sequenced_task_runner.h"
+#include "base/task_runner_util.h"
+#include "base/threading/sequenced_worker_pool.h"
+#include "content/public/browser/browser_thread.h"
+
+#if defined(OS_MACOSX)
+#include "content/public/browser/browser_child_process_host.h"
+#endif
+
+using content::BrowserThread;
+
+namespace task_manager {
+
+ProcessMetricsSample::ProcessMetricsSample()
+    : is_cpu_usage_valid(false),
+      cpu_usage(0),
+      is_idle_wakeups_valid(false),
+      idle_wakeups(0),
+      is_private_and_shared_valid(false),
+      private_bytes(0),
+      shared_bytes(0),
+      is_physical_memory_valid(false),
+      physical_memory(0) {}
+
+////////////////////////////////////////////////////////////////////////////////
+// ProcessMetricsSnapshot class
+////////////////////////////////////////////////////////////////////////////////
+
+ProcessMetricsSnapshot::ProcessMetricsSnapshot(SampleMap* samples,
+                                               base::TimeTicks sample_time)
+    : sample_time_(sample_time) {
+  samples_.swap(*samples);
+}
+
+ProcessMetricsSnapshot::~ProcessMetricsSnapshot() {}
+
+const ProcessMetricsSample* ProcessMetricsSnapshot::GetSample(
+    base::ProcessHandle handle) const {
+  SampleMap::const_iterator iter = samples_.find(handle);
+  return iter == samples_.end() ? NULL : &iter->second;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ProcessMetricsSampler::Core class
+////////////////////////////////////////////////////////////////////////////////
+
+class ProcessMetricsSampler::Core {
+ public:
+  Core() {}
+  ~Core();
+
+  // Starts sampling the process |handle| refers to. Takes ownership of
+  // |owned_handle|, a handle to the same process which the sampler opened for
+  // the Core, so that the process can be sampled through it even after the
+  // client closes |handle|.
+  void AddProcess(base::ProcessHandle handle,
+                  base::ProcessHandle owned_handle);
+
+  // Stops sampling |handle| and closes the handle the Core owns for it.
+  void RemoveProcess(base::ProcessHandle handle);
+
+  // Samples every process that was added and not removed.
+  scoped_refptr<const ProcessMetricsSnapshot> Sample();
+
+ private:
+  struct Process {
+    base::ProcessHandle owned_handle;
+
+    // Has to outlive a pass, as GetCPUUsage() returns the usage since the
+    // previous call.
+    base::ProcessMetrics* metrics;
+  };
+  typedef std::map<base::ProcessHandle, Process> ProcessMap;
+
+  static void CloseProcess(const Process& process);
+  static void SampleProcess(base::ProcessMetrics* metrics,
+                            ProcessMetricsSample* sample);
+
+  // The processes to sample, by the handle of the client that added them.
+  ProcessMap processes_;
+
+  DISALLOW_COPY_AND_ASSIGN(Core);
+};
+
+ProcessMetricsSampler::Core::~Core() {
+  for (ProcessMap::const_iterator iter = processes_.begin();
+       iter != processes_.end(); ++iter) {
+    CloseProcess(iter->second);
+  }
+}
+
+void ProcessMetricsSampler::Core::AddProcess(
+    base::ProcessHandle handle,
+    base::ProcessHandle owned_handle) {
+  DCHECK(processes_.find(handle) == processes_.end());
+  Process& process = processes_[handle];
+  process.owned_handle = owned_handle;
+#if !defined(OS_MACOSX)
+  process.metrics = base::ProcessMetrics::CreateProcessMetrics(owned_handle);
+#else
+  process.metrics = base::ProcessMetrics::CreateProcessMetrics(
+      owned_handle, content::BrowserChildProcessHost::GetPortProvider());
+#endif
+}
+
+void ProcessMetricsSampler::Core::RemoveProcess(base::ProcessHandle handle) {
+  ProcessMap::iterator iter = processes_.find(handle);
+  // Not found if the sampler could not open the process.
+  if (iter == processes_.end())
+    return;
+  CloseProcess(iter->second);
+  processes_.erase(iter);
+}
+
+scoped_refptr<const ProcessMetricsSnapshot>
+ProcessMetricsSampler::Core::Sample() {
+  ProcessMetricsSnapshot::SampleMap samples;
+  for (ProcessMap::const_iterator iter = processes_.begin();
+       iter != processes_.end(); ++iter) {
+    SampleProcess(iter->second.metrics, &samples[iter->first]);
+  }
+  return make_scoped_refptr(
+      new ProcessMetricsSnapshot(&samples, base::TimeTicks::Now()));
+}
+
+// static
+void ProcessMetricsSampler::Core::CloseProcess(const Process& process) {
+  delete process.metrics;
+  base::CloseProcessHandle(process.owned_handle);
+}
+
+// static
+void ProcessMetricsSampler::Core::SampleProcess(
+    base::ProcessMetrics* metrics,
+    ProcessMetricsSample* sample) {
+  sample->is_cpu_usage_valid = true;
+  sample->cpu_usage = metrics->GetCPUUsage();
+#if defined(OS_MACOSX)
+  // TODO: Implement GetIdleWakeupsPerSecond() on other platforms,
+  // crbug.com/120488
+  sample->is_idle_wakeups_valid = true;
+  sample->idle_wakeups = metrics->GetIdleWakeupsPerSecond();
+#endif
+
+  base::WorkingSetKBytes ws_usage;
+  if (!metrics->GetWorkingSetKBytes(&ws_usage))
+    return;
+#if defined(OS_LINUX)
+  // GetMemoryBytes() is derived from the same /proc/<pid> read as
+  // GetWorkingSetKBytes(), so don't read it twice. Private memory is also
+  // resident on Linux, so it is the physical memory too.
+  sample->is_private_and_shared_valid = true;
+  sample->private_bytes = ws_usage.priv * 1024;
+  sample->shared_bytes = ws_usage.shared * 1024;
+  sample->is_physical_memory_valid = true;
+  sample->physical_memory = ws_usage.priv * 1024;
+#else
+  // Memory = working_set.private + working_set.shareable.
+  // We exclude the shared memory.
+  sample->is_physical_memory_valid = true;
+  sample->physical_memory = metrics->GetWorkingSetSize();
+  sample->physical_memory -= ws_usage.shared * 1024;
+  sample->is_private_and_shared_valid =
+      metrics->GetMemoryBytes(&sample->private_bytes, &sample->shared_bytes);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ProcessMetricsSampler class
+////////////////////////////////////////////////////////////////////////////////
+
+// static
+ProcessMetricsSampler* ProcessMetricsSampler::GetInstance() {
+  // Leaked, so that the blocking pool never runs a pass against a deleted
+  // Core during shutdown.
+  static ProcessMetricsSampler* instance = NULL;
+  if (!instance) {
+    base::SequencedWorkerPool* pool = BrowserThread::GetBlockingPool();
+    instance = new ProcessMetricsSampler(
+        pool->GetSequencedTaskRunnerWithShutdownBehavior(
+            pool->GetSequenceToken(),
+            base::SequencedWorkerPool::CONTINUE_ON_SHUTDOWN),
+        base::TimeDelta::FromMilliseconds(kSampleIntervalMs));
+  }
+  return instance;
+}
+
+ProcessMetricsSampler::ProcessMetricsSampler(
+    const scoped_refptr<base::SequencedTaskRunner>& task_runner,
+    base::TimeDelta interval)
+    : task_runner_(task_runner),
+      interval_(interval),
+      core_(new Core),
+      sample_pending_(false),
+      weak_factory_(this) {
+}
+
+ProcessMetricsSampler::~ProcessMetricsSampler() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  task_runner_->DeleteSoon(FROM_HERE, core_);
+}
+
+void ProcessMetricsSampler::AddObserver(Observer* observer) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  observers_.AddObserver(observer);
+  if (timer_.IsRunning())
+    return;
+  timer_.Start(FROM_HERE, interval_, this, &ProcessMetricsSampler::SampleNow);
+  SampleNow();
+}
+
+void ProcessMetricsSampler::RemoveObserver(Observer* observer) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  observers_.RemoveObserver(observer);
+  if (!observers_.might_have_observers())
+    timer_.Stop();
+}
+
+void ProcessMetricsSampler::AddProcess(base::ProcessHandle handle) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  if (++processes_[handle] > 1)
+    return;
+
+  // |handle| is valid now, so its process id still names the same process.
+  base::ProcessHandle owned_handle;
+  if (!base::OpenPrivilegedProcessHandle(base::GetProcId(handle),
+                                         &owned_handle)) {
+    return;
+  }
+  task_runner_->PostTask(FROM_HERE,
+                         base::Bind(&Core::AddProcess, base::Unretained(core_),
+                                    handle, owned_handle));
+}
+
+void ProcessMetricsSampler::RemoveProcess(base::ProcessHandle handle) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  std::map<base::ProcessHandle, int>::iterator iter = processes_.find(handle);
+  DCHECK(iter != processes_.end());
+  if (iter == processes_.end() || --iter->second > 0)
+    return;
+  processes_.erase(iter);
+  task_runner_->PostTask(FROM_HERE,
+                         base::Bind(&Core::RemoveProcess,
+                                    base::Unretained(core_), handle));
+}
+
+void ProcessMetricsSampler::SampleNow() {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  // A pass that takes longer than |interval_| delays the next one rather than
+  // queuing passes up behind it.
+  if (sample_pending_)
+    return;
+  sample_pending_ = true;
+
+  base::PostTaskAndReplyWithResult(
+      task_runner_.get(),
+      FROM_HERE,
+      base::Bind(&Core::Sample, base::Unretained(core_)),
+      base::Bind(&ProcessMetricsSampler::OnSampled,
+                 weak_factory_.GetWeakPtr()));
+}
+
+void ProcessMetricsSampler::OnSampled(
+    const scoped_refptr<const ProcessMetricsSnapshot>& snapshot) {
+  DCHECK(thread_checker_.CalledOnValidThread());
+  sample_pending_ = false;
+  latest_snapshot_ = snapshot;
+  FOR_EACH_OBSERVER(Observer, observers_, OnProcessMetricsSampled(snapshot));
+}
+
+}  // namespace task_manager
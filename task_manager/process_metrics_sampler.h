@@ -0,0 +1,166 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_TASK_MANAGER_PROCESS_METRICS_SAMPLER_H_
+#define CHROME_BROWSER_TASK_MANAGER_PROCESS_METRICS_SAMPLER_H_
+
+#include <map>
+
+#include "base/basictypes.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/weak_ptr.h"
+#include "base/observer_list.h"
+#include "base/process/process_handle.h"
+#include "base/threading/thread_checker.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+
+namespace base {
+class SequencedTaskRunner;
+}
+
+namespace task_manager {
+
+// The CPU and memory usage of one process. The is_XXX members indicate if a
+// value could be read; some values are not available on every platform.
+struct ProcessMetricsSample {
+  ProcessMetricsSample();
+
+  bool is_cpu_usage_valid;
+  double cpu_usage;
+
+  bool is_idle_wakeups_valid;
+  int idle_wakeups;
+
+  bool is_private_and_shared_valid;
+  size_t private_bytes;
+  size_t shared_bytes;
+
+  bool is_physical_memory_valid;
+  size_t physical_memory;
+};
+
+// The samples of every process watched by a ProcessMetricsSampler, taken in
+// one pass. A snapshot does not change once it is built, so it can be handed
+// between threads and kept by any number of clients.
+class ProcessMetricsSnapshot
+    : public base::RefCountedThreadSafe<ProcessMetricsSnapshot> {
+ public:
+  typedef std::map<base::ProcessHandle, ProcessMetricsSample> SampleMap;
+
+  // Takes the contents of |samples|.
+  ProcessMetricsSnapshot(SampleMap* samples, base::TimeTicks sample_time);
+
+  // Returns the sample of |handle|, or NULL if it was not sampled.
+  const ProcessMetricsSample* GetSample(base::ProcessHandle handle) const;
+
+  const SampleMap& samples() const { return samples_; }
+  base::TimeTicks sample_time() const { return sample_time_; }
+
+ private:
+  friend class base::RefCountedThreadSafe<ProcessMetricsSnapshot>;
+  ~ProcessMetricsSnapshot();
+
+  SampleMap samples_;
+  const base::TimeTicks sample_time_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProcessMetricsSnapshot);
+};
+
+// Periodically samples the CPU and memory usage of a set of processes. All the
+// processes are sampled together on a background sequence, so that the
+// /proc/<pid> reads (or their equivalent on other platforms) never run on the
+// thread the sampler lives on; that thread only receives the resulting
+// snapshots.
+//
+// Clients register the processes they are interested in and observe the
+// sampler; sampling runs only while there is at least one observer. The task
+// manager is one client, but the sampler does not depend on it and can be used
+// by any component that wants process metrics without showing any UI.
+//
+// A ProcessMetricsSampler must be used on a single thread, which must have a
+// message loop once sampling starts.
+class ProcessMetricsSampler {
+ public:
+  class Observer {
+   public:
+    // Called after each sampling pass with the new |snapshot|.
+    virtual void OnProcessMetricsSampled(
+        const scoped_refptr<const ProcessMetricsSnapshot>& snapshot) = 0;
+
+   protected:
+    virtual ~Observer() {}
+  };
+
+  // The interval between two passes of the sampler returned by GetInstance().
+  static const int kSampleIntervalMs = 1000;
+
+  // Returns the sampler shared by the browser. It lives on the UI thread and
+  // samples on a sequence of the blocking pool every kSampleIntervalMs.
+  static ProcessMetricsSampler* GetInstance();
+
+  // Creates a sampler that samples on |task_runner| every |interval|.
+  ProcessMetricsSampler(
+      const scoped_refptr<base::SequencedTaskRunner>& task_runner,
+      base::TimeDelta interval);
+  ~ProcessMetricsSampler();
+
+  // Adding the first observer starts the periodic sampling, removing the last
+  // one stops it.
+  void AddObserver(Observer* observer);
+  void RemoveObserver(Observer* observer);
+
+  // Adds |handle| to, or removes it from, the processes to sample. Calls are
+  // counted, so each client can add the processes it needs and remove them
+  // once it is done, independently of the other clients. |handle| must be
+  // valid when it is first added; the sampler opens its own handle to the
+  // process, so samples are never taken through a handle the client closed.
+  // Snapshots still key the samples by |handle|.
+  void AddProcess(base::ProcessHandle handle);
+  void RemoveProcess(base::ProcessHandle handle);
+
+  // Starts a sampling pass now, unless one is already in progress. Observers
+  // are notified when it completes.
+  void SampleNow();
+
+  // Returns the snapshot of the last completed pass, or NULL if no pass has
+  // completed yet.
+  const scoped_refptr<const ProcessMetricsSnapshot>& latest_snapshot() const {
+    return latest_snapshot_;
+  }
+
+ private:
+  // Owns the base::ProcessMetrics and the sampler's own process handles, and
+  // runs the passes on |task_runner_|.
+  class Core;
+
+  // Called with the result of a sampling pass.
+  void OnSampled(const scoped_refptr<const ProcessMetricsSnapshot>& snapshot);
+
+  scoped_refptr<base::SequencedTaskRunner> task_runner_;
+  const base::TimeDelta interval_;
+
+  // Used on and deleted on |task_runner_|.
+  Core* core_;
+
+  // The processes to sample, with the number of AddProcess() calls not yet
+  // matched by a RemoveProcess() call.
+  std::map<base::ProcessHandle, int> processes_;
+
+  // Whether a pass was posted to |task_runner_| and has not completed yet.
+  bool sample_pending_;
+
+  base::RepeatingTimer<ProcessMetricsSampler> timer_;
+  ObserverList<Observer> observers_;
+  scoped_refptr<const ProcessMetricsSnapshot> latest_snapshot_;
+
+  base::ThreadChecker thread_checker_;
+  base::WeakPtrFactory<ProcessMetricsSampler> weak_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProcessMetricsSampler);
+};
+
+}  // namespace task_manager
+
+#endif  // CHROME_BROWSER_TASK_MANAGER_PROCESS_METRICS_SAMPLER_H_
@@ -0,0 +1,151 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/task_manager/process_metrics_sampler.h"
+
+#include "base/memory/scoped_ptr.h"
+#include "base/message_loop/message_loop.h"
+#include "base/message_loop/message_loop_proxy.h"
+#include "base/run_loop.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace task_manager {
+
+namespace {
+
+// Records the snapshots it is notified of, and quits |run_loop| once it has
+// seen |quit_after| of them.
+class TestObserver : public ProcessMetricsSampler::Observer {
+ public:
+  explicit TestObserver(int quit_after)
+      : quit_after_(quit_after), run_loop_(NULL), count_(0) {}
+
+  virtual void OnProcessMetricsSampled(
+      const scoped_refptr<const ProcessMetricsSnapshot>& snapshot) OVERRIDE {
+    last_snapshot_ = snapshot;
+    if (++count_ == quit_after_ && run_loop_)
+      run_loop_->Quit();
+  }
+
+  void set_run_loop(base::RunLoop* run_loop) { run_loop_ = run_loop; }
+  int count() const { return count_; }
+  const scoped_refptr<const ProcessMetricsSnapshot>& last_snapshot() const {
+    return last_snapshot_;
+  }
+
+ private:
+  const int quit_after_;
+  base::RunLoop* run_loop_;
+  int count_;
+  scoped_refptr<const ProcessMetricsSnapshot> last_snapshot_;
+
+  DISALLOW_COPY_AND_ASSIGN(TestObserver);
+};
+
+}  // namespace
+
+class ProcessMetricsSamplerTest : public testing::Test {
+ public:
+  ProcessMetricsSamplerTest()
+      : sampler_(new ProcessMetricsSampler(
+            message_loop_.message_loop_proxy(),
+            base::TimeDelta::FromMilliseconds(1))) {}
+
+  virtual void TearDown() OVERRIDE {
+    // The sampler deletes its core on the task runner.
+    sampler_.reset();
+    base::RunLoop().RunUntilIdle();
+  }
+
+ protected:
+  base::MessageLoop message_loop_;
+  scoped_ptr<ProcessMetricsSampler> sampler_;
+};
+
+TEST_F(ProcessMetricsSamplerTest, SamplesAddedProcesses) {
+  const base::ProcessHandle handle = base::GetCurrentProcessHandle();
+  EXPECT_FALSE(sampler_->latest_snapshot().get());
+
+  sampler_->AddProcess(handle);
+  sampler_->SampleNow();
+  base::RunLoop().RunUntilIdle();
+
+  const ProcessMetricsSnapshot* snapshot = sampler_->latest_snapshot().get();
+  ASSERT_TRUE(snapshot);
+  EXPECT_EQ(1u, snapshot->samples().size());
+  const ProcessMetricsSample* sample = snapshot->GetSample(handle);
+  ASSERT_TRUE(sample);
+  EXPECT_TRUE(sample->is_cpu_usage_valid);
+  EXPECT_TRUE(sample->is_private_and_shared_valid);
+  EXPECT_GT(sample->private_bytes, 0u);
+  EXPECT_TRUE(sample->is_physical_memory_valid);
+  EXPECT_GT(sample->physical_memory, 0u);
+}
+
+// The process is sampled until every AddProcess() call has been matched by a
+// RemoveProcess() call.
+TEST_F(ProcessMetricsSamplerTest, CountsProcesses) {
+  const base::ProcessHandle handle = base::GetCurrentProcessHandle();
+  sampler_->AddProcess(handle);
+  sampler_->AddProcess(handle);
+  sampler_->RemoveProcess(handle);
+  sampler_->SampleNow();
+  base::RunLoop().RunUntilIdle();
+  ASSERT_TRUE(sampler_->latest_snapshot().get());
+  EXPECT_TRUE(sampler_->latest_snapshot()->GetSample(handle));
+
+  sampler_->RemoveProcess(handle);
+  sampler_->SampleNow();
+  base::RunLoop().RunUntilIdle();
+  ASSERT_TRUE(sampler_->latest_snapshot().get());
+  EXPECT_FALSE(sampler_->latest_snapshot()->GetSample(handle));
+  EXPECT_TRUE(sampler_->latest_snapshot()->samples().empty());
+}
+
+// The sampler keeps its own handle, so a process is still sampled after the
+// client closes the handle it was added with.
+TEST_F(ProcessMetricsSamplerTest, OutlivesClientHandle) {
+  base::ProcessHandle handle;
+  ASSERT_TRUE(base::OpenPrivilegedProcessHandle(base::GetCurrentProcId(),
+                                                &handle));
+  sampler_->AddProcess(handle);
+  base::CloseProcessHandle(handle);
+  sampler_->SampleNow();
+  base::RunLoop().RunUntilIdle();
+
+  ASSERT_TRUE(sampler_->latest_snapshot().get());
+  const ProcessMetricsSample* sample =
+      sampler_->latest_snapshot()->GetSample(handle);
+  ASSERT_TRUE(sample);
+  EXPECT_TRUE(sample->is_physical_memory_valid);
+  EXPECT_GT(sample->physical_memory, 0u);
+  sampler_->RemoveProcess(handle);
+}
+
+// Observing the sampler samples periodically, and every observer gets the
+// same snapshots.
+TEST_F(ProcessMetricsSamplerTest, NotifiesObservers) {
+  const base::ProcessHandle handle = base::GetCurrentProcessHandle();
+  TestObserver observer1(3);
+  TestObserver observer2(-1);
+  sampler_->AddProcess(handle);
+  sampler_->AddObserver(&observer1);
+  sampler_->AddObserver(&observer2);
+
+  base::RunLoop run_loop;
+  observer1.set_run_loop(&run_loop);
+  run_loop.Run();
+  sampler_->RemoveObserver(&observer1);
+  sampler_->RemoveObserver(&observer2);
+
+  EXPECT_EQ(3, observer1.count());
+  EXPECT_EQ(3, observer2.count());
+  ASSERT_TRUE(observer1.last_snapshot().get());
+  EXPECT_EQ(observer1.last_snapshot().get(), observer2.last_snapshot().get());
+  EXPECT_EQ(sampler_->latest_snapshot().get(),
+            observer1.last_snapshot().get());
+  EXPECT_TRUE(observer1.last_snapshot()->GetSample(handle));
+}
+
+}  // namespace task_manager
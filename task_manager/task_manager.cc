@@ -8,9 +8,7 @@
 #include "base/i18n/number_formatting.h"
 #include "base/i18n/rtl.h"
 #include "base/prefs/pref_registry_simple.h"
-#include "base/process/process_metrics.h"
 #include "base/rand_util.h"
-#include "base/stl_util.h"
 #include "base/strings/string16.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/stringprintf.h"
@@ -48,10 +46,6 @@
 #include "ui/base/text/bytes_formatting.h"
 #include "ui/gfx/image/image_skia.h"
 
-#if defined(OS_MACOSX)
-#include "content/public/browser/browser_child_process_host.h"
-#endif
-
 using content::BrowserThread;
 using content::ResourceRequestInfo;
 using content::WebContents;
@@ -237,7 +231,9 @@ TaskManagerModel::PerProcessValues::~PerProcessValues() {}
 ////////////////////////////////////////////////////////////////////////////////
 
 TaskManagerModel::TaskManagerModel(TaskManager* task_manager)
-    : pending_video_memory_usage_stats_update_(false),
+    : process_metrics_sampler_(
+          task_manager::ProcessMetricsSampler::GetInstance()),
+      pending_video_memory_usage_stats_update_(false),
       update_requests_(0),
       listen_requests_(0),
       update_state_(IDLE),
@@ -573,22 +569,13 @@ bool TaskManagerModel::GetPhysicalMemory(int index, size_t* result) const {
   PerProcessValues& values(per_process_cache_[handle]);
 
   if (!values.is_physical_memory_valid) {
-    base::WorkingSetKBytes ws_usage;
-    MetricsMap::const_iterator iter = metrics_map_.find(handle);
-    if (iter == metrics_map_.end() ||
-        !iter->second->GetWorkingSetKBytes(&ws_usage))
+    const task_manager::ProcessMetricsSample* sample =
+        GetProcessMetricsSample(handle);
+    if (!sample || !sample->is_physical_memory_valid)
       return false;
 
     values.is_physical_memory_valid = true;
-#if defined(OS_LINUX)
-    // On Linux private memory is also resident. Just use it.
-    values.physical_memory = ws_usage.priv * 1024;
-#else
-    // Memory = working_set.private + working_set.shareable.
-    // We exclude the shared memory.
-    values.physical_memory = iter->second->GetWorkingSetSize();
-    values.physical_memory -= ws_usage.shared * 1024;
-#endif
+    values.physical_memory = sample->physical_memory;
   }
   *result = values.physical_memory;
   return true;
@@ -970,18 +957,9 @@ void TaskManagerModel::AddResource(Resource* resource) {
     resources_.insert(++iter, resource);
   }
 
-  // Create the ProcessMetrics for this process if needed (not in map).
-  if (metrics_map_.find(process) == metrics_map_.end()) {
-    base::ProcessMetrics* pm =
-#if !defined(OS_MACOSX)
-        base::ProcessMetrics::CreateProcessMetrics(process);
-#else
-        base::ProcessMetrics::CreateProcessMetrics(
-            process, content::BrowserChildProcessHost::GetPortProvider());
-#endif
-
-    metrics_map_[process] = pm;
-  }
+  // Start sampling the metrics of the process if it is new.
+  if (group_iter == group_map_.end())
+    process_metrics_sampler_->AddProcess(process);
 
   // Notify the table that the contents have changed for it to redraw.
   FOR_EACH_OBSERVER(TaskManagerModelObserver, observer_list_,
@@ -1011,12 +989,7 @@ void TaskManagerModel::RemoveResource(Resource* resource) {
     group_map_.erase(group_iter);
 
     // Nobody is using this process, we don't need the process metrics anymore.
-    MetricsMap::iterator pm_iter = metrics_map_.find(process);
-    DCHECK(pm_iter != metrics_map_.end());
-    if (pm_iter != metrics_map_.end()) {
-      delete pm_iter->second;
-      metrics_map_.erase(process);
-    }
+    process_metrics_sampler_->RemoveProcess(process);
   }
 
   // Remove the entry from the model list.
@@ -1059,6 +1032,9 @@ void TaskManagerModel::StartUpdating() {
   }
   update_state_ = TASK_PENDING;
 
+  // Have the process metrics sampled while we are updating.
+  process_metrics_sampler_->AddObserver(this);
+
   // Notify resource providers that we are updating.
   StartListening();
 
@@ -1079,6 +1055,8 @@ void TaskManagerModel::StopUpdating() {
   DCHECK_EQ(TASK_PENDING, update_state_);
   update_state_ = STOPPING;
 
+  process_metrics_sampler_->RemoveObserver(this);
+
   // Notify resource providers that we are done updating.
   StopListening();
 }
@@ -1122,12 +1100,13 @@ void TaskManagerModel::Clear() {
   if (size > 0) {
     resources_.clear();
 
-    // Clear the groups.
+    // Clear the groups, and stop sampling their processes.
+    for (GroupMap::const_iterator iter = group_map_.begin();
+         iter != group_map_.end(); ++iter) {
+      process_metrics_sampler_->RemoveProcess(iter->first);
+    }
     group_map_.clear();
 
-    // Clear the process related info.
-    STLDeleteValues(&metrics_map_);
-
     // Clear the network maps.
     current_byte_count_map_.clear();
 
@@ -1154,13 +1133,12 @@ void TaskManagerModel::Refresh() {
   nacl::NaClBrowser* nacl_browser = nacl::NaClBrowser::GetInstance();
 #endif  // !defined(DISABLE_NACL)
 
-  // Compute the CPU usage values and check if NaCl GDB debug stub port is
-  // known.
-  // Note that we compute the CPU usage for all resources (instead of doing it
-  // lazily) as process_util::GetCPUUsage() returns the CPU usage since the last
-  // time it was called, and not calling it everytime would skew the value the
-  // next time it is retrieved (as it would be for more than 1 cycle).
-  // The same is true for idle wakeups.
+  // Take the CPU usage values from the last process metrics snapshot and check
+  // if NaCl GDB debug stub port is known.
+  // The CPU usage is sampled for all processes on every pass of the sampler
+  // (instead of lazily) as base::ProcessMetrics::GetCPUUsage() returns the CPU
+  // usage since the last time it was called. The same is true for idle
+  // wakeups.
   for (ResourceList::iterator iter = resources_.begin();
        iter != resources_.end(); ++iter) {
     base::ProcessHandle process = (*iter)->GetProcess();
@@ -1177,20 +1155,18 @@ void TaskManagerModel::Refresh() {
 #endif  // !defined(DISABLE_NACL)
     if (values.is_cpu_usage_valid && values.is_idle_wakeups_valid)
       continue;
-    MetricsMap::iterator metrics_iter = metrics_map_.find(process);
-    DCHECK(metrics_iter != metrics_map_.end());
+    const task_manager::ProcessMetricsSample* sample =
+        GetProcessMetricsSample(process);
+    if (!sample)
+      continue;
     if (!values.is_cpu_usage_valid) {
-      values.is_cpu_usage_valid = true;
-      values.cpu_usage = metrics_iter->second->GetCPUUsage();
+      values.is_cpu_usage_valid = sample->is_cpu_usage_valid;
+      values.cpu_usage = sample->cpu_usage;
     }
-#if defined(OS_MACOSX)
-    // TODO: Implement GetIdleWakeupsPerSecond() on other platforms,
-    // crbug.com/120488
     if (!values.is_idle_wakeups_valid) {
-      values.is_idle_wakeups_valid = true;
-      values.idle_wakeups = metrics_iter->second->GetIdleWakeupsPerSecond();
+      values.is_idle_wakeups_valid = sample->is_idle_wakeups_valid;
+      values.idle_wakeups = sample->idle_wakeups;
     }
-#endif  // defined(OS_MACOSX)
   }
 
   // Send a request to refresh GPU memory consumption values
@@ -1223,6 +1199,13 @@ void TaskManagerModel::Refresh() {
   }
 }
 
+void TaskManagerModel::OnProcessMetricsSampled(
+    const scoped_refptr<const task_manager::ProcessMetricsSnapshot>& snapshot) {
+  // The values are picked up by the next Refresh(), so that all the columns
+  // change together.
+  process_metrics_snapshot_ = snapshot;
+}
+
 void TaskManagerModel::NotifyResourceTypeStats(
     base::ProcessId renderer_id,
     const blink::WebCache::ResourceTypeStats& stats) {
@@ -1437,20 +1420,27 @@ base::string16 TaskManagerModel::GetMemCellText(int64 number) const {
 #endif
 }
 
+const task_manager::ProcessMetricsSample*
+TaskManagerModel::GetProcessMetricsSample(base::ProcessHandle handle) const {
+  if (!process_metrics_snapshot_.get())
+    return NULL;
+  return process_metrics_snapshot_->GetSample(handle);
+}
+
 bool TaskManagerModel::CachePrivateAndSharedMemory(
     base::ProcessHandle handle) const {
   PerProcessValues& values(per_process_cache_[handle]);
   if (values.is_private_and_shared_valid)
     return true;
 
-  MetricsMap::const_iterator iter = metrics_map_.find(handle);
-  if (iter == metrics_map_.end() ||
-      !iter->second->GetMemoryBytes(&values.private_bytes,
-                                    &values.shared_bytes)) {
+  const task_manager::ProcessMetricsSample* sample =
+      GetProcessMetricsSample(handle);
+  if (!sample || !sample->is_private_and_shared_valid)
     return false;
-  }
 
   values.is_private_and_shared_valid = true;
+  values.private_bytes = sample->private_bytes;
+  values.shared_bytes = sample->shared_bytes;
   return true;
 }
 
@@ -17,6 +17,7 @@
 #include "base/strings/string16.h"
 #include "base/timer/timer.h"
 #include "chrome/browser/renderer_host/web_cache_manager.h"
+#include "chrome/browser/task_manager/process_metrics_sampler.h"
 #include "chrome/browser/task_manager/resource_provider.h"
 #include "chrome/browser/ui/host_desktop.h"
 #include "content/public/common/gpu_memory_stats.h"
@@ -26,10 +27,6 @@ class PrefRegistrySimple;
 class TaskManagerModel;
 class TaskManagerModelGpuDataManagerObserver;
 
-namespace base {
-class ProcessMetrics;
-}
-
 namespace content {
 class WebContents;
 }
@@ -137,7 +134,13 @@ class TaskManagerModelObserver {
 // TaskManagerModel caches the values from all task_manager::Resources. This is
 // done so the UI sees a consistant view of the resources until it is told a
 // value has been updated.
-class TaskManagerModel : public base::RefCountedThreadSafe<TaskManagerModel> {
+//
+// The CPU and memory usage of the processes are not read by the model. They
+// come from the snapshots of the shared task_manager::ProcessMetricsSampler,
+// which samples them off the UI thread while the model is updating.
+class TaskManagerModel
+    : public base::RefCountedThreadSafe<TaskManagerModel>,
+      public task_manager::ProcessMetricsSampler::Observer {
  public:
   // (start, length)
   typedef std::pair<int, int> GroupRange;
@@ -314,11 +317,17 @@ class TaskManagerModel : public base::RefCountedThreadSafe<TaskManagerModel> {
 
   void NotifyDataReady();
 
+  // task_manager::ProcessMetricsSampler::Observer:
+  virtual void OnProcessMetricsSampled(
+      const scoped_refptr<const task_manager::ProcessMetricsSnapshot>& snapshot)
+      OVERRIDE;
+
  private:
   friend class base::RefCountedThreadSafe<TaskManagerModel>;
   friend class TaskManagerBrowserTest;
   FRIEND_TEST_ALL_PREFIXES(ExtensionApiTest, ProcessesVsTaskManager);
   FRIEND_TEST_ALL_PREFIXES(TaskManagerTest, RefreshCalled);
+  FRIEND_TEST_ALL_PREFIXES(TaskManagerTest, UsesProcessMetricsSnapshot);
   FRIEND_TEST_ALL_PREFIXES(TaskManagerWindowControllerTest,
                            SelectionAdaptsToSorting);
 
@@ -407,7 +416,6 @@ class TaskManagerModel : public base::RefCountedThreadSafe<TaskManagerModel> {
   typedef std::vector<scoped_refptr<task_manager::ResourceProvider> >
       ResourceProviderList;
   typedef std::map<base::ProcessHandle, ResourceList> GroupMap;
-  typedef std::map<base::ProcessHandle, base::ProcessMetrics*> MetricsMap;
   typedef std::map<task_manager::Resource*, int64> ResourceValueMap;
   typedef std::map<task_manager::Resource*,
                    PerResourceValues> PerResourceCache;
@@ -474,6 +482,11 @@ class TaskManagerModel : public base::RefCountedThreadSafe<TaskManagerModel> {
   // displayed in the task manager's memory cell.
   base::string16 GetMemCellText(int64 number) const;
 
+  // Returns the sample of |handle| in the last snapshot of the process
+  // metrics, or NULL if there is none yet.
+  const task_manager::ProcessMetricsSample* GetProcessMetricsSample(
+      base::ProcessHandle handle) const;
+
   // Verifies the private and shared memory for |handle| is valid in
   // |per_process_cache_|. Returns true if the data in |per_process_cache_| is
   // valid.
@@ -508,9 +521,13 @@ class TaskManagerModel : public base::RefCountedThreadSafe<TaskManagerModel> {
   // the model (but the actual Resources are owned by the ResourceProviders).
   GroupMap group_map_;
 
-  // A map to retrieve the process metrics for a process. The ProcessMetrics are
-  // owned by the model.
-  MetricsMap metrics_map_;
+  // Samples the CPU and memory usage of the processes in |group_map_|. Not
+  // owned.
+  task_manager::ProcessMetricsSampler* process_metrics_sampler_;
+
+  // The last snapshot received from |process_metrics_sampler_|.
+  scoped_refptr<const task_manager::ProcessMetricsSnapshot>
+      process_metrics_snapshot_;
 
   // A map that keeps track of the number of bytes read per process since last
   // tick. The Resources are owned by the ResourceProviders.
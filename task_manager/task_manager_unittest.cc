@@ -8,6 +8,7 @@
 
 #include "base/message_loop/message_loop.h"
 #include "base/strings/utf_string_conversions.h"
+#include "chrome/browser/task_manager/process_metrics_sampler.h"
 #include "chrome/browser/task_manager/resource_provider.h"
 #include "grit/chromium_strings.h"
 #include "grit/generated_resources.h"
@@ -16,6 +17,8 @@
 #include "ui/gfx/image/image_skia.h"
 
 using base::ASCIIToUTF16;
+using task_manager::ProcessMetricsSample;
+using task_manager::ProcessMetricsSnapshot;
 
 namespace {
 
@@ -124,3 +127,40 @@ TEST_F(TaskManagerTest, RefreshCalled) {
   ASSERT_TRUE(resource.refresh_called());
   task_manager.RemoveResource(&resource);
 }
+
+// Tests that the model shows the CPU and memory usage of the last process
+// metrics snapshot it received.
+TEST_F(TaskManagerTest, UsesProcessMetricsSnapshot) {
+  base::MessageLoop loop;
+  TaskManager task_manager;
+  TaskManagerModel* model = task_manager.model_.get();
+  TestResource resource;
+
+  task_manager.AddResource(&resource);
+  size_t bytes = 0;
+  EXPECT_FALSE(model->GetPrivateMemory(0, &bytes));
+
+  ProcessMetricsSample sample;
+  sample.is_cpu_usage_valid = true;
+  sample.cpu_usage = 42.0;
+  sample.is_private_and_shared_valid = true;
+  sample.private_bytes = 4096;
+  sample.shared_bytes = 1024;
+  sample.is_physical_memory_valid = true;
+  sample.physical_memory = 8192;
+  ProcessMetricsSnapshot::SampleMap samples;
+  samples[resource.GetProcess()] = sample;
+  model->OnProcessMetricsSampled(make_scoped_refptr(
+      new ProcessMetricsSnapshot(&samples, base::TimeTicks::Now())));
+  model->update_state_ = TaskManagerModel::TASK_PENDING;
+  model->Refresh();
+
+  EXPECT_EQ(42.0, model->GetCPUUsage(0));
+  ASSERT_TRUE(model->GetPrivateMemory(0, &bytes));
+  EXPECT_EQ(4096u, bytes);
+  ASSERT_TRUE(model->GetSharedMemory(0, &bytes));
+  EXPECT_EQ(1024u, bytes);
+  ASSERT_TRUE(model->GetPhysicalMemory(0, &bytes));
+  EXPECT_EQ(8192u, bytes);
+  task_manager.RemoveResource(&resource);
+}
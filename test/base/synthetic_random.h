@@ -0,0 +1,40 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef CHROME_BROWSER_TEST_BASE_SYNTHETIC_RANDOM_H_
+#define CHROME_BROWSER_TEST_BASE_SYNTHETIC_RANDOM_H_
+
+#include "base/basictypes.h"
+
+// A small linear congruential generator for tests and perftests which build
+// synthetic data sets. Unlike base::RandGenerator() it can be seeded, so that
+// every run builds the same data and results can be compared across runs.
+// Not suitable for anything but test data.
+class SyntheticRandom {
+ public:
+  SyntheticRandom() : state_(kDefaultSeed) {}
+  explicit SyntheticRandom(uint32 seed) : state_(seed) {}
+
+  // Returns a value in [0, 0x7fff].
+  uint32 Next() {
+    return (NextUint32() >> 16) & 0x7fff;
+  }
+
+  // Returns the next raw 32-bit state. Its low bits are far from random, so
+  // it should only be used where the whole value matters, such as for hash
+  // prefixes.
+  uint32 NextUint32() {
+    state_ = state_ * 1103515245 + 12345;
+    return state_;
+  }
+
+ private:
+  static const uint32 kDefaultSeed = 12345;
+
+  uint32 state_;
+
+  DISALLOW_COPY_AND_ASSIGN(SyntheticRandom);
+};
+
+#endif  // CHROME_BROWSER_TEST_BASE_SYNTHETIC_RANDOM_H_
@@ -9,12 +9,14 @@
 #include "base/files/file.h"
 #include "base/memory/ref_counted_memory.h"
 #include "base/memory/scoped_ptr.h"
+#include "base/metrics/histogram.h"
 #include "base/stl_util.h"
 #include "base/strings/string_number_conversions.h"
 #include "base/strings/string_util.h"
 #include "base/strings/utf_string_conversions.h"
 #include "base/threading/sequenced_worker_pool.h"
 #include "base/threading/thread_restrictions.h"
+#include "base/time/time.h"
 #include "base/values.h"
 #include "chrome/browser/themes/theme_properties.h"
 #include "chrome/common/extensions/manifest_handlers/theme_handler.h"
@@ -43,7 +45,7 @@ namespace {
 // Version number of the current theme pack. We just throw out and rebuild
 // theme packs that aren't int-equal to this. Increment this number if you
 // change default theme assets.
-const int kThemePackVersion = 34;
+const int kThemePackVersion = 35;
 
 // IDs that are in the DataPack won't clash with the positive integer
 // uint16. kHeaderID should always have the maximum value because we want the
@@ -58,6 +60,24 @@ const int kDisplayPropertiesID = kMaxID - 4;
 const int kSourceImagesID = kMaxID - 5;
 const int kScaleFactorsID = kMaxID - 6;
 
+// Decoded bitmaps are stored at their raw ID plus this offset. Raw IDs are
+// well below it.
+const int kDecodedImageIDOffset = 0x8000;
+
+// Bitmaps with more pixel data than this are only stored as PNG.
+const size_t kMaxDecodedImageBytes = 4 * 1024 * 1024;
+
+#pragma pack(push,1)
+// Header of a decoded bitmap in the DataPack. It is followed by |height| rows
+// of |width| premultiplied SkPMColors. Packs are not shared between machines,
+// so the platform's SkPMColor byte order is used as is.
+struct DecodedImageHeader {
+  int32 width;
+  int32 height;
+  int32 is_opaque;
+};
+#pragma pack(pop)
+
 // The sum of kFrameBorderThickness and kNonClientRestoredExtraThickness from
 // OpaqueBrowserFrameView.
 const int kRestoredTabVerticalOffset = 15;
@@ -468,6 +488,62 @@ SkBitmap CreateLowQualityResizedBitmap(const SkBitmap& source_bitmap,
   return scaled_bitmap;
 }
 
+// Writes |bitmap| in the DataPack format of decoded bitmaps to |data|.
+// Returns false if |bitmap| should only be stored as PNG.
+bool EncodeDecodedBitmap(const SkBitmap& bitmap,
+                         std::vector<unsigned char>* data) {
+  if (bitmap.config() != SkBitmap::kARGB_8888_Config ||
+      bitmap.width() <= 0 || bitmap.height() <= 0) {
+    return false;
+  }
+  const size_t row_bytes = bitmap.width() * sizeof(SkPMColor);
+  if (row_bytes * bitmap.height() > kMaxDecodedImageBytes)
+    return false;
+
+  SkAutoLockPixels lock(bitmap);
+  if (!bitmap.getPixels())
+    return false;
+
+  DecodedImageHeader header;
+  header.width = bitmap.width();
+  header.height = bitmap.height();
+  header.is_opaque = bitmap.isOpaque() ? 1 : 0;
+  data->resize(sizeof(header) + row_bytes * bitmap.height());
+  memcpy(&(*data)[0], &header, sizeof(header));
+  unsigned char* dest = &(*data)[sizeof(header)];
+  for (int y = 0; y < bitmap.height(); ++y, dest += row_bytes)
+    memcpy(dest, bitmap.getAddr32(0, y), row_bytes);
+  return true;
+}
+
+// Reads a bitmap written by EncodeDecodedBitmap(). The pixels are copied,
+// because images handed out by the theme pack can outlive its mmapped
+// DataPack.
+bool DecodeDecodedBitmap(const base::RefCountedMemory* data,
+                         SkBitmap* bitmap) {
+  if (data->size() < sizeof(DecodedImageHeader))
+    return false;
+  DecodedImageHeader header;
+  // Do a memcpy to avoid misaligned memory access.
+  memcpy(&header, data->front(), sizeof(header));
+  if (header.width <= 0 || header.height <= 0)
+    return false;
+  const size_t row_bytes = header.width * sizeof(SkPMColor);
+  if (row_bytes * header.height != data->size() - sizeof(header))
+    return false;
+
+  bitmap->setConfig(SkBitmap::kARGB_8888_Config, header.width, header.height,
+                    0, header.is_opaque ? kOpaque_SkAlphaType :
+                                          kPremul_SkAlphaType);
+  if (!bitmap->allocPixels())
+    return false;
+  SkAutoLockPixels lock(*bitmap);
+  const unsigned char* src = data->front() + sizeof(header);
+  for (int y = 0; y < header.height; ++y, src += row_bytes)
+    memcpy(bitmap->getAddr32(0, y), src, row_bytes);
+  return true;
+}
+
 // A ImageSkiaSource that scales 100P image to the target scale factor
 // if the ImageSkiaRep for the target scale factor isn't available.
 class ThemeImageSource: public gfx::ImageSkiaSource {
@@ -494,14 +570,17 @@ class ThemeImageSource: public gfx::ImageSkiaSource {
 };
 
 // An ImageSkiaSource that delays decoding PNG data into bitmaps until
-// needed. Missing data for a scale factor is computed by scaling data for an
+// needed. Bitmaps found in |decoded_map| are copied instead of decoded from
+// PNG. Missing data for a scale factor is computed by scaling data for an
 // available scale factor. Computed bitmaps are stored for future look up.
 class ThemeImagePngSource : public gfx::ImageSkiaSource {
  public:
   typedef std::map<ui::ScaleFactor,
                    scoped_refptr<base::RefCountedMemory> > PngMap;
 
-  explicit ThemeImagePngSource(const PngMap& png_map) : png_map_(png_map) {}
+  ThemeImagePngSource(const PngMap& png_map, const PngMap& decoded_map)
+      : png_map_(png_map),
+        decoded_map_(decoded_map) {}
 
   virtual ~ThemeImagePngSource() {}
 
@@ -514,14 +593,11 @@ class ThemeImagePngSource : public gfx::ImageSkiaSource {
     if (exact_bitmap_it != bitmap_map_.end())
       return gfx::ImageSkiaRep(exact_bitmap_it->second, scale);
 
-    // Look up the raw PNG data for |scale_factor| in the png map. If found,
-    // decode it, store the result in the bitmap map and return it.
-    PngMap::const_iterator exact_png_it = png_map_.find(scale_factor);
-    if (exact_png_it != png_map_.end()) {
+    // Look up the decoded bitmap or the raw PNG data for |scale_factor|. If
+    // found, load it, store the result in the bitmap map and return it.
+    if (png_map_.count(scale_factor) || decoded_map_.count(scale_factor)) {
       SkBitmap bitmap;
-      if (!gfx::PNGCodec::Decode(exact_png_it->second->front(),
-                                 exact_png_it->second->size(),
-                                 &bitmap)) {
+      if (!LoadBitmap(scale_factor, &bitmap)) {
         NOTREACHED();
         return gfx::ImageSkiaRep();
       }
@@ -551,9 +627,7 @@ class ThemeImagePngSource : public gfx::ImageSkiaSource {
         bitmap_map_.find(available_scale_factor);
     if (available_bitmap_it == bitmap_map_.end()) {
       SkBitmap available_bitmap;
-      if (!gfx::PNGCodec::Decode(available_png_it->second->front(),
-                                 available_png_it->second->size(),
-                                 &available_bitmap)) {
+      if (!LoadBitmap(available_scale_factor, &available_bitmap)) {
         NOTREACHED();
         return gfx::ImageSkiaRep();
       }
@@ -571,7 +645,23 @@ class ThemeImagePngSource : public gfx::ImageSkiaSource {
     return gfx::ImageSkiaRep(scaled_bitmap, scale);
   }
 
+  // Loads the bitmap for |scale_factor|, preferring the decoded copy over the
+  // PNG data.
+  bool LoadBitmap(ui::ScaleFactor scale_factor, SkBitmap* bitmap) const {
+    PngMap::const_iterator decoded_it = decoded_map_.find(scale_factor);
+    if (decoded_it != decoded_map_.end() &&
+        DecodeDecodedBitmap(decoded_it->second.get(), bitmap)) {
+      return true;
+    }
+    PngMap::const_iterator png_it = png_map_.find(scale_factor);
+    return png_it != png_map_.end() &&
+        gfx::PNGCodec::Decode(png_it->second->front(),
+                              png_it->second->size(),
+                              bitmap);
+  }
+
   PngMap png_map_;
+  PngMap decoded_map_;
 
   typedef std::map<ui::ScaleFactor, SkBitmap> BitmapMap;
   BitmapMap bitmap_map_;
@@ -637,6 +727,7 @@ scoped_refptr<BrowserThemePack> BrowserThemePack::BuildFromExtension(
   DCHECK(BrowserThread::CurrentlyOn(BrowserThread::UI));
   DCHECK(extension);
   DCHECK(extension->is_theme());
+  const base::TimeTicks start_time = base::TimeTicks::Now();
 
   scoped_refptr<BrowserThemePack> pack(new BrowserThemePack);
   pack->BuildHeader(extension);
@@ -682,11 +773,13 @@ scoped_refptr<BrowserThemePack> BrowserThemePack::BuildFromExtension(
     it->second = gfx::Image(image_skia);
   }
 
-  // Generate raw images (for new-tab-page attribution and background) for
-  // any missing scale from an available scale image.
-  for (size_t i = 0; i < arraysize(kPreloadIDs); ++i) {
-    pack->GenerateRawImageForAllSupportedScales(kPreloadIDs[i]);
-  }
+  // Raw images (for new-tab-page attribution and background) for scales the
+  // theme does not provide are generated lazily, normally by WriteToDisk() on
+  // the file thread, so that scaling and re-encoding them does not hold up
+  // the theme switch.
+
+  UMA_HISTOGRAM_TIMES("Themes.BuildFromExtensionTime",
+                      base::TimeTicks::Now() - start_time);
 
   // The BrowserThemePack is now in a consistent state.
   return pack;
@@ -699,6 +792,7 @@ scoped_refptr<BrowserThemePack> BrowserThemePack::BuildFromDataPack(
   // Allow IO on UI thread due to deep-seated theme design issues.
   // (see http://crbug.com/80206)
   base::ThreadRestrictions::ScopedAllowIO allow_io;
+  const base::TimeTicks start_time = base::TimeTicks::Now();
   scoped_refptr<BrowserThemePack> pack(new BrowserThemePack);
   // Scale factor parameter is moot as data pack has image resources for all
   // supported scale factors.
@@ -758,6 +852,8 @@ scoped_refptr<BrowserThemePack> BrowserThemePack::BuildFromDataPack(
                 << "from those supported by platform.";
     return NULL;
   }
+  UMA_HISTOGRAM_TIMES("Themes.BuildFromDataPackTime",
+                      base::TimeTicks::Now() - start_time);
   return pack;
 }
 
@@ -806,9 +902,20 @@ bool BrowserThemePack::WriteToDisk(const base::FilePath& path) const {
 
   AddRawImagesTo(image_memory_, &resources);
 
+  {
+    // Entries of |generated_images_| are never removed, so |resources| can
+    // keep pointing at them after the lock is released.
+    base::AutoLock lock(generated_images_lock_);
+    for (size_t i = 0; i < arraysize(kPreloadIDs); ++i)
+      GenerateRawImageForAllSupportedScales(kPreloadIDs[i]);
+    AddRawImagesTo(generated_images_, &resources);
+  }
+
   RawImages reencoded_images;
-  RepackImages(images_on_file_thread_, &reencoded_images);
+  RawImages decoded_images;
+  RepackImages(images_on_file_thread_, &reencoded_images, &decoded_images);
   AddRawImagesTo(reencoded_images, &resources);
+  AddRawImagesTo(decoded_images, &resources);
 
   return ui::DataPack::WritePack(path, resources, ui::DataPack::BINARY);
 }
@@ -865,14 +972,19 @@ gfx::Image BrowserThemePack::GetImageNamed(int idr_id) {
     return image_iter->second;
 
   ThemeImagePngSource::PngMap png_map;
+  ThemeImagePngSource::PngMap decoded_map;
   for (size_t i = 0; i < scale_factors_.size(); ++i) {
     scoped_refptr<base::RefCountedMemory> memory =
         GetRawData(idr_id, scale_factors_[i]);
     if (memory.get())
       png_map[scale_factors_[i]] = memory;
+    memory = GetDecodedData(idr_id, scale_factors_[i]);
+    if (memory.get())
+      decoded_map[scale_factors_[i]] = memory;
   }
   if (!png_map.empty()) {
-    gfx::ImageSkia image_skia(new ThemeImagePngSource(png_map), 1.0f);
+    gfx::ImageSkia image_skia(
+        new ThemeImagePngSource(png_map, decoded_map), 1.0f);
     // |image_skia| takes ownership of ThemeImagePngSource.
     gfx::Image ret = gfx::Image(image_skia);
     images_on_ui_thread_[prs_id] = ret;
@@ -896,6 +1008,12 @@ base::RefCountedMemory* BrowserThemePack::GetRawData(
       RawImages::const_iterator it = image_memory_.find(raw_id);
       if (it != image_memory_.end()) {
         memory = it->second.get();
+      } else {
+        base::AutoLock lock(generated_images_lock_);
+        GenerateRawImageForAllSupportedScales(prs_id);
+        it = generated_images_.find(raw_id);
+        if (it != generated_images_.end())
+          memory = it->second.get();
       }
     }
   }
@@ -903,6 +1021,16 @@ base::RefCountedMemory* BrowserThemePack::GetRawData(
   return memory;
 }
 
+base::RefCountedMemory* BrowserThemePack::GetDecodedData(
+    int idr_id,
+    ui::ScaleFactor scale_factor) const {
+  if (!data_pack_.get())
+    return NULL;
+  int decoded_id = GetDecodedIDByPersistentID(GetPersistentIDByIDR(idr_id),
+                                              scale_factor);
+  return decoded_id == -1 ? NULL : data_pack_->GetStaticMemory(decoded_id);
+}
+
 bool BrowserThemePack::HasCustomImage(int idr_id) const {
   int prs_id = GetPersistentIDByIDR(idr_id);
   if (prs_id == -1)
@@ -1457,7 +1585,8 @@ void BrowserThemePack::CreateTabBackgroundImages(ImageCache* images) const {
 }
 
 void BrowserThemePack::RepackImages(const ImageCache& images,
-                                    RawImages* reencoded_images) const {
+                                    RawImages* reencoded_images,
+                                    RawImages* decoded_images) const {
   for (ImageCache::const_iterator it = images.begin();
        it != images.end(); ++it) {
     gfx::ImageSkia image_skia = *it->second.ToImageSkia();
@@ -1480,6 +1609,16 @@ void BrowserThemePack::RepackImages(const ImageCache& images,
           ui::GetSupportedScaleFactor(rep_it->scale()));
       (*reencoded_images)[raw_id] =
           base::RefCountedBytes::TakeVector(&bitmap_data);
+
+      if (EncodeDecodedBitmap(rep_it->sk_bitmap(), &bitmap_data)) {
+        int decoded_id = GetDecodedIDByPersistentID(
+            it->first,
+            ui::GetSupportedScaleFactor(rep_it->scale()));
+        if (decoded_id != -1) {
+          (*decoded_images)[decoded_id] =
+              base::RefCountedBytes::TakeVector(&bitmap_data);
+        }
+      }
     }
   }
 }
@@ -1530,6 +1669,13 @@ int BrowserThemePack::GetRawIDByPersistentID(
   return -1;
 }
 
+int BrowserThemePack::GetDecodedIDByPersistentID(
+    int prs_id,
+    ui::ScaleFactor scale_factor) const {
+  int raw_id = GetRawIDByPersistentID(prs_id, scale_factor);
+  return raw_id == -1 ? -1 : kDecodedImageIDOffset + raw_id;
+}
+
 bool BrowserThemePack::GetScaleFactorFromManifestKey(
     const std::string& key,
     ui::ScaleFactor* scale_factor) const {
@@ -1547,7 +1693,8 @@ bool BrowserThemePack::GetScaleFactorFromManifestKey(
   return false;
 }
 
-void BrowserThemePack::GenerateRawImageForAllSupportedScales(int prs_id) {
+void BrowserThemePack::GenerateRawImageForAllSupportedScales(
+    int prs_id) const {
   // Compute (by scaling) bitmaps for |prs_id| for any scale factors
   // for which the theme author did not provide a bitmap. We compute
   // the bitmaps using the highest scale factor that theme author
@@ -1558,11 +1705,14 @@ void BrowserThemePack::GenerateRawImageForAllSupportedScales(int prs_id) {
   // 1.8x, we will not use the 1.8x image here. Here we will only use
   // images provided for scale factors supported by the current system.
 
+  generated_images_lock_.AssertAcquired();
+
   // See if any image is missing. If not, we're done.
   bool image_missing = false;
   for (size_t i = 0; i < scale_factors_.size(); ++i) {
     int raw_id = GetRawIDByPersistentID(prs_id, scale_factors_[i]);
-    if (image_memory_.find(raw_id) == image_memory_.end()) {
+    if (image_memory_.find(raw_id) == image_memory_.end() &&
+        generated_images_.find(raw_id) == generated_images_.end()) {
       image_missing = true;
       break;
     }
@@ -1600,8 +1750,10 @@ void BrowserThemePack::GenerateRawImageForAllSupportedScales(int prs_id) {
   // Fill in all missing scale factors by scaling the available bitmap.
   for (size_t i = 0; i < scale_factors_.size(); ++i) {
     int scaled_raw_id = GetRawIDByPersistentID(prs_id, scale_factors_[i]);
-    if (image_memory_.find(scaled_raw_id) != image_memory_.end())
+    if (image_memory_.find(scaled_raw_id) != image_memory_.end() ||
+        generated_images_.find(scaled_raw_id) != generated_images_.end()) {
       continue;
+    }
     SkBitmap scaled_bitmap =
         CreateLowQualityResizedBitmap(available_bitmap,
                                       available_scale_factor,
@@ -1614,7 +1766,7 @@ void BrowserThemePack::GenerateRawImageForAllSupportedScales(int prs_id) {
                    << prs_id << " for scale_factor=" << scale_factors_[i];
       break;
     }
-    image_memory_[scaled_raw_id] =
+    generated_images_[scaled_raw_id] =
         base::RefCountedBytes::TakeVector(&bitmap_data);
   }
 }
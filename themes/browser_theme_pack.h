@@ -12,6 +12,7 @@
 #include "base/basictypes.h"
 #include "base/memory/scoped_ptr.h"
 #include "base/sequenced_task_runner_helpers.h"
+#include "base/synchronization/lock.h"
 #include "chrome/browser/themes/custom_theme_supplier.h"
 #include "extensions/common/extension.h"
 #include "third_party/skia/include/core/SkColor.h"
@@ -41,14 +42,17 @@ class DataPack;
 // The idea is to pre-process all images (tinting, compositing, etc) at theme
 // install time, save all the PNG-ified data into an mmappable file so we don't
 // suffer multiple file system access times, therefore solving two of the
-// problems with the previous implementation.
+// problems with the previous implementation. The generated images that are
+// drawn at startup are also saved as decoded bitmaps, so that loading them
+// from the DataPack is a copy instead of a PNG decode.
 //
 // A note on const-ness. All public, non-static methods are const.  We do this
 // because once we've constructed a BrowserThemePack through the
 // BuildFromExtension() interface, we WriteToDisk() on a thread other than the
 // UI thread that consumes a BrowserThemePack. There is no locking; thread
 // safety between the writing thread and the UI thread is ensured by having the
-// data be immutable.
+// data be immutable. The one exception is |generated_images_|, which is
+// filled lazily and guarded by |generated_images_lock_|.
 //
 // BrowserThemePacks are always deleted on the file thread because in the
 // common case, they are backed by mmapped data and the unmmapping operation
@@ -173,9 +177,11 @@ class BrowserThemePack : public CustomThemeSupplier {
   void CreateTabBackgroundImages(ImageCache* images) const;
 
   // Takes all the SkBitmaps in |images|, encodes them as PNGs and places
-  // them in |reencoded_images|.
+  // them in |reencoded_images|. Bitmaps which are small enough are also placed
+  // in |decoded_images| as their raw pixels.
   void RepackImages(const ImageCache& images,
-                    RawImages* reencoded_images) const;
+                    RawImages* reencoded_images,
+                    RawImages* decoded_images) const;
 
   // Takes all images in |source| and puts them in |destination|, freeing any
   // image already in |destination| that |source| would overwrite.
@@ -199,14 +205,25 @@ class BrowserThemePack : public CustomThemeSupplier {
   // |scale_factor| in memory.
   int GetRawIDByPersistentID(int prs_id, ui::ScaleFactor scale_factor) const;
 
+  // Returns a unique id to use to store the decoded bitmap for |prs_id| at
+  // |scale_factor| in the DataPack, or -1.
+  int GetDecodedIDByPersistentID(int prs_id,
+                                 ui::ScaleFactor scale_factor) const;
+
+  // Returns the decoded bitmap stored in |data_pack_| for |idr_id| at
+  // |scale_factor|, or NULL.
+  base::RefCountedMemory* GetDecodedData(int idr_id,
+                                         ui::ScaleFactor scale_factor) const;
+
   // Returns true if the |key| specifies a valid scale (e.g. "100") and
   // the corresponding scale factor is currently in use. If true, returns
   // the scale factor in |scale_factor|.
   bool GetScaleFactorFromManifestKey(const std::string& key,
                                      ui::ScaleFactor* scale_factor) const;
 
-  // Generates raw images for any missing scale from an available scale.
-  void GenerateRawImageForAllSupportedScales(int prs_id);
+  // Generates raw images for any missing scale from an available scale into
+  // |generated_images_|. |generated_images_lock_| must be held.
+  void GenerateRawImageForAllSupportedScales(int prs_id) const;
 
   // Data pack, if we have one.
   scoped_ptr<ui::DataPack> data_pack_;
@@ -271,6 +288,13 @@ class BrowserThemePack : public CustomThemeSupplier {
   // or vice versa.
   ImageCache images_on_file_thread_;
 
+  // Raw PNG data for the scale factors of |image_memory_| images that the
+  // theme does not provide. These are scaled from another scale factor the
+  // first time they are needed, which is usually by WriteToDisk() on the file
+  // thread. Entries are never removed, so returned pointers stay valid.
+  mutable RawImages generated_images_;
+  mutable base::Lock generated_images_lock_;
+
   DISALLOW_COPY_AND_ASSIGN(BrowserThemePack);
 };
 
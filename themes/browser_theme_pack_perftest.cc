@@ -0,0 +1,173 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome/browser/themes/browser_theme_pack.h"
+
+#include <vector>
+
+#include "base/files/scoped_temp_dir.h"
+#include "base/json/json_file_value_serializer.h"
+#include "base/memory/ref_counted_memory.h"
+#include "base/message_loop/message_loop.h"
+#include "base/path_service.h"
+#include "base/time/time.h"
+#include "base/values.h"
+#include "chrome/common/chrome_paths.h"
+#include "content/public/test/test_browser_thread.h"
+#include "grit/theme_resources.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+#include "third_party/skia/include/core/SkBitmap.h"
+#include "ui/base/layout.h"
+#include "ui/gfx/codec/png_codec.h"
+#include "ui/gfx/image/image.h"
+#include "ui/gfx/image/image_skia.h"
+
+using content::BrowserThread;
+using extensions::Extension;
+
+namespace {
+
+const int kIterations = 20;
+
+// The images drawn when a browser window first paints.
+const int kHotImageIDs[] = {
+  IDR_THEME_FRAME,
+  IDR_THEME_FRAME_INACTIVE,
+  IDR_THEME_TOOLBAR,
+  IDR_THEME_TAB_BACKGROUND,
+  IDR_THEME_BUTTON_BACKGROUND,
+};
+
+const float kScales[] = { 1.0f, 2.0f };
+
+base::FilePath GetStarGazingPath() {
+  base::FilePath test_path;
+  if (!PathService::Get(chrome::DIR_TEST_DATA, &test_path))
+    return test_path;
+  return test_path.AppendASCII("profiles")
+                  .AppendASCII("profile_with_complex_theme")
+                  .AppendASCII("Default")
+                  .AppendASCII("Extensions")
+                  .AppendASCII("mblmlcbknbnfebdfjnolmcapmdofhmme")
+                  .AppendASCII("1.1");
+}
+
+scoped_refptr<Extension> LoadExtension(const base::FilePath& path) {
+  std::string error;
+  JSONFileValueSerializer serializer(path.AppendASCII("manifest.json"));
+  scoped_ptr<base::DictionaryValue> manifest(
+      static_cast<base::DictionaryValue*>(
+          serializer.Deserialize(NULL, &error)));
+  if (!manifest.get())
+    return NULL;
+  return Extension::Create(path, extensions::Manifest::INVALID_LOCATION,
+                           *manifest, Extension::REQUIRE_KEY, &error);
+}
+
+// Gets the representations of the hot images at every scale, as painting
+// the window does.
+void LoadHotImages(BrowserThemePack* pack) {
+  for (size_t i = 0; i < arraysize(kHotImageIDs); ++i) {
+    gfx::Image image = pack->GetImageNamed(kHotImageIDs[i]);
+    if (image.IsEmpty())
+      continue;
+    for (size_t j = 0; j < arraysize(kScales); ++j)
+      EXPECT_FALSE(image.ToImageSkia()->GetRepresentation(kScales[j])
+                       .is_null());
+  }
+}
+
+}  // namespace
+
+class BrowserThemePackPerfTest : public testing::Test {
+ public:
+  BrowserThemePackPerfTest()
+      : ui_thread_(BrowserThread::UI, &message_loop_),
+        file_thread_(BrowserThread::FILE, &message_loop_) {
+    std::vector<ui::ScaleFactor> scale_factors;
+    scale_factors.push_back(ui::SCALE_FACTOR_100P);
+    scale_factors.push_back(ui::SCALE_FACTOR_200P);
+    scoped_set_supported_scale_factors_.reset(
+        new ui::test::ScopedSetSupportedScaleFactors(scale_factors));
+  }
+
+ protected:
+  base::MessageLoop message_loop_;
+  content::TestBrowserThread ui_thread_;
+  content::TestBrowserThread file_thread_;
+  scoped_ptr<ui::test::ScopedSetSupportedScaleFactors>
+      scoped_set_supported_scale_factors_;
+};
+
+// Installing a theme: build the pack from the extension and paint with it.
+TEST_F(BrowserThemePackPerfTest, ThemeSwitch) {
+  scoped_refptr<Extension> extension = LoadExtension(GetStarGazingPath());
+  ASSERT_TRUE(extension.get());
+
+  const base::TimeTicks start = base::TimeTicks::HighResNow();
+  for (int i = 0; i < kIterations; ++i) {
+    scoped_refptr<BrowserThemePack> pack =
+        BrowserThemePack::BuildFromExtension(extension.get());
+    ASSERT_TRUE(pack.get());
+    LoadHotImages(pack.get());
+  }
+  const base::TimeDelta elapsed = base::TimeTicks::HighResNow() - start;
+
+  perf_test::PrintResult("theme_pack_switch", "", "star_gazing",
+                         elapsed.InMillisecondsF() / kIterations, "ms",
+                         true);
+}
+
+// Starting with a theme: load the pack from disk and paint with it. The
+// "_png_decode" result is what decoding the same images from their PNG data
+// costs, as packs without decoded bitmaps did.
+TEST_F(BrowserThemePackPerfTest, Startup) {
+  base::ScopedTempDir dir;
+  ASSERT_TRUE(dir.CreateUniqueTempDir());
+  const base::FilePath file = dir.path().AppendASCII("data.pak");
+  {
+    scoped_refptr<Extension> extension = LoadExtension(GetStarGazingPath());
+    ASSERT_TRUE(extension.get());
+    scoped_refptr<BrowserThemePack> pack =
+        BrowserThemePack::BuildFromExtension(extension.get());
+    ASSERT_TRUE(pack.get());
+    ASSERT_TRUE(pack->WriteToDisk(file));
+  }
+
+  base::TimeTicks start = base::TimeTicks::HighResNow();
+  for (int i = 0; i < kIterations; ++i) {
+    scoped_refptr<BrowserThemePack> pack =
+        BrowserThemePack::BuildFromDataPack(
+            file, "mblmlcbknbnfebdfjnolmcapmdofhmme");
+    ASSERT_TRUE(pack.get());
+    LoadHotImages(pack.get());
+  }
+  const base::TimeDelta startup_time = base::TimeTicks::HighResNow() - start;
+
+  scoped_refptr<BrowserThemePack> pack = BrowserThemePack::BuildFromDataPack(
+      file, "mblmlcbknbnfebdfjnolmcapmdofhmme");
+  ASSERT_TRUE(pack.get());
+  start = base::TimeTicks::HighResNow();
+  for (int i = 0; i < kIterations; ++i) {
+    for (size_t j = 0; j < arraysize(kHotImageIDs); ++j) {
+      for (size_t k = 0; k < arraysize(kScales); ++k) {
+        scoped_refptr<base::RefCountedMemory> png = pack->GetRawData(
+            kHotImageIDs[j], ui::GetSupportedScaleFactor(kScales[k]));
+        SkBitmap bitmap;
+        if (png.get())
+          EXPECT_TRUE(gfx::PNGCodec::Decode(png->front(), png->size(),
+                                            &bitmap));
+      }
+    }
+  }
+  const base::TimeDelta png_time = base::TimeTicks::HighResNow() - start;
+
+  perf_test::PrintResult("theme_pack_startup", "", "star_gazing",
+                         startup_time.InMillisecondsF() / kIterations, "ms",
+                         true);
+  perf_test::PrintResult("theme_pack_startup", "_png_decode", "star_gazing",
+                         png_time.InMillisecondsF() / kIterations, "ms",
+                         true);
+}
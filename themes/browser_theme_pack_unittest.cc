@@ -147,6 +147,14 @@ class BrowserThemePackTest : public ::testing::Test {
                                          &theme_pack_->images_on_ui_thread_);
   }
 
+  // Returns the decoded bitmap data stored for |idr| in the DataPack of
+  // |pack|, or NULL.
+  base::RefCountedMemory* GetDecodedData(BrowserThemePack* pack,
+                                         int idr,
+                                         ui::ScaleFactor scale_factor) {
+    return pack->GetDecodedData(idr, scale_factor);
+  }
+
   // This function returns void in order to be able use ASSERT_...
   // The BrowserThemePack is returned in |pack|.
   void BuildFromUnpackedExtension(const base::FilePath& extension_path,
@@ -589,6 +597,79 @@ TEST_F(BrowserThemePackTest, CanBuildAndReadPack) {
   }
 }
 
+// The processed images are stored decoded, and must load back with exactly
+// the pixels they were written with.
+TEST_F(BrowserThemePackTest, DecodedImagesRoundTrip) {
+  base::ScopedTempDir dir;
+  ASSERT_TRUE(dir.CreateUniqueTempDir());
+  base::FilePath file = dir.path().AppendASCII("data.pak");
+
+  SkBitmap expected;
+  {
+    scoped_refptr<BrowserThemePack> pack;
+    BuildFromUnpackedExtension(GetStarGazingPath(), pack);
+    gfx::Image image = pack->GetImageNamed(IDR_THEME_FRAME);
+    ASSERT_FALSE(image.IsEmpty());
+    ASSERT_TRUE(image.ToImageSkia()->GetRepresentation(1.0f).sk_bitmap()
+                    .deepCopyTo(&expected, SkBitmap::kARGB_8888_Config));
+    ASSERT_TRUE(pack->WriteToDisk(file));
+  }
+
+  scoped_refptr<BrowserThemePack> pack =
+      BrowserThemePack::BuildFromDataPack(
+          file, "mblmlcbknbnfebdfjnolmcapmdofhmme");
+  ASSERT_TRUE(pack.get());
+  EXPECT_TRUE(GetDecodedData(pack.get(), IDR_THEME_FRAME,
+                             ui::SCALE_FACTOR_100P));
+  EXPECT_TRUE(GetDecodedData(pack.get(), IDR_THEME_FRAME,
+                             ui::SCALE_FACTOR_200P));
+  // Images which are copied into the pack unmodified are only kept as PNG.
+  EXPECT_FALSE(GetDecodedData(pack.get(), IDR_THEME_NTP_BACKGROUND,
+                              ui::SCALE_FACTOR_100P));
+
+  gfx::Image image = pack->GetImageNamed(IDR_THEME_FRAME);
+  ASSERT_FALSE(image.IsEmpty());
+  const SkBitmap& actual =
+      image.ToImageSkia()->GetRepresentation(1.0f).sk_bitmap();
+  ASSERT_EQ(expected.width(), actual.width());
+  ASSERT_EQ(expected.height(), actual.height());
+  SkAutoLockPixels expected_lock(expected);
+  SkAutoLockPixels actual_lock(actual);
+  for (int y = 0; y < expected.height(); ++y) {
+    EXPECT_EQ(0, memcmp(expected.getAddr32(0, y), actual.getAddr32(0, y),
+                        expected.width() * sizeof(SkPMColor)))
+        << "row " << y;
+  }
+}
+
+// Raw images for scales the theme does not provide are generated on first
+// use, and written to the DataPack.
+TEST_F(BrowserThemePackTest, GeneratesMissingRawImagesLazily) {
+  base::ScopedTempDir dir;
+  ASSERT_TRUE(dir.CreateUniqueTempDir());
+  base::FilePath file = dir.path().AppendASCII("data.pak");
+
+  {
+    scoped_refptr<BrowserThemePack> pack;
+    BuildFromUnpackedExtension(GetStarGazingPath(), pack);
+    base::RefCountedMemory* generated =
+        pack->GetRawData(IDR_THEME_NTP_BACKGROUND, ui::SCALE_FACTOR_200P);
+    ASSERT_TRUE(generated);
+    EXPECT_EQ(generated, pack->GetRawData(IDR_THEME_NTP_BACKGROUND,
+                                          ui::SCALE_FACTOR_200P));
+    ASSERT_TRUE(pack->WriteToDisk(file));
+  }
+
+  scoped_refptr<BrowserThemePack> pack =
+      BrowserThemePack::BuildFromDataPack(
+          file, "mblmlcbknbnfebdfjnolmcapmdofhmme");
+  ASSERT_TRUE(pack.get());
+  EXPECT_TRUE(pack->GetRawData(IDR_THEME_NTP_BACKGROUND,
+                               ui::SCALE_FACTOR_100P));
+  EXPECT_TRUE(pack->GetRawData(IDR_THEME_NTP_BACKGROUND,
+                               ui::SCALE_FACTOR_200P));
+}
+
 TEST_F(BrowserThemePackTest, HiDpiThemeTest) {
   base::ScopedTempDir dir;
   ASSERT_TRUE(dir.CreateUniqueTempDir());
@@ -13,12 +13,23 @@
 #include <vector>
 
 #include "base/logging.h"
+#include "build/build_config.h"
 #include "skia/ext/convolver.h"
 #include "skia/ext/recursive_gaussian_convolution.h"
 #include "third_party/skia/include/core/SkBitmap.h"
 #include "third_party/skia/include/core/SkSize.h"
 #include "ui/gfx/color_analysis.h"
 
+// SSE2 is part of x86-64, and 32-bit builds enable it explicitly.
+#if defined(ARCH_CPU_X86_FAMILY) && \
+    (defined(ARCH_CPU_64_BITS) || defined(__SSE2__))
+#define CONTENT_ANALYSIS_USE_SSE2
+#include <emmintrin.h>
+#elif defined(ARCH_CPU_ARM_FAMILY) && defined(__ARM_NEON__)
+#define CONTENT_ANALYSIS_USE_NEON
+#include <arm_neon.h>
+#endif
+
 namespace {
 
 const float kSigmaThresholdForRecursive = 1.5f;
@@ -221,6 +232,41 @@ void ConstrainedProfileThresholding(const std::vector<float>& profile,
   }
 }
 
+#if defined(CONTENT_ANALYSIS_USE_SSE2)
+
+// Computes grad_x^2 + grad_y^2 for 16 pixels, as four vectors of 32-bit sums
+// in pixel order. The sum does not fit in 16 bits, so the gradients are
+// interleaved into (grad_x, grad_y) pairs and _mm_madd_epi16 squares and adds
+// each pair into 32 bits at once.
+inline void SquaredGradientsSSE2(const uint8* grad_x,
+                                 const uint8* grad_y,
+                                 __m128i sums[4]) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(grad_x));
+  const __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(grad_y));
+  const __m128i x_lo = _mm_unpacklo_epi8(x, zero);
+  const __m128i x_hi = _mm_unpackhi_epi8(x, zero);
+  const __m128i y_lo = _mm_unpacklo_epi8(y, zero);
+  const __m128i y_hi = _mm_unpackhi_epi8(y, zero);
+  __m128i pairs = _mm_unpacklo_epi16(x_lo, y_lo);
+  sums[0] = _mm_madd_epi16(pairs, pairs);
+  pairs = _mm_unpackhi_epi16(x_lo, y_lo);
+  sums[1] = _mm_madd_epi16(pairs, pairs);
+  pairs = _mm_unpacklo_epi16(x_hi, y_hi);
+  sums[2] = _mm_madd_epi16(pairs, pairs);
+  pairs = _mm_unpackhi_epi16(x_hi, y_hi);
+  sums[3] = _mm_madd_epi16(pairs, pairs);
+}
+
+// SSE2 has no 32-bit max. The sums are below 2^31, so a signed compare works.
+inline __m128i MaxEpi32SSE2(__m128i a, __m128i b) {
+  const __m128i a_greater = _mm_cmpgt_epi32(a, b);
+  return _mm_or_si128(_mm_and_si128(a_greater, a),
+                      _mm_andnot_si128(a_greater, b));
+}
+
+#endif  // defined(CONTENT_ANALYSIS_USE_SSE2)
+
 }  // namespace
 
 namespace thumbnailing_utils {
@@ -351,13 +397,10 @@ void ApplyGaussianGradientMagnitudeFilter(SkBitmap* input_bitmap,
 
   unsigned grad_max = 0;
   for (int r = 0; r < image_size.height(); ++r) {
-    const uint8* grad_x_row = intermediate.getAddr8(0, r);
-    const uint8* grad_y_row = intermediate2.getAddr8(0, r);
-    for (int c = 0; c < image_size.width(); ++c) {
-      unsigned grad_x = grad_x_row[c];
-      unsigned grad_y = grad_y_row[c];
-      grad_max = std::max(grad_max, grad_x * grad_x + grad_y * grad_y);
-    }
+    grad_max = std::max(grad_max, internal::GradientMagnitudeMax(
+        intermediate.getAddr8(0, r),
+        intermediate2.getAddr8(0, r),
+        image_size.width()));
   }
 
   int bit_shift = 0;
@@ -365,14 +408,11 @@ void ApplyGaussianGradientMagnitudeFilter(SkBitmap* input_bitmap,
     bit_shift = static_cast<int>(
         std::log10(static_cast<float>(grad_max)) / std::log10(2.0f)) - 7;
   for (int r = 0; r < image_size.height(); ++r) {
-    const uint8* grad_x_row = intermediate.getAddr8(0, r);
-    const uint8* grad_y_row = intermediate2.getAddr8(0, r);
-    uint8* target_row = input_bitmap->getAddr8(0, r);
-    for (int c = 0; c < image_size.width(); ++c) {
-      unsigned grad_x = grad_x_row[c];
-      unsigned grad_y = grad_y_row[c];
-      target_row[c] = (grad_x * grad_x + grad_y * grad_y) >> bit_shift;
-    }
+    internal::GradientMagnitude(intermediate.getAddr8(0, r),
+                                intermediate2.getAddr8(0, r),
+                                image_size.width(),
+                                bit_shift,
+                                input_bitmap->getAddr8(0, r));
   }
 }
 
@@ -398,16 +438,17 @@ void ExtractImageProfileInformation(const SkBitmap& input_bitmap,
   rows->resize(area.height(), 0);
   columns->resize(area.width(), 0);
 
+  // Column sums are accumulated as integers and converted once at the end.
+  // Each sum stays below 2^24 for any bitmap shorter than 65793 rows, so this
+  // gives the same floats as accumulating in float.
+  std::vector<uint32> column_sums(area.width(), 0);
   for (int r = 0; r < area.height(); ++r) {
     // Points to the first byte of the row in the rectangle.
     const uint8* image_row = input_bitmap.getAddr8(area.x(), r + area.y());
-    unsigned row_sum = 0;
-    for (int c = 0; c < area.width(); ++c, ++image_row) {
-      row_sum += *image_row;
-      (*columns)[c] += *image_row;
-    }
-    (*rows)[r] = row_sum;
+    (*rows)[r] = internal::AccumulateProfiles(
+        image_row, area.width(), area.width() ? &column_sums[0] : NULL);
   }
+  std::copy(column_sums.begin(), column_sums.end(), columns->begin());
 
   if (apply_log) {
     // Generally for processing we will need to take logarithm of this data.
@@ -684,35 +725,36 @@ SkBitmap ComputeDecimatedImage(const SkBitmap& bitmap,
   target.setConfig(bitmap.config(), target_column_count, target_row_count);
   target.allocPixels();
 
+  // The kept columns are the same for every row, so find the runs of them
+  // once, as (byte offset, byte count) pairs, and only copy in the row loop.
+  std::vector<std::pair<size_t, size_t> > column_runs;
+  const size_t bytes_per_pixel = bitmap.bytesPerPixel();
+  for (int c = 0; c < bitmap.width();) {
+    if (!columns[c]) {
+      ++c;
+      continue;
+    }
+    int left_copy_pixel = c;
+    while (c < bitmap.width() && columns[c])
+      ++c;
+    column_runs.push_back(std::make_pair(left_copy_pixel * bytes_per_pixel,
+                                         (c - left_copy_pixel) *
+                                             bytes_per_pixel));
+  }
+
   int target_row = 0;
   for (int r = 0; r < bitmap.height(); ++r) {
     if (!rows[r])
       continue;  // We can just skip this one.
-    uint8* src_row =
+    const uint8* src_row =
         static_cast<uint8*>(bitmap.getPixels()) + r * bitmap.rowBytes();
     uint8* insertion_target = static_cast<uint8*>(target.getPixels()) +
         target_row * target.rowBytes();
-    int left_copy_pixel = -1;
-    for (int c = 0; c < bitmap.width(); ++c) {
-      if (left_copy_pixel < 0 && columns[c]) {
-        left_copy_pixel = c;  // Next time we will start copying from here.
-      } else if (left_copy_pixel >= 0 && !columns[c]) {
-        // This closes a fragment we want to copy. We do it now.
-        size_t bytes_to_copy = (c - left_copy_pixel) * bitmap.bytesPerPixel();
-        memcpy(insertion_target,
-               src_row + left_copy_pixel * bitmap.bytesPerPixel(),
-               bytes_to_copy);
-        left_copy_pixel = -1;
-        insertion_target += bytes_to_copy;
-      }
-    }
-    // We can still have the tail end to process here.
-    if (left_copy_pixel >= 0) {
-      size_t bytes_to_copy =
-          (bitmap.width() - left_copy_pixel) * bitmap.bytesPerPixel();
+    for (size_t i = 0; i < column_runs.size(); ++i) {
       memcpy(insertion_target,
-             src_row + left_copy_pixel * bitmap.bytesPerPixel(),
-             bytes_to_copy);
+             src_row + column_runs[i].first,
+             column_runs[i].second);
+      insertion_target += column_runs[i].second;
     }
     target_row++;
   }
@@ -770,4 +812,170 @@ SkBitmap CreateRetargetedThumbnailImage(
   return ComputeDecimatedImage(source_bitmap, included_rows, included_columns);
 }
 
+namespace internal {
+
+unsigned GradientMagnitudeMax(const uint8* grad_x,
+                              const uint8* grad_y,
+                              int width) {
+  unsigned grad_max = 0;
+  int c = 0;
+#if defined(CONTENT_ANALYSIS_USE_SSE2)
+  __m128i max4 = _mm_setzero_si128();
+  for (; c + 16 <= width; c += 16) {
+    __m128i sums[4];
+    SquaredGradientsSSE2(grad_x + c, grad_y + c, sums);
+    max4 = MaxEpi32SSE2(max4, MaxEpi32SSE2(MaxEpi32SSE2(sums[0], sums[1]),
+                                           MaxEpi32SSE2(sums[2], sums[3])));
+  }
+  max4 = MaxEpi32SSE2(max4, _mm_srli_si128(max4, 8));
+  max4 = MaxEpi32SSE2(max4, _mm_srli_si128(max4, 4));
+  grad_max = static_cast<unsigned>(_mm_cvtsi128_si32(max4));
+#elif defined(CONTENT_ANALYSIS_USE_NEON)
+  uint32x4_t max4 = vdupq_n_u32(0);
+  for (; c + 8 <= width; c += 8) {
+    const uint8x8_t x = vld1_u8(grad_x + c);
+    const uint8x8_t y = vld1_u8(grad_y + c);
+    const uint16x8_t x2 = vmull_u8(x, x);
+    const uint16x8_t y2 = vmull_u8(y, y);
+    max4 = vmaxq_u32(max4, vaddl_u16(vget_low_u16(x2), vget_low_u16(y2)));
+    max4 = vmaxq_u32(max4, vaddl_u16(vget_high_u16(x2), vget_high_u16(y2)));
+  }
+  uint32x2_t max2 = vmax_u32(vget_low_u32(max4), vget_high_u32(max4));
+  max2 = vpmax_u32(max2, max2);
+  grad_max = vget_lane_u32(max2, 0);
+#endif
+  if (c < width) {
+    grad_max = std::max(grad_max, GradientMagnitudeMaxScalar(
+        grad_x + c, grad_y + c, width - c));
+  }
+  return grad_max;
+}
+
+unsigned GradientMagnitudeMaxScalar(const uint8* grad_x,
+                                    const uint8* grad_y,
+                                    int width) {
+  unsigned grad_max = 0;
+  for (int c = 0; c < width; ++c) {
+    unsigned x = grad_x[c];
+    unsigned y = grad_y[c];
+    grad_max = std::max(grad_max, x * x + y * y);
+  }
+  return grad_max;
+}
+
+void GradientMagnitude(const uint8* grad_x,
+                       const uint8* grad_y,
+                       int width,
+                       int bit_shift,
+                       uint8* magnitude) {
+  int c = 0;
+#if defined(CONTENT_ANALYSIS_USE_SSE2)
+  const __m128i shift = _mm_cvtsi32_si128(bit_shift);
+  const __m128i low_byte = _mm_set1_epi32(0xff);
+  for (; c + 16 <= width; c += 16) {
+    __m128i sums[4];
+    SquaredGradientsSSE2(grad_x + c, grad_y + c, sums);
+    // Keep the low byte of each shifted sum, as the uint8 store of the scalar
+    // code does, so that the saturating packs below do not change it.
+    for (int i = 0; i < 4; ++i)
+      sums[i] = _mm_and_si128(_mm_srl_epi32(sums[i], shift), low_byte);
+    const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(sums[0], sums[1]),
+                                            _mm_packs_epi32(sums[2], sums[3]));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(magnitude + c), packed);
+  }
+#elif defined(CONTENT_ANALYSIS_USE_NEON)
+  const int32x4_t shift = vdupq_n_s32(-bit_shift);
+  for (; c + 8 <= width; c += 8) {
+    const uint8x8_t x = vld1_u8(grad_x + c);
+    const uint8x8_t y = vld1_u8(grad_y + c);
+    const uint16x8_t x2 = vmull_u8(x, x);
+    const uint16x8_t y2 = vmull_u8(y, y);
+    const uint32x4_t lo = vshlq_u32(
+        vaddl_u16(vget_low_u16(x2), vget_low_u16(y2)), shift);
+    const uint32x4_t hi = vshlq_u32(
+        vaddl_u16(vget_high_u16(x2), vget_high_u16(y2)), shift);
+    // vmovn keeps the low half of each lane, truncating like the scalar code.
+    vst1_u8(magnitude + c,
+            vmovn_u16(vcombine_u16(vmovn_u32(lo), vmovn_u32(hi))));
+  }
+#endif
+  if (c < width) {
+    GradientMagnitudeScalar(
+        grad_x + c, grad_y + c, width - c, bit_shift, magnitude + c);
+  }
+}
+
+void GradientMagnitudeScalar(const uint8* grad_x,
+                             const uint8* grad_y,
+                             int width,
+                             int bit_shift,
+                             uint8* magnitude) {
+  for (int c = 0; c < width; ++c) {
+    unsigned x = grad_x[c];
+    unsigned y = grad_y[c];
+    magnitude[c] = (x * x + y * y) >> bit_shift;
+  }
+}
+
+unsigned AccumulateProfiles(const uint8* row, int width, uint32* column_sums) {
+  unsigned row_sum = 0;
+  int c = 0;
+#if defined(CONTENT_ANALYSIS_USE_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i row_sums = zero;
+  for (; c + 16 <= width; c += 16) {
+    const __m128i pixels =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + c));
+    // _mm_sad_epu8 against zero sums each half of the pixels into 64 bits.
+    row_sums = _mm_add_epi64(row_sums, _mm_sad_epu8(pixels, zero));
+
+    const __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+    const __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+    const __m128i widened[4] = {
+      _mm_unpacklo_epi16(lo, zero),
+      _mm_unpackhi_epi16(lo, zero),
+      _mm_unpacklo_epi16(hi, zero),
+      _mm_unpackhi_epi16(hi, zero),
+    };
+    for (int i = 0; i < 4; ++i) {
+      __m128i* sums = reinterpret_cast<__m128i*>(column_sums + c + 4 * i);
+      _mm_storeu_si128(sums,
+                       _mm_add_epi32(_mm_loadu_si128(sums), widened[i]));
+    }
+  }
+  row_sum = static_cast<unsigned>(_mm_cvtsi128_si32(row_sums)) +
+      static_cast<unsigned>(_mm_cvtsi128_si32(_mm_srli_si128(row_sums, 8)));
+#elif defined(CONTENT_ANALYSIS_USE_NEON)
+  uint32x4_t row_sums = vdupq_n_u32(0);
+  for (; c + 8 <= width; c += 8) {
+    const uint16x8_t pixels = vmovl_u8(vld1_u8(row + c));
+    row_sums = vpadalq_u16(row_sums, pixels);
+    uint32* sums = column_sums + c;
+    vst1q_u32(sums, vaddw_u16(vld1q_u32(sums), vget_low_u16(pixels)));
+    vst1q_u32(sums + 4, vaddw_u16(vld1q_u32(sums + 4),
+                                  vget_high_u16(pixels)));
+  }
+  uint32x2_t row_sums2 =
+      vadd_u32(vget_low_u32(row_sums), vget_high_u32(row_sums));
+  row_sums2 = vpadd_u32(row_sums2, row_sums2);
+  row_sum = vget_lane_u32(row_sums2, 0);
+#endif
+  if (c < width)
+    row_sum += AccumulateProfilesScalar(row + c, width - c, column_sums + c);
+  return row_sum;
+}
+
+unsigned AccumulateProfilesScalar(const uint8* row,
+                                  int width,
+                                  uint32* column_sums) {
+  unsigned row_sum = 0;
+  for (int c = 0; c < width; ++c) {
+    row_sum += row[c];
+    column_sums[c] += row[c];
+  }
+  return row_sum;
+}
+
+}  // namespace internal
+
 }  // thumbnailing_utils
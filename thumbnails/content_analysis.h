@@ -80,6 +80,43 @@ SkBitmap CreateRetargetedThumbnailImage(const SkBitmap& source_bitmap,
                                         const gfx::Size& target_size,
                                         float kernel_sigma);
 
+namespace internal {
+
+// Per-row kernels of ApplyGaussianGradientMagnitudeFilter() and
+// ExtractImageProfileInformation(). Where SSE2 or NEON is available these use
+// it; the *Scalar() versions are the portable fallbacks, exposed so that unit
+// tests can check that the vectorized versions are bit-exact.
+
+// Returns the largest |grad_x|[i]^2 + |grad_y|[i]^2 over |width| pixels.
+unsigned GradientMagnitudeMax(const uint8* grad_x,
+                              const uint8* grad_y,
+                              int width);
+unsigned GradientMagnitudeMaxScalar(const uint8* grad_x,
+                                    const uint8* grad_y,
+                                    int width);
+
+// Sets |magnitude|[i] to (|grad_x|[i]^2 + |grad_y|[i]^2) >> |bit_shift|,
+// truncated to 8 bits, for |width| pixels.
+void GradientMagnitude(const uint8* grad_x,
+                       const uint8* grad_y,
+                       int width,
+                       int bit_shift,
+                       uint8* magnitude);
+void GradientMagnitudeScalar(const uint8* grad_x,
+                             const uint8* grad_y,
+                             int width,
+                             int bit_shift,
+                             uint8* magnitude);
+
+// Adds each of the |width| pixels of |row| to the matching entry of
+// |column_sums| and returns the sum of the pixels.
+unsigned AccumulateProfiles(const uint8* row, int width, uint32* column_sums);
+unsigned AccumulateProfilesScalar(const uint8* row,
+                                  int width,
+                                  uint32* column_sums);
+
+}  // namespace internal
+
 }  // namespace thumbnailing_utils
 
 #endif  // CHROME_BROWSER_THUMBNAILS_CONTENT_ANALYSIS_H_
@@ -0,0 +1,144 @@
+// Copyright 2014 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <algorithm>
+#include <vector>
+
+#include "base/time/time.h"
+#include "chrome/browser/test/base/synthetic_random.h"
+#include "chrome/browser/thumbnails/content_analysis.h"
+#include "skia/ext/platform_canvas.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+#include "third_party/skia/include/core/SkBitmap.h"
+#include "third_party/skia/include/core/SkColor.h"
+#include "ui/gfx/canvas.h"
+#include "ui/gfx/rect.h"
+#include "ui/gfx/size.h"
+
+namespace thumbnailing_utils {
+
+namespace {
+
+const int kCaptureCount = 10;
+const int kKernelIterations = 50;
+
+// Draws something resembling a tab screenshot: a header, columns of text-like
+// glyph blocks and a few pictures on a light background.
+SkBitmap CreateScreenshot(const gfx::Size& size) {
+  SyntheticRandom random;
+  gfx::Canvas canvas(size, 1.0f, true);
+  canvas.FillRect(gfx::Rect(size), SkColorSetRGB(250, 250, 250));
+  canvas.FillRect(gfx::Rect(0, 0, size.width(), 60),
+                  SkColorSetRGB(60, 90, 160));
+
+  const SkColor text_color = SkColorSetRGB(40, 40, 40);
+  for (int y = 90; y < size.height() - 20; y += 18) {
+    int x = 40 + random.Next() % 20;
+    const int line_end = size.width() - 300 - random.Next() % 200;
+    while (x < line_end) {
+      const int word_width = 12 + random.Next() % 60;
+      canvas.FillRect(gfx::Rect(x, y, word_width, 10), text_color);
+      x += word_width + 6;
+    }
+  }
+
+  for (int i = 0; i < 4; ++i) {
+    const gfx::Rect picture(size.width() - 260, 90 + i * 170, 220, 150);
+    canvas.FillRect(picture, SkColorSetRGB(random.Next() % 256,
+                                           random.Next() % 256,
+                                           random.Next() % 256));
+    canvas.DrawRect(picture, SkColorSetRGB(0, 0, 0));
+  }
+
+  return skia::GetTopDevice(*canvas.sk_canvas())->accessBitmap(false);
+}
+
+}  // namespace
+
+class ContentAnalysisPerfTest : public testing::Test {
+};
+
+TEST_F(ContentAnalysisPerfTest, CreateRetargetedThumbnailImage) {
+  const SkBitmap source = CreateScreenshot(gfx::Size(1280, 800));
+
+  const base::TimeTicks start = base::TimeTicks::HighResNow();
+  for (int i = 0; i < kCaptureCount; ++i) {
+    SkBitmap result = CreateRetargetedThumbnailImage(
+        source, gfx::Size(212, 132), 5.0f);
+    EXPECT_FALSE(result.empty());
+  }
+  const base::TimeDelta elapsed = base::TimeTicks::HighResNow() - start;
+
+  perf_test::PrintResult("content_analysis_retarget", "", "1280x800",
+                         elapsed.InMillisecondsF() / kCaptureCount,
+                         "ms/capture", true);
+}
+
+// Compares the row kernels with their scalar fallbacks on a 1280x800 frame.
+TEST_F(ContentAnalysisPerfTest, RowKernels) {
+  const int kWidth = 1280;
+  const int kHeight = 800;
+  SyntheticRandom random;
+  std::vector<uint8> grad_x(kWidth * kHeight);
+  std::vector<uint8> grad_y(kWidth * kHeight);
+  for (size_t i = 0; i < grad_x.size(); ++i) {
+    grad_x[i] = random.Next() & 0xff;
+    grad_y[i] = random.Next() & 0xff;
+  }
+  std::vector<uint8> magnitude(kWidth * kHeight);
+  std::vector<uint32> column_sums(kWidth);
+
+  base::TimeDelta magnitude_time[2];
+  base::TimeDelta profile_time[2];
+  unsigned checksum[2] = { 0, 0 };
+  for (int scalar = 0; scalar < 2; ++scalar) {
+    base::TimeTicks start = base::TimeTicks::HighResNow();
+    for (int i = 0; i < kKernelIterations; ++i) {
+      for (int r = 0; r < kHeight; ++r) {
+        const uint8* x = &grad_x[r * kWidth];
+        const uint8* y = &grad_y[r * kWidth];
+        uint8* out = &magnitude[r * kWidth];
+        if (scalar) {
+          checksum[scalar] += internal::GradientMagnitudeMaxScalar(
+              x, y, kWidth);
+          internal::GradientMagnitudeScalar(x, y, kWidth, 9, out);
+        } else {
+          checksum[scalar] += internal::GradientMagnitudeMax(x, y, kWidth);
+          internal::GradientMagnitude(x, y, kWidth, 9, out);
+        }
+      }
+    }
+    magnitude_time[scalar] = base::TimeTicks::HighResNow() - start;
+
+    start = base::TimeTicks::HighResNow();
+    for (int i = 0; i < kKernelIterations; ++i) {
+      std::fill(column_sums.begin(), column_sums.end(), 0);
+      for (int r = 0; r < kHeight; ++r) {
+        const uint8* row = &magnitude[r * kWidth];
+        checksum[scalar] += scalar ?
+            internal::AccumulateProfilesScalar(row, kWidth, &column_sums[0]) :
+            internal::AccumulateProfiles(row, kWidth, &column_sums[0]);
+      }
+    }
+    profile_time[scalar] = base::TimeTicks::HighResNow() - start;
+  }
+  EXPECT_EQ(checksum[0], checksum[1]);
+
+  const char* const kModifiers[] = { "", "_scalar" };
+  for (int scalar = 0; scalar < 2; ++scalar) {
+    perf_test::PrintResult("content_analysis_gradient_magnitude",
+                           kModifiers[scalar], "1280x800",
+                           magnitude_time[scalar].InMicroseconds() /
+                               static_cast<double>(kKernelIterations),
+                           "us/frame", true);
+    perf_test::PrintResult("content_analysis_profiles",
+                           kModifiers[scalar], "1280x800",
+                           profile_time[scalar].InMicroseconds() /
+                               static_cast<double>(kKernelIterations),
+                           "us/frame", true);
+  }
+}
+
+}  // namespace thumbnailing_utils
@@ -70,6 +70,15 @@ float AspectDifference(const gfx::Size& reference, const gfx::Size& candidate) {
                   static_cast<float>(reference.width()) / reference.height());
 }
 
+// Fills |pixels| with a pattern covering the whole range of values, with runs
+// of 255 to hit the largest sums.
+void FillKernelInput(int seed, std::vector<uint8>* pixels) {
+  for (size_t i = 0; i < pixels->size(); ++i) {
+    (*pixels)[i] = (i + seed) % 5 == 0 ?
+        255 : static_cast<uint8>(i * 37 + seed * 101);
+  }
+}
+
 }  // namespace
 
 namespace thumbnailing_utils {
@@ -607,6 +616,85 @@ TEST_F(ThumbnailContentAnalysisTest, ComputeDecimatedImage) {
                                     gfx::Point(0, 100)));
 }
 
+TEST_F(ThumbnailContentAnalysisTest, ComputeDecimatedImageEdgeColumns) {
+  gfx::Size image_size(64, 8);
+  gfx::Canvas canvas(image_size, 1.0f, true);
+  for (int x = 0; x < image_size.width(); ++x) {
+    canvas.FillRect(gfx::Rect(x, 0, 1, image_size.height()),
+                    SkColorSetRGB(x * 4, 255 - x * 4, 128));
+  }
+
+  // Keep the first and last columns, so that runs start and end at the edges.
+  std::vector<bool> rows(image_size.height(), true);
+  rows[3] = false;
+  std::vector<bool> columns(image_size.width(), false);
+  std::fill_n(columns.begin(), 3, true);
+  std::fill_n(columns.begin() + 10, 1, true);
+  std::fill_n(columns.begin() + 60, 4, true);
+
+  SkBitmap source =
+      skia::GetTopDevice(*canvas.sk_canvas())->accessBitmap(false);
+  SkBitmap result = ComputeDecimatedImage(source, rows, columns);
+  ASSERT_FALSE(result.empty());
+  EXPECT_EQ(8, result.width());
+  EXPECT_EQ(7, result.height());
+
+  EXPECT_TRUE(CompareImageFragments(source, result, gfx::Size(3, 3),
+                                    gfx::Point(0, 0), gfx::Point(0, 0)));
+  EXPECT_TRUE(CompareImageFragments(source, result, gfx::Size(1, 3),
+                                    gfx::Point(10, 0), gfx::Point(3, 0)));
+  EXPECT_TRUE(CompareImageFragments(source, result, gfx::Size(4, 4),
+                                    gfx::Point(60, 4), gfx::Point(4, 3)));
+}
+
+TEST_F(ThumbnailContentAnalysisTest, GradientMagnitudeKernelsMatchScalar) {
+  // Widths cover the vector loops, their scalar tails and no vector work at
+  // all. The inputs start one byte into the buffers to test unaligned loads.
+  const int kWidths[] = { 0, 1, 7, 8, 15, 16, 17, 33, 100, 1283 };
+  for (size_t i = 0; i < arraysize(kWidths); ++i) {
+    const int width = kWidths[i];
+    std::vector<uint8> grad_x(width + 1);
+    std::vector<uint8> grad_y(width + 1);
+    FillKernelInput(i, &grad_x);
+    FillKernelInput(i + 2, &grad_y);
+
+    EXPECT_EQ(internal::GradientMagnitudeMaxScalar(
+                  &grad_x[1], &grad_y[1], width),
+              internal::GradientMagnitudeMax(&grad_x[1], &grad_y[1], width))
+        << "width " << width;
+
+    for (int bit_shift = 0; bit_shift <= 10; ++bit_shift) {
+      std::vector<uint8> expected(width + 1, 0);
+      std::vector<uint8> actual(width + 1, 0);
+      internal::GradientMagnitudeScalar(
+          &grad_x[1], &grad_y[1], width, bit_shift, &expected[1]);
+      internal::GradientMagnitude(
+          &grad_x[1], &grad_y[1], width, bit_shift, &actual[1]);
+      EXPECT_EQ(expected, actual)
+          << "width " << width << ", bit_shift " << bit_shift;
+    }
+  }
+}
+
+TEST_F(ThumbnailContentAnalysisTest, AccumulateProfilesMatchesScalar) {
+  const int kWidths[] = { 0, 1, 7, 8, 15, 16, 17, 33, 100, 1283 };
+  for (size_t i = 0; i < arraysize(kWidths); ++i) {
+    const int width = kWidths[i];
+    std::vector<uint8> row(width + 1);
+    // Start from non-zero sums, as after the first row of an image.
+    std::vector<uint32> expected(width + 1, 1000);
+    std::vector<uint32> actual(width + 1, 1000);
+    for (int r = 0; r < 20; ++r) {
+      FillKernelInput(i + r, &row);
+      EXPECT_EQ(internal::AccumulateProfilesScalar(
+                    &row[1], width, &expected[1]),
+                internal::AccumulateProfiles(&row[1], width, &actual[1]))
+          << "width " << width;
+    }
+    EXPECT_EQ(expected, actual) << "width " << width;
+  }
+}
+
 TEST_F(ThumbnailContentAnalysisTest, CreateRetargetedThumbnailImage) {
   gfx::Size image_size(1200, 1300);
   gfx::Canvas canvas(image_size, 1.0f, true);
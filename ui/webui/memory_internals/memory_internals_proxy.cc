@@ -14,6 +14,9 @@
 #include "base/values.h"
 #include "chrome/browser/browser_process.h"
 #include "chrome/browser/chrome_notification_types.h"
+#include "chrome/browser/favicon/favicon_image_cache.h"
+#include "chrome/browser/favicon/favicon_service.h"
+#include "chrome/browser/favicon/favicon_service_factory.h"
 #include "chrome/browser/memory_details.h"
 #include "chrome/browser/prerender/prerender_manager.h"
 #include "chrome/browser/prerender/prerender_manager_factory.h"
@@ -326,7 +329,47 @@ void MemoryInternalsProxy::ConvertTabsInformation(
   }
 }
 
+void MemoryInternalsProxy::ConvertFaviconCacheInformation(
+    base::ListValue* favicon_caches) {
+  static const char* const kBucketNames[] = { "Small", "Large" };
+  COMPILE_ASSERT(arraysize(kBucketNames) == FaviconImageCache::BUCKET_COUNT,
+                 bucket_names_mismatch);
+
+  std::vector<Profile*> profiles(
+      g_browser_process->profile_manager()->GetLoadedProfiles());
+  for (size_t i = 0; i < profiles.size(); ++i) {
+    FaviconService* favicon_service = FaviconServiceFactory::GetForProfile(
+        profiles[i], Profile::IMPLICIT_ACCESS);
+    if (!favicon_service)
+      continue;
+    for (int j = 0; j < FaviconImageCache::BUCKET_COUNT; ++j) {
+      const FaviconImageCache::Stats& stats =
+          favicon_service->image_cache().stats(
+              static_cast<FaviconImageCache::Bucket>(j));
+      base::DictionaryValue* cache = new base::DictionaryValue();
+      favicon_caches->Append(cache);
+      cache->SetString("profile",
+                       profiles[i]->GetPath().BaseName().AsUTF8Unsafe());
+      cache->SetString("bucket", kBucketNames[j]);
+      cache->SetInteger("hits", stats.hits);
+      cache->SetInteger("misses", stats.misses);
+      const size_t lookups = stats.hits + stats.misses;
+      cache->SetDouble("hit_rate",
+                       lookups ? 100.0 * stats.hits / lookups : 0.0);
+      cache->SetInteger("evictions", stats.evictions);
+      cache->SetInteger("entries", stats.entry_count);
+      // Convert units from Bytes to KiB.
+      cache->SetInteger("memory", stats.bytes / 1024);
+      cache->SetInteger("memory_limit", stats.max_bytes / 1024);
+    }
+  }
+}
+
 void MemoryInternalsProxy::FinishCollection() {
+  base::ListValue* favicon_caches = new base::ListValue();
+  information_->Set("favicon_caches", favicon_caches);
+  ConvertFaviconCacheInformation(favicon_caches);
+
   information_->SetInteger("uptime", base::SysInfo::Uptime());
   information_->SetString("os", base::SysInfo::OperatingSystemName());
   information_->SetString("os_version",
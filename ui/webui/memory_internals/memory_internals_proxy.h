@@ -66,6 +66,10 @@ class MemoryInternalsProxy
       const std::set<content::WebContents*>& web_contents,
       base::ListValue* processes);
 
+  // Appends the statistics of the favicon image cache of each loaded profile
+  // to |favicon_caches|.
+  void ConvertFaviconCacheInformation(base::ListValue* favicon_caches);
+
   // Requests all renderer processes to get detailed memory information.
   void RequestRendererDetails();
 
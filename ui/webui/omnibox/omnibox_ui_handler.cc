@@ -19,6 +19,7 @@
 #include "chrome/browser/autocomplete/autocomplete_provider.h"
 #include "chrome/browser/history/history_service.h"
 #include "chrome/browser/history/history_service_factory.h"
+#include "chrome/browser/history/in_memory_url_index.h"
 #include "chrome/browser/history/url_database.h"
 #include "chrome/browser/search/search.h"
 #include "chrome/browser/search_engines/template_url.h"
@@ -139,6 +140,7 @@ void OmniboxUIHandler::OnResultChanged(bool default_match_changed) {
   result->results_by_provider =
       mojo::Array<AutocompleteResultsForProviderMojoPtr>::From(
           *controller_->providers());
+  result->hqp_intersection_cache_stats = GetHQPIntersectionCacheStats();
   client()->HandleNewAutocompleteResult(result.Pass());
 }
 
@@ -156,6 +158,26 @@ bool OmniboxUIHandler::LookupIsTypedHost(const base::string16& host,
   return true;
 }
 
+HQPIntersectionCacheStatsMojoPtr
+OmniboxUIHandler::GetHQPIntersectionCacheStats() const {
+  HistoryService* const history_service =
+      HistoryServiceFactory::GetForProfile(profile_,
+                                           Profile::EXPLICIT_ACCESS);
+  if (!history_service || !history_service->InMemoryIndex())
+    return HQPIntersectionCacheStatsMojoPtr();
+  history::URLIndexIntersectionCache::Stats stats;
+  if (!history_service->InMemoryIndex()->GetIntersectionCacheStats(&stats))
+    return HQPIntersectionCacheStatsMojoPtr();
+  HQPIntersectionCacheStatsMojoPtr result(HQPIntersectionCacheStatsMojo::New());
+  result->hits = static_cast<int32>(stats.hits);
+  result->misses = static_cast<int32>(stats.misses);
+  result->stale_hits = static_cast<int32>(stats.stale_hits);
+  result->entry_count = static_cast<int32>(stats.entry_count);
+  result->bytes = static_cast<int32>(stats.bytes);
+  result->max_bytes = static_cast<int32>(stats.max_bytes);
+  return result.Pass();
+}
+
 void OmniboxUIHandler::StartOmniboxQuery(const mojo::String& input_string,
                                          int32_t cursor_position,
                                          bool prevent_inline_autocomplete,
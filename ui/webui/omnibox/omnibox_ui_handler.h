@@ -50,6 +50,10 @@ class OmniboxUIHandler : public AutocompleteControllerDelegate,
   // value of |is_typed_host| is set appropriately.
   bool LookupIsTypedHost(const base::string16& host, bool* is_typed_host) const;
 
+  // Returns the HistoryQuick provider's intersection cache counters, or null
+  // if the index is unavailable or the cache is not enabled.
+  HQPIntersectionCacheStatsMojoPtr GetHQPIntersectionCacheStats() const;
+
   // Re-initializes the AutocompleteController in preparation for the
   // next query.
   void ResetController();